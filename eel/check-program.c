@@ -43,6 +43,12 @@ main (int   argc,
     gtk_init (&argc,
               &argv);
 
+    if (argc > 1 && g_strcmp0 (argv[1], "--benchmark") == 0)
+    {
+        eel_benchmark_graphic_effects ();
+        return EXIT_SUCCESS;
+    }
+
     /* Run the checks for eel twice. */
 
     eel_run_lib_self_checks ();
@@ -1617,9 +1617,14 @@ eel_canvas_group_draw (EelCanvasItem  *item,
     EelCanvasGroup *group;
     GList *list;
     EelCanvasItem *child = NULL;
+    cairo_rectangle_int_t extents;
 
     group = EEL_CANVAS_GROUP (item);
 
+    /* With thousands of icons and a single one to repaint, most children
+     * are left out by comparing them with the extents of the region alone */
+    cairo_region_get_extents (region, &extents);
+
     for (list = group->item_list; list; list = list->next)
     {
         child = list->data;
@@ -1629,6 +1634,12 @@ eel_canvas_group_draw (EelCanvasItem  *item,
         {
             GdkRectangle child_rect;
 
+            if (child->x2 < extents.x || child->x1 >= extents.x + extents.width ||
+                child->y2 < extents.y || child->y1 >= extents.y + extents.height)
+            {
+                continue;
+            }
+
             child_rect.x = child->x1;
             child_rect.y = child->y1;
             child_rect.width = child->x2 - child->x1 + 1;
@@ -2234,6 +2245,8 @@ shutdown_transients (EelCanvas *canvas)
     }
 
     remove_idle (canvas);
+
+    g_clear_pointer (&canvas->damage, cairo_region_destroy);
 }
 
 /* Destroy handler for EelCanvas */
@@ -3202,6 +3215,7 @@ eel_canvas_draw (GtkWidget *widget,
 
         canvas->need_update = FALSE;
     }
+    flush_damage (canvas);
 
     if (canvas->root->flags & EEL_CANVAS_ITEM_MAPPED)
     {
@@ -3220,6 +3234,24 @@ eel_canvas_draw (GtkWidget *widget,
     return FALSE;
 }
 
+/* Invalidates the areas the items asked to be repainted */
+static void
+flush_damage (EelCanvas *canvas)
+{
+    if (canvas->damage == NULL)
+    {
+        return;
+    }
+
+    if (gtk_widget_is_drawable (GTK_WIDGET (canvas)))
+    {
+        gdk_window_invalidate_region (gtk_layout_get_bin_window (GTK_LAYOUT (canvas)),
+                                      canvas->damage, FALSE);
+    }
+
+    g_clear_pointer (&canvas->damage, cairo_region_destroy);
+}
+
 static void
 do_update (EelCanvas *canvas)
 {
@@ -3257,6 +3289,8 @@ update_again:
     {
         goto update_again;
     }
+
+    flush_damage (canvas);
 }
 
 /* Idle handler for the canvas.  It deals with pending updates and redraws. */
@@ -3584,8 +3618,21 @@ eel_canvas_request_redraw (EelCanvas *canvas,
     bbox.width = x2 - x1;
     bbox.height = y2 - y1;
 
-    gdk_window_invalidate_rect (gtk_layout_get_bin_window (GTK_LAYOUT (canvas)),
-                                &bbox, FALSE);
+    /* Many items redraw themselves in a single update, a row of thumbnails
+     * arriving for instance, so they are only invalidated once it is over */
+    if (canvas->damage == NULL)
+    {
+        canvas->damage = cairo_region_create_rectangle (&bbox);
+    }
+    else if (cairo_region_contains_rectangle (canvas->damage, &bbox) != CAIRO_REGION_OVERLAP_IN)
+    {
+        cairo_region_union_rectangle (canvas->damage, &bbox);
+    }
+
+    if (!canvas->doing_update)
+    {
+        add_idle (canvas);
+    }
 }
 
 /**
@@ -354,6 +354,10 @@ struct _EelCanvas {
 	/* Idle handler ID */
 	guint idle_id;
 
+	/* The areas to repaint, invalidated together once the pending updates
+	 * are done, NULL when there are none */
+	cairo_region_t *damage;
+
 	/* Signal handler ID for destruction of the root item */
 	gulong root_destroy_id;
 
@@ -25,10 +25,20 @@
 
 #include "eel-graphic-effects.h"
 #include "eel-glib-extensions.h"
+#include "eel-lib-self-check-functions.h"
 
 #include <math.h>
 #include <string.h>
 
+/* The row kernels take 16 bytes at a time where the target has vectors
+ * of that width as a baseline, and finish rows byte by byte.
+ */
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /* shared utility to create a new pixbuf from the passed-in one */
 
 static GdkPixbuf *
@@ -51,26 +61,162 @@ create_new_pixbuf (GdkPixbuf *src)
 
 const int HOVER_COMPONENT_ADDITION = 15;
 
-static guchar
-lighten_component (guchar cur_value)
+/* Per-byte patterns over 16 bytes, for rows of 3 or 4 channel pixels.
+ * Rows start at a pixel, and 16 bytes hold whole 4 channel pixels, so
+ * byte i of a row takes byte i % 16 of a pattern.
+ */
+typedef struct
+{
+    guchar addition[16];
+    guchar color_mask[16];
+} RowPatterns;
+
+static void
+init_row_patterns (RowPatterns *patterns,
+                   gboolean     has_alpha)
 {
-    int new_value = cur_value;
-    new_value = cur_value + HOVER_COMPONENT_ADDITION;
-    if (new_value > 255)
+    for (int i = 0; i < 16; i++)
     {
-        new_value = 255;
+        gboolean is_alpha = has_alpha && i % 4 == 3;
+
+        patterns->addition[i] = is_alpha ? 0 : HOVER_COMPONENT_ADDITION;
+        patterns->color_mask[i] = is_alpha ? 0 : 0xff;
+    }
+}
+
+static void
+lighten_row_scalar (guchar            *dest,
+                    const guchar      *src,
+                    gsize              start,
+                    gsize              n_bytes,
+                    const RowPatterns *patterns)
+{
+    for (gsize i = start; i < n_bytes; i++)
+    {
+        dest[i] = MIN (src[i] + patterns->addition[i % 16], 255);
+    }
+}
+
+static void
+lighten_row (guchar            *dest,
+             const guchar      *src,
+             gsize              n_bytes,
+             const RowPatterns *patterns)
+{
+    gsize i = 0;
+
+#if defined (__SSE2__)
+    __m128i addition = _mm_loadu_si128 ((const __m128i *) patterns->addition);
+
+    for (; i + 16 <= n_bytes; i += 16)
+    {
+        __m128i pixels = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_adds_epu8 (pixels, addition));
+    }
+#elif defined (__ARM_NEON)
+    uint8x16_t addition = vld1q_u8 (patterns->addition);
+
+    for (; i + 16 <= n_bytes; i += 16)
+    {
+        vst1q_u8 (dest + i, vqaddq_u8 (vld1q_u8 (src + i), addition));
+    }
+#endif
+
+    lighten_row_scalar (dest, src, i, n_bytes, patterns);
+}
+
+/* Multiplies the color bytes of @dest by those of @src, and takes the
+ * alpha bytes of @src */
+static void
+colorize_row_scalar (guchar            *dest,
+                     const guchar      *src,
+                     gsize              start,
+                     gsize              n_bytes,
+                     const RowPatterns *patterns)
+{
+    for (gsize i = start; i < n_bytes; i++)
+    {
+        dest[i] = patterns->color_mask[i % 16] ? (src[i] * dest[i]) >> 8 : src[i];
+    }
+}
+
+static void
+colorize_row (guchar            *dest,
+              const guchar      *src,
+              gsize              n_bytes,
+              const RowPatterns *patterns)
+{
+    gsize i = 0;
+
+#if defined (__SSE2__)
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i mask = _mm_loadu_si128 ((const __m128i *) patterns->color_mask);
+
+    for (; i + 16 <= n_bytes; i += 16)
+    {
+        __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+        __m128i d = _mm_loadu_si128 ((const __m128i *) (dest + i));
+        __m128i low, high, product;
+
+        low = _mm_srli_epi16 (_mm_mullo_epi16 (_mm_unpacklo_epi8 (s, zero),
+                                               _mm_unpacklo_epi8 (d, zero)), 8);
+        high = _mm_srli_epi16 (_mm_mullo_epi16 (_mm_unpackhi_epi8 (s, zero),
+                                                _mm_unpackhi_epi8 (d, zero)), 8);
+        product = _mm_packus_epi16 (low, high);
+
+        _mm_storeu_si128 ((__m128i *) (dest + i),
+                          _mm_or_si128 (_mm_and_si128 (mask, product),
+                                        _mm_andnot_si128 (mask, s)));
+    }
+#elif defined (__ARM_NEON)
+    uint8x16_t mask = vld1q_u8 (patterns->color_mask);
+
+    for (; i + 16 <= n_bytes; i += 16)
+    {
+        uint8x16_t s = vld1q_u8 (src + i);
+        uint8x16_t d = vld1q_u8 (dest + i);
+        uint16x8_t low = vmull_u8 (vget_low_u8 (s), vget_low_u8 (d));
+        uint16x8_t high = vmull_u8 (vget_high_u8 (s), vget_high_u8 (d));
+        uint8x16_t product = vcombine_u8 (vshrn_n_u16 (low, 8), vshrn_n_u16 (high, 8));
+
+        vst1q_u8 (dest + i, vbslq_u8 (mask, product, s));
+    }
+#endif
+
+    colorize_row_scalar (dest, src, i, n_bytes, patterns);
+}
+
+static void
+lighten_pixbuf (GdkPixbuf *src,
+                GdkPixbuf *dest)
+{
+    RowPatterns patterns;
+    int width, height, n_channels, src_row_stride, dst_row_stride;
+    guchar *target_pixels, *original_pixels;
+
+    init_row_patterns (&patterns, gdk_pixbuf_get_has_alpha (src));
+
+    n_channels = gdk_pixbuf_get_n_channels (src);
+    width = gdk_pixbuf_get_width (src);
+    height = gdk_pixbuf_get_height (src);
+    dst_row_stride = gdk_pixbuf_get_rowstride (dest);
+    src_row_stride = gdk_pixbuf_get_rowstride (src);
+    target_pixels = gdk_pixbuf_get_pixels (dest);
+    original_pixels = gdk_pixbuf_get_pixels (src);
+
+    for (int i = 0; i < height; i++)
+    {
+        lighten_row (target_pixels + i * dst_row_stride,
+                     original_pixels + i * src_row_stride,
+                     (gsize) width * n_channels, &patterns);
     }
-    return (guchar) new_value;
 }
 
 GdkPixbuf *
 eel_create_spotlight_pixbuf (GdkPixbuf *src)
 {
     GdkPixbuf *dest;
-    int i, j;
-    int width, height, has_alpha, src_row_stride, dst_row_stride;
-    guchar *target_pixels, *original_pixels;
-    guchar *pixsrc, *pixdest;
 
     g_return_val_if_fail (gdk_pixbuf_get_colorspace (src) == GDK_COLORSPACE_RGB, NULL);
     g_return_val_if_fail ((!gdk_pixbuf_get_has_alpha (src)
@@ -80,30 +226,8 @@ eel_create_spotlight_pixbuf (GdkPixbuf *src)
     g_return_val_if_fail (gdk_pixbuf_get_bits_per_sample (src) == 8, NULL);
 
     dest = create_new_pixbuf (src);
+    lighten_pixbuf (src, dest);
 
-    has_alpha = gdk_pixbuf_get_has_alpha (src);
-    width = gdk_pixbuf_get_width (src);
-    height = gdk_pixbuf_get_height (src);
-    dst_row_stride = gdk_pixbuf_get_rowstride (dest);
-    src_row_stride = gdk_pixbuf_get_rowstride (src);
-    target_pixels = gdk_pixbuf_get_pixels (dest);
-    original_pixels = gdk_pixbuf_get_pixels (src);
-
-    for (i = 0; i < height; i++)
-    {
-        pixdest = target_pixels + i * dst_row_stride;
-        pixsrc = original_pixels + i * src_row_stride;
-        for (j = 0; j < width; j++)
-        {
-            *pixdest++ = lighten_component (*pixsrc++);
-            *pixdest++ = lighten_component (*pixsrc++);
-            *pixdest++ = lighten_component (*pixsrc++);
-            if (has_alpha)
-            {
-                *pixdest++ = *pixsrc++;
-            }
-        }
-    }
     return dest;
 }
 
@@ -113,12 +237,10 @@ GdkPixbuf *
 eel_create_colorized_pixbuf (GdkPixbuf *src,
                              GdkPixbuf *dest)
 {
-    int i, j;
-    int width, height, has_alpha, src_row_stride, dst_row_stride;
+    RowPatterns patterns;
+    int width, height, n_channels, src_row_stride, dst_row_stride;
     guchar *target_pixels;
     guchar *original_pixels;
-    guchar *pixsrc;
-    guchar *pixdest;
 
     g_return_val_if_fail (gdk_pixbuf_get_colorspace (src) == GDK_COLORSPACE_RGB, NULL);
     g_return_val_if_fail (gdk_pixbuf_get_colorspace (dest) == GDK_COLORSPACE_RGB, NULL);
@@ -135,7 +257,9 @@ eel_create_colorized_pixbuf (GdkPixbuf *src,
     g_return_val_if_fail (gdk_pixbuf_get_bits_per_sample (src) == 8, NULL);
     g_return_val_if_fail (gdk_pixbuf_get_bits_per_sample (dest) == 8, NULL);
 
-    has_alpha = gdk_pixbuf_get_has_alpha (src);
+    init_row_patterns (&patterns, gdk_pixbuf_get_has_alpha (src));
+
+    n_channels = gdk_pixbuf_get_n_channels (src);
     width = gdk_pixbuf_get_width (src);
     height = gdk_pixbuf_get_height (src);
     src_row_stride = gdk_pixbuf_get_rowstride (src);
@@ -143,23 +267,163 @@ eel_create_colorized_pixbuf (GdkPixbuf *src,
     target_pixels = gdk_pixbuf_get_pixels (dest);
     original_pixels = gdk_pixbuf_get_pixels (src);
 
-    for (i = 0; i < height; i++)
+    for (int i = 0; i < height; i++)
+    {
+        colorize_row (target_pixels + i * dst_row_stride,
+                      original_pixels + i * src_row_stride,
+                      (gsize) width * n_channels, &patterns);
+    }
+    return dest;
+}
+
+#if !defined (EEL_OMIT_SELF_CHECK)
+
+static GdkPixbuf *
+create_random_pixbuf (gboolean has_alpha,
+                      int      width,
+                      int      height,
+                      GRand   *rand)
+{
+    GdkPixbuf *pixbuf;
+    gsize n_bytes;
+
+    pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+    n_bytes = (gsize) width * gdk_pixbuf_get_n_channels (pixbuf);
+    for (int i = 0; i < height; i++)
     {
-        pixdest = target_pixels + i * dst_row_stride;
-        pixsrc = original_pixels + i * src_row_stride;
-        for (j = 0; j < width; j++)
+        guchar *row = gdk_pixbuf_get_pixels (pixbuf) + i * gdk_pixbuf_get_rowstride (pixbuf);
+
+        for (gsize j = 0; j < n_bytes; j++)
         {
-            *pixdest = ((*pixsrc++) * (*pixdest)) >> 8;
-            pixdest++;
-            *pixdest = ((*pixsrc++) * (*pixdest)) >> 8;
-            pixdest++;
-            *pixdest = ((*pixsrc++) * (*pixdest)) >> 8;
-            pixdest++;
-            if (has_alpha)
-            {
-                *pixdest++ = *pixsrc++;
-            }
+            row[j] = g_rand_int_range (rand, 0, 256);
         }
     }
-    return dest;
+
+    return pixbuf;
+}
+
+/* Whether the rows of @dest came out of the vector kernels as they would
+ * byte by byte, from @src and, when colorizing, @original_dest */
+static gboolean
+rows_match_scalar (GdkPixbuf *src,
+                   GdkPixbuf *original_dest,
+                   GdkPixbuf *dest,
+                   gboolean   colorize)
+{
+    RowPatterns patterns;
+    gsize n_bytes;
+    g_autofree guchar *expected = NULL;
+
+    init_row_patterns (&patterns, gdk_pixbuf_get_has_alpha (src));
+    n_bytes = (gsize) gdk_pixbuf_get_width (src) * gdk_pixbuf_get_n_channels (src);
+    expected = g_malloc (n_bytes);
+
+    for (int i = 0; i < gdk_pixbuf_get_height (src); i++)
+    {
+        const guchar *src_row = gdk_pixbuf_get_pixels (src) + i * gdk_pixbuf_get_rowstride (src);
+        const guchar *dest_row = gdk_pixbuf_get_pixels (dest) + i * gdk_pixbuf_get_rowstride (dest);
+
+        if (colorize)
+        {
+            memcpy (expected,
+                    gdk_pixbuf_get_pixels (original_dest) + i * gdk_pixbuf_get_rowstride (original_dest),
+                    n_bytes);
+            colorize_row_scalar (expected, src_row, 0, n_bytes, &patterns);
+        }
+        else
+        {
+            lighten_row_scalar (expected, src_row, 0, n_bytes, &patterns);
+        }
+
+        if (memcmp (expected, dest_row, n_bytes) != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void
+eel_self_check_graphic_effects (void)
+{
+    g_autoptr (GRand) rand = g_rand_new_with_seed (42);
+
+    /* Widths on both sides of the 16 byte vectors, with and without alpha */
+    for (int width = 1; width <= 21; width++)
+    {
+        for (int has_alpha = 0; has_alpha <= 1; has_alpha++)
+        {
+            g_autoptr (GdkPixbuf) src = create_random_pixbuf (has_alpha, width, 3, rand);
+            g_autoptr (GdkPixbuf) colors = create_random_pixbuf (has_alpha, width, 3, rand);
+            g_autoptr (GdkPixbuf) spotlight = NULL;
+            g_autoptr (GdkPixbuf) colorized = NULL;
+
+            spotlight = eel_create_spotlight_pixbuf (src);
+            EEL_CHECK_BOOLEAN_RESULT (rows_match_scalar (src, NULL, spotlight, FALSE), TRUE);
+
+            colorized = gdk_pixbuf_copy (colors);
+            eel_create_colorized_pixbuf (src, colorized);
+            EEL_CHECK_BOOLEAN_RESULT (rows_match_scalar (src, colors, colorized, TRUE), TRUE);
+        }
+    }
+}
+
+void
+eel_benchmark_graphic_effects (void)
+{
+    const int iterations = 200;
+    g_autoptr (GRand) rand = g_rand_new_with_seed (42);
+    g_autoptr (GdkPixbuf) src = create_random_pixbuf (TRUE, 256, 256, rand);
+    g_autoptr (GdkPixbuf) dest = create_random_pixbuf (TRUE, 256, 256, rand);
+    RowPatterns patterns;
+    gsize n_bytes;
+    gint64 start;
+
+    init_row_patterns (&patterns, TRUE);
+    n_bytes = 256 * 4;
+
+    start = g_get_monotonic_time ();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            lighten_row_scalar (gdk_pixbuf_get_pixels (dest) + i * gdk_pixbuf_get_rowstride (dest),
+                                gdk_pixbuf_get_pixels (src) + i * gdk_pixbuf_get_rowstride (src),
+                                0, n_bytes, &patterns);
+        }
+    }
+    g_print ("spotlight 256x256, scalar: %.1f µs\n",
+             (double) (g_get_monotonic_time () - start) / iterations);
+
+    start = g_get_monotonic_time ();
+    for (int n = 0; n < iterations; n++)
+    {
+        lighten_pixbuf (src, dest);
+    }
+    g_print ("spotlight 256x256, vector: %.1f µs\n",
+             (double) (g_get_monotonic_time () - start) / iterations);
+
+    start = g_get_monotonic_time ();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            colorize_row_scalar (gdk_pixbuf_get_pixels (dest) + i * gdk_pixbuf_get_rowstride (dest),
+                                 gdk_pixbuf_get_pixels (src) + i * gdk_pixbuf_get_rowstride (src),
+                                 0, n_bytes, &patterns);
+        }
+    }
+    g_print ("colorize 256x256, scalar: %.1f µs\n",
+             (double) (g_get_monotonic_time () - start) / iterations);
+
+    start = g_get_monotonic_time ();
+    for (int n = 0; n < iterations; n++)
+    {
+        eel_create_colorized_pixbuf (src, dest);
+    }
+    g_print ("colorize 256x256, vector: %.1f µs\n",
+             (double) (g_get_monotonic_time () - start) / iterations);
 }
+
+#endif /* !EEL_OMIT_SELF_CHECK */
@@ -25,6 +25,8 @@
 #include "eel-self-checks.h"
 
 void eel_run_lib_self_checks (void);
+/* Times the pixel effects kernels, for check-eel --benchmark */
+void eel_benchmark_graphic_effects (void);
 
 /* Putting the prototypes for these self-check functions in each
    header file for the files they are defined in would make compiling
@@ -38,6 +40,7 @@ void eel_run_lib_self_checks (void);
 */
 
 #define EEL_LIB_FOR_EACH_SELF_CHECK_FUNCTION(macro) \
+	macro (eel_self_check_graphic_effects) \
 	macro (eel_self_check_string) \
 /* Add new self-check functions to the list above this line. */
 
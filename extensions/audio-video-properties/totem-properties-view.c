@@ -34,9 +34,26 @@ struct TotemPropertiesViewPriv {
 	GtkWidget *label;
 	GtkWidget *vbox;
 	BaconVideoWidgetProperties *props;
-	GstDiscoverer *disco;
+	GCancellable *cancellable;
+	char *location;
+	char *cache_key;
 };
 
+/* One discoverer for all the pages, which probes the files one after the
+ * other, and the results of the last few, by URI and modification time,
+ * so that a page on a file probed already shows up right away. */
+#define DISCOVERER_CACHE_SIZE 16
+
+static GstDiscoverer *discoverer = NULL;
+typedef struct {
+	char *cache_key;
+	GList *views; /* of TotemPropertiesView */
+} PendingDiscovery;
+
+static GHashTable *pending_discoveries = NULL; /* URI -> PendingDiscovery */
+static GHashTable *discoverer_cache = NULL; /* cache key -> GstDiscovererInfo */
+static GQueue discoverer_cache_keys = G_QUEUE_INIT; /* oldest first */
+
 static GObjectClass *parent_class = NULL;
 static void totem_properties_view_finalize (GObject *object);
 
@@ -247,10 +264,8 @@ update_audio (TotemPropertiesView    *props,
 }
 
 static void
-discovered_cb (GstDiscoverer       *discoverer,
-	       GstDiscovererInfo   *info,
-	       GError              *error,
-	       TotemPropertiesView *props)
+update_from_info (TotemPropertiesView *props,
+		  GstDiscovererInfo   *info)
 {
 	GList *video_streams, *audio_streams;
 	const GstTagList *taglist;
@@ -259,13 +274,6 @@ discovered_cb (GstDiscoverer       *discoverer,
         GstClockTime duration;
         GstDiscovererStreamInfo *sinfo;
 
-	if (error) {
-		g_warning ("Couldn't get information about '%s': %s",
-			   gst_discoverer_info_get_uri (info),
-			   error->message);
-		return;
-	}
-
 	video_streams = gst_discoverer_info_get_video_streams (info);
 	has_video = (video_streams != NULL);
 	audio_streams = gst_discoverer_info_get_audio_streams (info);
@@ -309,10 +317,164 @@ discovered_cb (GstDiscoverer       *discoverer,
 }
 
 static void
-totem_properties_view_init (TotemPropertiesView *props)
+cache_info (const char        *cache_key,
+	    GstDiscovererInfo *info)
+{
+	char *key;
+
+	if (discoverer_cache == NULL)
+		discoverer_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							  g_free, g_object_unref);
+
+	if (g_hash_table_contains (discoverer_cache, cache_key))
+		return;
+
+	key = g_strdup (cache_key);
+	g_hash_table_insert (discoverer_cache, key, g_object_ref (info));
+	g_queue_push_tail (&discoverer_cache_keys, key);
+
+	while (g_queue_get_length (&discoverer_cache_keys) > DISCOVERER_CACHE_SIZE)
+		g_hash_table_remove (discoverer_cache,
+				     g_queue_pop_head (&discoverer_cache_keys));
+}
+
+static void
+pending_discovery_free (PendingDiscovery *pending)
+{
+	g_free (pending->cache_key);
+	g_list_free (pending->views);
+	g_free (pending);
+}
+
+static void
+discovered_cb (GstDiscoverer       *disco,
+	       GstDiscovererInfo   *info,
+	       GError              *error,
+	       gpointer             user_data)
+{
+	const char *uri;
+	PendingDiscovery *pending;
+	GList *l;
+
+	uri = gst_discoverer_info_get_uri (info);
+	pending = g_hash_table_lookup (pending_discoveries, uri);
+	if (pending == NULL)
+		return;
+
+	if (error) {
+		g_warning ("Couldn't get information about '%s': %s",
+			   uri, error->message);
+	} else {
+		/* Even with no page left waiting, for the next one */
+		cache_info (pending->cache_key, info);
+
+		for (l = pending->views; l != NULL; l = l->next)
+			update_from_info (l->data, info);
+	}
+
+	g_hash_table_remove (pending_discoveries, uri);
+}
+
+static gboolean
+ensure_discoverer (void)
 {
 	GError *err = NULL;
 
+	if (discoverer != NULL)
+		return TRUE;
+
+	discoverer = gst_discoverer_new (GST_SECOND * 60, &err);
+	if (discoverer == NULL) {
+		g_warning ("Could not create discoverer object: %s", err->message);
+		g_error_free (err);
+		return FALSE;
+	}
+	g_signal_connect (discoverer, "discovered",
+			  G_CALLBACK (discovered_cb), NULL);
+	gst_discoverer_start (discoverer);
+
+	pending_discoveries = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     g_free,
+						     (GDestroyNotify) pending_discovery_free);
+
+	return TRUE;
+}
+
+static void
+remove_pending_view (TotemPropertiesView *props)
+{
+	PendingDiscovery *pending;
+
+	if (pending_discoveries == NULL || props->priv->location == NULL)
+		return;
+
+	/* The discovery goes on, for the other pages or the next one */
+	pending = g_hash_table_lookup (pending_discoveries, props->priv->location);
+	if (pending != NULL)
+		pending->views = g_list_remove (pending->views, props);
+}
+
+static void
+query_mtime_cb (GObject      *source_object,
+		GAsyncResult *res,
+		gpointer      user_data)
+{
+	TotemPropertiesView *props;
+	GFileInfo *file_info;
+	GError *err = NULL;
+	guint64 mtime;
+	GstDiscovererInfo *info;
+	PendingDiscovery *pending;
+
+	file_info = g_file_query_info_finish (G_FILE (source_object), res, &err);
+	if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (err);
+		return;
+	}
+	g_clear_error (&err);
+
+	props = TOTEM_PROPERTIES_VIEW (user_data);
+
+	mtime = 0;
+	if (file_info != NULL) {
+		mtime = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		g_object_unref (file_info);
+	}
+
+	g_free (props->priv->cache_key);
+	props->priv->cache_key = g_strdup_printf ("%" G_GUINT64_FORMAT " %s",
+						  mtime, props->priv->location);
+
+	info = discoverer_cache != NULL ?
+	       g_hash_table_lookup (discoverer_cache, props->priv->cache_key) : NULL;
+	if (info != NULL) {
+		update_from_info (props, info);
+		return;
+	}
+
+	if (!ensure_discoverer ())
+		return;
+
+	/* Only probed once for all the pages waiting on it */
+	pending = g_hash_table_lookup (pending_discoveries, props->priv->location);
+	if (pending == NULL) {
+		if (gst_discoverer_discover_uri_async (discoverer, props->priv->location) == FALSE) {
+			g_warning ("Couldn't add %s to list", props->priv->location);
+			return;
+		}
+
+		pending = g_new0 (PendingDiscovery, 1);
+		pending->cache_key = g_strdup (props->priv->cache_key);
+		g_hash_table_insert (pending_discoveries,
+				     g_strdup (props->priv->location), pending);
+	}
+
+	pending->views = g_list_prepend (pending->views, props);
+}
+
+static void
+totem_properties_view_init (TotemPropertiesView *props)
+{
 	props->priv = g_new0 (TotemPropertiesViewPriv, 1);
 
 	props->priv->vbox = bacon_video_widget_properties_new ();
@@ -320,15 +482,6 @@ totem_properties_view_init (TotemPropertiesView *props)
 	gtk_widget_show (GTK_WIDGET (props));
 
 	props->priv->props = BACON_VIDEO_WIDGET_PROPERTIES (props->priv->vbox);
-
-	props->priv->disco = gst_discoverer_new (GST_SECOND * 60, &err);
-	if (props->priv->disco == NULL) {
-		g_warning ("Could not create discoverer object: %s", err->message);
-		g_error_free (err);
-		return;
-	}
-	g_signal_connect (props->priv->disco, "discovered",
-			  G_CALLBACK (discovered_cb), props);
 }
 
 static void
@@ -339,13 +492,13 @@ totem_properties_view_finalize (GObject *object)
 	props = TOTEM_PROPERTIES_VIEW (object);
 
 	if (props->priv != NULL) {
-		if (props->priv->disco) {
-			g_signal_handlers_disconnect_by_func (props->priv->disco,
-							      discovered_cb,
-							      props);
-			gst_discoverer_stop (props->priv->disco);
-			g_clear_object (&props->priv->disco);
+		remove_pending_view (props);
+		if (props->priv->cancellable) {
+			g_cancellable_cancel (props->priv->cancellable);
+			g_clear_object (&props->priv->cancellable);
 		}
+		g_free (props->priv->location);
+		g_free (props->priv->cache_key);
 		g_clear_object (&props->priv->label);
 		g_free (props->priv);
 	}
@@ -358,20 +511,33 @@ static void
 totem_properties_view_set_location (TotemPropertiesView *props,
 				    const char          *location)
 {
+	GFile *file;
+
 	g_assert (TOTEM_IS_PROPERTIES_VIEW (props));
 
-	if (props->priv->disco)
-		gst_discoverer_stop (props->priv->disco);
+	remove_pending_view (props);
+	if (props->priv->cancellable) {
+		g_cancellable_cancel (props->priv->cancellable);
+		g_clear_object (&props->priv->cancellable);
+	}
+	g_clear_pointer (&props->priv->location, g_free);
 
 	bacon_video_widget_properties_reset (props->priv->props);
 
-	if (location != NULL && props->priv->disco != NULL) {
-		gst_discoverer_start (props->priv->disco);
-
-		if (gst_discoverer_discover_uri_async (props->priv->disco, location) == FALSE) {
-			g_warning ("Couldn't add %s to list", location);
-			return;
-		}
+	if (location != NULL) {
+		props->priv->location = g_strdup (location);
+		props->priv->cancellable = g_cancellable_new ();
+
+		/* The cached results only hold for the file as it was */
+		file = g_file_new_for_uri (location);
+		g_file_query_info_async (file,
+					 G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					 G_FILE_QUERY_INFO_NONE,
+					 G_PRIORITY_DEFAULT,
+					 props->priv->cancellable,
+					 query_mtime_cb,
+					 props);
+		g_object_unref (file);
 	}
 }
 
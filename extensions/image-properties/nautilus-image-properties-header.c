@@ -0,0 +1,381 @@
+/*
+ * This file is part of Nautilus.
+ *
+ * Nautilus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nautilus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "nautilus-image-properties-header.h"
+
+#include <string.h>
+
+#define HEADER_BUFFER_SIZE 4096
+/* Past this, the image is loaded instead */
+#define HEADER_MAX_READ_SIZE (16 * HEADER_BUFFER_SIZE)
+
+typedef struct
+{
+    GInputStream *stream;
+    GCancellable *cancellable;
+    goffset position;
+    gsize total_read;
+
+    guint8 buffer[HEADER_BUFFER_SIZE];
+    goffset buffer_offset;
+    gsize buffer_length;
+} HeaderReader;
+
+/* Returns @size bytes at @offset, valid until the next call, or NULL */
+static const guint8 *
+header_reader_get (HeaderReader *reader,
+                   goffset       offset,
+                   gsize         size)
+{
+    gsize bytes_read;
+
+    g_assert (size <= HEADER_BUFFER_SIZE);
+
+    if (offset >= reader->buffer_offset &&
+        offset + size <= reader->buffer_offset + reader->buffer_length)
+    {
+        return reader->buffer + (offset - reader->buffer_offset);
+    }
+
+    if (reader->total_read >= HEADER_MAX_READ_SIZE)
+    {
+        return NULL;
+    }
+
+    if (offset != reader->position)
+    {
+        if (G_IS_SEEKABLE (reader->stream) &&
+            g_seekable_can_seek (G_SEEKABLE (reader->stream)))
+        {
+            if (!g_seekable_seek (G_SEEKABLE (reader->stream), offset, G_SEEK_SET,
+                                  reader->cancellable, NULL))
+            {
+                return NULL;
+            }
+        }
+        else if (offset < reader->position ||
+                 offset - reader->position > HEADER_MAX_READ_SIZE - reader->total_read ||
+                 g_input_stream_skip (reader->stream, offset - reader->position,
+                                      reader->cancellable, NULL) != offset - reader->position)
+        {
+            return NULL;
+        }
+        else
+        {
+            reader->total_read += offset - reader->position;
+        }
+        reader->position = offset;
+    }
+
+    if (!g_input_stream_read_all (reader->stream, reader->buffer, sizeof (reader->buffer),
+                                  &bytes_read, reader->cancellable, NULL))
+    {
+        return NULL;
+    }
+
+    reader->buffer_offset = offset;
+    reader->buffer_length = bytes_read;
+    reader->position += bytes_read;
+    reader->total_read += bytes_read;
+
+    return bytes_read >= size ? reader->buffer : NULL;
+}
+
+static guint16
+get_uint16 (const guint8 *data,
+            gboolean      big_endian)
+{
+    return big_endian ? (data[0] << 8) | data[1] : (data[1] << 8) | data[0];
+}
+
+static guint32
+get_uint32 (const guint8 *data,
+            gboolean      big_endian)
+{
+    return big_endian ?
+           ((guint32) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3] :
+           ((guint32) data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+}
+
+static gboolean
+read_png (HeaderReader        *reader,
+          const guint8        *data,
+          NautilusImageHeader *header)
+{
+    /* The IHDR chunk comes first, right after the signature */
+    if (memcmp (data + 12, "IHDR", 4) != 0)
+    {
+        return FALSE;
+    }
+
+    header->format_name = "png";
+    header->width = get_uint32 (data + 16, TRUE);
+    header->height = get_uint32 (data + 20, TRUE);
+
+    return TRUE;
+}
+
+static gboolean
+read_gif (HeaderReader        *reader,
+          const guint8        *data,
+          NautilusImageHeader *header)
+{
+    header->format_name = "gif";
+    header->width = get_uint16 (data + 6, FALSE);
+    header->height = get_uint16 (data + 8, FALSE);
+
+    return TRUE;
+}
+
+static gboolean
+read_webp (HeaderReader        *reader,
+           const guint8        *data,
+           NautilusImageHeader *header)
+{
+    guint32 bits;
+
+    if (memcmp (data + 12, "VP8 ", 4) == 0)
+    {
+        /* Lossy, after the frame tag and the start code */
+        if (data[23] != 0x9d || data[24] != 0x01 || data[25] != 0x2a)
+        {
+            return FALSE;
+        }
+        header->width = get_uint16 (data + 26, FALSE) & 0x3fff;
+        header->height = get_uint16 (data + 28, FALSE) & 0x3fff;
+    }
+    else if (memcmp (data + 12, "VP8L", 4) == 0)
+    {
+        /* Lossless, 14 bits each after the signature byte */
+        if (data[20] != 0x2f)
+        {
+            return FALSE;
+        }
+        bits = get_uint32 (data + 21, FALSE);
+        header->width = (bits & 0x3fff) + 1;
+        header->height = ((bits >> 14) & 0x3fff) + 1;
+    }
+    else if (memcmp (data + 12, "VP8X", 4) == 0)
+    {
+        /* Extended, with the canvas size on 24 bits each */
+        header->width = (data[24] | (data[25] << 8) | (data[26] << 16)) + 1;
+        header->height = (data[27] | (data[28] << 8) | (data[29] << 16)) + 1;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    header->format_name = "webp";
+
+    return TRUE;
+}
+
+static gboolean
+read_jpeg (HeaderReader        *reader,
+           const guint8        *data,
+           NautilusImageHeader *header)
+{
+    goffset offset;
+    guint8 marker;
+
+    /* Skip the segments up to the start of frame */
+    offset = 2;
+    while ((data = header_reader_get (reader, offset, 4)) != NULL)
+    {
+        if (data[0] != 0xff)
+        {
+            return FALSE;
+        }
+
+        marker = data[1];
+        if (marker == 0xff)
+        {
+            /* Fill byte */
+            offset++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8))
+        {
+            /* Markers without a segment */
+            offset += 2;
+            continue;
+        }
+        if (marker == 0xd9 || marker == 0xda)
+        {
+            /* End of image, or start of scan with no frame before */
+            return FALSE;
+        }
+
+        if (marker >= 0xc0 && marker <= 0xcf &&
+            marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+        {
+            data = header_reader_get (reader, offset, 9);
+            if (data == NULL)
+            {
+                return FALSE;
+            }
+
+            header->format_name = "jpeg";
+            header->height = get_uint16 (data + 5, TRUE);
+            header->width = get_uint16 (data + 7, TRUE);
+
+            return header->width > 0 && header->height > 0;
+        }
+
+        offset += 2 + get_uint16 (data + 2, TRUE);
+    }
+
+    return FALSE;
+}
+
+static gboolean
+read_tiff (HeaderReader        *reader,
+           const guint8        *data,
+           NautilusImageHeader *header)
+{
+    gboolean big_endian;
+    goffset ifd_offset;
+    guint16 n_entries;
+
+    big_endian = data[0] == 'M';
+    if (get_uint16 (data + 2, big_endian) != 42)
+    {
+        /* Including BigTIFF */
+        return FALSE;
+    }
+
+    ifd_offset = get_uint32 (data + 4, big_endian);
+    data = header_reader_get (reader, ifd_offset, 2);
+    if (data == NULL)
+    {
+        return FALSE;
+    }
+    n_entries = get_uint16 (data, big_endian);
+
+    header->width = 0;
+    header->height = 0;
+    for (guint i = 0; i < n_entries && (header->width == 0 || header->height == 0); i++)
+    {
+        guint16 tag;
+        guint16 type;
+        guint32 value;
+
+        data = header_reader_get (reader, ifd_offset + 2 + i * 12, 12);
+        if (data == NULL)
+        {
+            return FALSE;
+        }
+
+        tag = get_uint16 (data, big_endian);
+        if (tag != 256 && tag != 257)
+        {
+            /* Neither ImageWidth nor ImageLength */
+            continue;
+        }
+
+        type = get_uint16 (data + 2, big_endian);
+        if (type == 3)
+        {
+            value = get_uint16 (data + 8, big_endian);
+        }
+        else if (type == 4)
+        {
+            value = get_uint32 (data + 8, big_endian);
+        }
+        else
+        {
+            return FALSE;
+        }
+
+        if (value > G_MAXINT)
+        {
+            return FALSE;
+        }
+
+        if (tag == 256)
+        {
+            header->width = value;
+        }
+        else
+        {
+            header->height = value;
+        }
+    }
+
+    header->format_name = "tiff";
+
+    return header->width > 0 && header->height > 0;
+}
+
+gboolean
+nautilus_image_properties_header_read (GFile               *file,
+                                       GCancellable        *cancellable,
+                                       NautilusImageHeader *header)
+{
+    g_autoptr (GFileInputStream) stream = NULL;
+    g_autofree HeaderReader *reader = NULL;
+    const guint8 *data;
+    gboolean found;
+
+    stream = g_file_read (file, cancellable, NULL);
+    if (stream == NULL)
+    {
+        return FALSE;
+    }
+
+    reader = g_new0 (HeaderReader, 1);
+    reader->stream = G_INPUT_STREAM (stream);
+    reader->cancellable = cancellable;
+
+    /* Enough for the fixed part of every header */
+    data = header_reader_get (reader, 0, 30);
+    if (data == NULL)
+    {
+        found = FALSE;
+    }
+    else if (memcmp (data, "\x89PNG\r\n\x1a\n", 8) == 0)
+    {
+        found = read_png (reader, data, header);
+    }
+    else if (memcmp (data, "GIF87a", 6) == 0 || memcmp (data, "GIF89a", 6) == 0)
+    {
+        found = read_gif (reader, data, header);
+    }
+    else if (memcmp (data, "RIFF", 4) == 0 && memcmp (data + 8, "WEBP", 4) == 0)
+    {
+        found = read_webp (reader, data, header);
+    }
+    else if (data[0] == 0xff && data[1] == 0xd8)
+    {
+        found = read_jpeg (reader, data, header);
+    }
+    else if (memcmp (data, "II", 2) == 0 || memcmp (data, "MM", 2) == 0)
+    {
+        found = read_tiff (reader, data, header);
+    }
+    else
+    {
+        found = FALSE;
+    }
+
+    g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+
+    return found;
+}
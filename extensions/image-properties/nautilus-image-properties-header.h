@@ -0,0 +1,38 @@
+/*
+ * This file is part of Nautilus.
+ *
+ * Nautilus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nautilus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* The size of the common image formats, read from their headers without
+ * decoding anything: the JPEG start of frame, the PNG IHDR chunk, the
+ * first TIFF IFD, the WebP VP8, VP8L and VP8X chunks and the GIF screen
+ * descriptor. No more than a few KB are read, seeking over the rest.
+ */
+typedef struct
+{
+    const char *format_name; /* as named by gdk-pixbuf */
+    int width;
+    int height;
+} NautilusImageHeader;
+
+/* Blocking. Returns FALSE if the format is not one of the above, or the
+ * header could not be read, so the image has to be loaded instead. */
+gboolean nautilus_image_properties_header_read (GFile               *file,
+                                                GCancellable        *cancellable,
+                                                NautilusImageHeader *header);
@@ -21,6 +21,8 @@
 
 #include "nautilus-image-properties-page.h"
 
+#include "nautilus-image-properties-header.h"
+
 #include <gexiv2/gexiv2.h>
 #include <glib/gi18n.h>
 
@@ -33,6 +35,7 @@ struct _NautilusImagesPropertiesPage
     GCancellable *cancellable;
     GtkWidget *grid;
     GdkPixbufLoader *loader;
+    GdkPixbufFormat *format;
     gboolean got_size;
     gboolean pixbuf_still_loading;
     unsigned char buffer[LOAD_BUFFER_SIZE];
@@ -143,7 +146,7 @@ append_basic_info (NautilusImagesPropertiesPage *page)
     g_autofree char *desc = NULL;
     g_autofree char *value = NULL;
 
-    format = gdk_pixbuf_loader_get_format (page->loader);
+    format = page->format;
     name = gdk_pixbuf_format_get_name (format);
     desc = gdk_pixbuf_format_get_description (format);
     value = g_strdup_printf ("%s (%s)", name, desc);
@@ -284,9 +287,10 @@ load_finished (NautilusImagesPropertiesPage *page)
     if (page->loader != NULL)
     {
         gdk_pixbuf_loader_close (page->loader, NULL);
+        page->format = gdk_pixbuf_loader_get_format (page->loader);
     }
 
-    if (page->got_size)
+    if (page->got_size && page->format != NULL)
     {
         append_basic_info (page);
         append_gexiv2_info (page);
@@ -467,6 +471,87 @@ file_open_callback (GObject      *object,
     }
 }
 
+static GdkPixbufFormat *
+get_pixbuf_format (const char *name)
+{
+    g_autoptr (GSList) formats = NULL;
+
+    formats = gdk_pixbuf_get_formats ();
+    for (GSList *l = formats; l != NULL; l = l->next)
+    {
+        g_autofree char *format_name = NULL;
+
+        format_name = gdk_pixbuf_format_get_name (l->data);
+        if (g_strcmp0 (format_name, name) == 0)
+        {
+            return l->data;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+read_header_thread (GTask        *task,
+                    gpointer      source_object,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
+{
+    NautilusImageHeader *header;
+
+    header = g_new0 (NautilusImageHeader, 1);
+    if (!nautilus_image_properties_header_read (task_data, cancellable, header))
+    {
+        g_free (header);
+        header = NULL;
+    }
+
+    g_task_return_pointer (task, header, g_free);
+}
+
+static void
+read_header_callback (GObject      *object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+    NautilusImagesPropertiesPage *page;
+    FileOpenData *data;
+    g_autofree NautilusImageHeader *header = NULL;
+    GdkPixbufFormat *format;
+
+    page = NAUTILUS_IMAGE_PROPERTIES_PAGE (object);
+    data = user_data;
+    header = g_task_propagate_pointer (G_TASK (res), NULL);
+
+    if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (res))))
+    {
+        g_free (data);
+        return;
+    }
+
+    format = header != NULL ? get_pixbuf_format (header->format_name) : NULL;
+    if (format == NULL)
+    {
+        /* Load the image until its size is known instead */
+        g_file_read_async (g_task_get_task_data (G_TASK (res)),
+                           G_PRIORITY_DEFAULT,
+                           page->cancellable,
+                           file_open_callback,
+                           data);
+        return;
+    }
+
+    g_free (data);
+
+    page->format = format;
+    page->width = header->width;
+    page->height = header->height;
+    page->got_size = TRUE;
+
+    load_finished (page);
+    g_clear_object (&page->cancellable);
+}
+
 void
 nautilus_image_properties_page_load_from_file_info (NautilusImagesPropertiesPage *self,
                                                     NautilusFileInfo             *file_info)
@@ -474,6 +559,7 @@ nautilus_image_properties_page_load_from_file_info (NautilusImagesPropertiesPage
     g_autofree char *uri = NULL;
     g_autoptr (GFile) file = NULL;
     g_autofree char *path = NULL;
+    g_autoptr (GTask) task = NULL;
     FileOpenData *data;
 
     g_return_if_fail (NAUTILUS_IS_IMAGE_PROPERTIES_PAGE (self));
@@ -515,11 +601,11 @@ nautilus_image_properties_page_load_from_file_info (NautilusImagesPropertiesPage
     data->page = self;
     data->file_info = file_info;
 
-    g_file_read_async (file,
-                       G_PRIORITY_DEFAULT,
-                       self->cancellable,
-                       file_open_callback,
-                       data);
+    /* The headers of the common formats tell the size without any of the
+     * image data, which can be huge and on a slow share */
+    task = g_task_new (self, self->cancellable, read_header_callback, data);
+    g_task_set_task_data (task, g_object_ref (file), g_object_unref);
+    g_task_run_in_thread (task, read_header_thread);
 }
 
 NautilusImagesPropertiesPage *
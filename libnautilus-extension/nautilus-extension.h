@@ -32,6 +32,20 @@
 /**
  * SECTION:nautilus-extension
  * @title: Extension entry points
+ *
+ * Extensions are loaded at startup from the extensions directory. An
+ * extension can put off being loaded until it is needed by installing a
+ * manifest next to its library, with the same name and the
+ * `.nautilus-extension` suffix in place of the library suffix. The manifest
+ * is a key file listing the interfaces that the extension's types implement:
+ *
+ * |[
+ * [Nautilus Extension]
+ * Interfaces=NautilusPropertyPageProvider;
+ * ]|
+ *
+ * The library of such an extension is opened, and its types instantiated,
+ * the first time Nautilus asks for the providers of one of those interfaces.
  */
 
 /**
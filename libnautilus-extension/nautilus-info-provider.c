@@ -54,6 +54,65 @@ nautilus_info_provider_update_file_info (NautilusInfoProvider     *self,
     return iface->update_file_info (self, file, update_complete, handle);
 }
 
+/**
+ * nautilus_info_provider_can_update_file_info_list:
+ * @provider: a #NautilusInfoProvider
+ *
+ * Returns: whether @provider can update many files in one call, with
+ * nautilus_info_provider_update_file_info_list().
+ */
+gboolean
+nautilus_info_provider_can_update_file_info_list (NautilusInfoProvider *self)
+{
+    NautilusInfoProviderInterface *iface;
+
+    g_return_val_if_fail (NAUTILUS_IS_INFO_PROVIDER (self), FALSE);
+
+    iface = NAUTILUS_INFO_PROVIDER_GET_IFACE (self);
+
+    return iface->update_file_info_list != NULL;
+}
+
+/**
+ * nautilus_info_provider_update_file_info_list:
+ * @provider: a #NautilusInfoProvider
+ * @files: (element-type NautilusFileInfo): the files to update
+ * @update_complete: the closure to invoke, once, when all the files are done
+ * @handle: (out) (transfer none): an opaque handle to identify the operation
+ *
+ * Like nautilus_info_provider_update_file_info(), for many files at once.
+ * This is only used if the provider implements it, see
+ * nautilus_info_provider_can_update_file_info_list().
+ *
+ * The files all belong to the same directory. When a directory is being
+ * listed, Nautilus waits for the listing to finish, so that the provider
+ * can answer for the whole directory at once, for example with a single
+ * `git status`, unless it is too big for one call.
+ *
+ * Returns: a #NautilusOperationResult covering all of @files
+ */
+NautilusOperationResult
+nautilus_info_provider_update_file_info_list (NautilusInfoProvider     *self,
+                                              GList                    *files,
+                                              GClosure                 *update_complete,
+                                              NautilusOperationHandle **handle)
+{
+    NautilusInfoProviderInterface *iface;
+
+    g_return_val_if_fail (NAUTILUS_IS_INFO_PROVIDER (self),
+                          NAUTILUS_OPERATION_FAILED);
+    g_return_val_if_fail (update_complete != NULL,
+                          NAUTILUS_OPERATION_FAILED);
+    g_return_val_if_fail (handle != NULL, NAUTILUS_OPERATION_FAILED);
+
+    iface = NAUTILUS_INFO_PROVIDER_GET_IFACE (self);
+
+    g_return_val_if_fail (iface->update_file_info_list != NULL,
+                          NAUTILUS_OPERATION_FAILED);
+
+    return iface->update_file_info_list (self, files, update_complete, handle);
+}
+
 void
 nautilus_info_provider_cancel_update (NautilusInfoProvider    *self,
                                       NautilusOperationHandle *handle)
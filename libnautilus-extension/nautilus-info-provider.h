@@ -101,8 +101,11 @@ typedef enum
  * @g_iface: The parent interface.
  * @update_file_info: Returns a #NautilusOperationResult.
  *                    See nautilus_info_provider_update_file_info() for details.
- * @cancel_update: Cancels a previous call to nautilus_info_provider_update_file_info().
+ * @cancel_update: Cancels a previous call to nautilus_info_provider_update_file_info()
+ *                 or nautilus_info_provider_update_file_info_list().
  *                 See nautilus_info_provider_cancel_update() for details.
+ * @update_file_info_list: Optional. Returns a #NautilusOperationResult.
+ *                         See nautilus_info_provider_update_file_info_list() for details.
  *
  * Interface for extensions to provide additional information about files.
  */
@@ -116,6 +119,11 @@ struct _NautilusInfoProviderInterface
                                                  NautilusOperationHandle **handle);
     void                    (*cancel_update)    (NautilusInfoProvider     *provider,
                                                  NautilusOperationHandle  *handle);
+
+    NautilusOperationResult (*update_file_info_list) (NautilusInfoProvider     *provider,
+                                                      GList                    *files,
+                                                      GClosure                 *update_complete,
+                                                      NautilusOperationHandle **handle);
 };
 
 /* Interface Functions */
@@ -123,6 +131,11 @@ NautilusOperationResult nautilus_info_provider_update_file_info       (NautilusI
                                                                        NautilusFileInfo         *file,
                                                                        GClosure                 *update_complete,
                                                                        NautilusOperationHandle **handle);
+gboolean                nautilus_info_provider_can_update_file_info_list (NautilusInfoProvider *provider);
+NautilusOperationResult nautilus_info_provider_update_file_info_list  (NautilusInfoProvider     *provider,
+                                                                       GList                    *files,
+                                                                       GClosure                 *update_complete,
+                                                                       NautilusOperationHandle **handle);
 void                    nautilus_info_provider_cancel_update          (NautilusInfoProvider     *provider,
                                                                        NautilusOperationHandle  *handle);
 
@@ -82,6 +82,8 @@ struct _NautilusGtkPlacesViewPrivate
   GtkListStore                  *completion_store;
 
   GCancellable                  *networks_fetching_cancellable;
+  GPtrArray                     *fetched_networks;
+  guint                          networks_fetching_timeout_id;
 
   guint                          local_only : 1;
   guint                          should_open_location : 1;
@@ -147,6 +149,26 @@ const gchar *unsupported_protocols [] =
 static guint places_view_signals [LAST_SIGNAL] = { 0 };
 static GParamSpec *properties [LAST_PROP];
 
+/* The network locations are fetched NETWORK_FETCH_BATCH_SIZE at a time, so
+ * that they show up as the backends resolve them, and given up on after
+ * NETWORK_FETCH_TIMEOUT_SECONDS.
+ */
+#define NETWORK_FETCH_BATCH_SIZE 16
+#define NETWORK_FETCH_TIMEOUT_SECONDS 15
+
+typedef struct
+{
+  GFile *file;
+  GIcon *icon;
+  gchar *display_name;
+} NetworkLocation;
+
+/* The network locations found by the last complete fetch, shared by all
+ * the views. They are shown right away while being fetched again, and
+ * the ones that are not found again are removed when the fetch is done.
+ */
+static GPtrArray *cached_networks = NULL;
+
 static void
 emit_open_location (NautilusGtkPlacesView      *view,
                     GFile              *location,
@@ -407,6 +429,7 @@ nautilus_gtk_places_view_destroy (GtkWidget *widget)
 
   g_cancellable_cancel (priv->cancellable);
   g_cancellable_cancel (priv->networks_fetching_cancellable);
+  g_clear_handle_id (&priv->networks_fetching_timeout_id, g_source_remove);
 
   GTK_WIDGET_CLASS (nautilus_gtk_places_view_parent_class)->destroy (widget);
 }
@@ -427,6 +450,7 @@ nautilus_gtk_places_view_finalize (GObject *object)
   g_clear_object (&priv->network_monitor);
   g_clear_object (&priv->cancellable);
   g_clear_object (&priv->networks_fetching_cancellable);
+  g_clear_pointer (&priv->fetched_networks, g_ptr_array_unref);
   g_clear_object (&priv->path_size_group);
   g_clear_object (&priv->space_size_group);
 
@@ -810,7 +834,7 @@ add_drive (NautilusGtkPlacesView *view,
   g_list_free_full (volumes, g_object_unref);
 }
 
-static void
+static GtkWidget *
 add_file (NautilusGtkPlacesView *view,
           GFile         *file,
           GIcon         *icon,
@@ -830,6 +854,8 @@ add_file (NautilusGtkPlacesView *view,
                       NULL);
 
   insert_row (view, row, is_network);
+
+  return row;
 }
 
 static gboolean
@@ -943,38 +969,156 @@ monitor_network (NautilusGtkPlacesView *self)
                             self);
 }
 
-static void
-populate_networks (NautilusGtkPlacesView   *view,
-                   GFileEnumerator *enumerator,
-                   GList           *detected_networks)
+static NetworkLocation *
+network_location_new (GFileEnumerator *enumerator,
+                      GFileInfo       *info)
 {
-  GList *l;
+  NetworkLocation *location;
   GFile *file;
-  GFile *activatable_file;
   gchar *uri;
   GFileType type;
-  GIcon *icon;
-  gchar *display_name;
 
-  for (l = detected_networks; l != NULL; l = l->next)
+  file = g_file_enumerator_get_child (enumerator, info);
+  type = g_file_info_get_file_type (info);
+  if (type == G_FILE_TYPE_SHORTCUT || type == G_FILE_TYPE_MOUNTABLE)
+    uri = g_file_info_get_attribute_as_string (info, G_FILE_ATTRIBUTE_STANDARD_TARGET_URI);
+  else
+    uri = g_file_get_uri (file);
+
+  location = g_new0 (NetworkLocation, 1);
+  location->file = g_file_new_for_uri (uri);
+  location->icon = g_file_info_get_icon (info);
+  if (location->icon != NULL)
+    g_object_ref (location->icon);
+  location->display_name = g_file_info_get_attribute_as_string (info, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
+
+  g_free (uri);
+  g_clear_object (&file);
+
+  return location;
+}
+
+static void
+network_location_free (NetworkLocation *location)
+{
+  g_object_unref (location->file);
+  g_clear_object (&location->icon);
+  g_free (location->display_name);
+  g_free (location);
+}
+
+static GtkWidget *
+find_network_row (NautilusGtkPlacesView *view,
+                  GFile                 *file)
+{
+  NautilusGtkPlacesViewPrivate *priv;
+  GList *children;
+  GList *l;
+  GtkWidget *row;
+
+  priv = nautilus_gtk_places_view_get_instance_private (view);
+  row = NULL;
+
+  children = gtk_container_get_children (GTK_CONTAINER (priv->listbox));
+  for (l = children; l != NULL && row == NULL; l = l->next)
     {
-      file = g_file_enumerator_get_child (enumerator, l->data);
-      type = g_file_info_get_file_type (l->data);
-      if (type == G_FILE_TYPE_SHORTCUT || type == G_FILE_TYPE_MOUNTABLE)
-        uri = g_file_info_get_attribute_as_string (l->data, G_FILE_ATTRIBUTE_STANDARD_TARGET_URI);
-      else
-        uri = g_file_get_uri (file);
-      activatable_file = g_file_new_for_uri (uri);
-      display_name = g_file_info_get_attribute_as_string (l->data, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
-      icon = g_file_info_get_icon (l->data);
+      GFile *row_file;
+
+      if (!GPOINTER_TO_INT (g_object_get_data (l->data, "is-network")) ||
+          g_object_get_data (l->data, "is-placeholder") != NULL)
+        continue;
+
+      row_file = nautilus_gtk_places_view_row_get_file (l->data);
+      if (row_file != NULL && g_file_equal (row_file, file))
+        row = l->data;
+    }
+
+  g_list_free (children);
+
+  return row;
+}
+
+static void
+add_network_location (NautilusGtkPlacesView *view,
+                      NetworkLocation       *location,
+                      gboolean               cached)
+{
+  GtkWidget *row;
+
+  row = find_network_row (view, location->file);
+  if (row == NULL)
+    row = add_file (view, location->file, location->icon, location->display_name, NULL, TRUE);
+
+  /* Cached rows that are not found again are removed at the end */
+  g_object_set_data (G_OBJECT (row), "is-cached-network", GINT_TO_POINTER (cached));
+}
+
+static void
+remove_cached_network_rows (NautilusGtkPlacesView *view)
+{
+  NautilusGtkPlacesViewPrivate *priv;
+  GList *children;
+  GList *l;
+
+  priv = nautilus_gtk_places_view_get_instance_private (view);
+
+  children = gtk_container_get_children (GTK_CONTAINER (priv->listbox));
+  for (l = children; l != NULL; l = l->next)
+    {
+      if (g_object_get_data (l->data, "is-cached-network") != NULL)
+        gtk_widget_destroy (l->data);
+    }
+
+  g_list_free (children);
+}
+
+/* Ends the fetch, and when @complete, the network locations that were
+ * found replace the cached ones.
+ */
+static void
+finish_fetching_networks (NautilusGtkPlacesView *view,
+                          gboolean               complete)
+{
+  NautilusGtkPlacesViewPrivate *priv;
+
+  priv = nautilus_gtk_places_view_get_instance_private (view);
 
-      add_file (view, activatable_file, icon, display_name, NULL, TRUE);
+  g_clear_handle_id (&priv->networks_fetching_timeout_id, g_source_remove);
 
-      g_free (uri);
-      g_free (display_name);
-      g_clear_object (&file);
-      g_clear_object (&activatable_file);
+  if (complete)
+    {
+      remove_cached_network_rows (view);
+      g_clear_pointer (&cached_networks, g_ptr_array_unref);
+      cached_networks = g_steal_pointer (&priv->fetched_networks);
     }
+  else
+    {
+      g_clear_pointer (&priv->fetched_networks, g_ptr_array_unref);
+    }
+
+  nautilus_gtk_places_view_set_fetching_networks (view, FALSE);
+  update_network_state (view);
+  monitor_network (view);
+  update_loading (view);
+}
+
+static gboolean
+on_networks_fetching_timeout (gpointer user_data)
+{
+  NautilusGtkPlacesView *view;
+  NautilusGtkPlacesViewPrivate *priv;
+
+  view = NAUTILUS_GTK_PLACES_VIEW (user_data);
+  priv = nautilus_gtk_places_view_get_instance_private (view);
+
+  priv->networks_fetching_timeout_id = 0;
+
+  /* Keep what was found so far, and the cached locations too, since it
+   * is not known whether they are gone */
+  g_cancellable_cancel (priv->networks_fetching_cancellable);
+  finish_fetching_networks (view, FALSE);
+
+  return G_SOURCE_REMOVE;
 }
 
 static void
@@ -985,6 +1129,7 @@ network_enumeration_next_files_finished (GObject      *source_object,
   NautilusGtkPlacesViewPrivate *priv;
   NautilusGtkPlacesView *view;
   GList *detected_networks;
+  GList *l;
   GError *error;
 
   view = NAUTILUS_GTK_PLACES_VIEW (user_data);
@@ -994,31 +1139,53 @@ network_enumeration_next_files_finished (GObject      *source_object,
   detected_networks = g_file_enumerator_next_files_finish (G_FILE_ENUMERATOR (source_object),
                                                            res, &error);
 
+  /* avoid to update widgets if we are already destroyed, or if this
+     fetch was given up on or replaced by another one */
   if (error)
     {
       if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-        g_warning ("Failed to fetch network locations: %s", error->message);
+        {
+          g_warning ("Failed to fetch network locations: %s", error->message);
+
+          if (!priv->destroyed)
+            finish_fetching_networks (view, FALSE);
+        }
 
       g_clear_error (&error);
     }
-  else
+  else if (priv->destroyed)
     {
-      nautilus_gtk_places_view_set_fetching_networks (view, FALSE);
-      populate_networks (view, G_FILE_ENUMERATOR (source_object), detected_networks);
-
       g_list_free_full (detected_networks, g_object_unref);
     }
+  else if (detected_networks == NULL)
+    {
+      finish_fetching_networks (view, TRUE);
+    }
+  else
+    {
+      for (l = detected_networks; l != NULL; l = l->next)
+        {
+          NetworkLocation *location;
 
-  g_object_unref (view);
+          location = network_location_new (G_FILE_ENUMERATOR (source_object), l->data);
+          add_network_location (view, location, FALSE);
+          g_ptr_array_add (priv->fetched_networks, location);
+        }
+
+      g_list_free_full (detected_networks, g_object_unref);
 
-  /* avoid to update widgets if we are already destroyed
-     (and got cancelled s a result of that) */
-  if (!priv->destroyed)
-    {
       update_network_state (view);
-      monitor_network (view);
-      update_loading (view);
+
+      g_file_enumerator_next_files_async (G_FILE_ENUMERATOR (source_object),
+                                          NETWORK_FETCH_BATCH_SIZE,
+                                          G_PRIORITY_DEFAULT,
+                                          priv->networks_fetching_cancellable,
+                                          network_enumeration_next_files_finished,
+                                          user_data);
+      return;
     }
+
+  g_object_unref (view);
 }
 
 static void
@@ -1032,21 +1199,26 @@ network_enumeration_finished (GObject      *source_object,
 
   error = NULL;
   enumerator = g_file_enumerate_children_finish (G_FILE (source_object), res, &error);
+  priv = nautilus_gtk_places_view_get_instance_private (NAUTILUS_GTK_PLACES_VIEW (user_data));
 
   if (error)
     {
-      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
-          !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
-        g_warning ("Failed to fetch network locations: %s", error->message);
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+            g_warning ("Failed to fetch network locations: %s", error->message);
+
+          if (!priv->destroyed)
+            finish_fetching_networks (NAUTILUS_GTK_PLACES_VIEW (user_data), FALSE);
+        }
 
       g_clear_error (&error);
       g_object_unref (NAUTILUS_GTK_PLACES_VIEW (user_data));
     }
   else
     {
-      priv = nautilus_gtk_places_view_get_instance_private (NAUTILUS_GTK_PLACES_VIEW (user_data));
       g_file_enumerator_next_files_async (enumerator,
-                                          G_MAXINT32,
+                                          NETWORK_FETCH_BATCH_SIZE,
                                           G_PRIORITY_DEFAULT,
                                           priv->networks_fetching_cancellable,
                                           network_enumeration_next_files_finished,
@@ -1062,6 +1234,7 @@ fetch_networks (NautilusGtkPlacesView *view)
   GFile *network_file;
   const gchar * const *supported_uris;
   gboolean found;
+  guint i;
 
   priv = nautilus_gtk_places_view_get_instance_private (view);
   supported_uris = g_vfs_get_supported_uri_schemes (g_vfs_get_default ());
@@ -1078,9 +1251,22 @@ fetch_networks (NautilusGtkPlacesView *view)
   g_cancellable_cancel (priv->networks_fetching_cancellable);
   g_clear_object (&priv->networks_fetching_cancellable);
   priv->networks_fetching_cancellable = g_cancellable_new ();
+  g_clear_handle_id (&priv->networks_fetching_timeout_id, g_source_remove);
+
+  g_clear_pointer (&priv->fetched_networks, g_ptr_array_unref);
+  priv->fetched_networks = g_ptr_array_new_with_free_func ((GDestroyNotify) network_location_free);
+
+  /* Show what was found last time while refreshing */
+  for (i = 0; cached_networks != NULL && i < cached_networks->len; i++)
+    add_network_location (view, g_ptr_array_index (cached_networks, i), TRUE);
+
   nautilus_gtk_places_view_set_fetching_networks (view, TRUE);
   update_network_state (view);
 
+  priv->networks_fetching_timeout_id = g_timeout_add_seconds (NETWORK_FETCH_TIMEOUT_SECONDS,
+                                                              on_networks_fetching_timeout,
+                                                              view);
+
   g_object_ref (view);
   g_file_enumerate_children_async (network_file,
                                    "standard::type,standard::target-uri,standard::name,standard::display-name,standard::icon",
@@ -42,8 +42,10 @@
 #include "nautilus-debug.h"
 
 #include "nautilus-bookmark-list.h"
+#include "nautilus-cache-registry.h"
 #include "nautilus-dbus-manager.h"
 #include "nautilus-directory-private.h"
+#include "nautilus-executor.h"
 #include "nautilus-file.h"
 #include "nautilus-files-view.h"
 #include "nautilus-file-operations.h"
@@ -52,7 +54,9 @@
 #include "nautilus-freedesktop-dbus.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-icon-info.h"
+#include "nautilus-keyfile-metadata.h"
 #include "nautilus-lib-self-check-functions.h"
+#include "nautilus-metadata-writer.h"
 #include "nautilus-module.h"
 #include "nautilus-preferences-window.h"
 #include "nautilus-previewer.h"
@@ -79,6 +83,12 @@ typedef struct
 
     GList *windows;
 
+    /* A window built at idle time, outside of the application until
+     * nautilus_application_create_window() takes it */
+    NautilusWindow *spare_window;
+    guint spare_window_idle_id;
+    gboolean creating_spare_window;
+
     GHashTable *notifications;
 
     NautilusFileUndoManager *undo_manager;
@@ -87,10 +97,16 @@ typedef struct
     GCancellable *tag_manager_cancellable;
 
     guint previewer_selection_id;
+
+    /* Whether what only windows need is set up, see
+     * setup_for_windows() */
+    gboolean windows_setup_done;
 } NautilusApplicationPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (NautilusApplication, nautilus_application, GTK_TYPE_APPLICATION);
 
+static void setup_for_windows (NautilusApplication *self);
+
 void
 nautilus_application_set_accelerator (GApplication *app,
                                       const gchar  *action_name,
@@ -239,6 +255,104 @@ menu_provider_init_callback (void)
     nautilus_module_extension_list_free (providers);
 }
 
+static gboolean
+on_first_window_draw (GtkWidget *widget,
+                      cairo_t   *cr,
+                      gpointer   user_data)
+{
+    static gboolean painted = FALSE;
+
+    g_signal_handlers_disconnect_by_func (widget, on_first_window_draw, user_data);
+
+    if (!painted)
+    {
+        painted = TRUE;
+        nautilus_trace_mark ("first paint", NULL);
+    }
+
+    return GDK_EVENT_PROPAGATE;
+}
+
+static gboolean
+create_spare_window (gpointer user_data)
+{
+    NautilusApplication *self = NAUTILUS_APPLICATION (user_data);
+    NautilusApplicationPrivate *priv;
+    NautilusWindow *window;
+    gint64 begin_time;
+
+    priv = nautilus_application_get_instance_private (self);
+    priv->spare_window_idle_id = 0;
+    begin_time = g_get_monotonic_time ();
+
+    /* The window adds itself to the application, which would hold it and
+     * make it the active window until it is shown, so take it back out. */
+    priv->creating_spare_window = TRUE;
+    window = nautilus_window_new (gdk_screen_get_default ());
+    gtk_application_remove_window (GTK_APPLICATION (self), GTK_WINDOW (window));
+    priv->creating_spare_window = FALSE;
+
+    priv->spare_window = window;
+
+    nautilus_trace_span ("spare window creation", begin_time, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_spare_window (NautilusApplication *self)
+{
+    NautilusApplicationPrivate *priv;
+
+    priv = nautilus_application_get_instance_private (self);
+
+    if (priv->spare_window != NULL || priv->spare_window_idle_id != 0)
+    {
+        return;
+    }
+
+    /* After the window just created is drawn and has loaded */
+    priv->spare_window_idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                                  create_spare_window,
+                                                  self, NULL);
+}
+
+static NautilusWindow *
+take_spare_window (NautilusApplication *self,
+                   GdkScreen           *screen)
+{
+    NautilusApplicationPrivate *priv;
+    NautilusWindow *window;
+
+    priv = nautilus_application_get_instance_private (self);
+
+    if (priv->spare_window == NULL ||
+        gtk_window_get_screen (GTK_WINDOW (priv->spare_window)) != screen)
+    {
+        return NULL;
+    }
+
+    window = g_steal_pointer (&priv->spare_window);
+    gtk_window_set_application (GTK_WINDOW (window), GTK_APPLICATION (self));
+
+    return window;
+}
+
+static void
+destroy_spare_window (NautilusApplication *self)
+{
+    NautilusApplicationPrivate *priv;
+
+    priv = nautilus_application_get_instance_private (self);
+
+    g_clear_handle_id (&priv->spare_window_idle_id, g_source_remove);
+    if (priv->spare_window != NULL)
+    {
+        gtk_widget_destroy (GTK_WIDGET (priv->spare_window));
+        priv->spare_window = NULL;
+    }
+}
+
 NautilusWindow *
 nautilus_application_create_window (NautilusApplication *self,
                                     GdkScreen           *screen)
@@ -248,11 +362,19 @@ nautilus_application_create_window (NautilusApplication *self,
     g_autoptr (GVariant) default_size = NULL;
     gint default_width = 0;
     gint default_height = 0;
+    gint64 begin_time;
 
     g_return_val_if_fail (NAUTILUS_IS_APPLICATION (self), NULL);
     nautilus_profile_start (NULL);
+    begin_time = g_get_monotonic_time ();
+
+    setup_for_windows (self);
 
-    window = nautilus_window_new (screen);
+    window = take_spare_window (self, screen);
+    if (window == NULL)
+    {
+        window = nautilus_window_new (screen);
+    }
 
     maximized = g_settings_get_boolean
                     (nautilus_window_state, NAUTILUS_WINDOW_STATE_MAXIMIZED);
@@ -282,9 +404,17 @@ nautilus_application_create_window (NautilusApplication *self,
         gtk_style_context_add_class (style_context, "devel");
     }
 
+    if (nautilus_trace_is_enabled ())
+    {
+        g_signal_connect (window, "draw", G_CALLBACK (on_first_window_draw), NULL);
+    }
+
     DEBUG ("Creating a new navigation window");
+    nautilus_trace_span ("window creation", begin_time, NULL);
     nautilus_profile_end (NULL);
 
+    schedule_spare_window (self);
+
     return window;
 }
 
@@ -797,6 +927,68 @@ action_kill (GSimpleAction *action,
     g_application_quit (G_APPLICATION (application));
 }
 
+/* The actions can't answer their callers, so the stats go to the log
+ * rather than to whatever the standard output of the service is, which
+ * they would garble. */
+static void
+log_stats (const char *name,
+           const char *stats)
+{
+    g_message ("%s:\n%s", name, stats);
+}
+
+/* For debugging, e.g. with
+ * gdbus call --session --dest org.gnome.Nautilus --object-path /org/gnome/Nautilus
+ *   --method org.gtk.Actions.Activate dump-async-job-stats [] {}
+ * and then read its log.
+ */
+static void
+action_dump_async_job_stats (GSimpleAction *action,
+                             GVariant      *parameter,
+                             gpointer       user_data)
+{
+    g_autofree char *stats = NULL;
+
+    stats = nautilus_directory_get_async_job_stats ();
+    log_stats ("Async job stats", stats);
+}
+
+/* Likewise, with dump-cache-stats */
+static void
+action_dump_cache_stats (GSimpleAction *action,
+                         GVariant      *parameter,
+                         gpointer       user_data)
+{
+    g_autofree char *stats = NULL;
+
+    stats = nautilus_cache_registry_get_stats ();
+    log_stats ("Cache stats", stats);
+}
+
+/* Likewise, with dump-executor-stats */
+static void
+action_dump_executor_stats (GSimpleAction *action,
+                            GVariant      *parameter,
+                            gpointer       user_data)
+{
+    g_autofree char *stats = NULL;
+
+    stats = nautilus_executor_get_stats ();
+    log_stats ("Executor stats", stats);
+}
+
+/* Likewise, with dump-memory-stats */
+static void
+action_dump_memory_stats (GSimpleAction *action,
+                          GVariant      *parameter,
+                          gpointer       user_data)
+{
+    g_autofree char *stats = NULL;
+
+    stats = nautilus_directory_get_memory_stats ();
+    log_stats ("Memory stats", stats);
+}
+
 static void
 action_quit (GSimpleAction *action,
              GVariant      *parameter,
@@ -878,6 +1070,10 @@ const static GActionEntry app_entries[] =
     { "help", action_help, NULL, NULL, NULL },
     { "quit", action_quit, NULL, NULL, NULL },
     { "kill", action_kill, NULL, NULL, NULL },
+    { "dump-async-job-stats", action_dump_async_job_stats, NULL, NULL, NULL },
+    { "dump-cache-stats", action_dump_cache_stats, NULL, NULL, NULL },
+    { "dump-executor-stats", action_dump_executor_stats, NULL, NULL, NULL },
+    { "dump-memory-stats", action_dump_memory_stats, NULL, NULL, NULL },
     { "show-help-overlay", action_show_help_overlay, NULL, NULL, NULL },
 };
 
@@ -1294,6 +1490,13 @@ on_application_shutdown (GApplication *application,
 
     g_list_free (notification_ids);
 
+    destroy_spare_window (self);
+
+    nautilus_metadata_writer_flush ();
+    nautilus_keyfile_metadata_flush ();
+
+    nautilus_trace_write ();
+
     nautilus_icon_info_clear_caches ();
 }
 
@@ -1311,12 +1514,47 @@ icon_theme_changed_callback (GtkIconTheme *icon_theme,
     emit_change_signals_for_all_files_in_all_directories ();
 }
 
+/* The theme, the extensions and the tag migration, set up with the first
+ * window. Extensions asked for earlier are loaded on demand. */
+static void
+setup_for_windows (NautilusApplication *self)
+{
+    NautilusApplicationPrivate *priv;
+    gint64 modules_begin_time;
+
+    priv = nautilus_application_get_instance_private (self);
+
+    if (priv->windows_setup_done)
+    {
+        return;
+    }
+    priv->windows_setup_done = TRUE;
+
+    gtk_window_set_default_icon_name (APPLICATION_ID);
+
+    setup_theme_extensions ();
+
+    /* initialize nautilus modules */
+    nautilus_profile_start ("Modules");
+    modules_begin_time = g_get_monotonic_time ();
+    nautilus_module_setup ();
+    nautilus_trace_span ("extensions setup", modules_begin_time, NULL);
+    nautilus_profile_end ("Modules");
+
+    /* attach menu-provider module callback */
+    menu_provider_init_callback ();
+
+    nautilus_tag_manager_maybe_migrate_tracker2_data (priv->tag_manager);
+}
+
 void
 nautilus_application_startup_common (NautilusApplication *self)
 {
     NautilusApplicationPrivate *priv;
+    gint64 begin_time;
 
     nautilus_profile_start (NULL);
+    begin_time = g_get_monotonic_time ();
     priv = nautilus_application_get_instance_private (self);
 
     g_application_set_resource_base_path (G_APPLICATION (self), "/org/gnome/nautilus");
@@ -1326,20 +1564,15 @@ nautilus_application_startup_common (NautilusApplication *self)
      */
     G_APPLICATION_CLASS (nautilus_application_parent_class)->startup (G_APPLICATION (self));
 
-    gtk_window_set_default_icon_name (APPLICATION_ID);
-
-    setup_theme_extensions ();
-
     /* initialize preferences and create the global GSettings objects */
     nautilus_global_preferences_init ();
 
-    /* initialize nautilus modules */
-    nautilus_profile_start ("Modules");
-    nautilus_module_setup ();
-    nautilus_profile_end ("Modules");
-
-    /* attach menu-provider module callback */
-    menu_provider_init_callback ();
+    /* When started by D-Bus activation, it's mostly for the search
+     * provider, which needs none of this */
+    if ((g_application_get_flags (G_APPLICATION (self)) & G_APPLICATION_IS_SERVICE) == 0)
+    {
+        setup_for_windows (self);
+    }
 
     /* Initialize the UI handler singleton for file operations */
     priv->progress_handler = nautilus_progress_persistence_handler_new (G_OBJECT (self));
@@ -1351,8 +1584,9 @@ nautilus_application_startup_common (NautilusApplication *self)
 
     nautilus_init_application_actions (self);
 
-    nautilus_tag_manager_maybe_migrate_tracker2_data (priv->tag_manager);
+    nautilus_trace_watch_main_loop ();
 
+    nautilus_trace_span ("startup", begin_time, NULL);
     nautilus_profile_end (NULL);
 
     g_signal_connect (self, "notify::active-window", G_CALLBACK (on_application_active_window_changed), NULL);
@@ -1576,8 +1810,17 @@ nautilus_application_window_added (GtkApplication *app,
     NautilusApplicationPrivate *priv;
 
     priv = nautilus_application_get_instance_private (self);
+
+    /* E.g. the properties window, asked for over D-Bus */
+    setup_for_windows (self);
+
     GTK_APPLICATION_CLASS (nautilus_application_parent_class)->window_added (app, window);
 
+    if (priv->creating_spare_window)
+    {
+        return;
+    }
+
     if (NAUTILUS_IS_WINDOW (window))
     {
         priv->windows = g_list_prepend (priv->windows, window);
@@ -1598,6 +1841,11 @@ nautilus_application_window_removed (GtkApplication *app,
 
     GTK_APPLICATION_CLASS (nautilus_application_parent_class)->window_removed (app, window);
 
+    if (priv->creating_spare_window)
+    {
+        return;
+    }
+
     if (NAUTILUS_IS_WINDOW (window))
     {
         priv->windows = g_list_remove_all (priv->windows, window);
@@ -1609,6 +1857,8 @@ nautilus_application_window_removed (GtkApplication *app,
     /* if this was the last window, close the previewer */
     if (g_list_length (priv->windows) == 0)
     {
+        /* Not worth its memory while no window is open */
+        destroy_spare_window (self);
         nautilus_previewer_call_close ();
         nautilus_progress_persistence_handler_make_persistent (priv->progress_handler);
     }
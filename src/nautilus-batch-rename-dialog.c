@@ -31,6 +31,11 @@
 #define ROW_MARGIN_START 6
 #define ROW_MARGIN_TOP_BOTTOM 4
 
+/* Only the labels of the rows on screen, and of this many rows around
+ * them, are kept up to date with the preview. The others are filled in
+ * when scrolled to. */
+#define PREVIEW_ROWS_MARGIN 50
+
 struct _NautilusBatchRenameDialog
 {
     GtkDialog parent;
@@ -65,13 +70,15 @@ struct _NautilusBatchRenameDialog
     GList *original_name_listbox_rows;
     GList *arrow_listbox_rows;
     GList *result_listbox_rows;
-    GList *listbox_labels_new;
-    GList *listbox_labels_old;
+    GPtrArray *listbox_labels_new;
+    GPtrArray *listbox_labels_old;
     GList *listbox_icons;
     GtkSizeGroup *size_group;
 
     GList *selection;
     GList *new_names;
+    /* The new names being computed in a worker, cancelled by further edits */
+    GCancellable *new_names_cancellable;
     NautilusBatchRenameDialogMode mode;
     NautilusDirectory *directory;
 
@@ -91,6 +98,8 @@ struct _NautilusBatchRenameDialog
     GList *duplicates;
     GList *distinct_parent_directories;
     GList *directories_pending_conflict_check;
+    /* The selection by directory, for the current new names */
+    GHashTable *files_index;
 
     /* this hash table has information about the status
      * of all tags: availability, if it's currently used
@@ -100,6 +109,15 @@ struct _NautilusBatchRenameDialog
     GtkWidget *preselected_row1;
     GtkWidget *preselected_row2;
 
+    /* What the preview labels show: the new names, by row, and what
+     * they were computed from */
+    GPtrArray *preview_new_names;
+    GPtrArray *preview_sources;
+    NautilusBatchRenameDialogMode preview_mode;
+    gchar *preview_find_text;
+    /* Bumped when the preview changes, labels store the one they show */
+    guint preview_generation;
+
     gint row_height;
     gboolean rename_clicked;
 
@@ -423,54 +441,82 @@ split_entry_text (NautilusBatchRenameDialog *self,
     return result;
 }
 
-static GList *
-batch_rename_dialog_get_new_names (NautilusBatchRenameDialog *dialog)
+typedef struct
 {
-    GList *result = NULL;
-    GList *selection;
+    NautilusBatchRenameDialogMode mode;
+    GPtrArray *sources;
     GList *text_chunks;
-    g_autofree gchar *entry_text = NULL;
-    g_autofree gchar *replace_text = NULL;
+    GList *selection_metadata;
+    gchar *entry_text;
+    gchar *replace_text;
+} NewNamesData;
 
-    selection = dialog->selection;
-    text_chunks = NULL;
+static void
+new_names_data_free (NewNamesData *data)
+{
+    g_ptr_array_unref (data->sources);
+    g_list_free_full (data->text_chunks, string_free);
+    g_free (data->entry_text);
+    g_free (data->replace_text);
 
-    if (dialog->mode == NAUTILUS_BATCH_RENAME_DIALOG_REPLACE)
-    {
-        entry_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->find_entry)));
-    }
-    else
-    {
-        entry_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->name_entry)));
+    g_free (data);
+}
+
+static void
+get_new_names_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+    NewNamesData *data = task_data;
+    GPtrArray *new_names;
+
+    new_names = batch_rename_get_new_names (data->mode,
+                                            data->sources,
+                                            data->text_chunks,
+                                            data->selection_metadata,
+                                            data->entry_text,
+                                            data->replace_text,
+                                            cancellable);
+    if (new_names == NULL)
+    {
+        g_task_return_error_if_cancelled (task);
+        return;
     }
 
-    replace_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->replace_entry)));
+    g_task_return_pointer (task, new_names, (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+batch_rename_dialog_get_new_names_async (NautilusBatchRenameDialog *dialog,
+                                         GAsyncReadyCallback        callback)
+{
+    g_autoptr (GTask) task = NULL;
+    NewNamesData *data;
+
+    data = g_new0 (NewNamesData, 1);
+    data->mode = dialog->mode;
+    data->sources = batch_rename_sources_new (dialog->selection);
+    /* Set once, and only freed with the dialog, which the task keeps alive */
+    data->selection_metadata = dialog->selection_metadata;
 
     if (dialog->mode == NAUTILUS_BATCH_RENAME_DIALOG_REPLACE)
     {
-        result = batch_rename_dialog_get_new_names_list (dialog->mode,
-                                                         selection,
-                                                         NULL,
-                                                         NULL,
-                                                         entry_text,
-                                                         replace_text);
+        data->entry_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->find_entry)));
     }
     else
     {
-        text_chunks = split_entry_text (dialog, entry_text);
-
-        result = batch_rename_dialog_get_new_names_list (dialog->mode,
-                                                         selection,
-                                                         text_chunks,
-                                                         dialog->selection_metadata,
-                                                         entry_text,
-                                                         replace_text);
-        g_list_free_full (text_chunks, string_free);
+        data->entry_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->name_entry)));
+        data->text_chunks = split_entry_text (dialog, data->entry_text);
     }
 
-    result = g_list_reverse (result);
+    data->replace_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->replace_entry)));
 
-    return result;
+    dialog->new_names_cancellable = g_cancellable_new ();
+
+    task = g_task_new (dialog, dialog->new_names_cancellable, callback, NULL);
+    g_task_set_task_data (task, data, (GDestroyNotify) new_names_data_free);
+    g_task_run_in_thread (task, get_new_names_thread);
 }
 
 static void
@@ -507,9 +553,12 @@ listbox_header_func (GtkListBoxRow             *row,
 }
 
 /* This is manually done instead of using GtkSizeGroup because of the computational
- * complexity of the later.*/
+ * complexity of the later. Only the labels of the rows from @first to @last
+ * are measured, as the others have not been filled in.*/
 static void
-update_rows_height (NautilusBatchRenameDialog *dialog)
+update_rows_height (NautilusBatchRenameDialog *dialog,
+                    guint                      first,
+                    guint                      last)
 {
     GList *l;
     gint current_row_natural_height;
@@ -518,9 +567,9 @@ update_rows_height (NautilusBatchRenameDialog *dialog)
     maximum_height = -1;
 
     /* check if maximum height has changed */
-    for (l = dialog->listbox_labels_new; l != NULL; l = l->next)
+    for (guint i = first; i < last; i++)
     {
-        gtk_widget_get_preferred_height (GTK_WIDGET (l->data),
+        gtk_widget_get_preferred_height (g_ptr_array_index (dialog->listbox_labels_new, i),
                                          NULL,
                                          &current_row_natural_height);
 
@@ -528,11 +577,8 @@ update_rows_height (NautilusBatchRenameDialog *dialog)
         {
             maximum_height = current_row_natural_height;
         }
-    }
 
-    for (l = dialog->listbox_labels_old; l != NULL; l = l->next)
-    {
-        gtk_widget_get_preferred_height (GTK_WIDGET (l->data),
+        gtk_widget_get_preferred_height (g_ptr_array_index (dialog->listbox_labels_old, i),
                                          NULL,
                                          &current_row_natural_height);
 
@@ -542,9 +588,10 @@ update_rows_height (NautilusBatchRenameDialog *dialog)
         }
     }
 
-    for (l = dialog->listbox_icons; l != NULL; l = l->next)
+    /* The arrows are all the same */
+    if (dialog->listbox_icons != NULL)
     {
-        gtk_widget_get_preferred_height (GTK_WIDGET (l->data),
+        gtk_widget_get_preferred_height (GTK_WIDGET (dialog->listbox_icons->data),
                                          NULL,
                                          &current_row_natural_height);
 
@@ -563,15 +610,113 @@ update_rows_height (NautilusBatchRenameDialog *dialog)
             g_object_set (G_OBJECT (l->data), "height-request", dialog->row_height, NULL);
         }
 
-        for (l = dialog->listbox_labels_new; l != NULL; l = l->next)
+        for (guint i = 0; i < dialog->listbox_labels_new->len; i++)
         {
-            g_object_set (G_OBJECT (l->data), "height-request", dialog->row_height, NULL);
+            g_object_set (g_ptr_array_index (dialog->listbox_labels_new, i),
+                          "height-request", dialog->row_height, NULL);
+            g_object_set (g_ptr_array_index (dialog->listbox_labels_old, i),
+                          "height-request", dialog->row_height, NULL);
         }
+    }
+}
 
-        for (l = dialog->listbox_labels_old; l != NULL; l = l->next)
-        {
-            g_object_set (G_OBJECT (l->data), "height-request", dialog->row_height, NULL);
-        }
+static void
+update_preview_label (NautilusBatchRenameDialog *dialog,
+                      guint                      index)
+{
+    GtkLabel *label_new;
+    GtkLabel *label_old;
+    BatchRenameSource *source;
+    GString *new_name;
+
+    label_new = g_ptr_array_index (dialog->listbox_labels_new, index);
+    if (GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (label_new), "preview-generation")) ==
+        dialog->preview_generation)
+    {
+        return;
+    }
+
+    g_object_set_data (G_OBJECT (label_new), "preview-generation",
+                       GUINT_TO_POINTER (dialog->preview_generation));
+
+    new_name = g_ptr_array_index (dialog->preview_new_names, index);
+    gtk_label_set_label (label_new, new_name->str);
+    gtk_widget_set_tooltip_text (GTK_WIDGET (label_new), new_name->str);
+
+    label_old = g_ptr_array_index (dialog->listbox_labels_old, index);
+    source = g_ptr_array_index (dialog->preview_sources, index);
+    gtk_widget_set_tooltip_text (GTK_WIDGET (label_old), source->name);
+
+    if (dialog->preview_mode == NAUTILUS_BATCH_RENAME_DIALOG_FORMAT)
+    {
+        gtk_label_set_label (label_old, source->name);
+    }
+    else
+    {
+        g_autoptr (GString) markup = NULL;
+
+        markup = batch_rename_replace_label_text (source->name,
+                                                  dialog->preview_find_text);
+        gtk_label_set_markup (label_old, markup->str);
+    }
+}
+
+/* Fills in the labels of the rows on screen, and of the rows around them */
+static void
+update_visible_preview_labels (NautilusBatchRenameDialog *dialog)
+{
+    GtkAdjustment *adjustment;
+    gint first;
+    gint last;
+
+    if (dialog->preview_new_names == NULL ||
+        gtk_widget_in_destruction (GTK_WIDGET (dialog)))
+    {
+        return;
+    }
+
+    first = 0;
+    last = 0;
+    if (dialog->row_height > 0)
+    {
+        gdouble value;
+        gdouble page_size;
+
+        adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (dialog->scrolled_window));
+        value = gtk_adjustment_get_value (adjustment);
+        page_size = gtk_adjustment_get_page_size (adjustment);
+
+        /* Rows are separated by a 1px separator */
+        first = value / (dialog->row_height + 1);
+        last = (value + page_size) / (dialog->row_height + 1) + 1;
+    }
+
+    first = MAX (first - PREVIEW_ROWS_MARGIN, 0);
+    last = MIN (last + PREVIEW_ROWS_MARGIN, (gint) dialog->preview_new_names->len);
+
+    for (gint i = first; i < last; i++)
+    {
+        update_preview_label (dialog, i);
+    }
+
+    update_rows_height (dialog, first, MAX (first, last));
+}
+
+/* Shows the current new names in the preview */
+static void
+update_preview (NautilusBatchRenameDialog *dialog)
+{
+    gboolean row_height_known;
+
+    dialog->preview_generation++;
+
+    row_height_known = dialog->row_height > 0;
+    update_visible_preview_labels (dialog);
+
+    /* The visible rows are only known once a row has been measured */
+    if (!row_height_known)
+    {
+        update_visible_preview_labels (dialog);
     }
 }
 
@@ -593,7 +738,7 @@ create_original_name_row_for_label (NautilusBatchRenameDialog *dialog,
     gtk_widget_set_margin_start (label_old, ROW_MARGIN_START);
     gtk_label_set_ellipsize (GTK_LABEL (label_old), PANGO_ELLIPSIZE_END);
 
-    dialog->listbox_labels_old = g_list_prepend (dialog->listbox_labels_old, label_old);
+    g_ptr_array_add (dialog->listbox_labels_old, label_old);
 
     gtk_container_add (GTK_CONTAINER (row), label_old);
     gtk_widget_show_all (row);
@@ -619,7 +764,7 @@ create_result_row_for_label (NautilusBatchRenameDialog *dialog,
     gtk_widget_set_margin_start (label_new, ROW_MARGIN_START);
     gtk_label_set_ellipsize (GTK_LABEL (label_new), PANGO_ELLIPSIZE_END);
 
-    dialog->listbox_labels_new = g_list_prepend (dialog->listbox_labels_new, label_new);
+    g_ptr_array_add (dialog->listbox_labels_new, label_new);
 
     gtk_container_add (GTK_CONTAINER (row), label_new);
     gtk_widget_show_all (row);
@@ -665,9 +810,10 @@ prepare_batch_rename (NautilusBatchRenameDialog *dialog)
     GdkCursor *cursor;
     GdkDisplay *display;
 
-    /* wait for checking conflicts to finish, to be sure that
-     * the rename can actually take place */
-    if (dialog->directories_pending_conflict_check != NULL)
+    /* wait for the new names and for checking conflicts to finish, to be
+     * sure that the rename can actually take place */
+    if (dialog->new_names_cancellable != NULL ||
+        dialog->directories_pending_conflict_check != NULL)
     {
         dialog->rename_clicked = TRUE;
         return;
@@ -712,6 +858,8 @@ batch_rename_dialog_on_response (NautilusBatchRenameDialog *dialog,
             cancel_conflict_check (dialog);
         }
 
+        g_cancellable_cancel (dialog->new_names_cancellable);
+
         gtk_widget_destroy (GTK_WIDGET (dialog));
     }
 }
@@ -720,11 +868,7 @@ static void
 fill_display_listbox (NautilusBatchRenameDialog *dialog)
 {
     GtkWidget *row;
-    GList *l1;
-    GList *l2;
-    NautilusFile *file;
-    GString *new_name;
-    gchar *name;
+    GList *l;
 
     dialog->original_name_listbox_rows = NULL;
     dialog->arrow_listbox_rows = NULL;
@@ -733,13 +877,10 @@ fill_display_listbox (NautilusBatchRenameDialog *dialog)
     gtk_size_group_add_widget (dialog->size_group, dialog->result_listbox);
     gtk_size_group_add_widget (dialog->size_group, dialog->original_name_listbox);
 
-    for (l1 = dialog->new_names, l2 = dialog->selection; l1 != NULL && l2 != NULL; l1 = l1->next, l2 = l2->next)
+    /* The labels are filled in with the preview */
+    for (l = dialog->selection; l != NULL; l = l->next)
     {
-        file = NAUTILUS_FILE (l2->data);
-        new_name = l1->data;
-
-        name = nautilus_file_get_name (file);
-        row = create_original_name_row_for_label (dialog, name, TRUE);
+        row = create_original_name_row_for_label (dialog, NULL, TRUE);
         gtk_container_add (GTK_CONTAINER (dialog->original_name_listbox), row);
         dialog->original_name_listbox_rows = g_list_prepend (dialog->original_name_listbox_rows,
                                                              row);
@@ -749,19 +890,15 @@ fill_display_listbox (NautilusBatchRenameDialog *dialog)
         dialog->arrow_listbox_rows = g_list_prepend (dialog->arrow_listbox_rows,
                                                      row);
 
-        row = create_result_row_for_label (dialog, new_name->str, TRUE);
+        row = create_result_row_for_label (dialog, NULL, TRUE);
         gtk_container_add (GTK_CONTAINER (dialog->result_listbox), row);
         dialog->result_listbox_rows = g_list_prepend (dialog->result_listbox_rows,
                                                       row);
-
-        g_free (name);
     }
 
     dialog->original_name_listbox_rows = g_list_reverse (dialog->original_name_listbox_rows);
     dialog->arrow_listbox_rows = g_list_reverse (dialog->arrow_listbox_rows);
     dialog->result_listbox_rows = g_list_reverse (dialog->result_listbox_rows);
-    dialog->listbox_labels_old = g_list_reverse (dialog->listbox_labels_old);
-    dialog->listbox_labels_new = g_list_reverse (dialog->listbox_labels_new);
     dialog->listbox_icons = g_list_reverse (dialog->listbox_icons);
 }
 
@@ -929,54 +1066,21 @@ update_conflict_row_background (NautilusBatchRenameDialog *dialog)
 static void
 update_listbox (NautilusBatchRenameDialog *dialog)
 {
-    GList *l1;
-    GList *l2;
-    NautilusFile *file;
-    gchar *old_name;
-    GtkLabel *label;
+    GList *l;
     GString *new_name;
     gboolean empty_name = FALSE;
 
-    for (l1 = dialog->new_names, l2 = dialog->listbox_labels_new; l1 != NULL && l2 != NULL; l1 = l1->next, l2 = l2->next)
+    for (l = dialog->new_names; l != NULL; l = l->next)
     {
-        label = GTK_LABEL (l2->data);
-        new_name = l1->data;
-
-        gtk_label_set_label (label, new_name->str);
-        gtk_widget_set_tooltip_text (GTK_WIDGET (label), new_name->str);
+        new_name = l->data;
 
         if (g_strcmp0 (new_name->str, "") == 0)
         {
             empty_name = TRUE;
+            break;
         }
     }
 
-    for (l1 = dialog->selection, l2 = dialog->listbox_labels_old; l1 != NULL && l2 != NULL; l1 = l1->next, l2 = l2->next)
-    {
-        label = GTK_LABEL (l2->data);
-        file = NAUTILUS_FILE (l1->data);
-
-        old_name = nautilus_file_get_name (file);
-        gtk_widget_set_tooltip_text (GTK_WIDGET (label), old_name);
-
-        if (dialog->mode == NAUTILUS_BATCH_RENAME_DIALOG_FORMAT)
-        {
-            gtk_label_set_label (label, old_name);
-        }
-        else
-        {
-            new_name = batch_rename_replace_label_text (old_name,
-                                                        gtk_entry_get_text (GTK_ENTRY (dialog->find_entry)));
-            gtk_label_set_markup (GTK_LABEL (label), new_name->str);
-
-            g_string_free (new_name, TRUE);
-        }
-
-        g_free (old_name);
-    }
-
-    update_rows_height (dialog);
-
     if (empty_name)
     {
         gtk_widget_set_sensitive (dialog->rename_button, FALSE);
@@ -1033,141 +1137,88 @@ update_listbox (NautilusBatchRenameDialog *dialog)
     }
 }
 
+static void
+add_conflict (NautilusBatchRenameDialog *dialog,
+              BatchRenameEntry          *entry)
+{
+    ConflictData *conflict_data;
+
+    conflict_data = g_new (ConflictData, 1);
+    conflict_data->name = g_strdup (entry->new_name->str);
+    conflict_data->index = entry->index;
+    dialog->duplicates = g_list_prepend (dialog->duplicates,
+                                         conflict_data);
+}
+
+/* Only the files of the selection in @directory are looked at, through
+ * the index of the selection built for the new names. */
 static void
 check_conflict_for_files (NautilusBatchRenameDialog *dialog,
                           NautilusDirectory         *directory,
                           GList                     *files)
 {
-    gchar *current_directory;
-    gchar *parent_uri;
-    gchar *name;
-    NautilusFile *file;
-    GString *new_name;
-    GString *file_name;
-    GList *l1, *l2;
+    g_autofree gchar *current_directory = NULL;
+    BatchRenameParent *parent;
+    GList *l;
     GHashTable *directory_files_table;
-    GHashTable *new_names_table;
-    GHashTable *names_conflicts_table;
-    gboolean exists;
-    gboolean have_conflict;
-    gboolean tag_present;
-    gboolean same_parent_directory;
-    ConflictData *conflict_data;
+    GHashTable *new_names_count;
+
+    if (dialog->files_index == NULL)
+    {
+        return;
+    }
 
     current_directory = nautilus_directory_get_uri (directory);
+    parent = g_hash_table_lookup (dialog->files_index, current_directory);
+    if (parent == NULL)
+    {
+        return;
+    }
 
     directory_files_table = g_hash_table_new_full (g_str_hash,
                                                    g_str_equal,
                                                    (GDestroyNotify) g_free,
                                                    NULL);
-    new_names_table = g_hash_table_new_full (g_str_hash,
-                                             g_str_equal,
-                                             (GDestroyNotify) g_free,
-                                             (GDestroyNotify) g_free);
-    names_conflicts_table = g_hash_table_new_full (g_str_hash,
-                                                   g_str_equal,
-                                                   (GDestroyNotify) g_free,
-                                                   (GDestroyNotify) g_free);
+    /* New name -> how many files of this directory get it */
+    new_names_count = g_hash_table_new (g_str_hash, g_str_equal);
 
-    /* names_conflicts_table is used for knowing which names from the list are not unique,
-     * so that they can easily be reached when needed */
-    for (l1 = dialog->new_names, l2 = dialog->selection;
-         l1 != NULL && l2 != NULL;
-         l1 = l1->next, l2 = l2->next)
+    for (guint i = 0; i < parent->entries->len; i++)
     {
-        new_name = l1->data;
-        file = NAUTILUS_FILE (l2->data);
-        parent_uri = nautilus_file_get_parent_uri (file);
-
-        tag_present = g_hash_table_lookup (new_names_table, new_name->str) != NULL;
-        same_parent_directory = g_strcmp0 (parent_uri, current_directory) == 0;
-
-        if (same_parent_directory)
-        {
-            if (!tag_present)
-            {
-                g_hash_table_insert (new_names_table,
-                                     g_strdup (new_name->str),
-                                     nautilus_file_get_parent_uri (file));
-            }
-            else
-            {
-                g_hash_table_insert (names_conflicts_table,
-                                     g_strdup (new_name->str),
-                                     nautilus_file_get_parent_uri (file));
-            }
-        }
+        BatchRenameEntry *entry = g_ptr_array_index (parent->entries, i);
+        guint count;
 
-        g_free (parent_uri);
+        count = GPOINTER_TO_UINT (g_hash_table_lookup (new_names_count, entry->new_name->str));
+        g_hash_table_insert (new_names_count, entry->new_name->str, GUINT_TO_POINTER (count + 1));
     }
 
-    for (l1 = files; l1 != NULL; l1 = l1->next)
+    for (l = files; l != NULL; l = l->next)
     {
-        file = NAUTILUS_FILE (l1->data);
-        g_hash_table_insert (directory_files_table,
-                             nautilus_file_get_name (file),
-                             GINT_TO_POINTER (TRUE));
+        g_hash_table_add (directory_files_table,
+                          nautilus_file_get_name (NAUTILUS_FILE (l->data)));
     }
 
-    for (l1 = dialog->selection, l2 = dialog->new_names; l1 != NULL && l2 != NULL; l1 = l1->next, l2 = l2->next)
+    for (guint i = 0; i < parent->entries->len; i++)
     {
-        file = NAUTILUS_FILE (l1->data);
-
-        name = nautilus_file_get_name (file);
-        file_name = g_string_new (name);
-        g_free (name);
+        BatchRenameEntry *entry = g_ptr_array_index (parent->entries, i);
+        const gchar *new_name = entry->new_name->str;
 
-        parent_uri = nautilus_file_get_parent_uri (file);
-
-        new_name = l2->data;
-
-        have_conflict = FALSE;
-
-        /* check for duplicate only if the parent of the current file is
-         * the current directory and the name of the file has changed */
-        if (g_strcmp0 (parent_uri, current_directory) == 0 &&
-            !g_string_equal (new_name, file_name))
+        /* check for duplicate only if the name of the file has changed */
+        if (g_strcmp0 (new_name, entry->name) != 0 &&
+            (g_hash_table_contains (directory_files_table, new_name) ||
+             nautilus_directory_has_hidden_file_by_name (directory, new_name, NULL)) &&
+            !file_name_conflicts_with_results (dialog->files_index, current_directory,
+                                               entry->new_name))
         {
-            exists = GPOINTER_TO_INT (g_hash_table_lookup (directory_files_table, new_name->str));
-
-            if (exists == TRUE &&
-                !file_name_conflicts_with_results (dialog->selection, dialog->new_names, new_name, parent_uri))
-            {
-                conflict_data = g_new (ConflictData, 1);
-                conflict_data->name = g_strdup (new_name->str);
-                conflict_data->index = g_list_index (dialog->selection, l1->data);
-                dialog->duplicates = g_list_prepend (dialog->duplicates,
-                                                     conflict_data);
-
-                have_conflict = TRUE;
-            }
+            add_conflict (dialog, entry);
         }
-
-        if (!have_conflict)
+        else if (GPOINTER_TO_UINT (g_hash_table_lookup (new_names_count, new_name)) > 1)
         {
-            tag_present = g_hash_table_lookup (names_conflicts_table, new_name->str) != NULL;
-            same_parent_directory = g_strcmp0 (parent_uri, current_directory) == 0;
-
-            if (tag_present && same_parent_directory)
-            {
-                conflict_data = g_new (ConflictData, 1);
-                conflict_data->name = g_strdup (new_name->str);
-                conflict_data->index = g_list_index (dialog->selection, l1->data);
-                dialog->duplicates = g_list_prepend (dialog->duplicates,
-                                                     conflict_data);
-
-                have_conflict = TRUE;
-            }
+            add_conflict (dialog, entry);
         }
-
-        g_string_free (file_name, TRUE);
-        g_free (parent_uri);
     }
 
-    g_free (current_directory);
     g_hash_table_destroy (directory_files_table);
-    g_hash_table_destroy (new_names_table);
-    g_hash_table_destroy (names_conflicts_table);
+    g_hash_table_destroy (new_names_count);
 }
 
 static void
@@ -1226,6 +1277,9 @@ file_names_list_has_duplicates_async (NautilusBatchRenameDialog *self)
     self->directories_pending_conflict_check = nautilus_directory_list_copy (self->distinct_parent_directories);
     self->duplicates = NULL;
 
+    g_clear_pointer (&self->files_index, g_hash_table_destroy);
+    self->files_index = batch_rename_files_index_new (self->selection, self->new_names);
+
     for (l = self->distinct_parent_directories; l != NULL; l = l->next)
     {
         nautilus_directory_call_when_ready (l->data,
@@ -1373,22 +1427,72 @@ numbering_tag_is_some_added (NautilusBatchRenameDialog *self)
 }
 
 static void
-update_display_text (NautilusBatchRenameDialog *dialog)
+on_new_names_ready (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
 {
-    if(dialog->selection == NULL)
+    NautilusBatchRenameDialog *dialog;
+    NewNamesData *data;
+    g_autoptr (GPtrArray) new_names = NULL;
+
+    new_names = g_task_propagate_pointer (G_TASK (result), NULL);
+    if (new_names == NULL)
     {
+        /* Cancelled, further edits are computing their own */
         return;
     }
 
+    dialog = NAUTILUS_BATCH_RENAME_DIALOG (source_object);
+    data = g_task_get_task_data (G_TASK (result));
+
+    g_clear_object (&dialog->new_names_cancellable);
+
     if (dialog->duplicates != NULL)
     {
         g_list_free_full (dialog->duplicates, conflict_data_free);
         dialog->duplicates = NULL;
     }
 
-    if (dialog->new_names != NULL)
+    /* It points to the new names */
+    g_clear_pointer (&dialog->files_index, g_hash_table_destroy);
+
+    g_clear_pointer (&dialog->preview_new_names, g_ptr_array_unref);
+    g_list_free_full (dialog->new_names, string_free);
+    dialog->new_names = NULL;
+
+    /* The list owns the names */
+    for (guint i = new_names->len; i > 0; i--)
     {
-        g_list_free_full (dialog->new_names, string_free);
+        dialog->new_names = g_list_prepend (dialog->new_names,
+                                            g_ptr_array_index (new_names, i - 1));
+    }
+    g_ptr_array_set_free_func (new_names, NULL);
+
+    dialog->preview_new_names = g_steal_pointer (&new_names);
+    g_clear_pointer (&dialog->preview_sources, g_ptr_array_unref);
+    dialog->preview_sources = g_ptr_array_ref (data->sources);
+    dialog->preview_mode = data->mode;
+    g_free (dialog->preview_find_text);
+    dialog->preview_find_text = g_strdup (data->entry_text);
+
+    update_preview (dialog);
+
+    if (have_unallowed_character (dialog))
+    {
+        dialog->rename_clicked = FALSE;
+
+        return;
+    }
+
+    file_names_list_has_duplicates_async (dialog);
+}
+
+static void
+update_display_text (NautilusBatchRenameDialog *dialog)
+{
+    if(dialog->selection == NULL)
+    {
+        return;
     }
 
     if (!numbering_tag_is_some_added (dialog))
@@ -1400,14 +1504,19 @@ update_display_text (NautilusBatchRenameDialog *dialog)
         gtk_revealer_set_reveal_child (GTK_REVEALER (dialog->numbering_revealer), TRUE);
     }
 
-    dialog->new_names = batch_rename_dialog_get_new_names (dialog);
+    /* The previous new names stay shown until the new ones are ready */
+    if (dialog->new_names_cancellable != NULL)
+    {
+        g_cancellable_cancel (dialog->new_names_cancellable);
+        g_clear_object (&dialog->new_names_cancellable);
+    }
 
-    if (have_unallowed_character (dialog))
+    if (dialog->directories_pending_conflict_check != NULL)
     {
-        return;
+        cancel_conflict_check (dialog);
     }
 
-    file_names_list_has_duplicates_async (dialog);
+    batch_rename_dialog_get_new_names_async (dialog, on_new_names_ready);
 }
 
 static void
@@ -1925,8 +2034,8 @@ nautilus_batch_rename_dialog_finalize (GObject *object)
     g_list_free (dialog->original_name_listbox_rows);
     g_list_free (dialog->arrow_listbox_rows);
     g_list_free (dialog->result_listbox_rows);
-    g_list_free (dialog->listbox_labels_new);
-    g_list_free (dialog->listbox_labels_old);
+    g_ptr_array_unref (dialog->listbox_labels_new);
+    g_ptr_array_unref (dialog->listbox_labels_old);
     g_list_free (dialog->listbox_icons);
 
     for (l = dialog->selection_metadata; l != NULL; l = l->next)
@@ -1951,6 +2060,10 @@ nautilus_batch_rename_dialog_finalize (GObject *object)
         g_hash_table_destroy (dialog->create_date);
     }
 
+    g_clear_pointer (&dialog->files_index, g_hash_table_destroy);
+    g_clear_pointer (&dialog->preview_new_names, g_ptr_array_unref);
+    g_clear_pointer (&dialog->preview_sources, g_ptr_array_unref);
+    g_free (dialog->preview_find_text);
     g_list_free_full (dialog->new_names, string_free);
     g_list_free_full (dialog->duplicates, conflict_data_free);
 
@@ -1964,6 +2077,7 @@ nautilus_batch_rename_dialog_finalize (GObject *object)
 
     g_cancellable_cancel (dialog->metadata_cancellable);
     g_clear_object (&dialog->metadata_cancellable);
+    g_clear_object (&dialog->new_names_cancellable);
 
     G_OBJECT_CLASS (nautilus_batch_rename_dialog_parent_class)->finalize (object);
 }
@@ -2113,6 +2227,7 @@ nautilus_batch_rename_dialog_init (NautilusBatchRenameDialog *self)
     TagData *tag_data;
     guint i;
     g_autoptr (GtkBuilder) builder = NULL;
+    GtkAdjustment *adjustment;
 
     gtk_widget_init_template (GTK_WIDGET (self));
 
@@ -2187,6 +2302,15 @@ nautilus_batch_rename_dialog_init (NautilusBatchRenameDialog *self)
 
     self->row_height = -1;
 
+    self->listbox_labels_new = g_ptr_array_new ();
+    self->listbox_labels_old = g_ptr_array_new ();
+
+    adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (self->scrolled_window));
+    g_signal_connect_swapped (adjustment, "value-changed",
+                              G_CALLBACK (update_visible_preview_labels), self);
+    g_signal_connect_swapped (adjustment, "changed",
+                              G_CALLBACK (update_visible_preview_labels), self);
+
     g_signal_connect (self->original_name_listbox, "row-selected", G_CALLBACK (row_selected), self);
     g_signal_connect (self->arrow_listbox, "row-selected", G_CALLBACK (row_selected), self);
     g_signal_connect (self->result_listbox, "row-selected", G_CALLBACK (row_selected), self);
@@ -27,24 +27,56 @@
 #include <stdarg.h>
 #include <eel/eel-vfs-extensions.h>
 
+/* How many new names are computed between checks for cancellation */
+#define BATCH_RENAME_CANCEL_CHECK_INTERVAL 1000
+
+/* The metadata of the selection is queried for this many files at a time,
+ * with this many queries running at once */
+#define METADATA_QUERY_BATCH_SIZE 200
+#define METADATA_QUERY_MAX_RUNNING 4
+
 typedef struct
 {
     NautilusFile *file;
     gint position;
 } CreateDateElem;
 
+typedef struct
+{
+    gchar *file_name;
+    GDateTime *date_time;
+} CreationDate;
+
 typedef struct
 {
     NautilusBatchRenameDialog *dialog;
-    GHashTable *date_order_hash_table;
+    /* CreationDate, ordered when all the queries are done */
+    GPtrArray *creation_dates;
 
     GList *selection_metadata;
+    /* File name -> FileMetadata, the files all have the same parent */
+    GHashTable *metadata_by_name;
 
     gboolean has_metadata[G_N_ELEMENTS (metadata_tags_constants)];
 
+    /* The names of the selection, the ones from next_name are not queried yet */
+    gchar *parent_uri;
+    GPtrArray *names;
+    guint next_name;
+    guint n_queries_running;
+    gboolean cancelled;
+
     GCancellable *cancellable;
 } QueryData;
 
+/* One of the queries running at once, each has its own statement so that
+ * its bindings can't change under it */
+typedef struct
+{
+    QueryData *query_data;
+    TrackerSparqlStatement *statement;
+} QueryBatch;
+
 enum
 {
     FILE_NAME_INDEX,
@@ -67,6 +99,7 @@ enum
 static void on_cursor_callback (GObject      *object,
                                 GAsyncResult *result,
                                 gpointer      user_data);
+static void query_batch_run (QueryBatch *batch);
 
 void
 string_free (gpointer mem)
@@ -313,53 +346,41 @@ batch_rename_replace_label_text (gchar       *label,
 }
 
 static gchar *
-get_metadata (GList        *selection_metadata,
+get_metadata (GHashTable   *metadata_by_name,
               gchar        *file_name,
               MetadataType  metadata_type)
 {
-    GList *l;
     FileMetadata *file_metadata;
-    gchar *metadata = NULL;
 
-    for (l = selection_metadata; l != NULL; l = l->next)
+    file_metadata = g_hash_table_lookup (metadata_by_name, file_name);
+    if (file_metadata != NULL &&
+        file_metadata->metadata[metadata_type] &&
+        file_metadata->metadata[metadata_type]->len > 0)
     {
-        file_metadata = l->data;
-        if (g_strcmp0 (file_name, file_metadata->file_name->str) == 0)
-        {
-            if (file_metadata->metadata[metadata_type] &&
-                file_metadata->metadata[metadata_type]->len > 0)
-            {
-                metadata = file_metadata->metadata[metadata_type]->str;
-            }
-
-            break;
-        }
+        return file_metadata->metadata[metadata_type]->str;
     }
 
-    return metadata;
+    return NULL;
 }
 
 static GString *
-batch_rename_format (NautilusFile *file,
-                     GList        *text_chunks,
-                     GList        *selection_metadata,
-                     gint          count)
+batch_rename_format (BatchRenameSource *source,
+                     GList             *text_chunks,
+                     GHashTable        *metadata_by_name,
+                     gint               count)
 {
     GList *l;
     GString *tag_string;
     GString *new_name;
     gboolean added_tag;
     MetadataType metadata_type;
-    g_autofree gchar *file_name = NULL;
-    g_autofree gchar *extension = NULL;
+    gchar *file_name;
+    gchar *extension;
     gint i;
     gchar *metadata;
 
-    file_name = nautilus_file_get_display_name (file);
-    if (!nautilus_file_is_directory (file))
-    {
-        extension = nautilus_file_get_extension (file);
-    }
+    file_name = source->display_name;
+    extension = source->is_directory ? NULL : source->extension;
 
     new_name = g_string_new ("");
 
@@ -420,7 +441,7 @@ batch_rename_format (NautilusFile *file,
             if (g_strcmp0 (tag_string->str, tag_text_representation) == 0)
             {
                 metadata_type = metadata_tags_constants[i].metadata_type;
-                metadata = get_metadata (selection_metadata, file_name, metadata_type);
+                metadata = get_metadata (metadata_by_name, file_name, metadata_type);
 
                 /* TODO: This is a hack, we should provide a cancellable for checking
                  * the metadata, and if that is happening don't enter here. We can
@@ -436,7 +457,7 @@ batch_rename_format (NautilusFile *file,
                 {
                     case ORIGINAL_FILE_NAME:
                     {
-                        if (nautilus_file_is_directory (file))
+                        if (source->is_directory)
                         {
                             new_name = g_string_append (new_name, file_name);
                         }
@@ -488,102 +509,186 @@ batch_rename_format (NautilusFile *file,
     return new_name;
 }
 
-GList *
-batch_rename_dialog_get_new_names_list (NautilusBatchRenameDialogMode  mode,
-                                        GList                         *selection,
-                                        GList                         *text_chunks,
-                                        GList                         *selection_metadata,
-                                        gchar                         *entry_text,
-                                        gchar                         *replace_text)
+static void
+batch_rename_source_free (BatchRenameSource *source)
 {
-    GList *l;
-    GList *result;
-    GString *file_name;
-    GString *new_name;
-    NautilusFile *file;
-    gchar *name;
-    gint count;
+    g_free (source->name);
+    g_free (source->display_name);
+    g_free (source->extension);
 
-    result = NULL;
-    count = 1;
+    g_free (source);
+}
 
-    for (l = selection; l != NULL; l = l->next)
+GPtrArray *
+batch_rename_sources_new (GList *selection)
+{
+    GPtrArray *sources;
+
+    sources = g_ptr_array_new_full (g_list_length (selection),
+                                    (GDestroyNotify) batch_rename_source_free);
+
+    for (GList *l = selection; l != NULL; l = l->next)
     {
-        file = NAUTILUS_FILE (l->data);
+        NautilusFile *file = NAUTILUS_FILE (l->data);
+        BatchRenameSource *source;
+
+        source = g_new0 (BatchRenameSource, 1);
+        source->name = nautilus_file_get_name (file);
+        source->display_name = nautilus_file_get_display_name (file);
+        source->is_directory = nautilus_file_is_directory (file);
+        source->extension = nautilus_file_get_extension (file);
 
-        name = nautilus_file_get_name (file);
-        file_name = g_string_new (name);
+        g_ptr_array_add (sources, source);
+    }
+
+    return sources;
+}
+
+GPtrArray *
+batch_rename_get_new_names (NautilusBatchRenameDialogMode  mode,
+                            GPtrArray                     *sources,
+                            GList                         *text_chunks,
+                            GList                         *selection_metadata,
+                            gchar                         *entry_text,
+                            gchar                         *replace_text,
+                            GCancellable                  *cancellable)
+{
+    g_autoptr (GPtrArray) result = NULL;
+    g_autoptr (GHashTable) metadata_by_name = NULL;
+
+    result = g_ptr_array_new_full (sources->len, string_free);
+
+    /* The metadata of a file is looked up by its display name, the first
+     * one listed wins */
+    metadata_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+    for (GList *l = selection_metadata; l != NULL; l = l->next)
+    {
+        FileMetadata *file_metadata = l->data;
+
+        if (!g_hash_table_contains (metadata_by_name, file_metadata->file_name->str))
+        {
+            g_hash_table_insert (metadata_by_name,
+                                 file_metadata->file_name->str,
+                                 file_metadata);
+        }
+    }
+
+    for (guint i = 0; i < sources->len; i++)
+    {
+        BatchRenameSource *source = g_ptr_array_index (sources, i);
+        GString *new_name;
+
+        if (i % BATCH_RENAME_CANCEL_CHECK_INTERVAL == 0 &&
+            g_cancellable_is_cancelled (cancellable))
+        {
+            return NULL;
+        }
 
-        /* get the new name here and add it to the list*/
         if (mode == NAUTILUS_BATCH_RENAME_DIALOG_FORMAT)
         {
-            new_name = batch_rename_format (file,
+            new_name = batch_rename_format (source,
                                             text_chunks,
-                                            selection_metadata,
-                                            count++);
-            result = g_list_prepend (result, new_name);
+                                            metadata_by_name,
+                                            i + 1);
         }
-
-        if (mode == NAUTILUS_BATCH_RENAME_DIALOG_REPLACE)
+        else
         {
-            new_name = batch_rename_replace (file_name->str,
+            new_name = batch_rename_replace (source->name,
                                              entry_text,
                                              replace_text);
-            result = g_list_prepend (result, new_name);
         }
 
-        g_string_free (file_name, TRUE);
-        g_free (name);
+        g_ptr_array_add (result, new_name);
     }
 
-    return result;
+    return g_steal_pointer (&result);
 }
 
-/* There is a case that a new name for a file conflicts with an existing file name
- * in the directory but it's not a problem because the file in the directory that
- * conflicts is part of the batch renaming selection and it's going to change the name anyway. */
-gboolean
-file_name_conflicts_with_results (GList   *selection,
-                                  GList   *new_names,
-                                  GString *old_name,
-                                  gchar   *parent_uri)
+static void
+batch_rename_entry_free (BatchRenameEntry *entry)
 {
-    GList *l1;
-    GList *l2;
-    NautilusFile *selection_file;
-    GString *new_name;
+    g_free (entry->name);
+    g_free (entry);
+}
 
-    for (l1 = selection, l2 = new_names; l1 != NULL && l2 != NULL; l1 = l1->next, l2 = l2->next)
-    {
-        g_autofree gchar *name1 = NULL;
-        g_autofree gchar *selection_parent_uri = NULL;
+static void
+batch_rename_parent_free (BatchRenameParent *parent)
+{
+    g_hash_table_destroy (parent->by_name);
+    g_ptr_array_unref (parent->entries);
+    g_free (parent);
+}
 
-        selection_file = NAUTILUS_FILE (l1->data);
-        name1 = nautilus_file_get_name (selection_file);
+GHashTable *
+batch_rename_files_index_new (GList *selection,
+                              GList *new_names)
+{
+    GHashTable *files_index;
+    GList *l1, *l2;
+    gint index;
 
-        selection_parent_uri = nautilus_file_get_parent_uri (selection_file);
+    files_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify) batch_rename_parent_free);
 
-        if (g_strcmp0 (name1, old_name->str) == 0)
-        {
-            new_name = l2->data;
+    for (l1 = selection, l2 = new_names, index = 0;
+         l1 != NULL && l2 != NULL;
+         l1 = l1->next, l2 = l2->next, index++)
+    {
+        BatchRenameParent *parent;
+        BatchRenameEntry *entry;
+        gchar *parent_uri;
 
-            /* if the name didn't change, then there's a conflict */
-            if (g_string_equal (old_name, new_name) &&
-                (parent_uri == NULL || g_strcmp0 (parent_uri, selection_parent_uri) == 0))
-            {
-                return FALSE;
-            }
+        parent_uri = nautilus_file_get_parent_uri (NAUTILUS_FILE (l1->data));
+        parent = g_hash_table_lookup (files_index, parent_uri);
+        if (parent == NULL)
+        {
+            parent = g_new0 (BatchRenameParent, 1);
+            parent->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) batch_rename_entry_free);
+            parent->by_name = g_hash_table_new (g_str_hash, g_str_equal);
+            g_hash_table_insert (files_index, parent_uri, parent);
+        }
+        else
+        {
+            g_free (parent_uri);
+        }
 
+        entry = g_new0 (BatchRenameEntry, 1);
+        entry->index = index;
+        entry->name = nautilus_file_get_name (NAUTILUS_FILE (l1->data));
+        entry->new_name = l2->data;
 
-            /* if this file exists and it changed it's name, then there's no
-             * conflict */
-            return TRUE;
-        }
+        g_ptr_array_add (parent->entries, entry);
+        g_hash_table_insert (parent->by_name, entry->name, entry);
     }
 
+    return files_index;
+}
+
+/* There is a case that a new name for a file conflicts with an existing file name
+ * in the directory but it's not a problem because the file in the directory that
+ * conflicts is part of the batch renaming selection and it's going to change the name anyway. */
+gboolean
+file_name_conflicts_with_results (GHashTable  *files_index,
+                                  const gchar *parent_uri,
+                                  GString     *old_name)
+{
+    BatchRenameParent *parent;
+    BatchRenameEntry *entry;
+
+    parent = g_hash_table_lookup (files_index, parent_uri);
+    entry = parent != NULL ? g_hash_table_lookup (parent->by_name, old_name->str) : NULL;
+
     /* the case this function searched for doesn't exist, so the file
      * has a conlfict */
-    return FALSE;
+    if (entry == NULL)
+    {
+        return FALSE;
+    }
+
+    /* if the name didn't change, then there's a conflict, and if it
+     * changed it's name, then there's no conflict */
+    return !g_string_equal (old_name, entry->new_name);
 }
 
 static gint
@@ -746,13 +851,13 @@ nautilus_batch_rename_dialog_sort (GList      *selection,
 }
 
 static void
-cursor_next (QueryData           *query_data,
+cursor_next (QueryBatch          *batch,
              TrackerSparqlCursor *cursor)
 {
     tracker_sparql_cursor_next_async (cursor,
-                                      query_data->cancellable,
+                                      batch->query_data->cancellable,
                                       on_cursor_callback,
-                                      query_data);
+                                      batch);
 }
 
 static void
@@ -801,10 +906,10 @@ on_cursor_callback (GObject      *object,
 {
     TrackerSparqlCursor *cursor;
     gboolean success;
+    QueryBatch *batch;
     QueryData *query_data;
     MetadataType metadata_type;
     g_autoptr (GError) error = NULL;
-    GList *l;
     FileMetadata *file_metadata;
     GDateTime *date_time;
     guint i;
@@ -828,7 +933,8 @@ on_cursor_callback (GObject      *object,
     file_metadata = NULL;
 
     cursor = TRACKER_SPARQL_CURSOR (object);
-    query_data = user_data;
+    batch = user_data;
+    query_data = batch->query_data;
 
     success = tracker_sparql_cursor_next_finish (cursor, result, &error);
     if (!success)
@@ -836,20 +942,17 @@ on_cursor_callback (GObject      *object,
         if (error != NULL)
         {
             g_warning ("Error on batch rename tracker query cursor: %s", error->message);
+
+            /* The dialog is going away at the time of cancellation */
+            if (error->code == G_IO_ERROR_CANCELLED)
+            {
+                query_data->cancelled = TRUE;
+            }
         }
 
         g_clear_object (&cursor);
 
-        /* The dialog is going away at the time of cancellation */
-        if (error == NULL ||
-            (error != NULL && error->code != G_IO_ERROR_CANCELLED))
-        {
-            nautilus_batch_rename_dialog_query_finished (query_data->dialog,
-                                                         query_data->date_order_hash_table,
-                                                         query_data->selection_metadata);
-        }
-
-        g_free (query_data);
+        query_batch_run (batch);
 
         return;
     }
@@ -872,14 +975,13 @@ on_cursor_callback (GObject      *object,
 
     /* Search for the metadata object corresponding to the file name */
     file_name = tracker_sparql_cursor_get_string (cursor, FILE_NAME_INDEX, NULL);
-    for (l = query_data->selection_metadata; l != NULL; l = l->next)
+    file_metadata = file_name != NULL ?
+                    g_hash_table_lookup (query_data->metadata_by_name, file_name) : NULL;
+    if (file_metadata == NULL)
     {
-        file_metadata = l->data;
+        cursor_next (batch, cursor);
 
-        if (g_strcmp0 (file_name, file_metadata->file_name->str) == 0)
-        {
-            break;
-        }
+        return;
     }
 
     /* Set metadata when available, and delete for the whole selection when not */
@@ -960,21 +1062,23 @@ on_cursor_callback (GObject      *object,
                 remove_metadata (query_data,
                                  metadata_type);
 
-                if (metadata_type == CREATION_DATE &&
-                    query_data->date_order_hash_table)
+                if (metadata_type == CREATION_DATE)
                 {
-                    g_hash_table_destroy (query_data->date_order_hash_table);
-                    query_data->date_order_hash_table = NULL;
+                    g_ptr_array_set_size (query_data->creation_dates, 0);
                 }
             }
             else
             {
                 if (metadata_type == CREATION_DATE)
                 {
-                    /* Add the sort order to the order hash table */
-                    g_hash_table_insert (query_data->date_order_hash_table,
-                                         g_strdup (tracker_sparql_cursor_get_string (cursor, 0, NULL)),
-                                         GINT_TO_POINTER (g_hash_table_size (query_data->date_order_hash_table)));
+                    CreationDate *creation;
+
+                    /* The batches come in any order, they are sorted by
+                     * creation date once all are done */
+                    creation = g_new0 (CreationDate, 1);
+                    creation->file_name = g_strdup (file_name);
+                    creation->date_time = g_date_time_new_from_iso8601 (creation_date, NULL);
+                    g_ptr_array_add (query_data->creation_dates, creation);
 
                     date_time = g_date_time_new_local (atoi (year),
                                                        atoi (month),
@@ -994,44 +1098,187 @@ on_cursor_callback (GObject      *object,
     }
 
     /* Get next */
-    cursor_next (query_data, cursor);
+    cursor_next (batch, cursor);
 }
 
 static void
-batch_rename_dialog_query_callback (GObject      *object,
-                                    GAsyncResult *result,
-                                    gpointer      user_data)
+creation_date_free (CreationDate *creation)
 {
-    TrackerSparqlConnection *connection;
+    g_free (creation->file_name);
+    g_clear_pointer (&creation->date_time, g_date_time_unref);
+
+    g_free (creation);
+}
+
+static gint
+compare_creation_dates (gconstpointer a,
+                        gconstpointer b)
+{
+    const CreationDate *creation_a = *(CreationDate **) a;
+    const CreationDate *creation_b = *(CreationDate **) b;
+
+    if (creation_a->date_time == NULL || creation_b->date_time == NULL)
+    {
+        return (creation_a->date_time != NULL) - (creation_b->date_time != NULL);
+    }
+
+    return g_date_time_compare (creation_a->date_time, creation_b->date_time);
+}
+
+/* File name -> position in the order of creation */
+static GHashTable *
+get_date_order_hash_table (QueryData *query_data)
+{
+    GHashTable *date_order_hash_table;
+
+    if (!query_data->has_metadata[CREATION_DATE])
+    {
+        return NULL;
+    }
+
+    g_ptr_array_sort (query_data->creation_dates, compare_creation_dates);
+
+    date_order_hash_table = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   (GDestroyNotify) g_free,
+                                                   NULL);
+    for (guint i = 0; i < query_data->creation_dates->len; i++)
+    {
+        CreationDate *creation = g_ptr_array_index (query_data->creation_dates, i);
+
+        g_hash_table_insert (date_order_hash_table,
+                             g_steal_pointer (&creation->file_name),
+                             GINT_TO_POINTER (i));
+    }
+
+    return date_order_hash_table;
+}
+
+static void
+query_data_finish (QueryData *query_data)
+{
+    /* The dialog is going away at the time of cancellation */
+    if (!query_data->cancelled)
+    {
+        nautilus_batch_rename_dialog_query_finished (query_data->dialog,
+                                                     get_date_order_hash_table (query_data),
+                                                     query_data->selection_metadata);
+    }
+
+    g_ptr_array_unref (query_data->creation_dates);
+    g_hash_table_destroy (query_data->metadata_by_name);
+    g_ptr_array_unref (query_data->names);
+    g_free (query_data->parent_uri);
+
+    g_free (query_data);
+}
+
+static void
+on_query_batch_executed (GObject      *object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+    QueryBatch *batch;
     TrackerSparqlCursor *cursor;
-    QueryData *query_data;
     g_autoptr (GError) error = NULL;
 
-    connection = TRACKER_SPARQL_CONNECTION (object);
-    query_data = user_data;
-
-    cursor = tracker_sparql_connection_query_finish (connection,
-                                                     result,
-                                                     &error);
+    batch = user_data;
 
+    cursor = tracker_sparql_statement_execute_finish (TRACKER_SPARQL_STATEMENT (object),
+                                                      result,
+                                                      &error);
     if (error != NULL)
     {
         g_warning ("Error on batch rename query for metadata: %s", error->message);
 
-        /* The dialog is being finalized at this point */
-        if (error->code != G_IO_ERROR_CANCELLED)
+        if (error->code == G_IO_ERROR_CANCELLED)
         {
-            nautilus_batch_rename_dialog_query_finished (query_data->dialog,
-                                                         query_data->date_order_hash_table,
-                                                         query_data->selection_metadata);
+            batch->query_data->cancelled = TRUE;
         }
 
-        g_free (query_data);
+        query_batch_run (batch);
     }
     else
     {
-        cursor_next (query_data, cursor);
+        cursor_next (batch, cursor);
+    }
+}
+
+/* Queries the next names of the selection, or finishes the batch if they
+ * were all queried */
+static void
+query_batch_run (QueryBatch *batch)
+{
+    QueryData *query_data = batch->query_data;
+
+    if (query_data->cancelled || query_data->next_name >= query_data->names->len)
+    {
+        g_object_unref (batch->statement);
+        g_free (batch);
+
+        query_data->n_queries_running--;
+        if (query_data->n_queries_running == 0)
+        {
+            query_data_finish (query_data);
+        }
+
+        return;
+    }
+
+    tracker_sparql_statement_bind_string (batch->statement, "parent",
+                                          query_data->parent_uri);
+
+    /* The last batch repeats its last name for the names it lacks */
+    for (guint i = 0; i < METADATA_QUERY_BATCH_SIZE; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("name%u", i);
+        guint index = MIN (query_data->next_name + i, query_data->names->len - 1);
+
+        tracker_sparql_statement_bind_string (batch->statement, name,
+                                              g_ptr_array_index (query_data->names, index));
     }
+
+    query_data->next_name += METADATA_QUERY_BATCH_SIZE;
+
+    tracker_sparql_statement_execute_async (batch->statement,
+                                            query_data->cancellable,
+                                            on_query_batch_executed,
+                                            batch);
+}
+
+static GString *
+build_metadata_sparql (void)
+{
+    GString *sparql;
+
+    sparql = g_string_new ("SELECT "
+                           "nfo:fileName(?file) "
+                           "nie:contentCreated(?content) "
+                           "year(nie:contentCreated(?content)) "
+                           "month(nie:contentCreated(?content)) "
+                           "day(nie:contentCreated(?content)) "
+                           "hours(nie:contentCreated(?content)) "
+                           "minutes(nie:contentCreated(?content)) "
+                           "seconds(nie:contentCreated(?content)) "
+                           "nfo:model(nfo:equipment(?content)) "
+                           "nmm:seasonNumber(?content) "
+                           "nmm:episodeNumber(?content) "
+                           "nmm:trackNumber(?content) "
+                           "nmm:artistName(nmm:performer(?content)) "
+                           "nie:title(?content) "
+                           "nie:title(nmm:musicAlbum(?content)) "
+                           "WHERE { ?file a nfo:FileDataObject. ?file nie:url ?url. ?content nie:isStoredAs ?file. "
+                           "FILTER(tracker:uri-is-parent(~parent, ?url)) "
+                           "FILTER (nfo:fileName(?file) IN (");
+
+    for (guint i = 0; i < METADATA_QUERY_BATCH_SIZE; i++)
+    {
+        g_string_append_printf (sparql, "%s~name%u", i > 0 ? ", " : "", i);
+    }
+
+    g_string_append (sparql, ")) }");
+
+    return sparql;
 }
 
 void
@@ -1040,7 +1287,7 @@ check_metadata_for_selection (NautilusBatchRenameDialog *dialog,
                               GCancellable              *cancellable)
 {
     TrackerSparqlConnection *connection;
-    GString *query;
+    g_autoptr (GString) sparql = NULL;
     GList *l;
     NautilusFile *file;
     GError *error;
@@ -1048,76 +1295,34 @@ check_metadata_for_selection (NautilusBatchRenameDialog *dialog,
     gchar *file_name;
     FileMetadata *file_metadata;
     GList *selection_metadata;
+    GPtrArray *names;
+    GHashTable *metadata_by_name;
+    QueryBatch *batches[METADATA_QUERY_MAX_RUNNING];
     guint i;
-    g_autofree gchar *parent_uri = NULL;
-    gchar *file_name_escaped;
+    guint n_batches;
 
     error = NULL;
     selection_metadata = NULL;
-
-    query = g_string_new ("SELECT "
-                          "nfo:fileName(?file) "
-                          "nie:contentCreated(?content) "
-                          "year(nie:contentCreated(?content)) "
-                          "month(nie:contentCreated(?content)) "
-                          "day(nie:contentCreated(?content)) "
-                          "hours(nie:contentCreated(?content)) "
-                          "minutes(nie:contentCreated(?content)) "
-                          "seconds(nie:contentCreated(?content)) "
-                          "nfo:model(nfo:equipment(?content)) "
-                          "nmm:seasonNumber(?content) "
-                          "nmm:episodeNumber(?content) "
-                          "nmm:trackNumber(?content) "
-                          "nmm:artistName(nmm:performer(?content)) "
-                          "nie:title(?content) "
-                          "nie:title(nmm:musicAlbum(?content)) "
-                          "WHERE { ?file a nfo:FileDataObject. ?file nie:url ?url. ?content nie:isStoredAs ?file. ");
-
-    parent_uri = nautilus_file_get_parent_uri (NAUTILUS_FILE (selection->data));
-
-    g_string_append_printf (query,
-                            "FILTER(tracker:uri-is-parent(\"%s\", ?url)) ",
-                            parent_uri);
+    names = g_ptr_array_new_with_free_func (g_free);
+    metadata_by_name = g_hash_table_new (g_str_hash, g_str_equal);
 
     for (l = selection; l != NULL; l = l->next)
     {
         file = NAUTILUS_FILE (l->data);
         file_name = nautilus_file_get_name (file);
-        file_name_escaped = tracker_sparql_escape_string (file_name);
-
-        if (l == selection)
-        {
-            g_string_append_printf (query,
-                                    "FILTER (nfo:fileName(?file) IN (\"%s\", ",
-                                    file_name_escaped);
-        }
-        else if (l->next == NULL)
-        {
-            g_string_append_printf (query,
-                                    "\"%s\")) ",
-                                    file_name_escaped);
-        }
-        else
-        {
-            g_string_append_printf (query,
-                                    "\"%s\", ",
-                                    file_name_escaped);
-        }
 
         file_metadata = g_new0 (FileMetadata, 1);
         file_metadata->file_name = g_string_new (file_name);
         file_metadata->metadata[ORIGINAL_FILE_NAME] = g_string_new (file_name);
 
         selection_metadata = g_list_prepend (selection_metadata, file_metadata);
+        g_hash_table_insert (metadata_by_name, file_metadata->file_name->str, file_metadata);
 
-        g_free (file_name);
-        g_free (file_name_escaped);
+        g_ptr_array_add (names, file_name);
     }
 
     selection_metadata = g_list_reverse (selection_metadata);
 
-    g_string_append (query, "} ORDER BY ASC(nie:contentCreated(?content))");
-
     connection = nautilus_tracker_get_miner_fs_connection (&error);
     if (!connection)
     {
@@ -1127,30 +1332,64 @@ check_metadata_for_selection (NautilusBatchRenameDialog *dialog,
             g_error_free (error);
         }
 
+        g_ptr_array_unref (names);
+        g_hash_table_destroy (metadata_by_name);
+
         return;
     }
 
-    query_data = g_new (QueryData, 1);
-    query_data->date_order_hash_table = g_hash_table_new_full (g_str_hash,
-                                                               g_str_equal,
-                                                               (GDestroyNotify) g_free,
-                                                               NULL);
+    query_data = g_new0 (QueryData, 1);
+    query_data->creation_dates = g_ptr_array_new_with_free_func ((GDestroyNotify) creation_date_free);
     query_data->dialog = dialog;
     query_data->selection_metadata = selection_metadata;
+    query_data->metadata_by_name = metadata_by_name;
     for (i = 0; i < G_N_ELEMENTS (metadata_tags_constants); i++)
     {
         query_data->has_metadata[i] = TRUE;
     }
+    query_data->parent_uri = nautilus_file_get_parent_uri (NAUTILUS_FILE (selection->data));
+    query_data->names = names;
     query_data->cancellable = cancellable;
 
-    /* Make an asynchronous query to the store */
-    tracker_sparql_connection_query_async (connection,
-                                           query->str,
-                                           cancellable,
-                                           batch_rename_dialog_query_callback,
-                                           query_data);
+    /* Make asynchronous queries to the store, each for a batch of names */
+    sparql = build_metadata_sparql ();
+    n_batches = (names->len + METADATA_QUERY_BATCH_SIZE - 1) / METADATA_QUERY_BATCH_SIZE;
+
+    for (i = 0; i < MIN (n_batches, METADATA_QUERY_MAX_RUNNING); i++)
+    {
+        TrackerSparqlStatement *statement;
+
+        statement = tracker_sparql_connection_query_statement (connection,
+                                                               sparql->str,
+                                                               cancellable,
+                                                               &error);
+        if (statement == NULL)
+        {
+            g_warning ("Error on batch rename query for metadata: %s", error->message);
+            g_clear_error (&error);
+            break;
+        }
+
+        batches[query_data->n_queries_running] = g_new0 (QueryBatch, 1);
+        batches[query_data->n_queries_running]->query_data = query_data;
+        batches[query_data->n_queries_running]->statement = statement;
+        query_data->n_queries_running++;
+    }
+
+    if (query_data->n_queries_running == 0)
+    {
+        query_data->cancelled = g_cancellable_is_cancelled (cancellable);
+        query_data_finish (query_data);
+
+        return;
+    }
 
-    g_string_free (query, TRUE);
+    /* Started once all are counted, so that none finishes the query data early */
+    n_batches = query_data->n_queries_running;
+    for (i = 0; i < n_batches; i++)
+    {
+        query_batch_run (batches[i]);
+    }
 }
 
 GList *
@@ -22,12 +22,27 @@
 #include <gtk/gtk.h>
 #include <tracker-sparql.h>
 
-GList* batch_rename_dialog_get_new_names_list          (NautilusBatchRenameDialogMode  mode,
-                                                        GList                         *selection,
+/* What the new name of a file is computed from, copied from the file so
+ * that the new names can be computed in a worker thread */
+typedef struct
+{
+    gchar *name;
+    gchar *display_name;
+    gchar *extension;
+    gboolean is_directory;
+} BatchRenameSource;
+
+GPtrArray* batch_rename_sources_new                    (GList                         *selection);
+
+/* Returns the new names, as GStrings in the order of @sources, or NULL if
+ * @cancellable was cancelled. Safe to call from a worker thread. */
+GPtrArray* batch_rename_get_new_names                  (NautilusBatchRenameDialogMode  mode,
+                                                        GPtrArray                     *sources,
                                                         GList                         *tags_list,
                                                         GList                         *selection_metadata,
                                                         gchar                         *entry_text,
-                                                        gchar                         *replace_text);
+                                                        gchar                         *replace_text,
+                                                        GCancellable                  *cancellable);
 
 GList* file_names_list_has_duplicates                      (NautilusBatchRenameDialog   *dialog,
                                                             NautilusDirectory           *model,
@@ -52,10 +67,29 @@ void conflict_data_free                         (gpointer mem);
 
 GList* batch_rename_files_get_distinct_parents  (GList *selection);
 
-gboolean file_name_conflicts_with_results       (GList        *selection,
-                                                 GList        *new_names,
-                                                 GString      *old_name,
-                                                 gchar        *parent_uri);
+/* A file of the selection, with its new name */
+typedef struct
+{
+    gint index;
+    gchar *name;
+    /* Owned by the list of new names */
+    GString *new_name;
+} BatchRenameEntry;
+
+/* The files of the selection in a directory */
+typedef struct
+{
+    GPtrArray *entries;         /* BatchRenameEntry, in selection order */
+    GHashTable *by_name;        /* Name -> BatchRenameEntry */
+} BatchRenameParent;
+
+/* Parent URI -> BatchRenameParent, built once for a list of new names */
+GHashTable* batch_rename_files_index_new        (GList        *selection,
+                                                 GList        *new_names);
+
+gboolean file_name_conflicts_with_results       (GHashTable   *files_index,
+                                                 const gchar  *parent_uri,
+                                                 GString      *old_name);
 
 GString* batch_rename_replace_label_text        (gchar             *label,
                                                  const gchar       *substr);
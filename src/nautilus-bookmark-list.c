@@ -25,9 +25,11 @@
 #include <config.h>
 #include "nautilus-bookmark-list.h"
 
+#include "nautilus-executor.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-file.h"
 #include "nautilus-icon-names.h"
+#include "nautilus-profile.h"
 
 #include <gio/gio.h>
 #include <string.h>
@@ -44,6 +46,7 @@ struct _NautilusBookmarkList
     GList *list;
     GFileMonitor *monitor;
     GQueue *pending_ops;
+    gint64 load_begin_time;
 };
 
 enum
@@ -373,6 +376,9 @@ load_callback (GObject      *source_object,
     g_signal_emit (self, signals[CHANGED], 0);
     op_processed_cb (self);
 
+    nautilus_trace_span ("bookmarks load", self->load_begin_time,
+                         "%u bookmarks", g_list_length (self->list));
+
     g_strfreev (lines);
 }
 
@@ -414,10 +420,12 @@ load_file_async (NautilusBookmarkList *self)
     /* Wipe out old list. */
     clear (self);
 
+    self->load_begin_time = g_get_monotonic_time ();
+
     task = g_task_new (G_OBJECT (self),
                        NULL,
                        load_callback, NULL);
-    g_task_run_in_thread (task, load_io_thread);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_METADATA, task, load_io_thread);
 }
 
 static void
@@ -551,7 +559,7 @@ save_file_async (NautilusBookmarkList *self)
     contents = g_string_free (bookmark_string, FALSE);
     g_task_set_task_data (task, contents, g_free);
 
-    g_task_run_in_thread (task, save_io_thread);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_METADATA, task, save_io_thread);
 }
 
 static void
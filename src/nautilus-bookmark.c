@@ -55,6 +55,14 @@ enum
 
 #define ELLIPSISED_MENU_ITEM_MIN_CHARS  32
 
+/* Existence checks of bookmarks to stale network mounts can hang in stat()
+ * without end, each taking a GIO worker. Only a few run at once, so the
+ * rest of the GIO pool stays free, and one that takes too long is given
+ * up on, leaving the bookmark as it was and letting the next one run.
+ */
+#define MAX_EXISTS_CHECKS 4
+#define EXISTS_CHECK_TIMEOUT_SECS 3
+
 static GParamSpec *properties[NUM_PROPERTIES] = { NULL };
 static guint signals[LAST_SIGNAL];
 
@@ -74,9 +82,17 @@ struct _NautilusBookmark
     gboolean exists;
     guint exists_id;
     GCancellable *cancellable;
+    guint exists_timeout_id;
+    gboolean exists_check_queued;
 };
 
+/* Bookmarks waiting for their existence check, and the checks running */
+static GQueue exists_check_queue = G_QUEUE_INIT;
+static guint n_exists_checks = 0;
+static guint exists_check_idle_id = 0;
+
 static void nautilus_bookmark_disconnect_file (NautilusBookmark *file);
+static void exists_check_done (NautilusBookmark *bookmark);
 
 G_DEFINE_TYPE (NautilusBookmark, nautilus_bookmark, G_TYPE_OBJECT);
 
@@ -341,10 +357,18 @@ nautilus_bookmark_disconnect_file (NautilusBookmark *bookmark)
         g_clear_object (&bookmark->file);
     }
 
+    if (bookmark->exists_check_queued)
+    {
+        g_queue_remove (&exists_check_queue, bookmark);
+        bookmark->exists_check_queued = FALSE;
+    }
+
     if (bookmark->cancellable != NULL)
     {
         g_cancellable_cancel (bookmark->cancellable);
         g_clear_object (&bookmark->cancellable);
+
+        exists_check_done (bookmark);
     }
 
     if (bookmark->exists_id != 0)
@@ -433,6 +457,7 @@ exists_query_info_ready_cb (GObject      *source,
     info = g_file_query_info_finish (G_FILE (source), res, &error);
     if (!info && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
+        /* Disconnected or timed out, already accounted for */
         return;
     }
 
@@ -441,13 +466,92 @@ exists_query_info_ready_cb (GObject      *source,
     if (info)
     {
         exists = TRUE;
-
-        g_clear_object (&bookmark->cancellable);
     }
 
+    g_clear_object (&bookmark->cancellable);
+    exists_check_done (bookmark);
+
     nautilus_bookmark_set_exists (bookmark, exists);
 }
 
+static gboolean
+exists_check_timeout_cb (gpointer user_data)
+{
+    NautilusBookmark *bookmark = user_data;
+
+    DEBUG ("%s: existence check timed out", nautilus_bookmark_get_name (bookmark));
+
+    bookmark->exists_timeout_id = 0;
+
+    g_cancellable_cancel (bookmark->cancellable);
+    g_clear_object (&bookmark->cancellable);
+
+    exists_check_done (bookmark);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+start_exists_check (NautilusBookmark *bookmark)
+{
+    n_exists_checks++;
+
+    bookmark->cancellable = g_cancellable_new ();
+    bookmark->exists_timeout_id = g_timeout_add_seconds (EXISTS_CHECK_TIMEOUT_SECS,
+                                                         exists_check_timeout_cb,
+                                                         bookmark);
+
+    g_file_query_info_async (bookmark->location,
+                             G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                             0, G_PRIORITY_DEFAULT,
+                             bookmark->cancellable,
+                             exists_query_info_ready_cb, bookmark);
+}
+
+static gboolean
+exists_check_idle_cb (gpointer user_data)
+{
+    NautilusBookmark *bookmark;
+
+    exists_check_idle_id = 0;
+
+    while (n_exists_checks < MAX_EXISTS_CHECKS &&
+           (bookmark = g_queue_pop_head (&exists_check_queue)) != NULL)
+    {
+        bookmark->exists_check_queued = FALSE;
+        start_exists_check (bookmark);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Checks are started from a low priority idle, so that the bookmarks,
+ * already shown from the bookmarks file, don't hold up the first paint.
+ */
+static void
+schedule_exists_checks (void)
+{
+    if (exists_check_idle_id != 0 ||
+        n_exists_checks >= MAX_EXISTS_CHECKS ||
+        g_queue_is_empty (&exists_check_queue))
+    {
+        return;
+    }
+
+    exists_check_idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                            exists_check_idle_cb,
+                                            NULL, NULL);
+}
+
+static void
+exists_check_done (NautilusBookmark *bookmark)
+{
+    g_clear_handle_id (&bookmark->exists_timeout_id, g_source_remove);
+
+    n_exists_checks--;
+    schedule_exists_checks ();
+}
+
 static void
 nautilus_bookmark_update_exists (NautilusBookmark *bookmark)
 {
@@ -460,17 +564,16 @@ nautilus_bookmark_update_exists (NautilusBookmark *bookmark)
         return;
     }
 
-    if (bookmark->cancellable != NULL)
+    if (bookmark->cancellable != NULL ||
+        bookmark->exists_check_queued)
     {
         return;
     }
 
-    bookmark->cancellable = g_cancellable_new ();
-    g_file_query_info_async (bookmark->location,
-                             G_FILE_ATTRIBUTE_STANDARD_TYPE,
-                             0, G_PRIORITY_DEFAULT,
-                             bookmark->cancellable,
-                             exists_query_info_ready_cb, bookmark);
+    bookmark->exists_check_queued = TRUE;
+    g_queue_push_tail (&exists_check_queue, bookmark);
+
+    schedule_exists_checks ();
 }
 
 /* GObject methods */
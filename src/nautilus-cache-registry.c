@@ -0,0 +1,249 @@
+/* nautilus-cache-registry.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-cache-registry.h"
+
+#include <gio/gio.h>
+
+#include "nautilus-global-preferences.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_FILE
+#include "nautilus-debug.h"
+
+#define BUDGET_CHECK_INTERVAL_SECONDS 60
+
+typedef struct
+{
+    guint id;
+    char *name;
+    NautilusCachePriority priority;
+    NautilusCacheSizeFunc size_func;
+    NautilusCacheShedFunc shed_func;
+    gpointer user_data;
+    guint64 shed_count;
+} RegisteredCache;
+
+/* Of RegisteredCache, by priority */
+static GList *caches = NULL;
+static guint last_id = 0;
+static GMemoryMonitor *memory_monitor = NULL;
+static guint budget_check_id = 0;
+
+static gsize
+get_budget (void)
+{
+    return g_settings_get_uint64 (nautilus_preferences,
+                                  NAUTILUS_PREFERENCES_CACHE_MEMORY_BUDGET) * 1024 * 1024;
+}
+
+static gsize
+get_total_size (void)
+{
+    gsize total;
+
+    total = 0;
+    for (GList *l = caches; l != NULL; l = l->next)
+    {
+        RegisteredCache *cache = l->data;
+
+        total += cache->size_func (cache->user_data);
+    }
+
+    return total;
+}
+
+/* Asks the caches to shed at @level, the cheapest first, until they are
+ * down to @target bytes together. */
+static void
+shed_to (NautilusCacheShedLevel level,
+         gsize                  target)
+{
+    gsize total;
+    GList *next;
+
+    total = get_total_size ();
+    for (GList *l = caches; l != NULL && total > target; l = next)
+    {
+        RegisteredCache *cache = l->data;
+        gsize size;
+
+        /* Shedding may unregister caches */
+        next = l->next;
+
+        size = cache->size_func (cache->user_data);
+        if (size == 0)
+        {
+            continue;
+        }
+
+        DEBUG ("Shedding %s at level %d, %" G_GSIZE_FORMAT " bytes",
+               cache->name, level, size);
+
+        cache->shed_func (level, cache->user_data);
+        cache->shed_count++;
+
+        total = get_total_size ();
+    }
+}
+
+void
+nautilus_cache_registry_shed (NautilusCacheShedLevel level)
+{
+    gsize total;
+
+    total = get_total_size ();
+    switch (level)
+    {
+        case NAUTILUS_CACHE_SHED_SOME:
+        {
+            shed_to (level, total / 2);
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_MOST:
+        {
+            shed_to (level, total / 4);
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_ALL:
+        {
+            shed_to (level, 0);
+        }
+        break;
+    }
+}
+
+static void
+low_memory_warning (GMemoryMonitor             *monitor,
+                    GMemoryMonitorWarningLevel  level,
+                    gpointer                    user_data)
+{
+    if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL)
+    {
+        nautilus_cache_registry_shed (NAUTILUS_CACHE_SHED_ALL);
+    }
+    else if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM)
+    {
+        nautilus_cache_registry_shed (NAUTILUS_CACHE_SHED_MOST);
+    }
+    else
+    {
+        nautilus_cache_registry_shed (NAUTILUS_CACHE_SHED_SOME);
+    }
+}
+
+static gboolean
+check_budget (gpointer user_data)
+{
+    shed_to (NAUTILUS_CACHE_SHED_SOME, get_budget ());
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gint
+compare_priority (gconstpointer a,
+                  gconstpointer b)
+{
+    const RegisteredCache *cache_a = a;
+    const RegisteredCache *cache_b = b;
+
+    return cache_a->priority - cache_b->priority;
+}
+
+guint
+nautilus_cache_registry_add (const char            *name,
+                             NautilusCachePriority  priority,
+                             NautilusCacheSizeFunc  size_func,
+                             NautilusCacheShedFunc  shed_func,
+                             gpointer               user_data)
+{
+    RegisteredCache *cache;
+
+    g_return_val_if_fail (size_func != NULL && shed_func != NULL, 0);
+
+    if (memory_monitor == NULL)
+    {
+        memory_monitor = g_memory_monitor_dup_default ();
+        g_signal_connect (memory_monitor, "low-memory-warning",
+                          G_CALLBACK (low_memory_warning), NULL);
+    }
+
+    cache = g_new0 (RegisteredCache, 1);
+    cache->id = ++last_id;
+    cache->name = g_strdup (name);
+    cache->priority = priority;
+    cache->size_func = size_func;
+    cache->shed_func = shed_func;
+    cache->user_data = user_data;
+
+    /* Stable, so the first registered of a priority sheds first */
+    caches = g_list_insert_sorted (caches, cache, compare_priority);
+
+    if (budget_check_id == 0)
+    {
+        budget_check_id = g_timeout_add_seconds (BUDGET_CHECK_INTERVAL_SECONDS,
+                                                 check_budget, NULL);
+    }
+
+    return cache->id;
+}
+
+void
+nautilus_cache_registry_remove (guint id)
+{
+    for (GList *l = caches; l != NULL; l = l->next)
+    {
+        RegisteredCache *cache = l->data;
+
+        if (cache->id == id)
+        {
+            caches = g_list_delete_link (caches, l);
+            g_free (cache->name);
+            g_free (cache);
+            break;
+        }
+    }
+
+    if (caches == NULL)
+    {
+        g_clear_handle_id (&budget_check_id, g_source_remove);
+    }
+}
+
+char *
+nautilus_cache_registry_get_stats (void)
+{
+    GString *string;
+
+    string = g_string_new (NULL);
+    g_string_append_printf (string,
+                            "caches: %" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT " bytes\n",
+                            get_total_size (), get_budget ());
+
+    for (GList *l = caches; l != NULL; l = l->next)
+    {
+        RegisteredCache *cache = l->data;
+
+        g_string_append_printf (string,
+                                "  %s: %" G_GSIZE_FORMAT " bytes, priority %d, shed %" G_GUINT64_FORMAT " times\n",
+                                cache->name, cache->size_func (cache->user_data),
+                                cache->priority, cache->shed_count);
+    }
+
+    return g_string_free (string, FALSE);
+}
@@ -0,0 +1,60 @@
+/* nautilus-cache-registry.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* The cache registry keeps the memory of the caches of all subsystems in
+ * one budget. When the system is low on memory, or the caches together
+ * go over the budget, they are asked to shed in priority order, the
+ * cheapest to get back going first, until they are down to the target.
+ * Main thread only.
+ */
+
+typedef enum
+{
+    /* Loaded again from disk: thumbnails, icons */
+    NAUTILUS_CACHE_PRIORITY_RELOADABLE,
+    /* Worked out again with more I/O: counts, search results */
+    NAUTILUS_CACHE_PRIORITY_RECOMPUTABLE,
+} NautilusCachePriority;
+
+typedef enum
+{
+    NAUTILUS_CACHE_SHED_SOME, /* down to about half */
+    NAUTILUS_CACHE_SHED_MOST, /* down to about a quarter */
+    NAUTILUS_CACHE_SHED_ALL,
+} NautilusCacheShedLevel;
+
+/* Returns the bytes held by the cache, estimated where needed. */
+typedef gsize (*NautilusCacheSizeFunc) (gpointer user_data);
+typedef void  (*NautilusCacheShedFunc) (NautilusCacheShedLevel level,
+                                        gpointer               user_data);
+
+/* Returns an id for nautilus_cache_registry_remove(). */
+guint  nautilus_cache_registry_add       (const char            *name,
+                                          NautilusCachePriority  priority,
+                                          NautilusCacheSizeFunc  size_func,
+                                          NautilusCacheShedFunc  shed_func,
+                                          gpointer               user_data);
+void   nautilus_cache_registry_remove    (guint                  id);
+
+/* Sheds all the caches at @level, as on a memory warning. */
+void   nautilus_cache_registry_shed      (NautilusCacheShedLevel level);
+
+/* The size of every cache and the budget, as text for debugging. */
+char  *nautilus_cache_registry_get_stats (void);
@@ -59,6 +59,9 @@
  */
 #define KEYBOARD_ICON_REVEAL_TIMEOUT 10
 
+/* Time spent at once updating off-screen icons after a zoom change */
+#define UPDATE_STALE_IMAGES_BATCH_USECS (8 * G_TIME_SPAN_MILLISECOND)
+
 #define CONTEXT_MENU_TIMEOUT_INTERVAL 500
 
 /* Maximum amount of milliseconds the mouse button is allowed to stay down
@@ -1080,12 +1083,330 @@ sort_icons (NautilusCanvasContainer  *container,
     *icons = g_list_sort_with_data (*icons, compare_icons, container);
 }
 
+/* The rows are kept, the next layout reuses those before the first
+ * icon that changed.
+ */
+static void
+invalidate_layout_rows (NautilusCanvasContainer *container)
+{
+    container->details->layout_rows_valid = FALSE;
+    container->details->layout_rows_generation++;
+}
+
+static void
+add_layout_row (GArray   *rows,
+                GList    *line_start,
+                GList    *line_end,
+                guint     first_index,
+                double    layout_y,
+                gboolean  regular)
+{
+    NautilusCanvasLayoutRow row;
+    NautilusCanvasIcon *icon;
+    double y0, y1;
+    GList *p;
+
+    row.start = line_start;
+    row.first_index = first_index;
+    row.n_icons = 0;
+    row.layout_y = layout_y;
+    row.regular = regular;
+    row.y0 = G_MAXDOUBLE;
+    row.y1 = -G_MAXDOUBLE;
+    for (p = line_start; p != line_end; p = p->next)
+    {
+        icon = p->data;
+
+        nautilus_canvas_item_get_bounds_for_entire_item (icon->item,
+                                                         NULL, &y0, NULL, &y1);
+        row.y0 = MIN (row.y0, y0);
+        row.y1 = MAX (row.y1, y1);
+        row.n_icons++;
+    }
+    row.max_y1 = row.y1;
+
+    g_array_append_val (rows, row);
+}
+
+static void
+update_layout_rows_max_y1 (GArray *rows,
+                           guint   from)
+{
+    NautilusCanvasLayoutRow *row;
+    guint i;
+
+    for (i = from; i < rows->len; i++)
+    {
+        row = &g_array_index (rows, NautilusCanvasLayoutRow, i);
+        row->max_y1 = row->y1;
+        if (i > 0)
+        {
+            row->max_y1 = MAX (row->max_y1,
+                               g_array_index (rows, NautilusCanvasLayoutRow, i - 1).max_y1);
+        }
+    }
+}
+
+/* Returns the index of the first icon which changed or moved in the list
+ * since the last layout, and that of the last one in @last_return.
+ */
+static guint
+find_icons_needing_layout (GList *icons,
+                           guint *last_return,
+                           guint *n_icons_return)
+{
+    NautilusCanvasIcon *icon;
+    guint first, last, k;
+    GList *p;
+
+    first = G_MAXUINT;
+    last = 0;
+    for (p = icons, k = 0; p != NULL; p = p->next, k++)
+    {
+        icon = p->data;
+
+        if (icon->needs_layout || icon->layout_index != k)
+        {
+            first = MIN (first, k);
+            last = k;
+        }
+    }
+
+    *last_return = last;
+    *n_icons_return = k;
+
+    return MIN (first, k);
+}
+
+/* Finds the layout rows [start, end) which may have icons within the
+ * given world y range.
+ */
+static gboolean
+find_layout_rows (NautilusCanvasContainer *container,
+                  double                   y0,
+                  double                   y1,
+                  guint                   *start,
+                  guint                   *end)
+{
+    GArray *rows;
+    guint low, high, middle;
+
+    rows = container->details->layout_rows;
+    if (rows == NULL || !container->details->layout_rows_valid)
+    {
+        return FALSE;
+    }
+
+    low = 0;
+    high = rows->len;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (g_array_index (rows, NautilusCanvasLayoutRow, middle).max_y1 < y0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    *start = low;
+
+    high = rows->len;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (g_array_index (rows, NautilusCanvasLayoutRow, middle).y0 <= y1)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    *end = low;
+
+    return TRUE;
+}
+
+gboolean
+nautilus_canvas_container_get_icons_in_range (NautilusCanvasContainer  *container,
+                                              double                    y0,
+                                              double                    y1,
+                                              GList                   **start,
+                                              guint                    *n_icons)
+{
+    guint start_row, end_row, i;
+
+    if (!find_layout_rows (container, y0, y1, &start_row, &end_row))
+    {
+        return FALSE;
+    }
+
+    *start = NULL;
+    *n_icons = 0;
+    for (i = start_row; i < end_row; i++)
+    {
+        NautilusCanvasLayoutRow *row;
+
+        row = &g_array_index (container->details->layout_rows, NautilusCanvasLayoutRow, i);
+        if (*start == NULL)
+        {
+            *start = row->start;
+        }
+        *n_icons += row->n_icons;
+    }
+
+    return TRUE;
+}
+
 static void
 resort (NautilusCanvasContainer *container)
 {
+    GList *l;
+
+    invalidate_layout_rows (container);
     sort_icons (container, &container->details->icons);
     sort_selection (container);
     cache_icon_positions (container);
+
+    for (l = container->details->icons; l != NULL; l = l->next)
+    {
+        NautilusCanvasIcon *icon = l->data;
+
+        icon->unsorted = FALSE;
+    }
+    container->details->n_unsorted_icons = 0;
+}
+
+/* The icons added, or moved by a change, since the last sort are at the
+ * start of the list. Only those are sorted, then merged with the others,
+ * which keep their order, ahead of the new icons comparing equal. The
+ * icons at the top keep their place, and their layout, as more come in.
+ */
+static void
+merge_unsorted_icons (NautilusCanvasContainer *container)
+{
+    NautilusCanvasContainerDetails *details;
+    NautilusCanvasIcon *icon;
+    GList *unsorted, *sorted, *last;
+    GList *merged, *tail, *node;
+    guint i;
+
+    details = container->details;
+
+    unsorted = details->icons;
+    last = unsorted;
+    for (i = 0; i < details->n_unsorted_icons; i++)
+    {
+        icon = last->data;
+        icon->unsorted = FALSE;
+        if (i + 1 < details->n_unsorted_icons)
+        {
+            last = last->next;
+        }
+    }
+    sorted = last->next;
+    last->next = NULL;
+    if (sorted != NULL)
+    {
+        sorted->prev = NULL;
+    }
+    details->n_unsorted_icons = 0;
+
+    sort_icons (container, &unsorted);
+
+    merged = NULL;
+    tail = NULL;
+    while (unsorted != NULL)
+    {
+        if (sorted != NULL && compare_icons (unsorted->data, sorted->data, container) >= 0)
+        {
+            node = sorted;
+            sorted = sorted->next;
+        }
+        else
+        {
+            node = unsorted;
+            unsorted = unsorted->next;
+        }
+
+        node->prev = tail;
+        node->next = NULL;
+        if (tail != NULL)
+        {
+            tail->next = node;
+        }
+        else
+        {
+            merged = node;
+        }
+        tail = node;
+    }
+
+    /* The rest of the sorted icons follow as they are */
+    tail->next = sorted;
+    if (sorted != NULL)
+    {
+        sorted->prev = tail;
+    }
+
+    details->icons = merged;
+    cache_icon_positions (container);
+}
+
+static void
+update_icons_order (NautilusCanvasContainer *container)
+{
+    if (container->details->needs_resort)
+    {
+        resort (container);
+        container->details->needs_resort = FALSE;
+    }
+    else if (container->details->n_unsorted_icons > 0)
+    {
+        merge_unsorted_icons (container);
+    }
+}
+
+/* A changed icon still sorting between its neighbours keeps its place,
+ * otherwise it goes to the start of the list, to be merged. */
+static void
+reorder_changed_icon (NautilusCanvasContainer *container,
+                      NautilusCanvasIcon      *icon)
+{
+    NautilusCanvasContainerDetails *details;
+    GList *prev, *next;
+
+    details = container->details;
+    if (details->needs_resort || icon->unsorted)
+    {
+        return;
+    }
+
+    prev = icon->link->prev;
+    next = icon->link->next;
+    if ((prev == NULL ||
+         ((NautilusCanvasIcon *) prev->data)->unsorted ||
+         compare_icons (prev->data, icon, container) <= 0) &&
+        (next == NULL ||
+         compare_icons (icon, next->data, container) <= 0))
+    {
+        return;
+    }
+
+    invalidate_layout_rows (container);
+    details->icons = g_list_remove_link (details->icons, icon->link);
+    details->icons = g_list_concat (icon->link, details->icons);
+    icon->unsorted = TRUE;
+    details->n_unsorted_icons++;
+
+    if (icon->is_selected)
+    {
+        details->selection_needs_resort = TRUE;
+    }
 }
 
 typedef struct
@@ -1140,9 +1461,16 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
                            GList                   *icons,
                            double                   start_y)
 {
-    GList *p, *line_start;
+    NautilusCanvasContainerDetails *details;
+    GList *p, *line_start, *start;
     NautilusCanvasIcon *icon;
-    double canvas_width, y;
+    GArray *old_rows, *rows;
+    NautilusCanvasLayoutRow *row;
+    guint first_changed, last_changed, n_icons, old_n_icons;
+    guint k, line_index, first_row, old_row;
+    guint low, high, middle;
+    gboolean converged, line_regular;
+    double canvas_width, y, line_y;
     double available_width;
     GArray *positions;
     IconPositions *position;
@@ -1168,6 +1496,7 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
         return;
     }
 
+    details = container->details;
     positions = g_array_new (FALSE, FALSE, sizeof (IconPositions));
     gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
 
@@ -1227,14 +1556,78 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
 
     grid_width = MAX (min_grid_width, grid_width);
 
-    line_width = 0;
-    line_start = icons;
+    start = icons;
+    k = 0;
     y = start_y + CONTAINER_PAD_TOP;
+    first_row = 0;
+    last_changed = G_MAXUINT;
+
+    /* Only lay out again the lines from the first icon that changed or
+     * moved on, as long as the lines have the same geometry.
+     */
+    old_rows = icons == details->icons ? details->layout_rows : NULL;
+    rows = g_array_new (FALSE, FALSE, sizeof (NautilusCanvasLayoutRow));
+    if (old_rows != NULL && old_rows->len > 0 &&
+        details->layout_rows_grid_width == grid_width &&
+        details->layout_rows_canvas_width == canvas_width)
+    {
+        first_changed = find_icons_needing_layout (icons, &last_changed, &n_icons);
+        row = &g_array_index (old_rows, NautilusCanvasLayoutRow, old_rows->len - 1);
+        old_n_icons = row->first_index + row->n_icons;
+
+        if (first_changed == n_icons && n_icons == old_n_icons)
+        {
+            /* Nothing moved. */
+            g_array_unref (rows);
+            g_array_free (positions, TRUE);
+            details->layout_rows_valid = TRUE;
+            return;
+        }
+        first_changed = MIN (first_changed, n_icons - 1);
+
+        low = 0;
+        high = old_rows->len;
+        while (high - low > 1)
+        {
+            middle = low + (high - low) / 2;
+            if (g_array_index (old_rows, NautilusCanvasLayoutRow, middle).first_index <= first_changed)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        /* The changed icon might fit at the end of the line before. */
+        first_row = low > 0 ? low - 1 : 0;
+
+        if (first_row > 0)
+        {
+            /* The first icon of the line might be gone, but the line
+             * before is untouched.
+             */
+            row = &g_array_index (old_rows, NautilusCanvasLayoutRow, first_row - 1);
+            start = g_list_nth (row->start, row->n_icons);
+            g_array_append_vals (rows, old_rows->data, first_row);
+        }
+
+        row = &g_array_index (old_rows, NautilusCanvasLayoutRow, first_row);
+        k = row->first_index;
+        y = row->layout_y;
+    }
+    old_row = first_row + 1;
+    converged = FALSE;
+
+    line_width = 0;
+    line_start = start;
+    line_index = k;
+    line_regular = TRUE;
     i = 0;
 
     max_height_above = 0;
     max_height_below = 0;
-    for (p = icons; p != NULL; p = p->next)
+    for (p = start; p != NULL; p = p->next, k++)
     {
         icon = p->data;
 
@@ -1258,18 +1651,43 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
         /* If this icon doesn't fit, it's time to lay out the line that's queued up. */
         if (line_start != p && line_width + icon_width >= canvas_width)
         {
+            line_y = y;
+
             /* Advance to the baseline. */
             y += ICON_PAD_TOP + max_height_above;
 
             lay_down_one_line (container, line_start, p, y, max_height_above, positions, FALSE);
+            add_layout_row (rows, line_start, p, line_index, line_y, line_regular);
 
             /* Advance to next line. */
             y += max_height_below + ICON_PAD_BOTTOM;
 
             line_width = 0;
             line_start = p;
+            line_index = k;
+            line_regular = TRUE;
             i = 0;
 
+            /* Past the last change, the rest of the old lines is still
+             * right as soon as one of them starts at the same place.
+             */
+            if (old_rows != NULL && k > last_changed)
+            {
+                while (old_row < old_rows->len &&
+                       g_array_index (old_rows, NautilusCanvasLayoutRow, old_row).first_index < k)
+                {
+                    old_row++;
+                }
+
+                if (old_row < old_rows->len &&
+                    g_array_index (old_rows, NautilusCanvasLayoutRow, old_row).first_index == k &&
+                    g_array_index (old_rows, NautilusCanvasLayoutRow, old_row).layout_y == y)
+                {
+                    converged = TRUE;
+                    break;
+                }
+            }
+
             max_height_above = height_above;
             max_height_below = height_below;
         }
@@ -1285,6 +1703,8 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
             }
         }
 
+        line_regular = line_regular && icon_width == grid_width;
+
         g_array_set_size (positions, i + 1);
         position = &g_array_index (positions, IconPositions, i++);
         position->width = icon_width;
@@ -1295,18 +1715,45 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
 
         /* Add this icon. */
         line_width += icon_width;
+
+        icon->layout_index = k;
+        icon->needs_layout = FALSE;
     }
 
-    /* Lay down that last line of icons. */
-    if (line_start != NULL)
+    if (converged)
+    {
+        g_array_append_vals (rows,
+                             &g_array_index (old_rows, NautilusCanvasLayoutRow, old_row),
+                             old_rows->len - old_row);
+    }
+    else if (line_start != NULL)
     {
+        /* Lay down that last line of icons. */
+        line_y = y;
+
         /* Advance to the baseline. */
         y += ICON_PAD_TOP + max_height_above;
 
         lay_down_one_line (container, line_start, NULL, y, max_height_above, positions, FALSE);
+        add_layout_row (rows, line_start, NULL, line_index, line_y, line_regular);
     }
 
     g_array_free (positions, TRUE);
+
+    update_layout_rows_max_y1 (rows, first_row);
+    if (icons == details->icons)
+    {
+        g_clear_pointer (&details->layout_rows, g_array_unref);
+        details->layout_rows = rows;
+        details->layout_rows_grid_width = grid_width;
+        details->layout_rows_canvas_width = canvas_width;
+        details->layout_rows_valid = TRUE;
+        details->layout_rows_generation++;
+    }
+    else
+    {
+        g_array_unref (rows);
+    }
 }
 
 static double
@@ -1363,11 +1810,7 @@ redo_layout_internal (NautilusCanvasContainer *container)
         return;
     }
 
-    if (container->details->needs_resort)
-    {
-        resort (container);
-        container->details->needs_resort = FALSE;
-    }
+    update_icons_order (container);
     lay_down_icons (container, container->details->icons, 0);
 
     if (nautilus_canvas_container_is_layout_rtl (container))
@@ -1387,8 +1830,8 @@ redo_layout_callback (gpointer callback_data)
     NautilusCanvasContainer *container;
 
     container = NAUTILUS_CANVAS_CONTAINER (callback_data);
-    redo_layout_internal (container);
     container->details->idle_id = 0;
+    redo_layout_internal (container);
 
     return FALSE;
 }
@@ -1435,7 +1878,10 @@ button_event_modifies_selection (GdkEventButton *event)
     return (event->state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) != 0;
 }
 
-/* invalidate the cached label sizes for all the icons */
+/* invalidate the cached label sizes for all the icons. Measuring labels
+ * is the costly part of a layout, so off-screen icons keep their old size
+ * until they get visible.
+ */
 static void
 invalidate_label_sizes (NautilusCanvasContainer *container)
 {
@@ -1446,7 +1892,15 @@ invalidate_label_sizes (NautilusCanvasContainer *container)
     {
         icon = p->data;
 
-        nautilus_canvas_item_invalidate_label_size (icon->item);
+        if (icon->is_visible)
+        {
+            nautilus_canvas_item_invalidate_label_size (icon->item);
+            icon->needs_layout = TRUE;
+        }
+        else
+        {
+            icon->label_size_stale = TRUE;
+        }
     }
 }
 
@@ -1535,43 +1989,72 @@ static void
 rubberband_select (NautilusCanvasContainer *container,
                    const EelDRect          *current_rect)
 {
+    NautilusCanvasRubberbandInfo *band_info;
+    NautilusCanvasLayoutRow *row;
     GList *p;
-    gboolean selection_changed, is_in, canvas_rect_calculated;
+    gboolean selection_changed, is_in, use_rows;
     NautilusCanvasIcon *icon;
     EelIRect canvas_rect;
     EelCanvas *canvas;
+    guint start, end, i, j;
 
+    band_info = &container->details->rubberband_info;
     selection_changed = FALSE;
-    canvas_rect_calculated = FALSE;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
+    /* All the canvas items are in the same coordinate space */
+    canvas = EEL_CANVAS (container);
+    eel_canvas_w2c (canvas,
+                    current_rect->x0,
+                    current_rect->y0,
+                    &canvas_rect.x0,
+                    &canvas_rect.y0);
+    eel_canvas_w2c (canvas,
+                    current_rect->x1,
+                    current_rect->y1,
+                    &canvas_rect.x1,
+                    &canvas_rect.y1);
+
+    /* Only the lines under the rectangle, and the ones that were under it
+     * the last time, can have changed.
+     */
+    use_rows = find_layout_rows (container, current_rect->y0, current_rect->y1,
+                                 &start, &end);
+    if (use_rows && band_info->rows_generation == container->details->layout_rows_generation)
     {
-        icon = p->data;
+        for (i = MIN (start, band_info->rows_start); i < MAX (end, band_info->rows_end); i++)
+        {
+            row = &g_array_index (container->details->layout_rows, NautilusCanvasLayoutRow, i);
+            for (p = row->start, j = 0; j < row->n_icons; p = p->next, j++)
+            {
+                icon = p->data;
+
+                is_in = nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
 
-        if (!canvas_rect_calculated)
+                selection_changed |= icon_set_selected
+                                         (container, icon,
+                                         is_in ^ icon->was_selected_before_rubberband);
+            }
+        }
+    }
+    else
+    {
+        for (p = container->details->icons; p != NULL; p = p->next)
         {
-            /* Only do this calculation once, since all the canvas items
-             * we are interating are in the same coordinate space
-             */
-            canvas = EEL_CANVAS_ITEM (icon->item)->canvas;
-            eel_canvas_w2c (canvas,
-                            current_rect->x0,
-                            current_rect->y0,
-                            &canvas_rect.x0,
-                            &canvas_rect.y0);
-            eel_canvas_w2c (canvas,
-                            current_rect->x1,
-                            current_rect->y1,
-                            &canvas_rect.x1,
-                            &canvas_rect.y1);
-            canvas_rect_calculated = TRUE;
-        }
-
-        is_in = nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
+            icon = p->data;
 
-        selection_changed |= icon_set_selected
-                                 (container, icon,
-                                 is_in ^ icon->was_selected_before_rubberband);
+            is_in = nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
+
+            selection_changed |= icon_set_selected
+                                     (container, icon,
+                                     is_in ^ icon->was_selected_before_rubberband);
+        }
+    }
+
+    if (use_rows)
+    {
+        band_info->rows_generation = container->details->layout_rows_generation;
+        band_info->rows_start = start;
+        band_info->rows_end = end;
     }
 
     if (selection_changed)
@@ -1752,6 +2235,11 @@ start_rubberbanding (NautilusCanvasContainer *container,
         icon->was_selected_before_rubberband = icon->is_selected;
     }
 
+    /* Nothing is under the selection rectangle yet. */
+    band_info->rows_generation = details->layout_rows_generation;
+    band_info->rows_start = 0;
+    band_info->rows_end = 0;
+
     eel_canvas_window_to_world
         (EEL_CANVAS (container), event->x, event->y,
         &band_info->start_x, &band_info->start_y);
@@ -2646,6 +3134,130 @@ record_arrow_key_start (NautilusCanvasContainer *container,
     container->details->arrow_key_direction = direction;
 }
 
+/* Finds the icon next to @from in @direction from the lines of the last
+ * layout, as the scoring functions would, but without going through all
+ * the icons. Returns FALSE if the layout can't tell, for instance because
+ * the columns don't line up.
+ */
+static gboolean
+find_neighbor_in_layout_rows (NautilusCanvasContainer  *container,
+                              NautilusCanvasIcon       *from,
+                              GtkDirectionType          direction,
+                              gboolean                  wrap,
+                              NautilusCanvasIcon      **to)
+{
+    GArray *rows;
+    NautilusCanvasLayoutRow *row, *other_row;
+    GList *node;
+    guint low, high, middle;
+    guint column;
+    gboolean forward;
+
+    rows = container->details->layout_rows;
+    if (rows == NULL || !container->details->layout_rows_valid || rows->len == 0)
+    {
+        return FALSE;
+    }
+
+    low = 0;
+    high = rows->len;
+    while (high - low > 1)
+    {
+        middle = low + (high - low) / 2;
+        if (g_array_index (rows, NautilusCanvasLayoutRow, middle).first_index <= from->layout_index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    row = &g_array_index (rows, NautilusCanvasLayoutRow, low);
+    column = from->layout_index - row->first_index;
+    if (column >= row->n_icons)
+    {
+        return FALSE;
+    }
+    node = g_list_nth (row->start, column);
+    if (node == NULL || node->data != from)
+    {
+        return FALSE;
+    }
+
+    *to = NULL;
+
+    switch (direction)
+    {
+        case GTK_DIR_RIGHT:
+        case GTK_DIR_LEFT:
+        {
+            /* Lines are laid out from the right in RTL. */
+            forward = (direction == GTK_DIR_RIGHT) != nautilus_canvas_container_is_layout_rtl (container);
+            if (!wrap && (forward ? column + 1 == row->n_icons : column == 0))
+            {
+                return TRUE;
+            }
+
+            node = forward ? node->next : node->prev;
+            if (node != NULL)
+            {
+                *to = node->data;
+            }
+
+            return TRUE;
+        }
+
+        case GTK_DIR_DOWN:
+        {
+            if (low + 1 == rows->len)
+            {
+                return TRUE;
+            }
+
+            other_row = &g_array_index (rows, NautilusCanvasLayoutRow, low + 1);
+            if (!row->regular || !other_row->regular)
+            {
+                return FALSE;
+            }
+
+            /* The last line may be shorter. Then we go to its end. */
+            node = g_list_nth (other_row->start, MIN (column, other_row->n_icons - 1));
+            *to = node->data;
+
+            return TRUE;
+        }
+
+        case GTK_DIR_UP:
+        {
+            if (low == 0)
+            {
+                return TRUE;
+            }
+
+            other_row = &g_array_index (rows, NautilusCanvasLayoutRow, low - 1);
+            if (!row->regular || !other_row->regular)
+            {
+                return FALSE;
+            }
+
+            if (column < other_row->n_icons)
+            {
+                node = g_list_nth (other_row->start, column);
+                *to = node->data;
+            }
+
+            return TRUE;
+        }
+
+        default:
+        {
+            return FALSE;
+        }
+    }
+}
+
 static void
 keyboard_arrow_key (NautilusCanvasContainer *container,
                     GdkEventKey             *event,
@@ -2701,8 +3313,20 @@ keyboard_arrow_key (NautilusCanvasContainer *container,
                         (container, NULL,
                         empty_start, NULL);
     }
+    else if (find_neighbor_in_layout_rows (container, from, direction,
+                                           better_destination_fallback != NULL,
+                                           &to))
+    {
+        record_arrow_key_start (container, from, direction);
+
+        if (to == NULL)
+        {
+            to = from;
+        }
+    }
     else
     {
+        /* Scoring all the icons copes with any layout. */
         record_arrow_key_start (container, from, direction);
 
         to = find_best_icon
@@ -2971,6 +3595,8 @@ destroy (GtkWidget *object)
         container->details->align_idle_id = 0;
     }
 
+    unschedule_update_stale_images (container);
+
     if (container->details->selection_changed_id != 0)
     {
         g_source_remove (container->details->selection_changed_id);
@@ -3000,7 +3626,10 @@ finalize (GObject *object)
     g_hash_table_destroy (details->icon_set);
     details->icon_set = NULL;
 
+    g_clear_pointer (&details->layout_rows, g_array_unref);
+
     g_free (details->font);
+    g_clear_pointer (&details->font_description, pango_font_description_free);
 
     if (details->a11y_item_action_queue != NULL)
     {
@@ -3225,6 +3854,9 @@ style_updated (GtkWidget *widget)
 
     GTK_WIDGET_CLASS (nautilus_canvas_container_parent_class)->style_updated (widget);
 
+    /* The theme font may have changed. */
+    g_clear_pointer (&container->details->font_description, pango_font_description_free);
+
     if (gtk_widget_get_realized (widget))
     {
         nautilus_canvas_container_request_update_all_internal (container, TRUE);
@@ -4435,14 +5067,18 @@ nautilus_canvas_container_clear (NautilusCanvasContainer *container)
     clear_keyboard_rubberband_start (container);
     unschedule_keyboard_icon_reveal (container);
     set_pending_icon_to_reveal (container, NULL);
+    unschedule_update_stale_images (container);
     details->drop_target = NULL;
 
     for (p = details->icons; p != NULL; p = p->next)
     {
         icon_free (p->data);
     }
+    invalidate_layout_rows (container);
+    g_clear_pointer (&details->layout_rows, g_array_unref);
     g_list_free (details->icons);
     details->icons = NULL;
+    details->n_unsorted_icons = 0;
     g_list_free (details->new_icons);
     details->new_icons = NULL;
     g_list_free (details->selection);
@@ -4648,12 +5284,20 @@ icon_destroy (NautilusCanvasContainer *container,
 
     details = container->details;
 
-    item = g_list_find (details->icons, icon);
-    item = item->next ? item->next : item->prev;
+    item = icon->link->next ? icon->link->next : icon->link->prev;
     icon_to_focus = (item != NULL) ? item->data : NULL;
 
-    details->icons = g_list_remove (details->icons, icon);
+    invalidate_layout_rows (container);
+    details->icons = g_list_delete_link (details->icons, icon->link);
+    if (icon->unsorted)
+    {
+        details->n_unsorted_icons--;
+    }
     details->new_icons = g_list_remove (details->new_icons, icon);
+    if (details->stale_images != NULL)
+    {
+        g_ptr_array_remove (details->stale_images, icon);
+    }
     details->selection = g_list_remove (details->selection, icon->data);
     g_hash_table_remove (details->icon_set, icon->data);
 
@@ -4810,17 +5454,89 @@ nautilus_canvas_container_prioritize_thumbnailing (NautilusCanvasContainer *cont
     klass->prioritize_thumbnailing (container, icon->data);
 }
 
+static void
+update_icon_visibility (NautilusCanvasContainer *container,
+                        NautilusCanvasIcon      *icon,
+                        double                   min_y,
+                        double                   max_y)
+{
+    double x0, y0, x1, y1;
+    gboolean visible;
+
+    if (icon_is_positioned (icon))
+    {
+        eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+                                    &x0,
+                                    &y0,
+                                    &x1,
+                                    &y1);
+        eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+                             &x0,
+                             &y0);
+        eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+                             &x1,
+                             &y1);
+
+        visible = y1 >= min_y && y0 <= max_y;
+
+        icon->is_visible = visible;
+
+        if (visible)
+        {
+            if (icon->image_stale)
+            {
+                nautilus_canvas_container_update_icon (container, icon);
+                schedule_redo_layout (container);
+            }
+
+            nautilus_canvas_item_set_is_visible (icon->item, TRUE);
+            nautilus_canvas_container_prioritize_thumbnailing (container,
+                                                               icon);
+
+            if (icon->label_size_stale)
+            {
+                nautilus_canvas_item_invalidate_label_size (icon->item);
+                icon->label_size_stale = FALSE;
+                icon->needs_layout = TRUE;
+                schedule_redo_layout (container);
+            }
+        }
+        else
+        {
+            nautilus_canvas_item_set_is_visible (icon->item, FALSE);
+        }
+    }
+}
+
+static void
+set_layout_row_not_visible (NautilusCanvasLayoutRow *row)
+{
+    NautilusCanvasIcon *icon;
+    GList *p;
+    guint i;
+
+    for (p = row->start, i = 0; i < row->n_icons; p = p->next, i++)
+    {
+        icon = p->data;
+        icon->is_visible = FALSE;
+        nautilus_canvas_item_set_is_visible (icon->item, FALSE);
+    }
+}
+
 static void
 nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *container)
 {
+    NautilusCanvasContainerDetails *details;
     GtkAdjustment *vadj, *hadj;
     double min_y, max_y;
     double min_x, max_x;
-    double x0, y0, x1, y1;
     GList *node;
-    NautilusCanvasIcon *icon;
-    gboolean visible;
+    NautilusCanvasLayoutRow *row;
     GtkAllocation allocation;
+    gboolean use_rows;
+    guint start, end, i, j;
+
+    details = container->details;
 
     hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container));
     vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (container));
@@ -4837,41 +5553,51 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
     eel_canvas_c2w (EEL_CANVAS (container),
                     max_x, max_y, &max_x, &max_y);
 
-    /* Do the iteration in reverse to get the render-order from top to
-     * bottom for the prioritized thumbnails.
-     */
-    for (node = g_list_last (container->details->icons); node != NULL; node = node->prev)
+    use_rows = find_layout_rows (container, min_y, max_y, &start, &end);
+    if (use_rows && details->visible_rows_generation == details->layout_rows_generation)
     {
-        icon = node->data;
-
-        if (icon_is_positioned (icon))
+        /* Only the lines that were visible the last time need to be
+         * hidden, instead of all the icons.
+         */
+        for (i = details->visible_rows_start; i < details->visible_rows_end; i++)
         {
-            eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
-                                        &x0,
-                                        &y0,
-                                        &x1,
-                                        &y1);
-            eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-                                 &x0,
-                                 &y0);
-            eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-                                 &x1,
-                                 &y1);
-
-            visible = y1 >= min_y && y0 <= max_y;
-
-            if (visible)
+            if (i < start || i >= end)
             {
-                nautilus_canvas_item_set_is_visible (icon->item, TRUE);
-                nautilus_canvas_container_prioritize_thumbnailing (container,
-                                                                   icon);
+                set_layout_row_not_visible (&g_array_index (details->layout_rows,
+                                                            NautilusCanvasLayoutRow, i));
             }
-            else
+        }
+
+        /* Do the iteration in reverse to get the render-order from top to
+         * bottom for the prioritized thumbnails.
+         */
+        for (i = end; i > start; i--)
+        {
+            row = &g_array_index (details->layout_rows, NautilusCanvasLayoutRow, i - 1);
+            node = g_list_nth (row->start, row->n_icons - 1);
+            for (j = 0; j < row->n_icons; node = node->prev, j++)
             {
-                nautilus_canvas_item_set_is_visible (icon->item, FALSE);
+                update_icon_visibility (container, node->data, min_y, max_y);
             }
         }
     }
+    else
+    {
+        /* Do the iteration in reverse to get the render-order from top to
+         * bottom for the prioritized thumbnails.
+         */
+        for (node = g_list_last (details->icons); node != NULL; node = node->prev)
+        {
+            update_icon_visibility (container, node->data, min_y, max_y);
+        }
+    }
+
+    if (use_rows)
+    {
+        details->visible_rows_generation = details->layout_rows_generation;
+        details->visible_rows_start = start;
+        details->visible_rows_end = end;
+    }
 }
 
 static void
@@ -4907,6 +5633,9 @@ nautilus_canvas_container_update_icon (NautilusCanvasContainer *container,
 
     details = container->details;
 
+    icon->needs_layout = TRUE;
+    icon->image_stale = FALSE;
+
     /* compute the maximum size based on the scale factor */
     min_image_size = MINIMUM_IMAGE_SIZE * EEL_CANVAS (container)->pixels_per_unit;
     max_image_size = MAX (MAXIMUM_IMAGE_SIZE * EEL_CANVAS (container)->pixels_per_unit, NAUTILUS_ICON_MAXIMUM_SIZE);
@@ -5033,13 +5762,15 @@ nautilus_canvas_container_add (NautilusCanvasContainer *container,
     }
 
     /* Put it on both lists. */
+    invalidate_layout_rows (container);
     details->icons = g_list_prepend (details->icons, icon);
     details->new_icons = g_list_prepend (details->new_icons, icon);
+    icon->link = details->icons;
+    icon->unsorted = TRUE;
+    details->n_unsorted_icons++;
 
     g_hash_table_insert (details->icon_set, data, icon);
 
-    details->needs_resort = TRUE;
-
     /* Run an idle function to add the icons. */
     schedule_redo_layout (container);
 
@@ -5115,7 +5846,7 @@ nautilus_canvas_container_request_update (NautilusCanvasContainer *container,
     if (icon != NULL)
     {
         nautilus_canvas_container_update_icon (container, icon);
-        container->details->needs_resort = TRUE;
+        reorder_changed_icon (container, icon);
         schedule_redo_layout (container);
     }
 }
@@ -5128,6 +5859,128 @@ nautilus_canvas_container_get_zoom_level (NautilusCanvasContainer *container)
     return container->details->zoom_level;
 }
 
+static void
+unschedule_update_stale_images (NautilusCanvasContainer *container)
+{
+    g_clear_handle_id (&container->details->stale_images_idle_id, g_source_remove);
+    g_clear_pointer (&container->details->stale_images, g_ptr_array_unref);
+}
+
+static gboolean
+update_stale_images_callback (gpointer user_data)
+{
+    NautilusCanvasContainer *container;
+    GPtrArray *stale_images;
+    gint64 deadline;
+    gboolean updated;
+
+    container = NAUTILUS_CANVAS_CONTAINER (user_data);
+    stale_images = container->details->stale_images;
+    deadline = g_get_monotonic_time () + UPDATE_STALE_IMAGES_BATCH_USECS;
+    updated = FALSE;
+
+    while (stale_images->len > 0 && g_get_monotonic_time () < deadline)
+    {
+        NautilusCanvasIcon *icon;
+
+        icon = g_ptr_array_remove_index (stale_images, stale_images->len - 1);
+        if (icon->image_stale)
+        {
+            nautilus_canvas_container_update_icon (container, icon);
+            updated = TRUE;
+        }
+    }
+
+    if (updated)
+    {
+        schedule_redo_layout (container);
+    }
+
+    if (stale_images->len > 0)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    container->details->stale_images_idle_id = 0;
+    g_clear_pointer (&container->details->stale_images, g_ptr_array_unref);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Only the visible icons get their image for the new zoom level right
+ * away. The others keep the old one, and get the new one in idles, from
+ * the viewport outward, or once they get visible. The images of the
+ * other zoom levels are kept by the icon and thumbnail caches, so going
+ * back and forth costs little. */
+static void
+update_all_for_zoom (NautilusCanvasContainer *container)
+{
+    NautilusCanvasContainerDetails *details;
+    g_autoptr (GPtrArray) before = NULL;
+    g_autoptr (GPtrArray) after = NULL;
+    gboolean seen_visible;
+    GList *node;
+
+    details = container->details;
+
+    unschedule_update_stale_images (container);
+
+    before = g_ptr_array_new ();
+    after = g_ptr_array_new ();
+    seen_visible = FALSE;
+
+    for (node = details->icons; node != NULL; node = node->next)
+    {
+        NautilusCanvasIcon *icon = node->data;
+
+        nautilus_canvas_item_invalidate_label (icon->item);
+
+        if (icon->is_visible && !seen_visible)
+        {
+            /* The ones so far are above the viewport */
+            seen_visible = TRUE;
+            g_clear_pointer (&before, g_ptr_array_unref);
+            before = g_steal_pointer (&after);
+            after = g_ptr_array_new ();
+        }
+
+        if (icon->is_visible)
+        {
+            nautilus_canvas_container_update_icon (container, icon);
+        }
+        else
+        {
+            icon->image_stale = TRUE;
+            icon->needs_layout = TRUE;
+            g_ptr_array_add (after, icon);
+        }
+    }
+
+    if (before->len + after->len > 0)
+    {
+        /* Interleave the icons above and below the viewport, nearest
+         * last, so that the idle takes them from the end. */
+        details->stale_images = g_ptr_array_sized_new (before->len + after->len);
+        for (guint i = 0, j = 0; i < before->len || j < after->len;)
+        {
+            if (j < after->len)
+            {
+                g_ptr_array_add (details->stale_images,
+                                 g_ptr_array_index (after, after->len - 1 - j++));
+            }
+            if (i < before->len)
+            {
+                g_ptr_array_add (details->stale_images,
+                                 g_ptr_array_index (before, i++));
+            }
+        }
+        details->stale_images_idle_id = g_idle_add (update_stale_images_callback, container);
+    }
+
+    details->needs_resort = TRUE;
+    redo_layout (container);
+}
+
 void
 nautilus_canvas_container_set_zoom_level (NautilusCanvasContainer *container,
                                           int                      new_level)
@@ -5159,7 +6012,7 @@ nautilus_canvas_container_set_zoom_level (NautilusCanvasContainer *container,
                       / NAUTILUS_CANVAS_ICON_SIZE_STANDARD;
     eel_canvas_set_pixels_per_unit (EEL_CANVAS (container), pixels_per_unit);
 
-    nautilus_canvas_container_request_update_all_internal (container, TRUE);
+    update_all_for_zoom (container);
 }
 
 /**
@@ -5384,11 +6237,7 @@ nautilus_canvas_container_select_first (NautilusCanvasContainer *container)
 
     selection_changed = FALSE;
 
-    if (container->details->needs_resort)
-    {
-        resort (container);
-        container->details->needs_resort = FALSE;
-    }
+    update_icons_order (container);
 
     icon = g_list_nth_data (container->details->icons, 0);
     if (icon)
@@ -5699,11 +6548,33 @@ nautilus_canvas_container_set_font (NautilusCanvasContainer *container,
 
     g_free (container->details->font);
     container->details->font = g_strdup (font);
+    g_clear_pointer (&container->details->font_description, pango_font_description_free);
 
     nautilus_canvas_container_request_update_all_internal (container, TRUE);
     gtk_widget_queue_draw (GTK_WIDGET (container));
 }
 
+const PangoFontDescription *
+nautilus_canvas_container_get_label_font_description (NautilusCanvasContainer *container)
+{
+    PangoContext *context;
+
+    if (container->details->font_description == NULL)
+    {
+        if (container->details->font != NULL)
+        {
+            container->details->font_description = pango_font_description_from_string (container->details->font);
+        }
+        else
+        {
+            context = gtk_widget_get_pango_context (GTK_WIDGET (container));
+            container->details->font_description = pango_font_description_copy (pango_context_get_font_description (context));
+        }
+    }
+
+    return container->details->font_description;
+}
+
 /**
  * nautilus_canvas_container_get_icon_description
  * @container: An canvas container widget.
@@ -344,8 +344,13 @@ drag_data_get_callback (GtkWidget        *widget,
      * the selection data in the right format. Pass it means to
      * iterate all the selected icons.
      */
-    drag_info = &(NAUTILUS_CANVAS_CONTAINER (widget)->details->dnd_info->drag_info);
-    nautilus_drag_drag_data_get_from_cache (drag_info->selection_cache, context, selection_data, info, time);
+    drag_info = NAUTILUS_CANVAS_CONTAINER (widget)->details->dnd_source_info;
+    if (drag_info == NULL)
+    {
+        return;
+    }
+
+    nautilus_drag_drag_data_get_from_cache (drag_info, context, selection_data, info, time);
 }
 
 
@@ -596,11 +601,8 @@ drag_end_callback (GtkWidget      *widget,
 
     stop_cache_selection_list (&dnd_info->drag_info);
     nautilus_drag_destroy_selection_list (dnd_info->drag_info.selection_list);
-    nautilus_drag_destroy_selection_list (dnd_info->drag_info.selection_cache);
-    nautilus_drag_destroy_selection_list (container->details->dnd_source_info->selection_cache);
     dnd_info->drag_info.selection_list = NULL;
-    dnd_info->drag_info.selection_cache = NULL;
-    container->details->dnd_source_info->selection_cache = NULL;
+    nautilus_drag_clear_selection_cache (container->details->dnd_source_info);
 
     nautilus_window_end_dnd (window, context);
 }
@@ -610,7 +612,8 @@ nautilus_canvas_container_item_at (NautilusCanvasContainer *container,
                                    int                      x,
                                    int                      y)
 {
-    GList *p;
+    GList *p, *start;
+    guint n_icons, i;
     int size;
     EelDRect point;
     EelIRect canvas_point;
@@ -625,21 +628,30 @@ nautilus_canvas_container_item_at (NautilusCanvasContainer *container,
     point.x1 = x + size;
     point.y1 = y + size;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
+    eel_canvas_w2c (EEL_CANVAS (container),
+                    point.x0,
+                    point.y0,
+                    &canvas_point.x0,
+                    &canvas_point.y0);
+    eel_canvas_w2c (EEL_CANVAS (container),
+                    point.x1,
+                    point.y1,
+                    &canvas_point.x1,
+                    &canvas_point.y1);
+
+    /* Only look at the lines of icons around the point, when possible. */
+    if (!nautilus_canvas_container_get_icons_in_range (container, point.y0, point.y1,
+                                                       &start, &n_icons))
+    {
+        start = container->details->icons;
+        n_icons = G_MAXUINT;
+    }
+
+    for (p = start, i = 0; p != NULL && i < n_icons; p = p->next, i++)
     {
         NautilusCanvasIcon *icon;
         icon = p->data;
 
-        eel_canvas_w2c (EEL_CANVAS (container),
-                        point.x0,
-                        point.y0,
-                        &canvas_point.x0,
-                        &canvas_point.y0);
-        eel_canvas_w2c (EEL_CANVAS (container),
-                        point.x1,
-                        point.y1,
-                        &canvas_point.x1,
-                        &canvas_point.y1);
         if (nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_point))
         {
             return icon;
@@ -1294,7 +1306,6 @@ drag_begin_callback (GtkWidget      *widget,
     double x1, y1, x2, y2, winx, winy;
     int x_offset, y_offset;
     int start_x, start_y;
-    GList *dragged_files;
     double sx, sy;
 
     container = NAUTILUS_CANVAS_CONTAINER (widget);
@@ -1323,20 +1334,16 @@ drag_begin_callback (GtkWidget      *widget,
     gtk_drag_set_icon_surface (context, surface);
     cairo_surface_destroy (surface);
 
-    /* cache the data at the beginning since the view may change */
-    drag_info = &(container->details->dnd_info->drag_info);
+    /* cache the data at the beginning since the view may change. It is
+     * used both for in-process drops and for the drag data requests. */
+    drag_info = container->details->dnd_source_info;
     drag_info->selection_cache = nautilus_drag_create_selection_cache (widget,
                                                                        each_icon_get_data_binder);
 
-    container->details->dnd_source_info->selection_cache = nautilus_drag_create_selection_cache (widget,
-                                                                                                 each_icon_get_data_binder);
-
-    dragged_files = nautilus_drag_file_list_from_selection_list (drag_info->selection_cache);
-    if (nautilus_file_list_are_all_folders (dragged_files))
+    if (nautilus_drag_selection_list_are_all_folders (drag_info->selection_cache))
     {
         nautilus_window_start_dnd (window, context);
     }
-    g_list_free_full (dragged_files, g_object_unref);
 }
 
 void
@@ -897,21 +897,38 @@ measure_label_text (NautilusCanvasItem *item)
          */
         editable_layout = get_label_layout (&details->editable_text_layout, item, details->editable_text);
 
-        prepare_pango_layout_for_measure_entire_text (item, editable_layout);
-        layout_get_full_size (editable_layout,
-                              NULL,
-                              &editable_height_for_entire_text,
-                              NULL);
-        layout_get_size_for_layout (editable_layout,
-                                    nautilus_canvas_container_get_max_layout_lines (container),
-                                    editable_height_for_entire_text,
-                                    &editable_height_for_layout);
-
         prepare_pango_layout_for_draw (item, editable_layout);
         layout_get_full_size (editable_layout,
                               &editable_width,
                               &editable_height,
                               &editable_dx);
+
+        /* Most labels fit, and then the displayed text is the entire
+         * text, so there is no need to lay it out again without the
+         * height limit, and then again for drawing.
+         */
+        if (!pango_layout_is_ellipsized (editable_layout))
+        {
+            editable_height_for_entire_text = editable_height;
+            layout_get_size_for_layout (editable_layout,
+                                        nautilus_canvas_container_get_max_layout_lines (container),
+                                        editable_height_for_entire_text,
+                                        &editable_height_for_layout);
+        }
+        else
+        {
+            prepare_pango_layout_for_measure_entire_text (item, editable_layout);
+            layout_get_full_size (editable_layout,
+                                  NULL,
+                                  &editable_height_for_entire_text,
+                                  NULL);
+            layout_get_size_for_layout (editable_layout,
+                                        nautilus_canvas_container_get_max_layout_lines (container),
+                                        editable_height_for_entire_text,
+                                        &editable_height_for_layout);
+
+            prepare_pango_layout_for_draw (item, editable_layout);
+        }
     }
 
     if (have_additional)
@@ -1377,7 +1394,6 @@ create_label_layout (NautilusCanvasItem *item,
 {
     PangoLayout *layout;
     PangoContext *context;
-    PangoFontDescription *desc;
     NautilusCanvasContainer *container;
     EelCanvasItem *canvas_item;
     GString *str;
@@ -1427,17 +1443,8 @@ create_label_layout (NautilusCanvasItem *item,
     }
 #endif
 
-    /* Create a font description */
-    if (container->details->font)
-    {
-        desc = pango_font_description_from_string (container->details->font);
-    }
-    else
-    {
-        desc = pango_font_description_copy (pango_context_get_font_description (context));
-    }
-    pango_layout_set_font_description (layout, desc);
-    pango_font_description_free (desc);
+    pango_layout_set_font_description (layout,
+                                       nautilus_canvas_container_get_label_font_description (container));
     g_free (zeroified_text);
 
     return layout;
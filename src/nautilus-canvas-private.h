@@ -58,6 +58,25 @@ typedef struct {
 
 	/* Whether this item is visible in the view. */
 	eel_boolean_bit is_visible : 1;
+
+	/* Whether the item changed since it was last laid out. */
+	eel_boolean_bit needs_layout : 1;
+
+	/* Whether the label size has to be invalidated once visible. */
+	eel_boolean_bit label_size_stale : 1;
+
+	/* Whether the image is still the one of the previous zoom level. */
+	eel_boolean_bit image_stale : 1;
+
+	/* Whether the icon is among those to merge in sort order, at the
+	 * start of the icons list. */
+	eel_boolean_bit unsorted : 1;
+
+	/* The node of the icon in the icons list. */
+	GList *link;
+
+	/* Position in the icons list at the last layout. */
+	guint layout_index;
 } NautilusCanvasIcon;
 
 
@@ -76,8 +95,37 @@ typedef struct {
 	guint prev_x, prev_y;
 	int last_adj_x;
 	int last_adj_y;
+
+	/* The layout rows touched by the last selection rectangle, valid
+	 * for the layout rows generation it was computed for. */
+	guint rows_generation;
+	guint rows_start, rows_end;
 } NautilusCanvasRubberbandInfo;
 
+/* A line of icons, as laid out. Lines are stored top to bottom, so that
+ * the icons near a point or a rectangle can be found without going
+ * through all of them.
+ */
+typedef struct {
+	GList *start; /* in details->icons */
+	guint first_index; /* of start */
+	guint n_icons;
+
+	/* Where the layout of this line started from. */
+	double layout_y;
+
+	/* Whether all the icons take a single grid cell, so that the
+	 * columns of regular lines line up. */
+	gboolean regular;
+
+	/* World coordinates of the entire items, and the lowest bottom of
+	 * this line and all the previous ones, which is what bisection needs
+	 * since a long label can reach below the next line.
+	 */
+	double y0, y1;
+	double max_y1;
+} NautilusCanvasLayoutRow;
+
 typedef enum {
 	DRAG_STATE_INITIAL,
 	DRAG_STATE_MOVE_OR_COPY,
@@ -114,6 +162,8 @@ struct NautilusCanvasContainerDetails {
 	/* List of icons. */
 	GList *icons;
 	GList *new_icons;
+	/* How many icons at the start of the list are not sorted yet */
+	guint n_unsorted_icons;
 	GList *selection;
 	GHashTable *icon_set;
 
@@ -162,12 +212,31 @@ struct NautilusCanvasContainerDetails {
 
 	NautilusCanvasIcon *range_selection_base_icon;
 	
+	/* The lines of the last layout. Not valid for lookups anymore once
+	 * the icons changed, but still used to redo only the lines after the
+	 * first change. */
+	GArray *layout_rows;
+	gboolean layout_rows_valid;
+	guint layout_rows_generation;
+	double layout_rows_grid_width;
+	double layout_rows_canvas_width;
+
+	/* The layout rows with visible icons, valid for the layout rows
+	 * generation they were computed for. */
+	guint visible_rows_generation;
+	guint visible_rows_start, visible_rows_end;
+
 	/* Idle ID. */
 	guint idle_id;
 
 	/* Align idle id */
 	guint align_idle_id;
 
+	/* The icons left to update after a zoom change, the next one last,
+	 * and the idle doing it. */
+	GPtrArray *stale_images;
+	guint stale_images_idle_id;
+
 	/* DnD info. */
 	NautilusCanvasDndInfo *dnd_info;
 	NautilusDragInfo *dnd_source_info;
@@ -177,6 +246,8 @@ struct NautilusCanvasContainerDetails {
 
 	/* specific fonts used to draw labels */
 	char *font;
+	/* The font of the labels, parsed once for all of them. */
+	PangoFontDescription *font_description;
 	
 	/* State used so arrow keys don't wander if icons aren't lined up.
 	 */
@@ -217,6 +288,15 @@ char *        nautilus_canvas_container_get_icon_drop_target_uri    (NautilusCan
 								       NautilusCanvasIcon          *canvas);
 void          nautilus_canvas_container_update_icon                 (NautilusCanvasContainer *container,
 								       NautilusCanvasIcon          *canvas);
+const PangoFontDescription *
+              nautilus_canvas_container_get_label_font_description  (NautilusCanvasContainer *container);
+/* The icons laid out within the given world y range, or FALSE if the
+ * layout isn't up to date, in which case all the icons have to be checked. */
+gboolean      nautilus_canvas_container_get_icons_in_range          (NautilusCanvasContainer *container,
+								     double                 y0,
+								     double                 y1,
+								     GList                **start,
+								     guint                 *n_icons);
 gboolean      nautilus_canvas_container_scroll                      (NautilusCanvasContainer *container,
 								     int                    delta_x,
 								     int                    delta_y);
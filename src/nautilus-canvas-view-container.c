@@ -109,6 +109,10 @@ nautilus_canvas_view_container_prioritize_thumbnailing (NautilusCanvasContainer
 
     g_assert (NAUTILUS_IS_FILE (file));
 
+    /* The icon is on screen, so its item count is wanted first too. */
+    nautilus_file_prioritize_attributes (file);
+    nautilus_canvas_view_monitor_visible_file (get_canvas_view (container), file);
+
     if (nautilus_file_is_thumbnailing (file))
     {
         uri = nautilus_file_get_uri (file);
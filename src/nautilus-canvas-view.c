@@ -86,6 +86,10 @@ struct _NautilusCanvasView
 
     GtkWidget *canvas_container;
 
+    /* The files whose icons were shown, monitored for the info left out
+     * of the fast loads of slow locations */
+    GHashTable *extended_info_files;
+
     /* FIXME: Needed for async operations. Suposedly we would use cancellable and gtask,
      * sadly gtkclipboard doesn't support that.
      * We follow this pattern for checking validity of the object in the views.
@@ -296,6 +300,44 @@ unref_cover (NautilusCanvasIconData *data,
     nautilus_file_unref (NAUTILUS_FILE (data));
 }
 
+static void
+clear_extended_info_files (NautilusCanvasView *canvas_view)
+{
+    GHashTableIter iter;
+    gpointer key;
+
+    g_hash_table_iter_init (&iter, canvas_view->extended_info_files);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+        nautilus_file_monitor_remove (key, canvas_view->extended_info_files);
+        g_hash_table_iter_remove (&iter);
+    }
+}
+
+/* Called for each icon that gets on screen. Only those files get the
+ * info that takes a query for each of them on slow locations, and keep
+ * it up to date. */
+void
+nautilus_canvas_view_monitor_visible_file (NautilusCanvasView *canvas_view,
+                                           NautilusFile       *file)
+{
+    if (canvas_view->destroyed ||
+        g_hash_table_contains (canvas_view->extended_info_files, file))
+    {
+        return;
+    }
+
+    g_hash_table_add (canvas_view->extended_info_files, nautilus_file_ref (file));
+    nautilus_file_monitor_add (file, canvas_view->extended_info_files,
+                               NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO);
+}
+
+static NautilusFileAttributes
+nautilus_canvas_view_get_lazy_attributes (NautilusFilesView *view)
+{
+    return NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO;
+}
+
 static void
 nautilus_canvas_view_clear (NautilusFilesView *view)
 {
@@ -304,6 +346,8 @@ nautilus_canvas_view_clear (NautilusFilesView *view)
 
     g_return_if_fail (NAUTILUS_IS_CANVAS_VIEW (view));
 
+    clear_extended_info_files (NAUTILUS_CANVAS_VIEW (view));
+
     canvas_container = get_canvas_container (NAUTILUS_CANVAS_VIEW (view));
     if (!canvas_container)
     {
@@ -349,6 +393,12 @@ nautilus_canvas_view_remove_file (NautilusFilesView *view,
 
     canvas_view = NAUTILUS_CANVAS_VIEW (view);
 
+    if (g_hash_table_contains (canvas_view->extended_info_files, file))
+    {
+        nautilus_file_monitor_remove (file, canvas_view->extended_info_files);
+        g_hash_table_remove (canvas_view->extended_info_files, file);
+    }
+
     if (nautilus_canvas_container_remove (get_canvas_container (canvas_view),
                                           NAUTILUS_CANVAS_ICON_DATA (file)))
     {
@@ -1547,6 +1597,18 @@ nautilus_canvas_view_dispose (GObject *object)
     G_OBJECT_CLASS (nautilus_canvas_view_parent_class)->dispose (object);
 }
 
+static void
+nautilus_canvas_view_finalize (GObject *object)
+{
+    NautilusCanvasView *canvas_view;
+
+    canvas_view = NAUTILUS_CANVAS_VIEW (object);
+
+    g_hash_table_destroy (canvas_view->extended_info_files);
+
+    G_OBJECT_CLASS (nautilus_canvas_view_parent_class)->finalize (object);
+}
+
 static void
 nautilus_canvas_view_class_init (NautilusCanvasViewClass *klass)
 {
@@ -1557,6 +1619,7 @@ nautilus_canvas_view_class_init (NautilusCanvasViewClass *klass)
     oclass = G_OBJECT_CLASS (klass);
 
     oclass->dispose = nautilus_canvas_view_dispose;
+    oclass->finalize = nautilus_canvas_view_finalize;
 
     GTK_WIDGET_CLASS (klass)->destroy = nautilus_canvas_view_destroy;
 
@@ -1591,6 +1654,7 @@ nautilus_canvas_view_class_init (NautilusCanvasViewClass *klass)
     nautilus_files_view_class->scroll_to_file = canvas_view_scroll_to_file;
     nautilus_files_view_class->reveal_for_selection_context_menu = nautilus_canvas_view_reveal_for_selection_context_menu;
     nautilus_files_view_class->preview_selection_event = nautilus_canvas_view_preview_selection_event;
+    nautilus_files_view_class->get_lazy_attributes = nautilus_canvas_view_get_lazy_attributes;
 }
 
 static void
@@ -1602,6 +1666,9 @@ nautilus_canvas_view_init (NautilusCanvasView *canvas_view)
 
     canvas_view->sort = &sort_criteria[0];
     canvas_view->destroyed = FALSE;
+    canvas_view->extended_info_files = g_hash_table_new_full (NULL, NULL,
+                                                              (GDestroyNotify) nautilus_file_unref,
+                                                              NULL);
 
     canvas_container = nautilus_canvas_view_container_new (canvas_view);
     initialize_canvas_container (canvas_view, canvas_container);
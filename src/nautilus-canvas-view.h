@@ -42,4 +42,7 @@ NautilusFilesView * nautilus_canvas_view_new (NautilusWindowSlot *slot);
 
 NautilusCanvasContainer * nautilus_canvas_view_get_canvas_container (NautilusCanvasView *view);
 
+void nautilus_canvas_view_monitor_visible_file (NautilusCanvasView *view,
+                                                NautilusFile       *file);
+
 G_END_DECLS
@@ -37,6 +37,14 @@ typedef struct
 {
     gboolean cut;
     GList *files;
+
+    /* Serialized on the first request for each, and kept for the
+     * following ones */
+    char **uris;
+    char *uri_list;
+    gsize uri_list_len;
+    char *text;
+    gsize text_len;
 } ClipboardInfo;
 
 static GList *
@@ -74,8 +82,8 @@ convert_file_list_to_string (ClipboardInfo *info,
                              gsize         *len)
 {
     GString *uris;
-    char *uri, *tmp;
-    GFile *f;
+    const char *uri;
+    char *tmp;
     guint i;
     GList *l;
 
@@ -91,13 +99,11 @@ convert_file_list_to_string (ClipboardInfo *info,
 
     for (i = 0, l = info->files; l != NULL; l = l->next, i++)
     {
-        uri = nautilus_file_get_uri (l->data);
+        uri = nautilus_file_peek_uri (l->data);
 
         if (format_for_text)
         {
-            f = g_file_new_for_uri (uri);
-            tmp = g_file_get_parse_name (f);
-            g_object_unref (f);
+            tmp = g_file_get_parse_name (nautilus_file_peek_location (l->data));
 
             if (tmp != NULL)
             {
@@ -116,8 +122,6 @@ convert_file_list_to_string (ClipboardInfo *info,
             g_string_append (uris, uri);
             g_string_append_c (uris, '\n');
         }
-
-        g_free (uri);
     }
 
     *len = uris->len;
@@ -245,15 +249,61 @@ nautilus_clipboard_is_cut_from_selection_data (const gchar *selection_data)
     return is_cut_from_selection_data;
 }
 
+static char **
+get_clipboard_uris (ClipboardInfo *clipboard_info)
+{
+    if (clipboard_info->uris == NULL)
+    {
+        GList *l;
+        int i;
+
+        clipboard_info->uris = g_new (char *, g_list_length (clipboard_info->files) + 1);
+
+        for (i = 0, l = clipboard_info->files; l != NULL; l = l->next, i++)
+        {
+            clipboard_info->uris[i] = nautilus_file_get_uri (l->data);
+        }
+
+        clipboard_info->uris[i] = NULL;
+    }
+
+    return clipboard_info->uris;
+}
+
+/* The same as gtk_selection_data_set_uris() would set, without building it
+ * again for every request */
+static const char *
+get_clipboard_uri_list (ClipboardInfo *clipboard_info,
+                        gsize         *len)
+{
+    if (clipboard_info->uri_list == NULL)
+    {
+        char **uris;
+        GString *list;
+
+        uris = get_clipboard_uris (clipboard_info);
+        list = g_string_new (NULL);
+
+        for (int i = 0; uris[i] != NULL; i++)
+        {
+            g_string_append (list, uris[i]);
+            g_string_append (list, "\r\n");
+        }
+
+        clipboard_info->uri_list_len = list->len;
+        clipboard_info->uri_list = g_string_free (list, FALSE);
+    }
+
+    *len = clipboard_info->uri_list_len;
+    return clipboard_info->uri_list;
+}
+
 static void
 on_get_clipboard (GtkClipboard     *clipboard,
                   GtkSelectionData *selection_data,
                   guint             info,
                   gpointer          user_data)
 {
-    char **uris;
-    GList *l;
-    int i;
     ClipboardInfo *clipboard_info;
     GdkAtom target;
 
@@ -261,31 +311,31 @@ on_get_clipboard (GtkClipboard     *clipboard,
 
     target = gtk_selection_data_get_target (selection_data);
 
-    if (gtk_targets_include_uri (&target, 1))
+    if (target == gdk_atom_intern_static_string ("text/uri-list"))
     {
-        uris = g_malloc ((g_list_length (clipboard_info->files) + 1) * sizeof (char *));
-        i = 0;
-
-        for (l = clipboard_info->files; l != NULL; l = l->next)
-        {
-            uris[i] = nautilus_file_get_uri (l->data);
-            i++;
-        }
-
-        uris[i] = NULL;
-
-        gtk_selection_data_set_uris (selection_data, uris);
+        const char *uri_list;
+        gsize len;
 
-        g_strfreev (uris);
+        /* URIs are escaped, so this needs no conversion to ASCII */
+        uri_list = get_clipboard_uri_list (clipboard_info, &len);
+        gtk_selection_data_set (selection_data, target, 8,
+                                (const guchar *) uri_list, len);
+    }
+    else if (gtk_targets_include_uri (&target, 1))
+    {
+        gtk_selection_data_set_uris (selection_data,
+                                     get_clipboard_uris (clipboard_info));
     }
     else if (gtk_targets_include_text (&target, 1))
     {
-        char *str;
-        gsize len;
+        if (clipboard_info->text == NULL)
+        {
+            clipboard_info->text = convert_file_list_to_string (clipboard_info, FALSE,
+                                                                &clipboard_info->text_len);
+        }
 
-        str = convert_file_list_to_string (clipboard_info, FALSE, &len);
-        gtk_selection_data_set_text (selection_data, str, len);
-        g_free (str);
+        gtk_selection_data_set_text (selection_data, clipboard_info->text,
+                                     clipboard_info->text_len);
     }
 }
 
@@ -296,6 +346,9 @@ on_clear_clipboard (GtkClipboard *clipboard,
     ClipboardInfo *clipboard_info = (ClipboardInfo *) user_data;
 
     nautilus_file_list_free (clipboard_info->files);
+    g_strfreev (clipboard_info->uris);
+    g_free (clipboard_info->uri_list);
+    g_free (clipboard_info->text);
 
     g_free (clipboard_info);
 }
@@ -310,7 +363,7 @@ nautilus_clipboard_prepare_for_files (GtkClipboard *clipboard,
     int n_targets;
     ClipboardInfo *clipboard_info;
 
-    clipboard_info = g_new (ClipboardInfo, 1);
+    clipboard_info = g_new0 (ClipboardInfo, 1);
     clipboard_info->cut = cut;
     clipboard_info->files = nautilus_file_list_copy (files);
 
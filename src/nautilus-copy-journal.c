@@ -0,0 +1,433 @@
+/* nautilus-copy-journal.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-copy-journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Lines appended to the journal, the URIs being those of the sources:
+ *   S <start time>               first line
+ *   D <uri>                      folder created
+ *   F <size> <uri>               file copied whole
+ *   P <offset> <src size> <uri>  file copied up to offset
+ */
+#define JOURNAL_FLUSH_INTERVAL (5 * G_USEC_PER_SEC)
+#define JOURNAL_MAX_PENDING (64 * 1024)
+/* Past that, what it says is too likely to have changed since. */
+#define JOURNAL_MAX_AGE (24 * 60 * 60)
+
+typedef struct
+{
+    goffset offset;
+    goffset src_size;
+} PartialCopy;
+
+struct NautilusCopyJournal
+{
+    char *path;
+    int fd;
+    gboolean resumed;
+    gint64 start_time;
+    /* What was left by the interrupted run, by source URI */
+    GHashTable *files;          /* of sizes */
+    GHashTable *directories;
+    GHashTable *partials;       /* of PartialCopy */
+
+    GString *pending;
+    gint64 last_flush;
+};
+
+static char *
+get_journal_path (GList *sources,
+                  GFile *destination)
+{
+    g_autoptr (GChecksum) checksum = NULL;
+    g_autofree char *destination_uri = NULL;
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    destination_uri = g_file_get_uri (destination);
+    g_checksum_update (checksum, (const guchar *) destination_uri, -1);
+    for (GList *l = sources; l != NULL; l = l->next)
+    {
+        g_autofree char *uri = NULL;
+
+        uri = g_file_get_uri (l->data);
+        g_checksum_update (checksum, (const guchar *) "\n", 1);
+        g_checksum_update (checksum, (const guchar *) uri, -1);
+    }
+
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "copy-journals",
+                             g_checksum_get_string (checksum), NULL);
+}
+
+static gboolean
+is_too_old (struct stat *stat_buf)
+{
+    return g_get_real_time () / G_USEC_PER_SEC - stat_buf->st_mtime > JOURNAL_MAX_AGE;
+}
+
+/* Removes the journals left by the jobs which never got started again. */
+static void
+remove_old_journals (const char *dir_path)
+{
+    g_autoptr (GDir) dir = NULL;
+    struct stat stat_buf;
+    const char *name;
+    int fd;
+
+    dir = g_dir_open (dir_path, 0, NULL);
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL)
+    {
+        g_autofree char *path = NULL;
+
+        path = g_build_filename (dir_path, name, NULL);
+        if (g_lstat (path, &stat_buf) != 0 || !S_ISREG (stat_buf.st_mode) ||
+            !is_too_old (&stat_buf))
+        {
+            continue;
+        }
+
+        /* Unless a job that got stuck still has it */
+        fd = open (path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && flock (fd, LOCK_EX | LOCK_NB) == 0)
+        {
+            g_unlink (path);
+        }
+        if (fd >= 0)
+        {
+            close (fd);
+        }
+    }
+}
+
+static void
+journal_load (NautilusCopyJournal *journal,
+              char                *contents)
+{
+    g_auto (GStrv) lines = NULL;
+    char *end;
+
+    lines = g_strsplit (contents, "\n", -1);
+    if (lines[0] == NULL || !g_str_has_prefix (lines[0], "S "))
+    {
+        return;
+    }
+    journal->start_time = g_ascii_strtoll (lines[0] + 2, NULL, 10);
+    journal->resumed = journal->start_time > 0;
+
+    /* The last line may have been cut short, it has no newline then. */
+    for (guint i = 1; lines[i] != NULL && lines[i + 1] != NULL; i++)
+    {
+        char *line = lines[i];
+        PartialCopy *partial;
+        goffset *recorded_size;
+        goffset offset;
+        goffset size;
+
+        if (g_str_has_prefix (line, "D "))
+        {
+            g_hash_table_add (journal->directories, g_strdup (line + 2));
+        }
+        else if (g_str_has_prefix (line, "F "))
+        {
+            size = g_ascii_strtoll (line + 2, &end, 10);
+            if (*end == ' ')
+            {
+                recorded_size = g_new (goffset, 1);
+                *recorded_size = size;
+                g_hash_table_remove (journal->partials, end + 1);
+                g_hash_table_insert (journal->files, g_strdup (end + 1), recorded_size);
+            }
+        }
+        else if (g_str_has_prefix (line, "P "))
+        {
+            offset = g_ascii_strtoll (line + 2, &end, 10);
+            if (*end != ' ')
+            {
+                continue;
+            }
+            size = g_ascii_strtoll (end + 1, &end, 10);
+            if (*end != ' ')
+            {
+                continue;
+            }
+            partial = g_new (PartialCopy, 1);
+            partial->offset = offset;
+            partial->src_size = size;
+            g_hash_table_insert (journal->partials, g_strdup (end + 1), partial);
+        }
+    }
+}
+
+NautilusCopyJournal *
+nautilus_copy_journal_open (GList *sources,
+                            GFile *destination)
+{
+    NautilusCopyJournal *journal;
+    g_autofree char *path = NULL;
+    g_autofree char *dir = NULL;
+    g_autofree char *contents = NULL;
+    struct stat stat_buf;
+    int fd;
+
+    path = get_journal_path (sources, destination);
+    dir = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+        return NULL;
+    }
+    remove_old_journals (dir);
+
+    fd = open (path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    /* The lock goes away with the process, unlike the journal. */
+    if (flock (fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close (fd);
+        return NULL;
+    }
+
+    journal = g_new0 (NautilusCopyJournal, 1);
+    journal->path = g_steal_pointer (&path);
+    journal->fd = fd;
+    journal->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    journal->directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    journal->partials = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    journal->pending = g_string_new (NULL);
+    journal->last_flush = g_get_monotonic_time ();
+
+    if (fstat (fd, &stat_buf) == 0 && !is_too_old (&stat_buf) &&
+        g_file_get_contents (journal->path, &contents, NULL, NULL))
+    {
+        journal_load (journal, contents);
+    }
+    if (!journal->resumed)
+    {
+        if (ftruncate (fd, 0) != 0)
+        {
+            nautilus_copy_journal_free (journal);
+            return NULL;
+        }
+        journal->start_time = g_get_real_time () / G_USEC_PER_SEC;
+        g_string_append_printf (journal->pending, "S %" G_GINT64_FORMAT "\n",
+                                journal->start_time);
+    }
+
+    return journal;
+}
+
+static void
+journal_flush (NautilusCopyJournal *journal)
+{
+    gsize written;
+    ssize_t n;
+
+    written = 0;
+    while (written < journal->pending->len)
+    {
+        n = write (journal->fd, journal->pending->str + written,
+                   journal->pending->len - written);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+    fdatasync (journal->fd);
+
+    g_string_truncate (journal->pending, 0);
+    journal->last_flush = g_get_monotonic_time ();
+}
+
+gboolean
+nautilus_copy_journal_checkpoint_due (NautilusCopyJournal *journal)
+{
+    return journal->pending->len >= JOURNAL_MAX_PENDING ||
+           g_get_monotonic_time () - journal->last_flush >= JOURNAL_FLUSH_INTERVAL;
+}
+
+static void
+journal_append (NautilusCopyJournal *journal,
+                const char          *line,
+                GFile               *src)
+{
+    g_autofree char *uri = NULL;
+
+    uri = g_file_get_uri (src);
+    g_string_append (journal->pending, line);
+    g_string_append (journal->pending, uri);
+    g_string_append_c (journal->pending, '\n');
+
+    if (nautilus_copy_journal_checkpoint_due (journal))
+    {
+        journal_flush (journal);
+    }
+}
+
+void
+nautilus_copy_journal_free (NautilusCopyJournal *journal)
+{
+    g_unlink (journal->path);
+    close (journal->fd);
+
+    g_free (journal->path);
+    g_hash_table_destroy (journal->files);
+    g_hash_table_destroy (journal->directories);
+    g_hash_table_destroy (journal->partials);
+    g_string_free (journal->pending, TRUE);
+    g_free (journal);
+}
+
+gboolean
+nautilus_copy_journal_is_resumed (NautilusCopyJournal *journal)
+{
+    return journal->resumed;
+}
+
+gboolean
+nautilus_copy_journal_lookup_file (NautilusCopyJournal *journal,
+                                   GFile               *src,
+                                   goffset             *size)
+{
+    g_autofree char *uri = NULL;
+    goffset *recorded_size;
+
+    if (g_hash_table_size (journal->files) == 0)
+    {
+        return FALSE;
+    }
+
+    uri = g_file_get_uri (src);
+    recorded_size = g_hash_table_lookup (journal->files, uri);
+    if (recorded_size == NULL)
+    {
+        return FALSE;
+    }
+
+    *size = *recorded_size;
+    return TRUE;
+}
+
+gboolean
+nautilus_copy_journal_has_directory (NautilusCopyJournal *journal,
+                                     GFile               *src)
+{
+    g_autofree char *uri = NULL;
+
+    if (g_hash_table_size (journal->directories) == 0)
+    {
+        return FALSE;
+    }
+
+    uri = g_file_get_uri (src);
+    return g_hash_table_contains (journal->directories, uri);
+}
+
+goffset
+nautilus_copy_journal_get_partial (NautilusCopyJournal *journal,
+                                   GFile               *src,
+                                   goffset             *src_size)
+{
+    g_autofree char *uri = NULL;
+    PartialCopy *partial;
+
+    if (g_hash_table_size (journal->partials) == 0)
+    {
+        return 0;
+    }
+
+    uri = g_file_get_uri (src);
+    partial = g_hash_table_lookup (journal->partials, uri);
+    if (partial == NULL)
+    {
+        return 0;
+    }
+
+    *src_size = partial->src_size;
+    return partial->offset;
+}
+
+void
+nautilus_copy_journal_add_file (NautilusCopyJournal *journal,
+                                GFile               *src,
+                                goffset              size)
+{
+    g_autofree char *line = NULL;
+
+    line = g_strdup_printf ("F %" G_GOFFSET_FORMAT " ", size);
+    journal_append (journal, line, src);
+}
+
+void
+nautilus_copy_journal_add_directory (NautilusCopyJournal *journal,
+                                     GFile               *src)
+{
+    journal_append (journal, "D ", src);
+}
+
+static gboolean
+is_under (gpointer key,
+          gpointer value,
+          gpointer user_data)
+{
+    const char *prefix = user_data;
+
+    return g_str_has_prefix (key, prefix);
+}
+
+void
+nautilus_copy_journal_forget_directory (NautilusCopyJournal *journal,
+                                        GFile               *src)
+{
+    g_autofree char *uri = NULL;
+    g_autofree char *prefix = NULL;
+
+    uri = g_file_get_uri (src);
+    prefix = g_strconcat (uri, "/", NULL);
+
+    g_hash_table_remove (journal->directories, uri);
+    g_hash_table_foreach_remove (journal->directories, is_under, prefix);
+    g_hash_table_foreach_remove (journal->files, is_under, prefix);
+    g_hash_table_foreach_remove (journal->partials, is_under, prefix);
+}
+
+void
+nautilus_copy_journal_set_partial (NautilusCopyJournal *journal,
+                                   GFile               *src,
+                                   goffset              offset,
+                                   goffset              src_size)
+{
+    g_autofree char *line = NULL;
+
+    line = g_strdup_printf ("P %" G_GOFFSET_FORMAT " %" G_GOFFSET_FORMAT " ",
+                            offset, src_size);
+    journal_append (journal, line, src);
+    /* The caller flushed the file for this checkpoint. */
+    journal_flush (journal);
+}
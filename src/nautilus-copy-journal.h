@@ -0,0 +1,72 @@
+/* nautilus-copy-journal.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* A copy journal records, in the cache directory, how far a copy job got:
+ * the folders it created, the files it copied whole, and how much of a big
+ * file it has written. It is removed once the job is over, so one is only
+ * left behind by a job which didn't get to the end, like when the session
+ * went away. The same copy started again, same sources to the same
+ * destination, picks it up and goes on from there.
+ *
+ * It is written every few seconds, so what happened since may have to be
+ * done again. A journal not written for a day is not resumed, and is
+ * removed. Everything is called from the thread of the job.
+ */
+
+typedef struct NautilusCopyJournal NautilusCopyJournal;
+
+/* Returns NULL when there already is a job doing that copy. */
+NautilusCopyJournal *nautilus_copy_journal_open              (GList               *sources,
+                                                              GFile               *destination);
+/* Removes the journal, the job being over. */
+void                 nautilus_copy_journal_free              (NautilusCopyJournal *journal);
+
+/* Whether it was left by an interrupted job */
+gboolean             nautilus_copy_journal_is_resumed        (NautilusCopyJournal *journal);
+
+gboolean             nautilus_copy_journal_lookup_file       (NautilusCopyJournal *journal,
+                                                              GFile               *src,
+                                                              goffset             *size);
+gboolean             nautilus_copy_journal_has_directory     (NautilusCopyJournal *journal,
+                                                              GFile               *src);
+/* Returns the offset up to which @src was copied, which only holds while
+ * it still has @src_size bytes, or 0. */
+goffset              nautilus_copy_journal_get_partial       (NautilusCopyJournal *journal,
+                                                              GFile               *src,
+                                                              goffset             *src_size);
+
+void                 nautilus_copy_journal_add_file          (NautilusCopyJournal *journal,
+                                                              GFile               *src,
+                                                              goffset              size);
+void                 nautilus_copy_journal_add_directory     (NautilusCopyJournal *journal,
+                                                              GFile               *src);
+/* Drops what was recorded under @src, which turned out to be gone. */
+void                 nautilus_copy_journal_forget_directory  (NautilusCopyJournal *journal,
+                                                              GFile               *src);
+
+/* Whether it's time to write the journal, for the partial copies to know
+ * when to flush what they wrote before calling set_partial(). */
+gboolean             nautilus_copy_journal_checkpoint_due    (NautilusCopyJournal *journal);
+void                 nautilus_copy_journal_set_partial       (NautilusCopyJournal *journal,
+                                                              GFile               *src,
+                                                              goffset              offset,
+                                                              goffset              src_size);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusCopyJournal, nautilus_copy_journal_free)
@@ -39,8 +39,12 @@ struct _NautilusDBusManager
 
     NautilusDBusFileOperations *file_operations;
     NautilusDBusFileOperations2 *file_operations2;
+
+    guint last_batch_id;
 };
 
+#define BATCH_PROGRESS_INTERVAL_MS 500
+
 G_DEFINE_TYPE (NautilusDBusManager, nautilus_dbus_manager, G_TYPE_OBJECT);
 
 static void
@@ -505,6 +509,159 @@ handle_rename_uri2 (NautilusDBusFileOperations2 *object,
     return TRUE; /* invocation was handled */
 }
 
+typedef struct
+{
+    NautilusDBusManager *self;
+    guint id;
+
+    guint64 last_files;
+    guint64 last_bytes;
+    gdouble last_elapsed;
+} BatchData;
+
+static void
+batch_on_progress (guint64  files,
+                   guint64  bytes,
+                   gdouble  elapsed,
+                   gpointer callback_data)
+{
+    BatchData *data = callback_data;
+    gdouble interval;
+    gdouble files_per_second = 0;
+    gdouble bytes_per_second = 0;
+
+    interval = elapsed - data->last_elapsed;
+    if (interval > 0)
+    {
+        files_per_second = (files - data->last_files) / interval;
+        bytes_per_second = (bytes - data->last_bytes) / interval;
+    }
+
+    data->last_files = files;
+    data->last_bytes = bytes;
+    data->last_elapsed = elapsed;
+
+    if (data->self->file_operations2 == NULL)
+    {
+        return;
+    }
+
+    nautilus_dbus_file_operations2_emit_batch_progress (data->self->file_operations2,
+                                                        data->id, files, bytes,
+                                                        files_per_second,
+                                                        bytes_per_second);
+}
+
+static void
+batch_on_finished (gboolean success,
+                   gpointer callback_data)
+{
+    BatchData *data = callback_data;
+
+    if (data->self->file_operations2 != NULL)
+    {
+        nautilus_dbus_file_operations2_emit_batch_finished (data->self->file_operations2,
+                                                            data->id, success);
+    }
+
+    g_object_unref (data->self);
+    g_free (data);
+    g_application_release (g_application_get_default ());
+}
+
+static void
+batch_operation_free (NautilusBatchOperation *operation)
+{
+    g_list_free_full (operation->sources, g_object_unref);
+    g_clear_object (&operation->destination);
+    g_free (operation);
+}
+
+static gboolean
+handle_run_batch2 (NautilusDBusFileOperations2 *object,
+                   GDBusMethodInvocation       *invocation,
+                   GVariant                    *operations,
+                   GVariant                    *platform_data,
+                   NautilusDBusManager         *self)
+{
+    g_autoptr (NautilusFileOperationsDBusData) dbus_data = NULL;
+    GList *batch = NULL;
+    GVariantIter iter;
+    const gchar *name;
+    const gchar **sources;
+    const gchar *destination;
+    BatchData *data;
+    guint id;
+
+    g_variant_iter_init (&iter, operations);
+    while (g_variant_iter_next (&iter, "(&s^a&s&s)", &name, &sources, &destination))
+    {
+        NautilusBatchOperation *operation;
+
+        operation = g_new0 (NautilusBatchOperation, 1);
+        batch = g_list_prepend (batch, operation);
+
+        if (g_strcmp0 (name, "copy") == 0)
+        {
+            operation->kind = NAUTILUS_BATCH_OPERATION_COPY;
+        }
+        else if (g_strcmp0 (name, "move") == 0)
+        {
+            operation->kind = NAUTILUS_BATCH_OPERATION_MOVE;
+        }
+        else if (g_strcmp0 (name, "trash") == 0)
+        {
+            operation->kind = NAUTILUS_BATCH_OPERATION_TRASH;
+        }
+        else if (g_strcmp0 (name, "delete") == 0)
+        {
+            operation->kind = NAUTILUS_BATCH_OPERATION_DELETE;
+        }
+        else
+        {
+            g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_INVALID_ARGS,
+                                                   "Unknown operation “%s”", name);
+            g_free (sources);
+            g_list_free_full (batch, (GDestroyNotify) batch_operation_free);
+            return TRUE; /* invocation was handled */
+        }
+
+        for (gint idx = 0; sources[idx] != NULL; idx++)
+        {
+            operation->sources = g_list_prepend (operation->sources,
+                                                 g_file_new_for_uri (sources[idx]));
+        }
+        operation->sources = g_list_reverse (operation->sources);
+
+        if (operation->kind == NAUTILUS_BATCH_OPERATION_COPY ||
+            operation->kind == NAUTILUS_BATCH_OPERATION_MOVE)
+        {
+            operation->destination = g_file_new_for_uri (destination);
+        }
+
+        g_free (sources);
+    }
+    batch = g_list_reverse (batch);
+
+    dbus_data = nautilus_file_operations_dbus_data_new (platform_data);
+
+    data = g_new0 (BatchData, 1);
+    data->self = g_object_ref (self);
+    data->id = id = ++self->last_batch_id;
+
+    g_application_hold (g_application_get_default ());
+    nautilus_file_operations_batch (batch, NULL, dbus_data,
+                                    BATCH_PROGRESS_INTERVAL_MS,
+                                    batch_on_progress,
+                                    batch_on_finished, data);
+
+    g_list_free_full (batch, (GDestroyNotify) batch_operation_free);
+
+    nautilus_dbus_file_operations2_complete_run_batch (object, invocation, id);
+    return TRUE; /* invocation was handled */
+}
+
 static void
 undo_manager_changed (NautilusDBusManager *self)
 {
@@ -578,6 +735,10 @@ nautilus_dbus_manager_init (NautilusDBusManager *self)
                       "handle-rename-uri",
                       G_CALLBACK (handle_rename_uri2),
                       self);
+    g_signal_connect (self->file_operations2,
+                      "handle-run-batch",
+                      G_CALLBACK (handle_run_batch2),
+                      self);
     g_signal_connect (self->file_operations,
                       "handle-undo",
                       G_CALLBACK (handle_undo),
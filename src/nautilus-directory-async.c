@@ -25,16 +25,24 @@
 
 #define DEBUG_FLAG NAUTILUS_DEBUG_ASYNC_JOBS
 
+#include "nautilus-cache-registry.h"
 #include "nautilus-debug.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
+#include "nautilus-directory-reader.h"
+#include "nautilus-directory-snapshot.h"
 #include "nautilus-enums.h"
+#include "nautilus-executor.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-queue.h"
+#include "nautilus-file-utilities.h"
+#include "nautilus-filesystem-info-cache.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-metadata.h"
 #include "nautilus-profile.h"
 #include "nautilus-signaller.h"
+#include "nautilus-thumbnail-cache.h"
+#include "nautilus-thumbnail-probe.h"
 
 /* turn this on to check if async. job calls are balanced */
 #if 0
@@ -43,8 +51,53 @@
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
 
-/* Keep async. jobs down to this number for all directories. */
+/* The file list is loaded in batches that start small, so that the first
+ * files show up quickly, and double while the enumerator keeps returning
+ * full batches and handling one stays within the time budget.
+ */
+#define DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK 32
+#define DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK 4096
+#define DIRECTORY_LOAD_CALLBACK_BUDGET (4 * G_TIME_SPAN_MILLISECOND)
+
+/* Pending file infos are turned into NautilusFile objects in slices of
+ * about this long, so that huge directories do not block the main loop.
+ */
+#define DEQUEUE_PENDING_BUDGET (4 * G_TIME_SPAN_MILLISECOND)
+
+/* Async. jobs are budgeted per backend (filesystem id, or URI scheme
+ * and host when that is not known yet), so that one slow mount can not
+ * starve directories on other filesystems. The budget of each backend
+ * floats between these bounds depending on how long its jobs take.
+ */
+#define MIN_ASYNC_JOBS 2
 #define MAX_ASYNC_JOBS 10
+#define FAST_ASYNC_JOB_USEC (50 * G_TIME_SPAN_MILLISECOND)
+#define SLOW_ASYNC_JOB_USEC (500 * G_TIME_SPAN_MILLISECOND)
+
+/* Number of shallow item counts that may run at the same time for a
+ * single directory, and how far past the head of the work queue we
+ * look for files to start them on.
+ */
+#define MAX_DIRECTORY_COUNTS_IN_FLIGHT 4
+#define DIRECTORY_COUNT_LOOKAHEAD (4 * MAX_DIRECTORY_COUNTS_IN_FLIGHT)
+
+/* The same for file info queries, which are cheap but often come in
+ * bursts. Changes are announced in batches of up to this many files.
+ */
+#define MAX_FILE_INFOS_IN_FLIGHT 8
+#define FILE_INFO_LOOKAHEAD (4 * MAX_FILE_INFOS_IN_FLIGHT)
+#define FILE_INFO_CHANGES_PER_BATCH 100
+
+/* A thumbnail being loaded is given up on once it falls further than
+ * this behind the head of the work queue.
+ */
+#define THUMBNAIL_LOOKAHEAD 64
+
+/* Info providers may run at the same time on different files, and
+ * those that can take many files at once get up to a batch of them.
+ */
+#define MAX_EXTENSION_INFOS_IN_FLIGHT 4
+#define EXTENSION_INFO_BATCH_SIZE 1024
 
 struct ThumbnailState
 {
@@ -62,8 +115,7 @@ struct MountState
 
 struct FilesystemInfoState
 {
-    NautilusDirectory *directory;
-    GCancellable *cancellable;
+    NautilusDirectory *directory; /* NULL once cancelled */
     NautilusFile *file;
 };
 
@@ -75,6 +127,9 @@ struct DirectoryLoadState
     GHashTable *load_mime_list_hash;
     NautilusFile *load_directory_file;
     int load_file_count;
+    int items_per_callback;
+    gboolean probe_thumbnails;
+    gint64 begin_time;
 };
 
 struct MimeListState
@@ -89,6 +144,7 @@ struct MimeListState
 struct GetInfoState
 {
     NautilusDirectory *directory;
+    NautilusFile *file;
     GCancellable *cancellable;
 };
 
@@ -106,8 +162,66 @@ struct DirectoryCountState
     GCancellable *cancellable;
     GFileEnumerator *enumerator;
     int file_count;
+    GHashTable *mime_list_hash; /* also getting the MIME list if not NULL */
 };
 
+#define DEEP_COUNT_FIELDS (NAUTILUS_DIRECTORY_READER_TYPE | \
+                           NAUTILUS_DIRECTORY_READER_HIDDEN | \
+                           NAUTILUS_DIRECTORY_READER_SIZE | \
+                           NAUTILUS_DIRECTORY_READER_IDS)
+
+#define DEEP_COUNT_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+    G_FILE_ATTRIBUTE_ID_FILESYSTEM "," \
+    G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+    G_FILE_ATTRIBUTE_UNIX_INODE "," \
+    G_FILE_ATTRIBUTE_UNIX_NLINK
+
+/* Local trees are counted by a pool of threads instead. */
+#define DEEP_COUNT_MAX_THREADS 8
+#define DEEP_COUNT_PROGRESS_INTERVAL_MSEC 100
+#define DEEP_COUNT_CACHE_MAX_ENTRIES 32
+/* What a GFile waiting to be counted takes, about */
+#define DEEP_COUNT_CACHE_DIRECTORY_BYTES 256
+
+#define FILE_LIST_EVICTION_TIMEOUT_SECONDS 30
+
+/* How many of the next files have the queries of their filesystem
+ * started along with the current one */
+#define FILESYSTEM_INFO_PREFETCH_FILES 32
+/* What a loaded NautilusFile takes, about */
+#define FILE_LIST_FILE_BYTES 1024
+
+/* Shared between the counting threads, and the main thread which
+ * publishes the totals. Everything below the mutex is protected by it.
+ */
+typedef struct
+{
+    gatomicrefcount ref_count;
+    GCancellable *cancellable;
+    GFile *location;
+    guint64 mtime; /* of the location when counting started, 0 if unknown */
+    char *fs_id;
+    gboolean show_hidden_files;
+    GStrv prune_patterns;
+
+    GMutex mutex;
+    GCond cond;
+    GQueue directories; /* of GFile *, waiting to be counted */
+    guint busy_threads;
+    guint running_threads;
+    GHashTable *seen_inodes;
+
+    guint directory_count;
+    guint file_count;
+    guint unreadable_count;
+    goffset size;
+} DeepCountJob;
+
 struct DeepCountState
 {
     NautilusDirectory *directory;
@@ -115,10 +229,27 @@ struct DeepCountState
     GFileEnumerator *enumerator;
     GFile *deep_count_location;
     GList *deep_count_subdirectories;
-    GArray *seen_deep_count_inodes;
+    GHashTable *seen_deep_count_inodes; /* set of DeepCountInode, hardlinks only */
     char *fs_id;
+    /* The directories that are counted, but not descended into */
+    GStrv prune_patterns;
+
+    DeepCountJob *job; /* for local trees */
+    guint progress_timeout_id;
 };
 
+/* Finished and interrupted counts of local trees, so that counting a
+ * tree again picks up from where it was, as long as the directory was
+ * not modified since. Main thread only.
+ */
+static GHashTable *deep_count_cache = NULL; /* GFile -> DeepCountJob */
+static GQueue deep_count_cache_order = G_QUEUE_INIT; /* of GFile, oldest first */
+
+/* Directories nobody monitors, whose files are kept until evicted, the
+ * oldest first */
+static GQueue lingering_directories = G_QUEUE_INIT;
+static guint lingering_registry_id = 0;
+
 
 
 typedef struct
@@ -146,20 +277,54 @@ typedef struct
     Request request;
 } Monitor;
 
-typedef struct
+struct ExtensionInfoState
 {
     NautilusDirectory *directory;
     NautilusInfoProvider *provider;
     NautilusOperationHandle *handle;
+    GClosure *update_complete;
+    GList *files; /* of NautilusFile *, not reffed */
+    guint idle_id;
+};
+
+typedef struct
+{
+    ExtensionInfoState *state;
+    NautilusInfoProvider *provider;
+    NautilusOperationHandle *handle;
     NautilusOperationResult result;
 } InfoProviderResponse;
 
 typedef gboolean (*RequestCheck) (Request);
 typedef gboolean (*FileCheck) (NautilusFile *);
 
-/* Current number of async. jobs. */
-static int async_job_count;
-static GHashTable *waiting_directories;
+/* Bucket i counts the times under 2^i ms, the last one everything else. */
+#define ASYNC_JOB_HISTOGRAM_BUCKETS 16
+
+typedef struct
+{
+    const char *job;
+    guint64 started;
+    guint64 finished;
+    guint64 deferred; /* had to wait for a slot */
+    guint service_time[ASYNC_JOB_HISTOGRAM_BUCKETS];
+    guint wait_time[ASYNC_JOB_HISTOGRAM_BUCKETS];
+} AsyncJobStats;
+
+struct AsyncJobBudget
+{
+    char *id;
+    int job_count;
+    int max_jobs;
+    GTimeSpan average_latency;
+    GQueue waiting_directories;
+    GHashTable *job_stats; /* job name -> AsyncJobStats */
+};
+
+/* Budgets live for the whole process, keyed by backend id. */
+static GHashTable *async_job_budgets;
+/* The directory shown in the focused window, woken up first. */
+static NautilusDirectory *focused_directory;
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
 #endif
@@ -335,6 +500,233 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 }
 #endif
 
+static char *
+get_async_job_budget_id (NautilusDirectory *directory)
+{
+    g_autoptr (NautilusFile) file = NULL;
+    g_autofree char *uri = NULL;
+    g_autoptr (GUri) guri = NULL;
+    const char *host;
+
+    file = nautilus_directory_get_existing_corresponding_file (directory);
+    if (file != NULL && file->details->filesystem_id != NULL)
+    {
+        return g_strdup (file->details->filesystem_id);
+    }
+
+    uri = nautilus_directory_get_uri (directory);
+    guri = g_uri_parse (uri, G_URI_FLAGS_NONE, NULL);
+    if (guri == NULL)
+    {
+        return g_uri_parse_scheme (uri);
+    }
+
+    host = g_uri_get_host (guri);
+    return g_strdup_printf ("%s://%s", g_uri_get_scheme (guri),
+                            host != NULL ? host : "");
+}
+
+static AsyncJobBudget *
+get_async_job_budget (NautilusDirectory *directory)
+{
+    AsyncJobBudget *budget;
+    char *id;
+
+    if (directory->details->job_budget != NULL)
+    {
+        return directory->details->job_budget;
+    }
+
+    if (async_job_budgets == NULL)
+    {
+        async_job_budgets = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+    id = get_async_job_budget_id (directory);
+    budget = g_hash_table_lookup (async_job_budgets, id);
+    if (budget == NULL)
+    {
+        budget = g_new0 (AsyncJobBudget, 1);
+        budget->id = id;
+        budget->max_jobs = MAX_ASYNC_JOBS;
+        g_queue_init (&budget->waiting_directories);
+        budget->job_stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   NULL, g_free);
+        g_hash_table_insert (async_job_budgets, budget->id, budget);
+    }
+    else
+    {
+        g_free (id);
+    }
+
+    /* Once picked, a directory sticks to its budget, so that every
+     * job ends up being accounted where it was started.
+     */
+    directory->details->job_budget = budget;
+
+    return budget;
+}
+
+/* Additive increase while jobs are fast, multiplicative decrease when
+ * they get slow, so that a struggling server is not piled up with more
+ * requests than it can answer.
+ */
+static void
+async_job_budget_record_latency (AsyncJobBudget *budget,
+                                 GTimeSpan       latency)
+{
+    if (budget->average_latency == 0)
+    {
+        budget->average_latency = latency;
+    }
+    else
+    {
+        budget->average_latency = (7 * budget->average_latency + latency) / 8;
+    }
+
+    if (budget->average_latency < FAST_ASYNC_JOB_USEC)
+    {
+        budget->max_jobs = MIN (budget->max_jobs + 1, MAX_ASYNC_JOBS);
+    }
+    else if (budget->average_latency > SLOW_ASYNC_JOB_USEC &&
+             budget->job_count < budget->max_jobs)
+    {
+        budget->max_jobs = MAX (budget->max_jobs / 2, MIN_ASYNC_JOBS);
+    }
+}
+
+/* The jobs going through whole folders take as long as the folders are
+ * big, whatever the latency of the backend, so they are not averaged. */
+static gboolean
+async_job_is_round_trip (const char *job)
+{
+    static const char * const enumerating_jobs[] =
+    {
+        "file list", "directory count", "deep count", "MIME list", NULL
+    };
+
+    return !g_strv_contains (enumerating_jobs, job);
+}
+
+static AsyncJobStats *
+get_async_job_stats (AsyncJobBudget *budget,
+                     const char     *job)
+{
+    AsyncJobStats *stats;
+
+    stats = g_hash_table_lookup (budget->job_stats, job);
+    if (stats == NULL)
+    {
+        stats = g_new0 (AsyncJobStats, 1);
+        stats->job = job;
+        g_hash_table_insert (budget->job_stats, (gpointer) job, stats);
+    }
+
+    return stats;
+}
+
+static void
+async_job_histogram_add (guint      *histogram,
+                         GTimeSpan   time)
+{
+    GTimeSpan msec;
+    int bucket;
+
+    msec = time / G_TIME_SPAN_MILLISECOND;
+    for (bucket = 0; msec > 0 && bucket < ASYNC_JOB_HISTOGRAM_BUCKETS - 1; bucket++)
+    {
+        msec >>= 1;
+    }
+
+    histogram[bucket]++;
+}
+
+static void
+async_job_histogram_print (GString     *string,
+                           const char  *name,
+                           const guint *histogram)
+{
+    int bucket;
+
+    g_string_append_printf (string, "    %s:", name);
+    for (bucket = 0; bucket < ASYNC_JOB_HISTOGRAM_BUCKETS; bucket++)
+    {
+        if (histogram[bucket] == 0)
+        {
+            continue;
+        }
+
+        if (bucket == ASYNC_JOB_HISTOGRAM_BUCKETS - 1)
+        {
+            g_string_append_printf (string, " >=%dms %u", 1 << (bucket - 1), histogram[bucket]);
+        }
+        else
+        {
+            g_string_append_printf (string, " <%dms %u", 1 << bucket, histogram[bucket]);
+        }
+    }
+    g_string_append_c (string, '\n');
+}
+
+char *
+nautilus_directory_get_async_job_stats (void)
+{
+    GString *string;
+    GHashTableIter iter, stats_iter;
+    AsyncJobBudget *budget;
+    AsyncJobStats *stats;
+
+    string = g_string_new (NULL);
+
+    if (async_job_budgets == NULL)
+    {
+        return g_string_free (string, FALSE);
+    }
+
+    g_hash_table_iter_init (&iter, async_job_budgets);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &budget))
+    {
+        g_string_append_printf (string,
+                                "%s: %d/%d jobs, %u directories waiting, %" G_GINT64_FORMAT " ms per job\n",
+                                budget->id, budget->job_count, budget->max_jobs,
+                                g_queue_get_length (&budget->waiting_directories),
+                                budget->average_latency / G_TIME_SPAN_MILLISECOND);
+
+        g_hash_table_iter_init (&stats_iter, budget->job_stats);
+        while (g_hash_table_iter_next (&stats_iter, NULL, (gpointer *) &stats))
+        {
+            g_string_append_printf (string,
+                                    "  %s: %" G_GUINT64_FORMAT " started, %" G_GUINT64_FORMAT " finished, %" G_GUINT64_FORMAT " deferred\n",
+                                    stats->job, stats->started, stats->finished, stats->deferred);
+            async_job_histogram_print (string, "service", stats->service_time);
+            async_job_histogram_print (string, "wait", stats->wait_time);
+        }
+    }
+
+    return g_string_free (string, FALSE);
+}
+
+static void
+async_job_budgets_debug (void)
+{
+    GHashTableIter iter;
+    AsyncJobBudget *budget;
+
+    if (!DEBUGGING || async_job_budgets == NULL)
+    {
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, async_job_budgets);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &budget))
+    {
+        DEBUG ("budget %s: %d/%d jobs, %u directories waiting, %" G_GINT64_FORMAT " ms per job",
+               budget->id, budget->job_count, budget->max_jobs,
+               g_queue_get_length (&budget->waiting_directories),
+               budget->average_latency / G_TIME_SPAN_MILLISECOND);
+    }
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
@@ -343,25 +735,33 @@ static gboolean
 async_job_start (NautilusDirectory *directory,
                  const char        *job)
 {
+    AsyncJobBudget *budget;
+    AsyncJobStats *stats;
+    AsyncJobStart start;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
 #endif
 
     DEBUG ("starting %s in %p", job, directory->details->location);
 
-    g_assert (async_job_count >= 0);
-    g_assert (async_job_count <= MAX_ASYNC_JOBS);
+    budget = get_async_job_budget (directory);
+    stats = get_async_job_stats (budget, job);
 
-    if (async_job_count >= MAX_ASYNC_JOBS)
+    g_assert (budget->job_count >= 0);
+
+    if (budget->job_count >= budget->max_jobs)
     {
-        if (waiting_directories == NULL)
+        if (g_queue_find (&budget->waiting_directories, directory) == NULL)
         {
-            waiting_directories = g_hash_table_new (NULL, NULL);
+            g_queue_push_tail (&budget->waiting_directories, directory);
         }
 
-        g_hash_table_insert (waiting_directories,
-                             directory,
-                             directory);
+        /* Counted once however many times it is refused while waiting */
+        if (directory->details->job_wait_start_time == 0)
+        {
+            stats->deferred++;
+            directory->details->job_wait_start_time = g_get_monotonic_time ();
+        }
 
         return FALSE;
     }
@@ -385,7 +785,19 @@ async_job_start (NautilusDirectory *directory,
     }
 #endif
 
-    async_job_count += 1;
+    start.job = job;
+    start.start_time = g_get_monotonic_time ();
+    g_array_append_val (directory->details->job_start_times, start);
+
+    stats->started++;
+    if (directory->details->job_wait_start_time != 0)
+    {
+        async_job_histogram_add (stats->wait_time,
+                                 start.start_time - directory->details->job_wait_start_time);
+        directory->details->job_wait_start_time = 0;
+    }
+
+    budget->job_count += 1;
     return TRUE;
 }
 
@@ -394,6 +806,11 @@ static void
 async_job_end (NautilusDirectory *directory,
                const char        *job)
 {
+    AsyncJobBudget *budget;
+    AsyncJobStats *stats;
+    GArray *start_times;
+    GTimeSpan service_time;
+    guint i;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
     gpointer table_key, value;
@@ -401,7 +818,9 @@ async_job_end (NautilusDirectory *directory,
 
     DEBUG ("stopping %s in %p", job, directory->details->location);
 
-    g_assert (async_job_count > 0);
+    budget = directory->details->job_budget;
+    g_assert (budget != NULL);
+    g_assert (budget->job_count > 0);
 
 #ifdef DEBUG_ASYNC_JOBS
     {
@@ -424,33 +843,70 @@ async_job_end (NautilusDirectory *directory,
     }
 #endif
 
-    async_job_count -= 1;
-}
+    /* Jobs of one kind mostly finish in the order they were started,
+     * so the oldest start of that kind is a good enough estimate.
+     */
+    start_times = directory->details->job_start_times;
+    for (i = 0; i < start_times->len; i++)
+    {
+        if (g_strcmp0 (g_array_index (start_times, AsyncJobStart, i).job, job) == 0)
+        {
+            break;
+        }
+    }
+    if (i == start_times->len)
+    {
+        i = 0;
+    }
+    if (start_times->len > 0)
+    {
+        service_time = g_get_monotonic_time () -
+                       g_array_index (start_times, AsyncJobStart, i).start_time;
+        nautilus_trace_span (job, g_array_index (start_times, AsyncJobStart, i).start_time, NULL);
+        g_array_remove_index (start_times, i);
 
-/* Helper to get one value from a hash table. */
-static void
-get_one_value_callback (gpointer key,
-                        gpointer value,
-                        gpointer callback_data)
-{
-    gpointer *returned_value;
+        if (async_job_is_round_trip (job))
+        {
+            async_job_budget_record_latency (budget, service_time);
+        }
 
-    returned_value = callback_data;
-    *returned_value = value;
+        stats = get_async_job_stats (budget, job);
+        stats->finished++;
+        async_job_histogram_add (stats->service_time, service_time);
+    }
+
+    budget->job_count -= 1;
 }
 
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
+static gboolean
+async_job_budget_wake_up_one (AsyncJobBudget *budget)
 {
-    gpointer value;
+    NautilusDirectory *directory;
+
+    if (budget->job_count >= budget->max_jobs)
+    {
+        return FALSE;
+    }
+
+    if (focused_directory != NULL &&
+        focused_directory->details->job_budget == budget &&
+        g_queue_remove (&budget->waiting_directories, focused_directory))
+    {
+        directory = focused_directory;
+    }
+    else
+    {
+        directory = g_queue_pop_head (&budget->waiting_directories);
+    }
 
-    value = NULL;
-    if (table != NULL)
+    if (directory == NULL)
     {
-        g_hash_table_foreach (table, get_one_value_callback, &value);
+        return FALSE;
     }
-    return value;
+
+    nautilus_directory_async_state_changed (directory);
+
+    return TRUE;
 }
 
 /* Wake up directories that are "blocked" as long as there are job
@@ -460,38 +916,82 @@ static void
 async_job_wake_up (void)
 {
     static gboolean already_waking_up = FALSE;
-    gpointer value;
-
-    g_assert (async_job_count >= 0);
-    g_assert (async_job_count <= MAX_ASYNC_JOBS);
+    GList *budgets, *l;
 
-    if (already_waking_up)
+    if (already_waking_up || async_job_budgets == NULL)
     {
         return;
     }
 
     already_waking_up = TRUE;
-    while (async_job_count < MAX_ASYNC_JOBS)
+
+    async_job_budgets_debug ();
+
+    /* Budgets are never freed, but waking directories up might add
+     * new ones to the table, so don't iterate it directly.
+     */
+    budgets = g_hash_table_get_values (async_job_budgets);
+
+    if (focused_directory != NULL &&
+        focused_directory->details->job_budget != NULL)
     {
-        value = get_one_value (waiting_directories);
-        if (value == NULL)
+        async_job_budget_wake_up_one (focused_directory->details->job_budget);
+    }
+
+    for (l = budgets; l != NULL; l = l->next)
+    {
+        while (async_job_budget_wake_up_one (l->data))
         {
-            break;
+            /* Keep going while there are both free slots and waiters. */
         }
-        g_hash_table_remove (waiting_directories, value);
-        nautilus_directory_async_state_changed
-            (NAUTILUS_DIRECTORY (value));
     }
+
+    g_list_free (budgets);
+
     already_waking_up = FALSE;
 }
 
+void
+nautilus_directory_set_focused (NautilusDirectory *directory)
+{
+    focused_directory = directory;
+}
+
+static DirectoryCountState *
+find_directory_count_for_file (NautilusDirectory *directory,
+                               NautilusFile      *file)
+{
+    GList *node;
+    DirectoryCountState *state;
+
+    for (node = directory->details->count_in_progress; node != NULL; node = node->next)
+    {
+        state = node->data;
+        if (state->count_file == file)
+        {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+directory_count_cancel_one (NautilusDirectory   *directory,
+                            DirectoryCountState *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    directory->details->count_in_progress =
+        g_list_remove (directory->details->count_in_progress, state);
+}
+
 static void
 directory_count_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->count_in_progress != NULL)
+    while (directory->details->count_in_progress != NULL)
     {
-        g_cancellable_cancel (directory->details->count_in_progress->cancellable);
-        directory->details->count_in_progress = NULL;
+        directory_count_cancel_one (directory,
+                                    directory->details->count_in_progress->data);
     }
 }
 
@@ -506,6 +1006,8 @@ deep_count_cancel (NautilusDirectory *directory)
 
         directory->details->deep_count_file->details->deep_counts_status = NAUTILUS_REQUEST_NOT_STARTED;
 
+        g_clear_handle_id (&directory->details->deep_count_in_progress->progress_timeout_id,
+                           g_source_remove);
         directory->details->deep_count_in_progress->directory = NULL;
         directory->details->deep_count_in_progress = NULL;
         directory->details->deep_count_file = NULL;
@@ -547,18 +1049,50 @@ mount_cancel (NautilusDirectory *directory)
     }
 }
 
+static GetInfoState *
+find_file_info_for_file (NautilusDirectory *directory,
+                         NautilusFile      *file)
+{
+    GList *node;
+    GetInfoState *state;
+
+    for (node = directory->details->get_info_in_progress; node != NULL; node = node->next)
+    {
+        state = node->data;
+        if (state->file == file)
+        {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+static void flush_changed_file_infos (NautilusDirectory *directory);
+
+static void
+file_info_cancel_one (NautilusDirectory *directory,
+                      GetInfoState      *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    state->file = NULL;
+    directory->details->get_info_in_progress =
+        g_list_remove (directory->details->get_info_in_progress, state);
+
+    async_job_end (directory, "file info");
+}
+
 static void
 file_info_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->get_info_in_progress != NULL)
+    while (directory->details->get_info_in_progress != NULL)
     {
-        g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
-        directory->details->get_info_in_progress->directory = NULL;
-        directory->details->get_info_in_progress = NULL;
-        directory->details->get_info_file = NULL;
-
-        async_job_end (directory, "file info");
+        file_info_cancel_one (directory,
+                              directory->details->get_info_in_progress->data);
     }
+
+    flush_changed_file_infos (directory);
 }
 
 static void
@@ -762,6 +1296,12 @@ nautilus_directory_set_up_request (NautilusFileAttributes file_attributes)
         REQUEST_SET_TYPE (request, REQUEST_FILESYSTEM_INFO);
     }
 
+    if (file_attributes & NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO)
+    {
+        REQUEST_SET_TYPE (request, REQUEST_EXTENDED_INFO);
+        REQUEST_SET_TYPE (request, REQUEST_FILE_INFO);
+    }
+
     return request;
 }
 
@@ -839,7 +1379,12 @@ nautilus_directory_monitor_add_internal (NautilusDirectory         *directory,
      */
     if (directory->details->monitor == NULL)
     {
-        directory->details->monitor = nautilus_monitor_directory (directory->details->location);
+        directory->details->monitor = nautilus_monitor_directory (directory->details->location,
+                                                                  file != NULL);
+    }
+    else if (file == NULL)
+    {
+        nautilus_monitor_set_background (directory->details->monitor, FALSE);
     }
 
 
@@ -867,30 +1412,88 @@ nautilus_directory_monitor_add_internal (NautilusDirectory         *directory,
     nautilus_profile_end (NULL);
 }
 
-static void
-set_file_unconfirmed (NautilusFile *file,
-                      gboolean      unconfirmed)
+/* Like nautilus_directory_monitor_add_internal() for each of @files,
+ * but only kicks the I/O of the directory once for all of them.
+ */
+void
+nautilus_directory_monitor_add_files_internal (NautilusDirectory      *directory,
+                                               GList                  *files,
+                                               gconstpointer           client,
+                                               gboolean                monitor_hidden_files,
+                                               NautilusFileAttributes  file_attributes)
 {
-    NautilusDirectory *directory;
-
-    g_assert (NAUTILUS_IS_FILE (file));
-    g_assert (unconfirmed == FALSE || unconfirmed == TRUE);
+    Monitor *monitor;
+    Request request;
+    NautilusFile *file;
+    GList *l;
 
-    if (file->details->unconfirmed == unconfirmed)
+    g_assert (NAUTILUS_IS_DIRECTORY (directory));
+    g_assert (client != NULL);
+
+    if (files == NULL)
     {
         return;
     }
-    file->details->unconfirmed = unconfirmed;
 
-    directory = file->details->directory;
-    if (unconfirmed)
+    nautilus_profile_start (NULL);
+
+    request = nautilus_directory_set_up_request (file_attributes);
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        file = l->data;
+        g_assert (file->details->directory == directory);
+
+        remove_monitor (directory, file, client);
+
+        monitor = g_new (Monitor, 1);
+        monitor->file = file;
+        monitor->monitor_hidden_files = monitor_hidden_files;
+        monitor->client = client;
+        monitor->request = request;
+
+        insert_new_monitor (directory, monitor);
+        nautilus_directory_add_file_to_work_queue (directory, file);
+    }
+
+    if (directory->details->monitor == NULL)
     {
-        directory->details->confirmed_file_count--;
+        directory->details->monitor = nautilus_monitor_directory (directory->details->location,
+                                                                  TRUE);
     }
-    else
+
+    if (REQUEST_WANTS_TYPE (request, REQUEST_FILE_INFO) &&
+        directory->details->mime_db_monitor == 0)
+    {
+        directory->details->mime_db_monitor =
+            g_signal_connect_object (nautilus_signaller_get_current (),
+                                     "mime-data-changed",
+                                     G_CALLBACK (mime_db_changed_callback), directory, 0);
+    }
+
+    nautilus_directory_async_state_changed (directory);
+    nautilus_profile_end (NULL);
+}
+
+/* A file is confirmed once it has been seen by the current load of its
+ * directory. Starting a new load bumps the generation of the directory,
+ * which makes every file unconfirmed at once.
+ */
+static void
+confirm_file (NautilusFile *file)
+{
+    NautilusDirectory *directory;
+
+    g_assert (NAUTILUS_IS_FILE (file));
+
+    directory = file->details->directory;
+    if (file->details->load_generation == directory->details->load_generation)
     {
-        directory->details->confirmed_file_count++;
+        return;
     }
+
+    file->details->load_generation = directory->details->load_generation;
+    directory->details->confirmed_file_count++;
 }
 
 static gboolean show_hidden_files = TRUE;
@@ -902,8 +1505,7 @@ show_hidden_files_changed_callback (gpointer callback_data)
 }
 
 static gboolean
-should_skip_file (NautilusDirectory *directory,
-                  GFileInfo         *info)
+get_show_hidden_files (void)
 {
     static gboolean show_hidden_files_changed_callback_installed = FALSE;
 
@@ -921,7 +1523,14 @@ should_skip_file (NautilusDirectory *directory,
         show_hidden_files_changed_callback (NULL);
     }
 
-    if (!show_hidden_files &&
+    return show_hidden_files;
+}
+
+static gboolean
+should_skip_file (NautilusDirectory *directory,
+                  GFileInfo         *info)
+{
+    if (!get_show_hidden_files () &&
         (g_file_info_get_is_hidden (info) ||
          g_file_info_get_is_backup (info)))
     {
@@ -931,77 +1540,200 @@ should_skip_file (NautilusDirectory *directory,
     return FALSE;
 }
 
+static void
+drain_pending_file_info (NautilusDirectory *directory)
+{
+    GPtrArray *pending_file_info;
+    guint i;
+
+    pending_file_info = directory->details->pending_file_info;
+    for (i = directory->details->pending_file_info_offset; i < pending_file_info->len; i++)
+    {
+        g_object_unref (g_ptr_array_index (pending_file_info, i));
+    }
+    g_ptr_array_set_size (pending_file_info, 0);
+    directory->details->pending_file_info_offset = 0;
+}
+
+static gboolean
+directory_snapshots_enabled (void)
+{
+    return g_settings_get_boolean (nautilus_preferences,
+                                   NAUTILUS_PREFERENCES_USE_DIRECTORY_SNAPSHOTS);
+}
+
+/* How long the last listing of a remote directory is shown right away on
+ * the next visit, while it is read again. 0 if never. */
+static guint
+get_remote_listing_ttl (NautilusDirectory *directory)
+{
+    NautilusFile *file;
+    gboolean is_remote;
+
+    file = nautilus_directory_get_corresponding_file (directory);
+    is_remote = !g_file_is_native (directory->details->location) ||
+                nautilus_file_is_remote (file);
+    nautilus_file_unref (file);
+
+    if (!is_remote)
+    {
+        return 0;
+    }
+
+    return g_settings_get_uint (nautilus_preferences,
+                                NAUTILUS_PREFERENCES_REMOTE_LISTING_TTL);
+}
+
+static void
+save_directory_snapshot (NautilusDirectory *directory)
+{
+    NautilusFile *file;
+    time_t mtime;
+
+    /* Remote listings are slow enough to get back at any size */
+    if (get_remote_listing_ttl (directory) == 0 &&
+        (!directory_snapshots_enabled () ||
+         g_hash_table_size (directory->details->file_hash) < NAUTILUS_DIRECTORY_SNAPSHOT_MIN_FILES))
+    {
+        return;
+    }
+
+    file = nautilus_directory_get_corresponding_file (directory);
+    mtime = file->details->got_file_info ? file->details->mtime : 0;
+    nautilus_file_unref (file);
+
+    nautilus_directory_snapshot_save (directory->details->location,
+                                      mtime,
+                                      directory->details->file_list);
+}
+
+/* Show the files of the last snapshot right away, if it is still valid,
+ * or the recent files GtkRecentManager knows of, as listing recent:///
+ * looks up every one of them first.
+ * This has to happen before the files are marked unconfirmed, so that the
+ * live load confirms the files that are still there and sweeps the rest.
+ */
+static void
+load_directory_snapshot (NautilusDirectory *directory)
+{
+    NautilusFile *file;
+    GList *infos, *node;
+    GList *added_files;
+    GFileInfo *file_info;
+    guint ttl;
+    time_t mtime;
+
+    if (directory->details->file_list != NULL)
+    {
+        return;
+    }
+
+    if (nautilus_is_recent_directory (directory->details->location))
+    {
+        infos = nautilus_directory_snapshot_load_recent ();
+    }
+    else
+    {
+        ttl = get_remote_listing_ttl (directory);
+        if (ttl == 0 && !directory_snapshots_enabled ())
+        {
+            return;
+        }
+
+        file = nautilus_directory_get_corresponding_file (directory);
+        mtime = file->details->got_file_info ? file->details->mtime : 0;
+        nautilus_file_unref (file);
+
+        infos = nautilus_directory_snapshot_load (directory->details->location,
+                                                  directory_snapshots_enabled () ? mtime : 0,
+                                                  ttl);
+    }
+    if (infos == NULL)
+    {
+        return;
+    }
+
+    nautilus_profile_start ("nitems %u", g_list_length (infos));
+
+    added_files = NULL;
+    for (node = infos; node != NULL; node = node->next)
+    {
+        file_info = G_FILE_INFO (node->data);
+
+        if (nautilus_directory_find_file_by_name (directory,
+                                                  g_file_info_get_name (file_info)) != NULL)
+        {
+            continue;
+        }
+
+        file = nautilus_file_new_from_info (directory, file_info);
+        file->details->has_partial_info = TRUE;
+        nautilus_directory_add_file (directory, file);
+        file->details->is_added = TRUE;
+        added_files = g_list_prepend (added_files, file);
+    }
+    g_list_free_full (infos, g_object_unref);
+
+    nautilus_directory_emit_files_added (directory, added_files);
+    nautilus_file_list_free (added_files);
+
+    nautilus_profile_end (NULL);
+}
+
 static gboolean
 dequeue_pending_idle_callback (gpointer callback_data)
 {
     NautilusDirectory *directory;
-    GList *pending_file_info;
+    GPtrArray *pending_file_info;
     GList *node, *next;
     NautilusFile *file;
     GList *changed_files, *added_files;
     GFileInfo *file_info;
-    const char *mimetype, *name;
-    DirectoryLoadState *dir_load_state;
+    const char *name;
+    gint64 start_time;
 
     directory = NAUTILUS_DIRECTORY (callback_data);
 
     nautilus_directory_ref (directory);
 
-    nautilus_profile_start ("nitems %d", g_list_length (directory->details->pending_file_info));
+    pending_file_info = directory->details->pending_file_info;
 
-    directory->details->dequeue_pending_idle_id = 0;
+    nautilus_profile_start ("nitems %u",
+                            pending_file_info->len - directory->details->pending_file_info_offset);
 
-    /* Handle the files in the order we saw them. */
-    pending_file_info = g_list_reverse (directory->details->pending_file_info);
-    directory->details->pending_file_info = NULL;
+    directory->details->dequeue_pending_idle_id = 0;
 
     /* If we are no longer monitoring, then throw away these. */
     if (!nautilus_directory_is_file_list_monitored (directory))
     {
         nautilus_directory_async_state_changed (directory);
-        goto drain;
+        drain_pending_file_info (directory);
+        goto out;
     }
 
     added_files = NULL;
     changed_files = NULL;
 
-    dir_load_state = directory->details->directory_load_in_progress;
+    start_time = g_get_monotonic_time ();
 
-    /* Build a list of NautilusFile objects. */
-    for (node = pending_file_info; node != NULL; node = node->next)
+    /* Build a list of NautilusFile objects, in the order we saw them,
+     * until the time slice is used up.
+     */
+    while (directory->details->pending_file_info_offset < pending_file_info->len)
     {
-        file_info = node->data;
+        file_info = g_ptr_array_index (pending_file_info,
+                                       directory->details->pending_file_info_offset);
+        directory->details->pending_file_info_offset++;
 
         name = g_file_info_get_name (file_info);
 
-        /* Update the file count. */
-        /* FIXME bugzilla.gnome.org 45063: This could count a
-         * file twice if we get it from both load_directory
-         * and from new_files_callback. Not too hard to fix by
-         * moving this into the actual callback instead of
-         * waiting for the idle function.
-         */
-        if (dir_load_state &&
-            !should_skip_file (directory, file_info))
-        {
-            dir_load_state->load_file_count += 1;
-
-            /* Add the MIME type to the set. */
-            mimetype = g_file_info_get_content_type (file_info);
-            if (mimetype != NULL)
-            {
-                istr_set_insert (dir_load_state->load_mime_list_hash,
-                                 mimetype);
-            }
-        }
-
         /* check if the file already exists */
         file = nautilus_directory_find_file_by_name (directory, name);
         if (file != NULL)
         {
             /* file already exists in dir, check if we still need to
              *  emit file_added or if it changed */
-            set_file_unconfirmed (file, FALSE);
+            confirm_file (file);
             if (!file->details->is_added)
             {
                 /* We consider this newly added even if its in the list.
@@ -1012,27 +1744,50 @@ dequeue_pending_idle_callback (gpointer callback_data)
                 file->details->is_added = TRUE;
                 added_files = g_list_prepend (added_files, file);
             }
-            else if (nautilus_file_update_info (file, file_info))
+            else
             {
-                /* File changed, notify about the change. */
-                nautilus_file_ref (file);
-                changed_files = g_list_prepend (changed_files, file);
+                if (nautilus_file_update_info (file, file_info))
+                {
+                    /* File changed, notify about the change. */
+                    nautilus_file_ref (file);
+                    changed_files = g_list_prepend (changed_files, file);
+                }
+                file->details->has_partial_info = directory->details->directory_load_is_fast;
+                file->details->extended_info_failed = FALSE;
             }
         }
         else
         {
             /* new file, create a nautilus file object and add it to the list */
             file = nautilus_file_new_from_info (directory, file_info);
+            file->details->has_partial_info = directory->details->directory_load_is_fast;
             nautilus_directory_add_file (directory, file);
             file->details->is_added = TRUE;
             added_files = g_list_prepend (added_files, file);
         }
+
+        g_object_unref (file_info);
+
+        if (g_get_monotonic_time () - start_time > DEQUEUE_PENDING_BUDGET)
+        {
+            break;
+        }
+    }
+
+    if (directory->details->pending_file_info_offset == pending_file_info->len)
+    {
+        g_ptr_array_set_size (pending_file_info, 0);
+        directory->details->pending_file_info_offset = 0;
     }
 
     /* If we are done loading, then we assume that any unconfirmed
-     * files are gone.
+     * files are gone. Only look for them if the count says there are
+     * some, which is rarely the case.
      */
-    if (directory->details->directory_loaded)
+    if (directory->details->directory_loaded &&
+        pending_file_info->len == 0 &&
+        directory->details->confirmed_file_count <
+        (int) g_hash_table_size (directory->details->file_hash))
     {
         for (node = directory->details->file_list;
              node != NULL; node = next)
@@ -1040,7 +1795,7 @@ dequeue_pending_idle_callback (gpointer callback_data)
             file = NAUTILUS_FILE (node->data);
             next = node->next;
 
-            if (file->details->unconfirmed)
+            if (file->details->load_generation != directory->details->load_generation)
             {
                 nautilus_file_ref (file);
                 changed_files = g_list_prepend (changed_files, file);
@@ -1056,37 +1811,30 @@ dequeue_pending_idle_callback (gpointer callback_data)
     nautilus_directory_emit_files_added (directory, added_files);
     nautilus_file_list_free (added_files);
 
-    if (directory->details->directory_loaded &&
-        !directory->details->directory_loaded_sent_notification)
-    {
-        /* Send the done_loading signal. */
-        nautilus_directory_emit_done_loading (directory);
+    nautilus_trace_slow_span ("dequeue pending files", start_time, NULL);
 
-        if (dir_load_state)
+    if (pending_file_info->len > 0)
+    {
+        /* Pick up the rest in the next slice. */
+        nautilus_directory_schedule_dequeue_pending (directory);
+    }
+    else if (directory->details->directory_loaded &&
+             !directory->details->directory_loaded_sent_notification)
+    {
+        if (directory->details->directory_load_succeeded)
         {
-            file = dir_load_state->load_directory_file;
-
-            file->details->directory_count = dir_load_state->load_file_count;
-            file->details->directory_count_is_up_to_date = TRUE;
-            file->details->got_directory_count = TRUE;
-
-            file->details->got_mime_list = TRUE;
-            file->details->mime_list_is_up_to_date = TRUE;
-            g_list_free_full (file->details->mime_list, g_free);
-            file->details->mime_list = istr_set_get_as_list
-                                           (dir_load_state->load_mime_list_hash);
-
-            nautilus_file_changed (file);
+            save_directory_snapshot (directory);
         }
 
+        /* Send the done_loading signal. */
+        nautilus_directory_emit_done_loading (directory);
+
         nautilus_directory_async_state_changed (directory);
 
         directory->details->directory_loaded_sent_notification = TRUE;
     }
 
-drain:
-    g_list_free_full (pending_file_info, g_object_unref);
-
+out:
     /* Get the state machine running again. */
     nautilus_directory_async_state_changed (directory);
 
@@ -1126,10 +1874,21 @@ directory_load_one (NautilusDirectory *directory,
         return;
     }
 
+    /* Nobody would see them. Unless they were already known, because
+     * files that are not confirmed are taken for gone. */
+    if (directory->details->directory_load_skips_hidden &&
+        should_skip_file (directory, info) &&
+        nautilus_directory_find_file_by_name (directory, g_file_info_get_name (info)) == NULL)
+    {
+        /* Their names still clash, see nautilus_directory_has_hidden_file_by_name() */
+        g_hash_table_insert (directory->details->skipped_hidden_names,
+                             g_strdup (g_file_info_get_name (info)),
+                             GINT_TO_POINTER (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY));
+        return;
+    }
+
     /* Arrange for the "loading" part of the work. */
-    g_object_ref (info);
-    directory->details->pending_file_info
-        = g_list_prepend (directory->details->pending_file_info, info);
+    g_ptr_array_add (directory->details->pending_file_info, g_object_ref (info));
     nautilus_directory_schedule_dequeue_pending (directory);
 }
 
@@ -1167,11 +1926,7 @@ file_list_cancel (NautilusDirectory *directory)
         directory->details->dequeue_pending_idle_id = 0;
     }
 
-    if (directory->details->pending_file_info != NULL)
-    {
-        g_list_free_full (directory->details->pending_file_info, g_object_unref);
-        directory->details->pending_file_info = NULL;
-    }
+    drain_pending_file_info (directory);
 }
 
 static void
@@ -1179,25 +1934,56 @@ directory_load_done (NautilusDirectory *directory,
                      GError            *error)
 {
     GList *node;
+    DirectoryLoadState *state;
+    NautilusFile *file;
 
     nautilus_profile_start (NULL);
     g_object_ref (directory);
 
     directory->details->directory_loaded = TRUE;
     directory->details->directory_loaded_sent_notification = FALSE;
+    directory->details->directory_load_succeeded = (error == NULL);
+
+    /* The count and MIME list were gathered as the files came in, so
+     * they are known now, even if some files are still pending.
+     */
+    state = directory->details->directory_load_in_progress;
+    if (state != NULL)
+    {
+        file = state->load_directory_file;
+
+        file->details->directory_count = state->load_file_count;
+        file->details->directory_count_is_up_to_date = TRUE;
+        file->details->got_directory_count = TRUE;
+
+        file->details->got_mime_list = TRUE;
+        file->details->mime_list_is_up_to_date = TRUE;
+        g_list_free_full (file->details->mime_list, g_free);
+        file->details->mime_list = istr_set_get_as_list (state->load_mime_list_hash);
+
+        nautilus_file_changed (file);
+
+        if (nautilus_trace_is_enabled ())
+        {
+            g_autofree char *uri = nautilus_directory_get_uri (directory);
+
+            nautilus_trace_span ("directory load", state->begin_time,
+                                 "%s, %d files", uri, state->load_file_count);
+        }
+    }
 
     if (error != NULL)
     {
         /* The load did not complete successfully. This means
          * we don't know the status of the files in this directory.
-         * We clear the unconfirmed bit on each file here so that
-         * they won't be marked "gone" later -- we don't know enough
-         * about them to know whether they are really gone.
+         * We confirm each file here so that they won't be marked
+         * "gone" later -- we don't know enough about them to know
+         * whether they are really gone.
          */
         for (node = directory->details->file_list;
              node != NULL; node = node->next)
         {
-            set_file_unconfirmed (NAUTILUS_FILE (node->data), FALSE);
+            confirm_file (NAUTILUS_FILE (node->data));
         }
 
         nautilus_directory_emit_load_error (directory, error);
@@ -1239,6 +2025,37 @@ nautilus_directory_monitor_remove_internal (NautilusDirectory *directory,
     nautilus_directory_async_state_changed (directory);
 }
 
+/* Like nautilus_directory_monitor_remove_internal() for each of @files. */
+void
+nautilus_directory_monitor_remove_files_internal (NautilusDirectory *directory,
+                                                  GList             *files,
+                                                  gconstpointer      client)
+{
+    GList *l;
+
+    g_assert (NAUTILUS_IS_DIRECTORY (directory));
+    g_assert (client != NULL);
+
+    if (files == NULL)
+    {
+        return;
+    }
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        remove_monitor (directory, l->data, client);
+    }
+
+    if (directory->details->monitor != NULL
+        && g_hash_table_size (directory->details->monitor_table) == 0)
+    {
+        nautilus_monitor_cancel (directory->details->monitor);
+        directory->details->monitor = NULL;
+    }
+
+    nautilus_directory_async_state_changed (directory);
+}
+
 FileMonitors *
 nautilus_directory_remove_file_monitors (NautilusDirectory *directory,
                                          NautilusFile      *file)
@@ -1712,11 +2529,15 @@ nautilus_async_destroying_file (NautilusFile *file)
     /* Check if it's a file that's currently being worked on.
      * If so, make that NULL so it gets canceled right away.
      */
-    if (directory->details->count_in_progress != NULL &&
-        directory->details->count_in_progress->count_file == file)
+    for (node = directory->details->count_in_progress; node != NULL; node = node->next)
     {
-        directory->details->count_in_progress->count_file = NULL;
-        changed = TRUE;
+        DirectoryCountState *count_state = node->data;
+
+        if (count_state->count_file == file)
+        {
+            count_state->count_file = NULL;
+            changed = TRUE;
+        }
     }
     if (directory->details->deep_count_file == file)
     {
@@ -1729,15 +2550,25 @@ nautilus_async_destroying_file (NautilusFile *file)
         directory->details->mime_list_in_progress->mime_list_file = NULL;
         changed = TRUE;
     }
-    if (directory->details->get_info_file == file)
+    for (node = directory->details->get_info_in_progress; node != NULL; node = node->next)
     {
-        directory->details->get_info_file = NULL;
-        changed = TRUE;
+        GetInfoState *get_info_state = node->data;
+
+        if (get_info_state->file == file)
+        {
+            get_info_state->file = NULL;
+            changed = TRUE;
+        }
     }
-    if (directory->details->extension_info_file == file)
+    for (node = directory->details->extension_info_in_progress; node != NULL; node = node->next)
     {
-        directory->details->extension_info_file = NULL;
-        changed = TRUE;
+        ExtensionInfoState *extension_info_state = node->data;
+
+        if (g_list_find (extension_info_state->files, file) != NULL)
+        {
+            extension_info_state->files = g_list_remove (extension_info_state->files, file);
+            changed = TRUE;
+        }
     }
 
     if (directory->details->thumbnail_state != NULL &&
@@ -1789,6 +2620,14 @@ lacks_info (NautilusFile *file)
            && !file->details->is_gone;
 }
 
+static gboolean
+lacks_extended_info (NautilusFile *file)
+{
+    return file->details->has_partial_info
+           && !file->details->extended_info_failed
+           && !file->details->is_gone;
+}
+
 static gboolean
 lacks_filesystem_info (NautilusFile *file)
 {
@@ -1824,7 +2663,8 @@ static gboolean
 lacks_thumbnail (NautilusFile *file)
 {
     return nautilus_file_should_show_thumbnail (file) &&
-           file->details->thumbnail_path != NULL &&
+           file->details->thumbnail_info != NULL &&
+           file->details->thumbnail_info->path != NULL &&
            !file->details->thumbnail_is_up_to_date;
 }
 
@@ -1898,6 +2738,14 @@ request_is_satisfied (NautilusDirectory *directory,
         }
     }
 
+    if (REQUEST_WANTS_TYPE (request, REQUEST_EXTENDED_INFO))
+    {
+        if (has_problem (directory, file, lacks_extended_info))
+        {
+            return FALSE;
+        }
+    }
+
     if (REQUEST_WANTS_TYPE (request, REQUEST_FILESYSTEM_INFO))
     {
         if (has_problem (directory, file, lacks_filesystem_info))
@@ -2107,14 +2955,8 @@ nautilus_directory_is_file_list_monitored (NautilusDirectory *directory)
 static void
 mark_all_files_unconfirmed (NautilusDirectory *directory)
 {
-    GList *node;
-    NautilusFile *file;
-
-    for (node = directory->details->file_list; node != NULL; node = node->next)
-    {
-        file = node->data;
-        set_file_unconfirmed (file, TRUE);
-    }
+    directory->details->load_generation++;
+    directory->details->confirmed_file_count = 0;
 }
 
 static void
@@ -2139,16 +2981,46 @@ directory_load_state_free (DirectoryLoadState *state)
     g_free (state);
 }
 
+/* Update the file count and MIME list of the directory being loaded.
+ * This is done as the files come in, rather than when they are dequeued,
+ * so that files also reported by new_files_callback() are not counted
+ * twice.
+ */
 static void
-more_files_callback (GObject      *source_object,
-                     GAsyncResult *res,
-                     gpointer      user_data)
+directory_load_count_one (DirectoryLoadState *state,
+                          GFileInfo          *info)
 {
-    DirectoryLoadState *state;
+    const char *mimetype;
+
+    if (g_file_info_get_name (info) == NULL ||
+        should_skip_file (state->directory, info))
+    {
+        return;
+    }
+
+    state->load_file_count += 1;
+
+    /* Add the MIME type to the set. */
+    mimetype = g_file_info_get_content_type (info);
+    if (mimetype != NULL)
+    {
+        istr_set_insert (state->load_mime_list_hash, mimetype);
+    }
+}
+
+static void
+more_files_callback (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+    DirectoryLoadState *state;
     NautilusDirectory *directory;
     GError *error;
     GList *files, *l;
     GFileInfo *info;
+    gint64 start_time;
+    GTimeSpan elapsed;
+    int n_files;
 
     state = user_data;
 
@@ -2164,15 +3036,28 @@ more_files_callback (GObject      *source_object,
     g_assert (directory->details->directory_load_in_progress != NULL);
     g_assert (directory->details->directory_load_in_progress == state);
 
+    start_time = g_get_monotonic_time ();
+
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
                                                  res, &error);
 
+    n_files = 0;
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
+        if (state->probe_thumbnails && g_file_info_get_name (info) != NULL)
+        {
+            g_autoptr (GFile) location = NULL;
+
+            location = g_file_get_child (directory->details->location,
+                                         g_file_info_get_name (info));
+            nautilus_thumbnail_probe_resolve (location, info);
+        }
+        directory_load_count_one (state, info);
         directory_load_one (directory, info);
         g_object_unref (info);
+        n_files++;
     }
 
     if (files == NULL)
@@ -2182,14 +3067,29 @@ more_files_callback (GObject      *source_object,
     }
     else
     {
+        elapsed = g_get_monotonic_time () - start_time;
+        if (elapsed > DIRECTORY_LOAD_CALLBACK_BUDGET)
+        {
+            state->items_per_callback = MAX (state->items_per_callback / 2,
+                                             DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK);
+        }
+        else if (n_files >= state->items_per_callback &&
+                 2 * elapsed <= DIRECTORY_LOAD_CALLBACK_BUDGET)
+        {
+            state->items_per_callback = MIN (state->items_per_callback * 2,
+                                             DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK);
+        }
+
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             more_files_callback,
                                             state);
     }
 
+    nautilus_trace_slow_span ("more files", start_time, "%d files", n_files);
+
     nautilus_directory_unref (directory);
 
     if (error)
@@ -2233,7 +3133,7 @@ enumerate_children_callback (GObject      *source_object,
     {
         state->enumerator = enumerator;
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             more_files_callback,
@@ -2242,11 +3142,144 @@ enumerate_children_callback (GObject      *source_object,
 }
 
 
+static void
+stop_lingering (NautilusDirectory *directory)
+{
+    if (directory->details->file_list_eviction_id == 0)
+    {
+        return;
+    }
+
+    g_clear_handle_id (&directory->details->file_list_eviction_id, g_source_remove);
+    g_queue_remove (&lingering_directories, directory);
+}
+
+static void
+evict_file_list (NautilusDirectory *directory)
+{
+    DEBUG ("Evicting the file list of %p", directory->details->location);
+
+    /* The last files may hold the last reference to the directory */
+    nautilus_directory_ref (directory);
+    nautilus_directory_stop_monitoring_file_list (directory);
+    nautilus_directory_unref (directory);
+}
+
+static gboolean
+file_list_eviction_timeout (gpointer user_data)
+{
+    NautilusDirectory *directory = user_data;
+
+    directory->details->file_list_eviction_id = 0;
+    g_queue_remove (&lingering_directories, directory);
+
+    evict_file_list (directory);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gsize
+get_lingering_size (gpointer user_data)
+{
+    gsize size;
+
+    size = 0;
+    for (GList *l = lingering_directories.head; l != NULL; l = l->next)
+    {
+        NautilusDirectory *directory = l->data;
+
+        size += g_hash_table_size (directory->details->file_hash) * FILE_LIST_FILE_BYTES;
+    }
+
+    return size;
+}
+
+static void
+shed_lingering (NautilusCacheShedLevel level,
+                gpointer               user_data)
+{
+    guint keep;
+
+    keep = lingering_directories.length;
+    switch (level)
+    {
+        case NAUTILUS_CACHE_SHED_SOME:
+        {
+            keep /= 2;
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_MOST:
+        {
+            keep /= 4;
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_ALL:
+        {
+            keep = 0;
+        }
+        break;
+    }
+
+    while (lingering_directories.length > keep)
+    {
+        evict_file_list (g_queue_peek_head (&lingering_directories));
+    }
+}
+
+/* Keeps the loaded files of a directory nobody monitors any more for a
+ * while, so that going back to it shows them right away. Changes are not
+ * seen meanwhile, so they are loaded again then, like from a snapshot:
+ * the live load confirms the files still there and sweeps the rest.
+ */
+static void
+linger_file_list (NautilusDirectory *directory)
+{
+    guint timeout;
+
+    /* Remote listings are worth keeping for as long as they are shown */
+    timeout = MAX (FILE_LIST_EVICTION_TIMEOUT_SECONDS,
+                   get_remote_listing_ttl (directory));
+
+    directory->details->directory_loaded = FALSE;
+    directory->details->file_list_eviction_id =
+        g_timeout_add_seconds (timeout, file_list_eviction_timeout, directory);
+    g_queue_push_tail (&lingering_directories, directory);
+
+    if (lingering_registry_id == 0)
+    {
+        lingering_registry_id = nautilus_cache_registry_add ("unmonitored file lists",
+                                                             NAUTILUS_CACHE_PRIORITY_RECOMPUTABLE,
+                                                             get_lingering_size,
+                                                             shed_lingering, NULL);
+    }
+}
+
+/* The backends which aren't native but only list local files, like the
+ * trash and the recent files, are as quick to query as the native ones. */
+static gboolean
+location_is_local (GFile *location)
+{
+    static const char * const local_schemes[] =
+    {
+        "file", "trash", "recent", "burn", "admin", "computer", NULL
+    };
+    g_autofree char *scheme = NULL;
+
+    scheme = g_file_get_uri_scheme (location);
+
+    return scheme != NULL && g_strv_contains (local_schemes, scheme);
+}
+
 /* Start monitoring the file list if it isn't already. */
 static void
 start_monitoring_file_list (NautilusDirectory *directory)
 {
     DirectoryLoadState *state;
+    const char *attributes;
+
+    stop_lingering (directory);
 
     if (!directory->details->file_list_monitored)
     {
@@ -2266,13 +3299,23 @@ start_monitoring_file_list (NautilusDirectory *directory)
         return;
     }
 
+    load_directory_snapshot (directory);
     mark_all_files_unconfirmed (directory);
 
+    /* Not the cached value, which may not be updated yet when the
+     * preference change reloads this */
+    directory->details->directory_load_skips_hidden =
+        !g_settings_get_boolean (gtk_filechooser_preferences,
+                                 NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES);
+    g_hash_table_remove_all (directory->details->skipped_hidden_names);
+
     state = g_new0 (DirectoryLoadState, 1);
     state->directory = directory;
+    state->begin_time = g_get_monotonic_time ();
     state->cancellable = g_cancellable_new ();
     state->load_mime_list_hash = istr_set_new ();
     state->load_file_count = 0;
+    state->items_per_callback = DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK;
 
     g_assert (directory->details->location != NULL);
     state->load_directory_file =
@@ -2280,12 +3323,38 @@ start_monitoring_file_list (NautilusDirectory *directory)
     state->load_directory_file->details->loading_directory = TRUE;
 
 
-    DEBUG ("load_directory called to monitor file list of %p", directory->details->location);
+    /* On slow locations, show the files before asking for the expensive
+     * attributes, like owners and metadata.
+     */
+    directory->details->directory_load_is_fast =
+        !location_is_local (directory->details->location) ||
+        nautilus_file_is_remote (state->load_directory_file);
+
+    /* Looking the thumbnails up in the listed thumbnail cache saves
+     * hashing and stat()ing thumbnail paths for each file on the way.
+     */
+    if (directory->details->directory_load_is_fast)
+    {
+        attributes = NAUTILUS_FILE_FAST_ATTRIBUTES;
+    }
+    else if (nautilus_thumbnail_probe_is_ready ())
+    {
+        attributes = NAUTILUS_FILE_LOAD_ATTRIBUTES;
+        state->probe_thumbnails = TRUE;
+    }
+    else
+    {
+        attributes = NAUTILUS_FILE_DEFAULT_ATTRIBUTES;
+    }
+
+    DEBUG ("load_directory called to monitor file list of %p%s",
+           directory->details->location,
+           directory->details->directory_load_is_fast ? " (fast)" : "");
 
     directory->details->directory_load_in_progress = state;
 
     g_file_enumerate_children_async (directory->details->location,
-                                     NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+                                     attributes,
                                      0,     /* flags */
                                      G_PRIORITY_DEFAULT,     /* prio */
                                      state->cancellable,
@@ -2303,10 +3372,13 @@ nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
         return;
     }
 
+    stop_lingering (directory);
+
     directory->details->file_list_monitored = FALSE;
     file_list_cancel (directory);
     nautilus_file_list_unref (directory->details->file_list);
     directory->details->directory_loaded = FALSE;
+    g_hash_table_remove_all (directory->details->skipped_hidden_names);
 }
 
 static void
@@ -2316,7 +3388,13 @@ file_list_start_or_stop (NautilusDirectory *directory)
     {
         start_monitoring_file_list (directory);
     }
-    else
+    else if (directory->details->file_list_monitored &&
+             directory->details->directory_loaded &&
+             directory->details->directory_loaded_sent_notification)
+    {
+        linger_file_list (directory);
+    }
+    else if (directory->details->file_list_eviction_id == 0)
     {
         nautilus_directory_stop_monitoring_file_list (directory);
     }
@@ -2397,6 +3475,39 @@ nautilus_directory_force_reload_internal (NautilusDirectory      *directory,
     nautilus_profile_end (NULL);
 }
 
+/* Loads the file list again, updating the files that changed and
+ * reconciling the ones gone, without dropping any attributes. A load
+ * already going on is left to finish, as it does the same.
+ */
+void
+nautilus_directory_rescan_file_list (NautilusDirectory *directory)
+{
+    if (directory->details->directory_load_in_progress != NULL)
+    {
+        return;
+    }
+
+    nautilus_directory_force_reload_internal (directory, 0);
+}
+
+/* Loads the file list again if it was loaded without the hidden files,
+ * which are now to be shown. Only those are new, the others are kept. */
+void
+nautilus_directory_load_hidden_files (NautilusDirectory *directory)
+{
+    if (!directory->details->directory_load_skips_hidden)
+    {
+        return;
+    }
+
+    directory->details->directory_load_skips_hidden = FALSE;
+    g_hash_table_remove_all (directory->details->skipped_hidden_names);
+    if (directory->details->file_list_monitored)
+    {
+        nautilus_directory_force_reload_internal (directory, 0);
+    }
+}
+
 static gboolean
 monitor_includes_file (const Monitor *monitor,
                        NautilusFile  *file)
@@ -2501,33 +3612,44 @@ static void
 directory_count_stop (NautilusDirectory *directory)
 {
     NautilusFile *file;
+    DirectoryCountState *state;
+    GList *node, *next;
 
-    if (directory->details->count_in_progress != NULL)
+    for (node = directory->details->count_in_progress; node != NULL; node = next)
     {
-        file = directory->details->count_in_progress->count_file;
+        next = node->next;
+        state = node->data;
+
+        file = state->count_file;
         if (file != NULL)
         {
             g_assert (NAUTILUS_IS_FILE (file));
             g_assert (file->details->directory == directory);
             if (is_needy (file,
                           should_get_directory_count_now,
-                          REQUEST_DIRECTORY_COUNT))
+                          REQUEST_DIRECTORY_COUNT) ||
+                (state->mime_list_hash != NULL &&
+                 is_needy (file,
+                           should_get_mime_list,
+                           REQUEST_MIME_LIST)))
             {
-                return;
+                continue;
             }
         }
 
         /* The count is not wanted, so stop it. */
-        directory_count_cancel (directory);
+        directory_count_cancel_one (directory, state);
     }
 }
 
 static guint
-count_non_skipped_files (GList *list)
+count_non_skipped_files (GList      *list,
+                         GHashTable *mime_list_hash)
 {
     guint count;
     GList *node;
     GFileInfo *info;
+    const char *mime_type;
 
     count = 0;
     for (node = list; node != NULL; node = node->next)
@@ -2536,17 +3658,26 @@ count_non_skipped_files (GList *list)
         if (!should_skip_file (NULL, info))
         {
             count += 1;
+
+            mime_type = g_file_info_get_content_type (info);
+            if (mime_list_hash != NULL && mime_type != NULL)
+            {
+                istr_set_insert (mime_list_hash, mime_type);
+            }
         }
     }
     return count;
 }
 
 static void
-count_children_done (NautilusDirectory *directory,
-                     NautilusFile      *count_file,
-                     gboolean           succeeded,
-                     int                count)
+count_children_done (NautilusDirectory   *directory,
+                     DirectoryCountState *state,
+                     gboolean             succeeded,
+                     int                  count)
 {
+    NautilusFile *count_file;
+
+    count_file = state->count_file;
     g_assert (NAUTILUS_IS_FILE (count_file));
 
     count_file->details->directory_count_is_up_to_date = TRUE;
@@ -2564,7 +3695,26 @@ count_children_done (NautilusDirectory *directory,
         count_file->details->got_directory_count = TRUE;
         count_file->details->directory_count = count;
     }
-    directory->details->count_in_progress = NULL;
+
+    /* Same as mime_list_done (). */
+    if (state->mime_list_hash != NULL)
+    {
+        count_file->details->mime_list_is_up_to_date = TRUE;
+        g_list_free_full (count_file->details->mime_list, g_free);
+        if (!succeeded)
+        {
+            count_file->details->mime_list_failed = TRUE;
+            count_file->details->mime_list = NULL;
+        }
+        else
+        {
+            count_file->details->got_mime_list = TRUE;
+            count_file->details->mime_list = istr_set_get_as_list (state->mime_list_hash);
+        }
+    }
+
+    directory->details->count_in_progress =
+        g_list_remove (directory->details->count_in_progress, state);
 
     /* Send file-changed even if count failed, so interested parties can
      * distinguish between unknowable and not-yet-known cases.
@@ -2589,6 +3739,10 @@ directory_count_state_free (DirectoryCountState *state)
         g_object_unref (state->enumerator);
     }
     g_object_unref (state->cancellable);
+    if (state->mime_list_hash != NULL)
+    {
+        istr_set_destroy (state->mime_list_hash);
+    }
     nautilus_directory_unref (state->directory);
     g_free (state);
 }
@@ -2618,18 +3772,17 @@ count_more_files_callback (GObject      *source_object,
         return;
     }
 
-    g_assert (directory->details->count_in_progress != NULL);
-    g_assert (directory->details->count_in_progress == state);
+    g_assert (g_list_find (directory->details->count_in_progress, state) != NULL);
 
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
                                                  res, &error);
 
-    state->file_count += count_non_skipped_files (files);
+    state->file_count += count_non_skipped_files (files, state->mime_list_hash);
 
     if (files == NULL)
     {
-        count_children_done (directory, state->count_file,
+        count_children_done (directory, state,
                              TRUE, state->file_count);
         directory_count_state_free (state);
     }
@@ -2683,7 +3836,7 @@ count_children_callback (GObject      *source_object,
     if (enumerator == NULL)
     {
         count_children_done (state->directory,
-                             state->count_file,
+                             state,
                              FALSE, 0);
         g_error_free (error);
         directory_count_state_free (state);
@@ -2702,16 +3855,106 @@ count_children_callback (GObject      *source_object,
 }
 
 static void
-directory_count_start (NautilusDirectory *directory,
-                       NautilusFile      *file,
-                       gboolean          *doing_io)
+directory_count_load (NautilusDirectory *directory,
+                      NautilusFile      *file)
 {
     DirectoryCountState *state;
     GFile *location;
 
-    if (directory->details->count_in_progress != NULL)
+    /* Start counting. */
+    state = g_new0 (DirectoryCountState, 1);
+    state->count_file = file;
+    state->directory = nautilus_directory_ref (directory);
+    state->cancellable = g_cancellable_new ();
+
+    /* The MIME list needs the same enumeration, so get it on the way
+     * if it's wanted too, rather than listing the directory twice.
+     */
+    if (is_needy (file, should_get_mime_list, REQUEST_MIME_LIST) &&
+        (directory->details->mime_list_in_progress == NULL ||
+         directory->details->mime_list_in_progress->mime_list_file != file))
+    {
+        state->mime_list_hash = istr_set_new ();
+    }
+
+    directory->details->count_in_progress =
+        g_list_prepend (directory->details->count_in_progress, state);
+
+    location = nautilus_file_get_location (file);
+
+    {
+        g_autofree char *uri = NULL;
+        uri = g_file_get_uri (location);
+        DEBUG ("load_directory called to get shallow file count for %s", uri);
+    }
+
+    g_file_enumerate_children_async (location,
+                                     state->mime_list_hash != NULL ?
+                                     G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                     G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                                     G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
+                                     G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE :
+                                     G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                     G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                                     G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP,
+                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,     /* flags */
+                                     G_PRIORITY_DEFAULT,     /* prio */
+                                     state->cancellable,
+                                     count_children_callback,
+                                     state);
+    g_object_unref (location);
+}
+
+/* Fill the free count slots with files that are queued behind @file,
+ * so that the counts of the following rows are already in flight by the
+ * time they reach the head of the low priority queue.
+ */
+static void
+directory_count_prefetch (NautilusDirectory *directory,
+                          NautilusFile      *file)
+{
+    NautilusFile *next;
+    guint lookahead;
+
+    lookahead = 0;
+    for (next = nautilus_file_queue_next (directory->details->low_priority_queue, file);
+         next != NULL && lookahead < DIRECTORY_COUNT_LOOKAHEAD;
+         next = nautilus_file_queue_next (directory->details->low_priority_queue, next))
+    {
+        if (g_list_length (directory->details->count_in_progress) >= MAX_DIRECTORY_COUNTS_IN_FLIGHT)
+        {
+            return;
+        }
+
+        lookahead++;
+
+        if (!nautilus_file_is_directory (next) ||
+            find_directory_count_for_file (directory, next) != NULL ||
+            !is_needy (next,
+                       should_get_directory_count_now,
+                       REQUEST_DIRECTORY_COUNT))
+        {
+            continue;
+        }
+
+        if (!async_job_start (directory, "directory count"))
+        {
+            return;
+        }
+
+        directory_count_load (directory, next);
+    }
+}
+
+static void
+directory_count_start (NautilusDirectory *directory,
+                       NautilusFile      *file,
+                       gboolean          *doing_io)
+{
+    if (find_directory_count_for_file (directory, file) != NULL)
     {
         *doing_io = TRUE;
+        directory_count_prefetch (directory, file);
         return;
     }
 
@@ -2729,127 +3972,646 @@ directory_count_start (NautilusDirectory *directory,
         file->details->directory_count_failed = FALSE;
         file->details->got_directory_count = FALSE;
 
-        nautilus_directory_async_state_changed (directory);
-        return;
+        nautilus_directory_async_state_changed (directory);
+        return;
+    }
+
+    if (g_list_length (directory->details->count_in_progress) >= MAX_DIRECTORY_COUNTS_IN_FLIGHT)
+    {
+        /* Wait for one of the prefetched counts to finish. */
+        return;
+    }
+
+    if (!async_job_start (directory, "directory count"))
+    {
+        return;
+    }
+
+    directory_count_load (directory, file);
+    directory_count_prefetch (directory, file);
+}
+
+typedef struct
+{
+    guint32 device;
+    guint64 inode;
+} DeepCountInode;
+
+static guint
+deep_count_inode_hash (gconstpointer key)
+{
+    const DeepCountInode *inode = key;
+
+    return g_int64_hash (&inode->inode) ^ inode->device;
+}
+
+static gboolean
+deep_count_inode_equal (gconstpointer a,
+                        gconstpointer b)
+{
+    const DeepCountInode *inode_a = a;
+    const DeepCountInode *inode_b = b;
+
+    return inode_a->inode == inode_b->inode &&
+           inode_a->device == inode_b->device;
+}
+
+/* Only files with more than one link can be seen twice. @n_links is 0
+ * when it is unknown.
+ */
+static gboolean
+may_have_other_links (GFileType type,
+                      guint64   inode,
+                      guint32   n_links)
+{
+    if (type == G_FILE_TYPE_DIRECTORY)
+    {
+        return FALSE;
+    }
+
+    if (inode == 0)
+    {
+        return FALSE;
+    }
+
+    /* Backends which don't know the link count could still have links. */
+    if (n_links == 1)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+info_may_have_other_links (GFileInfo *info)
+{
+    return may_have_other_links (g_file_info_get_file_type (info),
+                                 g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE),
+                                 g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK));
+}
+
+/* Returns TRUE if the file is another link to an inode that was already
+ * counted. Only files that may have other links should be looked up, as
+ * they are all remembered.
+ */
+static gboolean
+seen_inode (GHashTable *seen_inodes,
+            guint64     inode_number,
+            guint32     device)
+{
+    DeepCountInode key;
+    DeepCountInode *inode;
+
+    key.inode = inode_number;
+    key.device = device;
+    if (g_hash_table_contains (seen_inodes, &key))
+    {
+        return TRUE;
+    }
+
+    inode = g_new (DeepCountInode, 1);
+    *inode = key;
+    g_hash_table_add (seen_inodes, inode);
+
+    return FALSE;
+}
+
+static void
+deep_count_one (DeepCountState *state,
+                GFileInfo      *info)
+{
+    NautilusFile *file;
+    GFile *subdir;
+    gboolean is_seen_inode;
+    const char *fs_id;
+
+    if (should_skip_file (NULL, info))
+    {
+        return;
+    }
+
+    is_seen_inode = info_may_have_other_links (info) &&
+                    seen_inode (state->seen_deep_count_inodes,
+                                g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE),
+                                g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE));
+
+    file = state->directory->details->deep_count_file;
+
+    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+    {
+        /* Count the directory. */
+        file->details->deep_counts->directory_count += 1;
+
+        /* Record the fact that we have to descend into this directory. */
+        fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+        if (g_strcmp0 (fs_id, state->fs_id) == 0 &&
+            !nautilus_prune_patterns_match ((const char * const *) state->prune_patterns,
+                                            g_file_info_get_name (info)))
+        {
+            /* only if it is on the same filesystem */
+            subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
+            state->deep_count_subdirectories = g_list_prepend
+                                                   (state->deep_count_subdirectories, subdir);
+        }
+    }
+    else
+    {
+        /* Even non-regular files count as files. */
+        file->details->deep_counts->file_count += 1;
+    }
+
+    /* Count the size. */
+    if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+    {
+        file->details->deep_counts->size += g_file_info_get_size (info);
+    }
+}
+
+static void
+deep_count_job_unref (DeepCountJob *job)
+{
+    if (!g_atomic_ref_count_dec (&job->ref_count))
+    {
+        return;
+    }
+
+    g_object_unref (job->cancellable);
+    g_object_unref (job->location);
+    g_free (job->fs_id);
+    g_strfreev (job->prune_patterns);
+    g_mutex_clear (&job->mutex);
+    g_cond_clear (&job->cond);
+    g_queue_clear_full (&job->directories, g_object_unref);
+    g_hash_table_destroy (job->seen_inodes);
+    g_free (job);
+}
+
+static void
+deep_count_cache_remove (GFile *location)
+{
+    DeepCountJob *job;
+
+    if (deep_count_cache == NULL)
+    {
+        return;
+    }
+
+    job = g_hash_table_lookup (deep_count_cache, location);
+    if (job != NULL)
+    {
+        g_queue_remove (&deep_count_cache_order, job->location);
+        g_hash_table_remove (deep_count_cache, location);
+    }
+}
+
+static void
+deep_count_cache_add (DeepCountJob *job)
+{
+    if (job->mtime == 0)
+    {
+        /* Nothing to tell whether it is still valid later */
+        return;
+    }
+
+    if (deep_count_cache == NULL)
+    {
+        deep_count_cache = g_hash_table_new_full (g_file_hash,
+                                                  (GEqualFunc) g_file_equal,
+                                                  NULL,
+                                                  (GDestroyNotify) deep_count_job_unref);
+        nautilus_cache_registry_add ("deep counts",
+                                     NAUTILUS_CACHE_PRIORITY_RECOMPUTABLE,
+                                     get_deep_count_cache_size,
+                                     shed_deep_count_cache, NULL);
+    }
+
+    g_atomic_ref_count_inc (&job->ref_count);
+    deep_count_cache_remove (job->location);
+    g_hash_table_insert (deep_count_cache, job->location, job);
+    g_queue_push_tail (&deep_count_cache_order, job->location);
+
+    while (g_queue_get_length (&deep_count_cache_order) > DEEP_COUNT_CACHE_MAX_ENTRIES)
+    {
+        g_hash_table_remove (deep_count_cache,
+                             g_queue_pop_head (&deep_count_cache_order));
+    }
+}
+
+/* Estimated, partial counts hold on to the directories left to count */
+static gsize
+get_deep_count_cache_size (gpointer user_data)
+{
+    gsize size;
+
+    if (deep_count_cache == NULL)
+    {
+        return 0;
+    }
+
+    size = 0;
+    for (GList *l = deep_count_cache_order.head; l != NULL; l = l->next)
+    {
+        DeepCountJob *job = g_hash_table_lookup (deep_count_cache, l->data);
+
+        g_mutex_lock (&job->mutex);
+        size += sizeof (DeepCountJob) +
+                g_queue_get_length (&job->directories) * DEEP_COUNT_CACHE_DIRECTORY_BYTES +
+                g_hash_table_size (job->seen_inodes) * sizeof (DeepCountInode);
+        g_mutex_unlock (&job->mutex);
+    }
+
+    return size;
+}
+
+static void
+shed_deep_count_cache (NautilusCacheShedLevel level,
+                       gpointer               user_data)
+{
+    guint keep;
+
+    keep = g_queue_get_length (&deep_count_cache_order);
+    switch (level)
+    {
+        case NAUTILUS_CACHE_SHED_SOME:
+        {
+            keep /= 2;
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_MOST:
+        {
+            keep /= 4;
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_ALL:
+        {
+            keep = 0;
+        }
+        break;
+    }
+
+    while (g_queue_get_length (&deep_count_cache_order) > keep)
+    {
+        g_hash_table_remove (deep_count_cache,
+                             g_queue_pop_head (&deep_count_cache_order));
+    }
+}
+
+static gboolean
+prune_patterns_equal (GStrv a,
+                      GStrv b)
+{
+    if (a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+
+    return g_strv_equal ((const gchar * const *) a, (const gchar * const *) b);
+}
+
+/* Takes the count of @location out of the cache, if it still applies to
+ * the directory as it is now and to the current preferences.
+ */
+static DeepCountJob *
+deep_count_cache_take (GFile   *location,
+                       guint64  mtime)
+{
+    DeepCountJob *job;
+    g_auto (GStrv) prune_patterns = NULL;
+
+    if (deep_count_cache == NULL)
+    {
+        return NULL;
+    }
+
+    job = g_hash_table_lookup (deep_count_cache, location);
+    if (job == NULL)
+    {
+        return NULL;
+    }
+
+    g_queue_remove (&deep_count_cache_order, job->location);
+    g_hash_table_steal (deep_count_cache, location);
+
+    prune_patterns = nautilus_get_prune_patterns ();
+    if (mtime == 0 || job->mtime != mtime ||
+        job->show_hidden_files != get_show_hidden_files () ||
+        !prune_patterns_equal (job->prune_patterns, prune_patterns))
+    {
+        deep_count_job_unref (job);
+        return NULL;
+    }
+
+    return job;
+}
+
+/* Runs in a counting thread. Returns FALSE if the count was cancelled
+ * before it was done with @location, so that nothing of it was added.
+ */
+static gboolean
+deep_count_job_count_directory (DeepCountJob *job,
+                                GFile        *location,
+                                GQueue       *subdirectories)
+{
+    g_autoptr (NautilusDirectoryReader) reader = NULL;
+    const NautilusDirectoryEntry *entry;
+    guint directory_count, file_count;
+    goffset size;
+    gboolean is_seen_inode;
+
+    reader = nautilus_directory_reader_new (location, DEEP_COUNT_FIELDS,
+                                            job->cancellable, NULL);
+    if (reader == NULL)
+    {
+        if (g_cancellable_is_cancelled (job->cancellable))
+        {
+            return FALSE;
+        }
+
+        g_mutex_lock (&job->mutex);
+        job->unreadable_count += 1;
+        g_mutex_unlock (&job->mutex);
+        return TRUE;
+    }
+
+    directory_count = 0;
+    file_count = 0;
+    size = 0;
+
+    while ((entry = nautilus_directory_reader_next (reader, NULL)) != NULL)
+    {
+        if (!job->show_hidden_files &&
+            (entry->is_hidden || entry->is_backup))
+        {
+            continue;
+        }
+
+        is_seen_inode = FALSE;
+        if (may_have_other_links (entry->type, entry->inode, entry->n_links))
+        {
+            g_mutex_lock (&job->mutex);
+            is_seen_inode = seen_inode (job->seen_inodes, entry->inode, entry->device);
+            g_mutex_unlock (&job->mutex);
+        }
+
+        if (entry->type == G_FILE_TYPE_DIRECTORY)
+        {
+            directory_count += 1;
+
+            /* Only descend into directories on the same filesystem. */
+            if (g_strcmp0 (entry->filesystem_id, job->fs_id) == 0 &&
+                !nautilus_prune_patterns_match ((const char * const *) job->prune_patterns,
+                                                entry->name))
+            {
+                g_queue_push_tail (subdirectories,
+                                   g_file_get_child (location, entry->name));
+            }
+        }
+        else
+        {
+            /* Even non-regular files count as files. */
+            file_count += 1;
+        }
+
+        if (!is_seen_inode)
+        {
+            size += entry->size;
+        }
+    }
+
+    if (g_cancellable_is_cancelled (job->cancellable))
+    {
+        /* Counted again from scratch when the job is resumed. The
+         * hardlinks seen so far stay seen, which is close enough. */
+        g_queue_clear_full (subdirectories, g_object_unref);
+        return FALSE;
+    }
+
+    g_mutex_lock (&job->mutex);
+    job->directory_count += directory_count;
+    job->file_count += file_count;
+    job->size += size;
+    g_mutex_unlock (&job->mutex);
+
+    return TRUE;
+}
+
+static void     deep_count_state_free (DeepCountState *state);
+static gboolean deep_count_job_finished (gpointer user_data);
+
+/* Each thread takes a directory from the shared queue, counts it, and
+ * queues its subdirectories for whichever thread is free next. The
+ * last thread to run out of work tells the main thread.
+ */
+static gpointer
+deep_count_job_thread (gpointer user_data)
+{
+    DeepCountState *state;
+    DeepCountJob *job;
+    GFile *location;
+    GQueue subdirectories = G_QUEUE_INIT;
+    gboolean counted;
+    gboolean last;
+
+    state = user_data;
+    job = state->job;
+
+    g_mutex_lock (&job->mutex);
+    while (TRUE)
+    {
+        while (g_queue_is_empty (&job->directories) &&
+               job->busy_threads > 0 &&
+               !g_cancellable_is_cancelled (job->cancellable))
+        {
+            g_cond_wait (&job->cond, &job->mutex);
+        }
+
+        if (g_queue_is_empty (&job->directories) ||
+            g_cancellable_is_cancelled (job->cancellable))
+        {
+            break;
+        }
+
+        location = g_queue_pop_head (&job->directories);
+        job->busy_threads++;
+        g_mutex_unlock (&job->mutex);
+
+        counted = deep_count_job_count_directory (job, location, &subdirectories);
+
+        g_mutex_lock (&job->mutex);
+        job->busy_threads--;
+        if (counted)
+        {
+            g_object_unref (location);
+        }
+        else
+        {
+            g_queue_push_head (&job->directories, location);
+        }
+        while (!g_queue_is_empty (&subdirectories))
+        {
+            g_queue_push_tail (&job->directories, g_queue_pop_head (&subdirectories));
+        }
+        g_cond_broadcast (&job->cond);
     }
 
-    if (!async_job_start (directory, "directory count"))
+    job->running_threads--;
+    last = job->running_threads == 0;
+    g_cond_broadcast (&job->cond);
+    g_mutex_unlock (&job->mutex);
+
+    if (last)
     {
-        return;
+        /* The state is only freed from here on, in the main thread. */
+        g_idle_add (deep_count_job_finished, state);
     }
 
-    /* Start counting. */
-    state = g_new0 (DirectoryCountState, 1);
-    state->count_file = file;
-    state->directory = nautilus_directory_ref (directory);
-    state->cancellable = g_cancellable_new ();
+    deep_count_job_unref (job);
 
-    directory->details->count_in_progress = state;
+    return NULL;
+}
 
-    location = nautilus_file_get_location (file);
+static void
+deep_count_job_publish (DeepCountState *state)
+{
+    NautilusFile *file;
+    DeepCountJob *job;
 
-    {
-        g_autofree char *uri = NULL;
-        uri = g_file_get_uri (location);
-        DEBUG ("load_directory called to get shallow file count for %s", uri);
-    }
+    file = state->directory->details->deep_count_file;
+    job = state->job;
 
-    g_file_enumerate_children_async (location,
-                                     G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                     G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-                                     G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP,
-                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,     /* flags */
-                                     G_PRIORITY_DEFAULT,     /* prio */
-                                     state->cancellable,
-                                     count_children_callback,
-                                     state);
-    g_object_unref (location);
+    g_mutex_lock (&job->mutex);
+    file->details->deep_counts->directory_count = job->directory_count;
+    file->details->deep_counts->file_count = job->file_count;
+    file->details->deep_counts->unreadable_count = job->unreadable_count;
+    file->details->deep_counts->size = job->size;
+    g_mutex_unlock (&job->mutex);
 }
 
-static inline gboolean
-seen_inode (DeepCountState *state,
-            GFileInfo      *info)
+static gboolean
+deep_count_job_progress_callback (gpointer user_data)
 {
-    guint64 inode, inode2;
-    guint i;
+    DeepCountState *state;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    state = user_data;
 
-    if (inode != 0)
-    {
-        for (i = 0; i < state->seen_deep_count_inodes->len; i++)
-        {
-            inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-            if (inode == inode2)
-            {
-                return TRUE;
-            }
-        }
-    }
+    deep_count_job_publish (state);
+    nautilus_file_updated_deep_count_in_progress (state->directory->details->deep_count_file);
 
-    return FALSE;
+    return G_SOURCE_CONTINUE;
 }
 
-static inline void
-mark_inode_as_seen (DeepCountState *state,
-                    GFileInfo      *info)
+static gboolean
+deep_count_job_finished (gpointer user_data)
 {
-    guint64 inode;
+    DeepCountState *state;
+    NautilusDirectory *directory;
+    NautilusFile *file;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-    if (inode != 0)
+    state = user_data;
+
+    if (state->directory == NULL)
     {
-        g_array_append_val (state->seen_deep_count_inodes, inode);
+        /* Operation was cancelled. Keep what was counted to resume from. */
+        deep_count_cache_add (state->job);
+        deep_count_state_free (state);
+        return G_SOURCE_REMOVE;
     }
+
+    directory = state->directory;
+    file = directory->details->deep_count_file;
+
+    g_clear_handle_id (&state->progress_timeout_id, g_source_remove);
+    deep_count_job_publish (state);
+
+    /* Only needed to resume from */
+    g_hash_table_remove_all (state->job->seen_inodes);
+    deep_count_cache_add (state->job);
+
+    file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
+    directory->details->deep_count_file = NULL;
+    directory->details->deep_count_in_progress = NULL;
+    deep_count_state_free (state);
+
+    nautilus_file_updated_deep_count_in_progress (file);
+    nautilus_file_changed (file);
+    async_job_end (directory, "deep count");
+    nautilus_directory_async_state_changed (directory);
+
+    return G_SOURCE_REMOVE;
 }
 
 static void
-deep_count_one (DeepCountState *state,
-                GFileInfo      *info)
+deep_count_job_start (DeepCountState *state,
+                      GFile          *location,
+                      guint64         mtime)
 {
-    NautilusFile *file;
-    GFile *subdir;
-    gboolean is_seen_inode;
-    const char *fs_id;
+    DeepCountJob *job;
+    gboolean resumed;
+    guint n_threads, i;
 
-    if (should_skip_file (NULL, info))
+    job = deep_count_cache_take (location, mtime);
+    resumed = job != NULL;
+
+    if (resumed && g_queue_is_empty (&job->directories))
     {
+        DEBUG ("Reusing the count of %p", location);
+
+        state->job = job;
+        deep_count_job_finished (state);
         return;
     }
 
-    is_seen_inode = seen_inode (state, info);
-    if (!is_seen_inode)
+    if (resumed)
     {
-        mark_inode_as_seen (state, info);
+        /* Not running, so nothing else looks at the cancellable */
+        g_object_unref (job->cancellable);
+        job->cancellable = g_object_ref (state->cancellable);
     }
+    else
+    {
+        job = g_new0 (DeepCountJob, 1);
+        g_atomic_ref_count_init (&job->ref_count);
+        job->cancellable = g_object_ref (state->cancellable);
+        job->location = g_object_ref (location);
+        job->mtime = mtime;
+        job->fs_id = g_strdup (state->fs_id);
+        job->show_hidden_files = get_show_hidden_files ();
+        job->prune_patterns = g_strdupv (state->prune_patterns);
+        g_mutex_init (&job->mutex);
+        g_cond_init (&job->cond);
+        g_queue_init (&job->directories);
+        job->seen_inodes = g_hash_table_new_full (deep_count_inode_hash,
+                                                  deep_count_inode_equal,
+                                                  g_free, NULL);
+        g_queue_push_tail (&job->directories, g_object_ref (location));
+    }
+    state->job = job;
 
-    file = state->directory->details->deep_count_file;
+    n_threads = CLAMP (g_get_num_processors (), 1, DEEP_COUNT_MAX_THREADS);
+    job->running_threads = n_threads;
 
-    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
-    {
-        /* Count the directory. */
-        file->details->deep_directory_count += 1;
+    DEBUG ("%s %p with %u threads", resumed ? "Resuming count of" : "Counting",
+           location, n_threads);
 
-        /* Record the fact that we have to descend into this directory. */
-        fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
-        if (g_strcmp0 (fs_id, state->fs_id) == 0)
-        {
-            /* only if it is on the same filesystem */
-            subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
-            state->deep_count_subdirectories = g_list_prepend
-                                                   (state->deep_count_subdirectories, subdir);
-        }
-    }
-    else
+    if (resumed)
     {
-        /* Even non-regular files count as files. */
-        file->details->deep_file_count += 1;
+        deep_count_job_publish (state);
+        nautilus_file_updated_deep_count_in_progress (state->directory->details->deep_count_file);
     }
 
-    /* Count the size. */
-    if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+    state->progress_timeout_id = g_timeout_add (DEEP_COUNT_PROGRESS_INTERVAL_MSEC,
+                                                deep_count_job_progress_callback,
+                                                state);
+
+    for (i = 0; i < n_threads; i++)
     {
-        file->details->deep_size += g_file_info_get_size (info);
+        g_atomic_ref_count_inc (&job->ref_count);
+        g_thread_unref (g_thread_new ("nautilus-deep-count",
+                                      deep_count_job_thread,
+                                      state));
     }
 }
 
@@ -2871,8 +4633,13 @@ deep_count_state_free (DeepCountState *state)
         g_object_unref (state->deep_count_location);
     }
     g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-    g_array_free (state->seen_deep_count_inodes, TRUE);
+    g_hash_table_destroy (state->seen_deep_count_inodes);
     g_free (state->fs_id);
+    g_strfreev (state->prune_patterns);
+    if (state->job != NULL)
+    {
+        deep_count_job_unref (state->job);
+    }
     g_free (state);
 }
 
@@ -3001,7 +4768,7 @@ deep_count_callback (GObject      *source_object,
 
     if (enumerator == NULL)
     {
-        file->details->deep_unreadable_count += 1;
+        file->details->deep_counts->unreadable_count += 1;
 
         deep_count_next_dir (state);
     }
@@ -3026,13 +4793,7 @@ deep_count_load (DeepCountState *state,
 
     DEBUG ("load_directory called to get deep file count for %p", location);
     g_file_enumerate_children_async (state->deep_count_location,
-                                     G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                     G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                     G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-                                     G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-                                     G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
-                                     G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-                                     G_FILE_ATTRIBUTE_UNIX_INODE,
+                                     DEEP_COUNT_ATTRIBUTES,
                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,     /* flags */
                                      G_PRIORITY_LOW,     /* prio */
                                      state->cancellable,
@@ -3072,17 +4833,28 @@ deep_count_got_info (GObject      *source_object,
 {
     GFileInfo *info;
     const char *id;
+    guint64 mtime;
     GFile *file = (GFile *) source_object;
     DeepCountState *state = (DeepCountState *) user_data;
 
+    mtime = 0;
     info = g_file_query_info_finish (file, res, NULL);
     if (info != NULL)
     {
         id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
         state->fs_id = g_strdup (id);
+        mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
         g_object_unref (info);
     }
-    deep_count_load (state, file);
+
+    if (state->directory != NULL && g_file_is_native (file))
+    {
+        deep_count_job_start (state, file, mtime);
+    }
+    else
+    {
+        deep_count_load (state, file);
+    }
 }
 
 static void
@@ -3092,6 +4864,7 @@ deep_count_start (NautilusDirectory *directory,
 {
     GFile *location;
     DeepCountState *state;
+    NautilusFileDeepCounts *deep_counts;
 
     if (directory->details->deep_count_in_progress != NULL)
     {
@@ -3122,23 +4895,28 @@ deep_count_start (NautilusDirectory *directory,
 
     /* Start counting. */
     file->details->deep_counts_status = NAUTILUS_REQUEST_IN_PROGRESS;
-    file->details->deep_directory_count = 0;
-    file->details->deep_file_count = 0;
-    file->details->deep_unreadable_count = 0;
-    file->details->deep_size = 0;
+    deep_counts = nautilus_file_ensure_deep_counts (file);
+    deep_counts->directory_count = 0;
+    deep_counts->file_count = 0;
+    deep_counts->unreadable_count = 0;
+    deep_counts->size = 0;
     directory->details->deep_count_file = file;
 
     state = g_new0 (DeepCountState, 1);
     state->directory = directory;
     state->cancellable = g_cancellable_new ();
-    state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+    state->seen_deep_count_inodes = g_hash_table_new_full (deep_count_inode_hash,
+                                                           deep_count_inode_equal,
+                                                           g_free, NULL);
     state->fs_id = NULL;
+    state->prune_patterns = nautilus_get_prune_patterns ();
 
     directory->details->deep_count_in_progress = state;
 
     location = nautilus_file_get_location (file);
     g_file_query_info_async (location,
-                             G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                             G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED,
                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                              G_PRIORITY_DEFAULT,
                              NULL,
@@ -3366,6 +5144,7 @@ mime_list_start (NautilusDirectory *directory,
                  gboolean          *doing_io)
 {
     MimeListState *state;
+    DirectoryCountState *count_state;
     GFile *location;
 
     mime_list_stop (directory);
@@ -3385,6 +5164,13 @@ mime_list_start (NautilusDirectory *directory,
     }
     *doing_io = TRUE;
 
+    /* Already on its way with the item count. */
+    count_state = find_directory_count_for_file (directory, file);
+    if (count_state != NULL && count_state->mime_list_hash != NULL)
+    {
+        return;
+    }
+
     if (!nautilus_file_is_directory (file))
     {
         g_list_free (file->details->mime_list);
@@ -3435,6 +5221,28 @@ get_info_state_free (GetInfoState *state)
     g_free (state);
 }
 
+/* Send the changed signals for the files whose info came back, all at
+ * once, so that a refresh of many files doesn't turn into as many view
+ * updates.
+ */
+static void
+flush_changed_file_infos (NautilusDirectory *directory)
+{
+    GList *changed_files;
+
+    if (directory->details->get_info_changed_files == NULL)
+    {
+        return;
+    }
+
+    changed_files = g_list_reverse (directory->details->get_info_changed_files);
+    directory->details->get_info_changed_files = NULL;
+    directory->details->get_info_changed_count = 0;
+
+    nautilus_directory_emit_change_signals (directory, changed_files);
+    nautilus_file_list_free (changed_files);
+}
+
 static void
 query_info_callback (GObject      *source_object,
                      GAsyncResult *res,
@@ -3457,11 +5265,11 @@ query_info_callback (GObject      *source_object,
 
     directory = nautilus_directory_ref (state->directory);
 
-    get_info_file = directory->details->get_info_file;
+    get_info_file = state->file;
     g_assert (NAUTILUS_IS_FILE (get_info_file));
 
-    directory->details->get_info_file = NULL;
-    directory->details->get_info_in_progress = NULL;
+    directory->details->get_info_in_progress =
+        g_list_remove (directory->details->get_info_in_progress, state);
 
     /* ref here because we might be removing the last ref when we
      * mark the file gone below, but we need to keep a ref at
@@ -3488,10 +5296,31 @@ query_info_callback (GObject      *source_object,
     {
         nautilus_file_update_info (get_info_file, info);
         g_object_unref (info);
+        get_info_file->details->has_partial_info = FALSE;
+    }
+    /* Still partial after a failure, to be completed once it is asked
+     * for again rather than right away */
+    get_info_file->details->extended_info_failed = get_info_file->details->has_partial_info;
+
+    if (nautilus_file_is_self_owned (get_info_file))
+    {
+        nautilus_file_changed (get_info_file);
+        nautilus_file_unref (get_info_file);
+    }
+    else
+    {
+        /* The batch owns the ref now. */
+        directory->details->get_info_changed_files =
+            g_list_prepend (directory->details->get_info_changed_files, get_info_file);
+        directory->details->get_info_changed_count++;
     }
 
-    nautilus_file_changed (get_info_file);
-    nautilus_file_unref (get_info_file);
+    /* Send what we have once the batch is done, or too big to wait for. */
+    if (directory->details->get_info_in_progress == NULL ||
+        directory->details->get_info_changed_count >= FILE_INFO_CHANGES_PER_BATCH)
+    {
+        flush_changed_file_infos (directory);
+    }
 
     async_job_end (directory, "file info");
     nautilus_directory_async_state_changed (directory);
@@ -3504,39 +5333,119 @@ query_info_callback (GObject      *source_object,
 static void
 file_info_stop (NautilusDirectory *directory)
 {
-    NautilusFile *file;
+    GList *node, *next;
+    GetInfoState *state;
 
-    if (directory->details->get_info_in_progress != NULL)
+    for (node = directory->details->get_info_in_progress; node != NULL; node = next)
     {
-        file = directory->details->get_info_file;
-        if (file != NULL)
+        next = node->next;
+        state = node->data;
+
+        if (state->file != NULL)
         {
-            g_assert (NAUTILUS_IS_FILE (file));
-            g_assert (file->details->directory == directory);
-            if (is_needy (file, lacks_info, REQUEST_FILE_INFO))
+            g_assert (NAUTILUS_IS_FILE (state->file));
+            g_assert (state->file->details->directory == directory);
+            if (is_needy (state->file, lacks_info, REQUEST_FILE_INFO) ||
+                is_needy (state->file, lacks_extended_info, REQUEST_EXTENDED_INFO))
             {
-                return;
+                continue;
             }
         }
 
         /* The info is not wanted, so stop it. */
-        file_info_cancel (directory);
+        file_info_cancel_one (directory, state);
+    }
+
+    if (directory->details->get_info_in_progress == NULL)
+    {
+        flush_changed_file_infos (directory);
     }
 }
 
 static void
-file_info_start (NautilusDirectory *directory,
-                 NautilusFile      *file,
-                 gboolean          *doing_io)
+file_info_load (NautilusDirectory *directory,
+                NautilusFile      *file)
 {
     GFile *location;
     GetInfoState *state;
 
+    file->details->get_info_failed = FALSE;
+    if (file->details->get_info_error)
+    {
+        g_error_free (file->details->get_info_error);
+        file->details->get_info_error = NULL;
+    }
+
+    state = g_new (GetInfoState, 1);
+    state->directory = directory;
+    state->file = file;
+    state->cancellable = g_cancellable_new ();
+
+    directory->details->get_info_in_progress =
+        g_list_prepend (directory->details->get_info_in_progress, state);
+
+    location = nautilus_file_get_location (file);
+    g_file_query_info_async (location,
+                             NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+                             0,
+                             G_PRIORITY_DEFAULT,
+                             state->cancellable, query_info_callback, state);
+    g_object_unref (location);
+}
+
+/* While the head of the queue is being queried, query the needy files
+ * behind it too, so that a burst of invalidated files in one directory
+ * isn't refreshed one round trip at a time.
+ */
+static void
+file_info_prefetch (NautilusDirectory *directory,
+                    NautilusFileQueue *queue,
+                    NautilusFile      *file,
+                    FileCheck          lacks_check,
+                    RequestType        request_type)
+{
+    NautilusFile *next;
+    guint lookahead;
+
+    lookahead = 0;
+    for (next = nautilus_file_queue_next (queue, file);
+         next != NULL && lookahead < FILE_INFO_LOOKAHEAD;
+         next = nautilus_file_queue_next (queue, next))
+    {
+        if (g_list_length (directory->details->get_info_in_progress) >= MAX_FILE_INFOS_IN_FLIGHT)
+        {
+            return;
+        }
+
+        lookahead++;
+
+        if (find_file_info_for_file (directory, next) != NULL ||
+            !is_needy (next, lacks_check, request_type))
+        {
+            continue;
+        }
+
+        if (!async_job_start (directory, "file info"))
+        {
+            return;
+        }
+
+        file_info_load (directory, next);
+    }
+}
+
+static void
+file_info_start (NautilusDirectory *directory,
+                 NautilusFile      *file,
+                 gboolean          *doing_io)
+{
     file_info_stop (directory);
 
-    if (directory->details->get_info_in_progress != NULL)
+    if (find_file_info_for_file (directory, file) != NULL)
     {
         *doing_io = TRUE;
+        file_info_prefetch (directory, directory->details->high_priority_queue,
+                            file, lacks_info, REQUEST_FILE_INFO);
         return;
     }
 
@@ -3551,27 +5460,42 @@ file_info_start (NautilusDirectory *directory,
         return;
     }
 
-    directory->details->get_info_file = file;
-    file->details->get_info_failed = FALSE;
-    if (file->details->get_info_error)
+    file_info_load (directory, file);
+    file_info_prefetch (directory, directory->details->high_priority_queue,
+                        file, lacks_info, REQUEST_FILE_INFO);
+}
+
+/* Files loaded with only the fast attributes get the rest from the low
+ * priority queue, so that this doesn't hold up counts and thumbnails of
+ * the files that are visible.
+ */
+static void
+extended_info_start (NautilusDirectory *directory,
+                     NautilusFile      *file,
+                     gboolean          *doing_io)
+{
+    if (find_file_info_for_file (directory, file) != NULL)
     {
-        g_error_free (file->details->get_info_error);
-        file->details->get_info_error = NULL;
+        *doing_io = TRUE;
+        file_info_prefetch (directory, directory->details->low_priority_queue,
+                            file, lacks_extended_info, REQUEST_EXTENDED_INFO);
+        return;
     }
 
-    state = g_new (GetInfoState, 1);
-    state->directory = directory;
-    state->cancellable = g_cancellable_new ();
+    if (!is_needy (file, lacks_extended_info, REQUEST_EXTENDED_INFO))
+    {
+        return;
+    }
+    *doing_io = TRUE;
 
-    directory->details->get_info_in_progress = state;
+    if (!async_job_start (directory, "file info"))
+    {
+        return;
+    }
 
-    location = nautilus_file_get_location (file);
-    g_file_query_info_async (location,
-                             NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
-                             0,
-                             G_PRIORITY_DEFAULT,
-                             state->cancellable, query_info_callback, state);
-    g_object_unref (location);
+    file_info_load (directory, file);
+    file_info_prefetch (directory, directory->details->low_priority_queue,
+                        file, lacks_extended_info, REQUEST_EXTENDED_INFO);
 }
 
 static void
@@ -3581,18 +5505,13 @@ thumbnail_done (NautilusDirectory *directory,
 {
     const char *thumb_mtime_str;
     time_t thumb_mtime = 0;
+    NautilusFileThumbnailInfo *thumbnail_info;
 
     file->details->thumbnail_is_up_to_date = TRUE;
-    if (file->details->thumbnail)
-    {
-        g_object_unref (file->details->thumbnail);
-        file->details->thumbnail = NULL;
-    }
-    if (file->details->scaled_thumbnail)
-    {
-        g_object_unref (file->details->scaled_thumbnail);
-        file->details->scaled_thumbnail = NULL;
-    }
+    thumbnail_info = nautilus_file_ensure_thumbnail_info (file);
+    nautilus_thumbnail_cache_forget (file);
+    g_clear_object (&thumbnail_info->pixbuf);
+    nautilus_file_thumbnail_info_clear_scaled (thumbnail_info);
 
     if (pixbuf)
     {
@@ -3605,13 +5524,13 @@ thumbnail_done (NautilusDirectory *directory,
         if (thumb_mtime == 0 ||
             thumb_mtime == file->details->mtime)
         {
-            file->details->thumbnail = g_object_ref (pixbuf);
-            file->details->thumbnail_mtime = thumb_mtime;
+            thumbnail_info->pixbuf = g_object_ref (pixbuf);
+            thumbnail_info->mtime = thumb_mtime;
+            nautilus_thumbnail_cache_use (file);
         }
         else
         {
-            g_free (file->details->thumbnail_path);
-            file->details->thumbnail_path = NULL;
+            g_clear_pointer (&thumbnail_info->path, g_free);
         }
     }
 
@@ -3734,53 +5653,72 @@ get_pixbuf_for_content (goffset  file_len,
     {
         pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
     }
-    g_object_unref (G_OBJECT (loader));
+    g_object_unref (G_OBJECT (loader));
+
+    if (pixbuf)
+    {
+        pixbuf2 = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+        g_object_unref (pixbuf);
+        pixbuf = pixbuf2;
+    }
+    return pixbuf;
+}
+
+
+/* Runs in a worker thread, so that big thumbnails don't block the UI
+ * while they are decoded and scaled down.
+ */
+static void
+thumbnail_load_thread (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+    gsize file_size;
+    char *file_contents;
+    GdkPixbuf *pixbuf;
+
+    if (!g_file_load_contents (G_FILE (source_object), cancellable,
+                               &file_contents, &file_size,
+                               NULL, NULL))
+    {
+        g_task_return_pointer (task, NULL, NULL);
+        return;
+    }
 
-    if (pixbuf)
+    pixbuf = NULL;
+    if (!g_cancellable_is_cancelled (cancellable))
     {
-        pixbuf2 = gdk_pixbuf_apply_embedded_orientation (pixbuf);
-        g_object_unref (pixbuf);
-        pixbuf = pixbuf2;
+        pixbuf = get_pixbuf_for_content (file_size, file_contents);
     }
-    return pixbuf;
-}
+    g_free (file_contents);
 
+    g_task_return_pointer (task, pixbuf, g_object_unref);
+}
 
 static void
-thumbnail_read_callback (GObject      *source_object,
-                         GAsyncResult *res,
-                         gpointer      user_data)
+thumbnail_loaded_callback (GObject      *source_object,
+                           GAsyncResult *res,
+                           gpointer      user_data)
 {
     ThumbnailState *state;
-    gsize file_size;
-    char *file_contents;
-    gboolean result;
     NautilusDirectory *directory;
     GdkPixbuf *pixbuf;
 
     state = user_data;
 
+    pixbuf = g_task_propagate_pointer (G_TASK (res), NULL);
+
     if (state->directory == NULL)
     {
         /* Operation was cancelled. Bail out */
+        g_clear_object (&pixbuf);
         thumbnail_state_free (state);
         return;
     }
 
     directory = nautilus_directory_ref (state->directory);
 
-    result = g_file_load_contents_finish (G_FILE (source_object),
-                                          res,
-                                          &file_contents, &file_size,
-                                          NULL, NULL);
-
-    pixbuf = NULL;
-    if (result)
-    {
-        pixbuf = get_pixbuf_for_content (file_size, file_contents);
-        g_free (file_contents);
-    }
-
     state->directory->details->thumbnail_state = NULL;
     async_job_end (state->directory, "thumbnail");
 
@@ -3791,6 +5729,40 @@ thumbnail_read_callback (GObject      *source_object,
     nautilus_directory_unref (directory);
 }
 
+/* The visible files are moved to the head of the queue as the view
+ * scrolls. If the thumbnail being loaded is no longer near the head,
+ * it has most likely scrolled out of view, so it can wait.
+ */
+static gboolean
+thumbnail_was_deprioritized (NautilusDirectory *directory,
+                             NautilusFile      *head)
+{
+    NautilusFile *file;
+    NautilusFile *next;
+    guint lookahead;
+
+    file = directory->details->thumbnail_state->file;
+    if (file == NULL || file == head ||
+        !is_needy (head, lacks_thumbnail, REQUEST_THUMBNAIL))
+    {
+        return FALSE;
+    }
+
+    lookahead = 0;
+    for (next = nautilus_file_queue_next (directory->details->low_priority_queue, head);
+         next != NULL && lookahead < THUMBNAIL_LOOKAHEAD;
+         next = nautilus_file_queue_next (directory->details->low_priority_queue, next))
+    {
+        if (next == file)
+        {
+            return FALSE;
+        }
+        lookahead++;
+    }
+
+    return TRUE;
+}
+
 static void
 thumbnail_start (NautilusDirectory *directory,
                  NautilusFile      *file,
@@ -3798,11 +5770,19 @@ thumbnail_start (NautilusDirectory *directory,
 {
     GFile *location;
     ThumbnailState *state;
+    g_autoptr (GTask) task = NULL;
 
     if (directory->details->thumbnail_state != NULL)
     {
-        *doing_io = TRUE;
-        return;
+        if (!thumbnail_was_deprioritized (directory, file))
+        {
+            *doing_io = TRUE;
+            return;
+        }
+
+        DEBUG ("cancelling thumbnail that scrolled out of view in %p",
+               directory->details->location);
+        thumbnail_cancel (directory);
     }
 
     if (!is_needy (file,
@@ -3823,14 +5803,14 @@ thumbnail_start (NautilusDirectory *directory,
     state->file = file;
     state->cancellable = g_cancellable_new ();
 
-    location = g_file_new_for_path (file->details->thumbnail_path);
+    location = g_file_new_for_path (file->details->thumbnail_info->path);
 
     directory->details->thumbnail_state = state;
 
-    g_file_load_contents_async (location,
-                                state->cancellable,
-                                thumbnail_read_callback,
-                                state);
+    task = g_task_new (location, state->cancellable,
+                       thumbnail_loaded_callback, state);
+    g_task_set_source_tag (task, thumbnail_start);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_THUMBNAILS, task, thumbnail_load_thread);
     g_object_unref (location);
 }
 
@@ -4046,7 +6026,7 @@ filesystem_info_cancel (NautilusDirectory *directory)
 {
     if (directory->details->filesystem_info_state != NULL)
     {
-        g_cancellable_cancel (directory->details->filesystem_info_state->cancellable);
+        /* The query is shared, so it goes on */
         directory->details->filesystem_info_state->directory = NULL;
         directory->details->filesystem_info_state = NULL;
         async_job_end (directory, "filesystem info");
@@ -4082,27 +6062,16 @@ filesystem_info_stop (NautilusDirectory *directory)
 static void
 filesystem_info_state_free (FilesystemInfoState *state)
 {
-    g_object_unref (state->cancellable);
     g_free (state);
 }
 
+/* careful here, info may be NULL */
 static void
-got_filesystem_info (FilesystemInfoState *state,
-                     GFileInfo           *info)
+set_filesystem_info (NautilusFile *file,
+                     GFileInfo    *info)
 {
-    NautilusDirectory *directory;
-    NautilusFile *file;
     const char *filesystem_type;
 
-    /* careful here, info may be NULL */
-
-    directory = nautilus_directory_ref (state->directory);
-
-    state->directory->details->filesystem_info_state = NULL;
-    async_job_end (state->directory, "filesystem info");
-
-    file = nautilus_file_ref (state->file);
-
     file->details->filesystem_info_is_up_to_date = TRUE;
     if (info != NULL)
     {
@@ -4118,6 +6087,23 @@ got_filesystem_info (FilesystemInfoState *state,
             file->details->filesystem_type = g_ref_string_new_intern (filesystem_type);
         }
     }
+}
+
+static void
+got_filesystem_info (FilesystemInfoState *state,
+                     GFileInfo           *info)
+{
+    NautilusDirectory *directory;
+    NautilusFile *file;
+
+    directory = nautilus_directory_ref (state->directory);
+
+    state->directory->details->filesystem_info_state = NULL;
+    async_job_end (state->directory, "filesystem info");
+
+    file = nautilus_file_ref (state->file);
+
+    set_filesystem_info (file, info);
 
     nautilus_directory_async_state_changed (directory);
     nautilus_file_changed (file);
@@ -4130,11 +6116,9 @@ got_filesystem_info (FilesystemInfoState *state,
 }
 
 static void
-query_filesystem_info_callback (GObject      *source_object,
-                                GAsyncResult *res,
-                                gpointer      user_data)
+query_filesystem_info_callback (GFileInfo *info,
+                                gpointer   user_data)
 {
-    GFileInfo *info;
     FilesystemInfoState *state;
 
     state = user_data;
@@ -4145,13 +6129,38 @@ query_filesystem_info_callback (GObject      *source_object,
         return;
     }
 
-    info = g_file_query_filesystem_info_finish (G_FILE (source_object), res, NULL);
-
     got_filesystem_info (state, info);
+}
 
-    if (info != NULL)
+/* Starts the queries of the other filesystems the next files are on, so
+ * that they run in parallel instead of one after the other. They are
+ * picked up from the cache when the files get their turn. */
+static void
+prefetch_filesystem_info (NautilusDirectory *directory,
+                          NautilusFile      *file)
+{
+    NautilusFile *next;
+    guint count;
+
+    count = 0;
+    for (next = nautilus_file_queue_next (directory->details->low_priority_queue, file);
+         next != NULL && count < FILESYSTEM_INFO_PREFETCH_FILES;
+         next = nautilus_file_queue_next (directory->details->low_priority_queue, next), count++)
     {
-        g_object_unref (info);
+        const char *filesystem_id = next->details->filesystem_id;
+        g_autoptr (GFile) location = NULL;
+
+        if (filesystem_id == NULL ||
+            g_strcmp0 (filesystem_id, file->details->filesystem_id) == 0 ||
+            nautilus_filesystem_info_cache_lookup (filesystem_id) != NULL ||
+            !is_needy (next, lacks_filesystem_info, REQUEST_FILESYSTEM_INFO))
+        {
+            continue;
+        }
+
+        /* Queries already in progress are joined, not repeated */
+        location = nautilus_file_get_location (next);
+        nautilus_filesystem_info_cache_query (location, filesystem_id, NULL, NULL);
     }
 }
 
@@ -4162,6 +6171,7 @@ filesystem_info_start (NautilusDirectory *directory,
 {
     GFile *location;
     FilesystemInfoState *state;
+    GFileInfo *info;
 
     if (directory->details->filesystem_info_state != NULL)
     {
@@ -4175,6 +6185,16 @@ filesystem_info_start (NautilusDirectory *directory,
     {
         return;
     }
+
+    /* Other files of the same filesystem got it just now */
+    info = nautilus_filesystem_info_cache_lookup (file->details->filesystem_id);
+    if (info != NULL)
+    {
+        set_filesystem_info (file, info);
+        nautilus_file_changed (file);
+        return;
+    }
+
     *doing_io = TRUE;
 
     if (!async_job_start (directory, "filesystem info"))
@@ -4185,69 +6205,108 @@ filesystem_info_start (NautilusDirectory *directory,
     state = g_new0 (FilesystemInfoState, 1);
     state->directory = directory;
     state->file = file;
-    state->cancellable = g_cancellable_new ();
 
     location = nautilus_file_get_location (file);
 
     directory->details->filesystem_info_state = state;
 
-    g_file_query_filesystem_info_async (location,
-                                        G_FILE_ATTRIBUTE_FILESYSTEM_READONLY ","
-                                        G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW ","
-                                        G_FILE_ATTRIBUTE_FILESYSTEM_TYPE ","
-                                        G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
-                                        G_PRIORITY_DEFAULT,
-                                        state->cancellable,
-                                        query_filesystem_info_callback,
-                                        state);
+    nautilus_filesystem_info_cache_query (location,
+                                          file->details->filesystem_id,
+                                          query_filesystem_info_callback,
+                                          state);
     g_object_unref (location);
+
+    prefetch_filesystem_info (directory, file);
 }
 
-static void
-extension_info_cancel (NautilusDirectory *directory)
+static ExtensionInfoState *
+find_extension_info (NautilusDirectory    *directory,
+                     NautilusFile         *file,
+                     NautilusInfoProvider *provider)
 {
-    if (directory->details->extension_info_in_progress != NULL)
+    GList *node;
+    ExtensionInfoState *state;
+
+    for (node = directory->details->extension_info_in_progress; node != NULL; node = node->next)
     {
-        if (directory->details->extension_info_idle)
+        state = node->data;
+        if (state->provider == provider &&
+            g_list_find (state->files, file) != NULL)
         {
-            g_source_remove (directory->details->extension_info_idle);
-        }
-        else
-        {
-            nautilus_info_provider_cancel_update
-                (directory->details->extension_info_provider,
-                directory->details->extension_info_in_progress);
+            return state;
         }
+    }
+
+    return NULL;
+}
+
+static void
+extension_info_state_free (ExtensionInfoState *state)
+{
+    /* A late call from the extension must not find the state. */
+    g_closure_invalidate (state->update_complete);
+    g_closure_unref (state->update_complete);
+    g_list_free (state->files);
+    g_free (state);
+}
+
+static void
+extension_info_cancel_one (NautilusDirectory  *directory,
+                           ExtensionInfoState *state)
+{
+    if (state->idle_id != 0)
+    {
+        g_source_remove (state->idle_id);
+    }
+    else if (state->handle != NULL)
+    {
+        nautilus_info_provider_cancel_update (state->provider, state->handle);
+    }
+
+    directory->details->extension_info_in_progress =
+        g_list_remove (directory->details->extension_info_in_progress, state);
+    extension_info_state_free (state);
 
-        directory->details->extension_info_in_progress = NULL;
-        directory->details->extension_info_file = NULL;
-        directory->details->extension_info_provider = NULL;
-        directory->details->extension_info_idle = 0;
+    async_job_end (directory, "extension info");
+}
 
-        async_job_end (directory, "extension info");
+static void
+extension_info_cancel (NautilusDirectory *directory)
+{
+    while (directory->details->extension_info_in_progress != NULL)
+    {
+        extension_info_cancel_one (directory,
+                                   directory->details->extension_info_in_progress->data);
     }
 }
 
 static void
 extension_info_stop (NautilusDirectory *directory)
 {
-    if (directory->details->extension_info_in_progress != NULL)
+    GList *node, *next, *l;
+    ExtensionInfoState *state;
+    NautilusFile *file;
+    gboolean needed;
+
+    for (node = directory->details->extension_info_in_progress; node != NULL; node = next)
     {
-        NautilusFile *file;
+        next = node->next;
+        state = node->data;
 
-        file = directory->details->extension_info_file;
-        if (file != NULL)
+        needed = FALSE;
+        for (l = state->files; l != NULL && !needed; l = l->next)
         {
+            file = l->data;
             g_assert (NAUTILUS_IS_FILE (file));
             g_assert (file->details->directory == directory);
-            if (is_needy (file, lacks_extension_info, REQUEST_EXTENSION_INFO))
-            {
-                return;
-            }
+            needed = is_needy (file, lacks_extension_info, REQUEST_EXTENSION_INFO);
         }
 
         /* The info is not wanted, so stop it. */
-        extension_info_cancel (directory);
+        if (!needed)
+        {
+            extension_info_cancel_one (directory, state);
+        }
     }
 }
 
@@ -4269,34 +6328,51 @@ finish_info_provider (NautilusDirectory    *directory,
     }
 }
 
+static void
+extension_info_done (ExtensionInfoState *state)
+{
+    NautilusDirectory *directory;
+    NautilusInfoProvider *provider;
+    GList *files, *l;
+
+    directory = state->directory;
+    provider = g_object_ref (state->provider);
+    files = nautilus_file_list_copy (state->files);
+
+    directory->details->extension_info_in_progress =
+        g_list_remove (directory->details->extension_info_in_progress, state);
+    extension_info_state_free (state);
+
+    async_job_end (directory, "extension info");
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        finish_info_provider (directory, l->data, provider);
+    }
+
+    nautilus_file_list_free (files);
+    g_object_unref (provider);
+}
 
 static gboolean
 info_provider_idle_callback (gpointer user_data)
 {
     InfoProviderResponse *response;
-    NautilusDirectory *directory;
+    ExtensionInfoState *state;
 
     response = user_data;
-    directory = response->directory;
+    state = response->state;
 
-    if (response->handle != directory->details->extension_info_in_progress
-        || response->provider != directory->details->extension_info_provider)
+    state->idle_id = 0;
+
+    if (response->handle != state->handle
+        || response->provider != state->provider)
     {
         g_warning ("Unexpected plugin response.  This probably indicates a bug in a Nautilus extension: handle=%p", response->handle);
     }
     else
     {
-        NautilusFile *file;
-        async_job_end (directory, "extension info");
-
-        file = directory->details->extension_info_file;
-
-        directory->details->extension_info_file = NULL;
-        directory->details->extension_info_provider = NULL;
-        directory->details->extension_info_in_progress = NULL;
-        directory->details->extension_info_idle = 0;
-
-        finish_info_provider (directory, file, response->provider);
+        extension_info_done (state);
     }
 
     return FALSE;
@@ -4314,69 +6390,176 @@ info_provider_callback (NautilusInfoProvider    *provider,
     response->provider = provider;
     response->handle = handle;
     response->result = result;
-    response->directory = NAUTILUS_DIRECTORY (user_data);
+    response->state = user_data;
 
-    response->directory->details->extension_info_idle =
+    response->state->idle_id =
         g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
                          info_provider_idle_callback, response,
                          g_free);
 }
 
-static void
-extension_info_start (NautilusDirectory *directory,
-                      NautilusFile      *file,
-                      gboolean          *doing_io)
+static gboolean
+extension_info_can_batch (NautilusDirectory    *directory,
+                          NautilusFile         *file,
+                          NautilusInfoProvider *provider)
 {
-    NautilusInfoProvider *provider;
-    NautilusOperationResult result;
-    NautilusOperationHandle *handle;
-    GClosure *update_complete;
+    return g_list_find (file->details->pending_info_providers, provider) != NULL &&
+           find_extension_info (directory, file, provider) == NULL &&
+           is_needy (file, lacks_extension_info, REQUEST_EXTENSION_INFO);
+}
+
+/* While the directory is being listed, providers that can take a list are
+ * held back until a whole batch is queued for them, so that they get all
+ * of a directory in one call if it fits instead of the files seen so far.
+ */
+static gboolean
+extension_info_waits_for_batch (NautilusDirectory    *directory,
+                                NautilusFile         *file,
+                                NautilusInfoProvider *provider)
+{
+    NautilusFile *next;
+    guint count;
 
-    if (directory->details->extension_info_in_progress != NULL)
+    if (directory->details->directory_load_in_progress == NULL ||
+        directory->details->directory_loaded ||
+        !nautilus_info_provider_can_update_file_info_list (provider))
     {
-        *doing_io = TRUE;
-        return;
+        return FALSE;
     }
 
-    if (!is_needy (file, lacks_extension_info, REQUEST_EXTENSION_INFO))
+    count = 1;
+    for (next = nautilus_file_queue_next (directory->details->extension_queue, file);
+         next != NULL && count < EXTENSION_INFO_BATCH_SIZE;
+         next = nautilus_file_queue_next (directory->details->extension_queue, next))
     {
-        return;
+        if (extension_info_can_batch (directory, next, provider))
+        {
+            count++;
+        }
     }
-    *doing_io = TRUE;
 
-    if (!async_job_start (directory, "extension info"))
+    return count < EXTENSION_INFO_BATCH_SIZE;
+}
+
+/* Providers that can take a list get the files queued behind @file that
+ * wait for them too, and complete them all at once.
+ */
+static void
+extension_info_dispatch (NautilusDirectory    *directory,
+                         NautilusFile         *file,
+                         NautilusInfoProvider *provider)
+{
+    ExtensionInfoState *state;
+    NautilusOperationResult result;
+    NautilusOperationHandle *handle;
+    NautilusFile *next;
+    gboolean batch;
+    guint count;
+
+    state = g_new0 (ExtensionInfoState, 1);
+    state->directory = directory;
+    state->provider = provider;
+    state->files = g_list_prepend (NULL, file);
+
+    batch = nautilus_info_provider_can_update_file_info_list (provider);
+    if (batch)
     {
-        return;
-    }
+        count = 1;
+        for (next = nautilus_file_queue_next (directory->details->extension_queue, file);
+             next != NULL && count < EXTENSION_INFO_BATCH_SIZE;
+             next = nautilus_file_queue_next (directory->details->extension_queue, next))
+        {
+            if (!extension_info_can_batch (directory, next, provider))
+            {
+                continue;
+            }
 
-    provider = file->details->pending_info_providers->data;
+            state->files = g_list_prepend (state->files, next);
+            count++;
+        }
+        state->files = g_list_reverse (state->files);
+    }
 
-    update_complete = g_cclosure_new (G_CALLBACK (info_provider_callback),
-                                      directory,
-                                      NULL);
-    g_closure_set_marshal (update_complete,
+    state->update_complete = g_cclosure_new (G_CALLBACK (info_provider_callback),
+                                             state,
+                                             NULL);
+    g_closure_ref (state->update_complete);
+    g_closure_sink (state->update_complete);
+    g_closure_set_marshal (state->update_complete,
                            g_cclosure_marshal_generic);
 
-    result = nautilus_info_provider_update_file_info
-                 (provider,
-                 NAUTILUS_FILE_INFO (file),
-                 update_complete,
-                 &handle);
+    directory->details->extension_info_in_progress =
+        g_list_prepend (directory->details->extension_info_in_progress, state);
 
-    g_closure_unref (update_complete);
+    handle = NULL;
+    if (batch)
+    {
+        result = nautilus_info_provider_update_file_info_list
+                     (provider,
+                     state->files,
+                     state->update_complete,
+                     &handle);
+    }
+    else
+    {
+        result = nautilus_info_provider_update_file_info
+                     (provider,
+                     NAUTILUS_FILE_INFO (file),
+                     state->update_complete,
+                     &handle);
+    }
 
     if (result == NAUTILUS_OPERATION_COMPLETE ||
         result == NAUTILUS_OPERATION_FAILED)
     {
-        finish_info_provider (directory, file, provider);
-        async_job_end (directory, "extension info");
+        g_clear_handle_id (&state->idle_id, g_source_remove);
+        extension_info_done (state);
     }
     else
     {
-        directory->details->extension_info_in_progress = handle;
-        directory->details->extension_info_provider = provider;
-        directory->details->extension_info_file = file;
+        state->handle = handle;
+    }
+}
+
+static void
+extension_info_start (NautilusDirectory *directory,
+                      NautilusFile      *file,
+                      gboolean          *doing_io)
+{
+    GList *providers, *node;
+    NautilusInfoProvider *provider;
+
+    if (!is_needy (file, lacks_extension_info, REQUEST_EXTENSION_INFO))
+    {
+        return;
+    }
+    *doing_io = TRUE;
+
+    /* Finishing a provider right away changes the pending list. */
+    providers = g_list_copy_deep (file->details->pending_info_providers,
+                                  (GCopyFunc) g_object_ref, NULL);
+
+    for (node = providers; node != NULL; node = node->next)
+    {
+        provider = node->data;
+
+        if (find_extension_info (directory, file, provider) != NULL ||
+            g_list_find (file->details->pending_info_providers, provider) == NULL ||
+            extension_info_waits_for_batch (directory, file, provider))
+        {
+            continue;
+        }
+
+        if (g_list_length (directory->details->extension_info_in_progress) >= MAX_EXTENSION_INFOS_IN_FLIGHT ||
+            !async_job_start (directory, "extension info"))
+        {
+            break;
+        }
+
+        extension_info_dispatch (directory, file, provider);
     }
+
+    g_list_free_full (providers, g_object_unref);
 }
 
 static void
@@ -4427,6 +6610,7 @@ start_or_stop_io (NautilusDirectory *directory)
         mime_list_start (directory, file, &doing_io);
         thumbnail_start (directory, file, &doing_io);
         filesystem_info_start (directory, file, &doing_io);
+        extended_info_start (directory, file, &doing_io);
 
         if (doing_io)
         {
@@ -4500,15 +6684,22 @@ nautilus_directory_cancel (NautilusDirectory *directory)
     file_list_cancel (directory);
     mime_list_cancel (directory);
     new_files_cancel (directory);
+    stop_lingering (directory);
     extension_info_cancel (directory);
     thumbnail_cancel (directory);
     mount_cancel (directory);
     filesystem_info_cancel (directory);
 
     /* We aren't waiting for anything any more. */
-    if (waiting_directories != NULL)
+    if (directory->details->job_budget != NULL)
+    {
+        g_queue_remove (&directory->details->job_budget->waiting_directories,
+                        directory);
+    }
+
+    if (focused_directory == directory)
     {
-        g_hash_table_remove (waiting_directories, directory);
+        focused_directory = NULL;
     }
 
     /* Check if any directories should wake up. */
@@ -4519,10 +6710,12 @@ static void
 cancel_directory_count_for_file (NautilusDirectory *directory,
                                  NautilusFile      *file)
 {
-    if (directory->details->count_in_progress != NULL &&
-        directory->details->count_in_progress->count_file == file)
+    DirectoryCountState *state;
+
+    state = find_directory_count_for_file (directory, file);
+    if (state != NULL)
     {
-        directory_count_cancel (directory);
+        directory_count_cancel_one (directory, state);
     }
 }
 
@@ -4551,9 +6744,12 @@ static void
 cancel_file_info_for_file (NautilusDirectory *directory,
                            NautilusFile      *file)
 {
-    if (directory->details->get_info_file == file)
+    GetInfoState *state;
+
+    state = find_file_info_for_file (directory, file);
+    if (state != NULL)
     {
-        file_info_cancel (directory);
+        file_info_cancel_one (directory, state);
     }
 }
 
@@ -4717,6 +6913,23 @@ nautilus_directory_remove_file_from_work_queue (NautilusDirectory *directory,
 }
 
 
+/* Used by views to get the attributes of the rows on screen before the
+ * rest of the directory.
+ */
+void
+nautilus_directory_prioritize_file_in_work_queue (NautilusDirectory *directory,
+                                                  NautilusFile      *file)
+{
+    g_return_if_fail (file->details->directory == directory);
+
+    nautilus_file_queue_move_to_head (directory->details->high_priority_queue,
+                                      file);
+    nautilus_file_queue_move_to_head (directory->details->low_priority_queue,
+                                      file);
+    nautilus_file_queue_move_to_head (directory->details->extension_queue,
+                                      file);
+}
+
 static void
 move_file_to_low_priority_queue (NautilusDirectory *directory,
                                  NautilusFile      *file)
@@ -0,0 +1,736 @@
+/* nautilus-directory-menu.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-directory-menu.h"
+
+#include <eel/eel-debug.h>
+#include <eel/eel-string.h>
+#include <eel/eel-vfs-extensions.h>
+#include <glib/gi18n.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_DIRECTORY_VIEW
+#include "nautilus-debug.h"
+
+#include "nautilus-application.h"
+#include "nautilus-directory.h"
+#include "nautilus-file.h"
+#include "nautilus-file-utilities.h"
+#include "nautilus-global-preferences.h"
+
+#define MAX_MENU_LEVELS 5
+#define TEMPLATE_LIMIT 30
+
+#define SHORTCUTS_PATH "/nautilus/scripts-accels"
+
+typedef enum
+{
+    MENU_KIND_SCRIPTS,
+    MENU_KIND_TEMPLATES,
+} MenuKind;
+
+typedef struct MenuDirectory MenuDirectory;
+
+struct MenuDirectory
+{
+    NautilusDirectoryMenu *owner;
+    NautilusDirectory *directory;
+    MenuDirectory *parent;
+    guint level;
+    GMenu *menu;
+    gboolean is_empty;
+    /* The URIs of the folders listed, see menu_directory_rebuild() */
+    GPtrArray *children;
+};
+
+struct _NautilusDirectoryMenu
+{
+    GObject parent_instance;
+
+    MenuKind kind;
+    char *uri;
+
+    /* URI -> MenuDirectory, for the folders of the tree */
+    GHashTable *directories;
+    /* The folders whose files changed since the last update */
+    GHashTable *outdated;
+    guint update_idle_id;
+
+    /* The menu of the top folder */
+    GMenu *menu;
+};
+
+G_DEFINE_TYPE (NautilusDirectoryMenu, nautilus_directory_menu, G_TYPE_OBJECT)
+
+enum
+{
+    CHANGED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+static NautilusDirectoryMenu *scripts_menu = NULL;
+static NautilusDirectoryMenu *templates_menu = NULL;
+
+/* Script display name -> accelerator */
+static GHashTable *script_accels = NULL;
+
+static MenuDirectory *menu_directory_new (NautilusDirectoryMenu *self,
+                                          const char            *uri,
+                                          MenuDirectory         *parent);
+static gboolean update_idle_cb (gpointer user_data);
+
+static void
+schedule_update (NautilusDirectoryMenu *self)
+{
+    if (self->update_idle_id == 0)
+    {
+        self->update_idle_id = g_idle_add (update_idle_cb, self);
+    }
+}
+
+static void
+directory_files_changed (NautilusDirectory *directory,
+                         GList             *files,
+                         gpointer           callback_data)
+{
+    MenuDirectory *menu_directory = callback_data;
+
+    g_hash_table_add (menu_directory->owner->outdated, menu_directory);
+    schedule_update (menu_directory->owner);
+}
+
+static void
+menu_directory_free (gpointer data)
+{
+    MenuDirectory *menu_directory = data;
+
+    g_signal_handlers_disconnect_by_data (menu_directory->directory, menu_directory);
+    nautilus_directory_file_monitor_remove (menu_directory->directory, menu_directory);
+    nautilus_directory_unref (menu_directory->directory);
+
+    g_object_unref (menu_directory->menu);
+    g_ptr_array_unref (menu_directory->children);
+
+    g_free (menu_directory);
+}
+
+static void
+remove_directory (NautilusDirectoryMenu *self,
+                  const char            *uri)
+{
+    MenuDirectory *menu_directory;
+
+    menu_directory = g_hash_table_lookup (self->directories, uri);
+    if (menu_directory == NULL)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < menu_directory->children->len; i++)
+    {
+        remove_directory (self, g_ptr_array_index (menu_directory->children, i));
+    }
+
+    g_hash_table_remove (self->outdated, menu_directory);
+    g_hash_table_remove (self->directories, uri);
+}
+
+static gboolean
+filter_templates_callback (NautilusFile *file,
+                           gpointer      callback_data)
+{
+    gboolean show_hidden = GPOINTER_TO_INT (callback_data);
+
+    if (nautilus_file_is_hidden_file (file))
+    {
+        if (!show_hidden)
+        {
+            return FALSE;
+        }
+
+        if (nautilus_file_is_directory (file))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static GList *
+get_menu_files (NautilusDirectoryMenu *self,
+                MenuDirectory         *menu_directory)
+{
+    GList *file_list;
+    GList *filtered;
+    GList *removed;
+    gboolean show_hidden;
+
+    file_list = nautilus_directory_get_file_list (menu_directory->directory);
+
+    if (self->kind == MENU_KIND_SCRIPTS)
+    {
+        filtered = nautilus_file_list_filter_hidden (file_list, FALSE);
+    }
+    else
+    {
+        /*
+         * The nautilus_file_list_filter_hidden() function isn't used here, because
+         * we want to show hidden files, but not directories. This is a compromise
+         * to allow creating hidden files but to prevent content from .git directory
+         * for example. See https://gitlab.gnome.org/GNOME/nautilus/issues/1413.
+         */
+        show_hidden = g_settings_get_boolean (gtk_filechooser_preferences,
+                                              NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES);
+        filtered = nautilus_file_list_filter (file_list, &removed,
+                                              filter_templates_callback,
+                                              GINT_TO_POINTER (show_hidden));
+        nautilus_file_list_free (removed);
+    }
+    nautilus_file_list_free (file_list);
+
+    return nautilus_file_list_sort_by_display_name (filtered);
+}
+
+static GMenuItem *
+create_file_item (NautilusDirectoryMenu *self,
+                  NautilusFile          *file)
+{
+    g_autofree char *name = NULL;
+    g_autofree char *uri = NULL;
+    g_autofree char *label = NULL;
+    g_autoptr (GIcon) icon = NULL;
+    GMenuItem *menu_item;
+    const char *action_name;
+
+    name = nautilus_file_get_display_name (file);
+    uri = nautilus_file_get_uri (file);
+
+    if (self->kind == MENU_KIND_SCRIPTS)
+    {
+        action_name = "view.run-script";
+        label = g_strdup (name);
+    }
+    else
+    {
+        g_autofree char *stripped = NULL;
+
+        action_name = "view.create-from-template";
+        stripped = eel_filename_strip_extension (name);
+        label = eel_str_double_underscores (stripped);
+    }
+
+    menu_item = g_menu_item_new (label, NULL);
+    g_menu_item_set_action_and_target_value (menu_item, action_name,
+                                             g_variant_new_string (uri));
+
+    icon = nautilus_file_get_gicon (file, 0);
+    if (icon != NULL)
+    {
+        g_menu_item_set_icon (menu_item, icon);
+    }
+
+    if (self->kind == MENU_KIND_SCRIPTS)
+    {
+        const char *shortcut;
+
+        shortcut = g_hash_table_lookup (script_accels, name);
+        if (shortcut != NULL)
+        {
+            g_autofree char *detailed_action_name = NULL;
+
+            detailed_action_name = g_action_print_detailed_name (action_name,
+                                                                 g_variant_new_string (uri));
+            nautilus_application_set_accelerator (g_application_get_default (),
+                                                  detailed_action_name, shortcut);
+        }
+    }
+
+    return menu_item;
+}
+
+/* Fills the menu of @menu_directory again. The folders listed get their
+ * own menus built the first time, and keep them afterwards. */
+static void
+menu_directory_rebuild (NautilusDirectoryMenu *self,
+                        MenuDirectory         *menu_directory)
+{
+    g_autoptr (GPtrArray) old_children = NULL;
+    GList *files;
+    GList *node;
+    gboolean was_empty;
+    int num;
+
+    was_empty = menu_directory->is_empty;
+    old_children = g_steal_pointer (&menu_directory->children);
+    menu_directory->children = g_ptr_array_new_with_free_func (g_free);
+
+    files = get_menu_files (self, menu_directory);
+    g_menu_remove_all (menu_directory->menu);
+
+    num = 0;
+    for (node = files; num < TEMPLATE_LIMIT && node != NULL; node = node->next, num++)
+    {
+        NautilusFile *file = node->data;
+        g_autoptr (GMenuItem) menu_item = NULL;
+
+        if (nautilus_file_is_directory (file))
+        {
+            MenuDirectory *child;
+            char *uri;
+
+            if (menu_directory->level >= MAX_MENU_LEVELS)
+            {
+                continue;
+            }
+
+            uri = nautilus_file_get_uri (file);
+            g_ptr_array_add (menu_directory->children, uri);
+
+            child = g_hash_table_lookup (self->directories, uri);
+            if (child == NULL)
+            {
+                child = menu_directory_new (self, uri, menu_directory);
+                menu_directory_rebuild (self, child);
+            }
+
+            if (!child->is_empty)
+            {
+                g_autofree char *display_name = NULL;
+                g_autofree char *label = NULL;
+
+                display_name = nautilus_file_get_display_name (file);
+                label = self->kind == MENU_KIND_TEMPLATES ?
+                        eel_str_double_underscores (display_name) :
+                        g_strdup (display_name);
+                menu_item = g_menu_item_new_submenu (label, G_MENU_MODEL (child->menu));
+            }
+        }
+        else if (self->kind == MENU_KIND_SCRIPTS ?
+                 nautilus_file_is_launchable (file) :
+                 nautilus_file_can_read (file))
+        {
+            menu_item = create_file_item (self, file);
+        }
+
+        if (menu_item != NULL)
+        {
+            g_menu_append_item (menu_directory->menu, menu_item);
+        }
+    }
+
+    nautilus_file_list_free (files);
+
+    /* Also when the folders created above found it outdated */
+    g_hash_table_remove (self->outdated, menu_directory);
+    menu_directory->is_empty = g_menu_model_get_n_items (G_MENU_MODEL (menu_directory->menu)) == 0;
+
+    /* The folders gone from the menu, or too full to be listed */
+    for (guint i = 0; i < old_children->len; i++)
+    {
+        const char *uri = g_ptr_array_index (old_children, i);
+
+        if (!g_ptr_array_find_with_equal_func (menu_directory->children, uri,
+                                               g_str_equal, NULL))
+        {
+            remove_directory (self, uri);
+        }
+    }
+
+    /* The parent lists the folder only when it has something */
+    if (menu_directory->is_empty != was_empty && menu_directory->parent != NULL)
+    {
+        g_hash_table_add (self->outdated, menu_directory->parent);
+    }
+}
+
+static MenuDirectory *
+menu_directory_new (NautilusDirectoryMenu *self,
+                    const char            *uri,
+                    MenuDirectory         *parent)
+{
+    MenuDirectory *menu_directory;
+
+    menu_directory = g_new0 (MenuDirectory, 1);
+    menu_directory->owner = self;
+    menu_directory->directory = nautilus_directory_get_by_uri (uri);
+    menu_directory->parent = parent;
+    menu_directory->level = parent != NULL ? parent->level + 1 : 0;
+    menu_directory->menu = parent != NULL ? g_menu_new () : g_object_ref (self->menu);
+    menu_directory->is_empty = TRUE;
+    menu_directory->children = g_ptr_array_new_with_free_func (g_free);
+
+    g_hash_table_insert (self->directories, g_strdup (uri), menu_directory);
+
+    nautilus_directory_file_monitor_add (menu_directory->directory, menu_directory,
+                                         FALSE,
+                                         NAUTILUS_FILE_ATTRIBUTES_FOR_ICON |
+                                         NAUTILUS_FILE_ATTRIBUTE_INFO |
+                                         NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT,
+                                         directory_files_changed, menu_directory);
+    g_signal_connect (menu_directory->directory, "files-added",
+                      G_CALLBACK (directory_files_changed), menu_directory);
+    g_signal_connect (menu_directory->directory, "files-changed",
+                      G_CALLBACK (directory_files_changed), menu_directory);
+
+    return menu_directory;
+}
+
+static MenuDirectory *
+get_deepest_outdated (NautilusDirectoryMenu *self)
+{
+    GHashTableIter iter;
+    MenuDirectory *menu_directory;
+    MenuDirectory *deepest = NULL;
+
+    g_hash_table_iter_init (&iter, self->outdated);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &menu_directory, NULL))
+    {
+        if (deepest == NULL || menu_directory->level > deepest->level)
+        {
+            deepest = menu_directory;
+        }
+    }
+
+    return deepest;
+}
+
+static gboolean
+update_idle_cb (gpointer user_data)
+{
+    NautilusDirectoryMenu *self = NAUTILUS_DIRECTORY_MENU (user_data);
+    MenuDirectory *menu_directory;
+
+    self->update_idle_id = 0;
+
+    /* The subfolders first, for their parents to know if they are empty */
+    while ((menu_directory = get_deepest_outdated (self)) != NULL)
+    {
+        menu_directory_rebuild (self, menu_directory);
+    }
+
+    g_signal_emit (self, signals[CHANGED], 0);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+show_hidden_files_changed (NautilusDirectoryMenu *self)
+{
+    GHashTableIter iter;
+    MenuDirectory *menu_directory;
+
+    g_hash_table_iter_init (&iter, self->directories);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &menu_directory))
+    {
+        g_hash_table_add (self->outdated, menu_directory);
+    }
+    schedule_update (self);
+}
+
+static void
+nautilus_directory_menu_finalize (GObject *object)
+{
+    NautilusDirectoryMenu *self = NAUTILUS_DIRECTORY_MENU (object);
+
+    g_clear_handle_id (&self->update_idle_id, g_source_remove);
+
+    g_hash_table_destroy (self->outdated);
+    g_hash_table_destroy (self->directories);
+    g_object_unref (self->menu);
+    g_free (self->uri);
+
+    G_OBJECT_CLASS (nautilus_directory_menu_parent_class)->finalize (object);
+}
+
+static void
+nautilus_directory_menu_class_init (NautilusDirectoryMenuClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = nautilus_directory_menu_finalize;
+
+    signals[CHANGED] = g_signal_new ("changed",
+                                     G_TYPE_FROM_CLASS (klass),
+                                     G_SIGNAL_RUN_LAST,
+                                     0,
+                                     NULL, NULL,
+                                     g_cclosure_marshal_VOID__VOID,
+                                     G_TYPE_NONE, 0);
+}
+
+static void
+nautilus_directory_menu_init (NautilusDirectoryMenu *self)
+{
+    self->directories = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, menu_directory_free);
+    self->outdated = g_hash_table_new (NULL, NULL);
+    self->menu = g_menu_new ();
+}
+
+static NautilusDirectoryMenu *
+nautilus_directory_menu_new (MenuKind    kind,
+                             const char *uri)
+{
+    NautilusDirectoryMenu *self;
+
+    self = g_object_new (NAUTILUS_TYPE_DIRECTORY_MENU, NULL);
+    self->kind = kind;
+    self->uri = g_strdup (uri);
+
+    if (uri != NULL)
+    {
+        g_hash_table_add (self->outdated, menu_directory_new (self, uri, NULL));
+        schedule_update (self);
+    }
+
+    if (kind == MENU_KIND_TEMPLATES)
+    {
+        g_signal_connect_object (gtk_filechooser_preferences,
+                                 "changed::" NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES,
+                                 G_CALLBACK (show_hidden_files_changed),
+                                 self, G_CONNECT_SWAPPED);
+    }
+
+    return self;
+}
+
+static char *
+set_up_scripts_directory (void)
+{
+    g_autofree gchar *old_scripts_directory_path = NULL;
+    g_autoptr (GFile) old_scripts_directory = NULL;
+    g_autofree gchar *scripts_directory_path = NULL;
+    g_autoptr (GFile) scripts_directory = NULL;
+    const char *override;
+    GFileType file_type;
+    g_autoptr (GError) error = NULL;
+
+    scripts_directory_path = nautilus_get_scripts_directory_path ();
+
+    override = g_getenv ("GNOME22_USER_DIR");
+
+    if (override)
+    {
+        old_scripts_directory_path = g_build_filename (override,
+                                                       "nautilus-scripts",
+                                                       NULL);
+    }
+    else
+    {
+        old_scripts_directory_path = g_build_filename (g_get_home_dir (),
+                                                       ".gnome2",
+                                                       "nautilus-scripts",
+                                                       NULL);
+    }
+
+    old_scripts_directory = g_file_new_for_path (old_scripts_directory_path);
+    scripts_directory = g_file_new_for_path (scripts_directory_path);
+
+    file_type = g_file_query_file_type (old_scripts_directory,
+                                        G_FILE_QUERY_INFO_NONE,
+                                        NULL);
+
+    if (file_type == G_FILE_TYPE_DIRECTORY &&
+        !g_file_query_exists (scripts_directory, NULL))
+    {
+        g_autoptr (GFile) updated = NULL;
+        const char *message;
+
+        /* test if we already attempted to migrate first */
+        updated = g_file_get_child (old_scripts_directory, "DEPRECATED-DIRECTORY");
+        message = _("Nautilus 3.6 deprecated this directory and tried migrating "
+                    "this configuration to ~/.local/share/nautilus");
+        if (!g_file_query_exists (updated, NULL))
+        {
+            g_autoptr (GFile) parent = NULL;
+
+            parent = g_file_get_parent (scripts_directory);
+            g_file_make_directory_with_parents (parent, NULL, &error);
+
+            if (error == NULL ||
+                g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+            {
+                g_clear_error (&error);
+
+                g_file_set_attribute_uint32 (parent,
+                                             G_FILE_ATTRIBUTE_UNIX_MODE,
+                                             S_IRWXU,
+                                             G_FILE_QUERY_INFO_NONE,
+                                             NULL, NULL);
+
+                g_file_move (old_scripts_directory,
+                             scripts_directory,
+                             G_FILE_COPY_NONE,
+                             NULL, NULL, NULL,
+                             &error);
+
+                if (error == NULL)
+                {
+                    g_file_replace_contents (updated,
+                                             message, strlen (message),
+                                             NULL,
+                                             FALSE,
+                                             G_FILE_CREATE_PRIVATE,
+                                             NULL, NULL, NULL);
+                }
+            }
+
+            g_clear_error (&error);
+        }
+    }
+
+    g_file_make_directory_with_parents (scripts_directory, NULL, &error);
+
+    if (error == NULL ||
+        g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+    {
+        g_file_set_attribute_uint32 (scripts_directory,
+                                     G_FILE_ATTRIBUTE_UNIX_MODE,
+                                     S_IRWXU,
+                                     G_FILE_QUERY_INFO_NONE,
+                                     NULL, NULL);
+
+        return g_file_get_uri (scripts_directory);
+    }
+
+    return NULL;
+}
+
+/* Expected format: accel script_name */
+static void
+load_custom_accels_for_scripts (void)
+{
+    gchar *path, *contents;
+    gchar **lines, **result;
+    GError *error = NULL;
+    const int max_len = 100;
+    int i;
+
+    path = g_build_filename (g_get_user_config_dir (), SHORTCUTS_PATH, NULL);
+
+    if (g_file_get_contents (path, &contents, NULL, &error))
+    {
+        lines = g_strsplit (contents, "\n", -1);
+        for (i = 0; lines[i] && (strstr (lines[i], " ") > 0); i++)
+        {
+            result = g_strsplit (lines[i], " ", 2);
+            g_hash_table_insert (script_accels,
+                                 g_strndup (result[1], max_len),
+                                 g_strndup (result[0], max_len));
+            g_strfreev (result);
+        }
+
+        g_free (contents);
+        g_strfreev (lines);
+    }
+    else
+    {
+        DEBUG ("Unable to open '%s', error message: %s", path, error->message);
+        g_clear_error (&error);
+    }
+
+    g_free (path);
+}
+
+static void
+unref_menus (void)
+{
+    g_clear_object (&scripts_menu);
+    g_clear_object (&templates_menu);
+    g_clear_pointer (&script_accels, g_hash_table_destroy);
+}
+
+NautilusDirectoryMenu *
+nautilus_directory_menu_get_scripts (void)
+{
+    g_autofree char *uri = NULL;
+
+    if (scripts_menu != NULL)
+    {
+        return scripts_menu;
+    }
+
+    script_accels = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, g_free);
+    load_custom_accels_for_scripts ();
+
+    uri = set_up_scripts_directory ();
+    if (uri == NULL)
+    {
+        g_warning ("Ignoring scripts directory, it may be a broken link\n");
+    }
+
+    if (templates_menu == NULL)
+    {
+        eel_debug_call_at_shutdown (unref_menus);
+    }
+    scripts_menu = nautilus_directory_menu_new (MENU_KIND_SCRIPTS, uri);
+
+    return scripts_menu;
+}
+
+NautilusDirectoryMenu *
+nautilus_directory_menu_get_templates (void)
+{
+    g_autofree char *uri = NULL;
+
+    if (templates_menu != NULL)
+    {
+        return templates_menu;
+    }
+
+    if (nautilus_should_use_templates_directory ())
+    {
+        uri = nautilus_get_templates_directory_uri ();
+    }
+
+    if (scripts_menu == NULL)
+    {
+        eel_debug_call_at_shutdown (unref_menus);
+    }
+    templates_menu = nautilus_directory_menu_new (MENU_KIND_TEMPLATES, uri);
+
+    return templates_menu;
+}
+
+const char *
+nautilus_directory_menu_get_uri (NautilusDirectoryMenu *self)
+{
+    g_return_val_if_fail (NAUTILUS_IS_DIRECTORY_MENU (self), NULL);
+
+    return self->uri;
+}
+
+GMenuModel *
+nautilus_directory_menu_get_model (NautilusDirectoryMenu *self)
+{
+    g_return_val_if_fail (NAUTILUS_IS_DIRECTORY_MENU (self), NULL);
+
+    return G_MENU_MODEL (self->menu);
+}
+
+gboolean
+nautilus_directory_menu_is_empty (NautilusDirectoryMenu *self)
+{
+    g_return_val_if_fail (NAUTILUS_IS_DIRECTORY_MENU (self), TRUE);
+
+    return g_menu_model_get_n_items (G_MENU_MODEL (self->menu)) == 0;
+}
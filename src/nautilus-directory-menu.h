@@ -0,0 +1,44 @@
+/* nautilus-directory-menu.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* The scripts and templates menus, shared by all the views: each folder
+ * of the tree is monitored once and has its own menu, rebuilt only when
+ * its files change. The items activate "view.run-script" and
+ * "view.create-from-template" with the URI of their file.
+ */
+
+#define NAUTILUS_TYPE_DIRECTORY_MENU (nautilus_directory_menu_get_type ())
+
+G_DECLARE_FINAL_TYPE (NautilusDirectoryMenu, nautilus_directory_menu, NAUTILUS, DIRECTORY_MENU, GObject)
+
+NautilusDirectoryMenu *nautilus_directory_menu_get_scripts   (void);
+NautilusDirectoryMenu *nautilus_directory_menu_get_templates (void);
+
+/* The URI of the folder of the menu, or NULL when there is none. */
+const char            *nautilus_directory_menu_get_uri       (NautilusDirectoryMenu *self);
+
+/* Always the same menu, emptied and filled again when "changed" is
+ * emitted. */
+GMenuModel            *nautilus_directory_menu_get_model     (NautilusDirectoryMenu *self);
+gboolean               nautilus_directory_menu_is_empty      (NautilusDirectoryMenu *self);
+
+G_END_DECLS
@@ -38,6 +38,14 @@ typedef struct MimeListState MimeListState;
 typedef struct ThumbnailState ThumbnailState;
 typedef struct MountState MountState;
 typedef struct FilesystemInfoState FilesystemInfoState;
+typedef struct ExtensionInfoState ExtensionInfoState;
+
+typedef struct
+{
+	const char *job; /* static string naming the kind of job */
+	gint64 start_time;
+} AsyncJobStart;
+typedef struct AsyncJobBudget AsyncJobBudget;
 
 typedef enum {
 	REQUEST_DEEP_COUNT,
@@ -49,6 +57,7 @@ typedef enum {
 	REQUEST_THUMBNAIL,
 	REQUEST_MOUNT,
 	REQUEST_FILESYSTEM_INFO,
+	REQUEST_EXTENDED_INFO,
 	REQUEST_TYPE_LAST
 } RequestType;
 
@@ -63,6 +72,8 @@ struct NautilusDirectoryDetails
 {
 	/* The location. */
 	GFile *location;
+	/* Shared by all the files for sorting by path */
+	char *uri_collation_key;
 
 	/* The file objects. */
 	NautilusFile *as_file;
@@ -89,31 +100,40 @@ struct NautilusDirectoryDetails
 	gboolean in_async_service_loop;
 	gboolean state_changed;
 
+	AsyncJobBudget *job_budget; /* per-backend job slots, shared */
+	GArray *job_start_times; /* of AsyncJobStart, oldest first */
+	gint64 job_wait_start_time; /* when we started waiting for a slot, or 0 */
+
 	gboolean file_list_monitored;
+	guint file_list_eviction_id; /* while nobody monitors the file list any more */
 	gboolean directory_loaded;
 	gboolean directory_loaded_sent_notification;
+	gboolean directory_load_succeeded; /* worth taking a snapshot of */
+	gboolean directory_load_is_fast; /* only NAUTILUS_FILE_FAST_ATTRIBUTES */
+	gboolean directory_load_skips_hidden; /* hidden files not loaded */
+	GHashTable *skipped_hidden_names; /* char * -> is a directory, of those */
 	DirectoryLoadState *directory_load_in_progress;
 
-	GList *pending_file_info; /* list of GnomeVFSFileInfo's that are pending */
-	int confirmed_file_count;
+	GPtrArray *pending_file_info; /* of GFileInfo *, in the order they were seen */
+	guint pending_file_info_offset; /* first one not dequeued yet */
+	guint load_generation; /* bumped each time the file list is (re)loaded */
+	int confirmed_file_count; /* files seen by the current load */
         guint dequeue_pending_idle_id;
 
 	GList *new_files_in_progress; /* list of NewFilesState * */
 
-	DirectoryCountState *count_in_progress;
+	GList *count_in_progress; /* list of DirectoryCountState * */
 
 	NautilusFile *deep_count_file;
 	DeepCountState *deep_count_in_progress;
 
 	MimeListState *mime_list_in_progress;
 
-	NautilusFile *get_info_file;
-	GetInfoState *get_info_in_progress;
+	GList *get_info_in_progress; /* list of GetInfoState * */
+	GList *get_info_changed_files; /* waiting to be announced, newest first */
+	guint get_info_changed_count;
 
-	NautilusFile *extension_info_file;
-	NautilusInfoProvider *extension_info_provider;
-	NautilusOperationHandle *extension_info_in_progress;
-	guint extension_info_idle;
+	GList *extension_info_in_progress; /* list of ExtensionInfoState * */
 
 	ThumbnailState *thumbnail_state;
 
@@ -150,12 +170,21 @@ void               nautilus_directory_monitor_add_internal            (NautilusD
 								       NautilusFileAttributes     attributes,
 								       NautilusDirectoryCallback  callback,
 								       gpointer                   callback_data);
+void               nautilus_directory_monitor_add_files_internal      (NautilusDirectory         *directory,
+								       GList                     *files,
+								       gconstpointer              client,
+								       gboolean                   monitor_hidden_files,
+								       NautilusFileAttributes     attributes);
 void               nautilus_directory_monitor_remove_internal         (NautilusDirectory         *directory,
 								       NautilusFile              *file,
 								       gconstpointer              client);
+void               nautilus_directory_monitor_remove_files_internal   (NautilusDirectory         *directory,
+								       GList                     *files,
+								       gconstpointer              client);
 void               nautilus_directory_get_info_for_new_files          (NautilusDirectory         *directory,
 								       GList                     *vfs_uris);
 NautilusFile *     nautilus_directory_get_existing_corresponding_file (NautilusDirectory         *directory);
+const char *       nautilus_directory_peek_uri_collation_key          (NautilusDirectory         *directory);
 void               nautilus_directory_invalidate_count_and_mime_list  (NautilusDirectory         *directory);
 gboolean           nautilus_directory_is_file_list_monitored          (NautilusDirectory         *directory);
 gboolean           nautilus_directory_is_anyone_monitoring_file_list  (NautilusDirectory         *directory);
@@ -169,6 +198,8 @@ void               nautilus_directory_cancel                          (NautilusD
 void               nautilus_async_destroying_file                     (NautilusFile              *file);
 void               nautilus_directory_force_reload_internal           (NautilusDirectory         *directory,
 								       NautilusFileAttributes     file_attributes);
+void               nautilus_directory_rescan_file_list                (NautilusDirectory         *directory);
+void               nautilus_directory_load_hidden_files               (NautilusDirectory         *directory);
 void               nautilus_directory_cancel_loading_file_attributes  (NautilusDirectory         *directory,
 								       NautilusFile              *file,
 								       NautilusFileAttributes     file_attributes);
@@ -218,6 +249,8 @@ void               nautilus_directory_add_file_to_work_queue          (NautilusD
 								       NautilusFile *file);
 void               nautilus_directory_remove_file_from_work_queue     (NautilusDirectory *directory,
 								       NautilusFile *file);
+void               nautilus_directory_prioritize_file_in_work_queue   (NautilusDirectory *directory,
+								       NautilusFile *file);
 
 
 /* debugging functions */
@@ -0,0 +1,535 @@
+/* nautilus-directory-reader.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-directory-reader.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gi18n.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_STATX
+#include <sys/sysmacros.h>
+#endif
+
+/* The fields which need more than the directory entry itself */
+#define STAT_FIELDS (NAUTILUS_DIRECTORY_READER_SIZE | \
+                     NAUTILUS_DIRECTORY_READER_TIMES | \
+                     NAUTILUS_DIRECTORY_READER_IDS | \
+                     NAUTILUS_DIRECTORY_READER_MODE)
+
+/* Don't bother with absurdly big .hidden files */
+#define MAX_HIDDEN_FILE_SIZE (1024 * 1024)
+
+struct NautilusDirectoryReader
+{
+    NautilusDirectoryReaderFields fields;
+    GCancellable *cancellable;
+
+    /* Local directories */
+    DIR *dir;
+    GHashTable *hidden_names;   /* The names listed in .hidden, or NULL */
+    gboolean utf8_filenames;
+    char *display_name;
+    char file_id[48];
+    char filesystem_id[24];
+
+    /* Other locations */
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+
+    NautilusDirectoryEntry entry;
+};
+
+typedef struct
+{
+    mode_t mode;
+    goffset size;
+    guint64 mtime;
+    guint64 atime;
+    guint64 inode;
+    guint64 device;
+    guint32 n_links;
+} LocalStat;
+
+static GFileType
+get_type_from_mode (mode_t mode)
+{
+    if (S_ISREG (mode))
+    {
+        return G_FILE_TYPE_REGULAR;
+    }
+    else if (S_ISDIR (mode))
+    {
+        return G_FILE_TYPE_DIRECTORY;
+    }
+    else if (S_ISLNK (mode))
+    {
+        return G_FILE_TYPE_SYMBOLIC_LINK;
+    }
+
+    return G_FILE_TYPE_SPECIAL;
+}
+
+static GFileType
+get_type_from_dirent (struct dirent *dirent)
+{
+    switch (dirent->d_type)
+    {
+        case DT_REG:
+        {
+            return G_FILE_TYPE_REGULAR;
+        }
+
+        case DT_DIR:
+        {
+            return G_FILE_TYPE_DIRECTORY;
+        }
+
+        case DT_LNK:
+        {
+            return G_FILE_TYPE_SYMBOLIC_LINK;
+        }
+
+        case DT_UNKNOWN:
+        {
+            return G_FILE_TYPE_UNKNOWN;
+        }
+
+        default:
+        {
+            return G_FILE_TYPE_SPECIAL;
+        }
+    }
+}
+
+/* Same as GIO, so that the same files are hidden either way. */
+static GHashTable *
+read_hidden_names (int dir_fd)
+{
+    GHashTable *hidden_names;
+    g_autofree char *contents = NULL;
+    g_auto (GStrv) lines = NULL;
+    struct stat st;
+    gssize n_read;
+    int fd;
+
+    fd = openat (dir_fd, ".hidden", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size > MAX_HIDDEN_FILE_SIZE)
+    {
+        close (fd);
+        return NULL;
+    }
+
+    contents = g_malloc (st.st_size + 1);
+    n_read = read (fd, contents, st.st_size);
+    close (fd);
+    if (n_read < 0)
+    {
+        return NULL;
+    }
+    contents[n_read] = '\0';
+
+    hidden_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    lines = g_strsplit (contents, "\n", -1);
+    for (guint i = 0; lines[i] != NULL; i++)
+    {
+        if (*lines[i] != '\0')
+        {
+            g_hash_table_add (hidden_names, g_steal_pointer (&lines[i]));
+        }
+    }
+
+    return hidden_names;
+}
+
+static gboolean
+stat_child (NautilusDirectoryReader *reader,
+            const char              *name,
+            LocalStat               *local_stat)
+{
+#ifdef HAVE_STATX
+    struct statx stx;
+    unsigned int mask;
+
+    mask = STATX_TYPE;
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_MODE)
+    {
+        mask |= STATX_MODE;
+    }
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_SIZE)
+    {
+        mask |= STATX_SIZE;
+    }
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_TIMES)
+    {
+        mask |= STATX_MTIME | STATX_ATIME;
+    }
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_IDS)
+    {
+        mask |= STATX_INO | STATX_NLINK;
+    }
+
+    if (statx (dirfd (reader->dir), name,
+               AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &stx) != 0)
+    {
+        return FALSE;
+    }
+
+    local_stat->mode = stx.stx_mode;
+    local_stat->size = stx.stx_size;
+    local_stat->mtime = stx.stx_mtime.tv_sec;
+    local_stat->atime = stx.stx_atime.tv_sec;
+    local_stat->inode = stx.stx_ino;
+    local_stat->device = makedev (stx.stx_dev_major, stx.stx_dev_minor);
+    local_stat->n_links = stx.stx_nlink;
+#else
+    struct stat st;
+
+    if (fstatat (dirfd (reader->dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        return FALSE;
+    }
+
+    local_stat->mode = st.st_mode;
+    local_stat->size = st.st_size;
+    local_stat->mtime = st.st_mtime;
+    local_stat->atime = st.st_atime;
+    local_stat->inode = st.st_ino;
+    local_stat->device = st.st_dev;
+    local_stat->n_links = st.st_nlink;
+#endif
+
+    return TRUE;
+}
+
+/* Returns FALSE if the child is gone, or on error. */
+static gboolean
+read_local_entry (NautilusDirectoryReader  *reader,
+                  struct dirent            *dirent,
+                  GError                  **error)
+{
+    NautilusDirectoryEntry *entry = &reader->entry;
+    const char *name = dirent->d_name;
+    GFileType type;
+    LocalStat st;
+    int errsv;
+
+    memset (entry, 0, sizeof (NautilusDirectoryEntry));
+    entry->name = name;
+
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_HIDDEN)
+    {
+        entry->is_hidden = name[0] == '.' ||
+                           (reader->hidden_names != NULL &&
+                            g_hash_table_contains (reader->hidden_names, name));
+        entry->is_backup = g_str_has_suffix (name, "~");
+    }
+
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_DISPLAY_NAME)
+    {
+        g_clear_pointer (&reader->display_name, g_free);
+        if (reader->utf8_filenames && g_utf8_validate (name, -1, NULL))
+        {
+            entry->display_name = name;
+        }
+        else
+        {
+            reader->display_name = g_filename_display_name (name);
+            entry->display_name = reader->display_name;
+        }
+    }
+
+    type = get_type_from_dirent (dirent);
+    if ((reader->fields & STAT_FIELDS) == 0 &&
+        ((reader->fields & NAUTILUS_DIRECTORY_READER_TYPE) == 0 || type != G_FILE_TYPE_UNKNOWN))
+    {
+        entry->type = type;
+        return TRUE;
+    }
+
+    if (!stat_child (reader, name, &st))
+    {
+        errsv = errno;
+        /* Removed since the directory was read, as GIO does */
+        if (errsv != ENOENT)
+        {
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                         _("Error when getting information for file “%s”: %s"),
+                         name, g_strerror (errsv));
+        }
+        return FALSE;
+    }
+
+    entry->type = get_type_from_mode (st.mode);
+    entry->size = st.size;
+    entry->mtime = st.mtime;
+    entry->atime = st.atime;
+    entry->inode = st.inode;
+    entry->device = st.device;
+    entry->n_links = st.n_links;
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_MODE)
+    {
+        entry->mode = st.mode;
+    }
+
+    if (reader->fields & NAUTILUS_DIRECTORY_READER_IDS)
+    {
+        g_snprintf (reader->file_id, sizeof (reader->file_id),
+                    "l%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT, st.device, st.inode);
+        g_snprintf (reader->filesystem_id, sizeof (reader->filesystem_id),
+                    "l%" G_GUINT64_FORMAT, st.device);
+        entry->file_id = reader->file_id;
+        entry->filesystem_id = reader->filesystem_id;
+    }
+
+    return TRUE;
+}
+
+static const NautilusDirectoryEntry *
+read_local_next (NautilusDirectoryReader  *reader,
+                 GError                  **error)
+{
+    struct dirent *dirent;
+    GError *entry_error = NULL;
+    int errsv;
+
+    while (TRUE)
+    {
+        if (g_cancellable_set_error_if_cancelled (reader->cancellable, error))
+        {
+            return NULL;
+        }
+
+        errno = 0;
+        dirent = readdir (reader->dir);
+        if (dirent == NULL)
+        {
+            errsv = errno;
+            if (errsv != 0)
+            {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             _("Error while reading the directory: %s"),
+                             g_strerror (errsv));
+            }
+            return NULL;
+        }
+
+        if (strcmp (dirent->d_name, ".") == 0 || strcmp (dirent->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        if (read_local_entry (reader, dirent, &entry_error))
+        {
+            return &reader->entry;
+        }
+
+        if (entry_error != NULL)
+        {
+            g_propagate_error (error, entry_error);
+            return NULL;
+        }
+    }
+}
+
+static char *
+get_attributes (NautilusDirectoryReaderFields fields)
+{
+    GString *attributes;
+
+    attributes = g_string_new (G_FILE_ATTRIBUTE_STANDARD_NAME);
+    if (fields & NAUTILUS_DIRECTORY_READER_TYPE)
+    {
+        g_string_append (attributes, "," G_FILE_ATTRIBUTE_STANDARD_TYPE);
+    }
+    if (fields & NAUTILUS_DIRECTORY_READER_HIDDEN)
+    {
+        g_string_append (attributes,
+                         "," G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN
+                         "," G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP);
+    }
+    if (fields & NAUTILUS_DIRECTORY_READER_DISPLAY_NAME)
+    {
+        g_string_append (attributes, "," G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
+    }
+    if (fields & NAUTILUS_DIRECTORY_READER_SIZE)
+    {
+        g_string_append (attributes, "," G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    }
+    if (fields & NAUTILUS_DIRECTORY_READER_TIMES)
+    {
+        g_string_append (attributes,
+                         "," G_FILE_ATTRIBUTE_TIME_MODIFIED
+                         "," G_FILE_ATTRIBUTE_TIME_ACCESS);
+    }
+    if (fields & NAUTILUS_DIRECTORY_READER_IDS)
+    {
+        g_string_append (attributes,
+                         "," G_FILE_ATTRIBUTE_UNIX_INODE
+                         "," G_FILE_ATTRIBUTE_UNIX_DEVICE
+                         "," G_FILE_ATTRIBUTE_UNIX_NLINK
+                         "," G_FILE_ATTRIBUTE_ID_FILE
+                         "," G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+    }
+    if (fields & NAUTILUS_DIRECTORY_READER_MODE)
+    {
+        g_string_append (attributes, "," G_FILE_ATTRIBUTE_UNIX_MODE);
+    }
+
+    return g_string_free (attributes, FALSE);
+}
+
+static const NautilusDirectoryEntry *
+read_enumerator_next (NautilusDirectoryReader  *reader,
+                      GError                  **error)
+{
+    NautilusDirectoryEntry *entry = &reader->entry;
+    GFileInfo *info;
+
+    g_clear_object (&reader->info);
+    info = g_file_enumerator_next_file (reader->enumerator, reader->cancellable, error);
+    if (info == NULL)
+    {
+        return NULL;
+    }
+    reader->info = info;
+
+    memset (entry, 0, sizeof (NautilusDirectoryEntry));
+    entry->name = g_file_info_get_name (info);
+    entry->display_name = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
+    entry->type = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_STANDARD_TYPE);
+    entry->is_hidden = g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN);
+    entry->is_backup = g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP);
+    entry->size = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    entry->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    entry->atime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_ACCESS);
+    entry->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    entry->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+    entry->n_links = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK);
+    entry->file_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+    entry->filesystem_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+    entry->mode = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+
+    return entry;
+}
+
+NautilusDirectoryReader *
+nautilus_directory_reader_new (GFile                         *location,
+                               NautilusDirectoryReaderFields  fields,
+                               GCancellable                  *cancellable,
+                               GError                       **error)
+{
+    NautilusDirectoryReader *reader;
+    g_autofree char *attributes = NULL;
+    const char *path;
+    int fd, errsv;
+
+    reader = g_new0 (NautilusDirectoryReader, 1);
+    reader->fields = fields;
+    reader->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+
+    path = g_file_has_uri_scheme (location, "file") ? g_file_peek_path (location) : NULL;
+    if (path != NULL)
+    {
+        fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            reader->dir = fdopendir (fd);
+            if (reader->dir == NULL)
+            {
+                errsv = errno;
+                close (fd);
+                errno = errsv;
+            }
+        }
+
+        if (reader->dir == NULL)
+        {
+            g_autofree char *display_name = NULL;
+
+            errsv = errno;
+            display_name = g_filename_display_name (path);
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                         _("Error opening directory “%s”: %s"),
+                         display_name, g_strerror (errsv));
+            nautilus_directory_reader_free (reader);
+            return NULL;
+        }
+
+        if (fields & NAUTILUS_DIRECTORY_READER_HIDDEN)
+        {
+            reader->hidden_names = read_hidden_names (dirfd (reader->dir));
+        }
+        reader->utf8_filenames = g_get_filename_charsets (NULL);
+
+        return reader;
+    }
+
+    attributes = get_attributes (fields);
+    reader->enumerator = g_file_enumerate_children (location, attributes,
+                                                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                    cancellable, error);
+    if (reader->enumerator == NULL)
+    {
+        nautilus_directory_reader_free (reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+const NautilusDirectoryEntry *
+nautilus_directory_reader_next (NautilusDirectoryReader  *reader,
+                                GError                  **error)
+{
+    if (reader->dir != NULL)
+    {
+        return read_local_next (reader, error);
+    }
+
+    return read_enumerator_next (reader, error);
+}
+
+void
+nautilus_directory_reader_free (NautilusDirectoryReader *reader)
+{
+    if (reader->dir != NULL)
+    {
+        closedir (reader->dir);
+    }
+    g_clear_pointer (&reader->hidden_names, g_hash_table_destroy);
+    g_free (reader->display_name);
+    g_clear_object (&reader->info);
+    g_clear_object (&reader->enumerator);
+    g_clear_object (&reader->cancellable);
+
+    g_free (reader);
+}
+
+int
+nautilus_directory_reader_get_fd (NautilusDirectoryReader *reader)
+{
+    return reader->dir != NULL ? dirfd (reader->dir) : -1;
+}
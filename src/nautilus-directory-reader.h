@@ -0,0 +1,78 @@
+/* nautilus-directory-reader.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* A directory reader lists the children of a directory, without following
+ * symbolic links, for the crawls that only need a few fields of each
+ * child and go through a lot of them.
+ *
+ * Local directories are read with the system calls directly, which only
+ * stat the children when a field needs it and don't allocate anything
+ * per child. Other locations go through a GFileEnumerator.
+ */
+
+typedef enum
+{
+    NAUTILUS_DIRECTORY_READER_TYPE = 1 << 0,
+    /* is_hidden and is_backup */
+    NAUTILUS_DIRECTORY_READER_HIDDEN = 1 << 1,
+    NAUTILUS_DIRECTORY_READER_DISPLAY_NAME = 1 << 2,
+    NAUTILUS_DIRECTORY_READER_SIZE = 1 << 3,
+    /* mtime and atime */
+    NAUTILUS_DIRECTORY_READER_TIMES = 1 << 4,
+    /* inode, device, n_links, file_id and filesystem_id */
+    NAUTILUS_DIRECTORY_READER_IDS = 1 << 5,
+    NAUTILUS_DIRECTORY_READER_MODE = 1 << 6,
+} NautilusDirectoryReaderFields;
+
+/* Only the fields asked for are set. The strings belong to the reader and
+ * are only valid until the next entry. */
+typedef struct
+{
+    const char *name;
+    const char *display_name;
+    GFileType type;
+    gboolean is_hidden;
+    gboolean is_backup;
+    goffset size;
+    guint64 mtime;
+    guint64 atime;
+    guint64 inode;
+    guint32 device;
+    guint32 n_links;            /* 0 when unknown */
+    guint32 mode;               /* as G_FILE_ATTRIBUTE_UNIX_MODE, 0 when unknown */
+    const char *file_id;        /* as G_FILE_ATTRIBUTE_ID_FILE */
+    const char *filesystem_id;  /* as G_FILE_ATTRIBUTE_ID_FILESYSTEM */
+} NautilusDirectoryEntry;
+
+typedef struct NautilusDirectoryReader NautilusDirectoryReader;
+
+NautilusDirectoryReader      *nautilus_directory_reader_new  (GFile                         *location,
+                                                              NautilusDirectoryReaderFields  fields,
+                                                              GCancellable                  *cancellable,
+                                                              GError                       **error);
+/* Returns NULL once all the children were listed, or on error. */
+const NautilusDirectoryEntry *nautilus_directory_reader_next (NautilusDirectoryReader       *reader,
+                                                              GError                       **error);
+void                          nautilus_directory_reader_free (NautilusDirectoryReader       *reader);
+/* The descriptor of a local directory, to work on the children with the
+ * *at() system calls, or -1 for other locations. */
+int                           nautilus_directory_reader_get_fd (NautilusDirectoryReader     *reader);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusDirectoryReader, nautilus_directory_reader_free)
@@ -0,0 +1,323 @@
+/* nautilus-directory-snapshot.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-directory-snapshot.h"
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "nautilus-file-private.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_ASYNC_JOBS
+#include "nautilus-debug.h"
+
+/* Bump this whenever the format below changes. */
+#define SNAPSHOT_VERSION 2
+
+/* version, directory mtime, real time when taken, and for every file:
+ * name, type, is hidden, size, mtime, MIME type and serialized icon.
+ */
+#define SNAPSHOT_FORMAT "(uxxa(subxxss))"
+#define SNAPSHOT_ENTRY_FORMAT "(subxxss)"
+
+static char *
+get_snapshot_path (GFile *location)
+{
+    g_autofree char *uri = NULL;
+    g_autofree char *checksum = NULL;
+
+    uri = g_file_get_uri (location);
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "snapshots",
+                             checksum, NULL);
+}
+
+static GFileInfo *
+snapshot_entry_to_info (const char *name,
+                        guint32     type,
+                        gboolean    is_hidden,
+                        gint64      size,
+                        gint64      mtime,
+                        const char *mime_type,
+                        const char *icon_string)
+{
+    GFileInfo *info;
+    g_autofree char *display_name = NULL;
+    g_autoptr (GIcon) icon = NULL;
+
+    info = g_file_info_new ();
+
+    display_name = g_filename_display_name (name);
+    g_file_info_set_name (info, name);
+    g_file_info_set_display_name (info, display_name);
+    g_file_info_set_file_type (info, type);
+    g_file_info_set_is_hidden (info, is_hidden);
+    if (size >= 0)
+    {
+        g_file_info_set_size (info, size);
+    }
+    if (mtime > 0)
+    {
+        g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+    }
+    if (*mime_type != '\0')
+    {
+        g_file_info_set_content_type (info, mime_type);
+    }
+    if (*icon_string != '\0')
+    {
+        icon = g_icon_new_for_string (icon_string, NULL);
+        if (icon != NULL)
+        {
+            g_file_info_set_icon (info, icon);
+        }
+    }
+
+    return info;
+}
+
+GList *
+nautilus_directory_snapshot_load (GFile  *location,
+                                  time_t  directory_mtime,
+                                  guint   max_age)
+{
+    g_autofree char *path = NULL;
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (GVariant) snapshot = NULL;
+    g_autoptr (GVariantIter) iter = NULL;
+    guint32 version;
+    gint64 stamp, taken;
+    gboolean is_recent;
+    const char *name, *mime_type, *icon_string;
+    guint32 type;
+    gboolean is_hidden;
+    gint64 size, mtime;
+    GList *infos;
+
+    if (directory_mtime == 0 && max_age == 0)
+    {
+        return NULL;
+    }
+
+    path = get_snapshot_path (location);
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        return NULL;
+    }
+
+    bytes = g_mapped_file_get_bytes (mapped_file);
+    /* Not trusted, so that a corrupted file can't do any harm. */
+    snapshot = g_variant_new_from_bytes (G_VARIANT_TYPE (SNAPSHOT_FORMAT), bytes, FALSE);
+
+    g_variant_get (snapshot, SNAPSHOT_FORMAT, &version, &stamp, &taken, &iter);
+    is_recent = max_age > 0 &&
+                g_get_real_time () - taken <= (gint64) max_age * G_USEC_PER_SEC;
+    if (version != SNAPSHOT_VERSION ||
+        !((directory_mtime != 0 && stamp == directory_mtime) || is_recent))
+    {
+        DEBUG ("Directory snapshot %s is out of date", path);
+        return NULL;
+    }
+
+    infos = NULL;
+    while (g_variant_iter_next (iter, "(&subxx&s&s)",
+                                &name, &type, &is_hidden, &size, &mtime,
+                                &mime_type, &icon_string))
+    {
+        infos = g_list_prepend (infos,
+                                snapshot_entry_to_info (name, type, is_hidden,
+                                                        size, mtime,
+                                                        mime_type, icon_string));
+    }
+
+    DEBUG ("Loaded %u files from directory snapshot %s",
+           g_list_length (infos), path);
+
+    return g_list_reverse (infos);
+}
+
+/* The name gvfsd-recent gives to the recent file of @uri */
+static char *
+get_recent_name (const char *uri)
+{
+    return g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+}
+
+/* Checked once with a recent file which is local and still there, as the
+ * others aren't listed, or are slow to look up. */
+static gboolean
+recent_names_are_known (GList *items)
+{
+    static enum { UNKNOWN, KNOWN, NOT_KNOWN } names = UNKNOWN;
+
+    for (GList *l = items; l != NULL && names == UNKNOWN; l = l->next)
+    {
+        GtkRecentInfo *recent_info = l->data;
+        g_autofree char *name = NULL;
+        g_autoptr (GFile) recent = NULL;
+        g_autoptr (GFile) child = NULL;
+        g_autoptr (GFileInfo) info = NULL;
+
+        if (!gtk_recent_info_is_local (recent_info) ||
+            !gtk_recent_info_exists (recent_info))
+        {
+            continue;
+        }
+
+        name = get_recent_name (gtk_recent_info_get_uri (recent_info));
+        recent = g_file_new_for_uri ("recent:///");
+        child = g_file_get_child (recent, name);
+        info = g_file_query_info (child, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+        names = info != NULL ? KNOWN : NOT_KNOWN;
+        DEBUG ("Recent files are %s", names == KNOWN ? "named as expected" : "not named as expected");
+    }
+
+    return names == KNOWN;
+}
+
+GList *
+nautilus_directory_snapshot_load_recent (void)
+{
+    GList *items;
+    GList *infos;
+
+    items = gtk_recent_manager_get_items (gtk_recent_manager_get_default ());
+    if (!recent_names_are_known (items))
+    {
+        g_list_free_full (items, (GDestroyNotify) gtk_recent_info_unref);
+        return NULL;
+    }
+
+    infos = NULL;
+    for (GList *l = items; l != NULL; l = l->next)
+    {
+        GtkRecentInfo *recent_info = l->data;
+        const char *uri = gtk_recent_info_get_uri (recent_info);
+        const char *mime_type = gtk_recent_info_get_mime_type (recent_info);
+        g_autofree char *name = NULL;
+        GFileInfo *info;
+
+        if (mime_type == NULL)
+        {
+            mime_type = "";
+        }
+
+        name = get_recent_name (uri);
+        info = snapshot_entry_to_info (name,
+                                       g_str_equal (mime_type, "inode/directory") ?
+                                       G_FILE_TYPE_DIRECTORY : G_FILE_TYPE_REGULAR,
+                                       FALSE, -1, 0, mime_type, "");
+        g_file_info_set_display_name (info, gtk_recent_info_get_display_name (recent_info));
+        if (*mime_type != '\0')
+        {
+            g_autoptr (GIcon) icon = g_content_type_get_icon (mime_type);
+
+            g_file_info_set_icon (info, icon);
+        }
+        g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_TARGET_URI, uri);
+        g_file_info_set_attribute_int64 (info, G_FILE_ATTRIBUTE_RECENT_MODIFIED,
+                                         gtk_recent_info_get_modified (recent_info));
+
+        infos = g_list_prepend (infos, info);
+    }
+    g_list_free_full (items, (GDestroyNotify) gtk_recent_info_unref);
+
+    DEBUG ("Loaded %u recent files", g_list_length (infos));
+
+    return g_list_reverse (infos);
+}
+
+static void
+snapshot_saved_callback (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+    g_autoptr (GError) error = NULL;
+
+    if (!g_file_replace_contents_finish (G_FILE (source_object), res, NULL, &error))
+    {
+        DEBUG ("Failed to save directory snapshot: %s", error->message);
+    }
+}
+
+void
+nautilus_directory_snapshot_save (GFile  *location,
+                                  time_t  directory_mtime,
+                                  GList  *files)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *dirname = NULL;
+    g_autoptr (GFile) snapshot_file = NULL;
+    g_autoptr (GVariant) snapshot = NULL;
+    g_autoptr (GBytes) bytes = NULL;
+    GVariantBuilder builder;
+    NautilusFile *file;
+    g_autofree char *icon_string = NULL;
+    GList *node;
+
+    path = get_snapshot_path (location);
+    dirname = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dirname, 0700) != 0)
+    {
+        return;
+    }
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" SNAPSHOT_ENTRY_FORMAT));
+    for (node = files; node != NULL; node = node->next)
+    {
+        file = NAUTILUS_FILE (node->data);
+
+        if (file->details->is_gone || !file->details->got_file_info)
+        {
+            continue;
+        }
+
+        g_clear_pointer (&icon_string, g_free);
+        if (file->details->icon != NULL)
+        {
+            icon_string = g_icon_to_string (file->details->icon);
+        }
+
+        g_variant_builder_add (&builder, SNAPSHOT_ENTRY_FORMAT,
+                               file->details->name,
+                               file->details->type,
+                               (gboolean) file->details->is_hidden,
+                               (gint64) file->details->size,
+                               (gint64) file->details->mtime,
+                               file->details->mime_type != NULL ? file->details->mime_type : "",
+                               icon_string != NULL ? icon_string : "");
+    }
+
+    snapshot = g_variant_ref_sink (g_variant_new ("(uxx@a(subxxss))",
+                                                  SNAPSHOT_VERSION,
+                                                  (gint64) directory_mtime,
+                                                  g_get_real_time (),
+                                                  g_variant_builder_end (&builder)));
+    bytes = g_variant_get_data_as_bytes (snapshot);
+
+    snapshot_file = g_file_new_for_path (path);
+    g_file_replace_contents_bytes_async (snapshot_file, bytes,
+                                         NULL, FALSE,
+                                         G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+                                         NULL,
+                                         snapshot_saved_callback, NULL);
+}
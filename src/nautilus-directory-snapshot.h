@@ -0,0 +1,48 @@
+/* nautilus-directory-snapshot.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <time.h>
+
+/* A snapshot is a cached copy of the basic information about the files
+ * of a directory, stored on disk so that a big directory can be shown
+ * right away on re-open while the real enumeration catches up.
+ *
+ * A snapshot is valid for the modification time of the directory it was
+ * taken for. Remote directories, whose modification time is often not
+ * known at that point, can use a snapshot up to a maximum age instead.
+ */
+
+/* Don't bother taking snapshots of directories smaller than this. */
+#define NAUTILUS_DIRECTORY_SNAPSHOT_MIN_FILES 500
+
+/* Returns a list of GFileInfo, or NULL if there is no valid snapshot.
+ * With a @max_age in seconds, a snapshot is also valid when taken no
+ * longer ago than that, whatever the modification time. */
+GList *nautilus_directory_snapshot_load  (GFile  *location,
+                                          time_t  directory_mtime,
+                                          guint   max_age);
+/* Returns a list of GFileInfo for the recent:/// files, made up from what
+ * GtkRecentManager knows of them, without looking at their targets, or
+ * NULL when gvfsd-recent doesn't name them as expected. */
+GList *nautilus_directory_snapshot_load_recent (void);
+/* Takes a snapshot of a list of NautilusFile, asynchronously. The
+ * @directory_mtime can be 0 when unknown. */
+void   nautilus_directory_snapshot_save  (GFile  *location,
+                                          time_t  directory_mtime,
+                                          GList  *files);
@@ -25,6 +25,7 @@
 #include <eel/eel-string.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
+#include <string.h>
 
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
@@ -32,6 +33,7 @@
 #include "nautilus-file-private.h"
 #include "nautilus-file-queue.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-filename-index.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-lib-self-check-functions.h"
 #include "nautilus-metadata.h"
@@ -210,9 +212,11 @@ nautilus_directory_finalize (GObject *object)
     {
         g_object_unref (directory->details->location);
     }
+    g_free (directory->details->uri_collation_key);
 
     g_assert (directory->details->file_list == NULL);
     g_hash_table_destroy (directory->details->file_hash);
+    g_hash_table_destroy (directory->details->skipped_hidden_names);
 
     nautilus_file_queue_destroy (directory->details->high_priority_queue);
     nautilus_file_queue_destroy (directory->details->low_priority_queue);
@@ -220,7 +224,10 @@ nautilus_directory_finalize (GObject *object)
     g_assert (directory->details->directory_load_in_progress == NULL);
     g_assert (directory->details->count_in_progress == NULL);
     g_assert (directory->details->dequeue_pending_idle_id == 0);
-    g_list_free_full (directory->details->pending_file_info, g_object_unref);
+    /* Drained by nautilus_directory_cancel(). */
+    g_assert (directory->details->pending_file_info->len == 0);
+    g_ptr_array_unref (directory->details->pending_file_info);
+    g_array_unref (directory->details->job_start_times);
 
     G_OBJECT_CLASS (nautilus_directory_parent_class)->finalize (object);
 }
@@ -336,16 +343,54 @@ nautilus_directory_class_init (NautilusDirectoryClass *klass)
     g_object_class_install_properties (object_class, NUM_PROPERTIES, properties);
 }
 
+static inline guint64
+name_hash_mix (guint64 hash,
+               guint64 word)
+{
+    hash = (hash ^ word) * G_GUINT64_CONSTANT (0x9fb21c651e98df25);
+    return hash ^ (hash >> 29);
+}
+
+/* Hashes names 8 bytes at a time: the file hash is looked up for every
+ * file enumerated, and names in big directories tend to be long. */
+static guint
+name_hash (gconstpointer key)
+{
+    const char *name = key;
+    gsize length;
+    guint64 hash, word;
+
+    length = strlen (name);
+    hash = G_GUINT64_CONSTANT (0x9e3779b97f4a7c15) ^ length;
+
+    for (; length >= sizeof (word); name += sizeof (word), length -= sizeof (word))
+    {
+        memcpy (&word, name, sizeof (word));
+        hash = name_hash_mix (hash, word);
+    }
+
+    word = 0;
+    memcpy (&word, name, length);
+    hash = name_hash_mix (hash, word);
+
+    return (guint) (hash ^ (hash >> 32));
+}
+
 static void
 nautilus_directory_init (NautilusDirectory *directory)
 {
     directory->details = G_TYPE_INSTANCE_GET_PRIVATE ((directory), NAUTILUS_TYPE_DIRECTORY, NautilusDirectoryDetails);
-    directory->details->file_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                           g_free, NULL);
+    directory->details->file_hash = g_hash_table_new_full (name_hash, g_str_equal,
+                                                           (GDestroyNotify) g_ref_string_release,
+                                                           NULL);
     directory->details->high_priority_queue = nautilus_file_queue_new ();
     directory->details->low_priority_queue = nautilus_file_queue_new ();
     directory->details->extension_queue = nautilus_file_queue_new ();
     directory->details->monitor_table = g_hash_table_new (NULL, NULL);
+    directory->details->job_start_times = g_array_new (FALSE, FALSE, sizeof (AsyncJobStart));
+    directory->details->pending_file_info = g_ptr_array_new ();
+    directory->details->skipped_hidden_names = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                                      g_free, NULL);
 }
 
 NautilusDirectory *
@@ -389,13 +434,113 @@ collect_all_directories (gpointer key,
     *dirs = g_list_prepend (*dirs, nautilus_directory_ref (directory));
 }
 
+typedef struct
+{
+    NautilusDirectory *directory;
+    guint n_files;
+    gsize bytes;
+} DirectoryMemoryUsage;
+
+static gint
+compare_memory_usage (gconstpointer a,
+                      gconstpointer b)
+{
+    const DirectoryMemoryUsage *usage_a = a;
+    const DirectoryMemoryUsage *usage_b = b;
+
+    if (usage_a->bytes != usage_b->bytes)
+    {
+        return usage_a->bytes > usage_b->bytes ? -1 : 1;
+    }
+
+    return 0;
+}
+
+char *
+nautilus_directory_get_memory_stats (void)
+{
+    g_autoptr (GArray) usages = NULL;
+    g_autofree char *total_size = NULL;
+    GString *string;
+    GHashTableIter iter;
+    NautilusDirectory *directory;
+    gsize total_bytes;
+    guint total_files;
+
+    string = g_string_new (NULL);
+
+    if (directories == NULL)
+    {
+        return g_string_free (string, FALSE);
+    }
+
+    usages = g_array_sized_new (FALSE, FALSE, sizeof (DirectoryMemoryUsage),
+                                g_hash_table_size (directories));
+
+    g_hash_table_iter_init (&iter, directories);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &directory))
+    {
+        DirectoryMemoryUsage usage;
+
+        usage.directory = directory;
+        usage.n_files = 0;
+        usage.bytes = sizeof (NautilusDirectory) + sizeof (NautilusDirectoryDetails);
+        if (directory->details->uri_collation_key != NULL)
+        {
+            usage.bytes += strlen (directory->details->uri_collation_key) + 1;
+        }
+
+        for (GList *l = directory->details->file_list; l != NULL; l = l->next)
+        {
+            usage.n_files++;
+            /* The list link, and the hash table entry of the file */
+            usage.bytes += sizeof (GList) + 3 * sizeof (gpointer);
+            usage.bytes += nautilus_file_get_memory_usage (l->data);
+        }
+
+        g_array_append_val (usages, usage);
+    }
+
+    g_array_sort (usages, compare_memory_usage);
+
+    total_bytes = 0;
+    total_files = 0;
+    for (guint i = 0; i < usages->len; i++)
+    {
+        DirectoryMemoryUsage *usage = &g_array_index (usages, DirectoryMemoryUsage, i);
+        g_autofree char *size = NULL;
+        g_autofree char *uri = NULL;
+
+        size = g_format_size (usage->bytes);
+        uri = nautilus_directory_get_uri (usage->directory);
+        g_string_append_printf (string, "%10s %8u files %3u monitors %s\n",
+                                size, usage->n_files,
+                                usage->directory->details->monitor_table != NULL ?
+                                g_hash_table_size (usage->directory->details->monitor_table) : 0,
+                                uri);
+
+        total_bytes += usage->bytes;
+        total_files += usage->n_files;
+    }
+
+    total_size = g_format_size (total_bytes);
+    g_string_append_printf (string, "%10s %8u files in %u directories\n",
+                            total_size, total_files, usages->len);
+
+    return g_string_free (string, FALSE);
+}
+
 static void
 filtering_changed_callback (gpointer callback_data)
 {
     g_autolist (NautilusDirectory) dirs = NULL;
+    gboolean show_hidden_files;
 
     g_assert (callback_data == NULL);
 
+    show_hidden_files = g_settings_get_boolean (gtk_filechooser_preferences,
+                                                NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES);
+
     dirs = NULL;
     g_hash_table_foreach (directories, collect_all_directories, &dirs);
 
@@ -409,6 +554,11 @@ filtering_changed_callback (gpointer callback_data)
         directory = NAUTILUS_DIRECTORY (l->data);
 
         nautilus_directory_invalidate_count_and_mime_list (directory);
+
+        if (show_hidden_files)
+        {
+            nautilus_directory_load_hidden_files (directory);
+        }
     }
 }
 
@@ -866,33 +1016,33 @@ add_to_hash_table (NautilusDirectory *directory,
                    NautilusFile      *file,
                    GList             *node)
 {
-    gchar *name;
+    GRefString *name;
 
-    name = nautilus_file_get_name (file);
+    name = file->details->name;
 
     g_assert (name != NULL);
     g_assert (node != NULL);
     g_assert (g_hash_table_lookup (directory->details->file_hash,
                                    name) == NULL);
-    g_hash_table_insert (directory->details->file_hash, name, node);
+    /* The key is the name of the file, shared rather than copied */
+    g_hash_table_insert (directory->details->file_hash,
+                         g_ref_string_acquire (name), node);
 }
 
 static GList *
 extract_from_hash_table (NautilusDirectory *directory,
                          NautilusFile      *file)
 {
-    g_autofree gchar *name = NULL;
     GList *node;
 
-    name = nautilus_file_get_name (file);
-    if (name == NULL)
+    if (file->details->name == NULL)
     {
         return NULL;
     }
 
     /* Find the list node in the hash table. */
-    node = g_hash_table_lookup (directory->details->file_hash, name);
-    g_hash_table_remove (directory->details->file_hash, name);
+    node = g_hash_table_lookup (directory->details->file_hash, file->details->name);
+    g_hash_table_remove (directory->details->file_hash, file->details->name);
 
     return node;
 }
@@ -914,6 +1064,7 @@ nautilus_directory_add_file (NautilusDirectory *directory,
     /* Add to hash table. */
     add_to_hash_table (directory, file, node);
 
+    file->details->load_generation = directory->details->load_generation;
     directory->details->confirmed_file_count++;
 
     add_to_work_queue = FALSE;
@@ -958,7 +1109,7 @@ nautilus_directory_remove_file (NautilusDirectory *directory,
 
     nautilus_directory_remove_file_from_work_queue (directory, file);
 
-    if (!file->details->unconfirmed)
+    if (file->details->load_generation == directory->details->load_generation)
     {
         directory->details->confirmed_file_count--;
     }
@@ -1099,6 +1250,24 @@ get_parent_directory_if_exists (GFile *location)
     return NULL;
 }
 
+/* The hidden file at @location, if it was not loaded, is no longer there */
+static void
+forget_skipped_hidden_name (GFile *location)
+{
+    NautilusDirectory *directory;
+    g_autofree char *name = NULL;
+
+    directory = get_parent_directory_if_exists (location);
+    if (directory == NULL)
+    {
+        return;
+    }
+
+    name = g_file_get_basename (location);
+    g_hash_table_remove (directory->details->skipped_hidden_names, name);
+    nautilus_directory_unref (directory);
+}
+
 static void
 hash_table_list_prepend (GHashTable    *table,
                          gconstpointer  key,
@@ -1232,6 +1401,8 @@ nautilus_directory_notify_files_added (GList *files)
 
     nautilus_profile_start (NULL);
 
+    nautilus_filename_index_notify_files_added (files);
+
     /* Make a list of added files in each directory. */
     added_lists = g_hash_table_new (NULL, NULL);
 
@@ -1341,6 +1512,7 @@ nautilus_directory_notify_files_changed (GList *files)
              * a changed signal.
              */
             file->details->file_info_is_up_to_date = FALSE;
+            file->details->extended_info_failed = FALSE;
             nautilus_file_invalidate_extension_info_internal (file);
 
             hash_table_list_prepend (changed_lists, directory, file);
@@ -1361,6 +1533,8 @@ nautilus_directory_notify_files_removed (GList *files)
     NautilusFile *file;
     GFile *location;
 
+    nautilus_filename_index_notify_files_removed (files);
+
     /* Make a list of changed files in each directory. */
     changed_lists = g_hash_table_new (NULL, NULL);
 
@@ -1374,6 +1548,8 @@ nautilus_directory_notify_files_removed (GList *files)
 
         location = p->data;
 
+        forget_skipped_hidden_name (location);
+
         /* Update file count for parent directory if anyone might care. */
         directory = get_parent_directory_if_exists (location);
         if (directory != NULL)
@@ -1409,19 +1585,36 @@ static void
 set_directory_location (NautilusDirectory *directory,
                         GFile             *location)
 {
+    g_autofree char *uri = NULL;
+
     if (directory->details->location)
     {
         g_object_unref (directory->details->location);
     }
     directory->details->location = g_object_ref (location);
 
+    /* Computed right away rather than on demand, since files of the
+     * directory may be sorted from several threads at once.
+     */
+    uri = g_file_get_uri (location);
+    g_free (directory->details->uri_collation_key);
+    directory->details->uri_collation_key = nautilus_collate_key_for_filename (uri);
+
     g_object_notify_by_pspec (G_OBJECT (directory), properties[PROP_LOCATION]);
 }
 
+const char *
+nautilus_directory_peek_uri_collation_key (NautilusDirectory *directory)
+{
+    return directory->details->uri_collation_key;
+}
+
 static void
 change_directory_location (NautilusDirectory *directory,
                            GFile             *new_location)
 {
+    GList *node;
+
     /* I believe it's impossible for a self-owned file/directory
      * to be moved. But if that did somehow happen, this function
      * wouldn't do enough to handle it.
@@ -1436,6 +1629,12 @@ change_directory_location (NautilusDirectory *directory,
     g_hash_table_insert (directories,
                          directory->details->location,
                          directory);
+
+    /* The files keep their names, but not their locations. */
+    for (node = directory->details->file_list; node != NULL; node = node->next)
+    {
+        nautilus_file_invalidate_location (NAUTILUS_FILE (node->data));
+    }
 }
 
 typedef struct
@@ -1579,6 +1778,8 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
     NautilusFileAttributes cancel_attributes;
     GFile *to_location, *from_location;
 
+    nautilus_filename_index_notify_files_moved (file_pairs);
+
     /* Make a list of added and changed files in each directory. */
     new_files_list = NULL;
     added_lists = g_hash_table_new (NULL, NULL);
@@ -1596,6 +1797,24 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
         from_location = pair->from;
         to_location = pair->to;
 
+        forget_skipped_hidden_name (from_location);
+
+        /* A move between two monitored directories is told by both, the
+         * second time with the file already moved.
+         */
+        file = nautilus_file_get_existing (from_location);
+        if (file == NULL)
+        {
+            file = nautilus_file_get_existing (to_location);
+            if (file != NULL)
+            {
+                nautilus_file_changed (file);
+                nautilus_file_unref (file);
+                continue;
+            }
+        }
+        nautilus_file_unref (file);
+
         /* Handle overwriting a file. */
         file = nautilus_file_get_existing (to_location);
         if (file != NULL)
@@ -1736,6 +1955,48 @@ nautilus_directory_get_file_by_name (NautilusDirectory *directory,
     return result;
 }
 
+gboolean
+nautilus_directory_has_hidden_file_by_name (NautilusDirectory *directory,
+                                            const gchar       *name,
+                                            gboolean          *is_directory)
+{
+    gpointer value;
+
+    if (!g_hash_table_lookup_extended (directory->details->skipped_hidden_names,
+                                       name, NULL, &value))
+    {
+        return FALSE;
+    }
+
+    if (is_directory != NULL)
+    {
+        *is_directory = GPOINTER_TO_INT (value);
+    }
+
+    return TRUE;
+}
+
+GStrv
+nautilus_directory_get_hidden_directory_names (NautilusDirectory *directory)
+{
+    GPtrArray *names;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    names = g_ptr_array_new ();
+    g_hash_table_iter_init (&iter, directory->details->skipped_hidden_names);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        if (GPOINTER_TO_INT (value))
+        {
+            g_ptr_array_add (names, g_strdup (key));
+        }
+    }
+    g_ptr_array_add (names, NULL);
+
+    return (GStrv) g_ptr_array_free (names, FALSE);
+}
+
 void
 nautilus_directory_call_when_ready (NautilusDirectory         *directory,
                                     NautilusFileAttributes     file_attributes,
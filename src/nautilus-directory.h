@@ -183,6 +183,12 @@ gboolean           nautilus_directory_contains_file            (NautilusDirector
 
 NautilusFile*           nautilus_directory_get_file_by_name            (NautilusDirectory *directory,
                                                                         const gchar       *name);
+/* Hidden files are not loaded while they are not shown, but their names
+ * are still taken. */
+gboolean           nautilus_directory_has_hidden_file_by_name  (NautilusDirectory         *directory,
+								const gchar               *name,
+								gboolean                  *is_directory);
+GStrv              nautilus_directory_get_hidden_directory_names (NautilusDirectory       *directory);
 /* Get (and ref) a NautilusFile object for this directory. */
 NautilusFile *     nautilus_directory_get_corresponding_file   (NautilusDirectory         *directory);
 
@@ -210,6 +216,21 @@ void               nautilus_directory_file_monitor_remove      (NautilusDirector
 								gconstpointer              client);
 void               nautilus_directory_force_reload             (NautilusDirectory         *directory);
 
+/* The directory of the focused window gets job slots before others
+ * waiting on the same backend. Pass NULL when no window is focused.
+ */
+void               nautilus_directory_set_focused              (NautilusDirectory         *directory);
+
+/* Counters and latency histograms of the async jobs, per backend and
+ * kind of job, as text. For debugging.
+ */
+char *             nautilus_directory_get_async_job_stats      (void);
+
+/* The estimated memory of the files of each directory, the largest
+ * first, as text. For debugging.
+ */
+char *             nautilus_directory_get_memory_stats         (void);
+
 /* Get a list of all files currently known in the directory. */
 GList *            nautilus_directory_get_file_list            (NautilusDirectory         *directory);
 
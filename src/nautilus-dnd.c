@@ -80,7 +80,7 @@ nautilus_drag_finalize (NautilusDragInfo *drag_info)
 {
     gtk_target_list_unref (drag_info->target_list);
     nautilus_drag_destroy_selection_list (drag_info->selection_list);
-    nautilus_drag_destroy_selection_list (drag_info->selection_cache);
+    nautilus_drag_clear_selection_cache (drag_info);
 
     g_free (drag_info);
 }
@@ -163,6 +163,25 @@ nautilus_drag_file_list_from_selection_list (const GList *selection_list)
     return g_list_reverse (file_list);
 }
 
+/* Like nautilus_file_list_are_all_folders() on the files of the list,
+ * without building it */
+gboolean
+nautilus_drag_selection_list_are_all_folders (const GList *selection_list)
+{
+    for (const GList *l = selection_list; l != NULL; l = l->next)
+    {
+        NautilusDragSelectionItem *selection_item = l->data;
+
+        if (selection_item->file != NULL &&
+            !nautilus_file_is_directory (selection_item->file))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 GList *
 nautilus_drag_uri_list_from_array (const char **uris)
 {
@@ -662,20 +681,39 @@ nautilus_drag_create_selection_cache (gpointer                             conta
     return cache;
 }
 
+void
+nautilus_drag_clear_selection_cache (NautilusDragInfo *drag_info)
+{
+    nautilus_drag_destroy_selection_list (drag_info->selection_cache);
+    drag_info->selection_cache = NULL;
+
+    if (drag_info->uri_list_data != NULL)
+    {
+        g_string_free (drag_info->uri_list_data, TRUE);
+        drag_info->uri_list_data = NULL;
+    }
+
+    if (drag_info->icon_list_data != NULL)
+    {
+        g_string_free (drag_info->icon_list_data, TRUE);
+        drag_info->icon_list_data = NULL;
+    }
+}
+
 /* Common function for drag_data_get_callback calls.
  * Returns FALSE if it doesn't handle drag data */
 gboolean
-nautilus_drag_drag_data_get_from_cache (GList            *cache,
+nautilus_drag_drag_data_get_from_cache (NautilusDragInfo *drag_info,
                                         GdkDragContext   *context,
                                         GtkSelectionData *selection_data,
                                         guint             info,
                                         guint32           time)
 {
     GList *l;
-    GString *result;
+    GString **result;
     NautilusDragEachSelectedItemDataGet func;
 
-    if (cache == NULL)
+    if (drag_info->selection_cache == NULL)
     {
         return FALSE;
     }
@@ -685,6 +723,7 @@ nautilus_drag_drag_data_get_from_cache (GList            *cache,
         case NAUTILUS_ICON_DND_GNOME_ICON_LIST:
         {
             func = add_one_gnome_icon;
+            result = &drag_info->icon_list_data;
         }
         break;
 
@@ -692,6 +731,7 @@ nautilus_drag_drag_data_get_from_cache (GList            *cache,
         case NAUTILUS_ICON_DND_TEXT:
         {
             func = add_one_uri;
+            result = &drag_info->uri_list_data;
         }
         break;
 
@@ -699,18 +739,21 @@ nautilus_drag_drag_data_get_from_cache (GList            *cache,
             return FALSE;
     }
 
-    result = g_string_new (NULL);
-
-    for (l = cache; l != NULL; l = l->next)
+    /* Drop targets may ask again while hovered, the list is serialized once */
+    if (*result == NULL)
     {
-        NautilusDragSelectionItem *item = l->data;
-        (*func)(item->uri, item->icon_x, item->icon_y, item->icon_width, item->icon_height, result);
+        *result = g_string_new (NULL);
+
+        for (l = drag_info->selection_cache; l != NULL; l = l->next)
+        {
+            NautilusDragSelectionItem *item = l->data;
+            (*func)(item->uri, item->icon_x, item->icon_y, item->icon_width, item->icon_height, *result);
+        }
     }
 
     gtk_selection_data_set (selection_data,
                             gtk_selection_data_get_target (selection_data),
-                            8, (guchar *) result->str, result->len);
-    g_string_free (result, TRUE);
+                            8, (guchar *) (*result)->str, (*result)->len);
 
     return TRUE;
 }
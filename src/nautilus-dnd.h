@@ -56,6 +56,11 @@ typedef struct {
 	/* cache of selected URIs, representing items being dragged */
 	GList *selection_cache;
 
+	/* selection_cache serialized for the drag data requests, on the
+	 * first request for each format */
+	GString *uri_list_data;
+	GString *icon_list_data;
+
         /* File selection list information request handler, for the call for
          * information (mostly the file system info, in order to know if we want
          * co copy or move the files) about the files being dragged, that can
@@ -114,7 +119,8 @@ GdkDragAction		    nautilus_drag_default_drop_action_for_uri_list     (GdkDragCo
 										const char			     *target_uri_string);
 GList			   *nautilus_drag_create_selection_cache	(gpointer			       container_context,
 									 NautilusDragEachSelectedItemIterator  each_selected_item_iterator);
-gboolean		    nautilus_drag_drag_data_get_from_cache	(GList				      *cache,
+void			    nautilus_drag_clear_selection_cache		(NautilusDragInfo		      *drag_info);
+gboolean		    nautilus_drag_drag_data_get_from_cache	(NautilusDragInfo		      *drag_info,
 									 GdkDragContext			      *context,
 									 GtkSelectionData		      *selection_data,
 									 guint				       info,
@@ -138,3 +144,4 @@ void			    nautilus_drag_autoscroll_stop		(NautilusDragInfo		      *drag_info);
 NautilusDragInfo *          nautilus_drag_get_source_data                 (GdkDragContext                     *context);
 
 GList *                     nautilus_drag_file_list_from_selection_list   (const GList                        *selection_list);
+gboolean                    nautilus_drag_selection_list_are_all_folders  (const GList                        *selection_list);
@@ -72,6 +72,7 @@ typedef enum
     NAUTILUS_FILE_ATTRIBUTE_THUMBNAIL                 = 1 << 5,
     NAUTILUS_FILE_ATTRIBUTE_MOUNT                     = 1 << 6,
     NAUTILUS_FILE_ATTRIBUTE_FILESYSTEM_INFO           = 1 << 7,
+    NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO             = 1 << 8, /* Info left out of a fast load */
 } NautilusFileAttributes;
 
 typedef enum
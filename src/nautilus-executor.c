@@ -0,0 +1,222 @@
+/* nautilus-executor.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-executor.h"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* From linux/ioprio.h, which glibc doesn't wrap */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+typedef struct
+{
+    const char *name;
+    /* 0 for as many as there are processors, -1 for no limit */
+    gint max_threads;
+    /* Lowers the priority of the threads, which can't be raised again by
+     * an unprivileged process. Their threads are only theirs then, rather
+     * than taken from and given back to the threads GLib keeps around. */
+    int nice;
+    int io_level;               /* of the best-effort class, 0 for unchanged */
+} ExecutorInfo;
+
+static const ExecutorInfo executor_infos[NAUTILUS_N_EXECUTORS] =
+{
+    /* The operations wait for the devices and for the user's answers in
+     * their threads, so a limit would hold up those which could go on */
+    [NAUTILUS_EXECUTOR_FILE_OPERATIONS] = { "file-ops", -1, 0, 0 },
+    [NAUTILUS_EXECUTOR_THUMBNAILS] = { "thumbnails", 0, 10, 7 },
+    [NAUTILUS_EXECUTOR_SEARCH] = { "search", 0, 0, 0 },
+    [NAUTILUS_EXECUTOR_METADATA] = { "metadata", 2, 5, 6 },
+};
+
+typedef struct
+{
+    GThreadPool *pool;
+    gint n_running;
+    gint n_done;
+} ExecutorState;
+
+typedef struct
+{
+    GTask *task;
+    GTaskThreadFunc task_func;
+} ExecutorJob;
+
+G_LOCK_DEFINE_STATIC (executors);
+static ExecutorState executors[NAUTILUS_N_EXECUTORS];
+
+static gboolean
+lowers_priority (const ExecutorInfo *info)
+{
+    return info->nice != 0 || info->io_level != 0;
+}
+
+static void
+lower_thread_priority (const ExecutorInfo *info)
+{
+#ifdef __linux__
+    pid_t tid = (pid_t) syscall (SYS_gettid);
+
+    /* Both only apply to the calling thread when given its id */
+    if (info->nice != 0 && setpriority (PRIO_PROCESS, tid, info->nice) != 0)
+    {
+        g_debug ("Failed to lower the CPU priority of the %s executor", info->name);
+    }
+    if (info->io_level != 0 &&
+        syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+                 IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT | info->io_level) != 0)
+    {
+        g_debug ("Failed to lower the I/O priority of the %s executor", info->name);
+    }
+#endif
+}
+
+static void
+executor_thread_func (gpointer data,
+                      gpointer user_data)
+{
+    ExecutorJob *job = data;
+    NautilusExecutor executor = GPOINTER_TO_INT (user_data);
+    ExecutorState *state = &executors[executor];
+
+    /* Once for each task, as the threads don't say when they start */
+    if (lowers_priority (&executor_infos[executor]))
+    {
+        lower_thread_priority (&executor_infos[executor]);
+    }
+
+    g_atomic_int_inc (&state->n_running);
+    job->task_func (job->task,
+                    g_task_get_source_object (job->task),
+                    g_task_get_task_data (job->task),
+                    g_task_get_cancellable (job->task));
+    g_atomic_int_add (&state->n_running, -1);
+    g_atomic_int_inc (&state->n_done);
+
+    g_object_unref (job->task);
+    g_free (job);
+}
+
+static gint
+get_max_threads (NautilusExecutor executor)
+{
+    gint max_threads = executor_infos[executor].max_threads;
+
+    return max_threads == 0 ? (gint) g_get_num_processors () : max_threads;
+}
+
+static GThreadPool *
+get_pool (NautilusExecutor executor)
+{
+    ExecutorState *state = &executors[executor];
+
+    G_LOCK (executors);
+
+    if (state->pool == NULL)
+    {
+        g_autoptr (GError) error = NULL;
+
+        state->pool = g_thread_pool_new (executor_thread_func,
+                                         GINT_TO_POINTER (executor),
+                                         get_max_threads (executor),
+                                         lowers_priority (&executor_infos[executor]),
+                                         &error);
+        if (state->pool == NULL)
+        {
+            g_error ("Failed to start the %s executor: %s",
+                     executor_infos[executor].name, error->message);
+        }
+    }
+
+    G_UNLOCK (executors);
+
+    return state->pool;
+}
+
+void
+nautilus_executor_run_in_thread (NautilusExecutor  executor,
+                                 GTask            *task,
+                                 GTaskThreadFunc   task_func)
+{
+    ExecutorJob *job;
+
+    g_return_if_fail (executor < NAUTILUS_N_EXECUTORS);
+    g_return_if_fail (G_IS_TASK (task));
+
+    job = g_new0 (ExecutorJob, 1);
+    job->task = g_object_ref (task);
+    job->task_func = task_func;
+
+    g_thread_pool_push (get_pool (executor), job, NULL);
+}
+
+void
+nautilus_executor_set_max_threads (NautilusExecutor executor,
+                                   guint            max_threads)
+{
+    g_return_if_fail (executor < NAUTILUS_N_EXECUTORS);
+    g_return_if_fail (max_threads > 0);
+
+    g_thread_pool_set_max_threads (get_pool (executor), max_threads, NULL);
+}
+
+char *
+nautilus_executor_get_stats (void)
+{
+    GString *string;
+
+    string = g_string_new (NULL);
+
+    G_LOCK (executors);
+
+    for (guint i = 0; i < NAUTILUS_N_EXECUTORS; i++)
+    {
+        ExecutorState *state = &executors[i];
+        gint max_threads;
+
+        if (state->pool == NULL)
+        {
+            continue;
+        }
+
+        max_threads = g_thread_pool_get_max_threads (state->pool);
+        g_string_append_printf (string, "%-10s %4d running %4u queued %8u done, ",
+                                executor_infos[i].name,
+                                g_atomic_int_get (&state->n_running),
+                                g_thread_pool_unprocessed (state->pool),
+                                (guint) g_atomic_int_get (&state->n_done));
+        if (max_threads < 0)
+        {
+            g_string_append (string, "no thread limit\n");
+        }
+        else
+        {
+            g_string_append_printf (string, "%d threads at most\n", max_threads);
+        }
+    }
+
+    G_UNLOCK (executors);
+
+    return g_string_free (string, FALSE);
+}
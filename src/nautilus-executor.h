@@ -0,0 +1,46 @@
+/* nautilus-executor.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* The executors run the tasks of each subsystem in threads of their own,
+ * instead of the pool all the GTasks share, so that a lot of work in one
+ * doesn't leave the others waiting for threads. The background ones run
+ * at a lower CPU and I/O priority, which the programs they spawn inherit.
+ */
+
+typedef enum
+{
+    NAUTILUS_EXECUTOR_FILE_OPERATIONS,
+    NAUTILUS_EXECUTOR_THUMBNAILS,
+    NAUTILUS_EXECUTOR_SEARCH,
+    NAUTILUS_EXECUTOR_METADATA,
+    NAUTILUS_N_EXECUTORS
+} NautilusExecutor;
+
+/* As g_task_run_in_thread(), in a thread of @executor. */
+void  nautilus_executor_run_in_thread   (NautilusExecutor  executor,
+                                         GTask            *task,
+                                         GTaskThreadFunc   task_func);
+
+/* For the subsystems whose own settings tell how much they run at once. */
+void  nautilus_executor_set_max_threads (NautilusExecutor  executor,
+                                         guint             max_threads);
+
+/* The threads, running and queued tasks of each executor, for debugging. */
+char *nautilus_executor_get_stats       (void);
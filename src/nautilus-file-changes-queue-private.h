@@ -0,0 +1,46 @@
+/* nautilus-file-changes-queue-private.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "nautilus-directory-notify.h"
+
+typedef enum
+{
+    CHANGE_FILE_INITIAL,
+    CHANGE_FILE_ADDED,
+    CHANGE_FILE_CHANGED,
+    CHANGE_FILE_REMOVED,
+    CHANGE_FILE_MOVED,
+} NautilusFileChangeKind;
+
+typedef struct
+{
+    NautilusFileChangeKind kind;
+    /* to is only set for moves */
+    GFilePair files;
+    gboolean from_monitor;
+} NautilusFileChange;
+
+/* Folds the changes to each location into what they come down to, taking
+ * the references of @changes. Exposed for the tests. */
+GArray *nautilus_file_changes_coalesce (GArray *changes);
+
+/* Takes up to @max_changes of the queued changes, in the order they were
+ * pushed, with their references. Exposed for the tests. */
+GArray *nautilus_file_changes_queue_take (guint max_changes);
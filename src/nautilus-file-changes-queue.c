@@ -19,161 +19,245 @@
 
 #include <config.h>
 #include "nautilus-file-changes-queue.h"
+#include "nautilus-file-changes-queue-private.h"
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-profile.h"
 #include "nautilus-tag-manager.h"
 
-typedef enum
+/* The changes pushed at once, in the order they were given */
+typedef struct NautilusFileChangesChunk NautilusFileChangesChunk;
+struct NautilusFileChangesChunk
 {
-    CHANGE_FILE_INITIAL,
-    CHANGE_FILE_ADDED,
-    CHANGE_FILE_CHANGED,
-    CHANGE_FILE_REMOVED,
-    CHANGE_FILE_MOVED,
-} NautilusFileChangeKind;
+    NautilusFileChangesChunk *next;
+    guint n_changes;
+    NautilusFileChange changes[];
+};
 
+/* Worker threads and monitors push chunks onto a lock-free stack, which the
+ * consumer, on the main thread, takes whole and puts back in order.
+ */
 typedef struct
 {
-    NautilusFileChangeKind kind;
-    GFile *from;
-    GFile *to;
-    GdkPoint point;
-    int screen;
-} NautilusFileChange;
+    NautilusFileChangesChunk *pushed;   /* atomic, newest first */
 
-typedef struct
-{
-    GList *head;
-    GList *tail;
-    GMutex mutex;
+    /* Only touched by the consumer, oldest first */
+    NautilusFileChangesChunk *head;
+    NautilusFileChangesChunk *tail;
+    guint head_position;
 } NautilusFileChangesQueue;
 
-static NautilusFileChangesQueue *
-nautilus_file_changes_queue_new (void)
+static NautilusFileChangesQueue file_changes_queue;
+
+static NautilusFileChangesChunk *
+chunk_new (guint n_changes)
 {
-    NautilusFileChangesQueue *result;
+    NautilusFileChangesChunk *chunk;
 
-    result = g_new0 (NautilusFileChangesQueue, 1);
-    g_mutex_init (&result->mutex);
+    chunk = g_malloc (G_STRUCT_OFFSET (NautilusFileChangesChunk, changes) +
+                      n_changes * sizeof (NautilusFileChange));
+    chunk->next = NULL;
+    chunk->n_changes = n_changes;
 
-    return result;
+    return chunk;
 }
 
-static NautilusFileChangesQueue *
-nautilus_file_changes_queue_get (void)
+static void
+set_change (NautilusFileChange     *change,
+            NautilusFileChangeKind  kind,
+            GFile                  *from,
+            GFile                  *to,
+            gboolean                from_monitor)
 {
-    static NautilusFileChangesQueue *file_changes_queue;
-
-    if (file_changes_queue == NULL)
-    {
-        file_changes_queue = nautilus_file_changes_queue_new ();
-    }
-
-    return file_changes_queue;
+    change->kind = kind;
+    change->files.from = g_object_ref (from);
+    change->files.to = to != NULL ? g_object_ref (to) : NULL;
+    change->from_monitor = from_monitor;
 }
 
 static void
-nautilus_file_changes_queue_add_common (NautilusFileChangesQueue *queue,
-                                        NautilusFileChange       *new_item)
+push_chunk (NautilusFileChangesChunk *chunk)
 {
-    /* enqueue the new queue item while locking down the list */
-    g_mutex_lock (&queue->mutex);
+    NautilusFileChangesChunk *pushed;
 
-    queue->head = g_list_prepend (queue->head, new_item);
-    if (queue->tail == NULL)
+    do
     {
-        queue->tail = queue->head;
+        pushed = g_atomic_pointer_get (&file_changes_queue.pushed);
+        chunk->next = pushed;
     }
+    while (!g_atomic_pointer_compare_and_exchange (&file_changes_queue.pushed,
+                                                   pushed, chunk));
+}
 
-    g_mutex_unlock (&queue->mutex);
+static void
+push_change (NautilusFileChangeKind  kind,
+             GFile                  *from,
+             GFile                  *to,
+             gboolean                from_monitor)
+{
+    NautilusFileChangesChunk *chunk;
+
+    chunk = chunk_new (1);
+    set_change (&chunk->changes[0], kind, from, to, from_monitor);
+    push_chunk (chunk);
 }
 
 void
 nautilus_file_changes_queue_file_added (GFile *location)
 {
-    NautilusFileChange *new_item;
-    NautilusFileChangesQueue *queue;
-
-    queue = nautilus_file_changes_queue_get ();
-
-    new_item = g_new0 (NautilusFileChange, 1);
-    new_item->kind = CHANGE_FILE_ADDED;
-    new_item->from = g_object_ref (location);
-    nautilus_file_changes_queue_add_common (queue, new_item);
+    push_change (CHANGE_FILE_ADDED, location, NULL, FALSE);
 }
 
 void
 nautilus_file_changes_queue_file_changed (GFile *location)
 {
-    NautilusFileChange *new_item;
-    NautilusFileChangesQueue *queue;
+    push_change (CHANGE_FILE_CHANGED, location, NULL, FALSE);
+}
+
+void
+nautilus_file_changes_queue_files_changed (GList *locations)
+{
+    NautilusFileChangesChunk *chunk;
+    guint i = 0;
 
-    queue = nautilus_file_changes_queue_get ();
+    if (locations == NULL)
+    {
+        return;
+    }
 
-    new_item = g_new0 (NautilusFileChange, 1);
-    new_item->kind = CHANGE_FILE_CHANGED;
-    new_item->from = g_object_ref (location);
-    nautilus_file_changes_queue_add_common (queue, new_item);
+    /* One chunk, pushed at once, for the lot */
+    chunk = chunk_new (g_list_length (locations));
+    for (GList *l = locations; l != NULL; l = l->next, i++)
+    {
+        set_change (&chunk->changes[i], CHANGE_FILE_CHANGED, l->data, NULL, FALSE);
+    }
+    push_chunk (chunk);
 }
 
 void
 nautilus_file_changes_queue_file_removed (GFile *location)
 {
-    NautilusFileChange *new_item;
-    NautilusFileChangesQueue *queue;
-
-    queue = nautilus_file_changes_queue_get ();
-
-    new_item = g_new0 (NautilusFileChange, 1);
-    new_item->kind = CHANGE_FILE_REMOVED;
-    new_item->from = g_object_ref (location);
-    nautilus_file_changes_queue_add_common (queue, new_item);
+    push_change (CHANGE_FILE_REMOVED, location, NULL, FALSE);
 }
 
 void
 nautilus_file_changes_queue_file_moved (GFile *from,
                                         GFile *to)
 {
-    NautilusFileChange *new_item;
-    NautilusFileChangesQueue *queue;
+    push_change (CHANGE_FILE_MOVED, from, to, FALSE);
+}
 
-    queue = nautilus_file_changes_queue_get ();
+void
+nautilus_file_changes_queue_monitor_file_added (GFile *location)
+{
+    push_change (CHANGE_FILE_ADDED, location, NULL, TRUE);
+}
 
-    new_item = g_new (NautilusFileChange, 1);
-    new_item->kind = CHANGE_FILE_MOVED;
-    new_item->from = g_object_ref (from);
-    new_item->to = g_object_ref (to);
-    nautilus_file_changes_queue_add_common (queue, new_item);
+void
+nautilus_file_changes_queue_monitor_file_changed (GFile *location)
+{
+    push_change (CHANGE_FILE_CHANGED, location, NULL, TRUE);
+}
+
+void
+nautilus_file_changes_queue_monitor_file_removed (GFile *location)
+{
+    push_change (CHANGE_FILE_REMOVED, location, NULL, TRUE);
+}
+
+void
+nautilus_file_changes_queue_monitor_file_moved (GFile *from,
+                                                GFile *to)
+{
+    push_change (CHANGE_FILE_MOVED, from, to, TRUE);
 }
 
-static NautilusFileChange *
-nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
+/* Moves what was pushed since the last time behind the changes the consumer
+ * is left with.
+ */
+static void
+take_pushed_chunks (NautilusFileChangesQueue *queue)
 {
-    GList *new_tail;
-    NautilusFileChange *result;
+    NautilusFileChangesChunk *pushed;
+    NautilusFileChangesChunk *oldest = NULL;
+    NautilusFileChangesChunk *newest;
+
+    do
+    {
+        pushed = g_atomic_pointer_get (&queue->pushed);
+    }
+    while (pushed != NULL &&
+           !g_atomic_pointer_compare_and_exchange (&queue->pushed, pushed, NULL));
+
+    newest = pushed;
+    while (pushed != NULL)
+    {
+        NautilusFileChangesChunk *next = pushed->next;
 
-    g_assert (queue != NULL);
+        pushed->next = oldest;
+        oldest = pushed;
+        pushed = next;
+    }
 
-    /* dequeue the tail item while locking down the list */
-    g_mutex_lock (&queue->mutex);
+    if (oldest == NULL)
+    {
+        return;
+    }
 
-    if (queue->tail == NULL)
+    if (queue->tail != NULL)
     {
-        result = NULL;
+        queue->tail->next = oldest;
     }
     else
     {
-        new_tail = queue->tail->prev;
-        result = queue->tail->data;
-        queue->head = g_list_remove_link (queue->head,
-                                          queue->tail);
-        g_list_free_1 (queue->tail);
-        queue->tail = new_tail;
+        queue->head = oldest;
+        queue->head_position = 0;
     }
+    queue->tail = newest;
+}
+
+/* Copies up to @max_changes changes out of the queue, in the order they
+ * were pushed. They are taken out before any of them gets notified, so
+ * that whatever the notifications run may consume changes again.
+ */
+static GArray *
+take_changes (NautilusFileChangesQueue *queue,
+              guint                     max_changes)
+{
+    GArray *changes;
+
+    take_pushed_chunks (queue);
 
-    g_mutex_unlock (&queue->mutex);
+    changes = g_array_new (FALSE, FALSE, sizeof (NautilusFileChange));
+    while (queue->head != NULL && changes->len < max_changes)
+    {
+        NautilusFileChangesChunk *chunk = queue->head;
+        guint n_changes;
+
+        n_changes = MIN (chunk->n_changes - queue->head_position,
+                         max_changes - changes->len);
+        g_array_append_vals (changes, &chunk->changes[queue->head_position], n_changes);
+        queue->head_position += n_changes;
+
+        if (queue->head_position == chunk->n_changes)
+        {
+            queue->head = chunk->next;
+            queue->head_position = 0;
+            if (queue->head == NULL)
+            {
+                queue->tail = NULL;
+            }
+            g_free (chunk);
+        }
+    }
 
-    return result;
+    return changes;
+}
+
+GArray *
+nautilus_file_changes_queue_take (guint max_changes)
+{
+    return take_changes (&file_changes_queue, max_changes);
 }
 
 enum
@@ -181,166 +265,482 @@ enum
     CONSUME_CHANGES_MAX_CHUNK = 20
 };
 
+/* Sends off @n_changes changes, all of the same kind, as one list whose
+ * links are laid out next to each other.
+ */
 static void
-pairs_list_free (GList *pairs)
+notify_changes (NautilusFileChange *changes,
+                guint               n_changes)
+{
+    g_autofree GList *links = NULL;
+    NautilusFileChangeKind kind = changes[0].kind;
+
+    links = g_new (GList, n_changes);
+    for (guint i = 0; i < n_changes; i++)
+    {
+        if (kind == CHANGE_FILE_MOVED)
+        {
+            links[i].data = &changes[i].files;
+        }
+        else
+        {
+            links[i].data = changes[i].files.from;
+        }
+        links[i].prev = i > 0 ? &links[i - 1] : NULL;
+        links[i].next = i + 1 < n_changes ? &links[i + 1] : NULL;
+    }
+
+    switch (kind)
+    {
+        case CHANGE_FILE_ADDED:
+        {
+            nautilus_directory_notify_files_added (links);
+        }
+        break;
+
+        case CHANGE_FILE_CHANGED:
+        {
+            nautilus_directory_notify_files_changed (links);
+        }
+        break;
+
+        case CHANGE_FILE_REMOVED:
+        {
+            nautilus_directory_notify_files_removed (links);
+        }
+        break;
+
+        case CHANGE_FILE_MOVED:
+        {
+            nautilus_directory_notify_files_moved (links);
+        }
+        break;
+
+        default:
+        {
+            g_assert_not_reached ();
+        }
+        break;
+    }
+
+    for (guint i = 0; i < n_changes; i++)
+    {
+        g_object_unref (changes[i].files.from);
+        g_clear_object (&changes[i].files.to);
+    }
+}
+
+/* What the changes to a location come down to, within a window */
+typedef enum
 {
-    GList *p;
-    GFilePair *pair;
+    PENDING_UNSEEN,     /* nothing yet in the window */
+    PENDING_NONE,       /* added, then removed */
+    PENDING_ADDED,
+    PENDING_CHANGED,
+    PENDING_REMOVED,
+    PENDING_READDED,    /* removed, then added back */
+} PendingState;
 
-    /* deep delete the list of pairs */
+typedef struct
+{
+    GFile *location;
+    PendingState state;
+} PendingChange;
 
-    for (p = pairs; p != NULL; p = p->next)
+static PendingState
+pending_state_apply (PendingState           state,
+                     NautilusFileChangeKind kind)
+{
+    switch (kind)
     {
-        /* delete the strings in each pair */
-        pair = p->data;
-        g_object_unref (pair->from);
-        g_object_unref (pair->to);
+        case CHANGE_FILE_ADDED:
+        {
+            return state == PENDING_REMOVED || state == PENDING_READDED ?
+                   PENDING_READDED : PENDING_ADDED;
+        }
+
+        case CHANGE_FILE_CHANGED:
+        {
+            if (state == PENDING_REMOVED)
+            {
+                /* It's there after all */
+                return PENDING_READDED;
+            }
+            if (state == PENDING_NONE)
+            {
+                /* Back again, and views never heard of it */
+                return PENDING_ADDED;
+            }
+            /* Whatever else it was, views re-query it anyway. */
+            return state == PENDING_UNSEEN ? PENDING_CHANGED : state;
+        }
+
+        case CHANGE_FILE_REMOVED:
+        {
+            /* Views never heard of a file added within the window */
+            return state == PENDING_ADDED || state == PENDING_NONE ?
+                   PENDING_NONE : PENDING_REMOVED;
+        }
+
+        default:
+        {
+            g_assert_not_reached ();
+        }
     }
 
-    /* delete the list and the now empty pair structs */
-    g_list_free_full (pairs, g_free);
+    return state;
+}
+
+static void
+append_change (GArray                 *changes,
+               NautilusFileChangeKind  kind,
+               GFile                  *location)
+{
+    NautilusFileChange change = { kind, { g_object_ref (location), NULL } };
+
+    g_array_append_val (changes, change);
 }
 
-/* go through changes in the change queue, send ones with the same kind
- * in a list to the different nautilus_directory_notify calls
+/* Sends what the pending changes came down to, grouped by kind: removals
+ * first, so that files removed and added back end up added.
  */
-void
-nautilus_file_changes_consume_changes (gboolean consume_all)
+static void
+flush_pending_changes (GArray     *pending,
+                       GHashTable *pending_by_location,
+                       GArray     *coalesced)
 {
-    g_autoptr (NautilusTagManager) tag_manager = nautilus_tag_manager_get ();
-    NautilusFileChange *change;
-    GList *additions, *changes, *deletions, *moves;
-    GFilePair *pair;
-    guint chunk_count;
-    NautilusFileChangesQueue *queue;
-    gboolean flush_needed;
-
-
-    additions = NULL;
-    changes = NULL;
-    deletions = NULL;
-    moves = NULL;
-
-    queue = nautilus_file_changes_queue_get ();
-
-    /* Consume changes from the queue, stuffing them into one of three lists,
-     * keep doing it while the changes are of the same kind, then send them off.
-     * This is to ensure that the changes get sent off in the same order that they
-     * arrived.
-     */
-    for (chunk_count = 0;; chunk_count++)
+    for (guint i = 0; i < pending->len; i++)
     {
-        change = nautilus_file_changes_queue_get_change (queue);
+        PendingChange *change = &g_array_index (pending, PendingChange, i);
 
-        /* figure out if we need to flush the pending changes that we collected sofar */
+        if (change->state == PENDING_REMOVED || change->state == PENDING_READDED)
+        {
+            append_change (coalesced, CHANGE_FILE_REMOVED, change->location);
+        }
+    }
+    for (guint i = 0; i < pending->len; i++)
+    {
+        PendingChange *change = &g_array_index (pending, PendingChange, i);
+
+        if (change->state == PENDING_ADDED || change->state == PENDING_READDED)
+        {
+            append_change (coalesced, CHANGE_FILE_ADDED, change->location);
+        }
+    }
+    for (guint i = 0; i < pending->len; i++)
+    {
+        PendingChange *change = &g_array_index (pending, PendingChange, i);
+
+        if (change->state == PENDING_CHANGED)
+        {
+            append_change (coalesced, CHANGE_FILE_CHANGED, change->location);
+        }
+        g_object_unref (change->location);
+    }
+
+    g_hash_table_remove_all (pending_by_location);
+    g_array_set_size (pending, 0);
+}
+
+/* Folds the changes to each location into what they come down to, e.g.
+ * added then changed into added, and added then removed into nothing.
+ * Moves are kept where they are, with everything before them sent first,
+ * as what follows may be about their new locations or their children.
+ */
+GArray *
+nautilus_file_changes_coalesce (GArray *changes)
+{
+    g_autoptr (GArray) pending = NULL;
+    g_autoptr (GHashTable) pending_by_location = NULL;
+    GArray *coalesced;
+
+    pending = g_array_new (FALSE, FALSE, sizeof (PendingChange));
+    pending_by_location = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+    coalesced = g_array_sized_new (FALSE, FALSE, sizeof (NautilusFileChange), changes->len);
+
+    for (guint i = 0; i < changes->len; i++)
+    {
+        NautilusFileChange *change = &g_array_index (changes, NautilusFileChange, i);
+        gpointer index;
 
-        if (change == NULL)
+        if (change->kind == CHANGE_FILE_MOVED)
         {
-            flush_needed = TRUE;
-            /* no changes left, flush everything */
+            flush_pending_changes (pending, pending_by_location, coalesced);
+            g_array_append_val (coalesced, *change);
+            continue;
+        }
+
+        if (g_hash_table_lookup_extended (pending_by_location, change->files.from, NULL, &index))
+        {
+            PendingChange *pending_change;
+
+            pending_change = &g_array_index (pending, PendingChange, GPOINTER_TO_UINT (index));
+            pending_change->state = pending_state_apply (pending_change->state, change->kind);
+            g_object_unref (change->files.from);
         }
         else
         {
-            flush_needed = additions != NULL
-                           && change->kind != CHANGE_FILE_ADDED;
+            PendingChange pending_change;
+
+            pending_change.location = change->files.from;
+            pending_change.state = pending_state_apply (PENDING_UNSEEN, change->kind);
+
+            g_hash_table_insert (pending_by_location, pending_change.location,
+                                 GUINT_TO_POINTER (pending->len));
+            g_array_append_val (pending, pending_change);
+        }
+    }
+    flush_pending_changes (pending, pending_by_location, coalesced);
+
+    return coalesced;
+}
+
+/* A change an operation told about, and that the monitors are about to
+ * tell again. Moves are kept as a move to their new location, and a
+ * removal of the old one. */
+typedef struct
+{
+    GFile *location;
+    NautilusFileChangeKind kind;
+    GFile *moved_from;
+    gint64 time;
+} OperationChange;
+
+/* The directory monitors tell about the changes the operations made some
+ * time after the operations themselves, this long at most. */
+#define OPERATION_ECHO_WINDOW_MSECS 1000
+
+static GHashTable *operation_changes;   /* of GFile to the latest OperationChange */
+static GQueue operation_changes_by_time = G_QUEUE_INIT;
+static guint prune_operation_changes_id;
+static guint64 n_suppressed_echoes;
+
+static void
+operation_change_free (OperationChange *change)
+{
+    g_object_unref (change->location);
+    g_clear_object (&change->moved_from);
+    g_free (change);
+}
+
+static void
+forget_operation_changes (gint64 before)
+{
+    OperationChange *change;
+
+    while ((change = g_queue_peek_head (&operation_changes_by_time)) != NULL &&
+           change->time < before)
+    {
+        g_queue_pop_head (&operation_changes_by_time);
+        if (g_hash_table_lookup (operation_changes, change->location) == change)
+        {
+            g_hash_table_remove (operation_changes, change->location);
+        }
+        operation_change_free (change);
+    }
+}
+
+static gboolean
+prune_operation_changes_cb (gpointer user_data)
+{
+    forget_operation_changes (g_get_monotonic_time () -
+                              OPERATION_ECHO_WINDOW_MSECS * G_TIME_SPAN_MILLISECOND);
+
+    if (g_queue_is_empty (&operation_changes_by_time))
+    {
+        prune_operation_changes_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+remember_operation_change (GFile                  *location,
+                           NautilusFileChangeKind  kind,
+                           GFile                  *moved_from,
+                           gint64                  now)
+{
+    OperationChange *change;
+
+    if (operation_changes == NULL)
+    {
+        operation_changes = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+    }
+
+    change = g_new0 (OperationChange, 1);
+    change->location = g_object_ref (location);
+    change->kind = kind;
+    change->moved_from = moved_from != NULL ? g_object_ref (moved_from) : NULL;
+    change->time = now;
+
+    g_hash_table_insert (operation_changes, change->location, change);
+    g_queue_push_tail (&operation_changes_by_time, change);
 
-            flush_needed |= changes != NULL
-                            && change->kind != CHANGE_FILE_CHANGED;
+    if (prune_operation_changes_id == 0)
+    {
+        prune_operation_changes_id = g_timeout_add (OPERATION_ECHO_WINDOW_MSECS,
+                                                    prune_operation_changes_cb, NULL);
+    }
+}
+
+/* Whether a monitor @change only tells again what an operation told */
+static gboolean
+is_operation_echo (NautilusFileChange *change,
+                   gint64              now)
+{
+    OperationChange *recent;
+    GFile *location;
 
-            flush_needed |= moves != NULL
-                            && change->kind != CHANGE_FILE_MOVED;
+    if (operation_changes == NULL)
+    {
+        return FALSE;
+    }
 
-            flush_needed |= deletions != NULL
-                            && change->kind != CHANGE_FILE_REMOVED;
+    location = change->kind == CHANGE_FILE_MOVED ? change->files.to : change->files.from;
+    recent = g_hash_table_lookup (operation_changes, location);
+    if (recent == NULL ||
+        now - recent->time > OPERATION_ECHO_WINDOW_MSECS * G_TIME_SPAN_MILLISECOND)
+    {
+        return FALSE;
+    }
 
-            flush_needed |= !consume_all && chunk_count >= CONSUME_CHANGES_MAX_CHUNK;
-            /* we have reached the chunk maximum */
+    switch (change->kind)
+    {
+        case CHANGE_FILE_ADDED:
+        {
+            return recent->kind == CHANGE_FILE_ADDED || recent->kind == CHANGE_FILE_MOVED;
         }
 
-        if (flush_needed)
+        case CHANGE_FILE_CHANGED:
         {
-            /* Send changes we collected off.
-             * At one time we may only have one of the lists
-             * contain changes.
-             */
+            /* The views query the files an operation adds once it is done
+             * with them, the changes done hint that follows is no news. */
+            return recent->kind != CHANGE_FILE_REMOVED;
+        }
 
-            if (deletions != NULL)
-            {
-                deletions = g_list_reverse (deletions);
-                nautilus_directory_notify_files_removed (deletions);
-                g_list_free_full (deletions, g_object_unref);
-                deletions = NULL;
-            }
-            if (moves != NULL)
-            {
-                moves = g_list_reverse (moves);
-                nautilus_directory_notify_files_moved (moves);
-                pairs_list_free (moves);
-                moves = NULL;
-            }
-            if (additions != NULL)
-            {
-                additions = g_list_reverse (additions);
-                nautilus_directory_notify_files_added (additions);
-                g_list_free_full (additions, g_object_unref);
-                additions = NULL;
-            }
-            if (changes != NULL)
-            {
-                changes = g_list_reverse (changes);
-                nautilus_directory_notify_files_changed (changes);
-                g_list_free_full (changes, g_object_unref);
-                changes = NULL;
-            }
+        case CHANGE_FILE_REMOVED:
+        {
+            return recent->kind == CHANGE_FILE_REMOVED;
         }
 
-        if (change == NULL)
+        case CHANGE_FILE_MOVED:
         {
-            /* we are done */
-            return;
+            return recent->kind == CHANGE_FILE_MOVED &&
+                   g_file_equal (recent->moved_from, change->files.from);
         }
 
-        /* add the new change to the list */
-        switch (change->kind)
+        default:
         {
-            case CHANGE_FILE_ADDED:
-            {
-                additions = g_list_prepend (additions, change->from);
-            }
-            break;
+            return FALSE;
+        }
+    }
+}
 
-            case CHANGE_FILE_CHANGED:
-            {
-                changes = g_list_prepend (changes, change->from);
-            }
-            break;
+/* Drops the monitor changes that only tell again, moments later, what
+ * operations told about, so that the directories and views don't go
+ * through every file an operation touches twice. The others are kept in
+ * the order they came.
+ */
+static void
+drop_operation_echoes (GArray *changes)
+{
+    gint64 now;
+    guint n_kept = 0;
+    guint n_dropped;
+
+    now = g_get_monotonic_time ();
 
-            case CHANGE_FILE_REMOVED:
+    for (guint i = 0; i < changes->len; i++)
+    {
+        NautilusFileChange *change = &g_array_index (changes, NautilusFileChange, i);
+
+        if (!change->from_monitor)
+        {
+            if (change->kind == CHANGE_FILE_MOVED)
             {
-                deletions = g_list_prepend (deletions, change->from);
+                remember_operation_change (change->files.to, CHANGE_FILE_MOVED,
+                                           change->files.from, now);
+                remember_operation_change (change->files.from, CHANGE_FILE_REMOVED,
+                                           NULL, now);
             }
-            break;
-
-            case CHANGE_FILE_MOVED:
+            else
             {
-                nautilus_tag_manager_update_moved_uris (tag_manager,
-                                                        change->from,
-                                                        change->to);
-
-                pair = g_new (GFilePair, 1);
-                pair->from = change->from;
-                pair->to = change->to;
-                moves = g_list_prepend (moves, pair);
+                remember_operation_change (change->files.from, change->kind, NULL, now);
             }
-            break;
-
-            default:
+        }
+        else if (is_operation_echo (change, now))
+        {
+            g_object_unref (change->files.from);
+            g_clear_object (&change->files.to);
+            continue;
+        }
+        else if (operation_changes != NULL)
+        {
+            /* Something else happened to it since */
+            g_hash_table_remove (operation_changes, change->files.from);
+            if (change->files.to != NULL)
             {
-                g_assert_not_reached ();
+                g_hash_table_remove (operation_changes, change->files.to);
             }
-            break;
         }
 
-        g_free (change);
+        g_array_index (changes, NautilusFileChange, n_kept++) = *change;
+    }
+
+    n_dropped = changes->len - n_kept;
+    g_array_set_size (changes, n_kept);
+
+    if (n_dropped > 0)
+    {
+        n_suppressed_echoes += n_dropped;
+        nautilus_trace_mark ("monitor echoes suppressed", "%u, %" G_GUINT64_FORMAT " in all",
+                             n_dropped, n_suppressed_echoes);
+    }
+}
+
+/* go through changes in the change queue, send runs of ones with the same
+ * kind to the different nautilus_directory_notify calls, so that they get
+ * sent off in the same order that they arrived.
+ */
+void
+nautilus_file_changes_consume_changes (gboolean consume_all)
+{
+    g_autoptr (NautilusTagManager) tag_manager = nautilus_tag_manager_get ();
+    g_autoptr (GArray) queued = NULL;
+    g_autoptr (GArray) changes = NULL;
+    NautilusFileChange *run;
+    guint run_length = 0;
+
+    queued = take_changes (&file_changes_queue,
+                           consume_all ? G_MAXUINT : CONSUME_CHANGES_MAX_CHUNK);
+    drop_operation_echoes (queued);
+    changes = nautilus_file_changes_coalesce (queued);
+
+    run = (NautilusFileChange *) changes->data;
+    for (guint i = 0; i < changes->len; i++)
+    {
+        NautilusFileChange *change = &g_array_index (changes, NautilusFileChange, i);
+
+        if (change->kind != run->kind)
+        {
+            notify_changes (run, run_length);
+            run = change;
+            run_length = 0;
+        }
+
+        if (change->kind == CHANGE_FILE_MOVED)
+        {
+            nautilus_tag_manager_update_moved_uris (tag_manager,
+                                                    change->files.from,
+                                                    change->files.to);
+        }
+
+        run_length++;
+    }
+
+    if (run_length > 0)
+    {
+        notify_changes (run, run_length);
     }
 }
@@ -24,8 +24,17 @@
 
 void nautilus_file_changes_queue_file_added                      (GFile      *location);
 void nautilus_file_changes_queue_file_changed                    (GFile      *location);
+void nautilus_file_changes_queue_files_changed                   (GList      *locations);
 void nautilus_file_changes_queue_file_removed                    (GFile      *location);
 void nautilus_file_changes_queue_file_moved                      (GFile      *from,
 								  GFile      *to);
 
+/* The same, for what the directory monitors saw. Those that only tell
+ * again what an operation just told about are dropped. */
+void nautilus_file_changes_queue_monitor_file_added              (GFile      *location);
+void nautilus_file_changes_queue_monitor_file_changed            (GFile      *location);
+void nautilus_file_changes_queue_monitor_file_removed            (GFile      *location);
+void nautilus_file_changes_queue_monitor_file_moved              (GFile      *from,
+								  GFile      *to);
+
 void nautilus_file_changes_consume_changes                       (gboolean    consume_all);
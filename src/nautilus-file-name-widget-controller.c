@@ -208,6 +208,8 @@ file_name_widget_controller_process_new_name (NautilusFileNameWidgetController *
     g_autofree gchar *name = NULL;
     gchar *error_message = NULL;
     NautilusFile *existing_file;
+    gboolean hidden_is_folder = FALSE;
+    gboolean hidden_exists;
     priv = nautilus_file_name_widget_controller_get_instance_private (controller);
 
     g_return_if_fail (NAUTILUS_IS_DIRECTORY (priv->containing_directory));
@@ -222,9 +224,14 @@ file_name_widget_controller_process_new_name (NautilusFileNameWidgetController *
                                    error_message != NULL);
 
     existing_file = nautilus_directory_get_file_by_name (priv->containing_directory, name);
-    *duplicated_name = existing_file != NULL &&
-                       !nautilus_file_name_widget_controller_ignore_existing_file (controller,
-                                                                                   existing_file);
+    /* Hidden files are not loaded while they are not shown */
+    hidden_exists = existing_file == NULL &&
+                    nautilus_directory_has_hidden_file_by_name (priv->containing_directory,
+                                                                name, &hidden_is_folder);
+    *duplicated_name = hidden_exists ||
+                       (existing_file != NULL &&
+                        !nautilus_file_name_widget_controller_ignore_existing_file (controller,
+                                                                                    existing_file));
 
     gtk_widget_set_sensitive (priv->activate_button, *valid_name && !*duplicated_name);
 
@@ -236,7 +243,9 @@ file_name_widget_controller_process_new_name (NautilusFileNameWidgetController *
 
     if (*duplicated_name)
     {
-        priv->duplicated_is_folder = nautilus_file_is_directory (existing_file);
+        priv->duplicated_is_folder = hidden_exists ?
+                                     hidden_is_folder :
+                                     nautilus_file_is_directory (existing_file);
     }
 
     if (existing_file != NULL)
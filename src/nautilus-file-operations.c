@@ -29,8 +29,19 @@
 #include <locale.h>
 #include <math.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <stdlib.h>
+#ifdef HAVE_FICLONE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#ifdef HAVE_FSTATFS
+#include <sys/vfs.h>
+#endif
 
 #include "nautilus-file-operations.h"
 
@@ -50,11 +61,15 @@
 #include <gio/gio.h>
 #include <glib.h>
 
+#include "nautilus-copy-journal.h"
+#include "nautilus-directory-reader.h"
 #include "nautilus-error-reporting.h"
+#include "nautilus-executor.h"
 #include "nautilus-operations-ui-manager.h"
 #include "nautilus-file-changes-queue.h"
 #include "nautilus-file-private.h"
 #include "nautilus-global-preferences.h"
+#include "nautilus-job-scheduler.h"
 #include "nautilus-trash-monitor.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-file-undo-operations.h"
@@ -87,6 +102,8 @@ typedef struct
     gboolean merge_all;
     gboolean replace_all;
     gboolean delete_all;
+    /* The progress is that of a batch, which finishes it */
+    gboolean batched;
 } CommonJob;
 
 typedef struct
@@ -100,6 +117,12 @@ typedef struct
     gchar *target_name;
     NautilusCopyCallback done_callback;
     gpointer done_callback_data;
+    struct CopyPipeline *pipeline;
+    /* Of the copies that can be resumed, see nautilus-copy-journal.h */
+    NautilusCopyJournal *journal;
+    /* The names in the folders duplicates are made in, listed once so that
+     * picking a unique name doesn't take a round trip per candidate */
+    GHashTable *taken_names;
 } CopyMoveJob;
 
 typedef struct
@@ -108,6 +131,7 @@ typedef struct
     GList *files;
     gboolean try_trash;
     gboolean user_cancel;
+    gboolean trashed_files;
     NautilusDeleteCallback done_callback;
     gpointer done_callback_data;
 } DeleteJob;
@@ -155,8 +179,19 @@ typedef struct
     guint32 file_mask;
     guint32 dir_permissions;
     guint32 dir_mask;
+
+    /* The folders are gone through by a few threads at once. The lock
+     * guards the undo info and the count of folders left to go through. */
+    GThreadPool *pool;
+    GMutex lock;
+    GCond cond;
+    guint pending_dirs;
+    gint n_changed;
 } SetPermissionsJob;
 
+/* How many folders the permissions are set in at once */
+#define SET_PERMISSIONS_MAX_THREADS 4
+
 typedef enum
 {
     OP_KIND_COPY,
@@ -166,10 +201,21 @@ typedef enum
     OP_KIND_COMPRESS
 } OpKind;
 
+typedef struct
+{
+    char *name;
+    GFileType type;
+    goffset size;
+    guint64 inode;              /* 0 unless the scan reads them */
+} ScannedChild;
+
 typedef struct
 {
     int num_files_children;
     goffset num_bytes_children;
+    /* Of ScannedChild, what the scan listed, for the copy not to list it
+     * again. NULL if it was not kept. */
+    GArray *children;
 } SourceDirInfo;
 
 typedef struct
@@ -179,8 +225,23 @@ typedef struct
     int num_files_since_progress;
     OpKind op;
     GHashTable *scanned_dirs_info;
+    gsize kept_children_size;
+    /* The children kept are copied in the order of their inodes, roughly
+     * that of their place on the disk, for reading them to seek less */
+    gboolean disk_order;
 } SourceInfo;
 
+/* How the contents of a file were copied */
+typedef enum
+{
+    COPY_MODE_STREAM,           /* read and written back by g_file_copy() */
+    COPY_MODE_KERNEL,           /* by copy_file_range() */
+    COPY_MODE_REFLINK,          /* by sharing the extents of the source */
+    COPY_MODE_DIRECT,           /* by copy_large_file(), bypassing the page cache */
+    COPY_MODE_SERVER,           /* by the server, see copy_file_on_server() */
+    COPY_MODE_RELAYED,          /* streamed, as the server couldn't copy it itself */
+} CopyMode;
+
 typedef struct
 {
     int num_files;
@@ -197,6 +258,17 @@ typedef struct
      * https://gitlab.gnome.org/GNOME/nautilus/-/merge_requests/605
      */
     gboolean partial_progress;
+
+    /* Of the last file copied, for the details of the progress */
+    CopyMode copy_mode;
+
+    /* Whether the copies are verified, and how many could be */
+    gboolean verify;
+    int num_verified;
+
+    /* The bytes copied so far by the copies running in other threads,
+     * which add to it atomically as they go. */
+    gssize pending_bytes;
 } TransferInfo;
 
 typedef struct
@@ -206,15 +278,31 @@ typedef struct
     GFile *destination_directory;
     GList *output_files;
 
-    gdouble base_progress;
-
-    guint64 archive_compressed_size;
     guint64 total_compressed_size;
 
+    /* The archives being extracted, several at once when they aren't on a
+     * slow device. The lock guards their progress and the output files,
+     * the dialog lock keeps their dialogs from showing up together. */
+    GPtrArray *archives;
+    GMutex lock;
+    GMutex dialog_lock;
+
     NautilusExtractCallback done_callback;
     gpointer done_callback_data;
 } ExtractJob;
 
+typedef struct
+{
+    ExtractJob *job;
+    GFile *source_file;
+    GFile *output_file;
+    guint64 compressed_size;
+    gdouble progress;
+} ExtractArchive;
+
+/* How many archives are extracted at once at most */
+#define MAX_PARALLEL_EXTRACTIONS 4
+
 typedef struct
 {
     CommonJob common;
@@ -233,6 +321,13 @@ typedef struct
     gpointer done_callback_data;
 } CompressJob;
 
+static void
+source_dir_info_free (SourceDirInfo *dir_info)
+{
+    g_clear_pointer (&dir_info->children, g_array_unref);
+    g_free (dir_info);
+}
+
 static void
 source_info_clear (SourceInfo *source_info)
 {
@@ -1094,7 +1189,10 @@ init_common (gsize                           job_size,
 static void
 finalize_common (CommonJob *common)
 {
-    nautilus_progress_info_finish (common->progress);
+    if (!common->batched)
+    {
+        nautilus_progress_info_finish (common->progress);
+    }
 
     if (common->inhibit_cookie != 0)
     {
@@ -1136,6 +1234,46 @@ finalize_common (CommonJob *common)
     g_free (common);
 }
 
+/* Waits for the devices of the operation to be free, see
+ * nautilus-job-scheduler.h. */
+static NautilusJobSlot *
+wait_for_devices (CommonJob *job,
+                  GList     *sources,
+                  GFile     *destination)
+{
+    NautilusJobSlot *slot;
+
+    slot = nautilus_job_scheduler_acquire (sources, destination,
+                                           job->progress, job->cancellable);
+    /* The time spent waiting doesn't count for the transfer rate. */
+    g_timer_start (job->time);
+
+    return slot;
+}
+
+static gboolean
+should_copy_in_disk_order (NautilusJobSlot *slot)
+{
+    switch (g_settings_get_enum (nautilus_preferences, NAUTILUS_PREFERENCES_COPY_READ_ORDER))
+    {
+        case NAUTILUS_COPY_READ_ORDER_DISK:
+        {
+            return TRUE;
+        }
+
+        case NAUTILUS_COPY_READ_ORDER_AUTO:
+        {
+            return slot != NULL && nautilus_job_slot_has_rotational_source (slot);
+        }
+
+        case NAUTILUS_COPY_READ_ORDER_LISTED:
+        default:
+        {
+            return FALSE;
+        }
+    }
+}
+
 static void
 skip_file (CommonJob *common,
            GFile     *file)
@@ -1773,6 +1911,26 @@ confirm_delete_directly (CommonJob *job,
     return response == 1;
 }
 
+/* The progress is only put together that often, as it builds a few
+ * strings each time, but for the last file so that it shows as done. */
+static gboolean
+transfer_info_report_due (TransferInfo *transfer_info,
+                          int           files_left)
+{
+    guint64 now;
+
+    now = g_get_monotonic_time ();
+    if (transfer_info->last_report_time != 0 &&
+        ABS ((gint64) (transfer_info->last_report_time - now)) < PROGRESS_NOTIFY_INTERVAL &&
+        files_left > 0)
+    {
+        return FALSE;
+    }
+    transfer_info->last_report_time = now;
+
+    return TRUE;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-nonliteral"
 static void
@@ -1783,13 +1941,11 @@ report_delete_progress (CommonJob    *job,
     int files_left;
     double elapsed, transfer_rate;
     int remaining_time;
-    gint64 now;
     char *details;
     char *status;
     DeleteJob *delete_job;
 
     delete_job = (DeleteJob *) job;
-    now = g_get_monotonic_time ();
     files_left = source_info->num_files - transfer_info->num_files;
 
     /* Races and whatnot could cause this to be negative... */
@@ -1798,17 +1954,12 @@ report_delete_progress (CommonJob    *job,
         files_left = 0;
     }
 
-    /* If the number of files left is 0, we want to update the status without
-     * considering this time, since we want to change the status to completed
-     * and probably we won't get more calls to this function */
-    if (transfer_info->last_report_time != 0 &&
-        ABS ((gint64) (transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
-        files_left > 0)
+    if (!transfer_info_report_due (transfer_info, files_left))
     {
         return;
     }
 
-    transfer_info->last_report_time = now;
+    nautilus_progress_info_set_transferred (job->progress, transfer_info->num_files, 0);
 
     if (source_info->num_files == 1)
     {
@@ -1950,7 +2101,7 @@ delete_file_recursively (GFile          *file,
 
     do
     {
-        g_autoptr (GFileEnumerator) enumerator = NULL;
+        g_autoptr (NautilusDirectoryReader) reader = NULL;
 
         success = g_file_delete (file, cancellable, &error);
         if (success ||
@@ -1961,37 +2112,26 @@ delete_file_recursively (GFile          *file,
 
         g_clear_error (&error);
 
-        enumerator = g_file_enumerate_children (file,
-                                                G_FILE_ATTRIBUTE_STANDARD_NAME,
-                                                G_FILE_QUERY_INFO_NONE,
-                                                cancellable, &error);
+        /* Only the names are needed, as the children are deleted the
+         * same way. */
+        reader = nautilus_directory_reader_new (file, 0, cancellable, &error);
 
-        if (enumerator)
+        if (reader)
         {
-            GFileInfo *info;
+            const NautilusDirectoryEntry *entry;
 
             success = TRUE;
 
-            info = g_file_enumerator_next_file (enumerator,
-                                                cancellable,
-                                                &error);
-
-            while (info != NULL)
+            while ((entry = nautilus_directory_reader_next (reader, &error)) != NULL)
             {
                 g_autoptr (GFile) child = NULL;
 
-                child = g_file_enumerator_get_child (enumerator, info);
+                child = g_file_get_child (file, entry->name);
 
                 success = success && delete_file_recursively (child,
                                                               cancellable,
                                                               callback,
                                                               callback_data);
-
-                g_object_unref (info);
-
-                info = g_file_enumerator_next_file (enumerator,
-                                                    cancellable,
-                                                    &error);
             }
         }
 
@@ -2018,11 +2158,10 @@ typedef struct
 } DeleteData;
 
 static void
-file_deleted_callback (GFile    *file,
-                       GError   *error,
-                       gpointer  callback_data)
+report_delete_error (DeleteData *data,
+                     GFile      *file,
+                     GError     *error)
 {
-    DeleteData *data = callback_data;
     CommonJob *job;
     SourceInfo *source_info;
     TransferInfo *transfer_info;
@@ -2037,16 +2176,6 @@ file_deleted_callback (GFile    *file,
     source_info = data->source_info;
     transfer_info = data->transfer_info;
 
-    data->transfer_info->num_files++;
-
-    if (error == NULL)
-    {
-        nautilus_file_changes_queue_file_removed (file);
-        report_delete_progress (data->job, data->source_info, data->transfer_info);
-
-        return;
-    }
-
     if (job_aborted (job) ||
         job->skip_all_error ||
         should_skip_file (job, file) ||
@@ -2105,152 +2234,589 @@ file_deleted_callback (GFile    *file,
 }
 
 static void
-delete_files (CommonJob *job,
-              GList     *files,
-              int       *files_skipped)
+file_deleted_callback (GFile    *file,
+                       GError   *error,
+                       gpointer  callback_data)
 {
-    GList *l;
-    GFile *file;
-    g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
-    TransferInfo transfer_info;
-    DeleteData data;
+    DeleteData *data = callback_data;
 
-    if (job_aborted (job))
-    {
-        return;
-    }
+    data->transfer_info->num_files++;
 
-    scan_sources (files,
-                  &source_info,
-                  job,
-                  OP_KIND_DELETE);
-    if (job_aborted (job))
+    if (error == NULL)
     {
+        nautilus_file_changes_queue_file_removed (file);
+        report_delete_progress (data->job, data->source_info, data->transfer_info);
+
         return;
     }
 
-    g_timer_start (job->time);
+    report_delete_error (data, file, error);
+}
 
-    memset (&transfer_info, 0, sizeof (transfer_info));
-    report_delete_progress (job, &source_info, &transfer_info);
+/* Local folders are deleted by a few threads at once. Each one empties a
+ * folder with unlinkat() on its file descriptor and hands the folders met
+ * in it over to the others, and a folder is removed by the thread which
+ * removed the last folder in it. The errors go back to the job thread,
+ * which brings up the dialogs while the threads wait.
+ *
+ * Folders are opened and removed relative to the descriptor of their
+ * parent, so that a folder swapped for a symlink while being deleted is
+ * not followed. A descriptor stays open until the folders in it are gone,
+ * and the deepest folders go first to keep few of them open.
+ */
+#define LOCAL_DELETE_MAX_THREADS 8
 
-    data.job = job;
-    data.source_info = &source_info;
-    data.transfer_info = &transfer_info;
+typedef struct LocalDeleteDir LocalDeleteDir;
 
-    for (l = files;
-         l != NULL && !job_aborted (job);
-         l = l->next)
-    {
-        gboolean success;
+struct LocalDeleteDir
+{
+    LocalDeleteDir *parent;
+    char *path;                 /* for the errors */
+    const char *name;           /* in @path */
+    guint depth;
+    /* The folder itself once opened, for the folders in it */
+    int fd;
+    /* The subfolders not removed yet, and one while it is being emptied */
+    gint pending;
+    /* Something in it was not deleted */
+    gint failed;
+};
 
-        file = l->data;
+typedef struct
+{
+    GFile *file;
+    GError *error;              /* NULL once everything is done */
+} LocalDeleteEvent;
 
-        if (should_skip_file (job, file))
-        {
-            (*files_skipped)++;
-            continue;
-        }
+typedef struct
+{
+    GThreadPool *pool;
+    GAsyncQueue *events;        /* of LocalDeleteEvent */
+    GCancellable *cancellable;
+    /* The parent of the folder deleted */
+    int root_parent_fd;
+    /* The folders pushed to the pool and not emptied yet */
+    gint outstanding;
+    /* The files and folders deleted or failed to */
+    gint handled;
+    gboolean root_deleted;
+
+    GMutex pause_mutex;
+    GCond pause_cond;
+    gint paused;
+} LocalDelete;
 
-        success = delete_file_recursively (file, job->cancellable,
-                                           file_deleted_callback,
-                                           &data);
+static void
+local_delete_push_event (LocalDelete *local_delete,
+                         GFile       *file,
+                         GError      *error)
+{
+    LocalDeleteEvent *event;
 
-        if (!success)
-        {
-            (*files_skipped)++;
-        }
-    }
+    event = g_new0 (LocalDeleteEvent, 1);
+    event->file = file;
+    event->error = error;
+    g_async_queue_push (local_delete->events, event);
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-nonliteral"
 static void
-report_trash_progress (CommonJob    *job,
-                       SourceInfo   *source_info,
-                       TransferInfo *transfer_info)
+local_delete_event_free (LocalDeleteEvent *event)
 {
-    int files_left;
-    double elapsed, transfer_rate;
-    int remaining_time;
-    gint64 now;
-    char *details;
-    char *status;
-    DeleteJob *delete_job;
+    g_clear_object (&event->file);
+    g_clear_error (&event->error);
+    g_free (event);
+}
 
-    delete_job = (DeleteJob *) job;
-    now = g_get_monotonic_time ();
-    files_left = source_info->num_files - transfer_info->num_files;
+static void
+local_delete_report_error (LocalDelete *local_delete,
+                           const char  *path,
+                           gboolean     opening,
+                           int          errsv)
+{
+    g_autofree char *display_name = NULL;
+    GError *error;
 
-    /* Races and whatnot could cause this to be negative... */
-    if (files_left < 0)
+    display_name = g_filename_display_name (path);
+    if (opening)
     {
-        files_left = 0;
+        error = g_error_new (G_IO_ERROR, g_io_error_from_errno (errsv),
+                             _("Error opening folder “%s”: %s"),
+                             display_name, g_strerror (errsv));
+    }
+    else
+    {
+        error = g_error_new (G_IO_ERROR, g_io_error_from_errno (errsv),
+                             _("Error removing file %s: %s"),
+                             display_name, g_strerror (errsv));
     }
+    local_delete_push_event (local_delete, g_file_new_for_path (path), error);
+}
 
-    /* If the number of files left is 0, we want to update the status without
-     * considering this time, since we want to change the status to completed
-     * and probably we won't get more calls to this function */
-    if (transfer_info->last_report_time != 0 &&
-        ABS ((gint64) (transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
-        files_left > 0)
+static gint
+local_delete_compare_depths (gconstpointer a,
+                             gconstpointer b,
+                             gpointer      user_data)
+{
+    const LocalDeleteDir *dir_a = a;
+    const LocalDeleteDir *dir_b = b;
+
+    return dir_a->depth > dir_b->depth ? -1 : dir_a->depth < dir_b->depth;
+}
+
+static void
+local_delete_set_paused (LocalDelete *local_delete,
+                         gboolean     paused)
+{
+    g_mutex_lock (&local_delete->pause_mutex);
+    g_atomic_int_set (&local_delete->paused, paused);
+    if (!paused)
     {
-        return;
+        g_cond_broadcast (&local_delete->pause_cond);
     }
+    g_mutex_unlock (&local_delete->pause_mutex);
+}
 
-    transfer_info->last_report_time = now;
+static void
+local_delete_wait_while_paused (LocalDelete *local_delete)
+{
+    if (!g_atomic_int_get (&local_delete->paused))
+    {
+        return;
+    }
 
-    if (source_info->num_files == 1)
+    g_mutex_lock (&local_delete->pause_mutex);
+    while (g_atomic_int_get (&local_delete->paused))
     {
-        g_autofree gchar *basename = NULL;
+        g_cond_wait (&local_delete->pause_cond, &local_delete->pause_mutex);
+    }
+    g_mutex_unlock (&local_delete->pause_mutex);
+}
 
-        if (files_left > 0)
+static int
+local_delete_get_parent_fd (LocalDelete    *local_delete,
+                            LocalDeleteDir *dir)
+{
+    return dir->parent != NULL ? dir->parent->fd : local_delete->root_parent_fd;
+}
+
+/* Removes @dir, and then its parents which it was the last folder of. */
+static void
+local_delete_dir_done (LocalDelete    *local_delete,
+                       LocalDeleteDir *dir)
+{
+    LocalDeleteDir *parent;
+    gboolean failed;
+
+    while (dir != NULL)
+    {
+        if (dir->fd >= 0)
         {
-            status = _("Trashing “%s”");
+            close (dir->fd);
         }
-        else
+
+        /* The parent is kept open until its last folder is done. */
+        failed = g_atomic_int_get (&dir->failed) ||
+                 g_cancellable_is_cancelled (local_delete->cancellable);
+        if (!failed &&
+            unlinkat (local_delete_get_parent_fd (local_delete, dir), dir->name,
+                      AT_REMOVEDIR) != 0)
         {
-            status = _("Trashed “%s”");
+            local_delete_report_error (local_delete, dir->path,
+                                       FALSE, errno);
+            failed = TRUE;
         }
+        g_atomic_int_inc (&local_delete->handled);
 
-        basename = get_basename (G_FILE (delete_job->files->data));
-        nautilus_progress_info_take_status (job->progress,
-                                            g_strdup_printf (status, basename));
-    }
-    else
-    {
-        if (files_left > 0)
+        parent = dir->parent;
+        if (parent == NULL)
         {
-            status = ngettext ("Trashing %'d file",
-                               "Trashing %'d files",
-                               source_info->num_files);
+            local_delete->root_deleted = !failed;
         }
-        else
+        else if (failed)
         {
-            status = ngettext ("Trashed %'d file",
-                               "Trashed %'d files",
-                               source_info->num_files);
+            g_atomic_int_set (&parent->failed, TRUE);
         }
-        nautilus_progress_info_take_status (job->progress,
-                                            g_strdup_printf (status,
-                                                             source_info->num_files));
+
+        g_free (dir->path);
+        g_free (dir);
+
+        if (parent == NULL || !g_atomic_int_dec_and_test (&parent->pending))
+        {
+            break;
+        }
+        dir = parent;
     }
+}
 
+static void
+local_delete_push_dir (LocalDelete    *local_delete,
+                       LocalDeleteDir *parent,
+                       char           *path)
+{
+    LocalDeleteDir *dir;
+    const char *separator;
 
-    elapsed = g_timer_elapsed (job->time, NULL);
-    transfer_rate = 0;
-    remaining_time = INT_MAX;
-    if (elapsed > 0)
+    dir = g_new0 (LocalDeleteDir, 1);
+    dir->parent = parent;
+    dir->path = path;
+    separator = strrchr (path, G_DIR_SEPARATOR);
+    dir->name = separator != NULL ? separator + 1 : path;
+    dir->depth = parent != NULL ? parent->depth + 1 : 0;
+    dir->fd = -1;
+    dir->pending = 1;
+
+    if (parent != NULL)
     {
-        transfer_rate = transfer_info->num_files / elapsed;
-        if (transfer_rate > 0)
+        g_atomic_int_inc (&parent->pending);
+    }
+    g_atomic_int_inc (&local_delete->outstanding);
+    g_thread_pool_push (local_delete->pool, dir, NULL);
+}
+
+static void
+local_delete_empty_dir (LocalDelete    *local_delete,
+                        LocalDeleteDir *dir)
+{
+    DIR *stream;
+    struct dirent *entry;
+    struct stat stat_buf;
+    gboolean is_dir;
+    int fd;
+    int stream_fd;
+    int errsv;
+
+    fd = openat (local_delete_get_parent_fd (local_delete, dir), dir->name,
+                 O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    /* The stream owns its descriptor, and @fd outlives it. */
+    stream_fd = fd >= 0 ? fcntl (fd, F_DUPFD_CLOEXEC, 0) : -1;
+    if (stream_fd < 0 || (stream = fdopendir (stream_fd)) == NULL)
+    {
+        errsv = errno;
+        if (stream_fd >= 0)
         {
-            remaining_time = (source_info->num_files - transfer_info->num_files) / transfer_rate;
+            close (stream_fd);
+        }
+        if (fd >= 0)
+        {
+            close (fd);
         }
+        local_delete_report_error (local_delete, dir->path,
+                                   TRUE, errsv);
+        g_atomic_int_set (&dir->failed, TRUE);
+        return;
     }
+    dir->fd = fd;
 
-    if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE ||
-        transfer_rate == 0)
+    while ((entry = readdir (stream)) != NULL)
+    {
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        local_delete_wait_while_paused (local_delete);
+        if (g_cancellable_is_cancelled (local_delete->cancellable))
+        {
+            break;
+        }
+
+        is_dir = entry->d_type == DT_DIR;
+        if (!is_dir)
+        {
+            if (unlinkat (fd, entry->d_name, 0) == 0)
+            {
+                g_atomic_int_inc (&local_delete->handled);
+                continue;
+            }
+
+            errsv = errno;
+            /* Unknown types are only looked up when they need to. */
+            is_dir = errsv == EISDIR ||
+                     (entry->d_type == DT_UNKNOWN &&
+                      fstatat (fd, entry->d_name, &stat_buf, AT_SYMLINK_NOFOLLOW) == 0 &&
+                      S_ISDIR (stat_buf.st_mode));
+            if (!is_dir)
+            {
+                g_autofree char *path = NULL;
+
+                path = g_build_filename (dir->path, entry->d_name, NULL);
+                local_delete_report_error (local_delete, path,
+                                           FALSE, errsv);
+                g_atomic_int_inc (&local_delete->handled);
+                g_atomic_int_set (&dir->failed, TRUE);
+                continue;
+            }
+        }
+
+        local_delete_push_dir (local_delete, dir,
+                               g_build_filename (dir->path, entry->d_name, NULL));
+    }
+
+    closedir (stream);
+}
+
+/* Runs in the threads of the pool. */
+static void
+local_delete_thread (gpointer data,
+                     gpointer user_data)
+{
+    LocalDeleteDir *dir = data;
+    LocalDelete *local_delete = user_data;
+
+    if (!g_cancellable_is_cancelled (local_delete->cancellable))
+    {
+        local_delete_empty_dir (local_delete, dir);
+    }
+
+    if (g_atomic_int_dec_and_test (&dir->pending))
+    {
+        local_delete_dir_done (local_delete, dir);
+    }
+
+    /* What was pushed by this one is counted already, so nothing is left
+     * once this reaches 0. */
+    if (g_atomic_int_dec_and_test (&local_delete->outstanding))
+    {
+        local_delete_push_event (local_delete, NULL, NULL);
+    }
+}
+
+/* As delete_file_recursively() with file_deleted_callback(), for a local
+ * folder. Only the folder itself is queued as removed, the monitors of
+ * the folders in it let the views know. */
+static gboolean
+delete_local_directory (GFile      *file,
+                        DeleteData *data)
+{
+    CommonJob *job;
+    LocalDelete local_delete = { 0 };
+    LocalDeleteEvent *event;
+    g_autofree char *path = NULL;
+    g_autofree char *parent_path = NULL;
+    int num_files;
+    int errsv;
+
+    job = data->job;
+    num_files = data->transfer_info->num_files;
+
+    path = g_file_get_path (file);
+    parent_path = g_path_get_dirname (path);
+    local_delete.root_parent_fd = open (parent_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (local_delete.root_parent_fd < 0)
+    {
+        g_autoptr (GError) error = NULL;
+        g_autofree char *display_name = NULL;
+
+        errsv = errno;
+        display_name = g_filename_display_name (parent_path);
+        error = g_error_new (G_IO_ERROR, g_io_error_from_errno (errsv),
+                             _("Error opening folder “%s”: %s"),
+                             display_name, g_strerror (errsv));
+        data->transfer_info->num_files++;
+        report_delete_error (data, file, error);
+
+        return FALSE;
+    }
+
+    local_delete.events = g_async_queue_new ();
+    local_delete.cancellable = job->cancellable;
+    g_mutex_init (&local_delete.pause_mutex);
+    g_cond_init (&local_delete.pause_cond);
+    local_delete.pool = g_thread_pool_new (local_delete_thread, &local_delete,
+                                           LOCAL_DELETE_MAX_THREADS, FALSE, NULL);
+    g_thread_pool_set_sort_function (local_delete.pool, local_delete_compare_depths, NULL);
+
+    local_delete_push_dir (&local_delete, NULL, g_steal_pointer (&path));
+
+    while (TRUE)
+    {
+        event = g_async_queue_timeout_pop (local_delete.events, PROGRESS_NOTIFY_INTERVAL);
+        data->transfer_info->num_files = num_files + g_atomic_int_get (&local_delete.handled);
+
+        if (event == NULL)
+        {
+            report_delete_progress (job, data->source_info, data->transfer_info);
+            continue;
+        }
+        if (event->error == NULL)
+        {
+            local_delete_event_free (event);
+            break;
+        }
+
+        local_delete_set_paused (&local_delete, TRUE);
+        report_delete_error (data, event->file, event->error);
+        local_delete_set_paused (&local_delete, FALSE);
+
+        local_delete_event_free (event);
+    }
+
+    /* Every error was queued before the end. */
+    g_thread_pool_free (local_delete.pool, FALSE, TRUE);
+    g_async_queue_unref (local_delete.events);
+    g_mutex_clear (&local_delete.pause_mutex);
+    g_cond_clear (&local_delete.pause_cond);
+    close (local_delete.root_parent_fd);
+
+    data->transfer_info->num_files = num_files + local_delete.handled;
+    if (local_delete.root_deleted)
+    {
+        nautilus_file_changes_queue_file_removed (file);
+    }
+    report_delete_progress (job, data->source_info, data->transfer_info);
+
+    return local_delete.root_deleted;
+}
+
+static void
+delete_files (CommonJob *job,
+              GList     *files,
+              int       *files_skipped)
+{
+    GList *l;
+    GFile *file;
+    g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
+    TransferInfo transfer_info;
+    DeleteData data;
+
+    if (job_aborted (job))
+    {
+        return;
+    }
+
+    scan_sources (files,
+                  &source_info,
+                  job,
+                  OP_KIND_DELETE);
+    if (job_aborted (job))
+    {
+        return;
+    }
+
+    g_timer_start (job->time);
+
+    memset (&transfer_info, 0, sizeof (transfer_info));
+    report_delete_progress (job, &source_info, &transfer_info);
+
+    data.job = job;
+    data.source_info = &source_info;
+    data.transfer_info = &transfer_info;
+
+    for (l = files;
+         l != NULL && !job_aborted (job);
+         l = l->next)
+    {
+        gboolean success;
+
+        file = l->data;
+
+        if (should_skip_file (job, file))
+        {
+            (*files_skipped)++;
+            continue;
+        }
+
+        if (g_file_is_native (file) &&
+            g_file_query_file_type (file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                    job->cancellable) == G_FILE_TYPE_DIRECTORY)
+        {
+            success = delete_local_directory (file, &data);
+        }
+        else
+        {
+            success = delete_file_recursively (file, job->cancellable,
+                                               file_deleted_callback,
+                                               &data);
+        }
+
+        if (!success)
+        {
+            (*files_skipped)++;
+        }
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static void
+report_trash_progress (CommonJob    *job,
+                       SourceInfo   *source_info,
+                       TransferInfo *transfer_info)
+{
+    int files_left;
+    double elapsed, transfer_rate;
+    int remaining_time;
+    char *details;
+    char *status;
+    DeleteJob *delete_job;
+
+    delete_job = (DeleteJob *) job;
+    files_left = source_info->num_files - transfer_info->num_files;
+
+    /* Races and whatnot could cause this to be negative... */
+    if (files_left < 0)
+    {
+        files_left = 0;
+    }
+
+    if (!transfer_info_report_due (transfer_info, files_left))
+    {
+        return;
+    }
+
+    nautilus_progress_info_set_transferred (job->progress, transfer_info->num_files, 0);
+
+    if (source_info->num_files == 1)
+    {
+        g_autofree gchar *basename = NULL;
+
+        if (files_left > 0)
+        {
+            status = _("Trashing “%s”");
+        }
+        else
+        {
+            status = _("Trashed “%s”");
+        }
+
+        basename = get_basename (G_FILE (delete_job->files->data));
+        nautilus_progress_info_take_status (job->progress,
+                                            g_strdup_printf (status, basename));
+    }
+    else
+    {
+        if (files_left > 0)
+        {
+            status = ngettext ("Trashing %'d file",
+                               "Trashing %'d files",
+                               source_info->num_files);
+        }
+        else
+        {
+            status = ngettext ("Trashed %'d file",
+                               "Trashed %'d files",
+                               source_info->num_files);
+        }
+        nautilus_progress_info_take_status (job->progress,
+                                            g_strdup_printf (status,
+                                                             source_info->num_files));
+    }
+
+
+    elapsed = g_timer_elapsed (job->time, NULL);
+    transfer_rate = 0;
+    remaining_time = INT_MAX;
+    if (elapsed > 0)
+    {
+        transfer_rate = transfer_info->num_files / elapsed;
+        if (transfer_rate > 0)
+        {
+            remaining_time = (source_info->num_files - transfer_info->num_files) / transfer_rate;
+        }
+    }
+
+    if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE ||
+        transfer_rate == 0)
     {
         if (files_left > 0)
         {
@@ -2492,62 +3058,332 @@ source_info_remove_file_from_count (GFile      *file,
 }
 
 static void
-trash_files (CommonJob *job,
-             GList     *files,
-             int       *files_skipped)
+trash_toplevel_file (CommonJob     *job,
+                     GFile         *file,
+                     SourceInfo    *source_info,
+                     TransferInfo  *transfer_info,
+                     int           *files_skipped,
+                     GList        **to_delete)
 {
-    GList *l;
-    GFile *file;
-    GList *to_delete;
-    g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
-    TransferInfo transfer_info;
     gboolean skipped_file;
 
-    if (job_aborted (job))
+    skipped_file = FALSE;
+    trash_file (job, file,
+                &skipped_file,
+                source_info, transfer_info,
+                TRUE, to_delete);
+    if (skipped_file)
     {
-        return;
+        (*files_skipped)++;
+        source_info_remove_file_from_count (file, job, source_info);
+        report_trash_progress (job, source_info, transfer_info);
     }
+}
 
-    scan_sources (files,
-                  &source_info,
-                  job,
-                  OP_KIND_TRASH);
-    if (job_aborted (job))
+/* The local files on the filesystem of the trash of the user are put in
+ * it here, as g_file_trash() does but in batches: the trash folders are
+ * opened once, and the trash info files of a batch are all written before
+ * being synced at once, where g_file_trash() syncs each of them. Whatever
+ * fails is left to g_file_trash(), which reports it.
+ */
+#define TRASH_BATCH_SIZE 512
+
+typedef struct
+{
+    char *path;
+    dev_t device;
+    int files_fd;
+    int info_fd;
+} HomeTrash;
+
+static void
+home_trash_close (HomeTrash *trash)
+{
+    if (trash->files_fd >= 0)
     {
-        return;
+        close (trash->files_fd);
+    }
+    if (trash->info_fd >= 0)
+    {
+        close (trash->info_fd);
     }
+    g_clear_pointer (&trash->path, g_free);
+}
 
-    g_timer_start (job->time);
+static gboolean
+home_trash_open (HomeTrash *trash)
+{
+    g_autofree char *files_path = NULL;
+    g_autofree char *info_path = NULL;
+    struct stat stat_buf;
 
-    memset (&transfer_info, 0, sizeof (transfer_info));
-    report_trash_progress (job, &source_info, &transfer_info);
+    trash->path = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+    files_path = g_build_filename (trash->path, "files", NULL);
+    info_path = g_build_filename (trash->path, "info", NULL);
 
-    to_delete = NULL;
-    for (l = files;
-         l != NULL && !job_aborted (job);
-         l = l->next)
+    trash->files_fd = -1;
+    trash->info_fd = -1;
+    if (g_mkdir_with_parents (files_path, 0700) == 0 &&
+        g_mkdir_with_parents (info_path, 0700) == 0)
     {
-        file = l->data;
-
-        skipped_file = FALSE;
-        trash_file (job, file,
-                    &skipped_file,
-                    &source_info, &transfer_info,
-                    TRUE, &to_delete);
-        if (skipped_file)
-        {
-            (*files_skipped)++;
-            source_info_remove_file_from_count (file, job, &source_info);
-            report_trash_progress (job, &source_info, &transfer_info);
-        }
+        trash->files_fd = open (files_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        trash->info_fd = open (info_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
     }
 
-    if (to_delete)
+    if (trash->files_fd < 0 || trash->info_fd < 0 ||
+        fstat (trash->files_fd, &stat_buf) != 0)
     {
-        to_delete = g_list_reverse (to_delete);
+        home_trash_close (trash);
+        return FALSE;
+    }
+    trash->device = stat_buf.st_dev;
+
+    return TRUE;
+}
+
+static gboolean
+home_trash_can_take (HomeTrash *trash,
+                     GFile     *file)
+{
+    g_autofree char *path = NULL;
+    struct stat stat_buf;
+
+    path = g_file_get_path (file);
+
+    return path != NULL &&
+           lstat (path, &stat_buf) == 0 &&
+           stat_buf.st_dev == trash->device &&
+           !g_str_has_prefix (path, trash->path);
+}
+
+/* Writes the trash info of @path under a name not used yet, which is
+ * returned, or NULL on failure. */
+static char *
+home_trash_write_info (HomeTrash  *trash,
+                       const char *path,
+                       const char *deletion_date)
+{
+    g_autofree char *basename = NULL;
+    g_autofree char *escaped_path = NULL;
+    g_autofree char *contents = NULL;
+    g_autofree char *info_name = NULL;
+    char *trash_name;
+    gsize length;
+    int fd;
+
+    basename = g_path_get_basename (path);
+    trash_name = g_strdup (basename);
+    for (int i = 1; ; i++)
+    {
+        g_free (info_name);
+        info_name = g_strconcat (trash_name, ".trashinfo", NULL);
+        fd = openat (trash->info_fd, info_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd >= 0 || errno != EEXIST)
+        {
+            break;
+        }
+
+        g_free (trash_name);
+        trash_name = g_strdup_printf ("%s.%d", basename, i);
+    }
+    if (fd < 0)
+    {
+        g_free (trash_name);
+        return NULL;
+    }
+
+    escaped_path = g_uri_escape_string (path, "/", FALSE);
+    contents = g_strdup_printf ("[Trash Info]\nPath=%s\nDeletionDate=%s\n",
+                                escaped_path, deletion_date);
+    length = strlen (contents);
+    if (write (fd, contents, length) != (gssize) length)
+    {
+        close (fd);
+        unlinkat (trash->info_fd, info_name, 0);
+        g_free (trash_name);
+        return NULL;
+    }
+    close (fd);
+
+    return trash_name;
+}
+
+static void
+trash_files_in_batch (CommonJob     *job,
+                      HomeTrash     *trash,
+                      GPtrArray     *batch,
+                      SourceInfo    *source_info,
+                      TransferInfo  *transfer_info,
+                      int           *files_skipped,
+                      GList        **to_delete)
+{
+    g_autoptr (GDateTime) now = NULL;
+    g_autofree char *deletion_date = NULL;
+    g_autofree char **trash_names = NULL;
+    g_autofree char *info_name = NULL;
+    GFile *file;
+
+    now = g_date_time_new_now_local ();
+    deletion_date = g_date_time_format (now, "%Y-%m-%dT%H:%M:%S");
+    trash_names = g_new0 (char *, batch->len);
+
+    for (guint i = 0; i < batch->len; i++)
+    {
+        g_autofree char *path = NULL;
+
+        file = g_ptr_array_index (batch, i);
+        if (!should_skip_file (job, file))
+        {
+            path = g_file_get_path (file);
+            trash_names[i] = home_trash_write_info (trash, path, deletion_date);
+        }
+    }
+
+    /* The trash info has to be there before what it is about. */
+#ifdef HAVE_SYNCFS
+    syncfs (trash->info_fd);
+#else
+    fsync (trash->info_fd);
+#endif
+
+    for (guint i = 0; i < batch->len; i++)
+    {
+        g_autofree char *path = NULL;
+
+        file = g_ptr_array_index (batch, i);
+
+        if (job_aborted (job))
+        {
+            /* Not put in the trash after all. */
+            if (trash_names[i] != NULL)
+            {
+                g_free (info_name);
+                info_name = g_strconcat (trash_names[i], ".trashinfo", NULL);
+                unlinkat (trash->info_fd, info_name, 0);
+            }
+        }
+        else if (trash_names[i] != NULL)
+        {
+            path = g_file_get_path (file);
+            if (renameat (AT_FDCWD, path, trash->files_fd, trash_names[i]) == 0)
+            {
+                transfer_info->num_files++;
+                nautilus_file_changes_queue_file_removed (file);
+
+                if (job->undo_info != NULL)
+                {
+                    g_autoptr (GFile) trash_root = NULL;
+                    g_autoptr (GFile) trashed = NULL;
+
+                    /* What is in the trash of the user is at the top of trash:///. */
+                    trash_root = g_file_new_for_uri ("trash:///");
+                    trashed = g_file_get_child (trash_root, trash_names[i]);
+                    nautilus_file_undo_info_trash_add_trashed_file (NAUTILUS_FILE_UNDO_INFO_TRASH (job->undo_info),
+                                                                    file, trashed);
+                }
+
+                report_trash_progress (job, source_info, transfer_info);
+            }
+            else
+            {
+                g_free (info_name);
+                info_name = g_strconcat (trash_names[i], ".trashinfo", NULL);
+                unlinkat (trash->info_fd, info_name, 0);
+
+                trash_toplevel_file (job, file, source_info, transfer_info,
+                                     files_skipped, to_delete);
+            }
+        }
+        else
+        {
+            trash_toplevel_file (job, file, source_info, transfer_info,
+                                 files_skipped, to_delete);
+        }
+
+        g_free (trash_names[i]);
+    }
+
+    g_ptr_array_set_size (batch, 0);
+}
+
+/* Returns whether any of @files was put in the trash */
+static gboolean
+trash_files (CommonJob *job,
+             GList     *files,
+             int       *files_skipped)
+{
+    GList *l;
+    GFile *file;
+    GList *to_delete;
+    g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
+    TransferInfo transfer_info;
+    HomeTrash trash;
+    GPtrArray *batch;
+
+    if (job_aborted (job))
+    {
+        return FALSE;
+    }
+
+    scan_sources (files,
+                  &source_info,
+                  job,
+                  OP_KIND_TRASH);
+    if (job_aborted (job))
+    {
+        return FALSE;
+    }
+
+    g_timer_start (job->time);
+
+    memset (&transfer_info, 0, sizeof (transfer_info));
+    report_trash_progress (job, &source_info, &transfer_info);
+
+    to_delete = NULL;
+    batch = NULL;
+    if (home_trash_open (&trash))
+    {
+        batch = g_ptr_array_new ();
+    }
+    for (l = files;
+         l != NULL && !job_aborted (job);
+         l = l->next)
+    {
+        file = l->data;
+
+        if (batch != NULL && home_trash_can_take (&trash, file))
+        {
+            g_ptr_array_add (batch, file);
+            if (batch->len == TRASH_BATCH_SIZE)
+            {
+                trash_files_in_batch (job, &trash, batch, &source_info, &transfer_info,
+                                      files_skipped, &to_delete);
+            }
+            continue;
+        }
+
+        trash_toplevel_file (job, file, &source_info, &transfer_info,
+                             files_skipped, &to_delete);
+    }
+    if (batch != NULL)
+    {
+        if (!job_aborted (job))
+        {
+            trash_files_in_batch (job, &trash, batch, &source_info, &transfer_info,
+                                  files_skipped, &to_delete);
+        }
+        g_ptr_array_unref (batch);
+        home_trash_close (&trash);
+    }
+
+    if (to_delete)
+    {
+        to_delete = g_list_reverse (to_delete);
         delete_files (job, to_delete, files_skipped);
         g_list_free (to_delete);
     }
+
+    return transfer_info.num_files > 0;
 }
 
 static void
@@ -2562,6 +3398,11 @@ delete_task_done (GObject      *source_object,
 
     g_list_free_full (job->files, g_object_unref);
 
+    if (job->trashed_files)
+    {
+        nautilus_trash_monitor_files_trashed ();
+    }
+
     if (job->done_callback)
     {
         debuting_uris = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
@@ -2641,6 +3482,9 @@ trash_or_delete_internal (GTask        *task,
         }
         if (confirmed)
         {
+            g_autoptr (NautilusJobSlot) slot = NULL;
+
+            slot = wait_for_devices (common, to_delete_files, NULL);
             delete_files (common, to_delete_files, &files_skipped);
         }
         else
@@ -2653,7 +3497,7 @@ trash_or_delete_internal (GTask        *task,
     {
         to_trash_files = g_list_reverse (to_trash_files);
 
-        trash_files (common, to_trash_files, &files_skipped);
+        job->trashed_files = trash_files (common, to_trash_files, &files_skipped);
     }
 
     if (files_skipped == g_list_length (job->files))
@@ -2747,7 +3591,7 @@ trash_or_delete_internal_async (GList                          *files,
 
     task = g_task_new (NULL, NULL, delete_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, trash_or_delete_internal);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, trash_or_delete_internal);
     g_object_unref (task);
 }
 
@@ -3117,7 +3961,7 @@ nautilus_file_operations_unmount_mount_full (GtkWindow               *parent_win
 
             task = g_task_new (NULL, NULL, empty_trash_task_done, job);
             g_task_set_task_data (task, job, NULL);
-            g_task_run_in_thread (task, empty_trash_thread_func);
+            nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, empty_trash_thread_func);
             g_object_unref (task);
             return;
         }
@@ -3321,13 +4165,11 @@ report_preparing_count_progress (CommonJob  *job,
 }
 
 static void
-count_file (GFileInfo     *info,
+count_file (goffset        num_bytes,
             CommonJob     *job,
             SourceInfo    *source_info,
             SourceDirInfo *dir_info)
 {
-    goffset num_bytes = g_file_info_get_size (info);
-
     source_info->num_files += 1;
     source_info->num_bytes += num_bytes;
 
@@ -3375,153 +4217,138 @@ get_scan_primary (OpKind kind)
     }
 }
 
-static void
-scan_dir (GFile      *dir,
-          SourceInfo *source_info,
-          CommonJob  *job,
-          GQueue     *dirs)
-{
-    GFileInfo *info;
-    GError *error;
-    GFile *subdir;
-    GFileEnumerator *enumerator;
-    char *primary, *secondary, *details;
-    int response;
-    SourceInfo saved_info;
-    g_autolist (GFile) subdirs = NULL;
-    SourceDirInfo *dir_info = NULL;
-    gboolean skip_subdirs = FALSE;
+/* The folders are read by a few threads at once while counting what there
+ * is to handle. What they list is counted in the job thread, which also
+ * brings up the dialogs. */
+#define SCAN_MAX_THREADS 4
+/* How much of what the scan listed is kept for the copy, in bytes */
+#define SCAN_MAX_KEPT_CHILDREN_SIZE (64 * 1024 * 1024)
 
-    /* It is possible for this function to be called multiple times for
-     * the same directory.
-     * We pass a NULL SourceDirInfo into count_file() if this directory has
-     * already been scanned once so that its children are not counted more
-     * than once in the SourceDirInfo corresponding to this directory.
-     */
+typedef struct
+{
+    GThreadPool *pool;
+    GAsyncQueue *done;          /* of ScannedDir */
+    guint in_flight;
+    GCancellable *cancellable;
+    NautilusDirectoryReaderFields fields;
+} SourceScan;
 
-    if (!g_hash_table_contains (source_info->scanned_dirs_info, dir))
-    {
-        dir_info = g_new0 (SourceDirInfo, 1);
+typedef struct
+{
+    GFile *dir;
+    gboolean opened;
+    GArray *children;           /* of ScannedChild */
+    GError *error;
+} ScannedDir;
 
-        g_hash_table_insert (source_info->scanned_dirs_info,
-                             g_object_ref (dir),
-                             dir_info);
-    }
+static void
+scanned_child_clear (ScannedChild *child)
+{
+    g_free (child->name);
+}
 
-    /* Stash a copy of the struct to restore state before goto retry. Note that
-     * this assumes the code below does not access any pointer member */
-    saved_info = *source_info;
+static void
+scanned_dir_free (ScannedDir *scanned)
+{
+    g_object_unref (scanned->dir);
+    g_clear_pointer (&scanned->children, g_array_unref);
+    g_clear_error (&scanned->error);
+    g_free (scanned);
+}
 
-retry:
+/* Runs in the threads of the pool. */
+static void
+scan_dir_thread (gpointer data,
+                 gpointer user_data)
+{
+    ScannedDir *scanned = data;
+    SourceScan *scan = user_data;
+    NautilusDirectoryReader *reader;
+    const NautilusDirectoryEntry *entry;
+    ScannedChild child;
 
-    if (dir_info != NULL)
+    reader = nautilus_directory_reader_new (scanned->dir,
+                                            scan->fields,
+                                            scan->cancellable,
+                                            &scanned->error);
+    if (reader != NULL)
     {
-        dir_info->num_files_children = 0;
-        dir_info->num_bytes_children = 0;
-    }
+        scanned->opened = TRUE;
+        scanned->children = g_array_new (FALSE, FALSE, sizeof (ScannedChild));
+        g_array_set_clear_func (scanned->children, (GDestroyNotify) scanned_child_clear);
 
-    error = NULL;
-    enumerator = g_file_enumerate_children (dir,
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                            job->cancellable,
-                                            &error);
-    if (enumerator)
-    {
-        error = NULL;
-        while ((info = g_file_enumerator_next_file (enumerator, job->cancellable, &error)) != NULL)
+        while ((entry = nautilus_directory_reader_next (reader, &scanned->error)) != NULL)
         {
-            count_file (info, job, source_info, dir_info);
+            child.name = g_strdup (entry->name);
+            child.type = entry->type;
+            child.size = entry->size;
+            child.inode = entry->inode;
+            g_array_append_val (scanned->children, child);
+        }
+        nautilus_directory_reader_free (reader);
+    }
 
-            if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
-            {
-                subdir = g_file_get_child (dir,
-                                           g_file_info_get_name (info));
+    g_async_queue_push (scan->done, scanned);
+}
 
-                subdirs = g_list_prepend (subdirs, subdir);
-            }
+static void
+scan_dir (GFile      *dir,
+          SourceScan *scan)
+{
+    ScannedDir *scanned;
 
-            g_object_unref (info);
-        }
-        g_file_enumerator_close (enumerator, job->cancellable, NULL);
-        g_object_unref (enumerator);
+    scanned = g_new0 (ScannedDir, 1);
+    scanned->dir = g_object_ref (dir);
 
-        if (error && IS_IO_ERROR (error, CANCELLED))
-        {
-            g_error_free (error);
-        }
-        else if (error)
-        {
-            g_autofree gchar *basename = NULL;
+    scan->in_flight++;
+    g_thread_pool_push (scan->pool, scanned, NULL);
+}
 
-            primary = get_scan_primary (source_info->op);
-            details = NULL;
-            basename = get_basename (dir);
+static gint
+compare_scanned_children_by_inode (gconstpointer a,
+                                   gconstpointer b)
+{
+    const ScannedChild *child_a = a;
+    const ScannedChild *child_b = b;
 
-            if (IS_IO_ERROR (error, PERMISSION_DENIED))
-            {
-                secondary = g_strdup_printf (_("Files in the folder “%s” cannot be handled "
-                                               "because you do not have permissions to see them."),
-                                             basename);
-            }
-            else
-            {
-                secondary = g_strdup_printf (_("There was an error getting information about the "
-                                               "files in the folder “%s”."), basename);
-                details = error->message;
-            }
+    return child_a->inode < child_b->inode ? -1 : child_a->inode > child_b->inode;
+}
 
-            response = run_warning (job,
-                                    primary,
-                                    secondary,
-                                    details,
-                                    FALSE,
-                                    CANCEL, RETRY, SKIP,
-                                    NULL);
+static void
+scan_dir_complete (ScannedDir *scanned,
+                   SourceInfo *source_info,
+                   CommonJob  *job,
+                   SourceScan *scan)
+{
+    GFile *dir;
+    GFile *subdir;
+    ScannedChild *child;
+    char *primary, *secondary, *details;
+    int response;
+    SourceDirInfo *dir_info = NULL;
+    gboolean keep_children;
+    gsize children_size;
 
-            g_error_free (error);
+    dir = scanned->dir;
 
-            if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT)
-            {
-                abort_job (job);
-                skip_subdirs = TRUE;
-            }
-            else if (response == 1)
-            {
-                g_clear_list (&subdirs, g_object_unref);
-                *source_info = saved_info;
-                goto retry;
-            }
-            else if (response == 2)
-            {
-                skip_readdir_error (job, dir);
-            }
-            else
-            {
-                g_assert_not_reached ();
-            }
-        }
-    }
-    else if (job->skip_all_error)
-    {
-        g_error_free (error);
-        skip_file (job, dir);
-        skip_subdirs = TRUE;
-    }
-    else if (IS_IO_ERROR (error, CANCELLED))
-    {
-        g_error_free (error);
-    }
-    else
+    if (!scanned->opened)
     {
         g_autofree gchar *basename = NULL;
 
+        if (job->skip_all_error)
+        {
+            skip_file (job, dir);
+            return;
+        }
+        if (IS_IO_ERROR (scanned->error, CANCELLED))
+        {
+            return;
+        }
+
         primary = get_scan_primary (source_info->op);
         details = NULL;
         basename = get_basename (dir);
-        if (IS_IO_ERROR (error, PERMISSION_DENIED))
+        if (IS_IO_ERROR (scanned->error, PERMISSION_DENIED))
         {
             secondary = g_strdup_printf (_("The folder “%s” cannot be handled because you "
                                            "do not have permissions to read it."),
@@ -3531,7 +4358,7 @@ retry:
         {
             secondary = g_strdup_printf (_("There was an error reading the folder “%s”."),
                                          basename);
-            details = error->message;
+            details = scanned->error->message;
         }
         /* set show_all to TRUE here, as we don't know how many
          * files we'll end up processing yet.
@@ -3544,12 +4371,9 @@ retry:
                                 CANCEL, SKIP_ALL, SKIP, RETRY,
                                 NULL);
 
-        g_error_free (error);
-
         if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT)
         {
             abort_job (job);
-            skip_subdirs = TRUE;
         }
         else if (response == 1 || response == 2)
         {
@@ -3558,47 +4382,128 @@ retry:
                 job->skip_all_error = TRUE;
             }
             skip_file (job, dir);
-            skip_subdirs = TRUE;
         }
         else if (response == 3)
         {
-            goto retry;
+            scan_dir (dir, scan);
         }
         else
         {
             g_assert_not_reached ();
         }
+
+        return;
     }
 
-    if (!skip_subdirs)
+    if (scanned->error != NULL && !IS_IO_ERROR (scanned->error, CANCELLED))
     {
-        while (subdirs != NULL)
+        g_autofree gchar *basename = NULL;
+
+        primary = get_scan_primary (source_info->op);
+        details = NULL;
+        basename = get_basename (dir);
+
+        if (IS_IO_ERROR (scanned->error, PERMISSION_DENIED))
+        {
+            secondary = g_strdup_printf (_("Files in the folder “%s” cannot be handled "
+                                           "because you do not have permissions to see them."),
+                                         basename);
+        }
+        else
+        {
+            secondary = g_strdup_printf (_("There was an error getting information about the "
+                                           "files in the folder “%s”."), basename);
+            details = scanned->error->message;
+        }
+
+        response = run_warning (job,
+                                primary,
+                                secondary,
+                                details,
+                                FALSE,
+                                CANCEL, RETRY, SKIP,
+                                NULL);
+
+        if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT)
+        {
+            abort_job (job);
+            return;
+        }
+        else if (response == 1)
+        {
+            scan_dir (dir, scan);
+            return;
+        }
+        else if (response == 2)
+        {
+            skip_readdir_error (job, dir);
+        }
+        else
+        {
+            g_assert_not_reached ();
+        }
+    }
+
+    /* It is possible for a directory to be scanned more than once. We
+     * pass a NULL SourceDirInfo into count_file() if this directory has
+     * already been scanned once so that its children are not counted more
+     * than once in the SourceDirInfo corresponding to this directory.
+     */
+    if (!g_hash_table_contains (source_info->scanned_dirs_info, dir))
+    {
+        dir_info = g_new0 (SourceDirInfo, 1);
+
+        g_hash_table_insert (source_info->scanned_dirs_info,
+                             g_object_ref (dir),
+                             dir_info);
+    }
+
+    children_size = 0;
+    for (guint i = 0; i < scanned->children->len; i++)
+    {
+        child = &g_array_index (scanned->children, ScannedChild, i);
+
+        count_file (child->size, job, source_info, dir_info);
+        children_size += sizeof (ScannedChild) + strlen (child->name) + 1;
+
+        if (child->type == G_FILE_TYPE_DIRECTORY)
         {
-            GList *l = subdirs;
-            subdirs = g_list_remove_link (subdirs, l);
+            subdir = g_file_get_child (dir, child->name);
+            scan_dir (subdir, scan);
+            g_object_unref (subdir);
+        }
+    }
 
-            /* Push to head, since we want depth-first */
-            g_queue_push_head_link (dirs, l);
+    /* The copy goes through the children again, which it doesn't need to
+     * list once more, unless they are not all there. */
+    keep_children = dir_info != NULL &&
+                    scanned->error == NULL &&
+                    (source_info->op == OP_KIND_COPY || source_info->op == OP_KIND_MOVE) &&
+                    source_info->kept_children_size + children_size <= SCAN_MAX_KEPT_CHILDREN_SIZE;
+    if (keep_children)
+    {
+        if (source_info->disk_order)
+        {
+            g_array_sort (scanned->children, compare_scanned_children_by_inode);
         }
+        dir_info->children = g_steal_pointer (&scanned->children);
+        source_info->kept_children_size += children_size;
     }
 }
 
 static void
 scan_file (GFile      *file,
            SourceInfo *source_info,
-           CommonJob  *job)
+           CommonJob  *job,
+           SourceScan *scan)
 {
     GFileInfo *info;
     GError *error;
-    GQueue *dirs;
-    GFile *dir;
     char *primary;
     char *secondary;
     char *details;
     int response;
 
-    dirs = g_queue_new ();
-
 retry:
     error = NULL;
     info = g_file_query_info (file,
@@ -3610,13 +4515,13 @@ retry:
 
     if (info)
     {
-        count_file (info, job, source_info, NULL);
+        count_file (g_file_info_get_size (info), job, source_info, NULL);
 
         /* trashing operation doesn't recurse */
         if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY &&
             source_info->op != OP_KIND_TRASH)
         {
-            g_queue_push_head (dirs, g_object_ref (file));
+            scan_dir (file, scan);
         }
         g_object_unref (info);
     }
@@ -3682,17 +4587,6 @@ retry:
             g_assert_not_reached ();
         }
     }
-
-    while (!job_aborted (job) &&
-           (dir = g_queue_pop_head (dirs)) != NULL)
-    {
-        scan_dir (dir, source_info, job, dirs);
-        g_object_unref (dir);
-    }
-
-    /* Free all from queue if we exited early */
-    g_queue_foreach (dirs, (GFunc) g_object_unref, NULL);
-    g_queue_free (dirs);
 }
 
 static void
@@ -3703,12 +4597,24 @@ scan_sources (GList      *files,
 {
     GList *l;
     GFile *file;
+    SourceScan scan = { 0 };
+    ScannedDir *scanned;
 
     source_info->op = kind;
     source_info->scanned_dirs_info = g_hash_table_new_full (g_file_hash,
                                                             (GEqualFunc) g_file_equal,
                                                             (GDestroyNotify) g_object_unref,
-                                                            (GDestroyNotify) g_free);
+                                                            (GDestroyNotify) source_dir_info_free);
+
+    scan.done = g_async_queue_new ();
+    scan.cancellable = job->cancellable;
+    scan.fields = NAUTILUS_DIRECTORY_READER_TYPE | NAUTILUS_DIRECTORY_READER_SIZE;
+    if (source_info->disk_order)
+    {
+        scan.fields |= NAUTILUS_DIRECTORY_READER_IDS;
+    }
+    scan.pool = g_thread_pool_new (scan_dir_thread, &scan,
+                                   SCAN_MAX_THREADS, FALSE, NULL);
 
     report_preparing_count_progress (job, source_info);
 
@@ -3718,9 +4624,26 @@ scan_sources (GList      *files,
 
         scan_file (file,
                    source_info,
-                   job);
+                   job,
+                   &scan);
+    }
+
+    /* Once aborted, what is left is only waited for. */
+    while (scan.in_flight > 0)
+    {
+        scanned = g_async_queue_pop (scan.done);
+        scan.in_flight--;
+
+        if (!job_aborted (job))
+        {
+            scan_dir_complete (scanned, source_info, job, &scan);
+        }
+        scanned_dir_free (scanned);
     }
 
+    g_thread_pool_free (scan.pool, FALSE, TRUE);
+    g_async_queue_unref (scan.done);
+
     /* Make sure we report the final count */
     report_preparing_count_progress (job, source_info);
 }
@@ -3946,10 +4869,10 @@ report_copy_progress (CopyMoveJob  *copy_job,
                       TransferInfo *transfer_info)
 {
     int files_left;
+    goffset num_bytes;
     goffset total_size;
     double elapsed, transfer_rate;
     int remaining_time;
-    guint64 now;
     CommonJob *job;
     gboolean is_move;
     gchar *status;
@@ -3960,8 +4883,6 @@ report_copy_progress (CopyMoveJob  *copy_job,
 
     is_move = copy_job->is_move;
 
-    now = g_get_monotonic_time ();
-
     files_left = source_info->num_files - transfer_info->num_files;
 
     /* Races and whatnot could cause this to be negative... */
@@ -3970,16 +4891,14 @@ report_copy_progress (CopyMoveJob  *copy_job,
         files_left = 0;
     }
 
-    /* If the number of files left is 0, we want to update the status without
-     * considering this time, since we want to change the status to completed
-     * and probably we won't get more calls to this function */
-    if (transfer_info->last_report_time != 0 &&
-        ABS ((gint64) (transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
-        files_left > 0)
+    if (!transfer_info_report_due (transfer_info, files_left))
     {
         return;
     }
-    transfer_info->last_report_time = now;
+
+    num_bytes = transfer_info->num_bytes +
+                (gssize) g_atomic_pointer_get (&transfer_info->pending_bytes);
+    nautilus_progress_info_set_transferred (job->progress, transfer_info->num_files, num_bytes);
 
     if (files_left != transfer_info->last_reported_files_left ||
         transfer_info->last_reported_files_left == 0)
@@ -4146,17 +5065,17 @@ report_copy_progress (CopyMoveJob  *copy_job,
         }
     }
 
-    total_size = MAX (source_info->num_bytes, transfer_info->num_bytes);
+    total_size = MAX (source_info->num_bytes, num_bytes);
 
     elapsed = g_timer_elapsed (job->time, NULL);
     transfer_rate = 0;
     remaining_time = INT_MAX;
     if (elapsed > 0)
     {
-        transfer_rate = transfer_info->num_bytes / elapsed;
+        transfer_rate = num_bytes / elapsed;
         if (transfer_rate > 0)
         {
-            remaining_time = (total_size - transfer_info->num_bytes) / transfer_rate;
+            remaining_time = (total_size - num_bytes) / transfer_rate;
         }
     }
 
@@ -4169,7 +5088,7 @@ report_copy_progress (CopyMoveJob  *copy_job,
             g_autofree gchar *formatted_size_num_bytes = NULL;
             g_autofree gchar *formatted_size_total_size = NULL;
 
-            formatted_size_num_bytes = g_format_size (transfer_info->num_bytes);
+            formatted_size_num_bytes = g_format_size (num_bytes);
             formatted_size_total_size = g_format_size (total_size);
             /* To translators: %s will expand to a size like "2 bytes" or "3 MB", so something like "4 kb / 4 MB" */
             details = g_strdup_printf (_("%s / %s"),
@@ -4208,7 +5127,7 @@ report_copy_progress (CopyMoveJob  *copy_job,
                 g_autofree gchar *formatted_size_transfer_rate = NULL;
 
                 formatted_time = get_formatted_time (remaining_time);
-                formatted_size_num_bytes = g_format_size (transfer_info->num_bytes);
+                formatted_size_num_bytes = g_format_size (num_bytes);
                 formatted_size_total_size = g_format_size (total_size);
                 formatted_size_transfer_rate = g_format_size ((goffset) transfer_rate);
                 /* To translators: %s will expand to a size like "2 bytes" or "3 MB", %s to a time duration like
@@ -4229,7 +5148,7 @@ report_copy_progress (CopyMoveJob  *copy_job,
                 g_autofree gchar *formatted_size_num_bytes = NULL;
                 g_autofree gchar *formatted_size_total_size = NULL;
 
-                formatted_size_num_bytes = g_format_size (transfer_info->num_bytes);
+                formatted_size_num_bytes = g_format_size (num_bytes);
                 formatted_size_total_size = g_format_size (total_size);
                 /* To translators: %s will expand to a size like "2 bytes" or "3 MB". */
                 details = g_strdup_printf (_("%s / %s"),
@@ -4267,6 +5186,72 @@ report_copy_progress (CopyMoveJob  *copy_job,
             }
         }
     }
+    if (transfer_info->copy_mode != COPY_MODE_STREAM)
+    {
+        g_autofree gchar *plain_details = NULL;
+        const char *mode;
+
+        plain_details = details;
+        if (transfer_info->copy_mode == COPY_MODE_REFLINK)
+        {
+            /* To translators: shown after the progress of a copy which only
+             * made the new files share the contents of the originals. */
+            mode = _("cloned");
+        }
+        else if (transfer_info->copy_mode == COPY_MODE_DIRECT)
+        {
+            /* To translators: shown after the progress of a copy which
+             * doesn't go through the cache of the system. */
+            mode = _("direct I/O");
+        }
+        else if (transfer_info->copy_mode == COPY_MODE_SERVER)
+        {
+            /* To translators: shown after the progress of a copy between two
+             * folders of a server, done by the server itself. */
+            mode = _("server-side copy");
+        }
+        else if (transfer_info->copy_mode == COPY_MODE_RELAYED)
+        {
+            /* To translators: shown after the progress of a copy between two
+             * folders of a server which the server couldn't do itself, so
+             * the contents go through this computer. */
+            mode = _("copied through this computer");
+        }
+        else
+        {
+            /* To translators: shown after the progress of a copy done by
+             * the system, without reading the contents of the files. */
+            mode = _("in-kernel copy");
+        }
+        /* To translators: the first %s is the progress of the operation, like
+         * "2 kb / 4 MB -- 2 hours left (4kb/sec)", and the second one the way
+         * the files are copied, like "cloned". */
+        details = g_strdup_printf (_("%s \xE2\x80\x94 %s"), plain_details, mode);
+    }
+    if (transfer_info->verify && files_left == 0)
+    {
+        g_autofree gchar *plain_details = NULL;
+        int num_unverified;
+
+        plain_details = details;
+        num_unverified = transfer_info->num_files - transfer_info->num_verified;
+        if (num_unverified > 0)
+        {
+            /* To translators: shown once a copy is done, after its progress,
+             * the %'d being the number of files which could not be compared
+             * with their original, like those copied to a phone. */
+            details = g_strdup_printf (ngettext ("%s \xE2\x80\x94 %'d file not verified",
+                                                 "%s \xE2\x80\x94 %'d files not verified",
+                                                 num_unverified),
+                                       plain_details, num_unverified);
+        }
+        else
+        {
+            /* To translators: shown once a copy is done, after its progress,
+             * when all its files were compared with their original. */
+            details = g_strdup_printf (_("%s \xE2\x80\x94 verified"), plain_details);
+        }
+    }
     nautilus_progress_info_take_details (job->progress, details);
 
     if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE)
@@ -4277,7 +5262,7 @@ report_copy_progress (CopyMoveJob  *copy_job,
                                                  elapsed);
     }
 
-    nautilus_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
+    nautilus_progress_info_set_progress (job->progress, num_bytes, total_size);
 }
 #pragma GCC diagnostic pop
 
@@ -4415,6 +5400,80 @@ get_unique_target_file (GFile      *src,
     return dest;
 }
 
+/* Returns the names in @dest_dir, listed the first time it is asked for, or
+ * NULL if it couldn't be listed. */
+static GHashTable *
+get_taken_names (CopyMoveJob *job,
+                 GFile       *dest_dir)
+{
+    g_autoptr (NautilusDirectoryReader) reader = NULL;
+    const NautilusDirectoryEntry *entry;
+    GHashTable *names;
+
+    if (job->taken_names == NULL)
+    {
+        job->taken_names = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                                  g_object_unref,
+                                                  (GDestroyNotify) g_hash_table_unref);
+    }
+
+    if (g_hash_table_lookup_extended (job->taken_names, dest_dir, NULL, (gpointer *) &names))
+    {
+        return names;
+    }
+
+    names = NULL;
+    reader = nautilus_directory_reader_new (dest_dir, 0, job->common.cancellable, NULL);
+    if (reader != NULL)
+    {
+        names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        while ((entry = nautilus_directory_reader_next (reader, NULL)) != NULL)
+        {
+            g_hash_table_add (names, g_strdup (entry->name));
+        }
+    }
+
+    g_hash_table_insert (job->taken_names, g_object_ref (dest_dir), names);
+
+    return names;
+}
+
+/* Same as get_unique_target_file(), but skips the names already taken in
+ * @dest_dir, going through as many counts as that takes. The copy still
+ * fails if the name turns out to be taken anyway, and another one is
+ * picked then. */
+static GFile *
+get_untaken_unique_target_file (CopyMoveJob *job,
+                                GFile       *src,
+                                GFile       *dest_dir,
+                                gboolean     same_fs,
+                                const char  *dest_fs_type,
+                                int         *count)
+{
+    GHashTable *names;
+    GFile *dest;
+    char *basename;
+
+    names = get_taken_names (job, dest_dir);
+
+    while (TRUE)
+    {
+        dest = get_unique_target_file (src, dest_dir, same_fs, dest_fs_type, (*count)++);
+        if (names == NULL)
+        {
+            return dest;
+        }
+
+        basename = g_file_get_basename (dest);
+        if (g_hash_table_add (names, basename))
+        {
+            return dest;
+        }
+
+        g_object_unref (dest);
+    }
+}
+
 static GFile *
 get_target_file_for_link (GFile      *src,
                           GFile      *dest_dir,
@@ -4699,6 +5758,8 @@ static void copy_move_file (CopyMoveJob  *job,
                             gboolean      overwrite,
                             gboolean     *skipped_file,
                             gboolean      readonly_source_fs);
+static gboolean test_dir_is_parent (GFile *child,
+                                    GFile *root);
 
 typedef enum
 {
@@ -4760,85 +5821,1818 @@ retry:
         {
             handled_invalid_filename = TRUE;
 
-            g_assert (*dest_fs_type == NULL);
+            g_assert (*dest_fs_type == NULL);
+
+            dest_dir = g_file_get_parent (*dest);
+
+            if (dest_dir != NULL)
+            {
+                *dest_fs_type = query_fs_type (dest_dir, job->cancellable);
+
+                new_dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
+                g_object_unref (dest_dir);
+
+                if (!g_file_equal (*dest, new_dest))
+                {
+                    g_object_unref (*dest);
+                    *dest = new_dest;
+                    g_error_free (error);
+                    return CREATE_DEST_DIR_RETRY;
+                }
+                else
+                {
+                    g_object_unref (new_dest);
+                }
+            }
+        }
+
+        primary = g_strdup (_("Error while copying."));
+        details = NULL;
+        basename = get_basename (src);
+
+        if (IS_IO_ERROR (error, PERMISSION_DENIED))
+        {
+            secondary = g_strdup_printf (_("The folder “%s” cannot be copied because you do not "
+                                           "have permissions to create it in the destination."),
+                                         basename);
+        }
+        else
+        {
+            secondary = g_strdup_printf (_("There was an error creating the folder “%s”."),
+                                         basename);
+            details = error->message;
+        }
+
+        response = run_warning (job,
+                                primary,
+                                secondary,
+                                details,
+                                FALSE,
+                                CANCEL, SKIP, RETRY,
+                                NULL);
+
+        g_error_free (error);
+
+        if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT)
+        {
+            abort_job (job);
+        }
+        else if (response == 1)
+        {
+            /* Skip: Do Nothing  */
+        }
+        else if (response == 2)
+        {
+            goto retry;
+        }
+        else
+        {
+            g_assert_not_reached ();
+        }
+        return CREATE_DEST_DIR_FAILED;
+    }
+    nautilus_file_changes_queue_file_added (*dest);
+
+    if (job->undo_info != NULL)
+    {
+        nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+                                                            src, *dest);
+    }
+
+    return CREATE_DEST_DIR_SUCCESS;
+}
+
+/* Sparse files, like disk images, take less room than their size. Their
+ * holes are found with SEEK_DATA and SEEK_HOLE, and left as holes in the
+ * copies made here, which only read and write what is in between. That is
+ * still counted as the whole size in the progress. */
+static gboolean
+stat_is_sparse (const struct stat *st)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    return (goffset) st->st_blocks * 512 < st->st_size;
+#else
+    return FALSE;
+#endif
+}
+
+/* Returns where the first data of @fd from @offset starts, or @size when
+ * there's only a hole left, and sets @data_end to where it stops. */
+static goffset
+find_next_data (int      fd,
+                goffset  offset,
+                goffset  size,
+                goffset *data_end)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    goffset data;
+    goffset hole;
+
+    *data_end = size;
+
+    data = lseek (fd, offset, SEEK_DATA);
+    if (data < 0)
+    {
+        /* Anything but ENXIO, which is for the hole at the end, means
+         * that the holes can't be found. */
+        return errno == ENXIO ? size : offset;
+    }
+
+    hole = lseek (fd, data, SEEK_HOLE);
+    if (hole >= 0)
+    {
+        *data_end = MIN (hole, size);
+    }
+
+    return MIN (data, size);
+#else
+    *data_end = size;
+    return offset;
+#endif
+}
+
+/* Opens @src and creates @dest for the copies done here rather than by
+ * g_file_copy(), when both are local, @src is a regular file of at least
+ * @min_size bytes, or a sparse one, and nothing is in the way at @dest.
+ * Whatever else is left to g_file_copy(), which also reports what is
+ * already there. */
+static gboolean
+open_local_copy (GFile           *src,
+                 GFile           *dest,
+                 GFileCopyFlags   flags,
+                 goffset          min_size,
+                 int             *src_fd,
+                 int             *dest_fd,
+                 struct stat     *src_stat,
+                 char           **dest_path)
+{
+    g_autofree char *src_path = NULL;
+    g_autofree char *path = NULL;
+
+    /* Replacing a file takes the backups and the atomic renames of
+     * g_file_copy(). */
+    if (flags & G_FILE_COPY_OVERWRITE)
+    {
+        return FALSE;
+    }
+
+    src_path = g_file_get_path (src);
+    path = g_file_get_path (dest);
+    if (src_path == NULL || path == NULL)
+    {
+        return FALSE;
+    }
+
+    *src_fd = open (src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (*src_fd < 0)
+    {
+        return FALSE;
+    }
+    if (fstat (*src_fd, src_stat) != 0 ||
+        !S_ISREG (src_stat->st_mode) ||
+        (src_stat->st_size < min_size && !stat_is_sparse (src_stat)))
+    {
+        close (*src_fd);
+        return FALSE;
+    }
+
+    *dest_fd = open (path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                     (flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) ? 0666 : src_stat->st_mode & 0777);
+    if (*dest_fd < 0)
+    {
+        close (*src_fd);
+        return FALSE;
+    }
+
+    *dest_path = g_steal_pointer (&path);
+
+    return TRUE;
+}
+
+/* Closes what open_local_copy() opened. A copy which is not @done is
+ * removed, and only reported if it was cancelled. */
+static gboolean
+close_local_copy (GFile                  *src,
+                  GFile                  *dest,
+                  GFileCopyFlags          flags,
+                  int                     src_fd,
+                  int                     dest_fd,
+                  const char             *dest_path,
+                  const struct stat      *src_stat,
+                  gboolean                done,
+                  GCancellable           *cancellable,
+                  GFileProgressCallback   progress_callback,
+                  gpointer                progress_callback_data,
+                  GError                **error)
+{
+    close (src_fd);
+    if (close (dest_fd) != 0)
+    {
+        done = FALSE;
+    }
+
+    if (!done)
+    {
+        unlink (dest_path);
+        g_cancellable_set_error_if_cancelled (cancellable, error);
+        return FALSE;
+    }
+
+    /* As g_file_copy(), failing to copy those is not an error. */
+    g_file_copy_attributes (src, dest, flags, cancellable, NULL);
+
+    if (progress_callback != NULL)
+    {
+        progress_callback (src_stat->st_size, src_stat->st_size, progress_callback_data);
+    }
+
+    return TRUE;
+}
+
+/* The bytes copied by copy_file_range() between two progress reports */
+#define KERNEL_COPY_CHUNK_SIZE (8 * 1024 * 1024)
+
+#ifdef HAVE_COPY_FILE_RANGE
+/* Has the kernel copy what is between the holes of @src_fd only. */
+static gboolean
+copy_sparse_file_range (int                     src_fd,
+                        int                     dest_fd,
+                        goffset                 size,
+                        GCancellable           *cancellable,
+                        GFileProgressCallback   progress_callback,
+                        gpointer                progress_callback_data)
+{
+    goffset offset;
+    goffset data_end;
+    loff_t src_offset;
+    loff_t dest_offset;
+    ssize_t n;
+
+    offset = 0;
+    while (offset < size)
+    {
+        src_offset = find_next_data (src_fd, offset, size, &data_end);
+        dest_offset = src_offset;
+
+        while (src_offset < data_end)
+        {
+            if (g_cancellable_is_cancelled (cancellable))
+            {
+                return FALSE;
+            }
+
+            n = copy_file_range (src_fd, &src_offset, dest_fd, &dest_offset,
+                                 MIN (KERNEL_COPY_CHUNK_SIZE, data_end - src_offset), 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return FALSE;
+            }
+
+            if (progress_callback != NULL)
+            {
+                progress_callback (src_offset, size, progress_callback_data);
+            }
+        }
+
+        offset = MAX (data_end, offset + 1);
+    }
+
+    /* For the hole at the end */
+    return ftruncate (dest_fd, size) == 0;
+}
+#endif
+
+/* Local files copied within a filesystem first try to share the extents of
+ * the source, and then, unless @clone_only, to be copied by the kernel,
+ * which both avoid going through userspace with the contents. This is all
+ * or nothing: FALSE without an error means that nothing was left at @dest
+ * and that the copy has to be done the usual way.
+ */
+static gboolean
+copy_file_in_kernel (GFile                  *src,
+                     GFile                  *dest,
+                     GFileCopyFlags          flags,
+                     gboolean                clone_only,
+                     GCancellable           *cancellable,
+                     GFileProgressCallback   progress_callback,
+                     gpointer                progress_callback_data,
+                     CopyMode               *mode,
+                     GError                **error)
+{
+#if defined(HAVE_FICLONE) || defined(HAVE_COPY_FILE_RANGE)
+    g_autofree char *dest_path = NULL;
+    struct stat src_stat;
+    int src_fd;
+    int dest_fd;
+    gboolean done;
+
+    if (!open_local_copy (src, dest, flags, 0, &src_fd, &dest_fd, &src_stat, &dest_path))
+    {
+        return FALSE;
+    }
+
+    done = FALSE;
+
+#ifdef HAVE_FICLONE
+    if (ioctl (dest_fd, FICLONE, src_fd) == 0)
+    {
+        *mode = COPY_MODE_REFLINK;
+        done = TRUE;
+    }
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    if (!done && !clone_only && stat_is_sparse (&src_stat))
+    {
+        done = copy_sparse_file_range (src_fd, dest_fd, src_stat.st_size, cancellable,
+                                       progress_callback, progress_callback_data);
+        if (done)
+        {
+            *mode = COPY_MODE_KERNEL;
+        }
+    }
+    else if (!done && !clone_only)
+    {
+        goffset copied;
+        ssize_t n;
+
+        copied = 0;
+        while (!g_cancellable_is_cancelled (cancellable))
+        {
+            n = copy_file_range (src_fd, NULL, dest_fd, NULL, KERNEL_COPY_CHUNK_SIZE, 0);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            if (n == 0)
+            {
+                /* Some filesystems claim to be done right away instead of
+                 * failing, leave those to g_file_copy(). */
+                done = copied > 0 || src_stat.st_size == 0;
+                break;
+            }
+
+            copied += n;
+            if (progress_callback != NULL)
+            {
+                progress_callback (copied, src_stat.st_size, progress_callback_data);
+            }
+        }
+
+        if (done)
+        {
+            *mode = COPY_MODE_KERNEL;
+        }
+    }
+#endif
+
+    return close_local_copy (src, dest, flags, src_fd, dest_fd, dest_path, &src_stat, done,
+                             cancellable, progress_callback, progress_callback_data,
+                             error);
+#else
+    return FALSE;
+#endif
+}
+
+/* Big files going to another filesystem, like a USB stick, are copied with
+ * bigger buffers than g_file_copy() uses, one being read by a thread while
+ * the other one is written. So that they don't push everything else out of
+ * the page cache, they are either dropped from it as they go, or not put
+ * there at all with direct I/O.
+ *
+ * When the copies are verified, and the copy goes to a filesystem whose
+ * data goes through a daemon or the network, the reading thread hashes
+ * what it reads, and the copy is read back to be hashed too once written.
+ * Elsewhere a write which made it to the disk is taken at its word.
+ *
+ * The holes of sparse files are skipped by the reading thread, each buffer
+ * being written where it was read, and the copy is given its whole size in
+ * the end.
+ */
+#define LARGE_COPY_BUFFER_SIZE (8 * 1024 * 1024)
+#define LARGE_COPY_N_BUFFERS 2
+/* Of the buffers, offsets and sizes, as asked by direct I/O */
+#define LARGE_COPY_ALIGNMENT 4096
+
+typedef struct
+{
+    guchar *data;
+    /* The negated errno when reading failed */
+    gssize length;
+    goffset offset;
+    gboolean last;
+} LargeCopyBuffer;
+
+typedef struct
+{
+    int fd;
+    goffset start_offset;
+    goffset size;
+    gsize buffer_size;
+    gboolean drop_cache;
+    gboolean sparse;
+    /* Of what was read, when verifying */
+    GChecksum *checksum;
+    gint stop;
+    GAsyncQueue *free_buffers;
+    GAsyncQueue *full_buffers;
+} LargeCopyReader;
+
+/* The holes read as zeros, which is what is hashed for them. */
+static void
+checksum_update_zeros (GChecksum *checksum,
+                       goffset    length)
+{
+    static const guchar zeros[64 * 1024];
+
+    while (length > 0)
+    {
+        g_checksum_update (checksum, zeros, MIN (length, (goffset) sizeof (zeros)));
+        length -= MIN (length, (goffset) sizeof (zeros));
+    }
+}
+
+/* Moves the reader past the hole at @offset, if any, and returns how much
+ * it may read from there without going into the next one. The offsets
+ * stay aligned for direct I/O, a few zeros being read instead. */
+static gsize
+large_copy_skip_hole (LargeCopyReader *reader,
+                      goffset         *offset)
+{
+    goffset data;
+    goffset data_end;
+
+    data = find_next_data (reader->fd, *offset, reader->size, &data_end);
+    data = MAX (*offset, data / LARGE_COPY_ALIGNMENT * LARGE_COPY_ALIGNMENT);
+    data_end = (data_end + LARGE_COPY_ALIGNMENT - 1) / LARGE_COPY_ALIGNMENT * LARGE_COPY_ALIGNMENT;
+
+    if (reader->checksum != NULL)
+    {
+        checksum_update_zeros (reader->checksum, data - *offset);
+    }
+
+    *offset = data;
+    lseek (reader->fd, data, SEEK_SET);
+
+    return MIN ((goffset) reader->buffer_size, MAX (data_end - data, 0));
+}
+
+static gpointer
+large_copy_read_thread (gpointer data)
+{
+    LargeCopyReader *reader = data;
+    LargeCopyBuffer *buffer;
+    goffset offset;
+    gsize limit;
+    ssize_t n;
+
+    offset = reader->start_offset;
+    while (TRUE)
+    {
+        buffer = g_async_queue_pop (reader->free_buffers);
+        if (g_atomic_int_get (&reader->stop))
+        {
+            return NULL;
+        }
+
+        limit = reader->buffer_size;
+        if (reader->sparse)
+        {
+            limit = large_copy_skip_hole (reader, &offset);
+        }
+
+        buffer->offset = offset;
+        buffer->length = 0;
+        buffer->last = limit == 0;
+        while (buffer->length < (gssize) limit)
+        {
+            n = read (reader->fd, buffer->data + buffer->length,
+                      limit - buffer->length);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0 && errno == EINVAL &&
+                (fcntl (reader->fd, F_GETFL) & O_DIRECT) != 0)
+            {
+                /* A short read left the buffer unaligned, or the
+                 * filesystem wants another alignment. */
+                fcntl (reader->fd, F_SETFL, fcntl (reader->fd, F_GETFL) & ~O_DIRECT);
+                continue;
+            }
+            if (n < 0)
+            {
+                buffer->length = -errno;
+                buffer->last = TRUE;
+                break;
+            }
+            if (n == 0)
+            {
+                buffer->last = TRUE;
+                break;
+            }
+            buffer->length += n;
+        }
+
+        if (buffer->length > 0)
+        {
+            offset += buffer->length;
+            if (reader->drop_cache)
+            {
+                posix_fadvise (reader->fd, buffer->offset, buffer->length, POSIX_FADV_DONTNEED);
+            }
+            if (reader->checksum != NULL)
+            {
+                g_checksum_update (reader->checksum, buffer->data, buffer->length);
+            }
+        }
+
+        g_async_queue_push (reader->full_buffers, buffer);
+        if (buffer->last)
+        {
+            return NULL;
+        }
+    }
+}
+
+static gboolean
+large_copy_write (int                   fd,
+                  const LargeCopyBuffer *buffer,
+                  gboolean             *direct)
+{
+    gssize written;
+    ssize_t n;
+
+    /* Direct I/O only writes whole blocks, so the end of the file is
+     * written through the page cache. */
+    if (*direct && buffer->length % LARGE_COPY_ALIGNMENT != 0)
+    {
+        fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_DIRECT);
+        *direct = FALSE;
+    }
+
+    written = 0;
+    while (written < buffer->length)
+    {
+        n = write (fd, buffer->data + written, buffer->length - written);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && errno == EINVAL && *direct)
+        {
+            /* The filesystem wants another alignment after all. */
+            fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_DIRECT);
+            *direct = FALSE;
+            continue;
+        }
+        if (n <= 0)
+        {
+            return FALSE;
+        }
+        written += n;
+    }
+
+    return TRUE;
+}
+
+/* Whether what is written to @fd may not be what is read back, as on FUSE
+ * or on network filesystems. Local filesystems report the writes that
+ * failed. */
+static gboolean
+copy_needs_read_back (int fd)
+{
+#ifdef HAVE_FSTATFS
+    static const guint32 magics[] =
+    {
+        0x65735546,             /* FUSE */
+        0x6969,                 /* NFS */
+        0x517b,                 /* SMB */
+        0xff534d42,             /* CIFS */
+        0xfe534d42,             /* SMB2 */
+        0x01021997,             /* 9P */
+        0x00c36400,             /* Ceph */
+    };
+    struct statfs buf;
+#endif
+
+    /* For the tests, which only have local filesystems to copy to */
+    if (g_strcmp0 (g_getenv ("NAUTILUS_COPY_READ_BACK"), "always") == 0)
+    {
+        return TRUE;
+    }
+
+#ifdef HAVE_FSTATFS
+    if (fstatfs (fd, &buf) != 0)
+    {
+        return TRUE;
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS (magics); i++)
+    {
+        if ((guint32) buf.f_type == magics[i])
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+#else
+    return TRUE;
+#endif
+}
+
+static gboolean
+checksum_update_fd (GChecksum *checksum,
+                    int        fd,
+                    guchar    *data,
+                    gsize      size)
+{
+    ssize_t n;
+
+    while (TRUE)
+    {
+        n = read (fd, data, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && errno == EINVAL && (fcntl (fd, F_GETFL) & O_DIRECT) != 0)
+        {
+            fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_DIRECT);
+            continue;
+        }
+        if (n <= 0)
+        {
+            return n == 0;
+        }
+        g_checksum_update (checksum, data, n);
+    }
+}
+
+/* Reads the copy at @dest_path back from the disk with @buffer, returning
+ * whether it hashes as @src_checksum. */
+static gboolean
+large_copy_verify (int                    dest_fd,
+                   const char            *dest_path,
+                   gboolean               direct,
+                   const LargeCopyBuffer *buffer,
+                   gsize                  buffer_size,
+                   GChecksum             *src_checksum)
+{
+    g_autoptr (GChecksum) checksum = NULL;
+    gboolean read_all;
+    int fd;
+
+    /* Otherwise what is read back is what is still in memory. */
+    if (fdatasync (dest_fd) != 0)
+    {
+        return FALSE;
+    }
+    posix_fadvise (dest_fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    fd = open (dest_path, O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    read_all = checksum_update_fd (checksum, fd, buffer->data, buffer_size);
+    close (fd);
+
+    return read_all &&
+           g_strcmp0 (g_checksum_get_string (checksum),
+                      g_checksum_get_string (src_checksum)) == 0;
+}
+
+/* The buffer of the copies hashed as they stream */
+#define STREAM_COPY_BUFFER_SIZE (LARGE_COPY_ALIGNMENT * 16)
+
+/* Whether a copy streamed to @dest is to be read back, which only the
+ * local paths can be. */
+static gboolean
+stream_copy_needs_read_back (GFile *dest)
+{
+    g_autoptr (GFile) parent = NULL;
+    g_autofree char *parent_path = NULL;
+    gboolean read_back;
+    int fd;
+
+    parent = g_file_get_parent (dest);
+    if (parent != NULL)
+    {
+        parent_path = g_file_get_path (parent);
+    }
+    if (parent_path == NULL)
+    {
+        return FALSE;
+    }
+
+    fd = open (parent_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+    read_back = copy_needs_read_back (fd);
+    close (fd);
+
+    return read_back;
+}
+
+/* Writes a copy made by g_file_copy() through to the disk, setting
+ * @verified to whether it could. */
+static void
+sync_stream_copy (GFile    *dest,
+                  gboolean *verified)
+{
+    g_autofree char *dest_path = NULL;
+    struct stat dest_stat;
+    int dest_fd;
+
+    *verified = FALSE;
+
+    dest_path = g_file_get_path (dest);
+    if (dest_path == NULL)
+    {
+        return;
+    }
+
+    dest_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (dest_fd < 0)
+    {
+        return;
+    }
+    *verified = fstat (dest_fd, &dest_stat) == 0 && S_ISREG (dest_stat.st_mode) &&
+                fdatasync (dest_fd) == 0;
+    close (dest_fd);
+}
+
+/* As g_file_copy() for a regular file, hashing the original as it goes
+ * by, with which the copy read back from the disk is then compared. The
+ * original, which may be remote, is only read once that way. @verified
+ * is set to whether the copy could be read back. One which doesn't match
+ * is removed and reported.
+ */
+static gboolean
+copy_stream_read_back (GFile                  *src,
+                       GFile                  *dest,
+                       GFileCopyFlags          flags,
+                       gboolean               *verified,
+                       GCancellable           *cancellable,
+                       GFileProgressCallback   progress_callback,
+                       gpointer                progress_callback_data,
+                       GError                **error)
+{
+    g_autoptr (GFileInputStream) in = NULL;
+    g_autoptr (GFileOutputStream) out = NULL;
+    g_autoptr (GFileInfo) info = NULL;
+    g_autoptr (GChecksum) src_checksum = NULL;
+    g_autoptr (GChecksum) dest_checksum = NULL;
+    g_autoptr (GCancellable) discard = NULL;
+    g_autofree guchar *data = NULL;
+    g_autofree char *dest_path = NULL;
+    goffset size;
+    goffset copied;
+    gssize n;
+    gboolean read_all;
+    int dest_fd;
+
+    in = g_file_read (src, cancellable, error);
+    if (in == NULL)
+    {
+        return FALSE;
+    }
+    info = g_file_input_stream_query_info (in, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                           cancellable, NULL);
+    size = info != NULL ? g_file_info_get_size (info) : 0;
+
+    if ((flags & G_FILE_COPY_OVERWRITE) != 0)
+    {
+        out = g_file_replace (dest, NULL, (flags & G_FILE_COPY_BACKUP) != 0,
+                              G_FILE_CREATE_REPLACE_DESTINATION, cancellable, error);
+    }
+    else
+    {
+        out = g_file_create (dest, G_FILE_CREATE_NONE, cancellable, error);
+    }
+    if (out == NULL)
+    {
+        return FALSE;
+    }
+
+    data = g_malloc (STREAM_COPY_BUFFER_SIZE);
+    src_checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    copied = 0;
+    while ((n = g_input_stream_read (G_INPUT_STREAM (in), data, STREAM_COPY_BUFFER_SIZE,
+                                     cancellable, error)) > 0)
+    {
+        g_checksum_update (src_checksum, data, n);
+        if (!g_output_stream_write_all (G_OUTPUT_STREAM (out), data, n, NULL,
+                                        cancellable, error))
+        {
+            n = -1;
+            break;
+        }
+
+        copied += n;
+        if (progress_callback != NULL)
+        {
+            progress_callback (copied, MAX (size, copied), progress_callback_data);
+        }
+    }
+    if (n < 0)
+    {
+        /* Closed cancelled, what it replaces is left as it was. */
+        discard = g_cancellable_new ();
+        g_cancellable_cancel (discard);
+        g_output_stream_close (G_OUTPUT_STREAM (out), discard, NULL);
+        if ((flags & G_FILE_COPY_OVERWRITE) == 0)
+        {
+            g_file_delete (dest, NULL, NULL);
+        }
+        return FALSE;
+    }
+    if (!g_output_stream_close (G_OUTPUT_STREAM (out), cancellable, error))
+    {
+        return FALSE;
+    }
+    g_input_stream_close (G_INPUT_STREAM (in), NULL, NULL);
+
+    /* As g_file_copy() does, not failing the copy over the metadata */
+    g_file_copy_attributes (src, dest, flags, cancellable, NULL);
+
+    dest_path = g_file_get_path (dest);
+    if (dest_path == NULL)
+    {
+        return TRUE;
+    }
+    dest_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (dest_fd < 0)
+    {
+        return TRUE;
+    }
+    /* Otherwise what is read back is what is still in memory. */
+    if (fdatasync (dest_fd) != 0)
+    {
+        close (dest_fd);
+        return TRUE;
+    }
+    posix_fadvise (dest_fd, 0, 0, POSIX_FADV_DONTNEED);
+    dest_checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    read_all = checksum_update_fd (dest_checksum, dest_fd, data, STREAM_COPY_BUFFER_SIZE);
+    close (dest_fd);
+    if (!read_all)
+    {
+        return TRUE;
+    }
+
+    if (g_strcmp0 (g_checksum_get_string (src_checksum),
+                   g_checksum_get_string (dest_checksum)) != 0)
+    {
+        unlink (dest_path);
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                     _("The copy doesn’t match the original."));
+        return FALSE;
+    }
+
+    *verified = TRUE;
+    return TRUE;
+}
+
+/* Whether @src is a regular file, which copy_stream_read_back() copies,
+ * the others being left to g_file_copy(). */
+static gboolean
+is_regular_file (GFile          *src,
+                 GFileCopyFlags  flags,
+                 GCancellable   *cancellable)
+{
+    g_autoptr (GFileInfo) info = NULL;
+
+    info = g_file_query_info (src, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                              (flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) != 0 ?
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS : G_FILE_QUERY_INFO_NONE,
+                              cancellable, NULL);
+
+    return info != NULL && g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR;
+}
+
+/* Opens the copy of @src which an interrupted job left at @dest, written up
+ * to @offset, to go on from there. */
+static gboolean
+open_partial_copy (GFile        *src,
+                   GFile        *dest,
+                   goffset       offset,
+                   goffset       src_size,
+                   int          *src_fd,
+                   int          *dest_fd,
+                   struct stat  *src_stat,
+                   char        **dest_path)
+{
+    g_autofree char *src_path = NULL;
+    g_autofree char *path = NULL;
+    struct stat dest_stat;
+
+    src_path = g_file_get_path (src);
+    path = g_file_get_path (dest);
+    if (src_path == NULL || path == NULL)
+    {
+        return FALSE;
+    }
+
+    *src_fd = open (src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (*src_fd < 0)
+    {
+        return FALSE;
+    }
+    *dest_fd = open (path, O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (*dest_fd < 0)
+    {
+        close (*src_fd);
+        return FALSE;
+    }
+
+    if (fstat (*src_fd, src_stat) != 0 ||
+        !S_ISREG (src_stat->st_mode) ||
+        src_stat->st_size != src_size ||
+        fstat (*dest_fd, &dest_stat) != 0 ||
+        !S_ISREG (dest_stat.st_mode) ||
+        dest_stat.st_size < offset ||
+        ftruncate (*dest_fd, offset) != 0 ||
+        lseek (*src_fd, offset, SEEK_SET) != offset ||
+        lseek (*dest_fd, offset, SEEK_SET) != offset)
+    {
+        close (*src_fd);
+        close (*dest_fd);
+        return FALSE;
+    }
+
+    *dest_path = g_steal_pointer (&path);
+
+    return TRUE;
+}
+
+/* With a @journal, the copy is resumed from where it was recorded to have
+ * got, and records how far it gets. With @verified, it is verified, and
+ * that is set to whether it could be. */
+static gboolean
+copy_large_file (GFile                  *src,
+                 GFile                  *dest,
+                 GFileCopyFlags          flags,
+                 NautilusCopyJournal    *journal,
+                 gboolean               *verified,
+                 GCancellable           *cancellable,
+                 GFileProgressCallback   progress_callback,
+                 gpointer                progress_callback_data,
+                 CopyMode               *mode,
+                 GError                **error)
+{
+    NautilusLargeFileCopyMode large_mode;
+    g_autofree char *dest_path = NULL;
+    struct stat src_stat;
+    goffset resume_offset;
+    goffset partial_size;
+    goffset min_size;
+    gsize buffer_size;
+    int src_fd;
+    int dest_fd;
+    LargeCopyReader reader = { 0 };
+    LargeCopyBuffer buffers[LARGE_COPY_N_BUFFERS] = { { 0 } };
+    LargeCopyBuffer *buffer;
+    GThread *thread;
+    gboolean direct;
+    gboolean done;
+    gboolean read_back;
+    int saved_errno;
+
+    resume_offset = 0;
+    if (journal != NULL && (flags & G_FILE_COPY_OVERWRITE) == 0)
+    {
+        resume_offset = nautilus_copy_journal_get_partial (journal, src, &partial_size);
+    }
+
+    large_mode = g_settings_get_enum (nautilus_preferences,
+                                      NAUTILUS_PREFERENCES_LARGE_FILE_COPY_MODE);
+    if (large_mode == NAUTILUS_LARGE_FILE_COPY_OFF)
+    {
+        return FALSE;
+    }
+    if (resume_offset > 0)
+    {
+        if (!open_partial_copy (src, dest, resume_offset, partial_size,
+                                &src_fd, &dest_fd, &src_stat, &dest_path))
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        min_size = g_settings_get_uint64 (nautilus_preferences,
+                                          NAUTILUS_PREFERENCES_LARGE_FILE_COPY_THRESHOLD) * 1024 * 1024;
+        if (!open_local_copy (src, dest, flags, min_size,
+                              &src_fd, &dest_fd, &src_stat, &dest_path))
+        {
+            return FALSE;
+        }
+    }
+
+    /* Small files don't need the whole of the buffers. */
+    buffer_size = LARGE_COPY_BUFFER_SIZE;
+    if (src_stat.st_size < LARGE_COPY_BUFFER_SIZE)
+    {
+        buffer_size = MAX (LARGE_COPY_ALIGNMENT,
+                           (src_stat.st_size + LARGE_COPY_ALIGNMENT - 1) / LARGE_COPY_ALIGNMENT * LARGE_COPY_ALIGNMENT);
+    }
+
+    for (guint i = 0; i < LARGE_COPY_N_BUFFERS; i++)
+    {
+        if (posix_memalign ((void **) &buffers[i].data, LARGE_COPY_ALIGNMENT,
+                            buffer_size) != 0)
+        {
+            for (guint j = 0; j < i; j++)
+            {
+                free (buffers[j].data);
+            }
+            return close_local_copy (src, dest, flags, src_fd, dest_fd, dest_path, &src_stat,
+                                     FALSE, cancellable, NULL, NULL, error);
+        }
+    }
+
+    /* Not every filesystem takes direct I/O, those are written through the
+     * page cache as in the other mode. */
+    direct = large_mode == NAUTILUS_LARGE_FILE_COPY_DIRECT &&
+             fcntl (src_fd, F_SETFL, fcntl (src_fd, F_GETFL) | O_DIRECT) == 0 &&
+             fcntl (dest_fd, F_SETFL, fcntl (dest_fd, F_GETFL) | O_DIRECT) == 0;
+    *mode = direct ? COPY_MODE_DIRECT : COPY_MODE_STREAM;
+
+    posix_fadvise (src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    reader.fd = src_fd;
+    reader.start_offset = resume_offset;
+    reader.size = src_stat.st_size;
+    reader.buffer_size = buffer_size;
+    reader.drop_cache = !direct;
+    reader.sparse = stat_is_sparse (&src_stat);
+    /* What was copied before isn't read again, so can't be verified. */
+    read_back = verified != NULL && resume_offset == 0 && copy_needs_read_back (dest_fd);
+    if (read_back)
+    {
+        reader.checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    }
+    reader.free_buffers = g_async_queue_new ();
+    reader.full_buffers = g_async_queue_new ();
+    for (guint i = 0; i < LARGE_COPY_N_BUFFERS; i++)
+    {
+        g_async_queue_push (reader.free_buffers, &buffers[i]);
+    }
+    thread = g_thread_new ("nautilus-large-copy", large_copy_read_thread, &reader);
+
+    done = FALSE;
+    saved_errno = 0;
+    while (TRUE)
+    {
+        buffer = g_async_queue_pop (reader.full_buffers);
+        if (buffer->length < 0)
+        {
+            saved_errno = -buffer->length;
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                         _("Error reading from file: %s"), g_strerror (saved_errno));
+            break;
+        }
+        if (g_cancellable_is_cancelled (cancellable))
+        {
+            break;
+        }
+        if ((reader.sparse && lseek (dest_fd, buffer->offset, SEEK_SET) != buffer->offset) ||
+            !large_copy_write (dest_fd, buffer, &direct))
+        {
+            saved_errno = errno;
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                         _("Error writing to file: %s"), g_strerror (saved_errno));
+            break;
+        }
+
+        if (!direct)
+        {
+            /* This starts writing back the buffer, the pages of the one
+             * before have been written by now and are dropped. */
+            posix_fadvise (dest_fd, MAX (0, buffer->offset - (goffset) buffer_size),
+                           buffer->length + buffer_size, POSIX_FADV_DONTNEED);
+        }
+        if (progress_callback != NULL)
+        {
+            progress_callback (buffer->offset + buffer->length, src_stat.st_size,
+                               progress_callback_data);
+        }
+
+        if (buffer->last)
+        {
+            done = TRUE;
+            break;
+        }
+
+        /* What is recorded has to be on the disk already. */
+        if (journal != NULL &&
+            nautilus_copy_journal_checkpoint_due (journal) &&
+            fdatasync (dest_fd) == 0)
+        {
+            nautilus_copy_journal_set_partial (journal, src, buffer->offset + buffer->length,
+                                               src_stat.st_size);
+        }
+        g_async_queue_push (reader.free_buffers, buffer);
+    }
+
+    if (!done)
+    {
+        /* Wakes the reader up if it waits for a buffer. */
+        g_atomic_int_set (&reader.stop, TRUE);
+        g_async_queue_push (reader.free_buffers, buffer);
+    }
+    g_thread_join (thread);
+
+    /* For the hole at the end */
+    if (done && reader.sparse)
+    {
+        if (ftruncate (dest_fd, src_stat.st_size) != 0)
+        {
+            done = FALSE;
+            saved_errno = errno;
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                         _("Error writing to file: %s"), g_strerror (saved_errno));
+        }
+        else if (progress_callback != NULL)
+        {
+            progress_callback (src_stat.st_size, src_stat.st_size, progress_callback_data);
+        }
+    }
+
+    if (done && read_back)
+    {
+        if (!large_copy_verify (dest_fd, dest_path,
+                                large_mode == NAUTILUS_LARGE_FILE_COPY_DIRECT,
+                                &buffers[0], buffer_size, reader.checksum))
+        {
+            done = FALSE;
+            saved_errno = EIO;
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         _("The copy doesn’t match the original."));
+        }
+        else
+        {
+            *verified = TRUE;
+        }
+    }
+    else if (done && verified != NULL && resume_offset == 0)
+    {
+        if (fdatasync (dest_fd) != 0)
+        {
+            done = FALSE;
+            saved_errno = errno;
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                         _("Error writing to file: %s"), g_strerror (saved_errno));
+        }
+        else
+        {
+            *verified = TRUE;
+        }
+    }
+    g_clear_pointer (&reader.checksum, g_checksum_free);
+
+    g_async_queue_unref (reader.free_buffers);
+    g_async_queue_unref (reader.full_buffers);
+    for (guint i = 0; i < LARGE_COPY_N_BUFFERS; i++)
+    {
+        free (buffers[i].data);
+    }
+
+    if (!done && saved_errno != 0)
+    {
+        /* Reported as is, it would happen again the usual way. */
+        close (src_fd);
+        close (dest_fd);
+        unlink (dest_path);
+        return FALSE;
+    }
+
+    return close_local_copy (src, dest, flags, src_fd, dest_fd, dest_path, &src_stat, done,
+                             cancellable, NULL, NULL, error);
+}
+
+/* Whether @src and @dest are on the same remote server, as two folders of
+ * a NAS, even on different shares: only the backend knows whether it can
+ * copy between them without the contents going through here.
+ */
+static gboolean
+is_same_remote_server (GFile *src,
+                       GFile *dest)
+{
+    g_autofree char *src_uri = NULL;
+    g_autofree char *dest_uri = NULL;
+    g_autoptr (GUri) src_guri = NULL;
+    g_autoptr (GUri) dest_guri = NULL;
+
+    if (g_file_is_native (src) || g_file_is_native (dest))
+    {
+        return FALSE;
+    }
+
+    src_uri = g_file_get_uri (src);
+    dest_uri = g_file_get_uri (dest);
+    src_guri = g_uri_parse (src_uri, G_URI_FLAGS_NONE, NULL);
+    dest_guri = g_uri_parse (dest_uri, G_URI_FLAGS_NONE, NULL);
+    if (src_guri == NULL || dest_guri == NULL ||
+        g_uri_get_host (src_guri) == NULL || g_uri_get_host (dest_guri) == NULL)
+    {
+        return FALSE;
+    }
+
+    return g_ascii_strcasecmp (g_uri_get_scheme (src_guri), g_uri_get_scheme (dest_guri)) == 0 &&
+           g_ascii_strcasecmp (g_uri_get_host (src_guri), g_uri_get_host (dest_guri)) == 0;
+}
+
+/* Only the copy of the backend, done by the server itself where the
+ * protocol allows it, without the fallback of g_file_copy() to reading
+ * and writing back the contents, so that it is known which one copied.
+ * Fails with G_IO_ERROR_NOT_SUPPORTED when the backend can't.
+ */
+static gboolean
+copy_file_on_server (GFile                  *src,
+                     GFile                  *dest,
+                     GFileCopyFlags          flags,
+                     GCancellable           *cancellable,
+                     GFileProgressCallback   progress_callback,
+                     gpointer                progress_callback_data,
+                     GError                **error)
+{
+    GFileIface *iface;
+
+    iface = G_FILE_GET_IFACE (dest);
+    if (G_OBJECT_TYPE (src) != G_OBJECT_TYPE (dest) || iface->copy == NULL)
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Operation not supported");
+        return FALSE;
+    }
+
+    return iface->copy (src, dest, flags, cancellable,
+                        progress_callback, progress_callback_data,
+                        error);
+}
+
+/* As g_file_copy(), trying copy_file_on_server() first between folders of
+ * a remote server, copy_file_in_kernel() within a local filesystem and
+ * copy_large_file() then. @mode is set to the way it was copied.
+ *
+ * With @verified, the copy is verified, and that is set to whether it
+ * could be: the clones are the original, the local copies are written
+ * through to the disk and the ones read back are compared with it, and
+ * the others are left as they are.
+ */
+static gboolean
+copy_file_contents (GFile                  *src,
+                    GFile                  *dest,
+                    GFileCopyFlags          flags,
+                    gboolean                same_fs,
+                    NautilusCopyJournal    *journal,
+                    gboolean               *verified,
+                    GCancellable           *cancellable,
+                    GFileProgressCallback   progress_callback,
+                    gpointer                progress_callback_data,
+                    CopyMode               *mode,
+                    GError                **error)
+{
+    GError *fast_error = NULL;
+
+    if (verified != NULL)
+    {
+        *verified = FALSE;
+    }
+
+    /* The contents don't go by here then, so the copy is left as it is. */
+    if (is_same_remote_server (src, dest))
+    {
+        if (copy_file_on_server (src, dest, flags, cancellable,
+                                 progress_callback, progress_callback_data,
+                                 &fast_error))
+        {
+            *mode = COPY_MODE_SERVER;
+            return TRUE;
+        }
+        if (!g_error_matches (fast_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+            g_propagate_error (error, fast_error);
+            return FALSE;
+        }
+        g_clear_error (&fast_error);
+
+        *mode = COPY_MODE_RELAYED;
+        return g_file_copy (src, dest, flags, cancellable,
+                            progress_callback, progress_callback_data,
+                            error);
+    }
+
+    /* What the kernel copies doesn't go by to be hashed. */
+    if (same_fs &&
+        copy_file_in_kernel (src, dest, flags, verified != NULL, cancellable,
+                             progress_callback, progress_callback_data,
+                             mode, &fast_error))
+    {
+        if (verified != NULL)
+        {
+            *verified = TRUE;
+        }
+        return TRUE;
+    }
+    if (fast_error == NULL &&
+        copy_large_file (src, dest, flags, journal, verified, cancellable,
+                         progress_callback, progress_callback_data,
+                         mode, &fast_error))
+    {
+        return TRUE;
+    }
+    if (fast_error != NULL)
+    {
+        g_propagate_error (error, fast_error);
+        return FALSE;
+    }
+
+    *mode = COPY_MODE_STREAM;
+    if (verified != NULL &&
+        stream_copy_needs_read_back (dest) &&
+        is_regular_file (src, flags, cancellable))
+    {
+        return copy_stream_read_back (src, dest, flags, verified, cancellable,
+                                      progress_callback, progress_callback_data,
+                                      error);
+    }
+    if (!g_file_copy (src, dest, flags, cancellable,
+                      progress_callback, progress_callback_data,
+                      error))
+    {
+        return FALSE;
+    }
+
+    if (verified != NULL)
+    {
+        sync_stream_copy (dest, verified);
+    }
+
+    return TRUE;
+}
+
+/* Copying a lot of small files is bound by the latency of each copy, not
+ * by the bandwidth, so the small regular files met while copying local
+ * folders are copied by a few threads at once. Everything else stays in
+ * the job thread: the folders are still created in order, the threads
+ * only report back, and a copy that failed is done again the usual way,
+ * which brings up the same dialogs.
+ */
+#define COPY_PIPELINE_MAX_THREADS 8
+/* The copies waiting or running, for the destination of the job */
+#define COPY_PIPELINE_MAX_IN_FLIGHT 64
+/* The bigger files are copied in the job thread, to report their progress. */
+#define COPY_PIPELINE_MAX_FILE_SIZE (1024 * 1024)
+
+typedef struct CopyPipeline
+{
+    GThreadPool *pool;
+    GAsyncQueue *done;          /* of PipelinedCopy */
+    guint in_flight;
+    GFileCopyFlags flags;
+    /* The sources are removed once copied, by the threads too */
+    gboolean is_move;
+    /* The source folders of the moves given up on, which are to stay */
+    GHashTable *skipped_dirs;
+    GCancellable *cancellable;
+    /* The folders to set the attributes of once the copies are done, as
+     * copying into them would change their times again. Last created
+     * first. */
+    GList *pending_directories;
+} CopyPipeline;
+
+typedef struct
+{
+    GFile *src;
+    GFile *dest;
+    GFile *dest_dir;
+    char *dest_fs_type;
+    gboolean same_fs;
+    goffset size;
+    CopyMode mode;
+    GError *error;
+    /* The bytes added to the pending bytes of the TransferInfo */
+    gssize *pending_bytes;
+    goffset reported_bytes;
+    gboolean verify;
+    gboolean verified;
+} PipelinedCopy;
+
+typedef struct
+{
+    GFile *dest;
+    GFileInfo *info;
+} PendingDirectory;
+
+static void
+pipelined_copy_free (PipelinedCopy *copy)
+{
+    g_object_unref (copy->src);
+    g_object_unref (copy->dest);
+    g_object_unref (copy->dest_dir);
+    g_free (copy->dest_fs_type);
+    g_clear_error (&copy->error);
+    g_free (copy);
+}
+
+static void
+pending_directory_free (PendingDirectory *directory)
+{
+    g_object_unref (directory->dest);
+    g_object_unref (directory->info);
+    g_free (directory);
+}
+
+static void
+pipelined_copy_progress_callback (goffset  current_num_bytes,
+                                  goffset  total_num_bytes,
+                                  gpointer user_data)
+{
+    PipelinedCopy *copy = user_data;
+
+    g_atomic_pointer_add (copy->pending_bytes, current_num_bytes - copy->reported_bytes);
+    copy->reported_bytes = current_num_bytes;
+}
+
+/* Removes the source of a move once it is known to be copied whole. */
+static gboolean
+pipelined_copy_remove_source (PipelinedCopy *copy,
+                              CopyPipeline  *pipeline)
+{
+    g_autoptr (GFileInfo) src_info = NULL;
+    g_autoptr (GFileInfo) dest_info = NULL;
+
+    src_info = g_file_query_info (copy->src, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  pipeline->cancellable, &copy->error);
+    if (src_info == NULL)
+    {
+        return FALSE;
+    }
+    dest_info = g_file_query_info (copy->dest, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                   G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                   pipeline->cancellable, &copy->error);
+    if (dest_info == NULL)
+    {
+        return FALSE;
+    }
+    if (g_file_info_get_size (src_info) != g_file_info_get_size (dest_info))
+    {
+        /* Changed while being copied. */
+        g_set_error_literal (&copy->error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "The source changed while being copied");
+        return FALSE;
+    }
+
+    return g_file_delete (copy->src, pipeline->cancellable, &copy->error);
+}
+
+/* Runs in the threads of the pool. */
+static void
+pipelined_copy_thread (gpointer data,
+                       gpointer user_data)
+{
+    PipelinedCopy *copy = data;
+    CopyPipeline *pipeline = user_data;
+
+    /* Local files are never volatile, so there is nothing to map. */
+    if (!copy_file_contents (copy->src, copy->dest,
+                             pipeline->flags,
+                             copy->same_fs,
+                             NULL,
+                             copy->verify ? &copy->verified : NULL,
+                             pipeline->cancellable,
+                             pipelined_copy_progress_callback, copy,
+                             &copy->mode,
+                             &copy->error))
+    {
+        /* Without overwriting, anything there is a partial copy. It is
+         * removed for the error to be met again by the job thread. */
+        if (!IS_IO_ERROR (copy->error, EXISTS))
+        {
+            g_file_delete (copy->dest, NULL, NULL);
+        }
+    }
+    else if (pipeline->is_move && !pipelined_copy_remove_source (copy, pipeline))
+    {
+        /* Back to how it was, for the job thread to move it the usual
+         * way, which reports what went wrong. */
+        g_file_delete (copy->dest, NULL, NULL);
+    }
+
+    g_async_queue_push (pipeline->done, copy);
+}
+
+static CopyPipeline *
+copy_pipeline_new (CommonJob *job,
+                   gboolean   readonly_source_fs,
+                   gboolean   is_move)
+{
+    CopyPipeline *pipeline;
+
+    pipeline = g_new0 (CopyPipeline, 1);
+    pipeline->done = g_async_queue_new ();
+    pipeline->cancellable = g_object_ref (job->cancellable);
+    pipeline->is_move = is_move;
+    pipeline->skipped_dirs = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                                    g_object_unref, NULL);
+    pipeline->flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+    if (readonly_source_fs)
+    {
+        pipeline->flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+    }
+    if (is_move)
+    {
+        /* As g_file_move() does when it has to copy */
+        pipeline->flags |= G_FILE_COPY_ALL_METADATA;
+    }
+    pipeline->pool = g_thread_pool_new (pipelined_copy_thread, pipeline,
+                                        COPY_PIPELINE_MAX_THREADS, FALSE, NULL);
+
+    return pipeline;
+}
+
+static void
+copy_pipeline_complete (CopyMoveJob   *copy_job,
+                        PipelinedCopy *copy,
+                        SourceInfo    *source_info,
+                        TransferInfo  *transfer_info)
+{
+    CommonJob *job;
+    gboolean skipped_file;
+
+    job = (CommonJob *) copy_job;
+
+    g_atomic_pointer_add (&transfer_info->pending_bytes, -copy->reported_bytes);
+
+    if (copy->error == NULL)
+    {
+        transfer_info->num_files++;
+        transfer_info->num_bytes += copy->size;
+        transfer_info->copy_mode = copy->mode;
+        if (copy->verified)
+        {
+            transfer_info->num_verified++;
+        }
+        report_copy_progress (copy_job, source_info, transfer_info);
+
+        if (copy_job->pipeline->is_move)
+        {
+            nautilus_file_changes_queue_file_moved (copy->src, copy->dest);
+        }
+        else
+        {
+            nautilus_file_changes_queue_file_added (copy->dest);
+        }
+
+        if (copy_job->journal != NULL)
+        {
+            nautilus_copy_journal_add_file (copy_job->journal, copy->src, copy->size);
+        }
+
+        if (job->undo_info != NULL)
+        {
+            nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+                                                                copy->src, copy->dest);
+        }
+    }
+    else if (!job_aborted (job))
+    {
+        skipped_file = FALSE;
+        copy_move_file (copy_job, copy->src, copy->dest_dir, copy->same_fs, FALSE,
+                        &copy->dest_fs_type, source_info, transfer_info, NULL, FALSE,
+                        &skipped_file,
+                        (copy_job->pipeline->flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) != 0);
+
+        if (skipped_file)
+        {
+            g_hash_table_add (copy_job->pipeline->skipped_dirs, g_file_get_parent (copy->src));
+            source_info_remove_file_from_count (copy->src, job, source_info);
+            report_copy_progress (copy_job, source_info, transfer_info);
+        }
+    }
+
+    pipelined_copy_free (copy);
+}
+
+/* Handles the copies that are done, waiting for them until no more than
+ * @max_in_flight are left. */
+static void
+copy_pipeline_collect (CopyMoveJob  *copy_job,
+                       SourceInfo   *source_info,
+                       TransferInfo *transfer_info,
+                       guint         max_in_flight)
+{
+    CopyPipeline *pipeline;
+    PipelinedCopy *copy;
+
+    pipeline = copy_job->pipeline;
+
+    while (pipeline->in_flight > 0)
+    {
+        if (pipeline->in_flight > max_in_flight)
+        {
+            /* The progress of the copies still running keeps being
+             * reported while waiting for them. */
+            copy = g_async_queue_timeout_pop (pipeline->done, PROGRESS_NOTIFY_INTERVAL);
+            if (copy == NULL)
+            {
+                report_copy_progress (copy_job, source_info, transfer_info);
+                continue;
+            }
+        }
+        else
+        {
+            copy = g_async_queue_try_pop (pipeline->done);
+            if (copy == NULL)
+            {
+                break;
+            }
+        }
+
+        pipeline->in_flight--;
+        copy_pipeline_complete (copy_job, copy, source_info, transfer_info);
+    }
+}
+
+/* Hands the copy of @src over to the pipeline if it can take it, and
+ * returns whether it did. */
+static gboolean
+copy_pipeline_push (CopyMoveJob   *copy_job,
+                    GFile         *src,
+                    GFileInfo     *src_info,
+                    GFile         *dest_dir,
+                    gboolean       same_fs,
+                    const char    *dest_fs_type,
+                    SourceInfo    *source_info,
+                    TransferInfo  *transfer_info)
+{
+    CopyPipeline *pipeline;
+    PipelinedCopy *copy;
+    GFile *dest;
+
+    pipeline = copy_job->pipeline;
+
+    if (pipeline == NULL ||
+        /* Those are renames */
+        (pipeline->is_move && same_fs) ||
+        copy_job->target_name != NULL ||
+        g_file_info_get_file_type (src_info) != G_FILE_TYPE_REGULAR ||
+        g_file_info_get_size (src_info) > COPY_PIPELINE_MAX_FILE_SIZE ||
+        !g_file_is_native (src) ||
+        should_skip_file ((CommonJob *) copy_job, src))
+    {
+        return FALSE;
+    }
+
+    dest = get_target_file (src, dest_dir, dest_fs_type, same_fs);
+    if (test_dir_is_parent (src, dest))
+    {
+        g_object_unref (dest);
+        return FALSE;
+    }
+
+    copy = g_new0 (PipelinedCopy, 1);
+    copy->src = g_object_ref (src);
+    copy->dest = dest;
+    copy->dest_dir = g_object_ref (dest_dir);
+    copy->dest_fs_type = g_strdup (dest_fs_type);
+    copy->same_fs = same_fs;
+    copy->size = g_file_info_get_size (src_info);
+    copy->pending_bytes = &transfer_info->pending_bytes;
+    copy->verify = transfer_info->verify;
+
+    pipeline->in_flight++;
+    g_thread_pool_push (pipeline->pool, copy, NULL);
+
+    copy_pipeline_collect (copy_job, source_info, transfer_info,
+                           COPY_PIPELINE_MAX_IN_FLIGHT);
+
+    return TRUE;
+}
+
+static void
+copy_pipeline_defer_attributes (CopyPipeline *pipeline,
+                                GFile        *dest,
+                                GFileInfo    *info)
+{
+    PendingDirectory *directory;
+
+    directory = g_new0 (PendingDirectory, 1);
+    directory->dest = g_object_ref (dest);
+    directory->info = g_object_ref (info);
+    pipeline->pending_directories = g_list_prepend (pipeline->pending_directories,
+                                                    directory);
+}
+
+/* Waits for all the copies, and frees the pipeline of the job. */
+static void
+copy_pipeline_finish (CopyMoveJob  *copy_job,
+                      SourceInfo   *source_info,
+                      TransferInfo *transfer_info)
+{
+    CopyPipeline *pipeline;
+
+    pipeline = copy_job->pipeline;
+
+    copy_pipeline_collect (copy_job, source_info, transfer_info, 0);
+
+    for (GList *l = pipeline->pending_directories; l != NULL; l = l->next)
+    {
+        PendingDirectory *directory = l->data;
+
+        /* Ignore errors here. Failure to copy metadata is not a hard error */
+        g_file_set_attributes_from_info (directory->dest,
+                                         directory->info,
+                                         G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                         copy_job->common.cancellable,
+                                         NULL);
+    }
+
+    copy_job->pipeline = NULL;
 
-            dest_dir = g_file_get_parent (*dest);
+    g_thread_pool_free (pipeline->pool, FALSE, TRUE);
+    g_async_queue_unref (pipeline->done);
+    g_object_unref (pipeline->cancellable);
+    g_hash_table_unref (pipeline->skipped_dirs);
+    g_list_free_full (pipeline->pending_directories, (GDestroyNotify) pending_directory_free);
+    g_free (pipeline);
+}
 
-            if (dest_dir != NULL)
-            {
-                *dest_fs_type = query_fs_type (dest_dir, job->cancellable);
+/* Counts @src as copied if the interrupted run of the job got to it. */
+static gboolean
+skip_journaled_file (CopyMoveJob  *copy_job,
+                     GFile        *src,
+                     SourceInfo   *source_info,
+                     TransferInfo *transfer_info)
+{
+    goffset size;
 
-                new_dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
-                g_object_unref (dest_dir);
+    if (copy_job->journal == NULL ||
+        !nautilus_copy_journal_lookup_file (copy_job->journal, src, &size))
+    {
+        return FALSE;
+    }
 
-                if (!g_file_equal (*dest, new_dest))
-                {
-                    g_object_unref (*dest);
-                    *dest = new_dest;
-                    g_error_free (error);
-                    return CREATE_DEST_DIR_RETRY;
-                }
-                else
-                {
-                    g_object_unref (new_dest);
-                }
-            }
-        }
+    transfer_info->num_files++;
+    transfer_info->num_bytes += size;
+    report_copy_progress (copy_job, source_info, transfer_info);
 
-        primary = g_strdup (_("Error while copying."));
-        details = NULL;
-        basename = get_basename (src);
+    return TRUE;
+}
 
-        if (IS_IO_ERROR (error, PERMISSION_DENIED))
-        {
-            secondary = g_strdup_printf (_("The folder “%s” cannot be copied because you do not "
-                                           "have permissions to create it in the destination."),
-                                         basename);
-        }
-        else
-        {
-            secondary = g_strdup_printf (_("There was an error creating the folder “%s”."),
-                                         basename);
-            details = error->message;
-        }
+/* Copies or moves the child of @src described by @info into @dest. */
+static void
+copy_move_directory_child (CopyMoveJob   *copy_job,
+                           GFile         *src,
+                           GFileInfo     *info,
+                           GFile         *dest,
+                           gboolean       same_fs,
+                           char         **dest_fs_type,
+                           SourceInfo    *source_info,
+                           TransferInfo  *transfer_info,
+                           gboolean      *skipped_file,
+                           gboolean       readonly_source_fs)
+{
+    CommonJob *job;
+    GFile *src_file;
 
-        response = run_warning (job,
-                                primary,
-                                secondary,
-                                details,
-                                FALSE,
-                                CANCEL, SKIP, RETRY,
-                                NULL);
+    job = (CommonJob *) copy_job;
 
-        g_error_free (error);
+    src_file = g_file_get_child (src, g_file_info_get_name (info));
+    if (!skip_journaled_file (copy_job, src_file, source_info, transfer_info) &&
+        !copy_pipeline_push (copy_job, src_file, info, dest, same_fs, *dest_fs_type,
+                             source_info, transfer_info))
+    {
+        copy_move_file (copy_job, src_file, dest, same_fs, FALSE, dest_fs_type,
+                        source_info, transfer_info, NULL, FALSE, skipped_file,
+                        readonly_source_fs);
 
-        if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT)
-        {
-            abort_job (job);
-        }
-        else if (response == 1)
-        {
-            /* Skip: Do Nothing  */
-        }
-        else if (response == 2)
-        {
-            goto retry;
-        }
-        else
+        if (*skipped_file)
         {
-            g_assert_not_reached ();
+            source_info_remove_file_from_count (src_file, job, source_info);
+            report_copy_progress (copy_job, source_info, transfer_info);
         }
-        return CREATE_DEST_DIR_FAILED;
-    }
-    nautilus_file_changes_queue_file_added (*dest);
-
-    if (job->undo_info != NULL)
-    {
-        nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
-                                                            src, *dest);
     }
 
-    return CREATE_DEST_DIR_SUCCESS;
+    g_object_unref (src_file);
 }
 
 /* a return value of FALSE means retry, i.e.
@@ -4861,9 +7655,10 @@ copy_move_directory (CopyMoveJob   *copy_job,
                      gboolean       readonly_source_fs)
 {
     g_autoptr (GFileInfo) src_info = NULL;
+    g_autoptr (GArray) children = NULL;
+    SourceDirInfo *dir_info;
     GFileInfo *info;
     GError *error;
-    GFile *src_file;
     GFileEnumerator *enumerator;
     char *primary, *secondary, *details;
     char *dest_fs_type;
@@ -4904,6 +7699,16 @@ copy_move_directory (CopyMoveJob   *copy_job,
             break;
         }
 
+        if (copy_job->journal != NULL)
+        {
+            /* A folder recorded before is gone, and so is what it had. */
+            if (nautilus_copy_journal_has_directory (copy_job->journal, src))
+            {
+                nautilus_copy_journal_forget_directory (copy_job->journal, src);
+            }
+            nautilus_copy_journal_add_directory (copy_job->journal, src);
+        }
+
         if (debuting_files)
         {
             g_hash_table_replace (debuting_files, g_object_ref (*dest), GINT_TO_POINTER (TRUE));
@@ -4930,38 +7735,65 @@ copy_move_directory (CopyMoveJob   *copy_job,
     local_skipped_file = FALSE;
     dest_fs_type = NULL;
 
+    dir_info = g_hash_table_lookup (source_info->scanned_dirs_info, src);
+    if (dir_info != NULL)
+    {
+        /* Only good once, the folder is listed again after that. */
+        children = g_steal_pointer (&dir_info->children);
+    }
+
     skip_error = should_skip_readdir_error (job, src);
 retry:
     error = NULL;
-    enumerator = g_file_enumerate_children (src,
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME,
-                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                            job->cancellable,
-                                            &error);
-    if (enumerator)
+    enumerator = NULL;
+    if (children == NULL)
+    {
+        enumerator = g_file_enumerate_children (src,
+                                                copy_job->pipeline != NULL ?
+                                                G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                                G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                                G_FILE_ATTRIBUTE_STANDARD_SIZE :
+                                                G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                job->cancellable,
+                                                &error);
+    }
+    if (children != NULL)
+    {
+        for (guint i = 0; i < children->len && !job_aborted (job); i++)
+        {
+            ScannedChild *child = &g_array_index (children, ScannedChild, i);
+
+            info = g_file_info_new ();
+            g_file_info_set_name (info, child->name);
+            g_file_info_set_file_type (info, child->type);
+            g_file_info_set_size (info, child->size);
+
+            copy_move_directory_child (copy_job, src, info, *dest, same_fs, &dest_fs_type,
+                                       source_info, transfer_info, &local_skipped_file,
+                                       readonly_source_fs);
+
+            g_object_unref (info);
+        }
+    }
+    if (children != NULL || enumerator != NULL)
     {
         error = NULL;
 
-        while (!job_aborted (job) &&
+        while (enumerator != NULL && !job_aborted (job) &&
                (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error ? NULL : &error)) != NULL)
         {
-            src_file = g_file_get_child (src,
-                                         g_file_info_get_name (info));
-            copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-                            source_info, transfer_info, NULL, FALSE, &local_skipped_file,
-                            readonly_source_fs);
-
-            if (local_skipped_file)
-            {
-                source_info_remove_file_from_count (src_file, job, source_info);
-                report_copy_progress (copy_job, source_info, transfer_info);
-            }
+            copy_move_directory_child (copy_job, src, info, *dest, same_fs, &dest_fs_type,
+                                       source_info, transfer_info, &local_skipped_file,
+                                       readonly_source_fs);
 
-            g_object_unref (src_file);
             g_object_unref (info);
         }
-        g_file_enumerator_close (enumerator, job->cancellable, NULL);
-        g_object_unref (enumerator);
+        if (enumerator != NULL)
+        {
+            g_file_enumerator_close (enumerator, job->cancellable, NULL);
+            g_object_unref (enumerator);
+        }
 
         if (error && IS_IO_ERROR (error, CANCELLED))
         {
@@ -5106,7 +7938,11 @@ retry:
         }
     }
 
-    if (src_info != NULL)
+    if (src_info != NULL && copy_job->pipeline != NULL)
+    {
+        copy_pipeline_defer_attributes (copy_job->pipeline, *dest, src_info);
+    }
+    else if (src_info != NULL)
     {
         /* Ignore errors here. Failure to copy metadata is not a hard error */
         g_file_set_attributes_from_info (*dest,
@@ -5116,6 +7952,16 @@ retry:
                                          NULL);
     }
 
+    if (copy_job->is_move && copy_job->pipeline != NULL)
+    {
+        /* What is in the folder has to be gone first. */
+        copy_pipeline_collect (copy_job, source_info, transfer_info, 0);
+        if (g_hash_table_contains (copy_job->pipeline->skipped_dirs, src))
+        {
+            local_skipped_file = TRUE;
+        }
+    }
+
     if (!job_aborted (job) && copy_job->is_move &&
         /* Don't delete source if there was a skipped file */
         !*skipped_file &&
@@ -5289,6 +8135,104 @@ handle_copy_move_conflict (CommonJob *job,
     return response;
 }
 
+/* The conflicts of the items themselves, counted before the copy starts
+ * from a listing of the destination, are answered all at once. That way
+ * the copy doesn't stop halfway for each of them, and the dialogs are left
+ * to those found in the folders merged. */
+static void
+ask_conflicts_first (CopyMoveJob *job)
+{
+    CommonJob *common;
+    g_autoptr (NautilusDirectoryReader) reader = NULL;
+    g_autoptr (GHashTable) names = NULL;
+    const NautilusDirectoryEntry *entry;
+    g_autofree char *dest_name = NULL;
+    char *primary, *secondary;
+    guint n_conflicts;
+    int response;
+
+    common = &job->common;
+
+    if (job->destination == NULL || job->target_name != NULL ||
+        job->files == NULL || job->files->next == NULL ||
+        !g_settings_get_boolean (nautilus_preferences, NAUTILUS_PREFERENCES_ASK_CONFLICTS_FIRST))
+    {
+        return;
+    }
+
+    /* Those are mostly what the copy left before, which it goes on with */
+    if (job->journal != NULL && nautilus_copy_journal_is_resumed (job->journal))
+    {
+        return;
+    }
+
+    reader = nautilus_directory_reader_new (job->destination, 0, common->cancellable, NULL);
+    if (reader == NULL)
+    {
+        return;
+    }
+
+    names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    while ((entry = nautilus_directory_reader_next (reader, NULL)) != NULL)
+    {
+        g_hash_table_add (names, g_strdup (entry->name));
+    }
+
+    n_conflicts = 0;
+    for (GList *l = job->files; l != NULL; l = l->next)
+    {
+        g_autoptr (GFile) parent = g_file_get_parent (l->data);
+        g_autofree char *basename = g_file_get_basename (l->data);
+
+        /* Copied over itself, which is an error of its own */
+        if (parent != NULL && g_file_equal (parent, job->destination))
+        {
+            continue;
+        }
+
+        if (basename != NULL && g_hash_table_contains (names, basename))
+        {
+            n_conflicts++;
+        }
+    }
+
+    /* A single one is better asked about with its details */
+    if (n_conflicts < 2 || job_aborted (common))
+    {
+        return;
+    }
+
+    dest_name = get_basename (job->destination);
+    primary = g_strdup_printf (ngettext ("%'d item already exists in “%s”.",
+                                         "%'d items already exist in “%s”.",
+                                         n_conflicts),
+                               n_conflicts, dest_name);
+    secondary = g_strdup (_("Replacing them overwrites the files and merges the folders. "
+                            "They can also be skipped, or asked about one by one."));
+
+    response = run_question (common,
+                             primary,
+                             secondary,
+                             NULL,
+                             FALSE,
+                             CANCEL, SKIP_ALL, _("Ask for _Each"), REPLACE_ALL,
+                             NULL);
+
+    if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT)
+    {
+        abort_job (common);
+    }
+    else if (response == 1)         /* skip all */
+    {
+        common->skip_all_conflict = TRUE;
+    }
+    else if (response == 3)         /* replace all */
+    {
+        common->replace_all = TRUE;
+        common->merge_all = TRUE;
+    }
+}
+
 static GFile *
 get_target_file_for_display_name (GFile       *dir,
                                   const gchar *name)
@@ -5358,6 +8302,70 @@ get_target_file_from_source_display_name (CopyMoveJob *copy_job,
 
 
 /* Debuting files is non-NULL only for toplevel items */
+typedef enum
+{
+    RESUMED_CONFLICT_NONE,
+    /* Copied whole after the journal was last written */
+    RESUMED_CONFLICT_COPIED,
+    /* Left by the interrupted run, to take over */
+    RESUMED_CONFLICT_OURS,
+} ResumedConflict;
+
+/* Tells what the interrupted run of a resumed job had to do with the
+ * existing @dest, so that it doesn't come up as a conflict. Only what the
+ * journal says the run created is taken over, anything else might be the
+ * user's and goes through the conflict dialog as usual. */
+static ResumedConflict
+get_resumed_conflict (CopyMoveJob *copy_job,
+                      GFile       *src,
+                      GFile       *dest,
+                      gboolean     is_merge,
+                      goffset     *size)
+{
+    g_autoptr (GFileInfo) src_info = NULL;
+    g_autoptr (GFileInfo) dest_info = NULL;
+    goffset partial_size;
+
+    if (is_merge)
+    {
+        return nautilus_copy_journal_has_directory (copy_job->journal, src) ?
+               RESUMED_CONFLICT_OURS : RESUMED_CONFLICT_NONE;
+    }
+
+    /* A big file the run had started writing */
+    if (nautilus_copy_journal_get_partial (copy_job->journal, src, &partial_size) > 0)
+    {
+        return RESUMED_CONFLICT_OURS;
+    }
+
+    src_info = g_file_query_info (src,
+                                  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  copy_job->common.cancellable, NULL);
+    dest_info = g_file_query_info (dest,
+                                   G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                   G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                   G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                   copy_job->common.cancellable, NULL);
+    if (src_info == NULL || dest_info == NULL)
+    {
+        return RESUMED_CONFLICT_NONE;
+    }
+
+    /* The copies get the times of their source once complete, so this is
+     * left as it is rather than overwritten. */
+    if (g_file_info_get_size (src_info) == g_file_info_get_size (dest_info) &&
+        g_file_info_get_attribute_uint64 (src_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) ==
+        g_file_info_get_attribute_uint64 (dest_info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+    {
+        *size = g_file_info_get_size (src_info);
+        return RESUMED_CONFLICT_COPIED;
+    }
+
+    return RESUMED_CONFLICT_NONE;
+}
+
 static void
 copy_move_file (CopyMoveJob   *copy_job,
                 GFile         *src,
@@ -5383,6 +8391,7 @@ copy_move_file (CopyMoveJob   *copy_job,
     gboolean res;
     int unique_name_nr;
     gboolean handled_invalid_filename;
+    gboolean verified;
 
     job = (CommonJob *) copy_job;
 
@@ -5403,7 +8412,8 @@ copy_move_file (CopyMoveJob   *copy_job,
 
     if (unique_names)
     {
-        dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr++);
+        dest = get_untaken_unique_target_file (copy_job, src, dest_dir, same_fs, *dest_fs_type,
+                                               &unique_name_nr);
     }
     else if (copy_job->target_name != NULL)
     {
@@ -5528,6 +8538,7 @@ retry:
     pdata.last_size = 0;
     pdata.source_info = source_info;
     pdata.transfer_info = transfer_info;
+    verified = FALSE;
 
     if (copy_job->is_move)
     {
@@ -5540,12 +8551,16 @@ retry:
     }
     else
     {
-        res = g_file_copy (src, dest,
-                           flags,
-                           job->cancellable,
-                           copy_file_progress_callback,
-                           &pdata,
-                           &error);
+        res = copy_file_contents (src, dest,
+                                  flags,
+                                  same_fs,
+                                  copy_job->journal,
+                                  transfer_info->verify ? &verified : NULL,
+                                  job->cancellable,
+                                  copy_file_progress_callback,
+                                  &pdata,
+                                  &transfer_info->copy_mode,
+                                  &error);
     }
 
     if (res)
@@ -5567,6 +8582,10 @@ retry:
     if (res)
     {
         transfer_info->num_files++;
+        if (verified)
+        {
+            transfer_info->num_verified++;
+        }
         report_copy_progress (copy_job, source_info, transfer_info);
 
         if (debuting_files)
@@ -5590,6 +8609,11 @@ retry:
                                                                 src, dest);
         }
 
+        if (copy_job->journal != NULL)
+        {
+            nautilus_copy_journal_add_file (copy_job->journal, src, pdata.last_size);
+        }
+
         g_object_unref (dest);
         return;
     }
@@ -5642,7 +8666,8 @@ retry:
         if (unique_names)
         {
             g_object_unref (dest);
-            dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr++);
+            dest = get_untaken_unique_target_file (copy_job, src, dest_dir, same_fs, *dest_fs_type,
+                                                   &unique_name_nr);
             goto retry;
         }
 
@@ -5659,6 +8684,38 @@ retry:
             goto retry;
         }
 
+        if (copy_job->journal != NULL &&
+            nautilus_copy_journal_is_resumed (copy_job->journal))
+        {
+            goffset size;
+
+            switch (get_resumed_conflict (copy_job, src, dest, is_merge, &size))
+            {
+                case RESUMED_CONFLICT_COPIED:
+                {
+                    transfer_info->num_files++;
+                    transfer_info->num_bytes += size;
+                    report_copy_progress (copy_job, source_info, transfer_info);
+                    nautilus_copy_journal_add_file (copy_job->journal, src, size);
+
+                    g_object_unref (dest);
+                    return;
+                }
+
+                case RESUMED_CONFLICT_OURS:
+                {
+                    overwrite = TRUE;
+                    goto retry;
+                }
+
+                case RESUMED_CONFLICT_NONE:
+                default:
+                {
+                }
+                break;
+            }
+        }
+
         if ((is_merge && job->merge_all) ||
             (!is_merge && job->replace_all))
         {
@@ -5915,6 +8972,15 @@ copy_files (CopyMoveJob  *job,
         g_object_unref (source_dir);
     }
 
+    /* Moves within a same filesystem are renames, and the others remove
+     * the source folders as they go. */
+    if (!job->is_move &&
+        job->destination != NULL &&
+        g_file_is_native (job->destination))
+    {
+        job->pipeline = copy_pipeline_new (common, readonly_source_fs, FALSE);
+    }
+
     unique_names = (job->destination == NULL);
     i = 0;
     for (l = job->files;
@@ -5958,6 +9024,11 @@ copy_files (CopyMoveJob  *job,
         i++;
     }
 
+    if (job->pipeline != NULL)
+    {
+        copy_pipeline_finish (job, source_info, transfer_info);
+    }
+
     g_free (dest_fs_type);
 }
 
@@ -5983,6 +9054,7 @@ copy_task_done (GObject      *source_object,
     }
     g_hash_table_unref (job->debuting_files);
     g_free (job->target_name);
+    g_clear_pointer (&job->taken_names, g_hash_table_unref);
 
     g_clear_object (&job->fake_display_source);
 
@@ -6025,6 +9097,8 @@ nautilus_file_operations_copy (GTask        *task,
     g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
     TransferInfo transfer_info;
     g_autofree char *dest_fs_id = NULL;
+    g_autoptr (NautilusJobSlot) slot = NULL;
+    g_autoptr (NautilusCopyJournal) journal = NULL;
     GFile *dest;
 
     job = task_data;
@@ -6053,6 +9127,17 @@ nautilus_file_operations_copy (GTask        *task,
 
     nautilus_progress_info_start (job->common.progress);
 
+    slot = wait_for_devices (common, job->files, job->destination);
+    source_info.disk_order = should_copy_in_disk_order (slot);
+
+    /* Duplicates and renamed copies get other names every time. */
+    if (job->destination != NULL && job->target_name == NULL &&
+        g_settings_get_boolean (nautilus_preferences, NAUTILUS_PREFERENCES_RESUMABLE_COPIES))
+    {
+        journal = nautilus_copy_journal_open (job->files, job->destination);
+        job->journal = journal;
+    }
+
     scan_sources (job->files,
                   &source_info,
                   common,
@@ -6084,9 +9169,17 @@ nautilus_file_operations_copy (GTask        *task,
         return;
     }
 
+    ask_conflicts_first (job);
+    if (job_aborted (common))
+    {
+        return;
+    }
+
     g_timer_start (job->common.time);
 
     memset (&transfer_info, 0, sizeof (transfer_info));
+    transfer_info.verify = g_settings_get_boolean (nautilus_preferences,
+                                                   NAUTILUS_PREFERENCES_VERIFY_COPIES);
     copy_files (job,
                 dest_fs_id,
                 &source_info, &transfer_info);
@@ -6136,7 +9229,7 @@ nautilus_file_operations_copy_async (GList                          *files,
 
     task = g_task_new (NULL, job->common.cancellable, copy_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, nautilus_file_operations_copy);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, nautilus_file_operations_copy);
     g_object_unref (task);
 }
 
@@ -6550,6 +9643,14 @@ move_files (CopyMoveJob   *job,
 
     report_copy_progress (job, source_info, transfer_info);
 
+    /* What is in the folders is copied and removed by a few threads at
+     * once, as for copies. */
+    if (job->destination != NULL &&
+        g_file_is_native (job->destination))
+    {
+        job->pipeline = copy_pipeline_new (common, FALSE, TRUE);
+    }
+
     i = 0;
     for (l = fallbacks;
          l != NULL && !job_aborted (common);
@@ -6580,6 +9681,11 @@ move_files (CopyMoveJob   *job,
             report_copy_progress (job, source_info, transfer_info);
         }
     }
+
+    if (job->pipeline != NULL)
+    {
+        copy_pipeline_finish (job, source_info, transfer_info);
+    }
 }
 
 
@@ -6670,7 +9776,7 @@ nautilus_file_operations_move_async (GList                          *files,
 
     task = g_task_new (NULL, job->common.cancellable, move_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, nautilus_file_operations_move);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, nautilus_file_operations_move);
     g_object_unref (task);
 }
 
@@ -6687,6 +9793,7 @@ nautilus_file_operations_move (GTask        *task,
     TransferInfo transfer_info;
     g_autofree char *dest_fs_id = NULL;
     g_autofree char *dest_fs_type = NULL;
+    g_autoptr (NautilusJobSlot) slot = NULL;
     GList *fallback_files;
 
     job = task_data;
@@ -6737,6 +9844,12 @@ nautilus_file_operations_move (GTask        *task,
         goto aborted;
     }
 
+    ask_conflicts_first (job);
+    if (job_aborted (common))
+    {
+        goto aborted;
+    }
+
     /* This moves all files that we can do without copy + delete */
     move_files_prepare (job, dest_fs_id, &dest_fs_type, &fallbacks);
     if (job_aborted (common))
@@ -6762,7 +9875,12 @@ nautilus_file_operations_move (GTask        *task,
     /* The rest we need to do deep copy + delete behind on,
      *  so scan for size */
 
-    fallback_files = get_files_from_fallbacks (fallbacks);
+    fallback_files = get_files_from_fallbacks (fallbacks);
+
+    /* Only what goes through copying is worth waiting for the devices. */
+    slot = wait_for_devices (common, fallback_files, job->destination);
+    source_info.disk_order = should_copy_in_disk_order (slot);
+
     scan_sources (fallback_files,
                   &source_info,
                   common,
@@ -7116,7 +10234,7 @@ nautilus_file_operations_link (GList                          *files,
 
     task = g_task_new (NULL, job->common.cancellable, link_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, link_task_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, link_task_thread_func);
 }
 
 
@@ -7157,7 +10275,7 @@ nautilus_file_operations_duplicate (GList                          *files,
 
     task = g_task_new (NULL, job->common.cancellable, copy_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, nautilus_file_operations_copy);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, nautilus_file_operations_copy);
 }
 
 static void
@@ -7170,6 +10288,8 @@ set_permissions_task_done (GObject      *source_object,
     job = user_data;
 
     g_object_unref (job->file);
+    g_mutex_clear (&job->lock);
+    g_cond_clear (&job->cond);
 
     if (job->done_callback)
     {
@@ -7178,120 +10298,140 @@ set_permissions_task_done (GObject      *source_object,
     }
 
     finalize_common ((CommonJob *) job);
+
+    nautilus_file_changes_consume_changes (TRUE);
 }
 
-static void
-set_permissions_file (SetPermissionsJob *job,
-                      GFile             *file,
-                      GFileInfo         *info);
+typedef struct
+{
+    GFile *file;
+    guint32 mode;
+} PermissionsChange;
 
 static void
-set_permissions_contained_files (SetPermissionsJob *job,
-                                 GFile             *file)
+set_permissions_push_dir (SetPermissionsJob *job,
+                          GFile             *dir)
 {
-    CommonJob *common;
-    GFileEnumerator *enumerator;
+    g_mutex_lock (&job->lock);
+    job->pending_dirs++;
+    g_mutex_unlock (&job->lock);
 
-    common = (CommonJob *) job;
+    g_thread_pool_push (job->pool, g_object_ref (dir), NULL);
+}
 
-    enumerator = g_file_enumerate_children (file,
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                            G_FILE_ATTRIBUTE_UNIX_MODE,
-                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+/* Runs in the threads of the pool, for each folder of the tree. */
+static void
+set_permissions_dir_thread (gpointer data,
+                            gpointer user_data)
+{
+    g_autoptr (GFile) dir = data;
+    SetPermissionsJob *job = user_data;
+    CommonJob *common = (CommonJob *) job;
+    g_autoptr (NautilusDirectoryReader) reader = NULL;
+    g_autoptr (GArray) changes = NULL;
+    GList *changed_files = NULL;
+    const NautilusDirectoryEntry *entry;
+    int dir_fd;
+
+    reader = nautilus_directory_reader_new (dir,
+                                            NAUTILUS_DIRECTORY_READER_TYPE |
+                                            NAUTILUS_DIRECTORY_READER_MODE,
                                             common->cancellable,
+                                            /* Ignore errors */
                                             NULL);
-    if (enumerator)
+    dir_fd = reader != NULL ? nautilus_directory_reader_get_fd (reader) : -1;
+    changes = g_array_new (FALSE, FALSE, sizeof (PermissionsChange));
+
+    while (reader != NULL && !job_aborted (common) &&
+           (entry = nautilus_directory_reader_next (reader, NULL)) != NULL)
     {
-        GFileInfo *child_info;
+        g_autoptr (GFile) child = NULL;
+        PermissionsChange change;
+        guint32 value;
+        guint32 mask;
+        guint32 current;
 
-        while (!job_aborted (common) &&
-               (child_info = g_file_enumerator_next_file (enumerator, common->cancellable, NULL)) != NULL)
+        /* The permissions of a link are those of its target, which may well
+         * be out of the tree. */
+        if (entry->type == G_FILE_TYPE_SYMBOLIC_LINK)
         {
-            GFile *child;
-
-            child = g_file_get_child (file,
-                                      g_file_info_get_name (child_info));
-            set_permissions_file (job, child, child_info);
-            g_object_unref (child);
-            g_object_unref (child_info);
+            continue;
         }
-        g_file_enumerator_close (enumerator, common->cancellable, NULL);
-        g_object_unref (enumerator);
-    }
-}
-
-static void
-set_permissions_file (SetPermissionsJob *job,
-                      GFile             *file,
-                      GFileInfo         *info)
-{
-    CommonJob *common;
-    gboolean free_info;
-    guint32 current;
-    guint32 value;
-    guint32 mask;
 
-    common = (CommonJob *) job;
+        child = g_file_get_child (dir, entry->name);
 
-    nautilus_progress_info_pulse_progress (common->progress);
+        if (entry->type == G_FILE_TYPE_DIRECTORY)
+        {
+            value = job->dir_permissions;
+            mask = job->dir_mask;
+        }
+        else
+        {
+            value = job->file_permissions;
+            mask = job->file_mask;
+        }
 
-    free_info = FALSE;
-    if (info == NULL)
-    {
-        free_info = TRUE;
-        info = g_file_query_info (file,
-                                  G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                  G_FILE_ATTRIBUTE_UNIX_MODE,
-                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                  common->cancellable,
-                                  NULL);
-        /* Ignore errors */
-        if (info == NULL)
+        current = (entry->mode & ~mask) | value;
+        if (entry->mode != 0 && current != entry->mode &&
+            (dir_fd >= 0 ?
+             fchmodat (dir_fd, entry->name, current & 07777, 0) == 0 :
+             g_file_set_attribute_uint32 (child, G_FILE_ATTRIBUTE_UNIX_MODE,
+                                          current, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          common->cancellable, NULL)))
         {
-            return;
+            change.file = g_object_ref (child);
+            change.mode = entry->mode;
+            g_array_append_val (changes, change);
+            changed_files = g_list_prepend (changed_files, g_object_ref (child));
         }
-    }
 
-    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
-    {
-        value = job->dir_permissions;
-        mask = job->dir_mask;
-    }
-    else
-    {
-        value = job->file_permissions;
-        mask = job->file_mask;
+        /* Only once the folder has its new permissions, which may be what
+         * makes it readable. */
+        if (entry->type == G_FILE_TYPE_DIRECTORY)
+        {
+            set_permissions_push_dir (job, child);
+        }
     }
 
+    /* What changed in the folder goes in batches to the undo info and the
+     * changes queue. */
+    nautilus_file_changes_queue_files_changed (changed_files);
+    g_list_free_full (changed_files, g_object_unref);
+    g_atomic_int_add (&job->n_changed, changes->len);
 
-    if (!job_aborted (common) &&
-        g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_MODE))
+    g_mutex_lock (&job->lock);
+    for (guint i = 0; i < changes->len; i++)
     {
-        current = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+        PermissionsChange *c = &g_array_index (changes, PermissionsChange, i);
 
         if (common->undo_info != NULL)
         {
             nautilus_file_undo_info_rec_permissions_add_file (NAUTILUS_FILE_UNDO_INFO_REC_PERMISSIONS (common->undo_info),
-                                                              file, current);
+                                                              c->file, c->mode);
         }
-
-        current = (current & ~mask) | value;
-
-        g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_UNIX_MODE,
-                                     current, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                     common->cancellable, NULL);
-    }
-
-    if (!job_aborted (common) &&
-        g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
-    {
-        set_permissions_contained_files (job, file);
+        g_object_unref (c->file);
     }
-    if (free_info)
+    job->pending_dirs--;
+    if (job->pending_dirs == 0)
     {
-        g_object_unref (info);
+        g_cond_signal (&job->cond);
     }
+    g_mutex_unlock (&job->lock);
+}
+
+static void
+report_set_permissions_progress (SetPermissionsJob *job)
+{
+    CommonJob *common = (CommonJob *) job;
+    gint n_changed;
+
+    n_changed = g_atomic_int_get (&job->n_changed);
+    nautilus_progress_info_take_details (common->progress,
+                                         g_strdup_printf (ngettext ("Changed the permissions of %'d file",
+                                                                    "Changed the permissions of %'d files",
+                                                                    n_changed),
+                                                          n_changed));
+    nautilus_progress_info_pulse_progress (common->progress);
 }
 
 static void
@@ -7302,6 +10442,7 @@ set_permissions_thread_func (GTask        *task,
 {
     SetPermissionsJob *job = task_data;
     CommonJob *common;
+    gint64 deadline;
 
     common = (CommonJob *) job;
 
@@ -7309,7 +10450,28 @@ set_permissions_thread_func (GTask        *task,
                                        _("Setting permissions"));
 
     nautilus_progress_info_start (job->common.progress);
-    set_permissions_contained_files (job, job->file);
+
+    job->pool = g_thread_pool_new (set_permissions_dir_thread, job,
+                                   SET_PERMISSIONS_MAX_THREADS, FALSE, NULL);
+    set_permissions_push_dir (job, job->file);
+
+    g_mutex_lock (&job->lock);
+    while (job->pending_dirs > 0)
+    {
+        deadline = g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND;
+        if (!g_cond_wait_until (&job->cond, &job->lock, deadline))
+        {
+            g_mutex_unlock (&job->lock);
+            report_set_permissions_progress (job);
+            g_mutex_lock (&job->lock);
+        }
+    }
+    g_mutex_unlock (&job->lock);
+
+    g_thread_pool_free (job->pool, FALSE, TRUE);
+    job->pool = NULL;
+
+    report_set_permissions_progress (job);
 }
 
 void
@@ -7330,6 +10492,8 @@ nautilus_file_set_permissions_recursive (const char         *directory,
     job->file_mask = file_mask;
     job->dir_permissions = dir_permissions;
     job->dir_mask = dir_mask;
+    g_mutex_init (&job->lock);
+    g_cond_init (&job->cond);
     job->done_callback = callback;
     job->done_callback_data = callback_data;
 
@@ -7343,7 +10507,7 @@ nautilus_file_set_permissions_recursive (const char         *directory,
 
     task = g_task_new (NULL, NULL, set_permissions_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, set_permissions_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, set_permissions_thread_func);
 }
 
 static GList *
@@ -7954,7 +11118,7 @@ nautilus_file_operations_new_folder (GtkWidget                      *parent_view
 
     task = g_task_new (NULL, job->common.cancellable, create_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, create_task_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, create_task_thread_func);
 }
 
 void
@@ -7993,7 +11157,7 @@ nautilus_file_operations_new_file_from_template (GtkWidget              *parent_
 
     task = g_task_new (NULL, job->common.cancellable, create_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, create_task_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, create_task_thread_func);
 }
 
 void
@@ -8030,7 +11194,7 @@ nautilus_file_operations_new_file (GtkWidget              *parent_view,
 
     task = g_task_new (NULL, job->common.cancellable, create_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, create_task_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, create_task_thread_func);
 }
 
 
@@ -8171,7 +11335,7 @@ nautilus_file_operations_empty_trash (GtkWidget                      *parent_vie
 
     task = g_task_new (NULL, NULL, empty_trash_task_done, job);
     g_task_set_task_data (task, job, NULL);
-    g_task_run_in_thread (task, empty_trash_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, empty_trash_thread_func);
 }
 
 static void
@@ -8192,6 +11356,9 @@ extract_task_done (GObject      *source_object,
     g_list_free_full (extract_job->source_files, g_object_unref);
     g_list_free_full (extract_job->output_files, g_object_unref);
     g_object_unref (extract_job->destination_directory);
+    g_clear_pointer (&extract_job->archives, g_ptr_array_unref);
+    g_mutex_clear (&extract_job->lock);
+    g_mutex_clear (&extract_job->dialog_lock);
 
     finalize_common ((CommonJob *) extract_job);
 
@@ -8204,7 +11371,8 @@ extract_job_on_decide_destination (AutoarExtractor *extractor,
                                    GList           *files,
                                    gpointer         user_data)
 {
-    ExtractJob *extract_job = user_data;
+    ExtractArchive *archive = user_data;
+    ExtractJob *extract_job = archive->job;
     GFile *decided_destination;
     g_autofree char *basename = NULL;
 
@@ -8212,37 +11380,68 @@ extract_job_on_decide_destination (AutoarExtractor *extractor,
                                         _("Verifying destination"));
 
     basename = g_file_get_basename (destination);
-    decided_destination = nautilus_generate_unique_file_in_directory (extract_job->destination_directory,
-                                                                      basename);
+
+    /* The archives extracted alongside may have picked the same name, and
+     * not created it yet. */
+    g_mutex_lock (&extract_job->lock);
+    decided_destination = nautilus_generate_unique_file_in_directory_excluding (extract_job->destination_directory,
+                                                                                basename,
+                                                                                extract_job->output_files);
 
     if (job_aborted ((CommonJob *) extract_job))
     {
+        g_mutex_unlock (&extract_job->lock);
         g_object_unref (decided_destination);
         return NULL;
     }
 
     extract_job->output_files = g_list_prepend (extract_job->output_files,
                                                 decided_destination);
+    g_set_object (&archive->output_file, decided_destination);
+    g_mutex_unlock (&extract_job->lock);
 
     return g_object_ref (decided_destination);
 }
 
+/* Each archive weighs as much as its size. Called with the lock held. */
+static gdouble
+get_extract_job_progress (ExtractJob *extract_job)
+{
+    gdouble job_progress;
+
+    if (extract_job->total_compressed_size == 0)
+    {
+        return 0;
+    }
+
+    job_progress = 0;
+    for (guint i = 0; i < extract_job->archives->len; i++)
+    {
+        ExtractArchive *archive = g_ptr_array_index (extract_job->archives, i);
+
+        job_progress += archive->progress *
+                        (gdouble) archive->compressed_size /
+                        (gdouble) extract_job->total_compressed_size;
+    }
+
+    return job_progress;
+}
+
 static void
 extract_job_on_progress (AutoarExtractor *extractor,
                          guint64          archive_current_decompressed_size,
                          guint            archive_current_decompressed_files,
                          gpointer         user_data)
 {
-    ExtractJob *extract_job = user_data;
-    CommonJob *common = user_data;
+    ExtractArchive *archive = user_data;
+    ExtractJob *extract_job = archive->job;
+    CommonJob *common = (CommonJob *) extract_job;
     GFile *source_file;
     char *details;
     double elapsed;
     double transfer_rate;
     int remaining_time;
     guint64 archive_total_decompressed_size;
-    gdouble archive_weight;
-    gdouble archive_decompress_progress;
     guint64 job_completed_size;
     gdouble job_progress;
     g_autofree gchar *basename = NULL;
@@ -8258,17 +11457,11 @@ extract_job_on_progress (AutoarExtractor *extractor,
 
     archive_total_decompressed_size = autoar_extractor_get_total_size (extractor);
 
-    archive_decompress_progress = (gdouble) archive_current_decompressed_size /
-                                  (gdouble) archive_total_decompressed_size;
-
-    archive_weight = 0;
-    if (extract_job->total_compressed_size)
-    {
-        archive_weight = (gdouble) extract_job->archive_compressed_size /
-                         (gdouble) extract_job->total_compressed_size;
-    }
-
-    job_progress = archive_decompress_progress * archive_weight + extract_job->base_progress;
+    g_mutex_lock (&extract_job->lock);
+    archive->progress = (gdouble) archive_current_decompressed_size /
+                        (gdouble) archive_total_decompressed_size;
+    job_progress = get_extract_job_progress (extract_job);
+    g_mutex_unlock (&extract_job->lock);
 
     elapsed = g_timer_elapsed (common->time, NULL);
 
@@ -8340,13 +11533,17 @@ extract_job_on_error (AutoarExtractor *extractor,
                       GError          *error,
                       gpointer         user_data)
 {
-    ExtractJob *extract_job = user_data;
+    ExtractArchive *archive = user_data;
+    ExtractJob *extract_job = archive->job;
+    g_autoptr (GMutexLocker) locker = NULL;
     GFile *source_file;
     gint response_id;
     g_autofree gchar *basename = NULL;
 
     source_file = autoar_extractor_get_source_file (extractor);
 
+    locker = g_mutex_locker_new (&extract_job->dialog_lock);
+
     if (IS_IO_ERROR (error, NOT_SUPPORTED))
     {
         handle_unsupported_compressed_file (extract_job->common.parent_window,
@@ -8380,12 +11577,9 @@ static void
 extract_job_on_completed (AutoarExtractor *extractor,
                           gpointer         user_data)
 {
-    ExtractJob *extract_job = user_data;
-    GFile *output_file;
-
-    output_file = G_FILE (extract_job->output_files->data);
+    ExtractArchive *archive = user_data;
 
-    nautilus_file_changes_queue_file_added (output_file);
+    nautilus_file_changes_queue_file_added (archive->output_file);
 }
 
 static void
@@ -8394,13 +11588,13 @@ extract_job_on_scanned (AutoarExtractor *extractor,
                         gpointer         user_data)
 {
     guint64 total_size;
-    ExtractJob *extract_job;
+    ExtractArchive *archive = user_data;
+    ExtractJob *extract_job = archive->job;
     GFile *source_file;
     g_autofree gchar *basename = NULL;
     GFileInfo *fsinfo;
     guint64 free_size;
 
-    extract_job = user_data;
     total_size = autoar_extractor_get_total_size (extractor);
     source_file = autoar_extractor_get_source_file (extractor);
     basename = get_basename (source_file);
@@ -8418,6 +11612,9 @@ extract_job_on_scanned (AutoarExtractor *extractor,
      */
     if (total_size != G_MAXUINT64 && total_size > free_size)
     {
+        g_autoptr (GMutexLocker) locker = NULL;
+
+        locker = g_mutex_locker_new (&extract_job->dialog_lock);
         nautilus_progress_info_take_status (extract_job->common.progress,
                                             g_strdup_printf (_("Error extracting “%s”"),
                                                              basename));
@@ -8474,6 +11671,59 @@ report_extract_final_progress (ExtractJob *extract_job,
                                                           formatted_size));
 }
 
+static void
+extract_archive_free (ExtractArchive *archive)
+{
+    g_object_unref (archive->source_file);
+    g_clear_object (&archive->output_file);
+    g_free (archive);
+}
+
+static void
+extract_archive (gpointer data,
+                 gpointer user_data)
+{
+    ExtractArchive *archive = data;
+    ExtractJob *extract_job = archive->job;
+    g_autoptr (AutoarExtractor) extractor = NULL;
+
+    if (job_aborted ((CommonJob *) extract_job))
+    {
+        return;
+    }
+
+    extractor = autoar_extractor_new (archive->source_file,
+                                      extract_job->destination_directory);
+
+    autoar_extractor_set_notify_interval (extractor,
+                                          PROGRESS_NOTIFY_INTERVAL);
+    g_signal_connect (extractor, "scanned",
+                      G_CALLBACK (extract_job_on_scanned),
+                      archive);
+    g_signal_connect (extractor, "error",
+                      G_CALLBACK (extract_job_on_error),
+                      archive);
+    g_signal_connect (extractor, "decide-destination",
+                      G_CALLBACK (extract_job_on_decide_destination),
+                      archive);
+    g_signal_connect (extractor, "progress",
+                      G_CALLBACK (extract_job_on_progress),
+                      archive);
+    g_signal_connect (extractor, "completed",
+                      G_CALLBACK (extract_job_on_completed),
+                      archive);
+
+    autoar_extractor_start (extractor,
+                            extract_job->common.cancellable);
+
+    g_signal_handlers_disconnect_by_data (extractor,
+                                          archive);
+
+    g_mutex_lock (&extract_job->lock);
+    archive->progress = 1;
+    g_mutex_unlock (&extract_job->lock);
+}
+
 static void
 extract_task_thread_func (GTask        *task,
                           gpointer      source_object,
@@ -8484,30 +11734,36 @@ extract_task_thread_func (GTask        *task,
     GList *l;
     GList *existing_output_files = NULL;
     gint total_files;
-    g_autofree guint64 *archive_compressed_sizes = NULL;
-    gint i;
-
-    g_timer_start (extract_job->common.time);
+    guint n_threads;
+    GThreadPool *pool;
+    g_autoptr (NautilusJobSlot) slot = NULL;
 
     nautilus_progress_info_start (extract_job->common.progress);
 
+    slot = wait_for_devices ((CommonJob *) extract_job,
+                             extract_job->source_files,
+                             extract_job->destination_directory);
+
     nautilus_progress_info_set_details (extract_job->common.progress,
                                         _("Preparing to extract"));
 
     total_files = g_list_length (extract_job->source_files);
 
-    archive_compressed_sizes = g_malloc0_n (total_files, sizeof (guint64));
     extract_job->total_compressed_size = 0;
 
-    for (l = extract_job->source_files, i = 0;
+    for (l = extract_job->source_files;
          l != NULL && !job_aborted ((CommonJob *) extract_job);
-         l = l->next, i++)
+         l = l->next)
     {
-        GFile *source_file;
+        ExtractArchive *archive;
         g_autoptr (GFileInfo) info = NULL;
 
-        source_file = G_FILE (l->data);
-        info = g_file_query_info (source_file,
+        archive = g_new0 (ExtractArchive, 1);
+        archive->job = extract_job;
+        archive->source_file = g_object_ref (l->data);
+        g_ptr_array_add (extract_job->archives, archive);
+
+        info = g_file_query_info (archive->source_file,
                                   G_FILE_ATTRIBUTE_STANDARD_SIZE,
                                   G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                   extract_job->common.cancellable,
@@ -8515,50 +11771,36 @@ extract_task_thread_func (GTask        *task,
 
         if (info)
         {
-            archive_compressed_sizes[i] = g_file_info_get_size (info);
-            extract_job->total_compressed_size += archive_compressed_sizes[i];
+            archive->compressed_size = g_file_info_get_size (info);
+            extract_job->total_compressed_size += archive->compressed_size;
         }
     }
 
-    extract_job->base_progress = 0;
-
-    for (l = extract_job->source_files, i = 0;
-         l != NULL && !job_aborted ((CommonJob *) extract_job);
-         l = l->next, i++)
+    /* The archives are extracted side by side, each with its own
+     * extractor, unless doing so would only make a slow disk seek back and
+     * forth between them. */
+    n_threads = MIN (extract_job->archives->len,
+                     MIN (g_get_num_processors (), MAX_PARALLEL_EXTRACTIONS));
+    if (nautilus_job_slot_has_slow_device (slot))
     {
-        g_autoptr (AutoarExtractor) extractor = NULL;
-
-        extractor = autoar_extractor_new (G_FILE (l->data),
-                                          extract_job->destination_directory);
-
-        autoar_extractor_set_notify_interval (extractor,
-                                              PROGRESS_NOTIFY_INTERVAL);
-        g_signal_connect (extractor, "scanned",
-                          G_CALLBACK (extract_job_on_scanned),
-                          extract_job);
-        g_signal_connect (extractor, "error",
-                          G_CALLBACK (extract_job_on_error),
-                          extract_job);
-        g_signal_connect (extractor, "decide-destination",
-                          G_CALLBACK (extract_job_on_decide_destination),
-                          extract_job);
-        g_signal_connect (extractor, "progress",
-                          G_CALLBACK (extract_job_on_progress),
-                          extract_job);
-        g_signal_connect (extractor, "completed",
-                          G_CALLBACK (extract_job_on_completed),
-                          extract_job);
-
-        extract_job->archive_compressed_size = archive_compressed_sizes[i];
-
-        autoar_extractor_start (extractor,
-                                extract_job->common.cancellable);
-
-        g_signal_handlers_disconnect_by_data (extractor,
-                                              extract_job);
+        n_threads = 1;
+    }
 
-        extract_job->base_progress += (gdouble) extract_job->archive_compressed_size /
-                                      (gdouble) extract_job->total_compressed_size;
+    if (n_threads <= 1)
+    {
+        for (guint i = 0; i < extract_job->archives->len; i++)
+        {
+            extract_archive (g_ptr_array_index (extract_job->archives, i), NULL);
+        }
+    }
+    else
+    {
+        pool = g_thread_pool_new (extract_archive, NULL, n_threads, FALSE, NULL);
+        for (guint i = 0; i < extract_job->archives->len; i++)
+        {
+            g_thread_pool_push (pool, g_ptr_array_index (extract_job->archives, i), NULL);
+        }
+        g_thread_pool_free (pool, FALSE, TRUE);
     }
 
     if (!job_aborted ((CommonJob *) extract_job))
@@ -8618,6 +11860,9 @@ nautilus_file_operations_extract_files (GList                          *files,
                                                   (GCopyFunc) g_object_ref,
                                                   NULL);
     extract_job->destination_directory = g_object_ref (destination_directory);
+    extract_job->archives = g_ptr_array_new_with_free_func ((GDestroyNotify) extract_archive_free);
+    g_mutex_init (&extract_job->lock);
+    g_mutex_init (&extract_job->dialog_lock);
     extract_job->done_callback = done_callback;
     extract_job->done_callback_data = done_callback_data;
 
@@ -8632,7 +11877,7 @@ nautilus_file_operations_extract_files (GList                          *files,
     task = g_task_new (NULL, extract_job->common.cancellable,
                        extract_task_done, extract_job);
     g_task_set_task_data (task, extract_job, NULL);
-    g_task_run_in_thread (task, extract_task_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, extract_task_thread_func);
 }
 
 static void
@@ -8907,11 +12152,16 @@ compress_task_thread_func (GTask        *task,
     CompressJob *compress_job = task_data;
     g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
     g_autoptr (AutoarCompressor) compressor = NULL;
-
-    g_timer_start (compress_job->common.time);
+    g_autoptr (GFile) destination_directory = NULL;
+    g_autoptr (NautilusJobSlot) slot = NULL;
 
     nautilus_progress_info_start (compress_job->common.progress);
 
+    destination_directory = g_file_get_parent (compress_job->output_file);
+    slot = wait_for_devices ((CommonJob *) compress_job,
+                             compress_job->source_files,
+                             destination_directory);
+
     scan_sources (compress_job->source_files,
                   &source_info,
                   (CommonJob *) compress_job,
@@ -8986,7 +12236,263 @@ nautilus_file_operations_compress (GList                          *files,
     task = g_task_new (NULL, compress_job->common.cancellable,
                        compress_task_done, compress_job);
     g_task_set_task_data (task, compress_job, NULL);
-    g_task_run_in_thread (task, compress_task_thread_func);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, compress_task_thread_func);
+}
+
+typedef struct
+{
+    NautilusBatchOperationKind kind;
+    CommonJob *job;
+} BatchStep;
+
+typedef struct
+{
+    CommonJob common;
+    GArray *steps;              /* of BatchStep */
+
+    /* What the steps done went through. The lock also guards the counts
+     * of the progress while a step is added to those. */
+    GMutex lock;
+    guint64 done_files;
+    guint64 done_bytes;
+
+    guint progress_timeout_id;
+    NautilusBatchProgressCallback progress_callback;
+    NautilusOpCallback done_callback;
+    gpointer callback_data;
+} BatchJob;
+
+/* Has @job go by the progress of @batch instead of its own, which was
+ * never started. */
+static void
+join_batch (CommonJob *job,
+            BatchJob  *batch)
+{
+    nautilus_progress_info_finish (job->progress);
+    g_object_unref (job->progress);
+    g_object_unref (job->cancellable);
+
+    job->progress = g_object_ref (batch->common.progress);
+    job->cancellable = g_object_ref (batch->common.cancellable);
+    job->batched = TRUE;
+}
+
+static void
+report_batch_progress (BatchJob *batch)
+{
+    guint64 files;
+    guint64 bytes;
+
+    g_mutex_lock (&batch->lock);
+    nautilus_progress_info_get_transferred (batch->common.progress, &files, &bytes);
+    files += batch->done_files;
+    bytes += batch->done_bytes;
+    g_mutex_unlock (&batch->lock);
+
+    batch->progress_callback (files, bytes,
+                              g_timer_elapsed (batch->common.time, NULL),
+                              batch->callback_data);
+}
+
+static gboolean
+batch_progress_timeout (gpointer user_data)
+{
+    report_batch_progress (user_data);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+batch_task_done (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+    BatchJob *batch = user_data;
+    gboolean success;
+
+    g_clear_handle_id (&batch->progress_timeout_id, g_source_remove);
+
+    /* As the sync variants, the steps are done the way they would be from
+     * their own tasks. */
+    for (guint i = 0; i < batch->steps->len; i++)
+    {
+        BatchStep *step = &g_array_index (batch->steps, BatchStep, i);
+
+        switch (step->kind)
+        {
+            case NAUTILUS_BATCH_OPERATION_COPY:
+            {
+                copy_task_done (NULL, NULL, step->job);
+            }
+            break;
+
+            case NAUTILUS_BATCH_OPERATION_MOVE:
+            {
+                move_task_done (NULL, NULL, step->job);
+            }
+            break;
+
+            case NAUTILUS_BATCH_OPERATION_TRASH:
+            case NAUTILUS_BATCH_OPERATION_DELETE:
+            {
+                delete_task_done (NULL, NULL, step->job);
+            }
+            break;
+        }
+    }
+    g_array_unref (batch->steps);
+
+    success = !job_aborted ((CommonJob *) batch);
+    if (batch->progress_callback != NULL)
+    {
+        report_batch_progress (batch);
+    }
+    if (batch->done_callback != NULL)
+    {
+        batch->done_callback (success, batch->callback_data);
+    }
+
+    g_mutex_clear (&batch->lock);
+    finalize_common ((CommonJob *) batch);
+}
+
+static void
+carry_answers (CommonJob *to,
+               CommonJob *from)
+{
+    to->skip_all_error = from->skip_all_error;
+    to->skip_all_conflict = from->skip_all_conflict;
+    to->merge_all = from->merge_all;
+    to->replace_all = from->replace_all;
+    to->delete_all = from->delete_all;
+}
+
+static void
+batch_task_thread_func (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+    BatchJob *batch = task_data;
+    CommonJob *common = (CommonJob *) batch;
+    guint64 files;
+    guint64 bytes;
+
+    nautilus_progress_info_start (common->progress);
+
+    for (guint i = 0; i < batch->steps->len && !job_aborted (common); i++)
+    {
+        BatchStep *step = &g_array_index (batch->steps, BatchStep, i);
+
+        carry_answers (step->job, common);
+
+        switch (step->kind)
+        {
+            case NAUTILUS_BATCH_OPERATION_COPY:
+            {
+                nautilus_file_operations_copy (NULL, NULL, step->job, cancellable);
+            }
+            break;
+
+            case NAUTILUS_BATCH_OPERATION_MOVE:
+            {
+                nautilus_file_operations_move (NULL, NULL, step->job, cancellable);
+            }
+            break;
+
+            case NAUTILUS_BATCH_OPERATION_TRASH:
+            case NAUTILUS_BATCH_OPERATION_DELETE:
+            {
+                trash_or_delete_internal (NULL, NULL, step->job, cancellable);
+            }
+            break;
+        }
+
+        carry_answers (common, step->job);
+
+        g_mutex_lock (&batch->lock);
+        nautilus_progress_info_get_transferred (common->progress, &files, &bytes);
+        nautilus_progress_info_set_transferred (common->progress, 0, 0);
+        batch->done_files += files;
+        batch->done_bytes += bytes;
+        g_mutex_unlock (&batch->lock);
+    }
+}
+
+void
+nautilus_file_operations_batch (GList                          *operations,
+                                GtkWindow                      *parent_window,
+                                NautilusFileOperationsDBusData *dbus_data,
+                                guint                           progress_interval,
+                                NautilusBatchProgressCallback   progress_callback,
+                                NautilusOpCallback              done_callback,
+                                gpointer                        callback_data)
+{
+    g_autoptr (GTask) task = NULL;
+    BatchJob *batch;
+
+    batch = op_job_new (BatchJob, parent_window, dbus_data);
+    batch->steps = g_array_new (FALSE, FALSE, sizeof (BatchStep));
+    g_mutex_init (&batch->lock);
+    batch->progress_callback = progress_callback;
+    batch->done_callback = done_callback;
+    batch->callback_data = callback_data;
+
+    /* The jobs are set up here, as they would be in the main thread. */
+    for (GList *l = operations; l != NULL; l = l->next)
+    {
+        NautilusBatchOperation *operation = l->data;
+        BatchStep step;
+
+        step.kind = operation->kind;
+        switch (operation->kind)
+        {
+            case NAUTILUS_BATCH_OPERATION_COPY:
+            {
+                step.job = (CommonJob *) copy_job_setup (operation->sources, operation->destination,
+                                                         parent_window, dbus_data, NULL, NULL);
+            }
+            break;
+
+            case NAUTILUS_BATCH_OPERATION_MOVE:
+            {
+                step.job = (CommonJob *) move_job_setup (operation->sources, operation->destination,
+                                                         parent_window, dbus_data, NULL, NULL);
+            }
+            break;
+
+            case NAUTILUS_BATCH_OPERATION_TRASH:
+            case NAUTILUS_BATCH_OPERATION_DELETE:
+            {
+                step.job = (CommonJob *) setup_delete_job (operation->sources, parent_window, dbus_data,
+                                                           operation->kind == NAUTILUS_BATCH_OPERATION_TRASH,
+                                                           NULL, NULL);
+            }
+            break;
+
+            default:
+            {
+                g_assert_not_reached ();
+            }
+        }
+
+        if (operation->destination != NULL)
+        {
+            nautilus_progress_info_set_destination (batch->common.progress, operation->destination);
+        }
+
+        join_batch (step.job, batch);
+        g_array_append_val (batch->steps, step);
+    }
+
+    if (progress_callback != NULL)
+    {
+        batch->progress_timeout_id = g_timeout_add (progress_interval, batch_progress_timeout, batch);
+    }
+
+    task = g_task_new (NULL, batch->common.cancellable, batch_task_done, batch);
+    g_task_set_task_data (task, batch, NULL);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, batch_task_thread_func);
 }
 
 #if !defined (NAUTILUS_OMIT_SELF_CHECK)
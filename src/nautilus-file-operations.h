@@ -48,6 +48,27 @@ typedef void (* NautilusMountCallback)     (GVolume    *volume,
 typedef void (* NautilusUnmountCallback)   (gpointer    callback_data);
 typedef void (* NautilusExtractCallback)   (GList    *outputs,
                                             gpointer  callback_data);
+/* The files and bytes gone through by a batch so far, and the seconds it
+ * has been running */
+typedef void (* NautilusBatchProgressCallback) (guint64  files,
+                                                guint64  bytes,
+                                                gdouble  elapsed,
+                                                gpointer callback_data);
+
+typedef enum
+{
+    NAUTILUS_BATCH_OPERATION_COPY,
+    NAUTILUS_BATCH_OPERATION_MOVE,
+    NAUTILUS_BATCH_OPERATION_TRASH,
+    NAUTILUS_BATCH_OPERATION_DELETE,
+} NautilusBatchOperationKind;
+
+typedef struct
+{
+    NautilusBatchOperationKind kind;
+    GList *sources;             /* of GFile */
+    GFile *destination;         /* of the copies and moves */
+} NautilusBatchOperation;
 
 /* FIXME: int copy_action should be an enum */
 
@@ -163,3 +184,15 @@ void nautilus_file_operations_compress (GList                          *files,
                                         NautilusFileOperationsDBusData *dbus_data,
                                         NautilusCreateCallback          done_callback,
                                         gpointer                        done_callback_data);
+
+/* Runs @operations, of NautilusBatchOperation, one after the other as a
+ * single operation: they share a progress, are cancelled together, and the
+ * answers to the "apply to all" dialogs go for the whole batch. The
+ * progress callback is called every @progress_interval milliseconds. */
+void nautilus_file_operations_batch (GList                          *operations,
+                                     GtkWindow                      *parent_window,
+                                     NautilusFileOperationsDBusData *dbus_data,
+                                     guint                           progress_interval,
+                                     NautilusBatchProgressCallback   progress_callback,
+                                     NautilusOpCallback              done_callback,
+                                     gpointer                        callback_data);
@@ -30,6 +30,18 @@
 #define NAUTILUS_FILE_DEFAULT_ATTRIBUTES				\
 	"standard::*,access::*,mountable::*,time::*,unix::*,owner::*,selinux::*,thumbnail::*,id::filesystem,trash::orig-path,trash::deletion-date,metadata::*,recent::*"
 
+/* What directory loads ask for when the thumbnail probe resolves the
+ * thumbnail attributes instead.
+ */
+#define NAUTILUS_FILE_LOAD_ATTRIBUTES					\
+	"standard::*,access::*,mountable::*,time::*,unix::*,owner::*,selinux::*,id::filesystem,trash::orig-path,trash::deletion-date,metadata::*,recent::*"
+
+/* Just enough to show a file, used to load slow locations quickly. The
+ * rest is fetched later, for NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO.
+ */
+#define NAUTILUS_FILE_FAST_ATTRIBUTES					\
+	"standard::name,standard::display-name,standard::edit-name,standard::type,standard::size,standard::icon,standard::symbolic-icon,standard::content-type,standard::is-hidden,standard::is-backup,standard::is-symlink,standard::symlink-target,standard::is-virtual,standard::target-uri,standard::sort-order,time::modified,id::filesystem"
+
 /* These are in the typical sort order. Known things come first, then
  * things where we can't know, finally things where we don't yet know.
  */
@@ -39,28 +51,121 @@ typedef enum {
 	UNKNOWN
 } Knowledge;
 
+/* Fields most files never use live in side structs, allocated the
+ * first time they are set, since there can be many NautilusFile
+ * objects (think of a search with hundreds of thousands of hits).
+ */
+typedef struct
+{
+	guint directory_count;
+	guint file_count;
+	guint unreadable_count;
+	goffset size;
+} NautilusFileDeepCounts;
+
+/* Zoom levels and views showing the same file side by side each get
+ * their own scaled thumbnail */
+#define NAUTILUS_FILE_MAX_SCALED_THUMBNAILS 4
+
+typedef struct
+{
+	GdkPixbuf *pixbuf; /* NULL for none */
+	double thumb_scale;
+	int scale;
+} NautilusFileScaledThumbnail;
+
+typedef struct
+{
+	char *path;
+	GdkPixbuf *pixbuf;
+	time_t mtime;
+
+	/* The most recently used first */
+	NautilusFileScaledThumbnail scaled[NAUTILUS_FILE_MAX_SCALED_THUMBNAILS];
+
+	/* The handle of the file in the thumbnail cache, while it has loaded
+	 * thumbnails, and what it is charged for them */
+	GList *cache_link;
+	gsize cache_bytes;
+} NautilusFileThumbnailInfo;
+
+/* Only for files in trash:// and recent:// */
+typedef struct
+{
+	char *orig_path;
+	time_t trash_time; /* 0 is unknown */
+	time_t recency; /* 0 is unknown */
+} NautilusFileTrashInfo;
+
+/* Only for search hits */
+typedef struct
+{
+	gdouble relevance;
+	gchar *fts_snippet;
+} NautilusFileSearchInfo;
+
+/* Emblems and attributes provided by extensions */
+typedef struct
+{
+	GList *emblems;
+	GList *pending_emblems;
+
+	GHashTable *attributes;
+	GHashTable *pending_attributes;
+} NautilusFileExtensionData;
+
+/* Keys of the sort criteria too expensive to compute on every
+ * comparison, computed the first time the file is sorted by them.
+ */
+typedef struct
+{
+	guint generation; /* of the keys as a whole */
+
+	char *type_collation_key; /* NULL for no type */
+	eel_boolean_bit got_type_collation_key : 1;
+	/* The key belongs to the keys shared by the files of a type */
+	eel_boolean_bit type_collation_key_shared : 1;
+} NautilusFileSortKeys;
+
+/* The icon last returned by nautilus_file_get_icon(), together with
+ * the arguments it was returned for. Dropped whenever the file changes.
+ */
+typedef struct
+{
+	NautilusIconInfo *icon;
+	int size;
+	int scale;
+	NautilusFileIconFlags flags;
+} NautilusFileIconMemo;
+
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
 	
 	GRefString *name;
 
+	/* Computed on demand from the directory and the name, and dropped
+	 * whenever either changes.
+	 */
+	GFile *location;
+	GRefString *uri;
+
 	/* File info: */
 	GFileType type;
+	int sort_order;
 
 	GRefString *display_name;
-	char *display_name_collation_key;
-	char *directory_name_collation_key;
+	char *display_name_collation_key; /* computed on demand */
 	GRefString *edit_name;
 
 	goffset size; /* -1 is unknown */
 	
-	int sort_order;
-	
 	guint32 permissions;
 	int uid; /* -1 is none */
 	int gid; /* -1 is none */
 
+	guint directory_count;
+
 	GRefString *owner;
 	GRefString *owner_real;
 	GRefString *group;
@@ -77,22 +182,12 @@ struct NautilusFileDetails
 	char *description;
 	
 	GError *get_info_error;
-	
-	guint directory_count;
 
-	guint deep_directory_count;
-	guint deep_file_count;
-	guint deep_unreadable_count;
-	goffset deep_size;
+	NautilusFileDeepCounts *deep_counts;
 
 	GIcon *icon;
-	
-	char *thumbnail_path;
-	GdkPixbuf *thumbnail;
-	time_t thumbnail_mtime;
 
-	GdkPixbuf *scaled_thumbnail;
-	double thumbnail_scale;
+	NautilusFileThumbnailInfo *thumbnail_info;
 
 	GList *mime_list; /* If this is a directory, the list of MIME types in it. */
 
@@ -105,7 +200,7 @@ struct NautilusFileDetails
 	 */
 	GRefString *filesystem_id;
 
-	char *trash_orig_path;
+	NautilusFileTrashInfo *trash_info;
 
 	/* The following is for file operations in progress. Since
 	 * there are normally only a few of these, we can move them to
@@ -117,24 +212,27 @@ struct NautilusFileDetails
 	/* NautilusInfoProviders that need to be run for this file */
 	GList *pending_info_providers;
 
-	/* Emblems provided by extensions */
-	GList *extension_emblems;
-	GList *pending_extension_emblems;
-
-	/* Attributes provided by extensions */
-	GHashTable *extension_attributes;
-	GHashTable *pending_extension_attributes;
+	NautilusFileExtensionData *extension_data;
 
 	GHashTable *metadata;
 
 	/* Mount for mountpoint or the references GMount for a "mountable" */
 	GMount *mount;
 	
+	/* Generation of the directory load that last saw this file. The
+	 * file is unconfirmed while it differs from the directory's.
+	 */
+	guint load_generation;
+
+	/* Starred generation is_starred was looked up at, 0 for none */
+	guint starred_generation;
+
 	/* boolean fields: bitfield to save space, since there can be
            many NautilusFile objects. */
 
-	eel_boolean_bit unconfirmed                   : 1;
 	eel_boolean_bit is_gone                       : 1;
+	/* Set while the file can be found by its URI in files_by_uri */
+	eel_boolean_bit is_in_uri_table               : 1;
 	/* Set when emitting files_added on the directory to make sure we
 	   add a file, and only once */
 	eel_boolean_bit is_added                      : 1;
@@ -145,6 +243,10 @@ struct NautilusFileDetails
 	eel_boolean_bit got_file_info                 : 1;
 	eel_boolean_bit get_info_failed               : 1;
 	eel_boolean_bit file_info_is_up_to_date       : 1;
+	/* The info only has NAUTILUS_FILE_FAST_ATTRIBUTES so far. */
+	eel_boolean_bit has_partial_info              : 1;
+	/* Not asked again for the rest until the info is invalidated. */
+	eel_boolean_bit extended_info_failed          : 1;
 	
 	eel_boolean_bit got_directory_count           : 1;
 	eel_boolean_bit directory_count_failed        : 1;
@@ -169,6 +271,8 @@ struct NautilusFileDetails
 	
 	eel_boolean_bit is_thumbnailing               : 1;
 
+	eel_boolean_bit is_starred                    : 1;
+
 	eel_boolean_bit is_symlink                    : 1;
 	eel_boolean_bit is_mountpoint                 : 1;
 	eel_boolean_bit is_hidden                     : 1;
@@ -197,11 +301,11 @@ struct NautilusFileDetails
 	eel_boolean_bit filesystem_remote             : 1;
 	GRefString     *filesystem_type;
 
-	time_t trash_time; /* 0 is unknown */
-	time_t recency; /* 0 is unknown */
+	NautilusFileSearchInfo *search_info;
 
-	gdouble search_relevance;
-	gchar *fts_snippet;
+	NautilusFileSortKeys *sort_keys;
+
+	NautilusFileIconMemo *icon_memo;
 
 	guint64 free_space; /* (guint)-1 for unknown */
 	time_t free_space_read; /* The time free_space was updated, or 0 for never */
@@ -232,6 +336,19 @@ gboolean      nautilus_file_get_date                       (NautilusFile
 							    time_t                 *date);
 void          nautilus_file_updated_deep_count_in_progress (NautilusFile           *file);
 
+/* Allocate the side structs on first use. */
+NautilusFileDeepCounts    *nautilus_file_ensure_deep_counts    (NautilusFile *file);
+NautilusFileThumbnailInfo *nautilus_file_ensure_thumbnail_info (NautilusFile *file);
+/* Estimates the memory of the file and the data it owns, for the debug
+ * stats. The strings interned across files, like the MIME type and the
+ * owner, are left out. */
+gsize nautilus_file_get_memory_usage (NautilusFile *file);
+
+/* Called by the thumbnail cache to take back the memory of the loaded
+ * thumbnails, which are loaded again when asked for. */
+void nautilus_file_drop_loaded_thumbnail (NautilusFile *file);
+void nautilus_file_thumbnail_info_clear_scaled (NautilusFileThumbnailInfo *thumbnail_info);
+
 
 void          nautilus_file_clear_info                     (NautilusFile           *file);
 /* Compare file's state with a fresh file info struct, return FALSE if
@@ -252,12 +369,17 @@ gboolean      nautilus_file_set_display_name               (NautilusFile
 							    const char             *display_name,
 							    const char             *edit_name,
 							    gboolean                custom);
+/* The display name, defaulting to the name, and its collation key, both
+ * owned by the file. */
+const char   *nautilus_file_peek_display_name              (NautilusFile           *file);
+const char   *nautilus_file_peek_display_name_collation_key (NautilusFile          *file);
 NautilusDirectory *
               nautilus_file_get_directory                  (NautilusFile           *file);
 void          nautilus_file_set_directory                  (NautilusFile           *file,
 							    NautilusDirectory      *directory);
 void          nautilus_file_set_mount                      (NautilusFile           *file,
 							    GMount                 *mount);
+void          nautilus_file_invalidate_location            (NautilusFile           *file);
 
 /* Mark specified attributes for this file out of date without canceling current
  * I/O or kicking off new I/O.
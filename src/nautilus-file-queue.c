@@ -123,6 +123,44 @@ nautilus_file_queue_head (NautilusFileQueue *queue)
     return NAUTILUS_FILE (queue->head->data);
 }
 
+NautilusFile *
+nautilus_file_queue_next (NautilusFileQueue *queue,
+                          NautilusFile      *file)
+{
+    GList *link;
+
+    link = g_hash_table_lookup (queue->item_to_link_map, file);
+
+    if (link == NULL || link->next == NULL)
+    {
+        return NULL;
+    }
+
+    return NAUTILUS_FILE (link->next->data);
+}
+
+void
+nautilus_file_queue_move_to_head (NautilusFileQueue *queue,
+                                  NautilusFile      *file)
+{
+    GList *link;
+
+    link = g_hash_table_lookup (queue->item_to_link_map, file);
+
+    if (link == NULL || link == queue->head)
+    {
+        return;
+    }
+
+    if (link == queue->tail)
+    {
+        queue->tail = queue->tail->prev;
+    }
+
+    queue->head = g_list_remove_link (queue->head, link);
+    queue->head = g_list_concat (link, queue->head);
+}
+
 gboolean
 nautilus_file_queue_is_empty (NautilusFileQueue *queue)
 {
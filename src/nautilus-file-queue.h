@@ -43,4 +43,16 @@ void               nautilus_file_queue_remove   (NautilusFileQueue *queue,
 /* Get the file at the head of the queue without removing or unrefing it. */
 NautilusFile *     nautilus_file_queue_head     (NautilusFileQueue *queue);
 
+/* Get the file following @file in the queue, or NULL if @file is the
+ * tail or is not on the queue. Runs in constant time.
+ */
+NautilusFile *     nautilus_file_queue_next     (NautilusFileQueue *queue,
+						 NautilusFile      *file);
+
+/* Move a file that is already on the queue to its head. Does nothing
+ * if the file is not on the queue.
+ */
+void               nautilus_file_queue_move_to_head (NautilusFileQueue *queue,
+						     NautilusFile      *file);
+
 gboolean           nautilus_file_queue_is_empty (NautilusFileQueue *queue);
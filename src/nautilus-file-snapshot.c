@@ -0,0 +1,139 @@
+/* nautilus-file-snapshot.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-file-snapshot.h"
+
+#include "nautilus-directory.h"
+#include "nautilus-file-private.h"
+
+static void
+snapshot_clear (NautilusFileSnapshot *snapshot)
+{
+    g_clear_pointer (&snapshot->name, g_ref_string_release);
+    g_clear_pointer (&snapshot->display_name, g_ref_string_release);
+    g_free (snapshot->collation_key);
+    g_clear_pointer (&snapshot->mime_type, g_ref_string_release);
+    g_clear_object (&snapshot->parent);
+}
+
+static NautilusFileSnapshot *
+snapshot_new (NautilusFile *file,
+              GFile        *parent)
+{
+    NautilusFileDetails *details = file->details;
+    NautilusFileSnapshot *snapshot;
+
+    snapshot = g_atomic_rc_box_new0 (NautilusFileSnapshot);
+
+    snapshot->name = g_ref_string_acquire (details->name);
+    /* Sets the one made from the name if there is none yet */
+    nautilus_file_peek_display_name (file);
+    snapshot->display_name = details->display_name != NULL ?
+                             g_ref_string_acquire (details->display_name) :
+                             g_ref_string_new_intern ("");
+    snapshot->collation_key = g_strdup (nautilus_file_peek_display_name_collation_key (file));
+    snapshot->mime_type = details->mime_type != NULL ?
+                          g_ref_string_acquire (details->mime_type) :
+                          g_ref_string_new_intern ("application/octet-stream");
+
+    snapshot->type = details->type;
+    snapshot->size = details->size;
+    snapshot->mtime = details->mtime;
+    snapshot->atime = details->atime;
+    snapshot->btime = details->btime;
+    snapshot->permissions = details->permissions;
+    snapshot->has_permissions = details->has_permissions;
+
+    snapshot->is_self_owned = nautilus_file_is_self_owned (file);
+    snapshot->parent = snapshot->is_self_owned ?
+                       nautilus_file_get_location (file) :
+                       g_object_ref (parent);
+
+    return snapshot;
+}
+
+NautilusFileSnapshot *
+nautilus_file_snapshot_new (NautilusFile *file)
+{
+    g_autoptr (GFile) parent = NULL;
+
+    g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
+
+    parent = nautilus_directory_get_location (file->details->directory);
+
+    return snapshot_new (file, parent);
+}
+
+GPtrArray *
+nautilus_file_snapshot_list_new (GList *files)
+{
+    NautilusDirectory *last_directory = NULL;
+    g_autoptr (GFile) parent = NULL;
+    GPtrArray *snapshots;
+
+    snapshots = g_ptr_array_new_full (g_list_length (files),
+                                      (GDestroyNotify) nautilus_file_snapshot_unref);
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        NautilusFile *file = l->data;
+
+        /* The files of a list mostly share their folder */
+        if (file->details->directory != last_directory)
+        {
+            last_directory = file->details->directory;
+            g_clear_object (&parent);
+            parent = nautilus_directory_get_location (last_directory);
+        }
+
+        g_ptr_array_add (snapshots, snapshot_new (file, parent));
+    }
+
+    return snapshots;
+}
+
+NautilusFileSnapshot *
+nautilus_file_snapshot_ref (NautilusFileSnapshot *snapshot)
+{
+    return g_atomic_rc_box_acquire (snapshot);
+}
+
+void
+nautilus_file_snapshot_unref (NautilusFileSnapshot *snapshot)
+{
+    g_atomic_rc_box_release_full (snapshot, (GDestroyNotify) snapshot_clear);
+}
+
+GFile *
+nautilus_file_snapshot_get_location (NautilusFileSnapshot *snapshot)
+{
+    if (snapshot->is_self_owned)
+    {
+        return g_object_ref (snapshot->parent);
+    }
+
+    return g_file_get_child (snapshot->parent, snapshot->name);
+}
+
+char *
+nautilus_file_snapshot_get_uri (NautilusFileSnapshot *snapshot)
+{
+    g_autoptr (GFile) location = NULL;
+
+    location = nautilus_file_snapshot_get_location (snapshot);
+
+    return g_file_get_uri (location);
+}
@@ -0,0 +1,60 @@
+/* nautilus-file-snapshot.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "nautilus-file.h"
+
+/* A snapshot holds what a file was when it was taken, for the work done
+ * on a lot of files in other threads, as NautilusFile is only for the main
+ * thread. It never changes, and can be read, reffed and unreffed from any
+ * thread. The names and the MIME type are shared with the file, so taking
+ * one doesn't copy much.
+ */
+
+typedef struct
+{
+    GRefString *name;
+    GRefString *display_name;
+    char *collation_key;        /* of the display name, as the names are sorted */
+    GFileType type;
+    goffset size;               /* -1 when unknown */
+    time_t mtime;               /* 0 when unknown */
+    time_t atime;               /* 0 when unknown */
+    time_t btime;               /* 0 when unknown */
+    GRefString *mime_type;      /* as nautilus_file_get_mime_type() */
+    guint32 permissions;        /* only when has_permissions */
+    gboolean has_permissions;
+
+    /*< private >*/
+    GFile *parent;              /* the file itself for those of roots */
+    gboolean is_self_owned;
+} NautilusFileSnapshot;
+
+/* Only from the main thread, as they read the files. */
+NautilusFileSnapshot *nautilus_file_snapshot_new          (NautilusFile         *file);
+/* Returns a GPtrArray of the snapshots of @files, in the same order. */
+GPtrArray            *nautilus_file_snapshot_list_new     (GList                *files);
+
+NautilusFileSnapshot *nautilus_file_snapshot_ref          (NautilusFileSnapshot *snapshot);
+void                  nautilus_file_snapshot_unref        (NautilusFileSnapshot *snapshot);
+
+GFile                *nautilus_file_snapshot_get_location (NautilusFileSnapshot *snapshot);
+char                 *nautilus_file_snapshot_get_uri      (NautilusFileSnapshot *snapshot);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusFileSnapshot, nautilus_file_snapshot_unref)
@@ -27,12 +27,14 @@
 
 #include <glib/gi18n.h>
 
+#include "nautilus-executor.h"
 #include "nautilus-file-operations.h"
 #include "nautilus-file.h"
 #include "nautilus-file-undo-manager.h"
 #include "nautilus-batch-rename-dialog.h"
 #include "nautilus-batch-rename-utilities.h"
 #include "nautilus-tag-manager.h"
+#include "nautilus-trash-reader.h"
 
 
 /* Since we use g_get_current_time for setting "orig_trash_time" in the undo
@@ -395,6 +397,117 @@ file_undo_info_delete_callback (GHashTable *debuting_uris,
                                    user_cancel);
 }
 
+/* A list of files kept as names relative to a common parent, in a string
+ * chunk, rather than as GFiles: an undo info can hold hundreds of thousands
+ * of them, and they are only needed again when the undo or redo runs. The
+ * names starting with a '/' are relative to the parent, the others are the
+ * URIs of the files outside of it.
+ */
+typedef struct
+{
+    GFile *parent;
+    GStringChunk *names;
+    GPtrArray *entries;
+} FileList;
+
+static void
+file_list_init (FileList *list,
+                GFile    *parent)
+{
+    list->parent = parent != NULL ? g_object_ref (parent) : NULL;
+    list->names = g_string_chunk_new (4096);
+    list->entries = g_ptr_array_new ();
+}
+
+static void
+file_list_clear (FileList *list)
+{
+    g_clear_object (&list->parent);
+    g_clear_pointer (&list->names, g_string_chunk_free);
+    g_clear_pointer (&list->entries, g_ptr_array_unref);
+}
+
+static guint
+file_list_get_length (FileList *list)
+{
+    return list->entries->len;
+}
+
+/* @file can be NULL, to keep the list in step with another one */
+static void
+file_list_add (FileList *list,
+               GFile    *file)
+{
+    g_autofree char *relative_path = NULL;
+    g_autofree char *name = NULL;
+
+    if (file == NULL)
+    {
+        g_ptr_array_add (list->entries, NULL);
+        return;
+    }
+
+    if (list->parent == NULL)
+    {
+        /* The first file decides then */
+        list->parent = g_file_get_parent (file);
+    }
+
+    if (list->parent != NULL)
+    {
+        relative_path = g_file_get_relative_path (list->parent, file);
+    }
+
+    if (relative_path != NULL)
+    {
+        name = g_strconcat ("/", relative_path, NULL);
+    }
+    else
+    {
+        name = g_file_get_uri (file);
+    }
+
+    g_ptr_array_add (list->entries, g_string_chunk_insert (list->names, name));
+}
+
+static GFile *
+file_list_get (FileList *list,
+               guint     index)
+{
+    const char *entry;
+
+    entry = g_ptr_array_index (list->entries, index);
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    if (entry[0] == '/')
+    {
+        return g_file_resolve_relative_path (list->parent, entry + 1);
+    }
+
+    return g_file_new_for_uri (entry);
+}
+
+static GList *
+file_list_get_files (FileList *list)
+{
+    GList *files = NULL;
+
+    for (guint i = file_list_get_length (list); i > 0; i--)
+    {
+        GFile *file = file_list_get (list, i - 1);
+
+        if (file != NULL)
+        {
+            files = g_list_prepend (files, file);
+        }
+    }
+
+    return files;
+}
+
 /* copy/move/duplicate/link/restore from trash */
 struct _NautilusFileUndoInfoExt
 {
@@ -402,8 +515,8 @@ struct _NautilusFileUndoInfoExt
 
     GFile *src_dir;
     GFile *dest_dir;
-    GQueue *sources;          /* Relative to src_dir */
-    GQueue *destinations;     /* Relative to dest_dir */
+    FileList sources;         /* Relative to src_dir */
+    FileList destinations;    /* Relative to dest_dir */
 };
 
 G_DEFINE_TYPE (NautilusFileUndoInfoExt, nautilus_file_undo_info_ext, NAUTILUS_TYPE_FILE_UNDO_INFO)
@@ -411,18 +524,16 @@ G_DEFINE_TYPE (NautilusFileUndoInfoExt, nautilus_file_undo_info_ext, NAUTILUS_TY
 static char *
 ext_get_first_target_short_name (NautilusFileUndoInfoExt *self)
 {
-    GList *targets_first;
-    char *file_name = NULL;
+    g_autoptr (GFile) target = NULL;
 
-    targets_first = g_queue_peek_head_link (self->destinations);
-
-    if (targets_first != NULL &&
-        targets_first->data != NULL)
+    if (file_list_get_length (&self->destinations) == 0)
     {
-        file_name = g_file_get_basename (targets_first->data);
+        return NULL;
     }
 
-    return file_name;
+    target = file_list_get (&self->destinations, 0);
+
+    return g_file_get_basename (target);
 }
 
 static void
@@ -582,12 +693,18 @@ ext_create_link_redo_func (NautilusFileUndoInfoExt        *self,
                            GtkWindow                      *parent_window,
                            NautilusFileOperationsDBusData *dbus_data)
 {
-    nautilus_file_operations_link (g_queue_peek_head_link (self->sources),
+    GList *files;
+
+    files = file_list_get_files (&self->sources);
+
+    nautilus_file_operations_link (files,
                                    self->dest_dir,
                                    parent_window,
                                    dbus_data,
                                    file_undo_info_transfer_callback,
                                    self);
+
+    g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -595,11 +712,17 @@ ext_duplicate_redo_func (NautilusFileUndoInfoExt        *self,
                          GtkWindow                      *parent_window,
                          NautilusFileOperationsDBusData *dbus_data)
 {
-    nautilus_file_operations_duplicate (g_queue_peek_head_link (self->sources),
+    GList *files;
+
+    files = file_list_get_files (&self->sources);
+
+    nautilus_file_operations_duplicate (files,
                                         parent_window,
                                         dbus_data,
                                         file_undo_info_transfer_callback,
                                         self);
+
+    g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -607,12 +730,18 @@ ext_copy_redo_func (NautilusFileUndoInfoExt        *self,
                     GtkWindow                      *parent_window,
                     NautilusFileOperationsDBusData *dbus_data)
 {
-    nautilus_file_operations_copy_async (g_queue_peek_head_link (self->sources),
+    GList *files;
+
+    files = file_list_get_files (&self->sources);
+
+    nautilus_file_operations_copy_async (files,
                                          self->dest_dir,
                                          parent_window,
                                          dbus_data,
                                          file_undo_info_transfer_callback,
                                          self);
+
+    g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -620,12 +749,18 @@ ext_move_restore_redo_func (NautilusFileUndoInfoExt        *self,
                             GtkWindow                      *parent_window,
                             NautilusFileOperationsDBusData *dbus_data)
 {
-    nautilus_file_operations_move_async (g_queue_peek_head_link (self->sources),
+    GList *files;
+
+    files = file_list_get_files (&self->sources);
+
+    nautilus_file_operations_move_async (files,
                                          self->dest_dir,
                                          parent_window,
                                          dbus_data,
                                          file_undo_info_transfer_callback,
                                          self);
+
+    g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -664,11 +799,17 @@ ext_restore_undo_func (NautilusFileUndoInfoExt        *self,
                        GtkWindow                      *parent_window,
                        NautilusFileOperationsDBusData *dbus_data)
 {
-    nautilus_file_operations_trash_or_delete_async (g_queue_peek_head_link (self->destinations),
+    GList *files;
+
+    files = file_list_get_files (&self->destinations);
+
+    nautilus_file_operations_trash_or_delete_async (files,
                                                     parent_window,
                                                     dbus_data,
                                                     file_undo_info_delete_callback,
                                                     self);
+
+    g_list_free_full (files, g_object_unref);
 }
 
 
@@ -677,12 +818,18 @@ ext_move_undo_func (NautilusFileUndoInfoExt        *self,
                     GtkWindow                      *parent_window,
                     NautilusFileOperationsDBusData *dbus_data)
 {
-    nautilus_file_operations_move_async (g_queue_peek_head_link (self->destinations),
+    GList *files;
+
+    files = file_list_get_files (&self->destinations);
+
+    nautilus_file_operations_move_async (files,
                                          self->src_dir,
                                          parent_window,
                                          dbus_data,
                                          file_undo_info_transfer_callback,
                                          self);
+
+    g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -692,14 +839,14 @@ ext_copy_duplicate_undo_func (NautilusFileUndoInfoExt        *self,
 {
     GList *files;
 
-    files = g_list_copy (g_queue_peek_head_link (self->destinations));
+    files = file_list_get_files (&self->destinations);
     files = g_list_reverse (files);     /* Deleting must be done in reverse */
 
     nautilus_file_operations_delete_async (files, parent_window,
                                            dbus_data,
                                            file_undo_info_delete_callback, self);
 
-    g_list_free (files);
+    g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -740,15 +887,8 @@ nautilus_file_undo_info_ext_finalize (GObject *obj)
 {
     NautilusFileUndoInfoExt *self = NAUTILUS_FILE_UNDO_INFO_EXT (obj);
 
-    if (self->sources)
-    {
-        g_queue_free_full (self->sources, g_object_unref);
-    }
-
-    if (self->destinations)
-    {
-        g_queue_free_full (self->destinations, g_object_unref);
-    }
+    file_list_clear (&self->sources);
+    file_list_clear (&self->destinations);
 
     g_clear_object (&self->src_dir);
     g_clear_object (&self->dest_dir);
@@ -784,8 +924,8 @@ nautilus_file_undo_info_ext_new (NautilusFileUndoOp  op_type,
 
     self->src_dir = g_object_ref (src_dir);
     self->dest_dir = g_object_ref (target_dir);
-    self->sources = g_queue_new ();
-    self->destinations = g_queue_new ();
+    file_list_init (&self->sources, src_dir);
+    file_list_init (&self->destinations, target_dir);
 
     return NAUTILUS_FILE_UNDO_INFO (self);
 }
@@ -795,8 +935,8 @@ nautilus_file_undo_info_ext_add_origin_target_pair (NautilusFileUndoInfoExt *sel
                                                     GFile                   *origin,
                                                     GFile                   *target)
 {
-    g_queue_push_tail (self->sources, g_object_ref (origin));
-    g_queue_push_tail (self->destinations, g_object_ref (target));
+    file_list_add (&self->sources, origin);
+    file_list_add (&self->destinations, target);
 }
 
 /* create new file/folder */
@@ -1590,7 +1730,13 @@ struct _NautilusFileUndoInfoTrash
 {
     NautilusFileUndoInfo parent_instance;
 
-    GHashTable *trashed;
+    FileList trashed;
+    GArray *trash_times;
+    /* Where the files went in the trash, in step with trashed, when it is
+     * known; the undo looks there first rather than going through the
+     * whole trash. */
+    FileList trashed_locations;
+    gboolean has_trashed_locations;
 };
 
 G_DEFINE_TYPE (NautilusFileUndoInfoTrash, nautilus_file_undo_info_trash, NAUTILUS_TYPE_FILE_UNDO_INFO)
@@ -1603,7 +1749,7 @@ trash_strings_func (NautilusFileUndoInfo  *info,
                     gchar                **redo_description)
 {
     NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (info);
-    gint count = g_hash_table_size (self->trashed);
+    gint count = file_list_get_length (&self->trashed);
 
     if (count != 1)
     {
@@ -1616,24 +1762,22 @@ trash_strings_func (NautilusFileUndoInfo  *info,
     }
     else
     {
-        GList *keys;
         char *name, *orig_path;
         GFile *file;
 
-        keys = g_hash_table_get_keys (self->trashed);
-        file = keys->data;
+        file = file_list_get (&self->trashed, 0);
         name = g_file_get_basename (file);
         orig_path = g_file_get_path (file);
         *undo_description = g_strdup_printf (_("Restore “%s” to “%s”"), name, orig_path);
 
         g_free (name);
         g_free (orig_path);
-        g_list_free (keys);
 
         name = g_file_get_parse_name (file);
         *redo_description = g_strdup_printf (_("Move “%s” to trash"), name);
 
         g_free (name);
+        g_object_unref (file);
     }
 
     *undo_label = g_strdup (_("_Undo Trash"));
@@ -1646,34 +1790,23 @@ trash_redo_func_callback (GHashTable *debuting_uris,
                           gpointer    user_data)
 {
     NautilusFileUndoInfoTrash *self = user_data;
-    GHashTable *new_trashed_files;
     GTimeVal current_time;
-    gsize updated_trash_time;
-    GFile *file;
-    GList *keys, *l;
+    gint64 updated_trash_time;
 
     if (!user_cancel)
     {
-        new_trashed_files =
-            g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
-                                   g_object_unref, NULL);
-
-        keys = g_hash_table_get_keys (self->trashed);
-
         g_get_current_time (&current_time);
         updated_trash_time = current_time.tv_sec;
 
-        for (l = keys; l != NULL; l = l->next)
+        for (guint i = 0; i < self->trash_times->len; i++)
         {
-            file = l->data;
-            g_hash_table_insert (new_trashed_files,
-                                 g_object_ref (file), GSIZE_TO_POINTER (updated_trash_time));
+            g_array_index (self->trash_times, gint64, i) = updated_trash_time;
         }
 
-        g_list_free (keys);
-        g_hash_table_destroy (self->trashed);
-
-        self->trashed = new_trashed_files;
+        /* They are somewhere else in the trash now. */
+        file_list_clear (&self->trashed_locations);
+        file_list_init (&self->trashed_locations, NULL);
+        self->has_trashed_locations = FALSE;
     }
 
     file_undo_info_delete_callback (debuting_uris, user_cancel, user_data);
@@ -1686,16 +1819,123 @@ trash_redo_func (NautilusFileUndoInfo           *info,
 {
     NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (info);
 
-    if (g_hash_table_size (self->trashed) > 0)
+    if (file_list_get_length (&self->trashed) > 0)
     {
         GList *locations;
 
-        locations = g_hash_table_get_keys (self->trashed);
+        locations = file_list_get_files (&self->trashed);
         nautilus_file_operations_trash_or_delete_async (locations, parent_window,
                                                         dbus_data,
                                                         trash_redo_func_callback, self);
 
-        g_list_free (locations);
+        g_list_free_full (locations, g_object_unref);
+    }
+}
+
+static gboolean
+trash_deletion_time_matches (GFileInfo *info,
+                             gint64     orig_trash_time)
+{
+    GDateTime *date;
+    gint64 trash_time;
+
+    trash_time = 0;
+    date = g_file_info_get_deletion_date (info);
+    if (date)
+    {
+        trash_time = g_date_time_to_unix (date);
+        g_date_time_unref (date);
+    }
+
+    return ABS (orig_trash_time - trash_time) <= TRASH_TIME_EPSILON;
+}
+
+/* Looks for the files at the places they were recorded to be trashed to,
+ * returning whether all of them were found there. */
+static gboolean
+trash_retrieve_recorded_files (NautilusFileUndoInfoTrash *self,
+                               GHashTable                *to_restore)
+{
+    gboolean all_found;
+
+    if (!self->has_trashed_locations)
+    {
+        return FALSE;
+    }
+
+    all_found = TRUE;
+    for (guint i = 0; i < file_list_get_length (&self->trashed); i++)
+    {
+        g_autoptr (GFileInfo) info = NULL;
+        g_autoptr (GFile) origfile = NULL;
+        g_autoptr (GFile) file = NULL;
+        g_autoptr (GFile) item = NULL;
+        const char *origpath;
+
+        item = file_list_get (&self->trashed_locations, i);
+        if (item != NULL)
+        {
+            info = g_file_query_info (item,
+                                      G_FILE_ATTRIBUTE_TRASH_DELETION_DATE ","
+                                      G_FILE_ATTRIBUTE_TRASH_ORIG_PATH,
+                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                      NULL, NULL);
+        }
+        if (info != NULL)
+        {
+            origpath = g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
+            if (origpath != NULL)
+            {
+                origfile = g_file_new_for_path (origpath);
+            }
+        }
+
+        file = file_list_get (&self->trashed, i);
+        if (origfile != NULL &&
+            g_file_equal (origfile, file) &&
+            trash_deletion_time_matches (info, g_array_index (self->trash_times, gint64, i)))
+        {
+            g_hash_table_insert (to_restore, g_object_ref (item), g_object_ref (origfile));
+        }
+        else
+        {
+            all_found = FALSE;
+        }
+    }
+
+    return all_found;
+}
+
+/* Looks for the files left in @trashed in the local trash folders, read
+ * directly, and takes those found out of it. */
+static void
+trash_retrieve_local_files (NautilusFileUndoInfoTrash *self,
+                            GHashTable                *trashed,
+                            GHashTable                *to_restore)
+{
+    g_autoptr (GPtrArray) items = NULL;
+
+    items = nautilus_trash_reader_read (NULL);
+    for (guint i = 0; items != NULL && i < items->len; i++)
+    {
+        NautilusTrashItem *item = g_ptr_array_index (items, i);
+        g_autoptr (GFile) origfile = NULL;
+        gpointer lookupvalue;
+        gint64 trash_time;
+
+        origfile = g_file_new_for_path (item->orig_path);
+        lookupvalue = g_hash_table_lookup (trashed, origfile);
+        if (lookupvalue == NULL)
+        {
+            continue;
+        }
+
+        trash_time = g_array_index (self->trash_times, gint64, GPOINTER_TO_UINT (lookupvalue) - 1);
+        if (ABS (trash_time - item->deletion_time) <= TRASH_TIME_EPSILON)
+        {
+            g_hash_table_insert (to_restore, g_object_ref (item->file), g_object_ref (origfile));
+            g_hash_table_remove (trashed, origfile);
+        }
     }
 }
 
@@ -1708,12 +1948,38 @@ trash_retrieve_files_to_restore_thread (GTask        *task,
     NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (source_object);
     GFileEnumerator *enumerator;
     GHashTable *to_restore;
+    g_autoptr (GHashTable) trashed = NULL;
     GFile *trash;
     GError *error = NULL;
 
     to_restore = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
                                         g_object_unref, g_object_unref);
 
+    if (trash_retrieve_recorded_files (self, to_restore))
+    {
+        g_task_return_pointer (task, to_restore, NULL);
+        return;
+    }
+
+    /* The files are only looked up by their original location here, so
+     * that is the only time they are needed as GFiles. */
+    trashed = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                     g_object_unref, NULL);
+    for (guint i = 0; i < file_list_get_length (&self->trashed); i++)
+    {
+        g_hash_table_insert (trashed, file_list_get (&self->trashed, i),
+                             GUINT_TO_POINTER (i + 1));
+    }
+
+    /* Rather than listing trash:/// through GVfs, which is slow for big
+     * trashes, unless some weren't found that way */
+    trash_retrieve_local_files (self, trashed, to_restore);
+    if (g_hash_table_size (trashed) == 0)
+    {
+        g_task_return_pointer (task, to_restore, NULL);
+        return;
+    }
+
     trash = g_file_new_for_uri ("trash:///");
 
     enumerator = g_file_enumerate_children (trash,
@@ -1728,7 +1994,6 @@ trash_retrieve_files_to_restore_thread (GTask        *task,
         GFileInfo *info;
         gpointer lookupvalue;
         GFile *item;
-        glong trash_time, orig_trash_time;
         const char *origpath;
         GFile *origfile;
 
@@ -1738,25 +2003,21 @@ trash_retrieve_files_to_restore_thread (GTask        *task,
             origpath = g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
             origfile = g_file_new_for_path (origpath);
 
-            lookupvalue = g_hash_table_lookup (self->trashed, origfile);
+            lookupvalue = g_hash_table_lookup (trashed, origfile);
 
-            if (lookupvalue)
+            /* Those found at their recorded place are already in. */
+            if (lookupvalue &&
+                trash_deletion_time_matches (info, g_array_index (self->trash_times, gint64,
+                                                                  GPOINTER_TO_UINT (lookupvalue) - 1)))
             {
-                GDateTime *date;
-
-                orig_trash_time = GPOINTER_TO_SIZE (lookupvalue);
-                trash_time = 0;
-                date = g_file_info_get_deletion_date (info);
-                if (date)
+                /* File in the trash */
+                item = g_file_get_child (trash, g_file_info_get_name (info));
+                if (g_hash_table_contains (to_restore, item))
                 {
-                    trash_time = g_date_time_to_unix (date);
-                    g_date_time_unref (date);
+                    g_object_unref (item);
                 }
-
-                if (ABS (orig_trash_time - trash_time) <= TRASH_TIME_EPSILON)
+                else
                 {
-                    /* File in the trash */
-                    item = g_file_get_child (trash, g_file_info_get_name (info));
                     g_hash_table_insert (to_restore, item, g_object_ref (origfile));
                 }
             }
@@ -1788,7 +2049,7 @@ trash_retrieve_files_to_restore_async (NautilusFileUndoInfoTrash *self,
 
     task = g_task_new (G_OBJECT (self), NULL, callback, user_data);
 
-    g_task_run_in_thread (task, trash_retrieve_files_to_restore_thread);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_FILE_OPERATIONS, task, trash_retrieve_files_to_restore_thread);
 
     g_object_unref (task);
 }
@@ -1817,7 +2078,15 @@ trash_retrieve_files_ready (GObject      *source,
             item = l->data;
             dest = g_hash_table_lookup (files_to_restore, item);
 
-            g_file_move (item, dest, G_FILE_COPY_NOFOLLOW_SYMLINKS, NULL, NULL, NULL, NULL);
+            /* The trash:/// files aren't native, those read directly are */
+            if (g_file_is_native (item))
+            {
+                nautilus_trash_reader_restore (item, dest, NULL);
+            }
+            else
+            {
+                g_file_move (item, dest, G_FILE_COPY_NOFOLLOW_SYMLINKS, NULL, NULL, NULL, NULL);
+            }
         }
 
         g_list_free (gfiles_in_trash);
@@ -1851,15 +2120,18 @@ trash_undo_func (NautilusFileUndoInfo           *info,
 static void
 nautilus_file_undo_info_trash_init (NautilusFileUndoInfoTrash *self)
 {
-    self->trashed = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
-                                           g_object_unref, NULL);
+    file_list_init (&self->trashed, NULL);
+    self->trash_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+    file_list_init (&self->trashed_locations, NULL);
 }
 
 static void
 nautilus_file_undo_info_trash_finalize (GObject *obj)
 {
     NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (obj);
-    g_hash_table_destroy (self->trashed);
+    file_list_clear (&self->trashed);
+    g_array_unref (self->trash_times);
+    file_list_clear (&self->trashed_locations);
 
     G_OBJECT_CLASS (nautilus_file_undo_info_trash_parent_class)->finalize (obj);
 }
@@ -1889,20 +2161,37 @@ nautilus_file_undo_info_trash_new (gint item_count)
 void
 nautilus_file_undo_info_trash_add_file (NautilusFileUndoInfoTrash *self,
                                         GFile                     *file)
+{
+    nautilus_file_undo_info_trash_add_trashed_file (self, file, NULL);
+}
+
+void
+nautilus_file_undo_info_trash_add_trashed_file (NautilusFileUndoInfoTrash *self,
+                                                GFile                     *file,
+                                                GFile                     *trashed)
 {
     GTimeVal current_time;
-    gsize orig_trash_time;
+    gint64 orig_trash_time;
 
     g_get_current_time (&current_time);
     orig_trash_time = current_time.tv_sec;
 
-    g_hash_table_insert (self->trashed, g_object_ref (file), GSIZE_TO_POINTER (orig_trash_time));
+    file_list_add (&self->trashed, file);
+    g_array_append_val (self->trash_times, orig_trash_time);
+    file_list_add (&self->trashed_locations, trashed);
+    self->has_trashed_locations |= (trashed != NULL);
 }
 
 GList *
 nautilus_file_undo_info_trash_get_files (NautilusFileUndoInfoTrash *self)
 {
-    return g_hash_table_get_keys (self->trashed);
+    return file_list_get_files (&self->trashed);
+}
+
+guint
+nautilus_file_undo_info_trash_get_n_files (NautilusFileUndoInfoTrash *self)
+{
+    return file_list_get_length (&self->trashed);
 }
 
 /* recursive permissions */
@@ -1911,7 +2200,8 @@ struct _NautilusFileUndoInfoRecPermissions
     NautilusFileUndoInfo parent_instance;
 
     GFile *dest_dir;
-    GHashTable *original_permissions;
+    FileList files;           /* Relative to dest_dir */
+    GArray *original_permissions;
     guint32 dir_mask;
     guint32 dir_permissions;
     guint32 file_mask;
@@ -1973,27 +2263,21 @@ rec_permissions_undo_func (NautilusFileUndoInfo           *info,
 {
     NautilusFileUndoInfoRecPermissions *self = NAUTILUS_FILE_UNDO_INFO_REC_PERMISSIONS (info);
 
-    if (g_hash_table_size (self->original_permissions) > 0)
+    if (file_list_get_length (&self->files) > 0)
     {
-        GList *gfiles_list;
         guint32 perm;
-        GList *l;
         GFile *dest;
-        char *item;
 
-        gfiles_list = g_hash_table_get_keys (self->original_permissions);
-        for (l = gfiles_list; l != NULL; l = l->next)
+        for (guint i = 0; i < file_list_get_length (&self->files); i++)
         {
-            item = l->data;
-            perm = GPOINTER_TO_UINT (g_hash_table_lookup (self->original_permissions, item));
-            dest = g_file_new_for_uri (item);
+            perm = g_array_index (self->original_permissions, guint32, i);
+            dest = file_list_get (&self->files, i);
             g_file_set_attribute_uint32 (dest,
                                          G_FILE_ATTRIBUTE_UNIX_MODE,
                                          perm, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
             g_object_unref (dest);
         }
 
-        g_list_free (gfiles_list);
         /* Here we must do what's necessary for the callback */
         file_undo_info_transfer_callback (NULL, TRUE, self);
     }
@@ -2002,8 +2286,7 @@ rec_permissions_undo_func (NautilusFileUndoInfo           *info,
 static void
 nautilus_file_undo_info_rec_permissions_init (NautilusFileUndoInfoRecPermissions *self)
 {
-    self->original_permissions = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                        g_free, NULL);
+    self->original_permissions = g_array_new (FALSE, FALSE, sizeof (guint32));
 }
 
 static void
@@ -2011,7 +2294,8 @@ nautilus_file_undo_info_rec_permissions_finalize (GObject *obj)
 {
     NautilusFileUndoInfoRecPermissions *self = NAUTILUS_FILE_UNDO_INFO_REC_PERMISSIONS (obj);
 
-    g_hash_table_destroy (self->original_permissions);
+    file_list_clear (&self->files);
+    g_array_unref (self->original_permissions);
     g_clear_object (&self->dest_dir);
 
     G_OBJECT_CLASS (nautilus_file_undo_info_rec_permissions_parent_class)->finalize (obj);
@@ -2045,6 +2329,7 @@ nautilus_file_undo_info_rec_permissions_new (GFile   *dest,
                          NULL);
 
     self->dest_dir = g_object_ref (dest);
+    file_list_init (&self->files, dest);
     self->file_permissions = file_permissions;
     self->file_mask = file_mask;
     self->dir_permissions = dir_permissions;
@@ -2058,8 +2343,8 @@ nautilus_file_undo_info_rec_permissions_add_file (NautilusFileUndoInfoRecPermiss
                                                   GFile                              *file,
                                                   guint32                             permission)
 {
-    gchar *original_uri = g_file_get_uri (file);
-    g_hash_table_insert (self->original_permissions, original_uri, GUINT_TO_POINTER (permission));
+    file_list_add (&self->files, file);
+    g_array_append_val (self->original_permissions, permission);
 }
 
 /* single file change permissions */
@@ -168,7 +168,13 @@ G_DECLARE_FINAL_TYPE (NautilusFileUndoInfoTrash, nautilus_file_undo_info_trash,
 NautilusFileUndoInfo *nautilus_file_undo_info_trash_new (gint item_count);
 void nautilus_file_undo_info_trash_add_file (NautilusFileUndoInfoTrash *self,
                                              GFile                     *file);
+/* @trashed is where @file ended up, as a child of trash:///. */
+void nautilus_file_undo_info_trash_add_trashed_file (NautilusFileUndoInfoTrash *self,
+                                                     GFile                     *file,
+                                                     GFile                     *trashed);
+/* Returns new references to the files, to be freed with g_list_free_full(). */
 GList *nautilus_file_undo_info_trash_get_files (NautilusFileUndoInfoTrash *self);
+guint nautilus_file_undo_info_trash_get_n_files (NautilusFileUndoInfoTrash *self);
 
 /* recursive permissions */
 #define NAUTILUS_TYPE_FILE_UNDO_INFO_REC_PERMISSIONS nautilus_file_undo_info_rec_permissions_get_type ()
@@ -41,6 +41,8 @@
 #include <gio/gio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <locale.h>
+#include <string.h>
 
 #define NAUTILUS_USER_DIRECTORY_NAME "nautilus"
 #define DEFAULT_NAUTILUS_DIRECTORY_MODE (0755)
@@ -563,6 +565,31 @@ nautilus_get_mounted_mount_for_root (GFile *location)
 GFile *
 nautilus_generate_unique_file_in_directory (GFile      *directory,
                                             const char *basename)
+{
+    return nautilus_generate_unique_file_in_directory_excluding (directory,
+                                                                 basename,
+                                                                 NULL);
+}
+
+static gboolean
+file_list_contains (GList *files,
+                    GFile *file)
+{
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        if (g_file_equal (l->data, file))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+GFile *
+nautilus_generate_unique_file_in_directory_excluding (GFile      *directory,
+                                                      const char *basename,
+                                                      GList      *excluded)
 {
     g_autofree char *basename_without_extension = NULL;
     const char *extension;
@@ -579,7 +606,8 @@ nautilus_generate_unique_file_in_directory (GFile      *directory,
     child = g_file_get_child (directory, basename);
 
     copy = 1;
-    while (g_file_query_exists (child, NULL))
+    while (file_list_contains (excluded, child) ||
+           g_file_query_exists (child, NULL))
     {
         g_autofree char *filename = NULL;
 
@@ -700,6 +728,7 @@ nautilus_trashed_files_get_original_directories (GList  *files,
     GHashTable *directories;
     NautilusFile *file, *original_file, *original_dir;
     GList *l, *m;
+    g_autoptr (GList) keys = NULL;
 
     directories = NULL;
 
@@ -734,18 +763,36 @@ nautilus_trashed_files_get_original_directories (GList  *files,
                 g_hash_table_steal (directories, original_dir);
                 nautilus_file_unref (original_dir);
             }
-            m = g_list_append (m, nautilus_file_ref (file));
+            m = g_list_prepend (m, nautilus_file_ref (file));
             g_hash_table_insert (directories, original_dir, m);
         }
         else if (unhandled_files != NULL)
         {
-            *unhandled_files = g_list_append (*unhandled_files, nautilus_file_ref (file));
+            *unhandled_files = g_list_prepend (*unhandled_files, nautilus_file_ref (file));
         }
 
         nautilus_file_unref (original_file);
         nautilus_file_unref (original_dir);
     }
 
+    /* The lists were built backwards, appending to them gets slow when
+     * restoring thousands of files. */
+    if (unhandled_files != NULL)
+    {
+        *unhandled_files = g_list_reverse (*unhandled_files);
+    }
+
+    if (directories != NULL)
+    {
+        keys = g_hash_table_get_keys (directories);
+    }
+    for (l = keys; l != NULL; l = l->next)
+    {
+        m = g_hash_table_lookup (directories, l->data);
+        g_hash_table_steal (directories, l->data);
+        g_hash_table_insert (directories, l->data, g_list_reverse (m));
+    }
+
     return directories;
 }
 
@@ -795,28 +842,37 @@ ensure_dirs_task_ready_cb (GObject      *_source,
                            gpointer      user_data)
 {
     NautilusFile *original_dir;
-    GFile *original_dir_location;
-    GList *original_dirs, *files, *locations, *l;
+    GList *original_dirs, *files, *operations, *l;
+    NautilusBatchOperation *operation;
     RestoreFilesData *data = user_data;
 
+    /* A move per original folder, all in a single batch, so that the
+     * restore is a single operation with a single progress. */
+    operations = NULL;
     original_dirs = g_hash_table_get_keys (data->original_dirs_hash);
     for (l = original_dirs; l != NULL; l = l->next)
     {
         original_dir = NAUTILUS_FILE (l->data);
-        original_dir_location = nautilus_file_get_location (original_dir);
-
         files = g_hash_table_lookup (data->original_dirs_hash, original_dir);
-        locations = locations_from_file_list (files);
-
-        nautilus_file_operations_move_async (locations,
-                                             original_dir_location,
-                                             data->parent_window,
-                                             NULL, NULL, NULL);
 
-        g_list_free_full (locations, g_object_unref);
-        g_object_unref (original_dir_location);
+        operation = g_new0 (NautilusBatchOperation, 1);
+        operation->kind = NAUTILUS_BATCH_OPERATION_MOVE;
+        operation->sources = locations_from_file_list (files);
+        operation->destination = nautilus_file_get_location (original_dir);
+        operations = g_list_prepend (operations, operation);
     }
 
+    nautilus_file_operations_batch (operations, data->parent_window, NULL,
+                                    0, NULL, NULL, NULL);
+
+    for (l = operations; l != NULL; l = l->next)
+    {
+        operation = l->data;
+        g_list_free_full (operation->sources, g_object_unref);
+        g_object_unref (operation->destination);
+        g_free (operation);
+    }
+    g_list_free (operations);
     g_list_free (original_dirs);
 
     g_hash_table_unref (data->original_dirs_hash);
@@ -898,44 +954,141 @@ nautilus_restore_files_from_trash (GList     *files,
     nautilus_file_list_unref (unhandled_files);
 }
 
+#define CONTENT_TYPES_CACHE_MAX_SIZE 64
+
+/* The content types guessed for the mounts seen, by the volume UUID, or
+ * the root, and the modification time of the root, so that the same media
+ * mounted again is not scanned again */
+static GHashTable *content_types_cache = NULL;
+
+/* GMount -> ContentTypesScan, shared by all the callers for the mount */
+static GHashTable *content_types_scans = NULL;
+
 typedef struct
 {
     NautilusMountGetContent callback;
     gpointer user_data;
 } GetContentTypesData;
 
+typedef struct
+{
+    GMount *mount;
+    char *cache_key;
+    GList *waiting;
+} ContentTypesScan;
+
+static void
+content_types_scan_finish (ContentTypesScan  *scan,
+                           char             **types)
+{
+    GList *waiting;
+
+    g_object_set_data_full (G_OBJECT (scan->mount),
+                            "nautilus-content-type-cache",
+                            g_strdupv (types),
+                            (GDestroyNotify) g_strfreev);
+
+    /* Callers asking from the callbacks get the types just set */
+    g_hash_table_remove (content_types_scans, scan->mount);
+
+    waiting = g_list_reverse (scan->waiting);
+    for (GList *l = waiting; l != NULL; l = l->next)
+    {
+        GetContentTypesData *data = l->data;
+
+        if (data->callback)
+        {
+            data->callback ((const char **) types, data->user_data);
+        }
+        g_slice_free (GetContentTypesData, data);
+    }
+    g_list_free (waiting);
+
+    g_object_unref (scan->mount);
+    g_free (scan->cache_key);
+    g_free (scan);
+}
+
 static void
 get_types_cb (GObject      *source_object,
               GAsyncResult *res,
               gpointer      user_data)
 {
-    GetContentTypesData *data;
+    ContentTypesScan *scan;
     char **types;
 
-    data = user_data;
+    scan = user_data;
     types = g_mount_guess_content_type_finish (G_MOUNT (source_object), res, NULL);
 
-    g_object_set_data_full (source_object,
-                            "nautilus-content-type-cache",
-                            g_strdupv (types),
-                            (GDestroyNotify) g_strfreev);
-
-    if (data->callback)
+    if (types != NULL)
     {
-        data->callback ((const char **) types, data->user_data);
+        if (content_types_cache == NULL ||
+            g_hash_table_size (content_types_cache) >= CONTENT_TYPES_CACHE_MAX_SIZE)
+        {
+            g_clear_pointer (&content_types_cache, g_hash_table_destroy);
+            content_types_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                         g_free, (GDestroyNotify) g_strfreev);
+        }
+        g_hash_table_insert (content_types_cache,
+                             g_strdup (scan->cache_key),
+                             g_strdupv (types));
     }
+
+    content_types_scan_finish (scan, types);
     g_strfreev (types);
-    g_slice_free (GetContentTypesData, data);
+}
+
+static void
+query_mount_root_cb (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+    ContentTypesScan *scan;
+    g_autoptr (GFileInfo) info = NULL;
+    g_autofree char *uuid = NULL;
+    g_autofree char *uri = NULL;
+    guint64 mtime = 0;
+    char **cached = NULL;
+
+    scan = user_data;
+    info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+    if (info != NULL)
+    {
+        mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    }
+
+    /* New files at the top of the media change the mtime of the root */
+    uuid = g_mount_get_uuid (scan->mount);
+    uri = g_file_get_uri (G_FILE (source_object));
+    scan->cache_key = g_strdup_printf ("%s %" G_GUINT64_FORMAT,
+                                       uuid != NULL ? uuid : uri, mtime);
+
+    if (content_types_cache != NULL)
+    {
+        cached = g_hash_table_lookup (content_types_cache, scan->cache_key);
+    }
+    if (cached != NULL)
+    {
+        content_types_scan_finish (scan, cached);
+        return;
+    }
+
+    g_mount_guess_content_type (scan->mount,
+                                FALSE,
+                                NULL,
+                                get_types_cb,
+                                scan);
 }
 
 void
 nautilus_get_x_content_types_for_mount_async (GMount                  *mount,
                                               NautilusMountGetContent  callback,
-                                              GCancellable            *cancellable,
                                               gpointer                 user_data)
 {
     char **cached;
     GetContentTypesData *data;
+    ContentTypesScan *scan;
+    g_autoptr (GFile) root = NULL;
 
     if (mount == NULL)
     {
@@ -960,11 +1113,32 @@ nautilus_get_x_content_types_for_mount_async (GMount                  *mount,
     data->callback = callback;
     data->user_data = user_data;
 
-    g_mount_guess_content_type (mount,
-                                FALSE,
-                                cancellable,
-                                get_types_cb,
-                                data);
+    if (content_types_scans == NULL)
+    {
+        content_types_scans = g_hash_table_new (NULL, NULL);
+    }
+
+    /* E.g. the tabs of a mount restored together */
+    scan = g_hash_table_lookup (content_types_scans, mount);
+    if (scan != NULL)
+    {
+        scan->waiting = g_list_prepend (scan->waiting, data);
+        return;
+    }
+
+    scan = g_new0 (ContentTypesScan, 1);
+    scan->mount = g_object_ref (mount);
+    scan->waiting = g_list_prepend (NULL, data);
+    g_hash_table_insert (content_types_scans, mount, scan);
+
+    root = g_mount_get_root (mount);
+    g_file_query_info_async (root,
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                             G_FILE_QUERY_INFO_NONE,
+                             G_PRIORITY_DEFAULT,
+                             NULL,
+                             query_mount_root_cb,
+                             scan);
 }
 
 char **
@@ -1437,6 +1611,41 @@ nautilus_uri_to_native_uri (const gchar *uri)
     return NULL;
 }
 
+GStrv
+nautilus_get_prune_patterns (void)
+{
+    g_auto (GStrv) patterns = NULL;
+
+    patterns = g_settings_get_strv (nautilus_preferences,
+                                    NAUTILUS_PREFERENCES_SEARCH_PRUNE_PATTERNS);
+    if (patterns[0] == NULL)
+    {
+        return NULL;
+    }
+
+    return g_steal_pointer (&patterns);
+}
+
+gboolean
+nautilus_prune_patterns_match (const char * const *patterns,
+                               const char         *name)
+{
+    if (patterns == NULL)
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0; patterns[i] != NULL; i++)
+    {
+        if (g_pattern_match_simple (patterns[i], name))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 NautilusQueryRecursive
 location_settings_search_get_recursive (void)
 {
@@ -1485,3 +1694,204 @@ location_settings_search_get_recursive_for_location (GFile *location)
 
     return recursive;
 }
+
+/* What g_utf8_collate_key_for_filename() puts between the parts of a key */
+#define COLLATION_SENTINEL "\1\1\1"
+
+/* Appends the collation key of an ASCII segment of a name, the same as
+ * g_utf8_collate_key() would. NFKC normalization leaves ASCII as is, so
+ * it goes to strxfrm() right away, or as is in the C locale. */
+static void
+append_ascii_segment_key (GString    *key,
+                          const char *start,
+                          gsize       length,
+                          gboolean    c_locale)
+{
+    char buffer[256];
+    g_autofree char *allocated = NULL;
+    const char *segment;
+    gsize old_length;
+    gsize xfrm_length;
+
+    if (c_locale)
+    {
+        g_string_append_len (key, start, length);
+        return;
+    }
+
+    if (length < sizeof (buffer))
+    {
+        memcpy (buffer, start, length);
+        buffer[length] = '\0';
+        segment = buffer;
+    }
+    else
+    {
+        allocated = g_strndup (start, length);
+        segment = allocated;
+    }
+
+    xfrm_length = strxfrm (NULL, segment, 0);
+    if (xfrm_length >= G_MAXINT - 2)
+    {
+        return;
+    }
+
+    old_length = key->len;
+    g_string_set_size (key, old_length + xfrm_length);
+    strxfrm (key->str + old_length, segment, xfrm_length + 1);
+}
+
+static gboolean
+is_ascii (const char *name)
+{
+    for (const char *p = name; *p != '\0'; p++)
+    {
+        if ((guchar) *p >= 0x80)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Follows g_utf8_collate_key_for_filename() step by step, so the keys can
+ * be compared with the ones it makes for non-ASCII names. */
+char *
+nautilus_collate_key_for_filename (const char *name)
+{
+    const char *collate;
+    gboolean c_locale;
+    GString *key;
+    GString *append;
+    const char *prev, *p, *end;
+    int digits;
+    int leading_zeros;
+
+    g_return_val_if_fail (name != NULL, NULL);
+
+    if (!g_get_charset (NULL) || !is_ascii (name))
+    {
+        return g_utf8_collate_key_for_filename (name, -1);
+    }
+
+    collate = setlocale (LC_COLLATE, NULL);
+    c_locale = collate != NULL && (strcmp (collate, "C") == 0 || strcmp (collate, "POSIX") == 0);
+
+    end = name + strlen (name);
+    key = g_string_sized_new ((end - name) * 2);
+    append = g_string_sized_new (0);
+
+    for (prev = p = name; p < end; p++)
+    {
+        switch (*p)
+        {
+            case '.':
+            {
+                if (prev != p)
+                {
+                    append_ascii_segment_key (key, prev, p - prev, c_locale);
+                }
+
+                g_string_append (key, COLLATION_SENTINEL "\1");
+
+                /* Skip the dot */
+                prev = p + 1;
+            }
+            break;
+
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+            {
+                if (prev != p)
+                {
+                    append_ascii_segment_key (key, prev, p - prev, c_locale);
+                }
+
+                g_string_append (key, COLLATION_SENTINEL "\2");
+
+                prev = p;
+
+                /* One colon for each digit after the first */
+                if (*p == '0')
+                {
+                    leading_zeros = 1;
+                    digits = 0;
+                }
+                else
+                {
+                    leading_zeros = 0;
+                    digits = 1;
+                }
+
+                while (++p < end)
+                {
+                    if (*p == '0' && digits == 0)
+                    {
+                        leading_zeros++;
+                    }
+                    else if (g_ascii_isdigit (*p))
+                    {
+                        digits++;
+                    }
+                    else
+                    {
+                        /* An all-zero number is one digit plus leading zeros */
+                        if (digits == 0)
+                        {
+                            digits++;
+                            leading_zeros--;
+                        }
+                        break;
+                    }
+                }
+
+                while (digits > 1)
+                {
+                    g_string_append_c (key, ':');
+                    digits--;
+                }
+
+                if (leading_zeros > 0)
+                {
+                    g_string_append_c (append, (char) leading_zeros);
+                    prev += leading_zeros;
+                }
+
+                /* The number itself */
+                g_string_append_len (key, prev, p - prev);
+
+                prev = p;
+
+                /* Back one step, for the outer loop */
+                p--;
+            }
+            break;
+
+            default:
+            {
+            }
+            break;
+        }
+    }
+
+    if (prev != p)
+    {
+        append_ascii_segment_key (key, prev, p - prev, c_locale);
+    }
+
+    /* The leading zeros break ties between the same numbers */
+    g_string_append (key, append->str);
+    g_string_free (append, TRUE);
+
+    return g_string_free (key, FALSE);
+}
@@ -69,6 +69,11 @@ gboolean nautilus_uri_parse                          (const char  *uri,
  */
 GFile * nautilus_generate_unique_file_in_directory (GFile      *directory,
                                                     const char *basename);
+/* Same, but also avoids the locations in @excluded, which are about to be
+ * created by someone else. */
+GFile * nautilus_generate_unique_file_in_directory_excluding (GFile      *directory,
+                                                              const char *basename,
+                                                              GList      *excluded);
 
 GFile *  nautilus_find_existing_uri_in_hierarchy     (GFile *location);
 
@@ -82,9 +87,11 @@ void nautilus_restore_files_from_trash (GList *files,
 typedef void (*NautilusMountGetContent) (const char **content, gpointer user_data);
 
 char ** nautilus_get_cached_x_content_types_for_mount (GMount *mount);
+/* The scan is shared by the callers for the same mount, and cached for the
+ * same media mounted again: @callback is always called, and the callers
+ * check themselves whether they still want the types. */
 void nautilus_get_x_content_types_for_mount_async (GMount *mount,
 						   NautilusMountGetContent callback,
-						   GCancellable *cancellable,
 						   gpointer user_data);
 char * get_message_for_content_type (const char *content_type);
 char * get_message_for_two_content_types (const char * const *content_types);
@@ -139,5 +146,15 @@ GList * nautilus_file_list_from_uri_list (GList *uris);
 
 gchar * nautilus_uri_to_native_uri (const gchar *uri);
 
+/* The same key as g_utf8_collate_key_for_filename(), made faster for
+ * ASCII names. */
+char * nautilus_collate_key_for_filename (const char *name);
+
+/* The patterns of the folders recursive crawls don't descend into, from
+ * the settings, or NULL if there are none. */
+GStrv    nautilus_get_prune_patterns   (void);
+gboolean nautilus_prune_patterns_match (const char * const *patterns,
+                                        const char         *name);
+
 NautilusQueryRecursive location_settings_search_get_recursive (void);
 NautilusQueryRecursive location_settings_search_get_recursive_for_location (GFile *location);
@@ -60,13 +60,16 @@
 #include "nautilus-file-undo-manager.h"
 #include "nautilus-file-undo-operations.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-filesystem-info-cache.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-icon-info.h"
 #include "nautilus-lib-self-check-functions.h"
 #include "nautilus-metadata.h"
 #include "nautilus-module.h"
+#include "nautilus-parallel-sort.h"
 #include "nautilus-signaller.h"
 #include "nautilus-tag-manager.h"
+#include "nautilus-thumbnail-cache.h"
 #include "nautilus-thumbnails.h"
 #include "nautilus-ui-utilities.h"
 #include "nautilus-vfs-file.h"
@@ -127,6 +130,10 @@ enum
 static guint signals[LAST_SIGNAL];
 
 static GHashTable *symbolic_links;
+/* The files looked up by their URIs, not reffed, to find them again without
+ * going through their folders. They drop out when their location changes,
+ * when they are gone and when they are finalized. */
+static GHashTable *files_by_uri;
 
 static guint64 cached_thumbnail_limit;
 static NautilusSpeedTradeoffValue show_file_thumbs;
@@ -175,10 +182,10 @@ static char *nautilus_file_get_owner_as_string (NautilusFile *file,
 static char *nautilus_file_get_type_as_string (NautilusFile *file);
 static char *nautilus_file_get_type_as_string_no_extra_text (NautilusFile *file);
 static char *nautilus_file_get_detailed_type_as_string (NautilusFile *file);
+static char *get_description (NautilusFile *file,
+                              gboolean      detailed);
 static gboolean update_info_and_name (NautilusFile *file,
                                       GFileInfo    *info);
-static const char *nautilus_file_peek_display_name (NautilusFile *file);
-static const char *nautilus_file_peek_display_name_collation_key (NautilusFile *file);
 static void file_mount_unmounted (GMount  *mount,
                                   gpointer data);
 static void metadata_hash_free (GHashTable *hash);
@@ -187,6 +194,282 @@ G_DEFINE_TYPE_WITH_CODE (NautilusFile, nautilus_file, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_FILE_INFO,
                                                 nautilus_file_info_iface_init));
 
+static void
+thumbnail_info_free (NautilusFileThumbnailInfo *thumbnail_info)
+{
+    g_free (thumbnail_info->path);
+    g_clear_object (&thumbnail_info->pixbuf);
+    nautilus_file_thumbnail_info_clear_scaled (thumbnail_info);
+    g_free (thumbnail_info);
+}
+
+static void
+trash_info_free (NautilusFileTrashInfo *trash_info)
+{
+    g_free (trash_info->orig_path);
+    g_free (trash_info);
+}
+
+static void
+search_info_free (NautilusFileSearchInfo *search_info)
+{
+    g_free (search_info->fts_snippet);
+    g_free (search_info);
+}
+
+static void
+sort_keys_free (NautilusFileSortKeys *sort_keys)
+{
+    if (!sort_keys->type_collation_key_shared)
+    {
+        g_free (sort_keys->type_collation_key);
+    }
+    g_free (sort_keys);
+}
+
+static void
+invalidate_sort_keys (NautilusFile *file)
+{
+    g_clear_pointer (&file->details->sort_keys, sort_keys_free);
+}
+
+static void
+icon_memo_free (NautilusFileIconMemo *icon_memo)
+{
+    g_object_unref (icon_memo->icon);
+    g_free (icon_memo);
+}
+
+static void
+invalidate_icon_memo (NautilusFile *file)
+{
+    g_clear_pointer (&file->details->icon_memo, icon_memo_free);
+}
+
+static void
+extension_data_free (NautilusFileExtensionData *extension_data)
+{
+    g_list_free_full (extension_data->pending_emblems, g_free);
+    g_list_free_full (extension_data->emblems, g_free);
+    g_clear_pointer (&extension_data->pending_attributes, g_hash_table_destroy);
+    g_clear_pointer (&extension_data->attributes, g_hash_table_destroy);
+    g_free (extension_data);
+}
+
+NautilusFileDeepCounts *
+nautilus_file_ensure_deep_counts (NautilusFile *file)
+{
+    if (file->details->deep_counts == NULL)
+    {
+        file->details->deep_counts = g_new0 (NautilusFileDeepCounts, 1);
+    }
+
+    return file->details->deep_counts;
+}
+
+NautilusFileThumbnailInfo *
+nautilus_file_ensure_thumbnail_info (NautilusFile *file)
+{
+    if (file->details->thumbnail_info == NULL)
+    {
+        file->details->thumbnail_info = g_new0 (NautilusFileThumbnailInfo, 1);
+    }
+
+    return file->details->thumbnail_info;
+}
+
+static gsize
+string_bytes (const char *string)
+{
+    return string != NULL ? strlen (string) + 1 : 0;
+}
+
+gsize
+nautilus_file_get_memory_usage (NautilusFile *file)
+{
+    NautilusFileDetails *details;
+    gsize bytes;
+
+    details = file->details;
+
+    bytes = sizeof (NautilusFile) + sizeof (NautilusFileDetails);
+
+    /* The names are often the same string */
+    bytes += string_bytes (details->name);
+    if (details->display_name != details->name)
+    {
+        bytes += string_bytes (details->display_name);
+    }
+    if (details->edit_name != details->name &&
+        details->edit_name != details->display_name)
+    {
+        bytes += string_bytes (details->edit_name);
+    }
+    bytes += string_bytes (details->display_name_collation_key);
+    bytes += string_bytes (details->uri);
+
+    bytes += string_bytes (details->symlink_name);
+    bytes += string_bytes (details->selinux_context);
+    bytes += string_bytes (details->description);
+    bytes += string_bytes (details->activation_uri);
+
+    for (GList *l = details->mime_list; l != NULL; l = l->next)
+    {
+        bytes += sizeof (GList) + string_bytes (l->data);
+    }
+
+    if (details->thumbnail_info != NULL)
+    {
+        bytes += sizeof (NautilusFileThumbnailInfo);
+        bytes += string_bytes (details->thumbnail_info->path);
+        bytes += details->thumbnail_info->cache_bytes;
+    }
+    if (details->trash_info != NULL)
+    {
+        bytes += sizeof (NautilusFileTrashInfo);
+        bytes += string_bytes (details->trash_info->orig_path);
+    }
+    if (details->search_info != NULL)
+    {
+        bytes += sizeof (NautilusFileSearchInfo);
+        bytes += string_bytes (details->search_info->fts_snippet);
+    }
+    if (details->sort_keys != NULL)
+    {
+        bytes += sizeof (NautilusFileSortKeys);
+        if (!details->sort_keys->type_collation_key_shared)
+        {
+            bytes += string_bytes (details->sort_keys->type_collation_key);
+        }
+    }
+    if (details->deep_counts != NULL)
+    {
+        bytes += sizeof (NautilusFileDeepCounts);
+    }
+    if (details->icon_memo != NULL)
+    {
+        bytes += sizeof (NautilusFileIconMemo);
+    }
+    if (details->extension_data != NULL)
+    {
+        bytes += sizeof (NautilusFileExtensionData);
+    }
+    if (details->metadata != NULL)
+    {
+        /* The entries only, the values are short */
+        bytes += g_hash_table_size (details->metadata) * 3 * sizeof (gpointer);
+    }
+
+    return bytes;
+}
+
+static NautilusFileSearchInfo *
+ensure_search_info (NautilusFile *file)
+{
+    if (file->details->search_info == NULL)
+    {
+        file->details->search_info = g_new0 (NautilusFileSearchInfo, 1);
+    }
+
+    return file->details->search_info;
+}
+
+static NautilusFileExtensionData *
+ensure_extension_data (NautilusFile *file)
+{
+    if (file->details->extension_data == NULL)
+    {
+        file->details->extension_data = g_new0 (NautilusFileExtensionData, 1);
+    }
+
+    return file->details->extension_data;
+}
+
+static const char *
+get_thumbnail_path (NautilusFile *file)
+{
+    return file->details->thumbnail_info != NULL ? file->details->thumbnail_info->path : NULL;
+}
+
+static GdkPixbuf *
+get_thumbnail_pixbuf (NautilusFile *file)
+{
+    return file->details->thumbnail_info != NULL ? file->details->thumbnail_info->pixbuf : NULL;
+}
+
+void
+nautilus_file_thumbnail_info_clear_scaled (NautilusFileThumbnailInfo *thumbnail_info)
+{
+    for (int i = 0; i < NAUTILUS_FILE_MAX_SCALED_THUMBNAILS; i++)
+    {
+        g_clear_object (&thumbnail_info->scaled[i].pixbuf);
+    }
+}
+
+/* Returns the thumbnail scaled by @thumb_scale for @scale, if there is one,
+ * making it the most recently used. */
+static GdkPixbuf *
+lookup_scaled_thumbnail (NautilusFileThumbnailInfo *thumbnail_info,
+                         double                     thumb_scale,
+                         int                        scale)
+{
+    for (int i = 0; i < NAUTILUS_FILE_MAX_SCALED_THUMBNAILS; i++)
+    {
+        NautilusFileScaledThumbnail found = thumbnail_info->scaled[i];
+
+        if (found.pixbuf == NULL)
+        {
+            break;
+        }
+
+        if (found.thumb_scale == thumb_scale && found.scale == scale)
+        {
+            memmove (&thumbnail_info->scaled[1], &thumbnail_info->scaled[0],
+                     i * sizeof (NautilusFileScaledThumbnail));
+            thumbnail_info->scaled[0] = found;
+
+            return found.pixbuf;
+        }
+    }
+
+    return NULL;
+}
+
+/* Takes @pixbuf, in place of the least recently used one if need be */
+static void
+add_scaled_thumbnail (NautilusFileThumbnailInfo *thumbnail_info,
+                      double                     thumb_scale,
+                      int                        scale,
+                      GdkPixbuf                 *pixbuf)
+{
+    g_clear_object (&thumbnail_info->scaled[NAUTILUS_FILE_MAX_SCALED_THUMBNAILS - 1].pixbuf);
+    memmove (&thumbnail_info->scaled[1], &thumbnail_info->scaled[0],
+             (NAUTILUS_FILE_MAX_SCALED_THUMBNAILS - 1) * sizeof (NautilusFileScaledThumbnail));
+
+    thumbnail_info->scaled[0].pixbuf = pixbuf;
+    thumbnail_info->scaled[0].thumb_scale = thumb_scale;
+    thumbnail_info->scaled[0].scale = scale;
+}
+
+void
+nautilus_file_drop_loaded_thumbnail (NautilusFile *file)
+{
+    NautilusFileThumbnailInfo *thumbnail_info = file->details->thumbnail_info;
+
+    if (thumbnail_info == NULL)
+    {
+        return;
+    }
+
+    nautilus_thumbnail_cache_forget (file);
+    g_clear_object (&thumbnail_info->pixbuf);
+    nautilus_file_thumbnail_info_clear_scaled (thumbnail_info);
+    invalidate_icon_memo (file);
+
+    /* So that it is loaded again when asked for */
+    file->details->thumbnail_is_up_to_date = FALSE;
+}
+
 static void
 nautilus_file_init (NautilusFile *file)
 {
@@ -274,8 +557,7 @@ nautilus_file_set_display_name (NautilusFile *file,
             file->details->display_name = g_ref_string_new (display_name);
         }
 
-        g_free (file->details->display_name_collation_key);
-        file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+        g_clear_pointer (&file->details->display_name_collation_key, g_free);
     }
 
     if (g_strcmp0 (file->details->edit_name, edit_name) != 0)
@@ -499,6 +781,7 @@ void
 nautilus_file_clear_info (NautilusFile *file)
 {
     file->details->got_file_info = FALSE;
+    invalidate_sort_keys (file);
     if (file->details->get_info_error)
     {
         g_error_free (file->details->get_info_error);
@@ -526,8 +809,10 @@ nautilus_file_clear_info (NautilusFile *file)
         file->details->icon = NULL;
     }
 
-    g_free (file->details->thumbnail_path);
-    file->details->thumbnail_path = NULL;
+    if (file->details->thumbnail_info != NULL)
+    {
+        g_clear_pointer (&file->details->thumbnail_info->path, g_free);
+    }
     file->details->thumbnailing_failed = FALSE;
 
     file->details->is_symlink = FALSE;
@@ -557,8 +842,11 @@ nautilus_file_clear_info (NautilusFile *file)
     file->details->mtime = 0;
     file->details->atime = 0;
     file->details->btime = 0;
-    file->details->trash_time = 0;
-    file->details->recency = 0;
+    if (file->details->trash_info != NULL)
+    {
+        file->details->trash_info->trash_time = 0;
+        file->details->trash_info->recency = 0;
+    }
     g_free (file->details->symlink_name);
     file->details->symlink_name = NULL;
     g_clear_pointer (&file->details->mime_type, g_ref_string_release);
@@ -587,16 +875,10 @@ void
 nautilus_file_set_directory (NautilusFile      *file,
                              NautilusDirectory *directory)
 {
-    char *parent_uri;
-
     g_clear_object (&file->details->directory);
-    g_free (file->details->directory_name_collation_key);
 
     file->details->directory = nautilus_directory_ref (directory);
-
-    parent_uri = nautilus_file_get_parent_uri (file);
-    file->details->directory_name_collation_key = g_utf8_collate_key_for_filename (parent_uri, -1);
-    g_free (parent_uri);
+    nautilus_file_invalidate_location (file);
 }
 
 static NautilusFile *
@@ -821,24 +1103,155 @@ nautilus_file_get_existing (GFile *location)
     return NAUTILUS_FILE (nautilus_file_get_internal (location, FALSE));
 }
 
+static NautilusFile *
+lookup_uri_table (const char *uri)
+{
+    if (files_by_uri == NULL)
+    {
+        return NULL;
+    }
+
+    return g_hash_table_lookup (files_by_uri, uri);
+}
+
+static void
+add_to_uri_table (NautilusFile *file)
+{
+    const char *uri;
+
+    if (file == NULL || file->details->is_in_uri_table || file->details->is_gone)
+    {
+        return;
+    }
+
+    if (files_by_uri == NULL)
+    {
+        files_by_uri = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+    /* The key is the URI of the file itself, kept as long as it is there */
+    uri = nautilus_file_peek_uri (file);
+    if (!g_hash_table_contains (files_by_uri, uri))
+    {
+        g_hash_table_insert (files_by_uri, (gpointer) uri, file);
+        file->details->is_in_uri_table = TRUE;
+    }
+}
+
+static void
+remove_from_uri_table (NautilusFile *file)
+{
+    if (!file->details->is_in_uri_table)
+    {
+        return;
+    }
+
+    g_hash_table_remove (files_by_uri, file->details->uri);
+    file->details->is_in_uri_table = FALSE;
+}
+
 NautilusFile *
 nautilus_file_get_existing_by_uri (const char *uri)
 {
     g_autoptr (GFile) location = NULL;
+    NautilusFile *file;
+
+    file = lookup_uri_table (uri);
+    if (file != NULL)
+    {
+        return nautilus_file_ref (file);
+    }
 
     location = g_file_new_for_uri (uri);
+    file = nautilus_file_get_existing (location);
+    add_to_uri_table (file);
 
-    return nautilus_file_get_existing (location);
+    return file;
 }
 
 NautilusFile *
 nautilus_file_get_by_uri (const char *uri)
 {
     g_autoptr (GFile) location = NULL;
+    NautilusFile *file;
+
+    file = lookup_uri_table (uri);
+    if (file != NULL)
+    {
+        return nautilus_file_ref (file);
+    }
 
     location = g_file_new_for_uri (uri);
+    file = nautilus_file_get (location);
+    add_to_uri_table (file);
+
+    return file;
+}
+
+/* Like nautilus_file_get_by_uri() for each of @uris, but the parent
+ * directory is only looked up once for the URIs in a row that share it,
+ * and not at all for the files already found by their URIs before.
+ */
+GList *
+nautilus_file_list_get_by_uris (GList *uris)
+{
+    g_autoptr (GFile) last_parent = NULL;
+    NautilusDirectory *directory;
+    NautilusFile *file;
+    GList *files;
+
+    directory = NULL;
+    files = NULL;
+    for (GList *l = uris; l != NULL; l = l->next)
+    {
+        g_autoptr (GFile) location = NULL;
+        g_autoptr (GFile) parent = NULL;
+        g_autofree char *basename = NULL;
+
+        file = lookup_uri_table (l->data);
+        if (file != NULL)
+        {
+            files = g_list_prepend (files, nautilus_file_ref (file));
+            continue;
+        }
+
+        location = g_file_new_for_uri (l->data);
+        parent = g_file_get_parent (location);
+
+        /* The files of roots belong to their own directory. */
+        if (parent == NULL)
+        {
+            file = nautilus_file_get (location);
+            add_to_uri_table (file);
+            files = g_list_prepend (files, file);
+            continue;
+        }
+
+        if (last_parent == NULL || !g_file_equal (parent, last_parent))
+        {
+            g_clear_pointer (&directory, nautilus_directory_unref);
+            g_set_object (&last_parent, parent);
+            directory = nautilus_directory_get_internal (parent, TRUE);
+        }
+
+        basename = g_file_get_basename (location);
+        file = nautilus_directory_find_file_by_name (directory, basename);
+        if (file != NULL)
+        {
+            nautilus_file_ref (file);
+        }
+        else
+        {
+            file = nautilus_file_new_from_filename (directory, basename, FALSE);
+            nautilus_directory_add_file (directory, file);
+        }
+        add_to_uri_table (file);
+
+        files = g_list_prepend (files, file);
+    }
+    g_clear_pointer (&directory, nautilus_directory_unref);
 
-    return nautilus_file_get (location);
+    return g_list_reverse (files);
 }
 
 gboolean
@@ -890,15 +1303,14 @@ finalize (GObject *object)
 
     nautilus_directory_unref (directory);
     g_clear_pointer (&file->details->name, g_ref_string_release);
+    nautilus_file_invalidate_location (file);
     g_clear_pointer (&file->details->display_name, g_ref_string_release);
     g_free (file->details->display_name_collation_key);
-    g_free (file->details->directory_name_collation_key);
     g_clear_pointer (&file->details->edit_name, g_ref_string_release);
     if (file->details->icon)
     {
         g_object_unref (file->details->icon);
     }
-    g_free (file->details->thumbnail_path);
     g_free (file->details->symlink_name);
     g_clear_pointer (&file->details->mime_type, g_ref_string_release);
     g_clear_pointer (&file->details->owner, g_ref_string_release);
@@ -909,14 +1321,9 @@ finalize (GObject *object)
     g_free (file->details->activation_uri);
     g_clear_object (&file->details->custom_icon);
 
-    if (file->details->thumbnail)
-    {
-        g_object_unref (file->details->thumbnail);
-    }
-    if (file->details->scaled_thumbnail)
-    {
-        g_object_unref (file->details->scaled_thumbnail);
-    }
+    g_clear_pointer (&file->details->deep_counts, g_free);
+    nautilus_thumbnail_cache_forget (file);
+    g_clear_pointer (&file->details->thumbnail_info, thumbnail_info_free);
 
     if (file->details->mount)
     {
@@ -926,29 +1333,20 @@ finalize (GObject *object)
 
     g_clear_pointer (&file->details->filesystem_id, g_ref_string_release);
     g_clear_pointer (&file->details->filesystem_type, g_ref_string_release);
-    g_free (file->details->trash_orig_path);
+    g_clear_pointer (&file->details->trash_info, trash_info_free);
 
     g_list_free_full (file->details->mime_list, g_free);
-    g_list_free_full (file->details->pending_extension_emblems, g_free);
-    g_list_free_full (file->details->extension_emblems, g_free);
     g_list_free_full (file->details->pending_info_providers, g_object_unref);
-
-    if (file->details->pending_extension_attributes)
-    {
-        g_hash_table_destroy (file->details->pending_extension_attributes);
-    }
-
-    if (file->details->extension_attributes)
-    {
-        g_hash_table_destroy (file->details->extension_attributes);
-    }
+    g_clear_pointer (&file->details->extension_data, extension_data_free);
 
     if (file->details->metadata)
     {
         metadata_hash_free (file->details->metadata);
     }
 
-    g_free (file->details->fts_snippet);
+    g_clear_pointer (&file->details->search_info, search_info_free);
+    invalidate_sort_keys (file);
+    invalidate_icon_memo (file);
 
     G_OBJECT_CLASS (nautilus_file_parent_class)->finalize (object);
 }
@@ -1707,36 +2105,98 @@ nautilus_file_get_location (NautilusFile *file)
 {
     g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-    return nautilus_file_info_get_location (NAUTILUS_FILE_INFO (file));
+    return g_object_ref (nautilus_file_peek_location (file));
 }
 
-/* Return the actual uri associated with the passed-in file. */
-char *
-nautilus_file_get_uri (NautilusFile *file)
+/* The location and the URI are made when first asked for, which may be from
+ * a worker thread, so they are published atomically and the copy of the
+ * thread that lost the race is dropped.
+ */
+GFile *
+nautilus_file_peek_location (NautilusFile *file)
 {
+    GFile *location;
+
     g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-    return nautilus_file_info_get_uri (NAUTILUS_FILE_INFO (file));
+    location = g_atomic_pointer_get (&file->details->location);
+    if (location == NULL)
+    {
+        location = nautilus_file_info_get_location (NAUTILUS_FILE_INFO (file));
+        if (!g_atomic_pointer_compare_and_exchange (&file->details->location, NULL, location))
+        {
+            g_object_unref (location);
+            location = g_atomic_pointer_get (&file->details->location);
+        }
+    }
+
+    return location;
 }
 
+/* Return the actual uri associated with the passed-in file. */
 char *
-nautilus_file_get_uri_scheme (NautilusFile *file)
+nautilus_file_get_uri (NautilusFile *file)
 {
     g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-    return nautilus_file_info_get_uri_scheme (NAUTILUS_FILE_INFO (file));
+    return g_strdup (nautilus_file_peek_uri (file));
 }
 
-
-gboolean
-nautilus_file_opens_in_view (NautilusFile *file)
+const char *
+nautilus_file_peek_uri (NautilusFile *file)
 {
-    return nautilus_file_is_directory (file);
-}
+    g_autofree char *uri = NULL;
+    GRefString *ref_uri;
 
-NautilusFileOperation *
-nautilus_file_operation_new (NautilusFile                  *file,
-                             NautilusFileOperationCallback  callback,
+    g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
+
+    ref_uri = g_atomic_pointer_get (&file->details->uri);
+    if (ref_uri == NULL)
+    {
+        uri = g_file_get_uri (nautilus_file_peek_location (file));
+        ref_uri = g_ref_string_new (uri);
+        if (!g_atomic_pointer_compare_and_exchange (&file->details->uri, NULL, ref_uri))
+        {
+            g_ref_string_release (ref_uri);
+            ref_uri = g_atomic_pointer_get (&file->details->uri);
+        }
+    }
+
+    return ref_uri;
+}
+
+/* Called when the name or the directory of the file change. */
+void
+nautilus_file_invalidate_location (NautilusFile *file)
+{
+    /* Before the URI it is known by goes */
+    remove_from_uri_table (file);
+
+    g_clear_object (&file->details->location);
+    g_clear_pointer (&file->details->uri, g_ref_string_release);
+
+    /* Starred files are known by their URIs. */
+    file->details->starred_generation = 0;
+}
+
+char *
+nautilus_file_get_uri_scheme (NautilusFile *file)
+{
+    g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
+
+    return nautilus_file_info_get_uri_scheme (NAUTILUS_FILE_INFO (file));
+}
+
+
+gboolean
+nautilus_file_opens_in_view (NautilusFile *file)
+{
+    return nautilus_file_is_directory (file);
+}
+
+NautilusFileOperation *
+nautilus_file_operation_new (NautilusFile                  *file,
+                             NautilusFileOperationCallback  callback,
                              gpointer                       callback_data)
 {
     NautilusFileOperation *op;
@@ -2432,6 +2892,56 @@ update_links_if_target (NautilusFile *target_file)
     nautilus_file_list_free (link_files);
 }
 
+/* Most files are neither in the trash nor recent, and don't need the
+ * side struct at all.
+ */
+static gboolean
+update_trash_info (NautilusFile *file,
+                   time_t        trash_time,
+                   time_t        recency,
+                   const char   *trash_orig_path)
+{
+    NautilusFileTrashInfo *trash_info;
+    gboolean changed;
+
+    if (trash_time == 0 && recency == 0 && trash_orig_path == NULL)
+    {
+        if (file->details->trash_info == NULL)
+        {
+            return FALSE;
+        }
+
+        g_clear_pointer (&file->details->trash_info, trash_info_free);
+        return TRUE;
+    }
+
+    if (file->details->trash_info == NULL)
+    {
+        file->details->trash_info = g_new0 (NautilusFileTrashInfo, 1);
+    }
+    trash_info = file->details->trash_info;
+
+    changed = FALSE;
+    if (trash_info->trash_time != trash_time)
+    {
+        changed = TRUE;
+        trash_info->trash_time = trash_time;
+    }
+    if (trash_info->recency != recency)
+    {
+        changed = TRUE;
+        trash_info->recency = recency;
+    }
+    if (g_strcmp0 (trash_info->orig_path, trash_orig_path) != 0)
+    {
+        changed = TRUE;
+        g_free (trash_info->orig_path);
+        trash_info->orig_path = g_strdup (trash_orig_path);
+    }
+
+    return changed;
+}
+
 static gboolean
 update_info_internal (NautilusFile *file,
                       GFileInfo    *info,
@@ -2785,7 +3295,7 @@ update_info_internal (NautilusFile *file,
     if (file->details->atime != atime ||
         file->details->mtime != mtime)
     {
-        if (file->details->thumbnail == NULL)
+        if (get_thumbnail_pixbuf (file) == NULL)
         {
             file->details->thumbnail_is_up_to_date = FALSE;
         }
@@ -2796,9 +3306,9 @@ update_info_internal (NautilusFile *file,
     file->details->mtime = mtime;
     file->details->btime = btime;
 
-    if (file->details->thumbnail != NULL &&
-        file->details->thumbnail_mtime != 0 &&
-        file->details->thumbnail_mtime != mtime)
+    if (get_thumbnail_pixbuf (file) != NULL &&
+        file->details->thumbnail_info->mtime != 0 &&
+        file->details->thumbnail_info->mtime != mtime)
     {
         file->details->thumbnail_is_up_to_date = FALSE;
         changed = TRUE;
@@ -2817,11 +3327,14 @@ update_info_internal (NautilusFile *file,
     }
 
     thumbnail_path = g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH);
-    if (g_strcmp0 (file->details->thumbnail_path, thumbnail_path) != 0)
+    if (g_strcmp0 (get_thumbnail_path (file), thumbnail_path) != 0)
     {
+        NautilusFileThumbnailInfo *thumbnail_info;
+
         changed = TRUE;
-        g_free (file->details->thumbnail_path);
-        file->details->thumbnail_path = g_strdup (thumbnail_path);
+        thumbnail_info = nautilus_file_ensure_thumbnail_info (file);
+        g_free (thumbnail_info->path);
+        thumbnail_info->path = g_strdup (thumbnail_path);
     }
 
     thumbnailing_failed = g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED);
@@ -2882,26 +3395,9 @@ update_info_internal (NautilusFile *file,
         g_time_val_from_iso8601 (time_string, &g_trash_time);
         trash_time = g_trash_time.tv_sec;
     }
-    if (file->details->trash_time != trash_time)
-    {
-        changed = TRUE;
-        file->details->trash_time = trash_time;
-    }
-
     recency = g_file_info_get_attribute_int64 (info, G_FILE_ATTRIBUTE_RECENT_MODIFIED);
-    if (file->details->recency != recency)
-    {
-        changed = TRUE;
-        file->details->recency = recency;
-    }
-
     trash_orig_path = g_file_info_get_attribute_byte_string (info, "trash::orig-path");
-    if (g_strcmp0 (file->details->trash_orig_path, trash_orig_path) != 0)
-    {
-        changed = TRUE;
-        g_free (file->details->trash_orig_path);
-        file->details->trash_orig_path = g_strdup (trash_orig_path);
-    }
+    changed |= update_trash_info (file, trash_time, recency, trash_orig_path);
 
     changed |=
         nautilus_file_update_metadata_from_info (file, info);
@@ -2926,6 +3422,7 @@ update_info_internal (NautilusFile *file,
             {
                 file->details->name = g_ref_string_new (name);
             }
+            nautilus_file_invalidate_location (file);
 
             if (!file->details->got_custom_display_name &&
                 g_file_info_get_display_name (info) == NULL)
@@ -2947,6 +3444,8 @@ update_info_internal (NautilusFile *file,
         add_to_link_hash_table (file);
 
         update_links_if_target (file);
+
+        invalidate_sort_keys (file);
     }
 
     return changed;
@@ -2994,6 +3493,7 @@ update_name_internal (NautilusFile *file,
 
     g_clear_pointer (&file->details->name, g_ref_string_release);
     file->details->name = g_ref_string_new (name);
+    nautilus_file_invalidate_location (file);
 
     if (!file->details->got_custom_display_name)
     {
@@ -3180,13 +3680,13 @@ get_time (NautilusFile     *file,
 
         case NAUTILUS_DATE_TYPE_TRASHED:
         {
-            time = file->details->trash_time;
+            time = nautilus_file_get_trash_time (file);
         }
         break;
 
         case NAUTILUS_DATE_TYPE_RECENCY:
         {
-            time = file->details->recency;
+            time = nautilus_file_get_recency (file);
         }
         break;
 
@@ -3378,8 +3878,23 @@ static int
 compare_by_directory_name (NautilusFile *file_1,
                            NautilusFile *file_2)
 {
-    return strcmp (file_1->details->directory_name_collation_key,
-                   file_2->details->directory_name_collation_key);
+    gboolean self_owned_1, self_owned_2;
+
+    /* Self-owned files have no parent, as if it were "". */
+    self_owned_1 = nautilus_file_is_self_owned (file_1);
+    self_owned_2 = nautilus_file_is_self_owned (file_2);
+    if (self_owned_1 || self_owned_2)
+    {
+        return self_owned_2 - self_owned_1;
+    }
+
+    if (file_1->details->directory == file_2->details->directory)
+    {
+        return 0;
+    }
+
+    return strcmp (nautilus_directory_peek_uri_collation_key (file_1->details->directory),
+                   nautilus_directory_peek_uri_collation_key (file_2->details->directory));
 }
 
 static GList *
@@ -3420,15 +3935,173 @@ prepend_automatic_keywords (NautilusFile *file,
     return names;
 }
 
+/* Bumped when the MIME data changes, as type descriptions may then too. */
+static guint sort_keys_generation = 1;
+
+static NautilusFileSortKeys *
+get_sort_keys (NautilusFile *file)
+{
+    if (file->details->sort_keys != NULL &&
+        file->details->sort_keys->generation != sort_keys_generation)
+    {
+        invalidate_sort_keys (file);
+    }
+
+    if (file->details->sort_keys == NULL)
+    {
+        file->details->sort_keys = g_new0 (NautilusFileSortKeys, 1);
+        file->details->sort_keys->generation = sort_keys_generation;
+    }
+
+    return file->details->sort_keys;
+}
+
+/* Interned MIME type -> the description and the collation key of its
+ * type, shared by all the files of the type, as most folders only have a
+ * handful. Filled from the sort threads too, and emptied with each new
+ * generation of the keys, which can only happen while no sort is running.
+ */
+typedef struct
+{
+    char *description;
+    char *collation_key;
+} TypeStrings;
+
+G_LOCK_DEFINE_STATIC (type_strings);
+static GHashTable *type_strings = NULL;
+static guint type_strings_generation = 0;
+
+static void
+type_strings_free (TypeStrings *strings)
+{
+    g_free (strings->description);
+    g_free (strings->collation_key);
+    g_free (strings);
+}
+
+/* Only for the files of known MIME types, with the lock held */
+static TypeStrings *
+get_shared_type_strings (NautilusFile *file)
+{
+    TypeStrings *strings;
+
+    if (type_strings == NULL)
+    {
+        type_strings = g_hash_table_new_full (NULL, NULL,
+                                              (GDestroyNotify) g_ref_string_release,
+                                              (GDestroyNotify) type_strings_free);
+    }
+    if (type_strings_generation != sort_keys_generation)
+    {
+        g_hash_table_remove_all (type_strings);
+        type_strings_generation = sort_keys_generation;
+    }
+
+    strings = g_hash_table_lookup (type_strings, file->details->mime_type);
+    if (strings == NULL)
+    {
+        strings = g_new0 (TypeStrings, 1);
+        strings->description = get_description (file, FALSE);
+        strings->collation_key = g_utf8_collate_key (strings->description, -1);
+        g_hash_table_insert (type_strings,
+                             g_ref_string_acquire (file->details->mime_type),
+                             strings);
+    }
+
+    return strings;
+}
+
+static char *
+get_shared_type_collation_key (NautilusFile *file)
+{
+    char *collation_key;
+
+    G_LOCK (type_strings);
+    collation_key = get_shared_type_strings (file)->collation_key;
+    G_UNLOCK (type_strings);
+
+    return collation_key;
+}
+
+static const char *
+peek_shared_type_description (NautilusFile *file)
+{
+    const char *description;
+
+    G_LOCK (type_strings);
+    description = get_shared_type_strings (file)->description;
+    G_UNLOCK (type_strings);
+
+    return description;
+}
+
+static const char *
+get_type_sort_key (NautilusFile *file)
+{
+    NautilusFileSortKeys *sort_keys;
+    g_autofree char *type_string = NULL;
+
+    sort_keys = get_sort_keys (file);
+    if (!sort_keys->got_type_collation_key &&
+        file->details->mime_type != NULL &&
+        !g_content_type_is_unknown (file->details->mime_type) &&
+        !nautilus_file_is_broken_symbolic_link (file))
+    {
+        /* The type only depends on the MIME type then */
+        sort_keys->type_collation_key = get_shared_type_collation_key (file);
+        sort_keys->type_collation_key_shared = TRUE;
+        sort_keys->got_type_collation_key = TRUE;
+    }
+    else if (!sort_keys->got_type_collation_key)
+    {
+        type_string = nautilus_file_get_type_as_string_no_extra_text (file);
+        if (type_string != NULL)
+        {
+            sort_keys->type_collation_key = g_utf8_collate_key (type_string, -1);
+        }
+        sort_keys->got_type_collation_key = TRUE;
+    }
+
+    return sort_keys->type_collation_key;
+}
+
+/**
+ * nautilus_file_is_starred:
+ * @file: a #NautilusFile
+ *
+ * Looks the file up in the starred files only once after each change to
+ * them, as sorting and drawing ask for every file over and over.
+ *
+ * Returns: whether @file is starred
+ */
+gboolean
+nautilus_file_is_starred (NautilusFile *file)
+{
+    guint generation;
+
+    g_return_val_if_fail (NAUTILUS_IS_FILE (file), FALSE);
+
+    generation = nautilus_tag_manager_get_starred_generation ();
+    if (file->details->starred_generation != generation)
+    {
+        g_autoptr (NautilusTagManager) tag_manager = nautilus_tag_manager_get ();
+
+        file->details->is_starred = nautilus_tag_manager_file_is_starred (tag_manager,
+                                                                          nautilus_file_peek_uri (file));
+        file->details->starred_generation = generation;
+    }
+
+    return file->details->is_starred;
+}
+
 static int
 compare_by_type (NautilusFile *file_1,
                  NautilusFile *file_2)
 {
     gboolean is_directory_1;
     gboolean is_directory_2;
-    char *type_string_1;
-    char *type_string_2;
-    int result;
+    const char *type_key_1;
+    const char *type_key_2;
 
     /* Directories go first. Then, if mime types are identical,
      * don't bother getting strings (for speed). This assumes
@@ -3453,25 +4126,24 @@ compare_by_type (NautilusFile *file_1,
         return +1;
     }
 
+    /* The MIME types are interned */
     if (file_1->details->mime_type != NULL &&
-        file_2->details->mime_type != NULL &&
-        strcmp (file_1->details->mime_type,
-                file_2->details->mime_type) == 0)
+        file_1->details->mime_type == file_2->details->mime_type)
     {
         return 0;
     }
 
-    type_string_1 = nautilus_file_get_type_as_string_no_extra_text (file_1);
-    type_string_2 = nautilus_file_get_type_as_string_no_extra_text (file_2);
+    type_key_1 = get_type_sort_key (file_1);
+    type_key_2 = get_type_sort_key (file_2);
 
-    if (type_string_1 == NULL || type_string_2 == NULL)
+    if (type_key_1 == NULL || type_key_2 == NULL)
     {
-        if (type_string_1 != NULL)
+        if (type_key_1 != NULL)
         {
             return -1;
         }
 
-        if (type_string_2 != NULL)
+        if (type_key_2 != NULL)
         {
             return 1;
         }
@@ -3479,31 +4151,18 @@ compare_by_type (NautilusFile *file_1,
         return 0;
     }
 
-    result = g_utf8_collate (type_string_1, type_string_2);
-
-    g_free (type_string_1);
-    g_free (type_string_2);
-
-    return result;
+    return strcmp (type_key_1, type_key_2);
 }
 
 static int
 compare_by_starred (NautilusFile *file_1,
                     NautilusFile *file_2)
 {
-    g_autoptr (NautilusTagManager) tag_manager = nautilus_tag_manager_get ();
-    g_autofree gchar *uri_1 = NULL;
-    g_autofree gchar *uri_2 = NULL;
     gboolean file_1_is_starred;
     gboolean file_2_is_starred;
 
-    uri_1 = nautilus_file_get_uri (file_1);
-    uri_2 = nautilus_file_get_uri (file_2);
-
-    file_1_is_starred = nautilus_tag_manager_file_is_starred (tag_manager,
-                                                              uri_1);
-    file_2_is_starred = nautilus_tag_manager_file_is_starred (tag_manager,
-                                                              uri_2);
+    file_1_is_starred = nautilus_file_is_starred (file_1);
+    file_2_is_starred = nautilus_file_is_starred (file_2);
     if (!!file_1_is_starred == !!file_2_is_starred)
     {
         return 0;
@@ -3525,7 +4184,7 @@ get_search_relevance (NautilusFile *file,
     /* we're only called in search directories, and in that
      * case, the relevance is always known (or zero).
      */
-    *relevance_out = file->details->search_relevance;
+    *relevance_out = file->details->search_info != NULL ? file->details->search_info->relevance : 0;
     return KNOWN;
 }
 
@@ -3807,6 +4466,32 @@ nautilus_file_compare_for_sort (NautilusFile         *file_1,
     return result;
 }
 
+static void
+compare_buffer_free (gpointer data)
+{
+    g_string_free (data, TRUE);
+}
+
+/* The values sorted by are formatted in these, one pair for each of the
+ * threads sorting, so that comparing them doesn't allocate anything */
+static GPrivate compare_buffer_1 = G_PRIVATE_INIT (compare_buffer_free);
+static GPrivate compare_buffer_2 = G_PRIVATE_INIT (compare_buffer_free);
+
+static GString *
+get_compare_buffer (GPrivate *key)
+{
+    GString *buffer;
+
+    buffer = g_private_get (key);
+    if (buffer == NULL)
+    {
+        buffer = g_string_new (NULL);
+        g_private_set (key, buffer);
+    }
+
+    return buffer;
+}
+
 int
 nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile *file_1,
                                                  NautilusFile *file_2,
@@ -3901,22 +4586,19 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile *file_1,
 
     if (result == 0)
     {
-        char *value_1;
-        char *value_2;
+        const char *value_1;
+        const char *value_2;
 
-        value_1 = nautilus_file_get_string_attribute_q (file_1,
-                                                        attribute);
-        value_2 = nautilus_file_get_string_attribute_q (file_2,
-                                                        attribute);
+        value_1 = nautilus_file_peek_string_attribute_q (file_1, attribute,
+                                                         get_compare_buffer (&compare_buffer_1));
+        value_2 = nautilus_file_peek_string_attribute_q (file_2, attribute,
+                                                         get_compare_buffer (&compare_buffer_2));
 
         if (value_1 != NULL && value_2 != NULL)
         {
             result = strcmp (value_1, value_2);
         }
 
-        g_free (value_1);
-        g_free (value_2);
-
         if (reversed)
         {
             result = -result;
@@ -4400,11 +5082,18 @@ nautilus_file_set_integer_metadata (NautilusFile *file,
                                 default_as_string, value_as_string);
 }
 
-static const char *
+const char *
 nautilus_file_peek_display_name_collation_key (NautilusFile *file)
 {
     const char *res;
 
+    if (file->details->display_name_collation_key == NULL &&
+        file->details->display_name != NULL)
+    {
+        file->details->display_name_collation_key =
+            nautilus_collate_key_for_filename (file->details->display_name);
+    }
+
     res = file->details->display_name_collation_key;
     if (res == NULL)
     {
@@ -4414,7 +5103,7 @@ nautilus_file_peek_display_name_collation_key (NautilusFile *file)
     return res;
 }
 
-static const char *
+const char *
 nautilus_file_peek_display_name (NautilusFile *file)
 {
     const char *name;
@@ -4810,7 +5499,7 @@ nautilus_file_should_show_thumbnail (NautilusFile *file)
      * of the original file.
      */
     if (nautilus_thumbnail_is_mimetype_limited_by_size (mime_type) &&
-        file->details->thumbnail_path == NULL &&
+        get_thumbnail_path (file) == NULL &&
         nautilus_file_get_size (file) > cached_thumbnail_limit)
     {
         return FALSE;
@@ -4942,8 +5631,12 @@ nautilus_file_get_keywords (NautilusFile *file)
 
     g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-    keywords = g_list_copy_deep (file->details->extension_emblems, (GCopyFunc) g_strdup, NULL);
-    keywords = g_list_concat (keywords, g_list_copy_deep (file->details->pending_extension_emblems, (GCopyFunc) g_strdup, NULL));
+    keywords = NULL;
+    if (file->details->extension_data != NULL)
+    {
+        keywords = g_list_copy_deep (file->details->extension_data->emblems, (GCopyFunc) g_strdup, NULL);
+        keywords = g_list_concat (keywords, g_list_copy_deep (file->details->extension_data->pending_emblems, (GCopyFunc) g_strdup, NULL));
+    }
 
     metadata_keywords = nautilus_file_get_metadata_list (file, NAUTILUS_METADATA_KEY_EMBLEMS);
     clean_up_metadata_keywords (file, &metadata_keywords);
@@ -5167,7 +5860,7 @@ out:
 char *
 nautilus_file_get_thumbnail_path (NautilusFile *file)
 {
-    return g_strdup (file->details->thumbnail_path);
+    return g_strdup (get_thumbnail_path (file));
 }
 
 static NautilusIconInfo *
@@ -5182,10 +5875,12 @@ nautilus_file_get_thumbnail_icon (NautilusFile          *file,
     double thumb_scale;
     GIcon *gicon;
     NautilusIconInfo *icon;
+    NautilusFileThumbnailInfo *thumbnail_info;
 
     icon = NULL;
     gicon = NULL;
     pixbuf = NULL;
+    thumbnail_info = file->details->thumbnail_info;
 
     if (flags & NAUTILUS_FILE_ICON_FLAGS_FORCE_THUMBNAIL_SIZE)
     {
@@ -5196,10 +5891,10 @@ nautilus_file_get_thumbnail_icon (NautilusFile          *file,
         modified_size = size * scale * NAUTILUS_CANVAS_ICON_SIZE_STANDARD / NAUTILUS_CANVAS_ICON_SIZE_SMALL;
     }
 
-    if (file->details->thumbnail)
+    if (thumbnail_info != NULL && thumbnail_info->pixbuf != NULL)
     {
-        w = gdk_pixbuf_get_width (file->details->thumbnail);
-        h = gdk_pixbuf_get_height (file->details->thumbnail);
+        w = gdk_pixbuf_get_width (thumbnail_info->pixbuf);
+        h = gdk_pixbuf_get_height (thumbnail_info->pixbuf);
 
         s = MAX (w, h);
         /* Don't scale up small thumbnails in the standard view */
@@ -5218,23 +5913,19 @@ nautilus_file_get_thumbnail_icon (NautilusFile          *file,
             thumb_scale = (double) NAUTILUS_LIST_ICON_SIZE_SMALL / s;
         }
 
-        if (file->details->thumbnail_scale == thumb_scale &&
-            file->details->scaled_thumbnail != NULL)
-        {
-            pixbuf = file->details->scaled_thumbnail;
-        }
-        else
+        pixbuf = lookup_scaled_thumbnail (thumbnail_info, thumb_scale, scale);
+        if (pixbuf == NULL)
         {
             GdkPixbuf *bg_pixbuf;
             int bg_size;
 
-            pixbuf = gdk_pixbuf_scale_simple (file->details->thumbnail,
+            pixbuf = gdk_pixbuf_scale_simple (thumbnail_info->pixbuf,
                                               MAX (w * thumb_scale, 1),
                                               MAX (h * thumb_scale, 1),
                                               GDK_INTERP_BILINEAR);
 
             /* We don't want frames around small icons */
-            if (!gdk_pixbuf_get_has_alpha (file->details->thumbnail) || s >= 128 * scale)
+            if (!gdk_pixbuf_get_has_alpha (thumbnail_info->pixbuf) || s >= 128 * scale)
             {
                 gboolean use_experimental_views;
 
@@ -5272,15 +5963,24 @@ nautilus_file_get_thumbnail_icon (NautilusFile          *file,
             g_clear_object (&pixbuf);
             pixbuf = bg_pixbuf;
 
-            g_clear_object (&file->details->scaled_thumbnail);
-            file->details->scaled_thumbnail = pixbuf;
-            file->details->thumbnail_scale = thumb_scale;
+            add_scaled_thumbnail (thumbnail_info, thumb_scale, scale, pixbuf);
         }
 
+        nautilus_thumbnail_cache_use (file);
+
         DEBUG ("Returning thumbnailed image, at size %d %d",
                gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf));
     }
-    else if (file->details->thumbnail_path == NULL &&
+    else if (get_thumbnail_path (file) != NULL &&
+             !file->details->thumbnail_is_up_to_date &&
+             file->details->directory != NULL)
+    {
+        /* Dropped by the thumbnail cache, or not loaded yet: load it
+         * for whoever asks for thumbnails. */
+        nautilus_directory_add_file_to_work_queue (file->details->directory, file);
+        nautilus_directory_async_state_changed (file->details->directory);
+    }
+    else if (get_thumbnail_path (file) == NULL &&
              file->details->can_read &&
              !file->details->is_thumbnailing &&
              !file->details->thumbnailing_failed &&
@@ -5340,6 +6040,7 @@ nautilus_file_get_icon (NautilusFile          *file,
                         NautilusFileIconFlags  flags)
 {
     NautilusIconInfo *icon;
+    NautilusFileIconMemo *icon_memo;
     GIcon *gicon;
 
     icon = NULL;
@@ -5349,6 +6050,16 @@ nautilus_file_get_icon (NautilusFile          *file,
         goto out;
     }
 
+    /* Views ask for the same icon every time a cell is drawn. */
+    icon_memo = file->details->icon_memo;
+    if (icon_memo != NULL &&
+        icon_memo->size == size &&
+        icon_memo->scale == scale &&
+        icon_memo->flags == flags)
+    {
+        return g_object_ref (icon_memo->icon);
+    }
+
     gicon = get_custom_icon (file);
     if (gicon != NULL)
     {
@@ -5387,6 +6098,25 @@ nautilus_file_get_icon (NautilusFile          *file,
     }
 
 out:
+    if (icon != NULL)
+    {
+        icon_memo = file->details->icon_memo;
+        if (icon_memo == NULL)
+        {
+            icon_memo = g_new0 (NautilusFileIconMemo, 1);
+            file->details->icon_memo = icon_memo;
+        }
+        else
+        {
+            g_object_unref (icon_memo->icon);
+        }
+
+        icon_memo->icon = g_object_ref (icon);
+        icon_memo->size = size;
+        icon_memo->scale = scale;
+        icon_memo->flags = flags;
+    }
+
     return icon;
 }
 
@@ -5472,35 +6202,18 @@ nautilus_file_get_trash_original_file_parent_as_string (NautilusFile *file)
     return filename;
 }
 
-/**
- * nautilus_file_get_date_as_string:
- *
- * Get a user-displayable string representing a file modification date.
- * The caller is responsible for g_free-ing this string.
- * @file: NautilusFile representing the file in question.
- *
- * Returns: Newly allocated string ready to display to the user.
- *
- **/
 static char *
-nautilus_file_get_date_as_string (NautilusFile       *file,
-                                  NautilusDateType    date_type,
-                                  NautilusDateFormat  date_format)
+format_date_string (time_t              file_time_raw,
+                    NautilusDateFormat  date_format,
+                    gboolean            use_24)
 {
-    time_t file_time_raw;
     GDateTime *file_date_time, *now;
     GDateTime *today_midnight;
     gint days_ago;
-    gboolean use_24;
     const gchar *format;
     gchar *result;
     gchar *result_with_ratio;
 
-    if (!nautilus_file_get_date (file, date_type, &file_time_raw))
-    {
-        return NULL;
-    }
-
     file_date_time = g_date_time_new_from_unix_local (file_time_raw);
     if (date_format != NAUTILUS_DATE_FORMAT_FULL)
     {
@@ -5519,9 +6232,6 @@ nautilus_file_get_date_as_string (NautilusFile       *file,
 
         days_ago = g_date_time_difference (today_midnight, file_date) / G_TIME_SPAN_DAY;
 
-        use_24 = g_settings_get_enum (gnome_interface_preferences, "clock-format") ==
-                 G_DESKTOP_CLOCK_FORMAT_24H;
-
         /* Show only the time if date is on today */
         if (days_ago == 0)
         {
@@ -5668,6 +6378,141 @@ nautilus_file_get_date_as_string (NautilusFile       *file,
     return result_with_ratio;
 }
 
+/* Formatting dates is expensive, and the views ask for the same ones
+ * over and over while drawing. The strings only depend on the date, the
+ * format, the clock format and on what day it is today, so they are
+ * kept until one of the latter two changes.
+ */
+#define DATE_STRING_CACHE_MAX_SIZE 10000
+
+typedef struct
+{
+    gint64 time;
+    NautilusDateFormat format;
+} DateStringKey;
+
+static GHashTable *date_string_cache = NULL;
+static gint64 date_string_cache_valid_until = 0;
+static gboolean date_string_use_24;
+
+static guint
+date_string_key_hash (gconstpointer key)
+{
+    const DateStringKey *date_string_key = key;
+
+    return g_int64_hash (&date_string_key->time) ^ date_string_key->format;
+}
+
+static gboolean
+date_string_key_equal (gconstpointer a,
+                       gconstpointer b)
+{
+    const DateStringKey *key_a = a;
+    const DateStringKey *key_b = b;
+
+    return key_a->time == key_b->time && key_a->format == key_b->format;
+}
+
+static void
+flush_date_string_cache (void)
+{
+    g_autoptr (GDateTime) now = NULL;
+    g_autoptr (GDateTime) today_midnight = NULL;
+    g_autoptr (GDateTime) tomorrow_midnight = NULL;
+
+    g_hash_table_remove_all (date_string_cache);
+
+    now = g_date_time_new_now_local ();
+    today_midnight = g_date_time_new_local (g_date_time_get_year (now),
+                                            g_date_time_get_month (now),
+                                            g_date_time_get_day_of_month (now),
+                                            0, 0, 0);
+    tomorrow_midnight = g_date_time_add_days (today_midnight, 1);
+    date_string_cache_valid_until = g_date_time_to_unix (tomorrow_midnight);
+
+    date_string_use_24 = g_settings_get_enum (gnome_interface_preferences, "clock-format") ==
+                         G_DESKTOP_CLOCK_FORMAT_24H;
+}
+
+static void
+clock_format_changed_callback (gpointer callback_data)
+{
+    date_string_cache_valid_until = 0;
+}
+
+/* The string is the cache's, only valid until the next date is asked for */
+static const char *
+peek_date_string (NautilusFile       *file,
+                  NautilusDateType    date_type,
+                  NautilusDateFormat  date_format)
+{
+    time_t file_time_raw;
+    DateStringKey key;
+    DateStringKey *new_key;
+    const char *cached;
+    char *result;
+
+    if (!nautilus_file_get_date (file, date_type, &file_time_raw))
+    {
+        return NULL;
+    }
+
+    if (date_string_cache == NULL)
+    {
+        date_string_cache = g_hash_table_new_full (date_string_key_hash,
+                                                   date_string_key_equal,
+                                                   g_free, g_free);
+        g_signal_connect_swapped (gnome_interface_preferences,
+                                  "changed::clock-format",
+                                  G_CALLBACK (clock_format_changed_callback),
+                                  NULL);
+    }
+
+    if (g_get_real_time () / G_USEC_PER_SEC >= date_string_cache_valid_until)
+    {
+        flush_date_string_cache ();
+    }
+
+    key.time = file_time_raw;
+    key.format = date_format;
+
+    cached = g_hash_table_lookup (date_string_cache, &key);
+    if (cached != NULL)
+    {
+        return cached;
+    }
+
+    result = format_date_string (file_time_raw, date_format, date_string_use_24);
+
+    if (g_hash_table_size (date_string_cache) >= DATE_STRING_CACHE_MAX_SIZE)
+    {
+        g_hash_table_remove_all (date_string_cache);
+    }
+    new_key = g_new (DateStringKey, 1);
+    *new_key = key;
+    g_hash_table_insert (date_string_cache, new_key, result);
+
+    return result;
+}
+
+/**
+ * nautilus_file_get_date_as_string:
+ *
+ * Get a user-displayable string representing a file modification date.
+ * The caller is responsible for g_free-ing this string.
+ * @file: NautilusFile representing the file in question.
+ *
+ * Returns: Newly allocated string ready to display to the user.
+ *
+ **/
+static char *
+nautilus_file_get_date_as_string (NautilusFile       *file,
+                                  NautilusDateType    date_type,
+                                  NautilusDateFormat  date_format)
+{
+    return g_strdup (peek_date_string (file, date_type, date_format));
+}
+
 static void
 show_directory_item_count_changed_callback (gpointer callback_data)
 {
@@ -5867,7 +6712,7 @@ nautilus_file_get_recency (NautilusFile *file)
 {
     g_return_val_if_fail (NAUTILUS_IS_FILE (file), 0);
 
-    return file->details->recency;
+    return file->details->trash_info != NULL ? file->details->trash_info->recency : 0;
 }
 
 time_t
@@ -5875,7 +6720,7 @@ nautilus_file_get_trash_time (NautilusFile *file)
 {
     g_return_val_if_fail (NAUTILUS_IS_FILE (file), 0);
 
-    return file->details->trash_time;
+    return file->details->trash_info != NULL ? file->details->trash_info->trash_time : 0;
 }
 
 static void
@@ -5966,20 +6811,24 @@ void
 nautilus_file_set_search_relevance (NautilusFile *file,
                                     gdouble       relevance)
 {
-    file->details->search_relevance = relevance;
+    ensure_search_info (file)->relevance = relevance;
 }
 
 void
 nautilus_file_set_search_fts_snippet (NautilusFile *file,
                                       const gchar  *fts_snippet)
 {
-    file->details->fts_snippet = g_strdup (fts_snippet);
+    NautilusFileSearchInfo *search_info;
+
+    search_info = ensure_search_info (file);
+    g_free (search_info->fts_snippet);
+    search_info->fts_snippet = g_strdup (fts_snippet);
 }
 
 const gchar *
 nautilus_file_get_search_fts_snippet (NautilusFile *file)
 {
-    return file->details->fts_snippet;
+    return file->details->search_info != NULL ? file->details->search_info->fts_snippet : NULL;
 }
 
 /**
@@ -6460,16 +7309,23 @@ nautilus_file_set_owner (NautilusFile                  *file,
     g_object_unref (info);
 }
 
-/**
- * nautilus_get_user_names:
- *
- * Get a list of user names. For users with a different associated
- * "real name", the real name follows the standard user name, separated
- * by a carriage return. The caller is responsible for freeing this list
- * and its contents.
- */
-GList *
-nautilus_get_user_names (void)
+/* Enumerating all the accounts can take seconds with a network directory,
+ * so the names are listed in a worker and kept for a while. */
+#define ACCOUNT_NAMES_TTL_SECONDS 300
+
+typedef struct
+{
+    GList * (*enumerate) (void);
+    GList *names;
+    gint64 time;
+    GList *waiters; /* of GTask, while a worker lists the names */
+} AccountNames;
+
+/* getpwent () and getgrent () keep their position in globals */
+G_LOCK_DEFINE_STATIC (account_enumeration);
+
+static GList *
+enumerate_user_names (void)
 {
     GList *list;
     char *real_name, *name;
@@ -6477,6 +7333,8 @@ nautilus_get_user_names (void)
 
     list = NULL;
 
+    G_LOCK (account_enumeration);
+
     setpwent ();
 
     while ((user = getpwent ()) != NULL)
@@ -6496,9 +7354,172 @@ nautilus_get_user_names (void)
 
     endpwent ();
 
+    G_UNLOCK (account_enumeration);
+
     return g_list_sort (list, (GCompareFunc) g_utf8_collate);
 }
 
+static GList *
+enumerate_group_names (void)
+{
+    GList *list;
+    struct group *group;
+
+    list = NULL;
+
+    G_LOCK (account_enumeration);
+
+    setgrent ();
+
+    while ((group = getgrent ()) != NULL)
+    {
+        list = g_list_prepend (list, g_strdup (group->gr_name));
+    }
+
+    endgrent ();
+
+    G_UNLOCK (account_enumeration);
+
+    return g_list_sort (list, (GCompareFunc) g_utf8_collate);
+}
+
+static AccountNames user_names = { .enumerate = enumerate_user_names };
+static AccountNames group_names = { .enumerate = enumerate_group_names };
+
+static void
+free_string_list (GList *list)
+{
+    g_list_free_full (list, g_free);
+}
+
+static gboolean
+account_names_are_fresh (AccountNames *account_names)
+{
+    return account_names->time != 0 &&
+           g_get_monotonic_time () - account_names->time < ACCOUNT_NAMES_TTL_SECONDS * G_USEC_PER_SEC;
+}
+
+static void
+account_names_set (AccountNames *account_names,
+                   GList        *names)
+{
+    free_string_list (account_names->names);
+    account_names->names = names;
+    account_names->time = g_get_monotonic_time ();
+}
+
+static void
+account_names_enumerate_thread (GTask        *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable)
+{
+    AccountNames *account_names = task_data;
+
+    g_task_return_pointer (task, account_names->enumerate (),
+                           (GDestroyNotify) free_string_list);
+}
+
+static void
+account_names_enumerate_done (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+    AccountNames *account_names = user_data;
+    GList *waiters;
+
+    account_names_set (account_names, g_task_propagate_pointer (G_TASK (result), NULL));
+
+    waiters = g_steal_pointer (&account_names->waiters);
+    for (GList *l = waiters; l != NULL; l = l->next)
+    {
+        g_task_return_pointer (l->data,
+                               g_list_copy_deep (account_names->names, (GCopyFunc) g_strdup, NULL),
+                               (GDestroyNotify) free_string_list);
+    }
+    g_list_free_full (waiters, g_object_unref);
+}
+
+static void
+account_names_get_async (AccountNames        *account_names,
+                         gpointer             source_tag,
+                         GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    g_autoptr (GTask) enumerate_task = NULL;
+
+    task = g_task_new (NULL, cancellable, callback, user_data);
+    g_task_set_source_tag (task, source_tag);
+
+    if (account_names_are_fresh (account_names))
+    {
+        g_task_return_pointer (task,
+                               g_list_copy_deep (account_names->names, (GCopyFunc) g_strdup, NULL),
+                               (GDestroyNotify) free_string_list);
+        return;
+    }
+
+    if (account_names->waiters == NULL)
+    {
+        enumerate_task = g_task_new (NULL, NULL, account_names_enumerate_done, account_names);
+        g_task_set_task_data (enumerate_task, account_names, NULL);
+        g_task_run_in_thread (enumerate_task, account_names_enumerate_thread);
+    }
+
+    account_names->waiters = g_list_prepend (account_names->waiters, g_steal_pointer (&task));
+}
+
+static GList *
+account_names_get (AccountNames *account_names)
+{
+    if (!account_names_are_fresh (account_names))
+    {
+        account_names_set (account_names, account_names->enumerate ());
+    }
+
+    return g_list_copy_deep (account_names->names, (GCopyFunc) g_strdup, NULL);
+}
+
+/**
+ * nautilus_get_user_names:
+ *
+ * Get a list of user names. For users with a different associated
+ * "real name", the real name follows the standard user name, separated
+ * by a carriage return. The caller is responsible for freeing this list
+ * and its contents.
+ */
+GList *
+nautilus_get_user_names (void)
+{
+    return account_names_get (&user_names);
+}
+
+/**
+ * nautilus_get_user_names_async:
+ *
+ * Like nautilus_get_user_names(), but lists the users in a worker thread
+ * when they are not known already.
+ */
+void
+nautilus_get_user_names_async (GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+    account_names_get_async (&user_names, nautilus_get_user_names_async,
+                             cancellable, callback, user_data);
+}
+
+GList *
+nautilus_get_user_names_finish (GAsyncResult  *result,
+                                GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 /**
  * nautilus_file_can_get_group:
  *
@@ -6616,62 +7637,105 @@ nautilus_get_group_names_for_user (void)
 GList *
 nautilus_get_all_group_names (void)
 {
-    GList *list;
-    struct group *group;
+    return account_names_get (&group_names);
+}
 
-    list = NULL;
+/**
+ * nautilus_file_get_settable_group_names:
+ *
+ * Get a list of all group names that the current user
+ * can set the group of a specific file to.
+ *
+ * @file: The NautilusFile in question.
+ */
+GList *
+nautilus_file_get_settable_group_names (NautilusFile *file)
+{
+    uid_t user_id;
+    GList *result;
 
-    setgrent ();
+    if (!nautilus_file_can_set_group (file))
+    {
+        return NULL;
+    }
 
-    while ((group = getgrent ()) != NULL)
+    /* Check the user. */
+    user_id = geteuid ();
+
+    if (user_id == 0)
     {
-        list = g_list_prepend (list, g_strdup (group->gr_name));
+        /* Root is allowed to set group to anything. */
+        result = nautilus_get_all_group_names ();
+    }
+    else if (user_id == (uid_t) file->details->uid)
+    {
+        /* Owner is allowed to set group to any that owner is member of. */
+        result = nautilus_get_group_names_for_user ();
+    }
+    else
+    {
+        g_warning ("unhandled case in nautilus_get_settable_group_names");
+        result = NULL;
     }
 
-    endgrent ();
+    return result;
+}
 
-    return g_list_sort (list, (GCompareFunc) g_utf8_collate);
+static void
+get_settable_group_names_thread (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+    g_task_return_pointer (task, nautilus_get_group_names_for_user (),
+                           (GDestroyNotify) free_string_list);
 }
 
-/**
- * nautilus_file_get_settable_group_names:
- *
- * Get a list of all group names that the current user
- * can set the group of a specific file to.
+/**
+ * nautilus_file_get_settable_group_names_async:
  *
- * @file: The NautilusFile in question.
+ * Like nautilus_file_get_settable_group_names(), but looks the groups up
+ * in a worker thread.
  */
-GList *
-nautilus_file_get_settable_group_names (NautilusFile *file)
+void
+nautilus_file_get_settable_group_names_async (NautilusFile        *file,
+                                              GCancellable        *cancellable,
+                                              GAsyncReadyCallback  callback,
+                                              gpointer             user_data)
 {
+    g_autoptr (GTask) task = NULL;
     uid_t user_id;
-    GList *result;
-
-    if (!nautilus_file_can_set_group (file))
-    {
-        return NULL;
-    }
 
-    /* Check the user. */
     user_id = geteuid ();
 
-    if (user_id == 0)
+    if (user_id == 0 && nautilus_file_can_set_group (file))
     {
-        /* Root is allowed to set group to anything. */
-        result = nautilus_get_all_group_names ();
+        account_names_get_async (&group_names, nautilus_file_get_settable_group_names_async,
+                                 cancellable, callback, user_data);
+        return;
     }
-    else if (user_id == (uid_t) file->details->uid)
+
+    task = g_task_new (NULL, cancellable, callback, user_data);
+    g_task_set_source_tag (task, nautilus_file_get_settable_group_names_async);
+
+    if (nautilus_file_can_set_group (file))
     {
-        /* Owner is allowed to set group to any that owner is member of. */
-        result = nautilus_get_group_names_for_user ();
+        /* Only the groups of the user, but those are looked up too */
+        g_task_run_in_thread (task, get_settable_group_names_thread);
     }
     else
     {
-        g_warning ("unhandled case in nautilus_get_settable_group_names");
-        result = NULL;
+        g_task_return_pointer (task, NULL, NULL);
     }
+}
 
-    return result;
+GList *
+nautilus_file_get_settable_group_names_finish (GAsyncResult  *result,
+                                               GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
 }
 
 /**
@@ -6786,18 +7850,10 @@ nautilus_file_get_octal_permissions_as_string (NautilusFile *file)
     return g_strdup_printf ("%03o", permissions);
 }
 
-/**
- * nautilus_file_get_permissions_as_string:
- *
- * Get a user-displayable string representing a file's permissions. The caller
- * is responsible for g_free-ing this string.
- * @file: NautilusFile representing the file in question.
- *
- * Returns: Newly allocated string ready to display to the user.
- *
- **/
-static char *
-nautilus_file_get_permissions_as_string (NautilusFile *file)
+/* As ls shows them, in @string of at least 11 bytes */
+static gboolean
+format_permissions (NautilusFile *file,
+                    char         *string)
 {
     guint32 permissions;
     gboolean is_directory;
@@ -6806,7 +7862,7 @@ nautilus_file_get_permissions_as_string (NautilusFile *file)
 
     if (!nautilus_file_can_get_permissions (file))
     {
-        return NULL;
+        return FALSE;
     }
 
     g_assert (NAUTILUS_IS_FILE (file));
@@ -6820,43 +7876,55 @@ nautilus_file_get_permissions_as_string (NautilusFile *file)
     sgid = permissions & S_ISGID;
     sticky = permissions & S_ISVTX;
 
-    return g_strdup_printf ("%c%c%c%c%c%c%c%c%c%c",
-                            is_link ? 'l' : is_directory ? 'd' : '-',
-                            permissions & S_IRUSR ? 'r' : '-',
-                            permissions & S_IWUSR ? 'w' : '-',
-                            permissions & S_IXUSR
-                            ? (suid ? 's' : 'x')
-                            : (suid ? 'S' : '-'),
-                            permissions & S_IRGRP ? 'r' : '-',
-                            permissions & S_IWGRP ? 'w' : '-',
-                            permissions & S_IXGRP
-                            ? (sgid ? 's' : 'x')
-                            : (sgid ? 'S' : '-'),
-                            permissions & S_IROTH ? 'r' : '-',
-                            permissions & S_IWOTH ? 'w' : '-',
-                            permissions & S_IXOTH
-                            ? (sticky ? 't' : 'x')
-                            : (sticky ? 'T' : '-'));
+    string[0] = is_link ? 'l' : is_directory ? 'd' : '-';
+    string[1] = permissions & S_IRUSR ? 'r' : '-';
+    string[2] = permissions & S_IWUSR ? 'w' : '-';
+    string[3] = permissions & S_IXUSR
+                ? (suid ? 's' : 'x')
+                : (suid ? 'S' : '-');
+    string[4] = permissions & S_IRGRP ? 'r' : '-';
+    string[5] = permissions & S_IWGRP ? 'w' : '-';
+    string[6] = permissions & S_IXGRP
+                ? (sgid ? 's' : 'x')
+                : (sgid ? 'S' : '-');
+    string[7] = permissions & S_IROTH ? 'r' : '-';
+    string[8] = permissions & S_IWOTH ? 'w' : '-';
+    string[9] = permissions & S_IXOTH
+                ? (sticky ? 't' : 'x')
+                : (sticky ? 'T' : '-');
+    string[10] = '\0';
+
+    return TRUE;
 }
 
 /**
- * nautilus_file_get_owner_as_string:
+ * nautilus_file_get_permissions_as_string:
  *
- * Get a user-displayable string representing a file's owner. The caller
+ * Get a user-displayable string representing a file's permissions. The caller
  * is responsible for g_free-ing this string.
  * @file: NautilusFile representing the file in question.
- * @include_real_name: Whether or not to append the real name (if any)
- * for this user after the user name.
  *
  * Returns: Newly allocated string ready to display to the user.
  *
  **/
 static char *
-nautilus_file_get_owner_as_string (NautilusFile *file,
-                                   gboolean      include_real_name)
+nautilus_file_get_permissions_as_string (NautilusFile *file)
 {
-    char *user_name;
+    char string[11];
+
+    if (!format_permissions (file, string))
+    {
+        return NULL;
+    }
+
+    return g_strdup (string);
+}
 
+/* The string is the file's, or a translation */
+static const char *
+peek_owner_name (NautilusFile *file,
+                 gboolean      include_real_name)
+{
     /* Before we have info on a file, the owner is unknown. */
     if (file->details->owner == NULL &&
         file->details->owner_real == NULL)
@@ -6868,27 +7936,42 @@ nautilus_file_get_owner_as_string (NautilusFile *file,
         file->details->uid == getuid ())
     {
         /* Translators: "Me" is used to indicate the file is owned by me (the current user) */
-        user_name = g_strdup (_("Me"));
+        return _("Me");
     }
     else if (file->details->owner_real == NULL)
     {
-        user_name = g_strdup (file->details->owner);
+        return file->details->owner;
     }
     else if (file->details->owner == NULL)
     {
-        user_name = g_strdup (file->details->owner_real);
+        return file->details->owner_real;
     }
     else if (include_real_name &&
              strcmp (file->details->owner, file->details->owner_real) != 0)
     {
-        user_name = g_strdup (file->details->owner_real);
-    }
-    else
-    {
-        user_name = g_strdup (file->details->owner);
+        return file->details->owner_real;
     }
 
-    return user_name;
+    return file->details->owner;
+}
+
+/**
+ * nautilus_file_get_owner_as_string:
+ *
+ * Get a user-displayable string representing a file's owner. The caller
+ * is responsible for g_free-ing this string.
+ * @file: NautilusFile representing the file in question.
+ * @include_real_name: Whether or not to append the real name (if any)
+ * for this user after the user name.
+ *
+ * Returns: Newly allocated string ready to display to the user.
+ *
+ **/
+static char *
+nautilus_file_get_owner_as_string (NautilusFile *file,
+                                   gboolean      include_real_name)
+{
+    return g_strdup (peek_owner_name (file, include_real_name));
 }
 
 static char *
@@ -7137,6 +8220,31 @@ nautilus_file_get_deep_directory_count_as_string (NautilusFile *file)
     return nautilus_file_get_deep_count_as_string_internal (file, FALSE, TRUE, FALSE);
 }
 
+static const char *
+peek_extension_attribute (NautilusFile *file,
+                          GQuark        attribute_q)
+{
+    NautilusFileExtensionData *extension_data;
+    const char *extension_attribute;
+
+    extension_attribute = NULL;
+    extension_data = file->details->extension_data;
+
+    if (extension_data != NULL && extension_data->pending_attributes)
+    {
+        extension_attribute = g_hash_table_lookup (extension_data->pending_attributes,
+                                                   GINT_TO_POINTER (attribute_q));
+    }
+
+    if (extension_attribute == NULL && extension_data != NULL && extension_data->attributes)
+    {
+        extension_attribute = g_hash_table_lookup (extension_data->attributes,
+                                                   GINT_TO_POINTER (attribute_q));
+    }
+
+    return extension_attribute;
+}
+
 /**
  * nautilus_file_get_string_attribute:
  *
@@ -7162,8 +8270,6 @@ char *
 nautilus_file_get_string_attribute_q (NautilusFile *file,
                                       GQuark        attribute_q)
 {
-    char *extension_attribute;
-
     if (attribute_q == attribute_name_q)
     {
         return nautilus_file_get_display_name (file);
@@ -7309,21 +8415,250 @@ nautilus_file_get_string_attribute_q (NautilusFile *file,
         return nautilus_file_get_volume_free_space (file);
     }
 
-    extension_attribute = NULL;
+    return g_strdup (peek_extension_attribute (file, attribute_q));
+}
+
+static const char *
+peek_type_as_string (NautilusFile *file,
+                     GString      *buffer)
+{
+    const char *mime_type;
+    const char *description;
 
-    if (file->details->pending_extension_attributes)
+    if (nautilus_file_is_broken_symbolic_link (file))
     {
-        extension_attribute = g_hash_table_lookup (file->details->pending_extension_attributes,
-                                                   GINT_TO_POINTER (attribute_q));
+        return _("Link (broken)");
     }
 
-    if (extension_attribute == NULL && file->details->extension_attributes)
+    /* As get_description (), without formatting it for every file */
+    mime_type = file->details->mime_type;
+    if (mime_type == NULL)
     {
-        extension_attribute = g_hash_table_lookup (file->details->extension_attributes,
-                                                   GINT_TO_POINTER (attribute_q));
+        description = NULL;
+    }
+    else if (g_content_type_is_unknown (mime_type))
+    {
+        description = nautilus_file_is_executable (file) ? _("Program") : _("Binary");
+    }
+    else
+    {
+        description = peek_shared_type_description (file);
+    }
+
+    if (!nautilus_file_is_symbolic_link (file))
+    {
+        return description;
+    }
+    if (description == NULL)
+    {
+        return _("Link");
+    }
+    g_string_printf (buffer, _("Link to %s"), description);
+
+    return buffer->str;
+}
+
+static const char *
+peek_size_as_string (NautilusFile *file,
+                     GString      *buffer)
+{
+    guint item_count;
+    gboolean count_unreadable;
+    g_autofree char *size_string = NULL;
+
+    if (nautilus_file_is_directory (file))
+    {
+        if (!nautilus_file_get_directory_item_count (file, &item_count, &count_unreadable))
+        {
+            return NULL;
+        }
+        g_string_printf (buffer, ngettext ("%'u item", "%'u items", item_count), item_count);
+
+        return buffer->str;
+    }
+
+    if (file->details->size == -1)
+    {
+        return NULL;
+    }
+    size_string = g_format_size (file->details->size);
+    g_string_assign (buffer, size_string);
+
+    return buffer->str;
+}
+
+static const char *
+peek_date_as_string (NautilusFile       *file,
+                     NautilusDateType    date_type,
+                     NautilusDateFormat  date_format,
+                     GString            *buffer)
+{
+    const char *date_string;
+
+    /* Copied, as asking for another date may drop it from the cache */
+    date_string = peek_date_string (file, date_type, date_format);
+    if (date_string == NULL)
+    {
+        return NULL;
+    }
+    g_string_assign (buffer, date_string);
+
+    return buffer->str;
+}
+
+/**
+ * nautilus_file_peek_string_attribute_q:
+ * @file: NautilusFile representing the file in question.
+ * @attribute_q: The quark of the attribute, as for
+ * nautilus_file_get_string_attribute_q().
+ * @buffer: A string to format the value into, reused from call to call.
+ *
+ * As nautilus_file_get_string_attribute_q(), for the views drawing and
+ * sorting by the same attributes of thousands of files. It doesn't
+ * allocate a string for each call: the names, MIME types, types, owners,
+ * groups and the attributes of the extensions are borrowed from @file
+ * and the caches they come from, and the sizes, dates and permissions
+ * are formatted into @buffer. The others are copied into @buffer.
+ *
+ * Returns: The value, valid until @file changes or @buffer is used
+ * again, or NULL if it is unknown.
+ **/
+const char *
+nautilus_file_peek_string_attribute_q (NautilusFile *file,
+                                       GQuark        attribute_q,
+                                       GString      *buffer)
+{
+    char permissions[11];
+    const char *extension_attribute;
+    g_autofree char *value = NULL;
+
+    g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
+    g_return_val_if_fail (buffer != NULL, NULL);
+
+    if (attribute_q == attribute_name_q)
+    {
+        return nautilus_file_peek_display_name (file);
+    }
+    if (attribute_q == attribute_type_q)
+    {
+        return peek_type_as_string (file, buffer);
+    }
+    if (attribute_q == attribute_mime_type_q)
+    {
+        return file->details->mime_type != NULL ?
+               file->details->mime_type : "application/octet-stream";
+    }
+    if (attribute_q == attribute_size_q)
+    {
+        return peek_size_as_string (file, buffer);
+    }
+    if (attribute_q == attribute_date_modified_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_MODIFIED,
+                                    NAUTILUS_DATE_FORMAT_REGULAR,
+                                    buffer);
+    }
+    if (attribute_q == attribute_date_modified_full_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_MODIFIED,
+                                    NAUTILUS_DATE_FORMAT_FULL,
+                                    buffer);
+    }
+    if (attribute_q == attribute_date_modified_with_time_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_MODIFIED,
+                                    NAUTILUS_DATE_FORMAT_REGULAR_WITH_TIME,
+                                    buffer);
+    }
+    if (attribute_q == attribute_date_accessed_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_ACCESSED,
+                                    NAUTILUS_DATE_FORMAT_REGULAR,
+                                    buffer);
+    }
+    if (attribute_q == attribute_date_accessed_full_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_ACCESSED,
+                                    NAUTILUS_DATE_FORMAT_FULL,
+                                    buffer);
+    }
+    if (attribute_q == attribute_date_created_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_CREATED,
+                                    NAUTILUS_DATE_FORMAT_REGULAR,
+                                    buffer);
     }
+    if (attribute_q == attribute_date_created_full_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_CREATED,
+                                    NAUTILUS_DATE_FORMAT_FULL,
+                                    buffer);
+    }
+    if (attribute_q == attribute_trashed_on_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_TRASHED,
+                                    NAUTILUS_DATE_FORMAT_REGULAR,
+                                    buffer);
+    }
+    if (attribute_q == attribute_trashed_on_full_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_TRASHED,
+                                    NAUTILUS_DATE_FORMAT_FULL,
+                                    buffer);
+    }
+    if (attribute_q == attribute_recency_q)
+    {
+        return peek_date_as_string (file,
+                                    NAUTILUS_DATE_TYPE_RECENCY,
+                                    NAUTILUS_DATE_FORMAT_REGULAR,
+                                    buffer);
+    }
+    if (attribute_q == attribute_permissions_q)
+    {
+        if (!format_permissions (file, permissions))
+        {
+            return NULL;
+        }
+        g_string_assign (buffer, permissions);
+
+        return buffer->str;
+    }
+    if (attribute_q == attribute_owner_q)
+    {
+        return peek_owner_name (file, TRUE);
+    }
+    if (attribute_q == attribute_group_q)
+    {
+        return file->details->group;
+    }
+
+    /* The columns of the extensions are named after them, so there is no
+     * telling them from the other attributes but by looking them up */
+    extension_attribute = peek_extension_attribute (file, attribute_q);
+    if (extension_attribute != NULL)
+    {
+        return extension_attribute;
+    }
+
+    /* The locations and the rest are rarely drawn or sorted by, or are
+     * cached by the views already */
+    value = nautilus_file_get_string_attribute_q (file, attribute_q);
+    if (value == NULL)
+    {
+        return NULL;
+    }
+    g_string_assign (buffer, value);
 
-    return g_strdup (extension_attribute);
+    return buffer->str;
 }
 
 char *
@@ -7823,26 +9158,18 @@ nautilus_file_is_broken_symbolic_link (NautilusFile *file)
 }
 
 static void
-get_fs_free_cb (GObject      *source_object,
-                GAsyncResult *res,
-                gpointer      user_data)
+get_fs_free_cb (GFileInfo *info,
+                gpointer   user_data)
 {
     NautilusFile *file;
     guint64 free_space;
-    GFileInfo *info;
 
     file = NAUTILUS_FILE (user_data);
 
     free_space = (guint64) - 1;
-    info = g_file_query_filesystem_info_finish (G_FILE (source_object),
-                                                res, NULL);
-    if (info)
+    if (info != NULL && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_FILESYSTEM_FREE))
     {
-        if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_FILESYSTEM_FREE))
-        {
-            free_space = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
-        }
-        g_object_unref (info);
+        free_space = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
     }
 
     if (file->details->free_space != free_space)
@@ -7875,11 +9202,10 @@ nautilus_file_get_volume_free_space (NautilusFile *file)
     {
         file->details->free_space_read = now;
         location = nautilus_file_get_location (file);
-        g_file_query_filesystem_info_async (location,
-                                            G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
-                                            0, NULL,
-                                            get_fs_free_cb,
-                                            nautilus_file_ref (file));
+        nautilus_filesystem_info_cache_query (location,
+                                              file->details->filesystem_id,
+                                              get_fs_free_cb,
+                                              nautilus_file_ref (file));
         g_object_unref (location);
     }
 
@@ -8267,9 +9593,9 @@ nautilus_file_get_trash_original_file (NautilusFile *file)
 
     original_file = NULL;
 
-    if (file->details->trash_orig_path != NULL)
+    if (file->details->trash_info != NULL && file->details->trash_info->orig_path != NULL)
     {
-        location = g_file_new_for_path (file->details->trash_orig_path);
+        location = g_file_new_for_path (file->details->trash_info->orig_path);
         original_file = nautilus_file_get (location);
         g_object_unref (location);
     }
@@ -8293,6 +9619,7 @@ nautilus_file_mark_gone (NautilusFile *file)
 
     /* Drop it from the symlink hash ! */
     remove_from_link_hash_table (file);
+    remove_from_uri_table (file);
 
     /* Removing the file from the directory can result in dropping the last
      * reference, and so clearing the info then will result in a crash.
@@ -8383,6 +9710,9 @@ nautilus_file_emit_changed (NautilusFile *file)
 
     g_assert (NAUTILUS_IS_FILE (file));
 
+    /* Whatever changed, the icon may have changed with it. */
+    invalidate_icon_memo (file);
+
     /* Send out a signal. */
     g_signal_emit (file, signals[CHANGED], 0, file);
 
@@ -8540,6 +9870,7 @@ static void
 invalidate_file_info (NautilusFile *file)
 {
     file->details->file_info_is_up_to_date = FALSE;
+    file->details->extended_info_failed = FALSE;
 }
 
 static void
@@ -8626,6 +9957,7 @@ nautilus_file_set_is_thumbnailing (NautilusFile *file,
     g_return_if_fail (NAUTILUS_IS_FILE (file));
 
     file->details->is_thumbnailing = is_thumbnailing;
+    invalidate_icon_memo (file);
 }
 
 
@@ -8655,6 +9987,20 @@ nautilus_file_invalidate_attributes (NautilusFile           *file,
     nautilus_directory_async_state_changed (file->details->directory);
 }
 
+void
+nautilus_file_prioritize_attributes (NautilusFile *file)
+{
+    g_return_if_fail (NAUTILUS_IS_FILE (file));
+
+    if (file->details->directory == NULL)
+    {
+        return;
+    }
+
+    nautilus_directory_prioritize_file_in_work_queue (file->details->directory, file);
+    nautilus_directory_async_state_changed (file->details->directory);
+}
+
 NautilusFileAttributes
 nautilus_file_get_all_attributes (void)
 {
@@ -8688,7 +10034,7 @@ nautilus_file_invalidate_all_attributes (NautilusFile *file)
 void
 nautilus_file_dump (NautilusFile *file)
 {
-    long size = file->details->deep_size;
+    long size = file->details->deep_counts != NULL ? file->details->deep_counts->size : 0;
     char *uri;
     const char *file_kind;
 
@@ -8924,7 +10270,8 @@ nautilus_file_get_default_sort_type (NautilusFile *file,
 
 static int
 compare_by_display_name_cover (gconstpointer a,
-                               gconstpointer b)
+                               gconstpointer b,
+                               gpointer      user_data)
 {
     return compare_by_display_name (NAUTILUS_FILE (a), NAUTILUS_FILE (b));
 }
@@ -8938,7 +10285,7 @@ compare_by_display_name_cover (gconstpointer a,
 GList *
 nautilus_file_list_sort_by_display_name (GList *list)
 {
-    return g_list_sort (list, compare_by_display_name_cover);
+    return nautilus_parallel_sort_list (list, compare_by_display_name_cover, NULL);
 }
 
 static GList *ready_data_list = NULL;
@@ -9098,6 +10445,9 @@ static void
 mime_type_data_changed_callback (GObject  *signaller,
                                  gpointer  user_data)
 {
+    /* Type descriptions might have changed too. */
+    sort_keys_generation++;
+
     /* Tell the world that icons might have changed. We could invent a narrower-scope
      * signal to mean only "thumbnails might have changed" if this ends up being slow
      * for some reason.
@@ -9167,21 +10517,26 @@ real_get_deep_counts (NautilusFile *file,
 
     if (file->details->deep_counts_status != NAUTILUS_REQUEST_NOT_STARTED)
     {
+        if (file->details->deep_counts == NULL)
+        {
+            return file->details->deep_counts_status;
+        }
+
         if (directory_count != NULL)
         {
-            *directory_count = file->details->deep_directory_count;
+            *directory_count = file->details->deep_counts->directory_count;
         }
         if (file_count != NULL)
         {
-            *file_count = file->details->deep_file_count;
+            *file_count = file->details->deep_counts->file_count;
         }
         if (unreadable_directory_count != NULL)
         {
-            *unreadable_directory_count = file->details->deep_unreadable_count;
+            *unreadable_directory_count = file->details->deep_counts->unreadable_count;
         }
         if (total_size != NULL)
         {
-            *total_size = file->details->deep_size;
+            *total_size = file->details->deep_counts->size;
         }
         return file->details->deep_counts_status;
     }
@@ -9301,17 +10656,24 @@ nautilus_file_class_init (NautilusFileClass *class)
 void
 nautilus_file_info_providers_done (NautilusFile *file)
 {
-    g_list_free_full (file->details->extension_emblems, g_free);
-    file->details->extension_emblems = file->details->pending_extension_emblems;
-    file->details->pending_extension_emblems = NULL;
+    NautilusFileExtensionData *extension_data;
 
-    if (file->details->extension_attributes)
+    extension_data = file->details->extension_data;
+    if (extension_data != NULL)
     {
-        g_hash_table_destroy (file->details->extension_attributes);
-    }
+        g_list_free_full (extension_data->emblems, g_free);
+        extension_data->emblems = extension_data->pending_emblems;
+        extension_data->pending_emblems = NULL;
 
-    file->details->extension_attributes = file->details->pending_extension_attributes;
-    file->details->pending_extension_attributes = NULL;
+        g_clear_pointer (&extension_data->attributes, g_hash_table_destroy);
+        extension_data->attributes = extension_data->pending_attributes;
+        extension_data->pending_attributes = NULL;
+
+        if (extension_data->emblems == NULL && extension_data->attributes == NULL)
+        {
+            g_clear_pointer (&file->details->extension_data, extension_data_free);
+        }
+    }
 
     nautilus_file_changed (file);
 }
@@ -9444,13 +10806,7 @@ get_name (NautilusFileInfo *file_info)
 static char *
 get_uri (NautilusFileInfo *file_info)
 {
-    NautilusFile *file;
-    g_autoptr (GFile) location = NULL;
-
-    file = NAUTILUS_FILE (file_info);
-    location = nautilus_file_get_location (file);
-
-    return g_file_get_uri (location);
+    return g_strdup (nautilus_file_peek_uri (NAUTILUS_FILE (file_info)));
 }
 
 static char *
@@ -9537,18 +10893,20 @@ add_emblem (NautilusFileInfo *file_info,
             const char       *emblem_name)
 {
     NautilusFile *file;
+    NautilusFileExtensionData *extension_data;
 
     file = NAUTILUS_FILE (file_info);
+    extension_data = ensure_extension_data (file);
 
     if (file->details->pending_info_providers)
     {
-        file->details->pending_extension_emblems = g_list_prepend (file->details->pending_extension_emblems,
-                                                                   g_strdup (emblem_name));
+        extension_data->pending_emblems = g_list_prepend (extension_data->pending_emblems,
+                                                          g_strdup (emblem_name));
     }
     else
     {
-        file->details->extension_emblems = g_list_prepend (file->details->extension_emblems,
-                                                           g_strdup (emblem_name));
+        extension_data->emblems = g_list_prepend (extension_data->emblems,
+                                                  g_strdup (emblem_name));
     }
 
     nautilus_file_changed (file);
@@ -9571,33 +10929,35 @@ add_string_attribute (NautilusFileInfo *file_info,
                       const char       *value)
 {
     NautilusFile *file;
+    NautilusFileExtensionData *extension_data;
 
     file = NAUTILUS_FILE (file_info);
+    extension_data = ensure_extension_data (file);
 
     if (file->details->pending_info_providers != NULL)
     {
         /* Lazily create hashtable */
-        if (file->details->pending_extension_attributes == NULL)
+        if (extension_data->pending_attributes == NULL)
         {
-            file->details->pending_extension_attributes =
+            extension_data->pending_attributes =
                 g_hash_table_new_full (g_direct_hash, g_direct_equal,
                                        NULL,
                                        (GDestroyNotify) g_free);
         }
-        g_hash_table_insert (file->details->pending_extension_attributes,
+        g_hash_table_insert (extension_data->pending_attributes,
                              GINT_TO_POINTER (g_quark_from_string (attribute_name)),
                              g_strdup (value));
     }
     else
     {
-        if (file->details->extension_attributes == NULL)
+        if (extension_data->attributes == NULL)
         {
-            file->details->extension_attributes =
+            extension_data->attributes =
                 g_hash_table_new_full (g_direct_hash, g_direct_equal,
                                        NULL,
                                        (GDestroyNotify) g_free);
         }
-        g_hash_table_insert (file->details->extension_attributes,
+        g_hash_table_insert (extension_data->attributes,
                              GINT_TO_POINTER (g_quark_from_string (attribute_name)),
                              g_strdup (value));
     }
@@ -141,6 +141,7 @@ GType                   nautilus_file_get_type                          (void);
 /* Getting at a single file. */
 NautilusFile *          nautilus_file_get                               (GFile                          *location);
 NautilusFile *          nautilus_file_get_by_uri                        (const char                     *uri);
+GList *                 nautilus_file_list_get_by_uris                  (GList                          *uris);
 
 /* Get a file only if the nautilus version already exists */
 NautilusFile *          nautilus_file_get_existing                      (GFile                          *location);
@@ -178,6 +179,10 @@ gboolean                nautilus_file_check_if_ready                    (Nautilu
 void                    nautilus_file_invalidate_attributes             (NautilusFile                   *file,
 									 NautilusFileAttributes          attributes);
 void                    nautilus_file_invalidate_all_attributes         (NautilusFile                   *file);
+/* Load pending attributes of this file before those of its siblings.
+ * Views use this for the rows that are currently on screen.
+ */
+void                    nautilus_file_prioritize_attributes             (NautilusFile                   *file);
 
 /* Basic attributes for file objects. */
 gboolean                nautilus_file_contains_text                     (NautilusFile                   *file);
@@ -187,6 +192,11 @@ char *                  nautilus_file_get_name                          (Nautilu
 GFile *                 nautilus_file_get_location                      (NautilusFile                   *file);
 char *			 nautilus_file_get_description			 (NautilusFile			 *file);
 char *                  nautilus_file_get_uri                           (NautilusFile                   *file);
+/* Borrowed, valid until the file is renamed or moved. Cheap to call
+ * repeatedly, e.g. to compare the URIs of files.
+ */
+const char *            nautilus_file_peek_uri                          (NautilusFile                   *file);
+GFile *                 nautilus_file_peek_location                     (NautilusFile                   *file);
 char *                  nautilus_file_get_uri_scheme                    (NautilusFile                   *file);
 NautilusFile *          nautilus_file_get_parent                        (NautilusFile                   *file);
 GFile *                 nautilus_file_get_parent_location               (NautilusFile                   *file);
@@ -227,6 +237,7 @@ gboolean                nautilus_file_is_in_admin                       (Nautilu
 gboolean                nautilus_file_is_remote                         (NautilusFile                   *file);
 gboolean                nautilus_file_is_other_locations                (NautilusFile                   *file);
 gboolean                nautilus_file_is_starred_location              (NautilusFile                   *file);
+gboolean                nautilus_file_is_starred                        (NautilusFile                   *file);
 gboolean		nautilus_file_is_home				(NautilusFile                   *file);
 GError *                nautilus_file_get_file_info_error               (NautilusFile                   *file);
 gboolean                nautilus_file_get_directory_item_count          (NautilusFile                   *file,
@@ -273,8 +284,19 @@ gboolean                nautilus_file_can_set_group                     (Nautilu
 char *                  nautilus_file_get_owner_name                    (NautilusFile                   *file);
 char *                  nautilus_file_get_group_name                    (NautilusFile                   *file);
 GList *                 nautilus_get_user_names                         (void);
+void                    nautilus_get_user_names_async                   (GCancellable                   *cancellable,
+                                                                         GAsyncReadyCallback             callback,
+                                                                         gpointer                        user_data);
+GList *                 nautilus_get_user_names_finish                  (GAsyncResult                   *result,
+                                                                         GError                        **error);
 GList *                 nautilus_get_all_group_names                    (void);
 GList *                 nautilus_file_get_settable_group_names          (NautilusFile                   *file);
+void                    nautilus_file_get_settable_group_names_async    (NautilusFile                   *file,
+                                                                         GCancellable                   *cancellable,
+                                                                         GAsyncReadyCallback             callback,
+                                                                         gpointer                        user_data);
+GList *                 nautilus_file_get_settable_group_names_finish   (GAsyncResult                   *result,
+                                                                         GError                        **error);
 gboolean                nautilus_file_can_get_selinux_context           (NautilusFile                   *file);
 char *                  nautilus_file_get_selinux_context               (NautilusFile                   *file);
 
@@ -416,6 +438,10 @@ char *                  nautilus_file_get_string_attribute_with_default (Nautilu
 									 const char                     *attribute_name);
 char *                  nautilus_file_get_string_attribute_with_default_q (NautilusFile                  *file,
 									 GQuark                          attribute_q);
+/* Without allocating, see its documentation for how long the result is valid. */
+const char *            nautilus_file_peek_string_attribute_q           (NautilusFile                   *file,
+									 GQuark                          attribute_q,
+									 GString                        *buffer);
 
 /* Matching with another URI. */
 gboolean                nautilus_file_matches_uri                       (NautilusFile                   *file,
@@ -0,0 +1,1218 @@
+/* nautilus-filename-index.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-filename-index.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "nautilus-directory-notify.h"
+#include "nautilus-file.h"
+#include "nautilus-file-utilities.h"
+#include "nautilus-search-hit.h"
+#include "nautilus-ui-utilities.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+/* Bump this whenever the format below changes. */
+#define INDEX_VERSION 2
+
+/* version, build time, show hidden files, recursive, the prune patterns
+ * of the crawl, the sorted paths of
+ * the directories, and for every file: path, display name, mtime, atime
+ * and whether it is a directory. Then the sorted trigrams, and at the same
+ * positions the sorted positions of the files whose names contain them.
+ */
+#define INDEX_FORMAT "(uxbuasasa(ssttb)auaau)"
+#define INDEX_ENTRY_FORMAT "(ssttb)"
+
+/* Crawling smaller trees is fast enough. */
+#define INDEX_MIN_FILES 5000
+
+/* Changes are not notified for the directories nobody is looking at, so
+ * an index is only trusted for this long before the next crawl replaces
+ * it. */
+#define INDEX_MAX_AGE (60 * 60 * G_USEC_PER_SEC)
+
+#define CANCELLABLE_CHECK_INTERVAL 1000
+
+struct NautilusFilenameIndex
+{
+    gint ref_count;
+
+    GFile *root;
+    gint64 build_time;
+    gboolean show_hidden;
+    NautilusQueryRecursive recursive;
+    GStrv prune_patterns;   /* NULL if nothing was pruned */
+
+    GVariant *directories;
+    GVariant *entries;
+    const guint32 *trigrams;
+    gsize n_trigrams;
+    GVariant *trigrams_variant;
+    GVariant *postings;
+
+    /* The changes notified since the index was built */
+    GMutex changes_mutex;
+    /* Relative path -> whether its children are removed as well. Files
+     * that got re-added are also hidden here, as they are in @added. */
+    GHashTable *removed;
+    GHashTable *added;      /* relative path -> NautilusFilenameIndexEntry */
+    /* The added paths whose type wasn't known, taken as not directories */
+    GHashTable *untyped;
+};
+
+/* The loaded indexes, by root URI */
+static GHashTable *indexes = NULL;
+static GMutex indexes_mutex;
+
+NautilusFilenameIndexEntry *
+nautilus_filename_index_entry_new (const char *path,
+                                   const char *display_name,
+                                   guint64     mtime,
+                                   guint64     atime,
+                                   gboolean    is_directory)
+{
+    NautilusFilenameIndexEntry *entry;
+
+    entry = g_new (NautilusFilenameIndexEntry, 1);
+    entry->path = g_strdup (path);
+    entry->display_name = g_strdup (display_name);
+    entry->mtime = mtime;
+    entry->atime = atime;
+    entry->is_directory = is_directory;
+
+    return entry;
+}
+
+void
+nautilus_filename_index_entry_free (NautilusFilenameIndexEntry *entry)
+{
+    g_free (entry->path);
+    g_free (entry->display_name);
+    g_free (entry);
+}
+
+static char *
+get_index_path (GFile *root)
+{
+    g_autofree char *uri = NULL;
+    g_autofree char *checksum = NULL;
+
+    uri = g_file_get_uri (root);
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "filename-indexes",
+                             checksum, NULL);
+}
+
+static inline guint32
+get_trigram (const char *string)
+{
+    return ((guint32) (guchar) string[0] << 16) |
+           ((guint32) (guchar) string[1] << 8) |
+           (guint32) (guchar) string[2];
+}
+
+static NautilusFilenameIndex *
+index_new (GFile    *root,
+           GVariant *data)
+{
+    NautilusFilenameIndex *index;
+    guint32 version;
+    guint32 recursive;
+
+    g_variant_get_child (data, 0, "u", &version);
+    if (version != INDEX_VERSION)
+    {
+        return NULL;
+    }
+
+    index = g_new0 (NautilusFilenameIndex, 1);
+    index->ref_count = 1;
+    index->root = g_object_ref (root);
+    g_variant_get_child (data, 1, "x", &index->build_time);
+    g_variant_get_child (data, 2, "b", &index->show_hidden);
+    g_variant_get_child (data, 3, "u", &recursive);
+    index->recursive = recursive;
+    g_variant_get_child (data, 4, "^as", &index->prune_patterns);
+    if (index->prune_patterns[0] == NULL)
+    {
+        g_clear_pointer (&index->prune_patterns, g_strfreev);
+    }
+    index->directories = g_variant_get_child_value (data, 5);
+    index->entries = g_variant_get_child_value (data, 6);
+    index->trigrams_variant = g_variant_get_child_value (data, 7);
+    index->trigrams = g_variant_get_fixed_array (index->trigrams_variant,
+                                                 &index->n_trigrams,
+                                                 sizeof (guint32));
+    index->postings = g_variant_get_child_value (data, 8);
+
+    g_mutex_init (&index->changes_mutex);
+    index->removed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    index->added = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify) nautilus_filename_index_entry_free);
+    index->untyped = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    if (g_variant_n_children (index->postings) != index->n_trigrams)
+    {
+        nautilus_filename_index_unref (index);
+        return NULL;
+    }
+
+    return index;
+}
+
+NautilusFilenameIndex *
+nautilus_filename_index_ref (NautilusFilenameIndex *index)
+{
+    g_atomic_int_inc (&index->ref_count);
+
+    return index;
+}
+
+void
+nautilus_filename_index_unref (NautilusFilenameIndex *index)
+{
+    if (!g_atomic_int_dec_and_test (&index->ref_count))
+    {
+        return;
+    }
+
+    g_object_unref (index->root);
+    g_strfreev (index->prune_patterns);
+    g_variant_unref (index->directories);
+    g_variant_unref (index->entries);
+    g_variant_unref (index->trigrams_variant);
+    g_variant_unref (index->postings);
+    g_mutex_clear (&index->changes_mutex);
+    g_hash_table_destroy (index->removed);
+    g_hash_table_destroy (index->added);
+    g_hash_table_destroy (index->untyped);
+    g_free (index);
+}
+
+static NautilusFilenameIndex *
+index_load (GFile *root)
+{
+    g_autofree char *path = NULL;
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (GVariant) data = NULL;
+
+    path = get_index_path (root);
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        return NULL;
+    }
+
+    bytes = g_mapped_file_get_bytes (mapped_file);
+    /* Not trusted, so that a corrupted file can't do any harm. */
+    data = g_variant_new_from_bytes (G_VARIANT_TYPE (INDEX_FORMAT), bytes, FALSE);
+
+    DEBUG ("Loaded filename index %s", path);
+
+    return index_new (root, data);
+}
+
+/* Must be called with the indexes mutex held. */
+static void
+ensure_indexes (void)
+{
+    if (indexes == NULL)
+    {
+        indexes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) nautilus_filename_index_unref);
+    }
+}
+
+/* Must be called with the indexes mutex held. */
+static void
+unregister_index (NautilusFilenameIndex *index)
+{
+    g_autofree char *uri = NULL;
+    g_autofree char *path = NULL;
+
+    uri = g_file_get_uri (index->root);
+    path = get_index_path (index->root);
+
+    DEBUG ("Dropping filename index of %s", uri);
+
+    g_unlink (path);
+    g_hash_table_remove (indexes, uri);
+}
+
+static gboolean
+index_is_up_to_date (NautilusFilenameIndex *index)
+{
+    return g_get_real_time () - index->build_time < INDEX_MAX_AGE;
+}
+
+gboolean
+nautilus_filename_index_should_build (NautilusQuery *query)
+{
+    g_autoptr (GFile) location = NULL;
+
+    location = nautilus_query_get_location (query);
+
+    return g_file_is_native (location) &&
+           nautilus_query_get_recursive (query) != NAUTILUS_QUERY_RECURSIVE_NEVER;
+}
+
+static int
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+    return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static int
+compare_trigrams (gconstpointer a,
+                  gconstpointer b)
+{
+    guint32 trigram_a = *(const guint32 *) a;
+    guint32 trigram_b = *(const guint32 *) b;
+
+    return trigram_a < trigram_b ? -1 : trigram_a > trigram_b;
+}
+
+static gboolean
+save_index (GFile    *root,
+            GVariant *data)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *dirname = NULL;
+    g_autoptr (GError) error = NULL;
+
+    path = get_index_path (root);
+    dirname = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dirname, 0700) != 0)
+    {
+        return FALSE;
+    }
+
+    if (!g_file_set_contents (path, g_variant_get_data (data),
+                              g_variant_get_size (data), &error))
+    {
+        DEBUG ("Failed to save filename index: %s", error->message);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+nautilus_filename_index_build (GFile                  *root,
+                               gboolean                show_hidden,
+                               NautilusQueryRecursive  recursive,
+                               const char * const     *prune_patterns,
+                               GPtrArray              *entries)
+{
+    const char * const no_patterns[] = { NULL };
+    g_autoptr (GHashTable) postings = NULL;
+    g_autoptr (GPtrArray) directories = NULL;
+    g_autoptr (GArray) trigrams = NULL;
+    g_autoptr (GVariant) data = NULL;
+    GVariantBuilder entries_builder;
+    GVariantBuilder postings_builder;
+    GHashTableIter iter;
+    gpointer trigram;
+    NautilusFilenameIndex *index;
+    NautilusFilenameIndexEntry *entry;
+    GArray *ids;
+    gsize length;
+    guint32 id;
+
+    if (entries->len < INDEX_MIN_FILES)
+    {
+        g_ptr_array_unref (entries);
+        return;
+    }
+
+    postings = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_array_unref);
+    directories = g_ptr_array_new ();
+
+    g_variant_builder_init (&entries_builder, G_VARIANT_TYPE ("a" INDEX_ENTRY_FORMAT));
+    for (id = 0; id < entries->len; id++)
+    {
+        g_autofree char *prepared = NULL;
+
+        entry = g_ptr_array_index (entries, id);
+        g_variant_builder_add (&entries_builder, INDEX_ENTRY_FORMAT,
+                               entry->path, entry->display_name,
+                               entry->mtime, entry->atime, entry->is_directory);
+        if (entry->is_directory)
+        {
+            g_ptr_array_add (directories, entry->path);
+        }
+
+        prepared = nautilus_query_prepare_string (entry->display_name);
+        length = strlen (prepared);
+        for (gsize i = 0; i + 3 <= length; i++)
+        {
+            trigram = GUINT_TO_POINTER (get_trigram (prepared + i));
+            ids = g_hash_table_lookup (postings, trigram);
+            if (ids == NULL)
+            {
+                ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+                g_hash_table_insert (postings, trigram, ids);
+            }
+            /* Entries are added in order, so the lists stay sorted. */
+            if (ids->len == 0 || g_array_index (ids, guint32, ids->len - 1) != id)
+            {
+                g_array_append_val (ids, id);
+            }
+        }
+    }
+
+    g_ptr_array_sort (directories, compare_strings);
+
+    trigrams = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+                                  g_hash_table_size (postings));
+    g_hash_table_iter_init (&iter, postings);
+    while (g_hash_table_iter_next (&iter, &trigram, NULL))
+    {
+        guint32 value = GPOINTER_TO_UINT (trigram);
+
+        g_array_append_val (trigrams, value);
+    }
+    g_array_sort (trigrams, compare_trigrams);
+
+    g_variant_builder_init (&postings_builder, G_VARIANT_TYPE ("aau"));
+    for (guint i = 0; i < trigrams->len; i++)
+    {
+        ids = g_hash_table_lookup (postings,
+                                   GUINT_TO_POINTER (g_array_index (trigrams, guint32, i)));
+        g_variant_builder_add_value (&postings_builder,
+                                     g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                                ids->data, ids->len,
+                                                                sizeof (guint32)));
+    }
+
+    data = g_variant_ref_sink (g_variant_new ("(uxbu^as@as@a(ssttb)@au@aau)",
+                                              INDEX_VERSION,
+                                              g_get_real_time (),
+                                              show_hidden,
+                                              (guint32) recursive,
+                                              prune_patterns != NULL ? prune_patterns : no_patterns,
+                                              g_variant_new_strv ((const char * const *) directories->pdata,
+                                                                  directories->len),
+                                              g_variant_builder_end (&entries_builder),
+                                              g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                                         trigrams->data,
+                                                                         trigrams->len,
+                                                                         sizeof (guint32)),
+                                              g_variant_builder_end (&postings_builder)));
+
+    g_clear_pointer (&postings, g_hash_table_unref);
+    g_clear_pointer (&directories, g_ptr_array_unref);
+    g_ptr_array_unref (entries);
+
+    save_index (root, data);
+
+    index = index_new (root, data);
+    if (index == NULL)
+    {
+        return;
+    }
+
+    DEBUG ("Built filename index of %" G_GSIZE_FORMAT " files and %" G_GSIZE_FORMAT " trigrams",
+           g_variant_n_children (index->entries), index->n_trigrams);
+
+    g_mutex_lock (&indexes_mutex);
+    ensure_indexes ();
+    g_hash_table_insert (indexes, g_file_get_uri (root), index);
+    g_mutex_unlock (&indexes_mutex);
+}
+
+static gboolean
+prune_patterns_equal (GStrv a,
+                      GStrv b)
+{
+    if (a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+
+    return g_strv_equal ((const char * const *) a, (const char * const *) b);
+}
+
+NautilusFilenameIndex *
+nautilus_filename_index_lookup (NautilusQuery *query)
+{
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (GPtrArray) mime_types = NULL;
+    g_autoptr (GPtrArray) date_range = NULL;
+    g_autofree char *uri = NULL;
+    g_auto (GStrv) prune_patterns = NULL;
+    NautilusFilenameIndex *index;
+    gboolean usable;
+
+    if (!nautilus_filename_index_should_build (query))
+    {
+        return NULL;
+    }
+
+    /* Neither are the contents of the files, nor their types. */
+    if (nautilus_query_get_search_content (query) == NAUTILUS_QUERY_SEARCH_CONTENT_FULL_TEXT)
+    {
+        return NULL;
+    }
+
+    mime_types = nautilus_query_get_mime_types (query);
+    if (mime_types->len > 0)
+    {
+        return NULL;
+    }
+
+    location = nautilus_query_get_location (query);
+    uri = g_file_get_uri (location);
+
+    g_mutex_lock (&indexes_mutex);
+    ensure_indexes ();
+
+    index = g_hash_table_lookup (indexes, uri);
+    if (index == NULL)
+    {
+        index = index_load (location);
+        if (index != NULL)
+        {
+            g_hash_table_insert (indexes, g_strdup (uri), index);
+        }
+    }
+
+    if (index != NULL && !index_is_up_to_date (index))
+    {
+        unregister_index (index);
+        index = NULL;
+    }
+
+    prune_patterns = nautilus_query_get_prune_patterns (query);
+    usable = index != NULL &&
+             index->show_hidden == nautilus_query_get_show_hidden_files (query) &&
+             index->recursive == nautilus_query_get_recursive (query) &&
+             prune_patterns_equal (index->prune_patterns, prune_patterns);
+
+    /* The dates of the added files are not known. */
+    date_range = nautilus_query_get_date_range (query);
+    if (usable && date_range != NULL)
+    {
+        g_mutex_lock (&index->changes_mutex);
+        usable = g_hash_table_size (index->added) == 0;
+        g_mutex_unlock (&index->changes_mutex);
+    }
+
+    if (usable)
+    {
+        nautilus_filename_index_ref (index);
+    }
+    g_mutex_unlock (&indexes_mutex);
+
+    return usable ? index : NULL;
+}
+
+/* @removed is the removed set of an index, or a copy of it. */
+static gboolean
+is_removed (GHashTable *removed,
+            const char *path)
+{
+    g_autofree char *parent = NULL;
+    gpointer with_children;
+    char *separator;
+
+    if (g_hash_table_size (removed) == 0)
+    {
+        return FALSE;
+    }
+
+    if (g_hash_table_contains (removed, path))
+    {
+        return TRUE;
+    }
+
+    parent = g_strdup (path);
+    while ((separator = strrchr (parent, G_DIR_SEPARATOR)) != NULL)
+    {
+        *separator = '\0';
+        if (g_hash_table_lookup_extended (removed, parent, NULL, &with_children) &&
+            GPOINTER_TO_INT (with_children))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+typedef struct
+{
+    const guint32 *ids;
+    gsize n_ids;
+} PostingList;
+
+static int
+compare_posting_lengths (gconstpointer a,
+                         gconstpointer b)
+{
+    const PostingList *list_a = a;
+    const PostingList *list_b = b;
+
+    return list_a->n_ids < list_b->n_ids ? -1 : list_a->n_ids > list_b->n_ids;
+}
+
+static gboolean
+find_posting_list (NautilusFilenameIndex *index,
+                   guint32                trigram,
+                   GPtrArray             *variants,
+                   PostingList           *list)
+{
+    GVariant *variant;
+    gsize low, high, middle;
+
+    low = 0;
+    high = index->n_trigrams;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (index->trigrams[middle] < trigram)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low == index->n_trigrams || index->trigrams[low] != trigram)
+    {
+        return FALSE;
+    }
+
+    /* The list points into the variant, which is kept around with it. */
+    variant = g_variant_get_child_value (index->postings, low);
+    g_ptr_array_add (variants, variant);
+    list->ids = g_variant_get_fixed_array (variant, &list->n_ids, sizeof (guint32));
+
+    return TRUE;
+}
+
+/* Returns the sorted positions of the files that may match all the
+ * words, or NULL if no word is long enough to tell. */
+static GArray *
+get_candidates (NautilusFilenameIndex *index,
+                const char * const    *words)
+{
+    g_autoptr (GArray) lists = NULL;
+    g_autoptr (GPtrArray) variants = NULL;
+    PostingList list;
+    GArray *candidates;
+    gsize length, kept, position;
+
+    lists = g_array_new (FALSE, FALSE, sizeof (PostingList));
+    variants = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+
+    for (guint i = 0; words != NULL && words[i] != NULL; i++)
+    {
+        length = strlen (words[i]);
+        for (gsize j = 0; j + 3 <= length; j++)
+        {
+            if (!find_posting_list (index, get_trigram (words[i] + j), variants, &list))
+            {
+                /* No file has this trigram. */
+                return g_array_new (FALSE, FALSE, sizeof (guint32));
+            }
+            g_array_append_val (lists, list);
+        }
+    }
+
+    if (lists->len == 0)
+    {
+        return NULL;
+    }
+
+    /* Intersect starting from the shortest list, so that the others are
+     * only searched for the few candidates left. */
+    g_array_sort (lists, compare_posting_lengths);
+    list = g_array_index (lists, PostingList, 0);
+    candidates = g_array_sized_new (FALSE, FALSE, sizeof (guint32), list.n_ids);
+    g_array_append_vals (candidates, list.ids, list.n_ids);
+
+    for (guint i = 1; i < lists->len && candidates->len > 0; i++)
+    {
+        list = g_array_index (lists, PostingList, i);
+        kept = 0;
+        position = 0;
+        for (guint j = 0; j < candidates->len; j++)
+        {
+            guint32 id = g_array_index (candidates, guint32, j);
+            gsize low = position, high = list.n_ids, middle;
+
+            while (low < high)
+            {
+                middle = low + (high - low) / 2;
+                if (list.ids[middle] < id)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            position = low;
+
+            if (position < list.n_ids && list.ids[position] == id)
+            {
+                g_array_index (candidates, guint32, kept++) = id;
+            }
+        }
+        g_array_set_size (candidates, kept);
+    }
+
+    return candidates;
+}
+
+typedef struct
+{
+    NautilusFilenameIndex *index;
+    NautilusQueryMatcher *matcher;
+    NautilusQuerySearchType type;
+    GPtrArray *date_range;
+    GList *hits;
+} SearchData;
+
+static void
+search_entry (SearchData *data,
+              const char *path,
+              const char *display_name,
+              guint64     mtime,
+              guint64     atime)
+{
+    NautilusSearchHit *hit;
+    g_autoptr (GFile) file = NULL;
+    g_autofree char *uri = NULL;
+    g_autoptr (GDateTime) date = NULL;
+    gdouble match;
+
+    match = nautilus_query_matcher_match (data->matcher, display_name);
+    if (match <= -1)
+    {
+        return;
+    }
+
+    if (data->date_range != NULL &&
+        !nautilus_file_date_in_between (data->type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS ?
+                                        atime : mtime,
+                                        g_ptr_array_index (data->date_range, 0),
+                                        g_ptr_array_index (data->date_range, 1)))
+    {
+        return;
+    }
+
+    file = g_file_resolve_relative_path (data->index->root, path);
+    uri = g_file_get_uri (file);
+    hit = nautilus_search_hit_new (uri);
+    nautilus_search_hit_set_fts_rank (hit, match);
+    if (mtime != 0)
+    {
+        date = g_date_time_new_from_unix_local (mtime);
+        nautilus_search_hit_set_modification_time (hit, date);
+    }
+
+    data->hits = g_list_prepend (data->hits, hit);
+}
+
+/* The changes are copied, so that the notifications coming from the main
+ * thread don't wait for the whole search. There are few of them, as the
+ * index is replaced once it gets old. */
+static void
+copy_changes (NautilusFilenameIndex  *index,
+              GHashTable            **removed,
+              GPtrArray             **added)
+{
+    NautilusFilenameIndexEntry *entry;
+    GHashTableIter iter;
+    gpointer path, with_children;
+
+    *removed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    *added = g_ptr_array_new_with_free_func ((GDestroyNotify) nautilus_filename_index_entry_free);
+
+    g_mutex_lock (&index->changes_mutex);
+    g_hash_table_iter_init (&iter, index->removed);
+    while (g_hash_table_iter_next (&iter, &path, &with_children))
+    {
+        g_hash_table_insert (*removed, g_strdup (path), with_children);
+    }
+
+    g_hash_table_iter_init (&iter, index->added);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+        g_ptr_array_add (*added,
+                         nautilus_filename_index_entry_new (entry->path, entry->display_name,
+                                                            entry->mtime, entry->atime,
+                                                            entry->is_directory));
+    }
+    g_mutex_unlock (&index->changes_mutex);
+}
+
+GList *
+nautilus_filename_index_search (NautilusFilenameIndex *index,
+                                NautilusQuery         *query,
+                                GCancellable          *cancellable)
+{
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+    g_autoptr (GPtrArray) date_range = NULL;
+    g_autoptr (GArray) candidates = NULL;
+    g_autoptr (GHashTable) removed = NULL;
+    g_autoptr (GPtrArray) added = NULL;
+    SearchData data = { 0 };
+    const char *path, *display_name;
+    guint64 mtime, atime;
+    gboolean is_directory;
+    NautilusFilenameIndexEntry *entry;
+    gsize n_entries, n_candidates;
+    guint32 id;
+
+    matcher = nautilus_query_get_matcher (query);
+    date_range = nautilus_query_get_date_range (query);
+
+    data.index = index;
+    data.matcher = matcher;
+    data.type = nautilus_query_get_search_type (query);
+    data.date_range = date_range;
+
+    candidates = get_candidates (index, nautilus_query_matcher_get_words (matcher));
+    n_entries = g_variant_n_children (index->entries);
+    n_candidates = candidates != NULL ? candidates->len : n_entries;
+
+    copy_changes (index, &removed, &added);
+    for (gsize i = 0; i < n_candidates; i++)
+    {
+        if (i % CANCELLABLE_CHECK_INTERVAL == 0 &&
+            g_cancellable_is_cancelled (cancellable))
+        {
+            break;
+        }
+
+        id = candidates != NULL ? g_array_index (candidates, guint32, i) : i;
+        /* The file could be corrupted. */
+        if (id >= n_entries)
+        {
+            continue;
+        }
+
+        g_variant_get_child (index->entries, id, "(&s&sttb)",
+                             &path, &display_name, &mtime, &atime, &is_directory);
+        if (!is_removed (removed, path))
+        {
+            search_entry (&data, path, display_name, mtime, atime);
+        }
+    }
+
+    for (guint i = 0; i < added->len; i++)
+    {
+        entry = g_ptr_array_index (added, i);
+        search_entry (&data, entry->path, entry->display_name, entry->mtime, entry->atime);
+    }
+
+    DEBUG ("Filename index search looked at %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " files",
+           n_candidates, n_entries);
+
+    return data.hits;
+}
+
+static gboolean
+is_indexed_directory (NautilusFilenameIndex *index,
+                      const char            *path)
+{
+    NautilusFilenameIndexEntry *entry;
+    const char *directory;
+    gsize low, high, middle;
+    int result;
+
+    entry = g_hash_table_lookup (index->added, path);
+    if (entry != NULL)
+    {
+        return entry->is_directory;
+    }
+
+    low = 0;
+    high = g_variant_n_children (index->directories);
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        g_variant_get_child (index->directories, middle, "&s", &directory);
+        result = strcmp (directory, path);
+        if (result == 0)
+        {
+            return TRUE;
+        }
+        else if (result < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Must be called with the changes mutex held. */
+static void
+remove_path (NautilusFilenameIndex *index,
+             const char            *path)
+{
+    GHashTableIter iter;
+    const char *added_path;
+    gsize length;
+
+    g_hash_table_insert (index->removed, g_strdup (path), GINT_TO_POINTER (TRUE));
+
+    length = strlen (path);
+    g_hash_table_iter_init (&iter, index->added);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &added_path, NULL))
+    {
+        if (strncmp (added_path, path, length) == 0 &&
+            (added_path[length] == '\0' || added_path[length] == G_DIR_SEPARATOR))
+        {
+            g_hash_table_remove (index->untyped, added_path);
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+}
+
+/* Whether @path is below a folder the crawl didn't descend into */
+static gboolean
+is_pruned (NautilusFilenameIndex *index,
+           const char            *path)
+{
+    g_auto (GStrv) components = NULL;
+
+    if (index->prune_patterns == NULL)
+    {
+        return FALSE;
+    }
+
+    components = g_strsplit (path, G_DIR_SEPARATOR_S, -1);
+    /* The last component is the file itself, which is still listed. */
+    for (guint i = 0; components[i] != NULL && components[i + 1] != NULL; i++)
+    {
+        if (nautilus_prune_patterns_match ((const char * const *) index->prune_patterns,
+                                           components[i]))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Must be called with the changes mutex held. @type is
+ * G_FILE_TYPE_UNKNOWN when it isn't known, and only tells whether it is
+ * a directory otherwise. Returns whether the file is listed. */
+static gboolean
+add_path (NautilusFilenameIndex *index,
+          GFile                 *file,
+          const char            *path,
+          GFileType              type)
+{
+    NautilusFilenameIndexEntry *entry;
+    g_autofree char *basename = NULL;
+    g_autofree char *display_name = NULL;
+
+    basename = g_file_get_basename (file);
+    if (!index->show_hidden &&
+        (basename[0] == '.' || g_str_has_suffix (basename, "~")))
+    {
+        return FALSE;
+    }
+
+    if (is_pruned (index, path))
+    {
+        return FALSE;
+    }
+
+    display_name = g_filename_display_name (basename);
+    /* Hides the file if it is in the index already */
+    if (!g_hash_table_contains (index->removed, path))
+    {
+        g_hash_table_insert (index->removed, g_strdup (path), GINT_TO_POINTER (FALSE));
+    }
+    entry = nautilus_filename_index_entry_new (path, display_name, 0, 0,
+                                               type == G_FILE_TYPE_DIRECTORY);
+    g_hash_table_insert (index->added, entry->path, entry);
+    if (type == G_FILE_TYPE_UNKNOWN)
+    {
+        g_hash_table_add (index->untyped, g_strdup (path));
+    }
+    else
+    {
+        g_hash_table_remove (index->untyped, path);
+    }
+
+    return TRUE;
+}
+
+/* The notifications come from the main thread, so the type is taken from
+ * the NautilusFile rather than asked for, and is often not known yet for
+ * the new files. It only matters once they are moved. */
+static GFileType
+get_known_type (GFile *location)
+{
+    g_autoptr (NautilusFile) file = NULL;
+
+    file = nautilus_file_get_existing (location);
+
+    return file != NULL ? nautilus_file_get_file_type (file) : G_FILE_TYPE_UNKNOWN;
+}
+
+/* Must be called with the changes mutex held. */
+static GFileType
+get_indexed_type (NautilusFilenameIndex *index,
+                  const char            *path)
+{
+    if (g_hash_table_contains (index->untyped, path))
+    {
+        return G_FILE_TYPE_UNKNOWN;
+    }
+
+    /* Any type but a directory would do */
+    return is_indexed_directory (index, path) ? G_FILE_TYPE_DIRECTORY : G_FILE_TYPE_REGULAR;
+}
+
+typedef struct
+{
+    NautilusFilenameIndex *index;
+    char *path;
+} TypeCheck;
+
+/* For a file of unknown type that got moved: a directory gets the index
+ * dropped, as its files were not notified. */
+static void
+type_checked (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+    TypeCheck *check = user_data;
+    g_autoptr (GFileInfo) info = NULL;
+    g_autofree char *uri = NULL;
+
+    info = g_file_query_info_finish (G_FILE (source_object), result, NULL);
+    uri = g_file_get_uri (check->index->root);
+
+    g_mutex_lock (&indexes_mutex);
+    if (info != NULL && indexes != NULL &&
+        g_hash_table_lookup (indexes, uri) == check->index)
+    {
+        if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        {
+            unregister_index (check->index);
+        }
+        else
+        {
+            g_mutex_lock (&check->index->changes_mutex);
+            g_hash_table_remove (check->index->untyped, check->path);
+            g_mutex_unlock (&check->index->changes_mutex);
+        }
+    }
+    g_mutex_unlock (&indexes_mutex);
+
+    nautilus_filename_index_unref (check->index);
+    g_free (check->path);
+    g_free (check);
+}
+
+static void
+check_type (NautilusFilenameIndex *index,
+            GFile                 *location,
+            const char            *path)
+{
+    TypeCheck *check;
+
+    check = g_new0 (TypeCheck, 1);
+    check->index = nautilus_filename_index_ref (index);
+    check->path = g_strdup (path);
+
+    g_file_query_info_async (location, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, G_PRIORITY_DEFAULT,
+                             NULL, type_checked, check);
+}
+
+static char *
+get_relative_path (NautilusFilenameIndex *index,
+                   GFile                 *file)
+{
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    return g_file_get_relative_path (index->root, file);
+}
+
+void
+nautilus_filename_index_notify_files_added (GList *files)
+{
+    NautilusFilenameIndex *index;
+    GHashTableIter iter;
+
+    g_mutex_lock (&indexes_mutex);
+    if (indexes != NULL)
+    {
+        g_hash_table_iter_init (&iter, indexes);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &index))
+        {
+            g_mutex_lock (&index->changes_mutex);
+            for (GList *l = files; l != NULL; l = l->next)
+            {
+                g_autofree char *path = get_relative_path (index, l->data);
+
+                if (path != NULL)
+                {
+                    /* Copied directories get their files notified too. */
+                    add_path (index, l->data, path, get_known_type (l->data));
+                }
+            }
+            g_mutex_unlock (&index->changes_mutex);
+        }
+    }
+    g_mutex_unlock (&indexes_mutex);
+}
+
+void
+nautilus_filename_index_notify_files_removed (GList *files)
+{
+    NautilusFilenameIndex *index;
+    GHashTableIter iter;
+
+    g_mutex_lock (&indexes_mutex);
+    if (indexes != NULL)
+    {
+        g_hash_table_iter_init (&iter, indexes);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &index))
+        {
+            g_mutex_lock (&index->changes_mutex);
+            for (GList *l = files; l != NULL; l = l->next)
+            {
+                g_autofree char *path = get_relative_path (index, l->data);
+
+                if (path != NULL)
+                {
+                    remove_path (index, path);
+                }
+            }
+            g_mutex_unlock (&index->changes_mutex);
+        }
+    }
+    g_mutex_unlock (&indexes_mutex);
+}
+
+typedef struct
+{
+    NautilusFilenameIndex *index;
+    GFile *location;
+    char *path;
+} PendingTypeCheck;
+
+void
+nautilus_filename_index_notify_files_moved (GList *file_pairs)
+{
+    g_autoptr (GList) stale_indexes = NULL;
+    g_autoptr (GArray) type_checks = NULL;
+    NautilusFilenameIndex *index;
+    GHashTableIter iter;
+    GFilePair *pair;
+    gboolean stale;
+
+    type_checks = g_array_new (FALSE, FALSE, sizeof (PendingTypeCheck));
+
+    g_mutex_lock (&indexes_mutex);
+    if (indexes != NULL)
+    {
+        g_hash_table_iter_init (&iter, indexes);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &index))
+        {
+            stale = FALSE;
+
+            g_mutex_lock (&index->changes_mutex);
+            for (GList *l = file_pairs; l != NULL && !stale; l = l->next)
+            {
+                g_autofree char *from_path = NULL;
+                g_autofree char *to_path = NULL;
+                GFileType type;
+
+                pair = l->data;
+                from_path = get_relative_path (index, pair->from);
+                to_path = get_relative_path (index, pair->to);
+                if (from_path == NULL && to_path == NULL)
+                {
+                    continue;
+                }
+
+                /* The file is still known by its old location here. */
+                type = from_path != NULL ?
+                       get_indexed_type (index, from_path) :
+                       get_known_type (pair->from);
+                if (from_path != NULL)
+                {
+                    remove_path (index, from_path);
+                }
+                if (to_path != NULL)
+                {
+                    /* The files of a moved directory are not notified, so
+                     * the index can't follow them. */
+                    stale = type == G_FILE_TYPE_DIRECTORY;
+                    if (add_path (index, pair->to, to_path, type) &&
+                        type == G_FILE_TYPE_UNKNOWN)
+                    {
+                        PendingTypeCheck check = { index, pair->to, g_steal_pointer (&to_path) };
+
+                        g_array_append_val (type_checks, check);
+                    }
+                }
+            }
+            g_mutex_unlock (&index->changes_mutex);
+
+            if (stale)
+            {
+                stale_indexes = g_list_prepend (stale_indexes, index);
+            }
+        }
+
+        /* Started before the indexes may go away */
+        for (guint i = 0; i < type_checks->len; i++)
+        {
+            PendingTypeCheck *check = &g_array_index (type_checks, PendingTypeCheck, i);
+
+            check_type (check->index, check->location, check->path);
+            g_free (check->path);
+        }
+
+        for (GList *l = stale_indexes; l != NULL; l = l->next)
+        {
+            unregister_index (l->data);
+        }
+    }
+    g_mutex_unlock (&indexes_mutex);
+}
@@ -0,0 +1,77 @@
+/* nautilus-filename-index.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "nautilus-query.h"
+
+/* A filename index is a list of every file below a search location,
+ * together with posting lists mapping each trigram of the file names to
+ * the files containing it, so that a substring search only has to look
+ * at the files having all the trigrams of the query words.
+ *
+ * An index is built from a full crawl of the simple search engine, and
+ * stored on disk in a form that can be used right away once mapped. The
+ * file changes notified afterwards are kept in memory on top of it, until
+ * the index gets too old and the next crawl replaces it.
+ */
+
+typedef struct NautilusFilenameIndex NautilusFilenameIndex;
+
+typedef struct
+{
+    char *path;             /* relative to the root of the index */
+    char *display_name;
+    guint64 mtime;
+    guint64 atime;
+    gboolean is_directory;
+} NautilusFilenameIndexEntry;
+
+NautilusFilenameIndexEntry *nautilus_filename_index_entry_new  (const char *path,
+                                                                const char *display_name,
+                                                                guint64     mtime,
+                                                                guint64     atime,
+                                                                gboolean    is_directory);
+void                        nautilus_filename_index_entry_free (NautilusFilenameIndexEntry *entry);
+
+/* Whether crawls of @query should be turned into an index. */
+gboolean               nautilus_filename_index_should_build (NautilusQuery *query);
+/* Builds, registers and saves the index of @root, taking ownership of
+ * @entries. This is slow and done in a search thread. */
+void                   nautilus_filename_index_build        (GFile                  *root,
+                                                             gboolean                show_hidden,
+                                                             NautilusQueryRecursive  recursive,
+                                                             const char * const     *prune_patterns,
+                                                             GPtrArray              *entries);
+
+/* Returns a reference to an up to date index that can answer @query on
+ * its own, or NULL. */
+NautilusFilenameIndex *nautilus_filename_index_lookup       (NautilusQuery *query);
+NautilusFilenameIndex *nautilus_filename_index_ref          (NautilusFilenameIndex *index);
+void                   nautilus_filename_index_unref        (NautilusFilenameIndex *index);
+/* Returns a list of NautilusSearchHit. Can be called from any thread. */
+GList                 *nautilus_filename_index_search       (NautilusFilenameIndex *index,
+                                                             NautilusQuery         *query,
+                                                             GCancellable          *cancellable);
+
+/* Keeps the loaded indexes up to date with the changes made to the files. */
+void                   nautilus_filename_index_notify_files_added   (GList *files);
+void                   nautilus_filename_index_notify_files_removed (GList *files);
+void                   nautilus_filename_index_notify_files_moved   (GList *file_pairs);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusFilenameIndex, nautilus_filename_index_unref)
@@ -55,6 +55,7 @@
 #include "nautilus-clipboard.h"
 #include "nautilus-compress-dialog-controller.h"
 #include "nautilus-directory.h"
+#include "nautilus-directory-menu.h"
 #include "nautilus-dnd.h"
 #include "nautilus-enums.h"
 #include "nautilus-error-reporting.h"
@@ -74,6 +75,7 @@
 #include "nautilus-mime-actions.h"
 #include "nautilus-module.h"
 #include "nautilus-new-folder-dialog-controller.h"
+#include "nautilus-parallel-sort.h"
 #include "nautilus-previewer.h"
 #include "nautilus-profile.h"
 #include "nautilus-program-choosing.h"
@@ -82,6 +84,7 @@
 #include "nautilus-search-directory.h"
 #include "nautilus-signaller.h"
 #include "nautilus-tag-manager.h"
+#include "nautilus-thumbnails.h"
 #include "nautilus-toolbar.h"
 #include "nautilus-trash-monitor.h"
 #include "nautilus-ui-utilities.h"
@@ -111,12 +114,18 @@
 #define DUPLICATE_HORIZONTAL_ICON_OFFSET 70
 #define DUPLICATE_VERTICAL_ICON_OFFSET   30
 
+/* Number of pending files added to the view in the first frame. Later
+ * frames adapt it to DISPLAY_PENDING_FRAME_BUDGET. */
 #define MAX_QUEUED_UPDATES 500
+/* Microseconds of each frame spent adding pending files to the view,
+ * leaving the rest for drawing and input. */
+#define DISPLAY_PENDING_FRAME_BUDGET 8000
+#define DISPLAY_PENDING_MIN_CHUNK 50
+#define DISPLAY_PENDING_MAX_CHUNK 20000
 
-#define MAX_MENU_LEVELS 5
-#define TEMPLATE_LIMIT 30
-
-#define SHORTCUTS_PATH "/nautilus/scripts-accels"
+/* Up to this many selected folders get their deep size computed for the
+ * status. */
+#define SELECTION_DEEP_COUNT_MAX_FOLDERS 10
 
 /* Delay to show the Loading... floating bar */
 #define FLOATING_BAR_LOADING_DELAY 200 /* ms */
@@ -155,12 +164,30 @@ enum
     NUM_PROPERTIES
 };
 
-static guint signals[LAST_SIGNAL];
-
-static char *scripts_directory_uri = NULL;
-static int scripts_directory_uri_length;
+/* What the files of the selection can do, counted by the selection stats
+ * so that the actions don't look at every selected file each time. */
+typedef enum
+{
+    SELECTION_CAN_DELETE,
+    SELECTION_CAN_TRASH,
+    SELECTION_CAN_RENAME,
+    SELECTION_IS_HOME,
+    SELECTION_IS_IN_TRASH,
+    SELECTION_IS_ARCHIVE,
+    SELECTION_EXTRACTS,
+    SELECTION_LAUNCHES,
+    SELECTION_OPENS_IN_EXTERNAL_APP,
+    SELECTION_OPENS_IN_VIEW,
+    SELECTION_SHOWS_MOUNT,
+    SELECTION_SHOWS_UNMOUNT,
+    SELECTION_SHOWS_EJECT,
+    SELECTION_SHOWS_START,
+    SELECTION_SHOWS_STOP,
+    SELECTION_SHOWS_DETECT_MEDIA,
+    N_SELECTION_CAPABILITIES
+} SelectionCapability;
 
-static GHashTable *script_accels = NULL;
+static guint signals[LAST_SIGNAL];
 
 typedef struct
 {
@@ -181,17 +208,22 @@ typedef struct
 
     gboolean supports_zooming;
 
-    GList *scripts_directory_list;
-    GList *templates_directory_list;
 
     guint display_selection_idle_id;
+    guint display_selection_tick_id;
     guint update_context_menus_timeout_id;
     guint update_status_idle_id;
     guint reveal_selection_idle_id;
 
     guint display_pending_source_id;
+    guint display_pending_tick_id;
+    guint display_pending_chunk_size;
     guint changes_timeout_id;
 
+    /* While tracing, to record the slow frames of the view */
+    GdkFrameClock *trace_frame_clock;
+    gulong trace_after_paint_id;
+
     guint update_interval;
     guint64 last_queued;
 
@@ -206,11 +238,33 @@ typedef struct
     GList *new_changed_files;
     GHashTable *non_ready_files;
     GList *old_added_files;
-    GList *old_changed_files;
+    /* A set, so that a file changing over and over is only sent once */
+    GHashTable *old_changed_files;
+    /* The files changed while the view is suspended, coalesced the same
+     * way until it is shown again */
+    GHashTable *suspended_changed_files;
 
     GList *pending_selection;
     GHashTable *pending_reveal;
 
+    /* Running totals of the selection for the status, updated with the
+     * files that entered or left the selection since the last time.
+     * NautilusFile -> SelectionStatsEntry */
+    GHashTable *selection_stats;
+    guint selection_stats_generation;
+    guint selection_folder_count;
+    guint selection_folder_item_count;
+    guint selection_folders_without_item_count;
+    guint selection_non_folder_count;
+    guint selection_non_folder_sizes_known;
+    goffset selection_non_folder_size;
+    /* Selected files with each SelectionCapability */
+    guint selection_capability_counts[N_SELECTION_CAPABILITIES];
+    guint selection_starred_count;
+    guint selection_starred_generation;
+    /* Selected folders being deep counted */
+    GHashTable *selection_deep_count_files;
+
     /* whether we are in the active slot */
     gboolean active;
 
@@ -242,6 +296,9 @@ typedef struct
 
     GMenu *selection_menu_model;
     GMenu *background_menu_model;
+    /* Where the Open With <App> item goes, until the selection menu is
+     * shown and the default application has been looked up */
+    GMenu *pending_open_with_section;
 
     GtkWidget *selection_menu;
     GtkWidget *background_menu;
@@ -323,6 +380,7 @@ static void     reset_update_interval (NautilusFilesView *view);
 static void     schedule_idle_display_of_pending_files (NautilusFilesView *view);
 static void     unschedule_display_of_pending_files (NautilusFilesView *view);
 static void     disconnect_model_handlers (NautilusFilesView *view);
+static void     clear_selection_stats (NautilusFilesView *view);
 static void     metadata_for_directory_as_file_ready_callback (NautilusFile *file,
                                                                gpointer      callback_data);
 static void     metadata_for_files_in_directory_ready_callback (NautilusDirectory *directory,
@@ -334,7 +392,6 @@ static void     nautilus_files_view_trash_state_changed_callback (NautilusTrashM
 static void     nautilus_files_view_select_file (NautilusFilesView *view,
                                                  NautilusFile      *file);
 
-static void     update_templates_directory (NautilusFilesView *view);
 
 static void     extract_files (NautilusFilesView *view,
                                GList             *files,
@@ -1030,17 +1087,19 @@ nautilus_files_view_get_selection (NautilusView *view)
     return NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->get_selection (NAUTILUS_FILES_VIEW (view));
 }
 
+/* What a selected file adds to the selection totals */
 typedef struct
 {
-    NautilusFile *file;
-    NautilusFilesView *directory_view;
-} ScriptLaunchParameters;
-
-typedef struct
-{
-    NautilusFile *file;
-    NautilusFilesView *directory_view;
-} CreateTemplateParameters;
+    guint generation;
+    gboolean is_folder;
+    gboolean item_count_known;
+    guint item_count;
+    gboolean size_known;
+    goffset size;
+    guint capabilities;
+    GDriveStartStopType start_stop_type;
+    gboolean is_starred;
+} SelectionStatsEntry;
 
 static FileAndDirectory *
 file_and_directory_new (NautilusFile      *file,
@@ -1055,14 +1114,6 @@ file_and_directory_new (NautilusFile      *file,
     return fad;
 }
 
-static NautilusFile *
-file_and_directory_get_file (FileAndDirectory *fad)
-{
-    g_return_val_if_fail (fad != NULL, NULL);
-
-    return nautilus_file_ref (fad->file);
-}
-
 static void
 file_and_directory_free (gpointer data)
 {
@@ -1096,46 +1147,13 @@ file_and_directory_hash  (gconstpointer v)
     return GPOINTER_TO_UINT (fad->file) ^ GPOINTER_TO_UINT (fad->directory);
 }
 
-static ScriptLaunchParameters *
-script_launch_parameters_new (NautilusFile      *file,
-                              NautilusFilesView *directory_view)
-{
-    ScriptLaunchParameters *result;
-
-    result = g_new0 (ScriptLaunchParameters, 1);
-    result->directory_view = directory_view;
-    nautilus_file_ref (file);
-    result->file = file;
-
-    return result;
-}
-
-static void
-script_launch_parameters_free (ScriptLaunchParameters *parameters)
-{
-    nautilus_file_unref (parameters->file);
-    g_free (parameters);
-}
-
-static CreateTemplateParameters *
-create_template_parameters_new (NautilusFile      *file,
-                                NautilusFilesView *directory_view)
-{
-    CreateTemplateParameters *result;
-
-    result = g_new0 (CreateTemplateParameters, 1);
-    result->directory_view = directory_view;
-    nautilus_file_ref (file);
-    result->file = file;
-
-    return result;
-}
-
-static void
-create_templates_parameters_free (CreateTemplateParameters *parameters)
+static GHashTable *
+file_and_directory_set_new (void)
 {
-    nautilus_file_unref (parameters->file);
-    g_free (parameters);
+    return g_hash_table_new_full (file_and_directory_hash,
+                                  file_and_directory_equal,
+                                  file_and_directory_free,
+                                  NULL);
 }
 
 NautilusWindow *
@@ -2864,248 +2882,6 @@ show_hidden_files_changed_callback (gpointer callback_data)
     }
 }
 
-static gboolean
-set_up_scripts_directory_global (void)
-{
-    g_autofree gchar *old_scripts_directory_path = NULL;
-    g_autoptr (GFile) old_scripts_directory = NULL;
-    g_autofree gchar *scripts_directory_path = NULL;
-    g_autoptr (GFile) scripts_directory = NULL;
-    const char *override;
-    GFileType file_type;
-    g_autoptr (GError) error = NULL;
-
-    if (scripts_directory_uri != NULL)
-    {
-        return TRUE;
-    }
-
-    scripts_directory_path = nautilus_get_scripts_directory_path ();
-
-    override = g_getenv ("GNOME22_USER_DIR");
-
-    if (override)
-    {
-        old_scripts_directory_path = g_build_filename (override,
-                                                       "nautilus-scripts",
-                                                       NULL);
-    }
-    else
-    {
-        old_scripts_directory_path = g_build_filename (g_get_home_dir (),
-                                                       ".gnome2",
-                                                       "nautilus-scripts",
-                                                       NULL);
-    }
-
-    old_scripts_directory = g_file_new_for_path (old_scripts_directory_path);
-    scripts_directory = g_file_new_for_path (scripts_directory_path);
-
-    file_type = g_file_query_file_type (old_scripts_directory,
-                                        G_FILE_QUERY_INFO_NONE,
-                                        NULL);
-
-    if (file_type == G_FILE_TYPE_DIRECTORY &&
-        !g_file_query_exists (scripts_directory, NULL))
-    {
-        g_autoptr (GFile) updated = NULL;
-        const char *message;
-
-        /* test if we already attempted to migrate first */
-        updated = g_file_get_child (old_scripts_directory, "DEPRECATED-DIRECTORY");
-        message = _("Nautilus 3.6 deprecated this directory and tried migrating "
-                    "this configuration to ~/.local/share/nautilus");
-        if (!g_file_query_exists (updated, NULL))
-        {
-            g_autoptr (GFile) parent = NULL;
-
-            parent = g_file_get_parent (scripts_directory);
-            g_file_make_directory_with_parents (parent, NULL, &error);
-
-            if (error == NULL ||
-                g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
-            {
-                g_clear_error (&error);
-
-                g_file_set_attribute_uint32 (parent,
-                                             G_FILE_ATTRIBUTE_UNIX_MODE,
-                                             S_IRWXU,
-                                             G_FILE_QUERY_INFO_NONE,
-                                             NULL, NULL);
-
-                g_file_move (old_scripts_directory,
-                             scripts_directory,
-                             G_FILE_COPY_NONE,
-                             NULL, NULL, NULL,
-                             &error);
-
-                if (error == NULL)
-                {
-                    g_file_replace_contents (updated,
-                                             message, strlen (message),
-                                             NULL,
-                                             FALSE,
-                                             G_FILE_CREATE_PRIVATE,
-                                             NULL, NULL, NULL);
-                }
-            }
-
-            g_clear_error (&error);
-        }
-    }
-
-    g_file_make_directory_with_parents (scripts_directory, NULL, &error);
-
-    if (error == NULL ||
-        g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
-    {
-        g_file_set_attribute_uint32 (scripts_directory,
-                                     G_FILE_ATTRIBUTE_UNIX_MODE,
-                                     S_IRWXU,
-                                     G_FILE_QUERY_INFO_NONE,
-                                     NULL, NULL);
-
-        scripts_directory_uri = g_file_get_uri (scripts_directory);
-        scripts_directory_uri_length = strlen (scripts_directory_uri);
-    }
-
-    return scripts_directory_uri != NULL;
-}
-
-static void
-scripts_added_or_changed_callback (NautilusDirectory *directory,
-                                   GList             *files,
-                                   gpointer           callback_data)
-{
-    NautilusFilesView *view;
-    NautilusFilesViewPrivate *priv;
-
-    view = NAUTILUS_FILES_VIEW (callback_data);
-    priv = nautilus_files_view_get_instance_private (view);
-
-    if (priv->active)
-    {
-        schedule_update_context_menus (view);
-    }
-}
-
-static void
-templates_added_or_changed_callback (NautilusDirectory *directory,
-                                     GList             *files,
-                                     gpointer           callback_data)
-{
-    NautilusFilesView *view;
-    NautilusFilesViewPrivate *priv;
-
-    view = NAUTILUS_FILES_VIEW (callback_data);
-    priv = nautilus_files_view_get_instance_private (view);
-
-    if (priv->active)
-    {
-        schedule_update_context_menus (view);
-    }
-}
-
-static void
-add_directory_to_directory_list (NautilusFilesView  *view,
-                                 NautilusDirectory  *directory,
-                                 GList             **directory_list,
-                                 GCallback           changed_callback)
-{
-    NautilusFileAttributes attributes;
-
-    if (g_list_find (*directory_list, directory) == NULL)
-    {
-        nautilus_directory_ref (directory);
-
-        attributes =
-            NAUTILUS_FILE_ATTRIBUTES_FOR_ICON |
-            NAUTILUS_FILE_ATTRIBUTE_INFO |
-            NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT;
-
-        nautilus_directory_file_monitor_add (directory, directory_list,
-                                             FALSE, attributes,
-                                             (NautilusDirectoryCallback) changed_callback, view);
-
-        g_signal_connect_object (directory, "files-added",
-                                 G_CALLBACK (changed_callback), view, 0);
-        g_signal_connect_object (directory, "files-changed",
-                                 G_CALLBACK (changed_callback), view, 0);
-
-        *directory_list = g_list_append (*directory_list, directory);
-    }
-}
-
-static void
-remove_directory_from_directory_list (NautilusFilesView  *view,
-                                      NautilusDirectory  *directory,
-                                      GList             **directory_list,
-                                      GCallback           changed_callback)
-{
-    *directory_list = g_list_remove (*directory_list, directory);
-
-    g_signal_handlers_disconnect_by_func (directory,
-                                          G_CALLBACK (changed_callback),
-                                          view);
-
-    nautilus_directory_file_monitor_remove (directory, directory_list);
-
-    nautilus_directory_unref (directory);
-}
-
-
-static void
-add_directory_to_scripts_directory_list (NautilusFilesView *view,
-                                         NautilusDirectory *directory)
-{
-    NautilusFilesViewPrivate *priv;
-
-    priv = nautilus_files_view_get_instance_private (view);
-
-    add_directory_to_directory_list (view, directory,
-                                     &priv->scripts_directory_list,
-                                     G_CALLBACK (scripts_added_or_changed_callback));
-}
-
-static void
-remove_directory_from_scripts_directory_list (NautilusFilesView *view,
-                                              NautilusDirectory *directory)
-{
-    NautilusFilesViewPrivate *priv;
-
-    priv = nautilus_files_view_get_instance_private (view);
-
-    remove_directory_from_directory_list (view, directory,
-                                          &priv->scripts_directory_list,
-                                          G_CALLBACK (scripts_added_or_changed_callback));
-}
-
-static void
-add_directory_to_templates_directory_list (NautilusFilesView *view,
-                                           NautilusDirectory *directory)
-{
-    NautilusFilesViewPrivate *priv;
-
-    priv = nautilus_files_view_get_instance_private (view);
-
-    add_directory_to_directory_list (view, directory,
-                                     &priv->templates_directory_list,
-                                     G_CALLBACK (templates_added_or_changed_callback));
-}
-
-static void
-remove_directory_from_templates_directory_list (NautilusFilesView *view,
-                                                NautilusDirectory *directory)
-{
-    NautilusFilesViewPrivate *priv;
-
-    priv = nautilus_files_view_get_instance_private (view);
-
-    remove_directory_from_directory_list (view, directory,
-                                          &priv->templates_directory_list,
-                                          G_CALLBACK (templates_added_or_changed_callback));
-}
-
 static void
 slot_active_changed (NautilusWindowSlot *slot,
                      GParamSpec         *pspec,
@@ -3115,6 +2891,12 @@ slot_active_changed (NautilusWindowSlot *slot,
 
     priv = nautilus_files_view_get_instance_private (view);
 
+    /* Views kept aside by the slot don't own the window's actions */
+    if (gtk_widget_get_parent (GTK_WIDGET (view)) == NULL)
+    {
+        return;
+    }
+
     if (priv->active == nautilus_window_slot_get_active (slot))
     {
         return;
@@ -3198,13 +2980,14 @@ nautilus_files_view_set_selection (NautilusView *nautilus_files_view,
     }
 }
 
+static void stop_tracing_frames (NautilusFilesView *view);
+
 static void
 nautilus_files_view_destroy (GtkWidget *object)
 {
     NautilusFilesView *view;
     NautilusFilesViewPrivate *priv;
     GtkClipboard *clipboard;
-    GList *node, *next;
 
     view = NAUTILUS_FILES_VIEW (object);
     priv = nautilus_files_view_get_instance_private (view);
@@ -3218,18 +3001,6 @@ nautilus_files_view_destroy (GtkWidget *object)
         priv->model = NULL;
     }
 
-    for (node = priv->scripts_directory_list; node != NULL; node = next)
-    {
-        next = node->next;
-        remove_directory_from_scripts_directory_list (view, node->data);
-    }
-
-    for (node = priv->templates_directory_list; node != NULL; node = next)
-    {
-        next = node->next;
-        remove_directory_from_templates_directory_list (view, node->data);
-    }
-
     while (priv->subdirectory_list != NULL)
     {
         nautilus_files_view_remove_subdirectory (view,
@@ -3238,6 +3009,7 @@ nautilus_files_view_destroy (GtkWidget *object)
 
     remove_update_context_menus_timeout_callback (view);
     remove_update_status_idle_callback (view);
+    stop_tracing_frames (view);
 
     if (priv->display_selection_idle_id != 0)
     {
@@ -3245,6 +3017,14 @@ nautilus_files_view_destroy (GtkWidget *object)
         priv->display_selection_idle_id = 0;
     }
 
+    if (priv->display_selection_tick_id != 0)
+    {
+        gtk_widget_remove_tick_callback (GTK_WIDGET (view), priv->display_selection_tick_id);
+        priv->display_selection_tick_id = 0;
+    }
+
+    clear_selection_stats (view);
+
     if (priv->reveal_selection_idle_id != 0)
     {
         g_source_remove (priv->reveal_selection_idle_id);
@@ -3311,6 +3091,7 @@ nautilus_files_view_finalize (GObject *object)
     g_clear_object (&priv->view_action_group);
     g_clear_object (&priv->background_menu_model);
     g_clear_object (&priv->selection_menu_model);
+    g_clear_object (&priv->pending_open_with_section);
     g_clear_object (&priv->toolbar_menu_sections->zoom_section);
     g_clear_object (&priv->toolbar_menu_sections->extended_section);
     g_clear_object (&priv->extensions_background_menu);
@@ -3321,7 +3102,11 @@ nautilus_files_view_finalize (GObject *object)
     g_free (priv->toolbar_menu_sections);
 
     g_hash_table_destroy (priv->non_ready_files);
+    g_hash_table_destroy (priv->old_changed_files);
+    g_hash_table_destroy (priv->suspended_changed_files);
     g_hash_table_destroy (priv->pending_reveal);
+    g_hash_table_destroy (priv->selection_stats);
+    g_hash_table_destroy (priv->selection_deep_count_files);
 
     g_cancellable_cancel (priv->starred_cancellable);
     g_clear_object (&priv->starred_cancellable);
@@ -3337,112 +3122,490 @@ nautilus_files_view_finalize (GObject *object)
  * @view: NautilusFilesView for which to display selection info.
  *
  **/
-void
-nautilus_files_view_display_selection_info (NautilusFilesView *view)
+static void
+selection_stats_remove_entry (NautilusFilesViewPrivate *priv,
+                              SelectionStatsEntry      *entry)
 {
-    g_autolist (NautilusFile) selection = NULL;
-    goffset non_folder_size;
-    gboolean non_folder_size_known;
-    guint non_folder_count, folder_count, folder_item_count;
-    gboolean folder_item_count_known;
-    guint file_item_count;
-    GList *p;
-    char *first_item_name;
-    char *non_folder_count_str;
-    char *non_folder_item_count_str;
-    char *folder_count_str;
-    char *folder_item_count_str;
-    char *primary_status;
-    char *detail_status;
-    NautilusFile *file;
-
-    g_return_if_fail (NAUTILUS_IS_FILES_VIEW (view));
-
-    selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
-
-    folder_item_count_known = TRUE;
-    folder_count = 0;
-    folder_item_count = 0;
-    non_folder_count = 0;
-    non_folder_size_known = FALSE;
-    non_folder_size = 0;
-    first_item_name = NULL;
-    folder_count_str = NULL;
-    folder_item_count_str = NULL;
-    non_folder_count_str = NULL;
-    non_folder_item_count_str = NULL;
-
-    for (p = selection; p != NULL; p = p->next)
+    for (guint i = 0; i < N_SELECTION_CAPABILITIES; i++)
     {
-        file = p->data;
-        if (nautilus_file_is_directory (file))
+        if (entry->capabilities & (1 << i))
         {
-            folder_count++;
-            if (nautilus_file_get_directory_item_count (file, &file_item_count, NULL))
-            {
-                folder_item_count += file_item_count;
-            }
-            else
-            {
-                folder_item_count_known = FALSE;
-            }
-        }
-        else
-        {
-            non_folder_count++;
-            if (!nautilus_file_can_get_size (file))
-            {
-                non_folder_size_known = TRUE;
-                non_folder_size += nautilus_file_get_size (file);
-            }
-        }
-
-        if (first_item_name == NULL)
-        {
-            first_item_name = nautilus_file_get_display_name (file);
+            priv->selection_capability_counts[i]--;
         }
     }
 
-    /* Break out cases for localization's sake. But note that there are still pieces
-     * being assembled in a particular order, which may be a problem for some localizers.
-     */
+    if (entry->is_starred)
+    {
+        priv->selection_starred_count--;
+    }
 
-    if (folder_count != 0)
+    if (entry->is_folder)
     {
-        if (folder_count == 1 && non_folder_count == 0)
+        priv->selection_folder_count--;
+        if (entry->item_count_known)
         {
-            folder_count_str = g_strdup_printf (_("“%s” selected"), first_item_name);
+            priv->selection_folder_item_count -= entry->item_count;
         }
         else
         {
-            folder_count_str = g_strdup_printf (ngettext ("%'d folder selected",
-                                                          "%'d folders selected",
-                                                          folder_count),
-                                                folder_count);
+            priv->selection_folders_without_item_count--;
         }
-
-        if (folder_count == 1)
+    }
+    else
+    {
+        priv->selection_non_folder_count--;
+        if (entry->size_known)
         {
-            if (!folder_item_count_known)
-            {
-                folder_item_count_str = g_strdup ("");
-            }
-            else
-            {
-                folder_item_count_str = g_strdup_printf (ngettext ("(containing %'d item)",
-                                                                   "(containing %'d items)",
-                                                                   folder_item_count),
-                                                         folder_item_count);
-            }
+            priv->selection_non_folder_sizes_known--;
+            priv->selection_non_folder_size -= entry->size;
         }
-        else
-        {
-            if (!folder_item_count_known)
-            {
-                folder_item_count_str = g_strdup ("");
-            }
-            else
-            {
+    }
+}
+
+static void
+file_should_show_foreach (NautilusFile        *file,
+                          gboolean            *show_mount,
+                          gboolean            *show_unmount,
+                          gboolean            *show_eject,
+                          gboolean            *show_start,
+                          gboolean            *show_stop,
+                          gboolean            *show_poll,
+                          GDriveStartStopType *start_stop_type)
+{
+    *show_mount = FALSE;
+    *show_unmount = FALSE;
+    *show_eject = FALSE;
+    *show_start = FALSE;
+    *show_stop = FALSE;
+    *show_poll = FALSE;
+
+    if (nautilus_file_can_eject (file))
+    {
+        *show_eject = TRUE;
+    }
+
+    if (nautilus_file_can_mount (file))
+    {
+        *show_mount = TRUE;
+    }
+
+    if (nautilus_file_can_start (file) || nautilus_file_can_start_degraded (file))
+    {
+        *show_start = TRUE;
+    }
+
+    if (nautilus_file_can_stop (file))
+    {
+        *show_stop = TRUE;
+    }
+
+    /* Dot not show both Unmount and Eject/Safe Removal; too confusing to
+     * have too many menu entries */
+    if (nautilus_file_can_unmount (file) && !*show_eject && !*show_stop)
+    {
+        *show_unmount = TRUE;
+    }
+
+    if (nautilus_file_can_poll_for_media (file) && !nautilus_file_is_media_check_automatic (file))
+    {
+        *show_poll = TRUE;
+    }
+
+    *start_stop_type = nautilus_file_get_start_stop_type (file);
+}
+
+static guint
+get_selection_capabilities (NautilusFile        *file,
+                            GDriveStartStopType *start_stop_type)
+{
+    gboolean has[N_SELECTION_CAPABILITIES];
+    guint capabilities;
+
+    has[SELECTION_CAN_DELETE] = nautilus_file_can_delete (file);
+    has[SELECTION_CAN_TRASH] = nautilus_file_can_trash (file);
+    has[SELECTION_CAN_RENAME] = nautilus_file_can_rename (file);
+    has[SELECTION_IS_HOME] = nautilus_file_is_home (file);
+    has[SELECTION_IS_IN_TRASH] = nautilus_file_is_in_trash (file);
+    has[SELECTION_IS_ARCHIVE] = nautilus_file_is_archive (file);
+    has[SELECTION_EXTRACTS] = nautilus_mime_file_extracts (file);
+    has[SELECTION_LAUNCHES] = nautilus_mime_file_launches (file);
+    has[SELECTION_OPENS_IN_EXTERNAL_APP] = nautilus_mime_file_opens_in_external_app (file);
+    has[SELECTION_OPENS_IN_VIEW] = nautilus_file_opens_in_view (file);
+    file_should_show_foreach (file,
+                              &has[SELECTION_SHOWS_MOUNT],
+                              &has[SELECTION_SHOWS_UNMOUNT],
+                              &has[SELECTION_SHOWS_EJECT],
+                              &has[SELECTION_SHOWS_START],
+                              &has[SELECTION_SHOWS_STOP],
+                              &has[SELECTION_SHOWS_DETECT_MEDIA],
+                              start_stop_type);
+
+    capabilities = 0;
+    for (guint i = 0; i < N_SELECTION_CAPABILITIES; i++)
+    {
+        if (has[i])
+        {
+            capabilities |= 1 << i;
+        }
+    }
+
+    return capabilities;
+}
+
+static void
+selection_stats_add_file (NautilusFilesViewPrivate *priv,
+                          NautilusFile             *file)
+{
+    SelectionStatsEntry *entry;
+
+    entry = g_new0 (SelectionStatsEntry, 1);
+    entry->generation = priv->selection_stats_generation;
+
+    entry->capabilities = get_selection_capabilities (file, &entry->start_stop_type);
+    for (guint i = 0; i < N_SELECTION_CAPABILITIES; i++)
+    {
+        if (entry->capabilities & (1 << i))
+        {
+            priv->selection_capability_counts[i]++;
+        }
+    }
+
+    entry->is_starred = nautilus_file_is_starred (file);
+    if (entry->is_starred)
+    {
+        priv->selection_starred_count++;
+    }
+
+    if (nautilus_file_is_directory (file))
+    {
+        entry->is_folder = TRUE;
+        entry->item_count_known = nautilus_file_get_directory_item_count (file, &entry->item_count, NULL);
+
+        priv->selection_folder_count++;
+        if (entry->item_count_known)
+        {
+            priv->selection_folder_item_count += entry->item_count;
+        }
+        else
+        {
+            priv->selection_folders_without_item_count++;
+        }
+    }
+    else
+    {
+        if (!nautilus_file_can_get_size (file))
+        {
+            entry->size_known = TRUE;
+            entry->size = nautilus_file_get_size (file);
+        }
+
+        priv->selection_non_folder_count++;
+        if (entry->size_known)
+        {
+            priv->selection_non_folder_sizes_known++;
+            priv->selection_non_folder_size += entry->size;
+        }
+    }
+
+    g_hash_table_insert (priv->selection_stats, nautilus_file_ref (file), entry);
+}
+
+/* Drops what is known about a file that changed, so that it is counted
+ * again if it is still selected. */
+static void
+selection_stats_forget_file (NautilusFilesView *view,
+                             NautilusFile      *file)
+{
+    NautilusFilesViewPrivate *priv;
+    SelectionStatsEntry *entry;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    entry = g_hash_table_lookup (priv->selection_stats, file);
+    if (entry != NULL)
+    {
+        selection_stats_remove_entry (priv, entry);
+        g_hash_table_remove (priv->selection_stats, file);
+    }
+}
+
+/* Brings the totals up to date with @selection, only looking at the
+ * files that entered or left it. */
+static void
+update_selection_stats (NautilusFilesView *view,
+                        GList             *selection)
+{
+    NautilusFilesViewPrivate *priv;
+    SelectionStatsEntry *entry;
+    GHashTableIter iter;
+    gpointer value;
+    guint length;
+    GList *l;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    priv->selection_stats_generation++;
+
+    length = 0;
+    for (l = selection; l != NULL; l = l->next, length++)
+    {
+        entry = g_hash_table_lookup (priv->selection_stats, l->data);
+        if (entry != NULL)
+        {
+            entry->generation = priv->selection_stats_generation;
+        }
+        else
+        {
+            selection_stats_add_file (priv, l->data);
+        }
+    }
+
+    /* Only when files left the selection */
+    if (g_hash_table_size (priv->selection_stats) > length)
+    {
+        g_hash_table_iter_init (&iter, priv->selection_stats);
+        while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+            entry = value;
+            if (entry->generation != priv->selection_stats_generation)
+            {
+                selection_stats_remove_entry (priv, entry);
+                g_hash_table_iter_remove (&iter);
+            }
+        }
+    }
+
+    /* Files were starred or unstarred, which doesn't change them */
+    if (priv->selection_starred_generation != nautilus_tag_manager_get_starred_generation ())
+    {
+        gpointer key;
+
+        priv->selection_starred_generation = nautilus_tag_manager_get_starred_generation ();
+        priv->selection_starred_count = 0;
+
+        g_hash_table_iter_init (&iter, priv->selection_stats);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+            entry = value;
+            entry->is_starred = nautilus_file_is_starred (key);
+            if (entry->is_starred)
+            {
+                priv->selection_starred_count++;
+            }
+        }
+    }
+}
+
+static gboolean
+selection_any (NautilusFilesViewPrivate *priv,
+               SelectionCapability       capability)
+{
+    return priv->selection_capability_counts[capability] > 0;
+}
+
+/* Also TRUE for an empty selection */
+static gboolean
+selection_all (NautilusFilesViewPrivate *priv,
+               SelectionCapability       capability)
+{
+    return priv->selection_capability_counts[capability] == g_hash_table_size (priv->selection_stats);
+}
+
+/* Keeps deep counting the selected folders, if there are few of them, and
+ * returns their total size if all the counts are done. */
+static gboolean
+update_selection_deep_counts (NautilusFilesView *view,
+                              goffset           *total_size)
+{
+    NautilusFilesViewPrivate *priv;
+    SelectionStatsEntry *entry;
+    GHashTableIter iter;
+    gpointer key, value;
+    gboolean wanted, all_done;
+    goffset size;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    wanted = priv->selection_folder_count > 0 &&
+             priv->selection_folder_count <= SELECTION_DEEP_COUNT_MAX_FOLDERS;
+
+    g_hash_table_iter_init (&iter, priv->selection_deep_count_files);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+        if (!wanted || !g_hash_table_contains (priv->selection_stats, key))
+        {
+            nautilus_file_monitor_remove (key, &priv->selection_deep_count_files);
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+    if (!wanted)
+    {
+        return FALSE;
+    }
+
+    /* As there are few folders, the selection can't be much bigger. */
+    g_hash_table_iter_init (&iter, priv->selection_stats);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        entry = value;
+        if (entry->is_folder && !g_hash_table_contains (priv->selection_deep_count_files, key))
+        {
+            g_hash_table_add (priv->selection_deep_count_files, nautilus_file_ref (key));
+            nautilus_file_monitor_add (key, &priv->selection_deep_count_files,
+                                       NAUTILUS_FILE_ATTRIBUTE_DEEP_COUNTS);
+        }
+    }
+
+    all_done = TRUE;
+    *total_size = 0;
+    g_hash_table_iter_init (&iter, priv->selection_deep_count_files);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+        if (nautilus_file_get_deep_counts (key, NULL, NULL, NULL, &size, FALSE) != NAUTILUS_REQUEST_DONE)
+        {
+            all_done = FALSE;
+        }
+        *total_size += size;
+    }
+
+    return all_done;
+}
+
+static void
+clear_selection_stats (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+    GHashTableIter iter;
+    gpointer key;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    g_hash_table_iter_init (&iter, priv->selection_deep_count_files);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+        nautilus_file_monitor_remove (key, &priv->selection_deep_count_files);
+    }
+    g_hash_table_remove_all (priv->selection_deep_count_files);
+
+    g_hash_table_remove_all (priv->selection_stats);
+    priv->selection_folder_count = 0;
+    priv->selection_folder_item_count = 0;
+    priv->selection_folders_without_item_count = 0;
+    priv->selection_non_folder_count = 0;
+    priv->selection_non_folder_sizes_known = 0;
+    priv->selection_non_folder_size = 0;
+    memset (priv->selection_capability_counts, 0, sizeof (priv->selection_capability_counts));
+    priv->selection_starred_count = 0;
+}
+
+void
+nautilus_files_view_display_selection_info (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+    g_autolist (NautilusFile) selection = NULL;
+    goffset non_folder_size;
+    gboolean non_folder_size_known;
+    guint non_folder_count, folder_count, folder_item_count;
+    gboolean folder_item_count_known;
+    goffset folder_size;
+    gboolean folder_size_known;
+    char *first_item_name;
+    char *non_folder_count_str;
+    char *non_folder_item_count_str;
+    char *folder_count_str;
+    char *folder_item_count_str;
+    char *primary_status;
+    char *detail_status;
+    char *size_string;
+
+    g_return_if_fail (NAUTILUS_IS_FILES_VIEW (view));
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+    update_selection_stats (view, selection);
+    folder_size_known = update_selection_deep_counts (view, &folder_size);
+
+    folder_count = priv->selection_folder_count;
+    folder_item_count = priv->selection_folder_item_count;
+    folder_item_count_known = priv->selection_folders_without_item_count == 0;
+    non_folder_count = priv->selection_non_folder_count;
+    non_folder_size_known = priv->selection_non_folder_sizes_known > 0;
+    non_folder_size = priv->selection_non_folder_size;
+    first_item_name = selection != NULL ? nautilus_file_get_display_name (selection->data) : NULL;
+    folder_count_str = NULL;
+    folder_item_count_str = NULL;
+    non_folder_count_str = NULL;
+    non_folder_item_count_str = NULL;
+
+    /* Break out cases for localization's sake. But note that there are still pieces
+     * being assembled in a particular order, which may be a problem for some localizers.
+     */
+
+    if (folder_count != 0)
+    {
+        if (folder_count == 1 && non_folder_count == 0)
+        {
+            folder_count_str = g_strdup_printf (_("“%s” selected"), first_item_name);
+        }
+        else
+        {
+            folder_count_str = g_strdup_printf (ngettext ("%'d folder selected",
+                                                          "%'d folders selected",
+                                                          folder_count),
+                                                folder_count);
+        }
+
+        if (folder_size_known && !folder_item_count_known)
+        {
+            size_string = g_format_size (folder_size);
+            folder_item_count_str = g_strdup_printf (_("(%s)"), size_string);
+            g_free (size_string);
+        }
+        else if (folder_size_known && folder_count == 1)
+        {
+            size_string = g_format_size (folder_size);
+            /* translators: the %s is the total size of the folder and its contents */
+            folder_item_count_str = g_strdup_printf (ngettext ("(containing %'d item, %s)",
+                                                               "(containing %'d items, %s)",
+                                                               folder_item_count),
+                                                     folder_item_count, size_string);
+            g_free (size_string);
+        }
+        else if (folder_size_known)
+        {
+            size_string = g_format_size (folder_size);
+            /* translators: this is preceded with a string of form 'N folders' (N more than 1),
+             * and the %s is the total size of the folders and their contents */
+            folder_item_count_str = g_strdup_printf (ngettext ("(containing a total of %'d item, %s)",
+                                                               "(containing a total of %'d items, %s)",
+                                                               folder_item_count),
+                                                     folder_item_count, size_string);
+            g_free (size_string);
+        }
+        else if (folder_count == 1)
+        {
+            if (!folder_item_count_known)
+            {
+                folder_item_count_str = g_strdup ("");
+            }
+            else
+            {
+                folder_item_count_str = g_strdup_printf (ngettext ("(containing %'d item)",
+                                                                   "(containing %'d items)",
+                                                                   folder_item_count),
+                                                         folder_item_count);
+            }
+        }
+        else
+        {
+            if (!folder_item_count_known)
+            {
+                folder_item_count_str = g_strdup ("");
+            }
+            else
+            {
                 /* translators: this is preceded with a string of form 'N folders' (N more than 1) */
                 folder_item_count_str = g_strdup_printf (ngettext ("(containing a total of %'d item)",
                                                                    "(containing a total of %'d items)",
@@ -3480,8 +3643,6 @@ nautilus_files_view_display_selection_info (NautilusFilesView *view)
 
         if (non_folder_size_known)
         {
-            char *size_string;
-
             size_string = g_format_size (non_folder_size);
             /* This is marked for translation in case a localiser
              * needs to use something other than parentheses. The
@@ -4016,7 +4177,36 @@ static void
 sort_files (NautilusFilesView  *view,
             GList             **list)
 {
-    *list = g_list_sort_with_data (*list, compare_files_cover, view);
+    *list = nautilus_parallel_sort_list (*list, compare_files_cover, view);
+}
+
+/* Hidden views, e.g. of background tabs, don't show the changes to their
+ * files once loaded. They collect them until they are shown again. */
+static gboolean
+is_suspended (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    return !priv->loading && !gtk_widget_get_mapped (GTK_WIDGET (view));
+}
+
+static void
+take_suspended_changed_files (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+    GHashTableIter iter;
+    FileAndDirectory *pending;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    g_hash_table_iter_init (&iter, priv->suspended_changed_files);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &pending, NULL))
+    {
+        g_hash_table_iter_steal (&iter);
+        priv->new_changed_files = g_list_prepend (priv->new_changed_files, pending);
+    }
 }
 
 /* Go through all the new added and changed files.
@@ -4031,7 +4221,7 @@ process_new_files (NautilusFilesView *view)
     g_autolist (FileAndDirectory) new_added_files = NULL;
     g_autolist (FileAndDirectory) new_changed_files = NULL;
     GList *old_added_files;
-    GList *old_changed_files;
+    GHashTable *old_changed_files;
     GHashTable *non_ready_files;
     GList *node, *next;
     FileAndDirectory *pending;
@@ -4039,6 +4229,8 @@ process_new_files (NautilusFilesView *view)
 
     priv = nautilus_files_view_get_instance_private (view);
 
+    take_suspended_changed_files (view);
+
     new_added_files = g_steal_pointer (&priv->new_added_files);
     new_changed_files = g_steal_pointer (&priv->new_changed_files);
 
@@ -4100,7 +4292,7 @@ process_new_files (NautilusFilesView *view)
             else
             {
                 new_changed_files = g_list_delete_link (new_changed_files, node);
-                old_changed_files = g_list_prepend (old_changed_files, pending);
+                g_hash_table_add (old_changed_files, pending);
             }
         }
     }
@@ -4112,14 +4304,9 @@ process_new_files (NautilusFilesView *view)
         sort_files (view, &priv->old_added_files);
     }
 
-    /* Resort old_changed_files too, since file attributes
-     * relevant to sorting could have changed.
+    /* The order of old_changed_files doesn't matter, the views put the
+     * changed files back in place themselves.
      */
-    if (old_changed_files != priv->old_changed_files)
-    {
-        priv->old_changed_files = old_changed_files;
-        sort_files (view, &priv->old_changed_files);
-    }
 }
 
 static void
@@ -4161,70 +4348,38 @@ on_end_file_changes (NautilusFilesView *view)
     }
 }
 
-static int
-compare_pointers (gconstpointer pointer_1,
-                  gconstpointer pointer_2)
-{
-    if (pointer_1 < pointer_2)
-    {
-        return -1;
-    }
-    else if (pointer_1 > pointer_2)
-    {
-        return +1;
-    }
-
-    return 0;
-}
-
-static gboolean
-_g_lists_sort_and_check_for_intersection (GList **list_1,
-                                          GList **list_2)
-{
-    GList *node_1;
-    GList *node_2;
-    int compare_result;
-
-    *list_1 = g_list_sort (*list_1, compare_pointers);
-    *list_2 = g_list_sort (*list_2, compare_pointers);
-
-    node_1 = *list_1;
-    node_2 = *list_2;
-
-    while (node_1 != NULL && node_2 != NULL)
-    {
-        compare_result = compare_pointers (node_1->data, node_2->data);
-        if (compare_result == 0)
-        {
-            return TRUE;
-        }
-        if (compare_result <= 0)
-        {
-            node_1 = node_1->next;
-        }
-        if (compare_result >= 0)
-        {
-            node_2 = node_2->next;
-        }
-    }
-
-    return FALSE;
-}
-
+/* Adds at most @max_added of the pending files to the view, in sort order.
+ * The changes are only sent with the last of the added files, since they may
+ * be about files that aren't in the view yet.
+ */
 static void
-process_old_files (NautilusFilesView *view)
+process_old_files (NautilusFilesView *view,
+                   guint              max_added)
 {
     NautilusFilesViewPrivate *priv;
     g_autolist (FileAndDirectory) files_added = NULL;
-    g_autolist (FileAndDirectory) files_changed = NULL;
+    g_autoptr (GHashTable) files_changed = NULL;
+    g_autoptr (GHashTable) changed_files_set = NULL;
+    GHashTableIter iter;
     FileAndDirectory *pending;
-    GList *files;
+    GList *rest;
     g_autoptr (GList) pending_additions = NULL;
 
     priv = nautilus_files_view_get_instance_private (view);
     files_added = g_steal_pointer (&priv->old_added_files);
-    files_changed = g_steal_pointer (&priv->old_changed_files);
 
+    rest = g_list_nth (files_added, max_added);
+    if (rest != NULL)
+    {
+        rest->prev->next = NULL;
+        rest->prev = NULL;
+        priv->old_added_files = rest;
+    }
+    else if (g_hash_table_size (priv->old_changed_files) > 0)
+    {
+        files_changed = g_steal_pointer (&priv->old_changed_files);
+        priv->old_changed_files = file_and_directory_set_new ();
+    }
 
     if (files_added != NULL || files_changed != NULL)
     {
@@ -4251,10 +4406,16 @@ process_old_files (NautilusFilesView *view)
                            signals[ADD_FILES], 0, pending_additions);
         }
 
-        for (GList *node = files_changed; node != NULL; node = node->next)
+        if (files_changed != NULL)
+        {
+            changed_files_set = g_hash_table_new (NULL, NULL);
+            g_hash_table_iter_init (&iter, files_changed);
+        }
+        while (files_changed != NULL &&
+               g_hash_table_iter_next (&iter, (gpointer *) &pending, NULL))
         {
             gboolean should_show_file;
-            pending = node->data;
+            g_hash_table_add (changed_files_set, pending->file);
             should_show_file = still_should_show_file (view, pending);
             g_signal_emit (view,
                            signals[should_show_file ? FILE_CHANGED : REMOVE_FILE], 0,
@@ -4281,10 +4442,10 @@ process_old_files (NautilusFilesView *view)
         {
             g_autolist (NautilusFile) selection = NULL;
             selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
-            files = g_list_copy_deep (files_changed, (GCopyFunc) file_and_directory_get_file, NULL);
-            send_selection_change = _g_lists_sort_and_check_for_intersection
-                                        (&files, &selection);
-            nautilus_file_list_free (files);
+            for (GList *node = selection; node != NULL && !send_selection_change; node = node->next)
+            {
+                send_selection_change = g_hash_table_contains (changed_files_set, node->data);
+            }
         }
 
         if (send_selection_change)
@@ -4299,16 +4460,46 @@ process_old_files (NautilusFilesView *view)
     }
 }
 
+static void schedule_frame_display_of_pending_files (NautilusFilesView *view);
+
 static void
 display_pending_files (NautilusFilesView *view)
 {
     NautilusFilesViewPrivate *priv;
     g_autolist (NautilusFile) selection = NULL;
+    gint64 start, elapsed;
+    guint chunk_size;
+    gboolean whole_chunk;
+
+    priv = nautilus_files_view_get_instance_private (view);
 
     process_new_files (view);
-    process_old_files (view);
 
-    priv = nautilus_files_view_get_instance_private (view);
+    chunk_size = priv->display_pending_chunk_size;
+    whole_chunk = g_list_nth (priv->old_added_files, chunk_size) != NULL;
+
+    start = g_get_monotonic_time ();
+    process_old_files (view, chunk_size);
+    elapsed = g_get_monotonic_time () - start;
+
+    nautilus_trace_slow_span ("display pending files", start, "%u files", chunk_size);
+
+    /* Size the next chunk so that it fits in the frame budget, going by
+     * how long this one took. */
+    if (whole_chunk && elapsed > 0)
+    {
+        priv->display_pending_chunk_size = CLAMP ((gint64) chunk_size * DISPLAY_PENDING_FRAME_BUDGET / elapsed,
+                                                  DISPLAY_PENDING_MIN_CHUNK,
+                                                  DISPLAY_PENDING_MAX_CHUNK);
+    }
+
+    if (priv->old_added_files != NULL)
+    {
+        /* Let the view draw and handle input before the next chunk. */
+        schedule_frame_display_of_pending_files (view);
+        return;
+    }
+
     selection = nautilus_files_view_get_selection (NAUTILUS_VIEW (view));
 
     if (selection == NULL &&
@@ -4346,6 +4537,26 @@ display_selection_info_idle_callback (gpointer data)
     return FALSE;
 }
 
+/* While the view is shown, the selection info is updated at most once per
+ * frame, however fast the selection changes (e.g. rubberbanding). */
+static gboolean
+display_selection_info_tick_callback (GtkWidget     *widget,
+                                      GdkFrameClock *frame_clock,
+                                      gpointer       user_data)
+{
+    NautilusFilesView *view;
+    NautilusFilesViewPrivate *priv;
+
+    view = NAUTILUS_FILES_VIEW (widget);
+    priv = nautilus_files_view_get_instance_private (view);
+
+    priv->display_selection_tick_id = 0;
+    nautilus_files_view_display_selection_info (view);
+    nautilus_files_view_send_selection_change (view);
+
+    return G_SOURCE_REMOVE;
+}
+
 static void
 remove_update_context_menus_timeout_callback (NautilusFilesView *view)
 {
@@ -4396,15 +4607,169 @@ display_pending_callback (gpointer data)
     view = NAUTILUS_FILES_VIEW (data);
     priv = nautilus_files_view_get_instance_private (view);
 
-    g_object_ref (G_OBJECT (view));
-
-    priv->display_pending_source_id = 0;
+    g_object_ref (G_OBJECT (view));
+
+    priv->display_pending_source_id = 0;
+
+    display_pending_files (view);
+
+    g_object_unref (G_OBJECT (view));
+
+    return FALSE;
+}
+
+static gboolean
+display_pending_tick_callback (GtkWidget     *widget,
+                               GdkFrameClock *frame_clock,
+                               gpointer       user_data)
+{
+    NautilusFilesView *view;
+    NautilusFilesViewPrivate *priv;
+
+    view = NAUTILUS_FILES_VIEW (widget);
+    priv = nautilus_files_view_get_instance_private (view);
+
+    g_object_ref (G_OBJECT (view));
+
+    priv->display_pending_tick_id = 0;
+
+    display_pending_files (view);
+
+    g_object_unref (G_OBJECT (view));
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Shows the next chunk of the pending files at the next frame, or in an
+ * idle if the view isn't drawn. */
+static void
+schedule_frame_display_of_pending_files (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    if (!gtk_widget_get_mapped (GTK_WIDGET (view)))
+    {
+        schedule_idle_display_of_pending_files (view);
+        return;
+    }
+
+    unschedule_display_of_pending_files (view);
+
+    priv->display_pending_tick_id =
+        gtk_widget_add_tick_callback (GTK_WIDGET (view),
+                                      display_pending_tick_callback,
+                                      NULL, NULL);
+}
+
+static void
+on_frame_clock_after_paint (GdkFrameClock     *frame_clock,
+                            NautilusFilesView *view)
+{
+    /* From the start of the frame, so with the layout and the paint */
+    nautilus_trace_slow_span ("view frame",
+                              gdk_frame_clock_get_frame_time (frame_clock),
+                              "%s", G_OBJECT_TYPE_NAME (view));
+}
+
+static void
+stop_tracing_frames (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    if (priv->trace_frame_clock != NULL)
+    {
+        g_clear_signal_handler (&priv->trace_after_paint_id, priv->trace_frame_clock);
+        g_clear_object (&priv->trace_frame_clock);
+    }
+}
+
+static void
+start_tracing_frames (NautilusFilesView *view)
+{
+    NautilusFilesViewPrivate *priv;
+    GdkFrameClock *frame_clock;
+
+    priv = nautilus_files_view_get_instance_private (view);
+
+    frame_clock = gtk_widget_get_frame_clock (GTK_WIDGET (view));
+    if (!nautilus_trace_is_enabled () || frame_clock == NULL)
+    {
+        return;
+    }
+
+    stop_tracing_frames (view);
+
+    priv->trace_frame_clock = g_object_ref (frame_clock);
+    priv->trace_after_paint_id = g_signal_connect_object (frame_clock, "after-paint",
+                                                          G_CALLBACK (on_frame_clock_after_paint),
+                                                          view, 0);
+}
+
+static void
+on_unmap (GtkWidget *widget,
+          gpointer   user_data)
+{
+    NautilusFilesViewPrivate *priv;
+
+    priv = nautilus_files_view_get_instance_private (NAUTILUS_FILES_VIEW (widget));
+
+    stop_tracing_frames (NAUTILUS_FILES_VIEW (widget));
+
+    if (is_suspended (NAUTILUS_FILES_VIEW (widget)))
+    {
+        /* Caught up with when shown again, see on_map() */
+        unschedule_display_of_pending_files (NAUTILUS_FILES_VIEW (widget));
+        remove_update_status_idle_callback (NAUTILUS_FILES_VIEW (widget));
+    }
+    else if (priv->display_pending_tick_id != 0)
+    {
+        /* The frame clock doesn't tick for unmapped widgets. */
+        schedule_idle_display_of_pending_files (NAUTILUS_FILES_VIEW (widget));
+    }
+
+    /* Thumbnails shown elsewhere come first */
+    nautilus_thumbnail_demote_owner (widget);
+
+    if (priv->display_selection_tick_id != 0)
+    {
+        gtk_widget_remove_tick_callback (widget, priv->display_selection_tick_id);
+        priv->display_selection_tick_id = 0;
+        priv->display_selection_idle_id = g_idle_add (display_selection_info_idle_callback,
+                                                      widget);
+    }
+}
+
+static void
+on_map (GtkWidget *widget,
+        gpointer   user_data)
+{
+    NautilusFilesView *view;
+    NautilusFilesViewPrivate *priv;
+
+    view = NAUTILUS_FILES_VIEW (widget);
+    priv = nautilus_files_view_get_instance_private (view);
+
+    start_tracing_frames (view);
 
-    display_pending_files (view);
+    if (priv->loading)
+    {
+        return;
+    }
 
-    g_object_unref (G_OBJECT (view));
+    /* Show what changed while the view was hidden in one go */
+    if (priv->new_added_files != NULL ||
+        priv->new_changed_files != NULL ||
+        priv->old_added_files != NULL ||
+        g_hash_table_size (priv->suspended_changed_files) > 0)
+    {
+        schedule_idle_display_of_pending_files (view);
+    }
 
-    return FALSE;
+    schedule_update_status (view);
 }
 
 static void
@@ -4434,7 +4799,8 @@ schedule_timeout_display_of_pending_files (NautilusFilesView *view,
     priv = nautilus_files_view_get_instance_private (view);
 
     /* No need to schedule an update if there's already one pending. */
-    if (priv->display_pending_source_id != 0)
+    if (priv->display_pending_source_id != 0 ||
+        priv->display_pending_tick_id != 0)
     {
         return;
     }
@@ -4456,6 +4822,12 @@ unschedule_display_of_pending_files (NautilusFilesView *view)
         g_source_remove (priv->display_pending_source_id);
         priv->display_pending_source_id = 0;
     }
+
+    if (priv->display_pending_tick_id != 0)
+    {
+        gtk_widget_remove_tick_callback (GTK_WIDGET (view), priv->display_pending_tick_id);
+        priv->display_pending_tick_id = 0;
+    }
 }
 
 static void
@@ -4474,8 +4846,25 @@ queue_pending_files (NautilusFilesView  *view,
         return;
     }
 
+    if (is_suspended (view) && pending_list == &priv->new_changed_files)
+    {
+        for (GList *l = files; l != NULL; l = l->next)
+        {
+            g_hash_table_add (priv->suspended_changed_files,
+                              file_and_directory_new (l->data, directory));
+        }
+
+        return;
+    }
+
     fad_list = g_list_copy_deep (files, (GCopyFunc) file_and_directory_new, directory);
     *pending_list = g_list_concat (fad_list, *pending_list);
+
+    if (is_suspended (view))
+    {
+        return;
+    }
+
     /* Generally we don't want to show the files while the directory is loading
      * the files themselves, so we avoid jumping and oddities. However, for
      * search it can be a long wait, and we actually want to show files as
@@ -4630,6 +5019,11 @@ files_changed_callback (NautilusDirectory *directory,
 
     schedule_changes (view);
 
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        selection_stats_forget_file (view, l->data);
+    }
+
     queue_pending_files (view, directory, files, &priv->new_changed_files);
 
     /* The free space or the number of items could have changed */
@@ -4687,6 +5081,34 @@ load_error_callback (NautilusDirectory *directory,
         nautilus_files_view_get_containing_window (view));
 }
 
+/* Monitor the things needed to get the right icon. Also
+ * monitor a directory's item count because the "size"
+ * attribute is based on that, and the file's metadata
+ * and possible custom name. The extended info is only
+ * fetched after the rest, for slow locations, and the views
+ * which know the files in view only ask for it for those.
+ */
+static NautilusFileAttributes
+get_monitored_attributes (NautilusFilesView *view)
+{
+    NautilusFileAttributes attributes;
+
+    attributes =
+        NAUTILUS_FILE_ATTRIBUTES_FOR_ICON |
+        NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT |
+        NAUTILUS_FILE_ATTRIBUTE_INFO |
+        NAUTILUS_FILE_ATTRIBUTE_MOUNT |
+        NAUTILUS_FILE_ATTRIBUTE_EXTENSION_INFO |
+        NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO;
+
+    if (NAUTILUS_FILES_VIEW_GET_CLASS (view)->get_lazy_attributes != NULL)
+    {
+        attributes &= ~NAUTILUS_FILES_VIEW_GET_CLASS (view)->get_lazy_attributes (view);
+    }
+
+    return attributes;
+}
+
 void
 nautilus_files_view_add_subdirectory (NautilusFilesView *view,
                                       NautilusDirectory *directory)
@@ -4700,12 +5122,7 @@ nautilus_files_view_add_subdirectory (NautilusFilesView *view,
 
     nautilus_directory_ref (directory);
 
-    attributes =
-        NAUTILUS_FILE_ATTRIBUTES_FOR_ICON |
-        NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT |
-        NAUTILUS_FILE_ATTRIBUTE_INFO |
-        NAUTILUS_FILE_ATTRIBUTE_MOUNT |
-        NAUTILUS_FILE_ATTRIBUTE_EXTENSION_INFO;
+    attributes = get_monitored_attributes (view);
 
     nautilus_directory_file_monitor_add (directory,
                                          &priv->model,
@@ -4800,25 +5217,6 @@ nautilus_files_view_get_content_widget (NautilusFilesView *view)
     return priv->scrolled_window;
 }
 
-/* home_dir_in_selection()
- *
- * Return TRUE if the home directory is in the selection.
- */
-
-static gboolean
-home_dir_in_selection (GList *selection)
-{
-    for (GList *node = selection; node != NULL; node = node->next)
-    {
-        if (nautilus_file_is_home (NAUTILUS_FILE (node->data)))
-        {
-            return TRUE;
-        }
-    }
-
-    return FALSE;
-}
-
 static void
 trash_or_delete_done_cb (GHashTable        *debuting_uris,
                          gboolean           user_cancel,
@@ -4882,24 +5280,6 @@ nautilus_files_view_get_directory_as_file (NautilusFilesView *view)
     return priv->directory_as_file;
 }
 
-static GdkPixbuf *
-get_menu_icon_for_file (NautilusFile *file,
-                        GtkWidget    *widget)
-{
-    NautilusIconInfo *info;
-    GdkPixbuf *pixbuf;
-    int size, scale;
-
-    size = nautilus_get_icon_size_for_stock_size (GTK_ICON_SIZE_MENU);
-    scale = gtk_widget_get_scale_factor (widget);
-
-    info = nautilus_file_get_icon (file, size, scale, 0);
-    pixbuf = nautilus_icon_info_get_pixbuf_nodefault_at_size (info, size);
-    g_object_unref (info);
-
-    return pixbuf;
-}
-
 static GList *
 get_extension_selection_menu_items (NautilusFilesView *view)
 {
@@ -5193,678 +5573,220 @@ get_file_paths_or_uris_as_newline_delimited_string (GList    *selection,
             if (path != NULL)
             {
                 g_string_append (expanding_string, path);
-                g_string_append (expanding_string, "\n");
-            }
-        }
-        else
-        {
-            g_string_append (expanding_string, uri);
-            g_string_append (expanding_string, "\n");
-        }
-    }
-
-    return g_string_free (expanding_string, FALSE);
-}
-
-static char *
-get_file_paths_as_newline_delimited_string (GList *selection)
-{
-    return get_file_paths_or_uris_as_newline_delimited_string (selection, TRUE);
-}
-
-static char *
-get_file_uris_as_newline_delimited_string (GList *selection)
-{
-    return get_file_paths_or_uris_as_newline_delimited_string (selection, FALSE);
-}
-
-/*
- * Set up some environment variables that scripts can use
- * to take advantage of the current Nautilus state.
- */
-static void
-set_script_environment_variables (NautilusFilesView *view,
-                                  GList             *selected_files)
-{
-    g_autofree gchar *file_paths = NULL;
-    g_autofree gchar *uris = NULL;
-    g_autofree gchar *uri = NULL;
-    g_autofree gchar *geometry_string = NULL;
-    NautilusFilesViewPrivate *priv;
-
-    priv = nautilus_files_view_get_instance_private (view);
-
-    file_paths = get_file_paths_as_newline_delimited_string (selected_files);
-    g_setenv ("NAUTILUS_SCRIPT_SELECTED_FILE_PATHS", file_paths, TRUE);
-
-    uris = get_file_uris_as_newline_delimited_string (selected_files);
-    g_setenv ("NAUTILUS_SCRIPT_SELECTED_URIS", uris, TRUE);
-
-    uri = nautilus_directory_get_uri (priv->model);
-    g_setenv ("NAUTILUS_SCRIPT_CURRENT_URI", uri, TRUE);
-
-    geometry_string = eel_gtk_window_get_geometry_string
-                          (GTK_WINDOW (nautilus_files_view_get_containing_window (view)));
-    g_setenv ("NAUTILUS_SCRIPT_WINDOW_GEOMETRY", geometry_string, TRUE);
-}
-
-/* Unset all the special script environment variables. */
-static void
-unset_script_environment_variables (void)
-{
-    g_unsetenv ("NAUTILUS_SCRIPT_SELECTED_FILE_PATHS");
-    g_unsetenv ("NAUTILUS_SCRIPT_SELECTED_URIS");
-    g_unsetenv ("NAUTILUS_SCRIPT_CURRENT_URI");
-    g_unsetenv ("NAUTILUS_SCRIPT_WINDOW_GEOMETRY");
-}
-
-static void
-run_script (GSimpleAction *action,
-            GVariant      *state,
-            gpointer       user_data)
-{
-    ScriptLaunchParameters *launch_parameters;
-    NautilusFilesViewPrivate *priv;
-    g_autofree gchar *file_uri = NULL;
-    g_autofree gchar *local_file_path = NULL;
-    g_autofree gchar *quoted_path = NULL;
-    g_autofree gchar *old_working_dir = NULL;
-    g_autolist (NautilusFile) selection = NULL;
-    g_auto (GStrv) parameters = NULL;
-    GdkScreen *screen;
-
-    launch_parameters = (ScriptLaunchParameters *) user_data;
-    priv = nautilus_files_view_get_instance_private (launch_parameters->directory_view);
-
-    file_uri = nautilus_file_get_uri (launch_parameters->file);
-    local_file_path = g_filename_from_uri (file_uri, NULL, NULL);
-    g_assert (local_file_path != NULL);
-    quoted_path = g_shell_quote (local_file_path);
-
-    old_working_dir = change_to_view_directory (launch_parameters->directory_view);
-
-    selection = nautilus_view_get_selection (NAUTILUS_VIEW (launch_parameters->directory_view));
-    set_script_environment_variables (launch_parameters->directory_view, selection);
-
-    parameters = get_file_names_as_parameter_array (selection, priv->model);
-
-    screen = gtk_widget_get_screen (GTK_WIDGET (launch_parameters->directory_view));
-
-    DEBUG ("run_script, script_path=“%s” (omitting script parameters)",
-           local_file_path);
-
-    nautilus_launch_application_from_command_array (screen, quoted_path, FALSE,
-                                                    (const char * const *) parameters);
-
-    unset_script_environment_variables ();
-    g_chdir (old_working_dir);
-}
-
-static void
-add_script_to_scripts_menus (NautilusFilesView *view,
-                             NautilusFile      *file,
-                             GMenu             *menu)
-{
-    NautilusFilesViewPrivate *priv;
-    gchar *name;
-    g_autofree gchar *uri = NULL;
-    g_autofree gchar *escaped_uri = NULL;
-    GdkPixbuf *mimetype_icon;
-    gchar *action_name, *detailed_action_name;
-    ScriptLaunchParameters *launch_parameters;
-    GAction *action;
-    GMenuItem *menu_item;
-    const gchar *shortcut;
-
-    priv = nautilus_files_view_get_instance_private (view);
-    launch_parameters = script_launch_parameters_new (file, view);
-
-    name = nautilus_file_get_display_name (file);
-
-    uri = nautilus_file_get_uri (file);
-    escaped_uri = g_uri_escape_string (uri, NULL, TRUE);
-    action_name = g_strconcat ("script_", escaped_uri, NULL);
-
-    action = G_ACTION (g_simple_action_new (action_name, NULL));
-
-    g_signal_connect_data (action, "activate",
-                           G_CALLBACK (run_script),
-                           launch_parameters,
-                           (GClosureNotify) script_launch_parameters_free, 0);
-
-    g_action_map_add_action (G_ACTION_MAP (priv->view_action_group), action);
-
-    g_object_unref (action);
-
-    detailed_action_name = g_strconcat ("view.", action_name, NULL);
-    menu_item = g_menu_item_new (name, detailed_action_name);
-
-    mimetype_icon = get_menu_icon_for_file (file, GTK_WIDGET (view));
-    if (mimetype_icon != NULL)
-    {
-        g_menu_item_set_icon (menu_item, G_ICON (mimetype_icon));
-        g_object_unref (mimetype_icon);
-    }
-
-    g_menu_append_item (menu, menu_item);
-
-    if ((shortcut = g_hash_table_lookup (script_accels, name)))
-    {
-        nautilus_application_set_accelerator (g_application_get_default (),
-                                              detailed_action_name, shortcut);
-    }
-
-    g_free (name);
-    g_free (action_name);
-    g_free (detailed_action_name);
-    g_object_unref (menu_item);
-}
-
-static gboolean
-directory_belongs_in_scripts_menu (const char *uri)
-{
-    int num_levels;
-    int i;
-
-    if (!g_str_has_prefix (uri, scripts_directory_uri))
-    {
-        return FALSE;
-    }
-
-    num_levels = 0;
-    for (i = scripts_directory_uri_length; uri[i] != '\0'; i++)
-    {
-        if (uri[i] == '/')
-        {
-            num_levels++;
-        }
-    }
-
-    if (num_levels > MAX_MENU_LEVELS)
-    {
-        return FALSE;
-    }
-
-    return TRUE;
-}
-
-/* Expected format: accel script_name */
-static void
-nautilus_load_custom_accel_for_scripts (void)
-{
-    gchar *path, *contents;
-    gchar **lines, **result;
-    GError *error = NULL;
-    const int max_len = 100;
-    int i;
-
-    path = g_build_filename (g_get_user_config_dir (), SHORTCUTS_PATH, NULL);
-
-    if (g_file_get_contents (path, &contents, NULL, &error))
-    {
-        lines = g_strsplit (contents, "\n", -1);
-        for (i = 0; lines[i] && (strstr (lines[i], " ") > 0); i++)
-        {
-            result = g_strsplit (lines[i], " ", 2);
-            g_hash_table_insert (script_accels,
-                                 g_strndup (result[1], max_len),
-                                 g_strndup (result[0], max_len));
-            g_strfreev (result);
-        }
-
-        g_free (contents);
-        g_strfreev (lines);
-    }
-    else
-    {
-        DEBUG ("Unable to open '%s', error message: %s", path, error->message);
-        g_clear_error (&error);
-    }
-
-    g_free (path);
-}
-
-static GMenu *
-update_directory_in_scripts_menu (NautilusFilesView *view,
-                                  NautilusDirectory *directory)
-{
-    GList *file_list, *filtered, *node;
-    GMenu *menu, *children_menu;
-    GMenuItem *menu_item;
-    gboolean any_scripts;
-    NautilusFile *file;
-    NautilusDirectory *dir;
-    char *uri;
-    gchar *file_name;
-    int num;
-
-    g_return_val_if_fail (NAUTILUS_IS_FILES_VIEW (view), NULL);
-    g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
-
-    if (script_accels == NULL)
-    {
-        script_accels = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               g_free, g_free);
-        nautilus_load_custom_accel_for_scripts ();
-    }
-
-    file_list = nautilus_directory_get_file_list (directory);
-    filtered = nautilus_file_list_filter_hidden (file_list, FALSE);
-    nautilus_file_list_free (file_list);
-    menu = g_menu_new ();
-
-    filtered = nautilus_file_list_sort_by_display_name (filtered);
-
-    num = 0;
-    any_scripts = FALSE;
-    for (node = filtered; num < TEMPLATE_LIMIT && node != NULL; node = node->next, num++)
-    {
-        file = node->data;
-        if (nautilus_file_is_directory (file))
-        {
-            uri = nautilus_file_get_uri (file);
-            if (directory_belongs_in_scripts_menu (uri))
-            {
-                dir = nautilus_directory_get_by_uri (uri);
-                add_directory_to_scripts_directory_list (view, dir);
-
-                children_menu = update_directory_in_scripts_menu (view, dir);
-
-                if (children_menu != NULL)
-                {
-                    file_name = nautilus_file_get_display_name (file);
-                    menu_item = g_menu_item_new_submenu (file_name,
-                                                         G_MENU_MODEL (children_menu));
-                    g_menu_append_item (menu, menu_item);
-                    any_scripts = TRUE;
-                    g_object_unref (menu_item);
-                    g_object_unref (children_menu);
-                    g_free (file_name);
-                }
-
-                nautilus_directory_unref (dir);
+                g_string_append (expanding_string, "\n");
             }
-            g_free (uri);
         }
-        else if (nautilus_file_is_launchable (file))
+        else
         {
-            add_script_to_scripts_menus (view, file, menu);
-            any_scripts = TRUE;
+            g_string_append (expanding_string, uri);
+            g_string_append (expanding_string, "\n");
         }
     }
 
-    nautilus_file_list_free (filtered);
-
-    if (!any_scripts)
-    {
-        g_object_unref (menu);
-        menu = NULL;
-    }
-
-    return menu;
+    return g_string_free (expanding_string, FALSE);
 }
 
+static char *
+get_file_paths_as_newline_delimited_string (GList *selection)
+{
+    return get_file_paths_or_uris_as_newline_delimited_string (selection, TRUE);
+}
 
+static char *
+get_file_uris_as_newline_delimited_string (GList *selection)
+{
+    return get_file_paths_or_uris_as_newline_delimited_string (selection, FALSE);
+}
 
+/*
+ * Set up some environment variables that scripts can use
+ * to take advantage of the current Nautilus state.
+ */
 static void
-update_scripts_menu (NautilusFilesView *view,
-                     GtkBuilder        *builder)
+set_script_environment_variables (NautilusFilesView *view,
+                                  GList             *selected_files)
 {
+    g_autofree gchar *file_paths = NULL;
+    g_autofree gchar *uris = NULL;
+    g_autofree gchar *uri = NULL;
+    g_autofree gchar *geometry_string = NULL;
     NautilusFilesViewPrivate *priv;
-    GList *sorted_copy, *node;
-    NautilusDirectory *directory;
-    GMenu *submenu;
-    char *uri;
 
     priv = nautilus_files_view_get_instance_private (view);
 
-    sorted_copy = nautilus_directory_list_sort_by_uri
-                      (nautilus_directory_list_copy (priv->scripts_directory_list));
-
-    for (node = sorted_copy; node != NULL; node = node->next)
-    {
-        directory = node->data;
-
-        uri = nautilus_directory_get_uri (directory);
-        if (!directory_belongs_in_scripts_menu (uri))
-        {
-            remove_directory_from_scripts_directory_list (view, directory);
-        }
-        g_free (uri);
-    }
-    nautilus_directory_list_free (sorted_copy);
-
-    directory = nautilus_directory_get_by_uri (scripts_directory_uri);
-    submenu = update_directory_in_scripts_menu (view, directory);
-    if (submenu != NULL)
-    {
-        GObject *object;
-
-        object = gtk_builder_get_object (builder, "scripts-submenu");
-        nautilus_gmenu_set_from_model (G_MENU (object),
-                                       G_MENU_MODEL (submenu));
+    file_paths = get_file_paths_as_newline_delimited_string (selected_files);
+    g_setenv ("NAUTILUS_SCRIPT_SELECTED_FILE_PATHS", file_paths, TRUE);
 
-        g_object_unref (submenu);
-    }
+    uris = get_file_uris_as_newline_delimited_string (selected_files);
+    g_setenv ("NAUTILUS_SCRIPT_SELECTED_URIS", uris, TRUE);
 
-    nautilus_directory_unref (directory);
+    uri = nautilus_directory_get_uri (priv->model);
+    g_setenv ("NAUTILUS_SCRIPT_CURRENT_URI", uri, TRUE);
 
-    priv->scripts_present = submenu != NULL;
+    geometry_string = eel_gtk_window_get_geometry_string
+                          (GTK_WINDOW (nautilus_files_view_get_containing_window (view)));
+    g_setenv ("NAUTILUS_SCRIPT_WINDOW_GEOMETRY", geometry_string, TRUE);
 }
 
+/* Unset all the special script environment variables. */
 static void
-create_template (GSimpleAction *action,
-                 GVariant      *state,
-                 gpointer       user_data)
+unset_script_environment_variables (void)
 {
-    CreateTemplateParameters *parameters;
-
-    parameters = user_data;
-
-    nautilus_files_view_new_file (parameters->directory_view, NULL, parameters->file);
+    g_unsetenv ("NAUTILUS_SCRIPT_SELECTED_FILE_PATHS");
+    g_unsetenv ("NAUTILUS_SCRIPT_SELECTED_URIS");
+    g_unsetenv ("NAUTILUS_SCRIPT_CURRENT_URI");
+    g_unsetenv ("NAUTILUS_SCRIPT_WINDOW_GEOMETRY");
 }
 
-static void
-add_template_to_templates_menus (NautilusFilesView *view,
-                                 NautilusFile      *file,
-                                 GMenu             *menu)
+/* The action can be activated with any URI, only what is in the scripts
+ * folder is run. */
+static gboolean
+is_runnable_script (const char *path)
 {
-    NautilusFilesViewPrivate *priv;
-    char *tmp, *uri, *name;
-    g_autofree gchar *escaped_uri = NULL;
-    GdkPixbuf *mimetype_icon;
-    char *action_name, *detailed_action_name;
-    CreateTemplateParameters *parameters;
-    GAction *action;
-    g_autofree char *label = NULL;
-    GMenuItem *menu_item;
-
-    priv = nautilus_files_view_get_instance_private (view);
-    tmp = nautilus_file_get_display_name (file);
-    name = eel_filename_strip_extension (tmp);
-    g_free (tmp);
-
-    uri = nautilus_file_get_uri (file);
-    escaped_uri = g_uri_escape_string (uri, NULL, TRUE);
-    action_name = g_strconcat ("template_", escaped_uri, NULL);
-    action = G_ACTION (g_simple_action_new (action_name, NULL));
-    parameters = create_template_parameters_new (file, view);
-
-    g_signal_connect_data (action, "activate",
-                           G_CALLBACK (create_template),
-                           parameters,
-                           (GClosureNotify) create_templates_parameters_free, 0);
-
-    g_action_map_add_action (G_ACTION_MAP (priv->view_action_group), action);
-
-    detailed_action_name = g_strconcat ("view.", action_name, NULL);
-    label = eel_str_double_underscores (name);
-    menu_item = g_menu_item_new (label, detailed_action_name);
+    g_autofree char *scripts_path = NULL;
+    g_autoptr (GFile) scripts_directory = NULL;
+    g_autoptr (GFile) script = NULL;
 
-    mimetype_icon = get_menu_icon_for_file (file, GTK_WIDGET (view));
-    if (mimetype_icon != NULL)
+    if (path == NULL)
     {
-        g_menu_item_set_icon (menu_item, G_ICON (mimetype_icon));
-        g_object_unref (mimetype_icon);
+        return FALSE;
     }
 
-    g_menu_append_item (menu, menu_item);
+    scripts_path = nautilus_get_scripts_directory_path ();
+    scripts_directory = g_file_new_for_path (scripts_path);
+    /* Which resolves the “..” in it */
+    script = g_file_new_for_path (path);
 
-    g_free (name);
-    g_free (uri);
-    g_free (action_name);
-    g_free (detailed_action_name);
-    g_object_unref (action);
-    g_object_unref (menu_item);
+    return g_file_has_prefix (script, scripts_directory) &&
+           !g_file_test (path, G_FILE_TEST_IS_DIR) &&
+           g_file_test (path, G_FILE_TEST_IS_EXECUTABLE);
 }
 
 static void
-update_templates_directory (NautilusFilesView *view)
+action_run_script (GSimpleAction *action,
+                   GVariant      *parameter,
+                   gpointer       user_data)
 {
+    NautilusFilesView *view;
     NautilusFilesViewPrivate *priv;
-    NautilusDirectory *templates_directory;
-    GList *node, *next;
-    char *templates_uri;
+    const gchar *file_uri;
+    g_autofree gchar *local_file_path = NULL;
+    g_autofree gchar *quoted_path = NULL;
+    g_autofree gchar *old_working_dir = NULL;
+    g_autolist (NautilusFile) selection = NULL;
+    g_auto (GStrv) parameters = NULL;
+    GdkScreen *screen;
 
+    view = NAUTILUS_FILES_VIEW (user_data);
     priv = nautilus_files_view_get_instance_private (view);
 
-    for (node = priv->templates_directory_list; node != NULL; node = next)
+    file_uri = g_variant_get_string (parameter, NULL);
+    local_file_path = g_filename_from_uri (file_uri, NULL, NULL);
+    if (!is_runnable_script (local_file_path))
     {
-        next = node->next;
-        remove_directory_from_templates_directory_list (view, node->data);
+        g_warning ("Not running “%s”, which is not a script of the scripts folder", file_uri);
+        return;
     }
+    quoted_path = g_shell_quote (local_file_path);
 
-    if (nautilus_should_use_templates_directory ())
-    {
-        templates_uri = nautilus_get_templates_directory_uri ();
-        templates_directory = nautilus_directory_get_by_uri (templates_uri);
-        g_free (templates_uri);
-        add_directory_to_templates_directory_list (view, templates_directory);
-        nautilus_directory_unref (templates_directory);
-    }
-}
+    old_working_dir = change_to_view_directory (view);
 
-static gboolean
-directory_belongs_in_templates_menu (const char *templates_directory_uri,
-                                     const char *uri)
-{
-    int num_levels;
-    int i;
+    selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+    set_script_environment_variables (view, selection);
 
-    if (templates_directory_uri == NULL)
-    {
-        return FALSE;
-    }
+    parameters = get_file_names_as_parameter_array (selection, priv->model);
 
-    if (!g_str_has_prefix (uri, templates_directory_uri))
-    {
-        return FALSE;
-    }
+    screen = gtk_widget_get_screen (GTK_WIDGET (view));
 
-    num_levels = 0;
-    for (i = strlen (templates_directory_uri); uri[i] != '\0'; i++)
-    {
-        if (uri[i] == '/')
-        {
-            num_levels++;
-        }
-    }
+    DEBUG ("run_script, script_path=“%s” (omitting script parameters)",
+           local_file_path);
 
-    if (num_levels > MAX_MENU_LEVELS)
-    {
-        return FALSE;
-    }
+    nautilus_launch_application_from_command_array (screen, quoted_path, FALSE,
+                                                    (const char * const *) parameters);
 
-    return TRUE;
+    unset_script_environment_variables ();
+    g_chdir (old_working_dir);
 }
 
-static gboolean
-filter_templates_callback (NautilusFile *file,
-                           gpointer      callback_data)
+static void
+directory_menu_changed (NautilusFilesView *view)
 {
-    gboolean show_hidden = GPOINTER_TO_INT (callback_data);
+    NautilusFilesViewPrivate *priv;
 
-    if (nautilus_file_is_hidden_file (file))
-    {
-        if (!show_hidden)
-        {
-            return FALSE;
-        }
+    priv = nautilus_files_view_get_instance_private (view);
 
-        if (nautilus_file_is_directory (file))
-        {
-            return FALSE;
-        }
+    if (priv->active)
+    {
+        schedule_update_context_menus (view);
     }
-
-    return TRUE;
-}
-
-static GList *
-filter_templates (GList    *files,
-                  gboolean  show_hidden)
-{
-    GList *filtered_files;
-    GList *removed_files;
-
-    filtered_files = nautilus_file_list_filter (files,
-                                                &removed_files,
-                                                filter_templates_callback,
-                                                GINT_TO_POINTER (show_hidden));
-    nautilus_file_list_free (removed_files);
-
-    return filtered_files;
 }
 
-static GMenuModel *
-update_directory_in_templates_menu (NautilusFilesView *view,
-                                    NautilusDirectory *directory)
+static void
+update_scripts_menu (NautilusFilesView *view,
+                     GtkBuilder        *builder)
 {
     NautilusFilesViewPrivate *priv;
-    GList *file_list, *filtered, *node;
-    GMenu *menu;
-    GMenuItem *menu_item;
-    gboolean any_templates;
-    NautilusFile *file;
-    NautilusDirectory *dir;
-    char *uri;
-    char *templates_directory_uri;
-    int num;
-
-    g_return_val_if_fail (NAUTILUS_IS_FILES_VIEW (view), NULL);
-    g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
+    NautilusDirectoryMenu *scripts;
 
     priv = nautilus_files_view_get_instance_private (view);
+    scripts = nautilus_directory_menu_get_scripts ();
 
-    file_list = nautilus_directory_get_file_list (directory);
-
-    /*
-     * The nautilus_file_list_filter_hidden() function isn't used here, because
-     * we want to show hidden files, but not directories. This is a compromise
-     * to allow creating hidden files but to prevent content from .git directory
-     * for example. See https://gitlab.gnome.org/GNOME/nautilus/issues/1413.
-     */
-    filtered = filter_templates (file_list, priv->show_hidden_files);
-    nautilus_file_list_free (file_list);
-    templates_directory_uri = nautilus_get_templates_directory_uri ();
-    menu = g_menu_new ();
-
-    filtered = nautilus_file_list_sort_by_display_name (filtered);
-
-    num = 0;
-    any_templates = FALSE;
-    for (node = filtered; num < TEMPLATE_LIMIT && node != NULL; node = node->next, num++)
+    priv->scripts_present = !nautilus_directory_menu_is_empty (scripts);
+    if (priv->scripts_present)
     {
-        file = node->data;
-        if (nautilus_file_is_directory (file))
-        {
-            uri = nautilus_file_get_uri (file);
-            if (directory_belongs_in_templates_menu (templates_directory_uri, uri))
-            {
-                g_autoptr (GMenuModel) children_menu = NULL;
-
-                dir = nautilus_directory_get_by_uri (uri);
-                add_directory_to_templates_directory_list (view, dir);
-
-                children_menu = update_directory_in_templates_menu (view, dir);
-
-                if (children_menu != NULL)
-                {
-                    g_autofree char *display_name = NULL;
-                    g_autofree char *label = NULL;
-
-                    display_name = nautilus_file_get_display_name (file);
-                    label = eel_str_double_underscores (display_name);
-                    menu_item = g_menu_item_new_submenu (label, children_menu);
-                    g_menu_append_item (menu, menu_item);
-                    any_templates = TRUE;
-                    g_object_unref (menu_item);
-                }
+        GObject *object;
 
-                nautilus_directory_unref (dir);
-            }
-            g_free (uri);
-        }
-        else if (nautilus_file_can_read (file))
-        {
-            add_template_to_templates_menus (view, file, menu);
-            any_templates = TRUE;
-        }
+        object = gtk_builder_get_object (builder, "scripts-submenu");
+        nautilus_gmenu_set_from_model (G_MENU (object),
+                                       nautilus_directory_menu_get_model (scripts));
     }
+}
 
-    nautilus_file_list_free (filtered);
-    g_free (templates_directory_uri);
+static void
+action_create_from_template (GSimpleAction *action,
+                             GVariant      *parameter,
+                             gpointer       user_data)
+{
+    NautilusFilesView *view;
+    g_autoptr (NautilusFile) file = NULL;
 
-    if (!any_templates)
-    {
-        g_object_unref (menu);
-        menu = NULL;
-    }
+    view = NAUTILUS_FILES_VIEW (user_data);
+    file = nautilus_file_get_by_uri (g_variant_get_string (parameter, NULL));
 
-    return G_MENU_MODEL (menu);
+    nautilus_files_view_new_file (view, NULL, file);
 }
 
-
-
 static void
 update_templates_menu (NautilusFilesView *view,
                        GtkBuilder        *builder)
 {
     NautilusFilesViewPrivate *priv;
-    GList *sorted_copy, *node;
-    NautilusDirectory *directory;
-    g_autoptr (GMenuModel) submenu = NULL;
-    char *uri;
-    char *templates_directory_uri;
+    NautilusDirectoryMenu *templates;
+    GMenuModel *submenu = NULL;
 
     priv = nautilus_files_view_get_instance_private (view);
 
-    if (nautilus_should_use_templates_directory ())
-    {
-        templates_directory_uri = nautilus_get_templates_directory_uri ();
-    }
-    else
+    if (!nautilus_should_use_templates_directory ())
     {
         priv->templates_present = FALSE;
         return;
     }
 
-
-    sorted_copy = nautilus_directory_list_sort_by_uri
-                      (nautilus_directory_list_copy (priv->templates_directory_list));
-
-    for (node = sorted_copy; node != NULL; node = node->next)
-    {
-        directory = node->data;
-
-        uri = nautilus_directory_get_uri (directory);
-        if (!directory_belongs_in_templates_menu (templates_directory_uri, uri))
-        {
-            remove_directory_from_templates_directory_list (view, directory);
-        }
-        g_free (uri);
-    }
-    nautilus_directory_list_free (sorted_copy);
-
-    directory = nautilus_directory_get_by_uri (templates_directory_uri);
-    submenu = update_directory_in_templates_menu (view, directory);
-    if (submenu != NULL)
+    templates = nautilus_directory_menu_get_templates ();
+    if (!nautilus_directory_menu_is_empty (templates))
     {
         GObject *object;
+
+        submenu = nautilus_directory_menu_get_model (templates);
         object = gtk_builder_get_object (builder, "templates-submenu");
         nautilus_gmenu_set_from_model (G_MENU (object), submenu);
     }
 
     nautilus_view_set_templates_menu (NAUTILUS_VIEW (view), submenu);
 
-    nautilus_directory_unref (directory);
-
     priv->templates_present = submenu != NULL;
-
-    g_free (templates_directory_uri);
 }
 
-
 static void
 action_open_scripts_folder (GSimpleAction *action,
                             GVariant      *state,
@@ -5874,7 +5796,7 @@ action_open_scripts_folder (GSimpleAction *action,
 
     if (location == NULL)
     {
-        location = g_file_new_for_uri (scripts_directory_uri);
+        location = g_file_new_for_uri (nautilus_directory_menu_get_uri (nautilus_directory_menu_get_scripts ()));
     }
 
     nautilus_application_open_location_full (NAUTILUS_APPLICATION (g_application_get_default ()),
@@ -7088,6 +7010,8 @@ const GActionEntry view_entries[] =
     { "scripts" },
     { "new-folder-with-selection", action_new_folder_with_selection },
     { "open-scripts-folder", action_open_scripts_folder },
+    { "run-script", action_run_script, "s" },
+    { "create-from-template", action_create_from_template, "s" },
     { "open-item-location", action_open_item_location },
     { "open-with-default-application", action_open_with_default_application },
     { "open-with-other-application", action_open_with_other_application },
@@ -7218,71 +7142,19 @@ on_clipboard_contents_received (GtkClipboard *clipboard,
                                  is_data_valid && g_action_get_enabled (action));
 
     action = g_action_map_lookup_action (G_ACTION_MAP (priv->view_action_group),
-                                         "paste-into");
-
-    g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-                                 is_data_valid && g_action_get_enabled (action));
-
-    action = g_action_map_lookup_action (G_ACTION_MAP (priv->view_action_group),
-                                         "create-link");
-
-    g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-                                 is_data_valid && g_action_get_enabled (action));
-
-
-    g_object_unref (view);
-}
-
-static void
-file_should_show_foreach (NautilusFile        *file,
-                          gboolean            *show_mount,
-                          gboolean            *show_unmount,
-                          gboolean            *show_eject,
-                          gboolean            *show_start,
-                          gboolean            *show_stop,
-                          gboolean            *show_poll,
-                          GDriveStartStopType *start_stop_type)
-{
-    *show_mount = FALSE;
-    *show_unmount = FALSE;
-    *show_eject = FALSE;
-    *show_start = FALSE;
-    *show_stop = FALSE;
-    *show_poll = FALSE;
-
-    if (nautilus_file_can_eject (file))
-    {
-        *show_eject = TRUE;
-    }
-
-    if (nautilus_file_can_mount (file))
-    {
-        *show_mount = TRUE;
-    }
-
-    if (nautilus_file_can_start (file) || nautilus_file_can_start_degraded (file))
-    {
-        *show_start = TRUE;
-    }
+                                         "paste-into");
 
-    if (nautilus_file_can_stop (file))
-    {
-        *show_stop = TRUE;
-    }
+    g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
+                                 is_data_valid && g_action_get_enabled (action));
 
-    /* Dot not show both Unmount and Eject/Safe Removal; too confusing to
-     * have too many menu entries */
-    if (nautilus_file_can_unmount (file) && !*show_eject && !*show_stop)
-    {
-        *show_unmount = TRUE;
-    }
+    action = g_action_map_lookup_action (G_ACTION_MAP (priv->view_action_group),
+                                         "create-link");
 
-    if (nautilus_file_can_poll_for_media (file) && !nautilus_file_is_media_check_automatic (file))
-    {
-        *show_poll = TRUE;
-    }
+    g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
+                                 is_data_valid && g_action_get_enabled (action));
 
-    *start_stop_type = nautilus_file_get_start_stop_type (file);
+
+    g_object_unref (view);
 }
 
 static gboolean
@@ -7343,91 +7215,6 @@ on_clipboard_owner_changed (GtkClipboard *clipboard,
     nautilus_files_view_update_context_menus (self);
 }
 
-static gboolean
-can_delete_all (GList *files)
-{
-    NautilusFile *file;
-    GList *l;
-
-    for (l = files; l != NULL; l = l->next)
-    {
-        file = l->data;
-        if (!nautilus_file_can_delete (file))
-        {
-            return FALSE;
-        }
-    }
-    return TRUE;
-}
-
-static gboolean
-can_trash_all (GList *files)
-{
-    NautilusFile *file;
-    GList *l;
-
-    for (l = files; l != NULL; l = l->next)
-    {
-        file = l->data;
-        if (!nautilus_file_can_trash (file))
-        {
-            return FALSE;
-        }
-    }
-    return TRUE;
-}
-
-static gboolean
-all_in_trash (GList *files)
-{
-    NautilusFile *file;
-    GList *l;
-
-    for (l = files; l != NULL; l = l->next)
-    {
-        file = l->data;
-        if (!nautilus_file_is_in_trash (file))
-        {
-            return FALSE;
-        }
-    }
-    return TRUE;
-}
-
-static gboolean
-can_extract_all (GList *files)
-{
-    NautilusFile *file;
-    GList *l;
-
-    for (l = files; l != NULL; l = l->next)
-    {
-        file = l->data;
-        if (!nautilus_file_is_archive (file))
-        {
-            return FALSE;
-        }
-    }
-    return TRUE;
-}
-
-static gboolean
-nautilus_handles_all_files_to_extract (GList *files)
-{
-    NautilusFile *file;
-    GList *l;
-
-    for (l = files; l != NULL; l = l->next)
-    {
-        file = l->data;
-        if (!nautilus_mime_file_extracts (file))
-        {
-            return FALSE;
-        }
-    }
-    return TRUE;
-}
-
 GActionGroup *
 nautilus_files_view_get_action_group (NautilusFilesView *view)
 {
@@ -7445,7 +7232,6 @@ real_update_actions_state (NautilusFilesView *view)
 {
     NautilusFilesViewPrivate *priv;
     g_autolist (NautilusFile) selection = NULL;
-    GList *l;
     gint selection_count;
     gboolean zoom_level_is_default;
     gboolean selection_contains_home_dir;
@@ -7472,41 +7258,39 @@ real_update_actions_state (NautilusFilesView *view)
     gboolean show_eject;
     gboolean show_start;
     gboolean show_stop;
-    gboolean show_detect_media;
     gboolean settings_show_delete_permanently;
     gboolean settings_show_create_link;
-    GDriveStartStopType start_stop_type;
     g_autoptr (GFile) current_location = NULL;
     g_autofree gchar *current_uri = NULL;
     gboolean can_star_current_directory;
     gboolean show_star;
     gboolean show_unstar;
-    gchar *uri;
 
     priv = nautilus_files_view_get_instance_private (view);
 
     view_action_group = priv->view_action_group;
 
     selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
-    selection_count = g_list_length (selection);
-    selection_contains_home_dir = home_dir_in_selection (selection);
+    update_selection_stats (view, selection);
+    selection_count = g_hash_table_size (priv->selection_stats);
+    selection_contains_home_dir = selection_any (priv, SELECTION_IS_HOME);
     selection_contains_recent = showing_recent_directory (view);
     selection_contains_starred = showing_starred_directory (view);
     selection_contains_search = nautilus_view_is_searching (NAUTILUS_VIEW (view));
     selection_is_read_only = selection_count == 1 &&
                              (!nautilus_file_can_write (NAUTILUS_FILE (selection->data)) &&
                               !nautilus_file_has_activation_uri (NAUTILUS_FILE (selection->data)));
-    selection_all_in_trash = all_in_trash (selection);
+    selection_all_in_trash = selection_all (priv, SELECTION_IS_IN_TRASH);
     zoom_level_is_default = nautilus_files_view_is_zoom_level_default (view);
 
     is_read_only = nautilus_files_view_is_read_only (view);
     can_create_files = nautilus_files_view_supports_creating_files (view);
     can_delete_files =
-        can_delete_all (selection) &&
+        selection_all (priv, SELECTION_CAN_DELETE) &&
         selection_count != 0 &&
         !selection_contains_home_dir;
     can_trash_files =
-        can_trash_all (selection) &&
+        selection_all (priv, SELECTION_CAN_TRASH) &&
         selection_count != 0 &&
         !selection_contains_home_dir;
     can_copy_files = selection_count != 0;
@@ -7517,9 +7301,9 @@ real_update_actions_state (NautilusFilesView *view)
                             selection_count == 1 &&
                             can_paste_into_file (NAUTILUS_FILE (selection->data)));
     can_extract_files = selection_count != 0 &&
-                        can_extract_all (selection);
+                        selection_all (priv, SELECTION_IS_ARCHIVE);
     can_extract_here = nautilus_files_view_supports_extract_here (view);
-    handles_all_files_to_extract = nautilus_handles_all_files_to_extract (selection);
+    handles_all_files_to_extract = selection_all (priv, SELECTION_EXTRACTS);
     settings_show_delete_permanently = g_settings_get_boolean (nautilus_preferences,
                                                                NAUTILUS_PREFERENCES_SHOW_DELETE_PERMANENTLY);
     settings_show_create_link = g_settings_get_boolean (nautilus_preferences,
@@ -7535,17 +7319,9 @@ real_update_actions_state (NautilusFilesView *view)
 
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "rename");
-    if (selection_count > 1)
-    {
-        g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-                                     nautilus_file_can_rename_files (selection));
-    }
-    else
-    {
-        g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-                                     selection_count == 1 &&
-                                     nautilus_file_can_rename (selection->data));
-    }
+    g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
+                                 selection_count != 0 &&
+                                 selection_all (priv, SELECTION_CAN_RENAME));
 
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "extract-here");
@@ -7578,24 +7354,8 @@ real_update_actions_state (NautilusFilesView *view)
                                          "new-folder");
     g_simple_action_set_enabled (G_SIMPLE_ACTION (action), can_create_files);
 
-    item_opens_in_view = selection_count != 0;
-
-    for (l = selection; l != NULL; l = l->next)
-    {
-        NautilusFile *file;
-
-        file = NAUTILUS_FILE (selection->data);
-
-        if (!nautilus_file_opens_in_view (file))
-        {
-            item_opens_in_view = FALSE;
-        }
-
-        if (!item_opens_in_view)
-        {
-            break;
-        }
-    }
+    item_opens_in_view = selection_count != 0 &&
+                         selection_all (priv, SELECTION_OPENS_IN_VIEW);
 
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "open-with-default-application");
@@ -7618,7 +7378,9 @@ real_update_actions_state (NautilusFilesView *view)
     g_simple_action_set_enabled (G_SIMPLE_ACTION (action), can_set_wallpaper (selection));
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "restore-from-trash");
-    g_simple_action_set_enabled (G_SIMPLE_ACTION (action), can_restore_from_trash (selection));
+    g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
+                                 selection_any (priv, SELECTION_IS_IN_TRASH) &&
+                                 can_restore_from_trash (selection));
 
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "move-to-trash");
@@ -7680,43 +7442,12 @@ real_update_actions_state (NautilusFilesView *view)
                                  !selection_contains_starred);
 
     /* Drive menu */
-    show_mount = (selection != NULL);
-    show_unmount = (selection != NULL);
-    show_eject = (selection != NULL);
-    show_start = (selection != NULL && selection_count == 1);
-    show_stop = (selection != NULL && selection_count == 1);
-    show_detect_media = (selection != NULL && selection_count == 1);
-    for (l = selection; l != NULL && (show_mount || show_unmount
-                                      || show_eject
-                                      || show_start || show_stop
-                                      || show_detect_media);
-         l = l->next)
-    {
-        NautilusFile *file;
-        gboolean show_mount_one;
-        gboolean show_unmount_one;
-        gboolean show_eject_one;
-        gboolean show_start_one;
-        gboolean show_stop_one;
-        gboolean show_detect_media_one;
-
-        file = NAUTILUS_FILE (l->data);
-        file_should_show_foreach (file,
-                                  &show_mount_one,
-                                  &show_unmount_one,
-                                  &show_eject_one,
-                                  &show_start_one,
-                                  &show_stop_one,
-                                  &show_detect_media_one,
-                                  &start_stop_type);
-
-        show_mount &= show_mount_one;
-        show_unmount &= show_unmount_one;
-        show_eject &= show_eject_one;
-        show_start &= show_start_one;
-        show_stop &= show_stop_one;
-        show_detect_media &= show_detect_media_one;
-    }
+    show_mount = selection_count != 0 && selection_all (priv, SELECTION_SHOWS_MOUNT);
+    show_unmount = selection_count != 0 && selection_all (priv, SELECTION_SHOWS_UNMOUNT);
+    show_eject = selection_count != 0 && selection_all (priv, SELECTION_SHOWS_EJECT);
+    show_start = selection_count == 1 && selection_all (priv, SELECTION_SHOWS_START);
+    show_stop = selection_count == 1 && selection_all (priv, SELECTION_SHOWS_STOP);
+    show_detect_media = selection_count == 1 && selection_all (priv, SELECTION_SHOWS_DETECT_MEDIA);
 
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "mount-volume");
@@ -7815,32 +7546,11 @@ real_update_actions_state (NautilusFilesView *view)
     can_star_current_directory = nautilus_tag_manager_can_star_contents (priv->tag_manager, current_location);
 
     show_star = (selection != NULL) &&
-                (can_star_current_directory || selection_contains_starred);
+                (can_star_current_directory || selection_contains_starred) &&
+                priv->selection_starred_count == 0;
     show_unstar = (selection != NULL) &&
-                  (can_star_current_directory || selection_contains_starred);
-    for (l = selection; l != NULL; l = l->next)
-    {
-        NautilusFile *file;
-
-        file = NAUTILUS_FILE (l->data);
-        uri = nautilus_file_get_uri (file);
-
-        if (!show_star && !show_unstar)
-        {
-            break;
-        }
-
-        if (nautilus_tag_manager_file_is_starred (priv->tag_manager, uri))
-        {
-            show_star = FALSE;
-        }
-        else
-        {
-            show_unstar = FALSE;
-        }
-
-        g_free (uri);
-    }
+                  (can_star_current_directory || selection_contains_starred) &&
+                  priv->selection_starred_count == (guint) selection_count;
 
     action = g_action_map_lookup_action (G_ACTION_MAP (view_action_group),
                                          "star");
@@ -7864,84 +7574,34 @@ nautilus_files_view_update_actions_state (NautilusFilesView *view)
     NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->update_actions_state (view);
 }
 
+/* Looking up the default application of every selected file can take a
+ * while, so it is only done when the selection menu is shown. */
 static void
-update_selection_menu (NautilusFilesView *view,
-                       GtkBuilder        *builder)
+update_open_with_default_application_item (NautilusFilesView *view)
 {
+    NautilusFilesViewPrivate *priv;
     g_autolist (NautilusFile) selection = NULL;
-    GList *l;
-    gint selection_count;
     gboolean show_app;
     gboolean show_run;
     gboolean show_extract;
-    gboolean item_opens_in_view;
     gchar *item_label;
     GAppInfo *app;
     GIcon *app_icon;
     GMenuItem *menu_item;
-    GObject *object;
-    gboolean show_mount;
-    gboolean show_unmount;
-    gboolean show_eject;
-    gboolean show_start;
-    gboolean show_stop;
-    gboolean show_detect_media;
-    GDriveStartStopType start_stop_type;
 
-    selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
-    selection_count = g_list_length (selection);
-
-    show_mount = (selection != NULL);
-    show_unmount = (selection != NULL);
-    show_eject = (selection != NULL);
-    show_start = (selection != NULL && selection_count == 1);
-    show_stop = (selection != NULL && selection_count == 1);
-    show_detect_media = (selection != NULL && selection_count == 1);
-    start_stop_type = G_DRIVE_START_STOP_TYPE_UNKNOWN;
-    item_label = g_strdup_printf (ngettext ("New Folder with Selection (%'d Item)",
-                                            "New Folder with Selection (%'d Items)",
-                                            selection_count),
-                                  selection_count);
-    menu_item = g_menu_item_new (item_label, "view.new-folder-with-selection");
-    g_menu_item_set_attribute (menu_item, "hidden-when", "s", "action-disabled");
-    object = gtk_builder_get_object (builder, "new-folder-with-selection-section");
-    g_menu_append_item (G_MENU (object), menu_item);
-    g_object_unref (menu_item);
-    g_free (item_label);
+    priv = nautilus_files_view_get_instance_private (view);
 
-    /* Open With <App> menu item */
-    show_extract = show_app = show_run = item_opens_in_view = selection_count != 0;
-    for (l = selection; l != NULL; l = l->next)
+    if (priv->pending_open_with_section == NULL)
     {
-        NautilusFile *file;
-
-        file = NAUTILUS_FILE (l->data);
-
-        if (!nautilus_mime_file_extracts (file))
-        {
-            show_extract = FALSE;
-        }
-
-        if (!nautilus_mime_file_opens_in_external_app (file))
-        {
-            show_app = FALSE;
-        }
-
-        if (!nautilus_mime_file_launches (file))
-        {
-            show_run = FALSE;
-        }
+        return;
+    }
 
-        if (!nautilus_file_opens_in_view (file))
-        {
-            item_opens_in_view = FALSE;
-        }
+    selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+    update_selection_stats (view, selection);
 
-        if (!show_extract && !show_app && !show_run && !item_opens_in_view)
-        {
-            break;
-        }
-    }
+    show_app = selection != NULL && selection_all (priv, SELECTION_OPENS_IN_EXTERNAL_APP);
+    show_run = selection != NULL && selection_all (priv, SELECTION_LAUNCHES);
+    show_extract = selection != NULL && selection_all (priv, SELECTION_EXTRACTS);
 
     item_label = NULL;
     app = NULL;
@@ -7985,47 +7645,61 @@ update_selection_menu (NautilusFilesView *view,
     if (app_icon != NULL)
     {
         g_menu_item_set_icon (menu_item, app_icon);
+        g_object_unref (app_icon);
     }
 
-    object = gtk_builder_get_object (builder, "open-with-default-application-section");
-    g_menu_append_item (G_MENU (object), menu_item);
+    g_menu_append_item (priv->pending_open_with_section, menu_item);
+    g_clear_object (&priv->pending_open_with_section);
 
     g_free (item_label);
     g_object_unref (menu_item);
+}
 
-    /* Drives */
-    for (l = selection; l != NULL && (show_mount || show_unmount
-                                      || show_eject
-                                      || show_start || show_stop
-                                      || show_detect_media);
-         l = l->next)
-    {
-        NautilusFile *file;
-        gboolean show_mount_one;
-        gboolean show_unmount_one;
-        gboolean show_eject_one;
-        gboolean show_start_one;
-        gboolean show_stop_one;
-        gboolean show_detect_media_one;
+static void
+update_selection_menu (NautilusFilesView *view,
+                       GtkBuilder        *builder)
+{
+    NautilusFilesViewPrivate *priv;
+    g_autolist (NautilusFile) selection = NULL;
+    gint selection_count;
+    gchar *item_label;
+    GMenuItem *menu_item;
+    GObject *object;
+    gboolean show_start;
+    gboolean show_stop;
+    GDriveStartStopType start_stop_type;
+    SelectionStatsEntry *entry;
 
-        file = NAUTILUS_FILE (l->data);
-        file_should_show_foreach (file,
-                                  &show_mount_one,
-                                  &show_unmount_one,
-                                  &show_eject_one,
-                                  &show_start_one,
-                                  &show_stop_one,
-                                  &show_detect_media_one,
-                                  &start_stop_type);
-
-        show_mount &= show_mount_one;
-        show_unmount &= show_unmount_one;
-        show_eject &= show_eject_one;
-        show_start &= show_start_one;
-        show_stop &= show_stop_one;
-        show_detect_media &= show_detect_media_one;
+    priv = nautilus_files_view_get_instance_private (view);
+
+    selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+    update_selection_stats (view, selection);
+    selection_count = g_hash_table_size (priv->selection_stats);
+
+    show_start = selection_count == 1 && selection_all (priv, SELECTION_SHOWS_START);
+    show_stop = selection_count == 1 && selection_all (priv, SELECTION_SHOWS_STOP);
+    start_stop_type = G_DRIVE_START_STOP_TYPE_UNKNOWN;
+    if (selection_count == 1)
+    {
+        entry = g_hash_table_lookup (priv->selection_stats, selection->data);
+        start_stop_type = entry->start_stop_type;
     }
 
+    item_label = g_strdup_printf (ngettext ("New Folder with Selection (%'d Item)",
+                                            "New Folder with Selection (%'d Items)",
+                                            selection_count),
+                                  selection_count);
+    menu_item = g_menu_item_new (item_label, "view.new-folder-with-selection");
+    g_menu_item_set_attribute (menu_item, "hidden-when", "s", "action-disabled");
+    object = gtk_builder_get_object (builder, "new-folder-with-selection-section");
+    g_menu_append_item (G_MENU (object), menu_item);
+    g_object_unref (menu_item);
+    g_free (item_label);
+
+    /* Open With <App> menu item, filled in when the menu is shown */
+    object = gtk_builder_get_object (builder, "open-with-default-application-section");
+    g_set_object (&priv->pending_open_with_section, G_MENU (object));
+
     if (show_start)
     {
         switch (start_stop_type)
@@ -8252,6 +7926,7 @@ nautilus_files_view_pop_up_selection_context_menu  (NautilusFilesView *view,
      * etc. states by forcing menus to update now.
      */
     update_context_menus_if_pending (view);
+    update_open_with_default_application_item (view);
 
     if (NULL == priv->selection_menu)
     {
@@ -8425,9 +8100,10 @@ schedule_update_status (NautilusFilesView *view)
         return;
     }
 
-    if (priv->loading)
+    if (priv->loading || is_suspended (view))
     {
-        /* Don't update status bar while loading the dir */
+        /* Don't update status bar while loading the dir, or while
+         * it isn't shown */
         return;
     }
 
@@ -8465,11 +8141,21 @@ nautilus_files_view_notify_selection_changed (NautilusFilesView *view)
     priv->selection_was_removed = FALSE;
 
     /* Schedule a display of the new selection. */
-    if (priv->display_selection_idle_id == 0)
+    if (priv->display_selection_idle_id == 0 && priv->display_selection_tick_id == 0)
     {
-        priv->display_selection_idle_id
-            = g_idle_add (display_selection_info_idle_callback,
-                          view);
+        if (gtk_widget_get_mapped (GTK_WIDGET (view)))
+        {
+            priv->display_selection_tick_id
+                = gtk_widget_add_tick_callback (GTK_WIDGET (view),
+                                                display_selection_info_tick_callback,
+                                                NULL, NULL);
+        }
+        else
+        {
+            priv->display_selection_idle_id
+                = g_idle_add (display_selection_info_idle_callback,
+                              view);
+        }
     }
 
     if (priv->batching_selection_level != 0)
@@ -8654,17 +8340,7 @@ finish_loading (NautilusFilesView *view)
     priv->load_error_handler_id = g_signal_connect (priv->model, "load-error",
                                                     G_CALLBACK (load_error_callback), view);
 
-    /* Monitor the things needed to get the right icon. Also
-     * monitor a directory's item count because the "size"
-     * attribute is based on that, and the file's metadata
-     * and possible custom name.
-     */
-    attributes =
-        NAUTILUS_FILE_ATTRIBUTES_FOR_ICON |
-        NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT |
-        NAUTILUS_FILE_ATTRIBUTE_INFO |
-        NAUTILUS_FILE_ATTRIBUTE_MOUNT |
-        NAUTILUS_FILE_ATTRIBUTE_EXTENSION_INFO;
+    attributes = get_monitored_attributes (view);
 
     priv->files_added_handler_id = g_signal_connect
                                        (priv->model, "files-added",
@@ -8812,8 +8488,8 @@ nautilus_files_view_stop_loading (NautilusFilesView *view)
     g_list_free_full (priv->old_added_files, file_and_directory_free);
     priv->old_added_files = NULL;
 
-    g_list_free_full (priv->old_changed_files, file_and_directory_free);
-    priv->old_changed_files = NULL;
+    g_hash_table_remove_all (priv->old_changed_files);
+    g_hash_table_remove_all (priv->suspended_changed_files);
 
     g_list_free_full (priv->pending_selection, g_object_unref);
     priv->pending_selection = NULL;
@@ -9303,6 +8979,7 @@ nautilus_files_view_parent_set (GtkWidget *widget,
     }
     else
     {
+        priv->active = FALSE;
         remove_update_context_menus_timeout_callback (view);
         /* Only remove the action group if it matchs the current view
          * action group. If not, we can remove an action group set by
@@ -9634,9 +9311,6 @@ nautilus_files_view_init (NautilusFilesView *view)
     NautilusFilesViewPrivate *priv;
     GtkBuilder *builder;
     AtkObject *atk_object;
-    NautilusDirectory *scripts_directory;
-    NautilusDirectory *templates_directory;
-    gchar *templates_uri;
     GtkClipboard *clipboard;
     GApplication *app;
     const gchar *open_accels[] =
@@ -9710,6 +9384,16 @@ nautilus_files_view_init (NautilusFilesView *view)
                       "end-file-changes",
                       G_CALLBACK (on_end_file_changes),
                       view);
+    g_signal_connect (view,
+                      "map",
+                      G_CALLBACK (on_map),
+                      NULL);
+    g_signal_connect (view,
+                      "unmap",
+                      G_CALLBACK (on_unmap),
+                      NULL);
+
+    priv->display_pending_chunk_size = MAX_QUEUED_UPDATES;
 
     g_object_unref (builder);
 
@@ -9790,37 +9474,26 @@ nautilus_files_view_init (NautilusFilesView *view)
                       G_CALLBACK (floating_bar_action_cb),
                       view);
 
-    priv->non_ready_files =
-        g_hash_table_new_full (file_and_directory_hash,
-                               file_and_directory_equal,
-                               file_and_directory_free,
-                               NULL);
+    priv->non_ready_files = file_and_directory_set_new ();
+    priv->old_changed_files = file_and_directory_set_new ();
+    priv->suspended_changed_files = file_and_directory_set_new ();
 
     priv->pending_reveal = g_hash_table_new (NULL, NULL);
 
+    priv->selection_stats = g_hash_table_new_full (NULL, NULL,
+                                                   (GDestroyNotify) nautilus_file_unref,
+                                                   g_free);
+    priv->selection_deep_count_files = g_hash_table_new_full (NULL, NULL,
+                                                              (GDestroyNotify) nautilus_file_unref,
+                                                              NULL);
+
     gtk_style_context_set_junction_sides (gtk_widget_get_style_context (GTK_WIDGET (view)),
                                           GTK_JUNCTION_TOP | GTK_JUNCTION_LEFT);
 
-    if (set_up_scripts_directory_global ())
-    {
-        scripts_directory = nautilus_directory_get_by_uri (scripts_directory_uri);
-        add_directory_to_scripts_directory_list (view, scripts_directory);
-        nautilus_directory_unref (scripts_directory);
-    }
-    else
-    {
-        g_warning ("Ignoring scripts directory, it may be a broken link\n");
-    }
-
-    if (nautilus_should_use_templates_directory ())
-    {
-        templates_uri = nautilus_get_templates_directory_uri ();
-        templates_directory = nautilus_directory_get_by_uri (templates_uri);
-        g_free (templates_uri);
-        add_directory_to_templates_directory_list (view, templates_directory);
-        nautilus_directory_unref (templates_directory);
-    }
-    update_templates_directory (view);
+    g_signal_connect_object (nautilus_directory_menu_get_scripts (), "changed",
+                             G_CALLBACK (directory_menu_changed), view, G_CONNECT_SWAPPED);
+    g_signal_connect_object (nautilus_directory_menu_get_templates (), "changed",
+                             G_CALLBACK (directory_menu_changed), view, G_CONNECT_SWAPPED);
 
     priv->sort_directories_first =
         g_settings_get_boolean (gtk_filechooser_preferences, NAUTILUS_PREFERENCES_SORT_DIRECTORIES_FIRST);
@@ -239,6 +239,10 @@ struct _NautilusFilesViewClass {
 
         void           (* preview_selection_event)     (NautilusFilesView *view,
                                                         GtkDirectionType   direction);
+
+        /* The attributes the view asks for itself, for the files it shows,
+         * and which are left out of those monitored for all of them. */
+        NautilusFileAttributes (* get_lazy_attributes) (NautilusFilesView *view);
 };
 
 NautilusFilesView *      nautilus_files_view_new                         (guint               id,
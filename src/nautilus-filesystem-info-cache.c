@@ -0,0 +1,200 @@
+/* nautilus-filesystem-info-cache.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-filesystem-info-cache.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_ASYNC_JOBS
+#include "nautilus-debug.h"
+
+typedef struct
+{
+    NautilusFilesystemInfoCallback callback;
+    gpointer user_data;
+} Waiter;
+
+typedef struct
+{
+    char *filesystem_id; /* NULL if not shared */
+    GFileInfo *info;
+    gint64 time;
+    GSList *waiters; /* of Waiter, newest first */
+    gboolean in_progress;
+    guint idle_id; /* to call the waiters of a fresh entry */
+} FilesystemInfoEntry;
+
+/* Filesystem id -> FilesystemInfoEntry, never removed: there are only so
+ * many filesystems */
+static GHashTable *entries = NULL;
+
+static void
+entry_free (FilesystemInfoEntry *entry)
+{
+    g_free (entry->filesystem_id);
+    g_clear_object (&entry->info);
+    g_slist_free_full (entry->waiters, g_free);
+
+    g_free (entry);
+}
+
+static GHashTable *
+get_entries (void)
+{
+    if (entries == NULL)
+    {
+        entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, (GDestroyNotify) entry_free);
+    }
+
+    return entries;
+}
+
+static gboolean
+entry_is_fresh (FilesystemInfoEntry *entry)
+{
+    return entry->time != 0 &&
+           g_get_monotonic_time () - entry->time <
+           NAUTILUS_FILESYSTEM_INFO_TTL_SECONDS * G_USEC_PER_SEC;
+}
+
+GFileInfo *
+nautilus_filesystem_info_cache_lookup (const char *filesystem_id)
+{
+    FilesystemInfoEntry *entry;
+
+    if (filesystem_id == NULL)
+    {
+        return NULL;
+    }
+
+    entry = g_hash_table_lookup (get_entries (), filesystem_id);
+    if (entry == NULL || !entry_is_fresh (entry))
+    {
+        return NULL;
+    }
+
+    return entry->info;
+}
+
+static void
+call_waiters (FilesystemInfoEntry *entry)
+{
+    GSList *waiters;
+
+    /* Newer waiters start a new query, if the callbacks add any */
+    waiters = g_slist_reverse (g_steal_pointer (&entry->waiters));
+    for (GSList *l = waiters; l != NULL; l = l->next)
+    {
+        Waiter *waiter = l->data;
+
+        if (waiter->callback != NULL)
+        {
+            waiter->callback (entry->info, waiter->user_data);
+        }
+    }
+    g_slist_free_full (waiters, g_free);
+}
+
+static gboolean
+call_fresh_waiters (gpointer user_data)
+{
+    FilesystemInfoEntry *entry = user_data;
+
+    entry->idle_id = 0;
+    call_waiters (entry);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+query_info_callback (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+    FilesystemInfoEntry *entry = user_data;
+    g_autoptr (GError) error = NULL;
+
+    g_clear_object (&entry->info);
+    entry->info = g_file_query_filesystem_info_finish (G_FILE (source_object), res, &error);
+    entry->in_progress = FALSE;
+
+    if (entry->info != NULL)
+    {
+        entry->time = g_get_monotonic_time ();
+    }
+    else
+    {
+        /* Not cached, the next query tries again */
+        DEBUG ("Failed to query filesystem info: %s", error->message);
+        entry->time = 0;
+    }
+
+    call_waiters (entry);
+
+    if (entry->filesystem_id == NULL)
+    {
+        entry_free (entry);
+    }
+}
+
+void
+nautilus_filesystem_info_cache_query (GFile                          *location,
+                                      const char                     *filesystem_id,
+                                      NautilusFilesystemInfoCallback  callback,
+                                      gpointer                        user_data)
+{
+    FilesystemInfoEntry *entry;
+    Waiter *waiter;
+
+    entry = NULL;
+    if (filesystem_id != NULL)
+    {
+        entry = g_hash_table_lookup (get_entries (), filesystem_id);
+    }
+    if (entry == NULL)
+    {
+        entry = g_new0 (FilesystemInfoEntry, 1);
+        if (filesystem_id != NULL)
+        {
+            entry->filesystem_id = g_strdup (filesystem_id);
+            g_hash_table_insert (get_entries (), entry->filesystem_id, entry);
+        }
+    }
+
+    waiter = g_new0 (Waiter, 1);
+    waiter->callback = callback;
+    waiter->user_data = user_data;
+    entry->waiters = g_slist_prepend (entry->waiters, waiter);
+
+    if (entry->in_progress || entry->idle_id != 0)
+    {
+        return;
+    }
+
+    if (entry_is_fresh (entry))
+    {
+        entry->idle_id = g_idle_add (call_fresh_waiters, entry);
+        return;
+    }
+
+    entry->in_progress = TRUE;
+    g_file_query_filesystem_info_async (location,
+                                        NAUTILUS_FILESYSTEM_INFO_ATTRIBUTES,
+                                        G_PRIORITY_DEFAULT,
+                                        NULL,
+                                        query_info_callback,
+                                        entry);
+}
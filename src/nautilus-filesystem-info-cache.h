@@ -0,0 +1,51 @@
+/* nautilus-filesystem-info-cache.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* The filesystem info cache keeps what g_file_query_filesystem_info()
+ * returned for each filesystem, by filesystem id, for a short while.
+ * Queries for a filesystem already being queried wait for that query
+ * instead of making their own. Main thread only.
+ */
+
+#define NAUTILUS_FILESYSTEM_INFO_TTL_SECONDS 2
+
+/* All of them are queried, whichever is wanted */
+#define NAUTILUS_FILESYSTEM_INFO_ATTRIBUTES \
+        G_FILE_ATTRIBUTE_FILESYSTEM_READONLY "," \
+        G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW "," \
+        G_FILE_ATTRIBUTE_FILESYSTEM_TYPE "," \
+        G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE "," \
+        G_FILE_ATTRIBUTE_FILESYSTEM_FREE
+
+/* @info is NULL if the query failed */
+typedef void (*NautilusFilesystemInfoCallback) (GFileInfo *info,
+                                                gpointer   user_data);
+
+/* Returns the cached info of @filesystem_id if it is recent enough, or
+ * NULL. */
+GFileInfo *nautilus_filesystem_info_cache_lookup (const char                     *filesystem_id);
+
+/* Calls @callback, always and never right away, with the info of the
+ * filesystem of @location. Without a @filesystem_id, nothing is shared.
+ * @callback can be NULL to only have the info cached. */
+void       nautilus_filesystem_info_cache_query  (GFile                          *location,
+                                                  const char                     *filesystem_id,
+                                                  NautilusFilesystemInfoCallback  callback,
+                                                  gpointer                        user_data);
@@ -127,6 +127,45 @@ typedef enum
 #define NAUTILUS_PREFERENCES_SHOW_DIRECTORY_ITEM_COUNTS "show-directory-item-counts"
 #define NAUTILUS_PREFERENCES_SHOW_FILE_THUMBNAILS	"show-image-thumbnails"
 #define NAUTILUS_PREFERENCES_FILE_THUMBNAIL_LIMIT	"thumbnail-limit"
+#define NAUTILUS_PREFERENCES_THUMBNAIL_WORKERS		"thumbnail-workers"
+#define NAUTILUS_PREFERENCES_THUMBNAIL_CACHE_SIZE	"thumbnail-cache-size"
+
+/* Memory for all the caches together, shed past that */
+#define NAUTILUS_PREFERENCES_CACHE_MEMORY_BUDGET	"cache-memory-budget"
+
+/* Keep on-disk snapshots of big directories for faster re-open */
+#define NAUTILUS_PREFERENCES_USE_DIRECTORY_SNAPSHOTS "use-directory-snapshots"
+
+/* Show the last listing of remote directories on re-open for this long */
+#define NAUTILUS_PREFERENCES_REMOTE_LISTING_TTL "remote-listing-ttl"
+
+/* Copying big local files */
+#define NAUTILUS_PREFERENCES_LARGE_FILE_COPY_MODE "large-file-copy-mode"
+#define NAUTILUS_PREFERENCES_LARGE_FILE_COPY_THRESHOLD "large-file-copy-threshold"
+
+/* Keep a journal of the copies for them to be resumed */
+#define NAUTILUS_PREFERENCES_RESUMABLE_COPIES "resumable-copies"
+/* Compare the copies with their originals */
+#define NAUTILUS_PREFERENCES_VERIFY_COPIES "verify-copies"
+/* Answer the conflicts of the items copied before copying them */
+#define NAUTILUS_PREFERENCES_ASK_CONFLICTS_FIRST "ask-conflicts-first"
+
+typedef enum
+{
+	NAUTILUS_LARGE_FILE_COPY_OFF,
+	NAUTILUS_LARGE_FILE_COPY_BUFFERED,
+	NAUTILUS_LARGE_FILE_COPY_DIRECT
+} NautilusLargeFileCopyMode;
+
+/* Copy the files of a folder in the order of their place on the disk */
+#define NAUTILUS_PREFERENCES_COPY_READ_ORDER "copy-read-order"
+
+typedef enum
+{
+	NAUTILUS_COPY_READ_ORDER_LISTED,
+	NAUTILUS_COPY_READ_ORDER_AUTO,
+	NAUTILUS_COPY_READ_ORDER_DISK
+} NautilusCopyReadOrder;
 
 typedef enum
 {
@@ -145,6 +184,7 @@ typedef enum
 
 /* Search behaviour */
 #define NAUTILUS_PREFERENCES_RECURSIVE_SEARCH "recursive-search"
+#define NAUTILUS_PREFERENCES_SEARCH_PRUNE_PATTERNS "search-prune-patterns"
 
 /* Context menu options */
 #define NAUTILUS_PREFERENCES_SHOW_DELETE_PERMANENTLY "show-delete-permanently"
@@ -16,8 +16,10 @@
  */
 
 #include "nautilus-icon-info.h"
+#include "nautilus-cache-registry.h"
 
 #include "nautilus-enums.h"
+#include "nautilus-profile.h"
 
 struct _NautilusIconInfo
 {
@@ -27,12 +29,21 @@ struct _NautilusIconInfo
     gint64 last_use_time;
     GdkPixbuf *pixbuf;
 
+    /* Where it is cached, if it is: under cache_key in cache, and under
+     * each of name_keys in themed_name_cache. */
+    GList *lru_link;
+    GHashTable *cache;
+    gpointer cache_key;
+    GSList *name_keys;
+    gsize cache_bytes;
+
     char *icon_name;
 
     gint orig_scale;
 };
 
 static void schedule_reap_cache (void);
+static void touch_cached_icon (NautilusIconInfo *icon);
 
 G_DEFINE_TYPE (NautilusIconInfo,
                nautilus_icon_info,
@@ -64,7 +75,7 @@ pixbuf_toggle_notify (gpointer  info,
         g_object_remove_toggle_ref (object,
                                     pixbuf_toggle_notify,
                                     info);
-        icon->last_use_time = g_get_monotonic_time ();
+        touch_cached_icon (icon);
         schedule_reap_cache ();
     }
 }
@@ -166,60 +177,215 @@ typedef struct
 
 static GHashTable *loadable_icon_cache = NULL;
 static GHashTable *themed_icon_cache = NULL;
+/* Maps the names of a themed icon straight to its icon info, so that
+ * looking up the same MIME type icon over and over again doesn't go
+ * through the icon theme every time. Uses ThemedIconKey, with the
+ * names joined in place of the filename.
+ */
+static GHashTable *themed_name_cache = NULL;
+/* Emblemed icons, so that the many files showing the same icon with the
+ * same emblems, like a read-only disc, share one rendering of it. Uses
+ * LoadableIconKey. Thumbnails with emblems are not shared, and are left
+ * out.
+ */
+static GHashTable *emblemed_icon_cache = NULL;
 static guint reap_cache_timeout = 0;
 
-#define MICROSEC_PER_SEC ((guint64) 1000000L)
+/* The cached icon infos, the most recently used first, and how much their
+ * pixbufs take. Icons whose pixbufs are in use elsewhere are not evicted:
+ * they are only kept from being loaded again.
+ */
+static GQueue lru_icons = G_QUEUE_INIT;
+static gsize cached_bytes = 0;
+static guint64 cache_hits = 0;
+static guint64 cache_misses = 0;
+static guint64 cache_evictions = 0;
+static guint cache_registry_id = 0;
 
-static guint time_now;
+#define CACHE_BUDGET_BYTES (32 * 1024 * 1024)
+#define REAP_AGE_USEC (30 * G_USEC_PER_SEC)
 
-static gboolean
-reap_old_icon (gpointer key,
-               gpointer value,
-               gpointer user_info)
+static void
+profile_cache (void)
+{
+    nautilus_profile_msg ("icon cache %u icons %" G_GSIZE_FORMAT " bytes, "
+                          "hits %" G_GUINT64_FORMAT " misses %" G_GUINT64_FORMAT
+                          " evictions %" G_GUINT64_FORMAT,
+                          g_queue_get_length (&lru_icons), cached_bytes,
+                          cache_hits, cache_misses, cache_evictions);
+}
+
+static void
+touch_cached_icon (NautilusIconInfo *icon)
+{
+    icon->last_use_time = g_get_monotonic_time ();
+
+    if (icon->lru_link != NULL)
+    {
+        g_queue_unlink (&lru_icons, icon->lru_link);
+        g_queue_push_head_link (&lru_icons, icon->lru_link);
+    }
+}
+
+static void
+uncache_icon (NautilusIconInfo *icon)
 {
-    NautilusIconInfo *icon = value;
-    gboolean *reapable_icons_left = user_info;
+    g_autoptr (NautilusIconInfo) ref = g_object_ref (icon);
+    GSList *name_keys;
 
-    if (icon->sole_owner)
+    g_queue_delete_link (&lru_icons, icon->lru_link);
+    icon->lru_link = NULL;
+    cached_bytes -= icon->cache_bytes;
+    icon->cache_bytes = 0;
+
+    name_keys = g_steal_pointer (&icon->name_keys);
+    for (GSList *l = name_keys; l != NULL; l = l->next)
+    {
+        g_hash_table_remove (themed_name_cache, l->data);
+    }
+    g_slist_free (name_keys);
+
+    g_hash_table_remove (icon->cache, icon->cache_key);
+    icon->cache = NULL;
+    icon->cache_key = NULL;
+}
+
+/* Evicts the least recently used icons not in use until the cache is
+ * down to @bytes, but for the most recent one if @keep_newest. */
+static void
+trim_cache_to (gsize    bytes,
+               gboolean keep_newest)
+{
+    GList *prev;
+
+    for (GList *l = lru_icons.tail;
+         l != NULL && cached_bytes > bytes && !(keep_newest && l == lru_icons.head);
+         l = prev)
     {
-        if (time_now - icon->last_use_time > 30 * MICROSEC_PER_SEC)
+        NautilusIconInfo *icon = l->data;
+
+        prev = l->prev;
+        if (icon->sole_owner)
         {
-            /* This went unused 30 secs ago. reap */
-            return TRUE;
+            uncache_icon (icon);
+            cache_evictions++;
         }
-        else
+    }
+}
+
+/* Never the one just cached, even if it doesn't fit alone */
+static void
+trim_cache (void)
+{
+    trim_cache_to (CACHE_BUDGET_BYTES, TRUE);
+}
+
+static gsize
+get_cache_size (gpointer user_data)
+{
+    return cached_bytes;
+}
+
+static void
+shed_cache (NautilusCacheShedLevel level,
+            gpointer               user_data)
+{
+    switch (level)
+    {
+        case NAUTILUS_CACHE_SHED_SOME:
         {
-            /* We can reap this soon */
-            *reapable_icons_left = TRUE;
+            trim_cache_to (cached_bytes / 2, FALSE);
         }
+        break;
+
+        case NAUTILUS_CACHE_SHED_MOST:
+        {
+            trim_cache_to (cached_bytes / 4, FALSE);
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_ALL:
+        {
+            trim_cache_to (0, FALSE);
+        }
+        break;
+    }
+
+    profile_cache ();
+}
+
+/* Takes ownership of @key, and of a reference to @icon */
+static void
+cache_icon (GHashTable       *cache,
+            gpointer          key,
+            NautilusIconInfo *icon)
+{
+    if (cache_registry_id == 0)
+    {
+        cache_registry_id = nautilus_cache_registry_add ("icons",
+                                                         NAUTILUS_CACHE_PRIORITY_RELOADABLE,
+                                                         get_cache_size, shed_cache, NULL);
     }
 
-    return FALSE;
+    g_hash_table_insert (cache, key, icon);
+
+    icon->cache = cache;
+    icon->cache_key = key;
+    icon->cache_bytes = icon->pixbuf != NULL ? gdk_pixbuf_get_byte_length (icon->pixbuf) : 0;
+    cached_bytes += icon->cache_bytes;
+
+    g_queue_push_head (&lru_icons, icon);
+    icon->lru_link = lru_icons.head;
+    icon->last_use_time = g_get_monotonic_time ();
+
+    trim_cache ();
+}
+
+/* Also finds the already cached @icon by @key, the joined icon names */
+static void
+cache_icon_name (gpointer          key,
+                 NautilusIconInfo *icon)
+{
+    g_hash_table_insert (themed_name_cache, key, g_object_ref (icon));
+    icon->name_keys = g_slist_prepend (icon->name_keys, key);
 }
 
 static gboolean
 reap_cache (gpointer data)
 {
     gboolean reapable_icons_left;
+    gint64 time_now;
+    GList *prev;
 
-    reapable_icons_left = TRUE;
+    reapable_icons_left = FALSE;
 
     time_now = g_get_monotonic_time ();
 
-    if (loadable_icon_cache)
+    for (GList *l = lru_icons.tail; l != NULL; l = prev)
     {
-        g_hash_table_foreach_remove (loadable_icon_cache,
-                                     reap_old_icon,
-                                     &reapable_icons_left);
-    }
+        NautilusIconInfo *icon = l->data;
 
-    if (themed_icon_cache)
-    {
-        g_hash_table_foreach_remove (themed_icon_cache,
-                                     reap_old_icon,
-                                     &reapable_icons_left);
+        prev = l->prev;
+        if (!icon->sole_owner)
+        {
+            continue;
+        }
+
+        if (time_now - icon->last_use_time > REAP_AGE_USEC)
+        {
+            /* This went unused 30 secs ago. reap */
+            uncache_icon (icon);
+            cache_evictions++;
+        }
+        else
+        {
+            /* We can reap this soon */
+            reapable_icons_left = TRUE;
+        }
     }
 
+    profile_cache ();
+
     if (reapable_icons_left)
     {
         return TRUE;
@@ -245,14 +411,9 @@ schedule_reap_cache (void)
 void
 nautilus_icon_info_clear_caches (void)
 {
-    if (loadable_icon_cache)
-    {
-        g_hash_table_remove_all (loadable_icon_cache);
-    }
-
-    if (themed_icon_cache)
+    while (!g_queue_is_empty (&lru_icons))
     {
-        g_hash_table_remove_all (themed_icon_cache);
+        uncache_icon (g_queue_peek_tail (&lru_icons));
     }
 }
 
@@ -330,6 +491,41 @@ themed_icon_key_free (ThemedIconKey *key)
     g_slice_free (ThemedIconKey, key);
 }
 
+/* Renders any other icon, emblems and all, through the icon theme */
+static NautilusIconInfo *
+lookup_gicon_in_theme (GIcon *icon,
+                       int    size,
+                       int    scale)
+{
+    NautilusIconInfo *icon_info;
+    GdkPixbuf *pixbuf;
+    GtkIconInfo *gtk_icon_info;
+
+    gtk_icon_info = gtk_icon_theme_lookup_by_gicon_for_scale (gtk_icon_theme_get_default (),
+                                                              icon,
+                                                              size,
+                                                              scale,
+                                                              GTK_ICON_LOOKUP_FORCE_SIZE);
+    if (gtk_icon_info != NULL)
+    {
+        pixbuf = gtk_icon_info_load_icon (gtk_icon_info, NULL);
+        g_object_unref (gtk_icon_info);
+    }
+    else
+    {
+        pixbuf = NULL;
+    }
+
+    icon_info = nautilus_icon_info_new_for_pixbuf (pixbuf, scale);
+
+    if (pixbuf != NULL)
+    {
+        g_object_unref (pixbuf);
+    }
+
+    return icon_info;
+}
+
 NautilusIconInfo *
 nautilus_icon_info_lookup (GIcon *icon,
                            int    size,
@@ -360,8 +556,11 @@ nautilus_icon_info_lookup (GIcon *icon,
         icon_info = g_hash_table_lookup (loadable_icon_cache, &lookup_key);
         if (icon_info)
         {
+            cache_hits++;
+            touch_cached_icon (icon_info);
             return g_object_ref (icon_info);
         }
+        cache_misses++;
 
         pixbuf = NULL;
         stream = g_loadable_icon_load (G_LOADABLE_ICON (icon),
@@ -378,11 +577,12 @@ nautilus_icon_info_lookup (GIcon *icon,
         }
 
         icon_info = nautilus_icon_info_new_for_pixbuf (pixbuf, scale);
+        g_clear_object (&pixbuf);
 
         key = loadable_icon_key_new (icon, scale, size);
-        g_hash_table_insert (loadable_icon_cache, key, icon_info);
+        cache_icon (loadable_icon_cache, key, g_object_ref (icon_info));
 
-        return g_object_ref (icon_info);
+        return icon_info;
     }
     else if (G_IS_THEMED_ICON (icon))
     {
@@ -392,6 +592,7 @@ nautilus_icon_info_lookup (GIcon *icon,
         GtkIconTheme *icon_theme;
         GtkIconInfo *gtkicon_info;
         const char *filename;
+        g_autofree char *joined_names = NULL;
 
         if (themed_icon_cache == NULL)
         {
@@ -401,9 +602,31 @@ nautilus_icon_info_lookup (GIcon *icon,
                                        (GDestroyNotify) themed_icon_key_free,
                                        (GDestroyNotify) g_object_unref);
         }
+        if (themed_name_cache == NULL)
+        {
+            themed_name_cache =
+                g_hash_table_new_full ((GHashFunc) themed_icon_key_hash,
+                                       (GEqualFunc) themed_icon_key_equal,
+                                       (GDestroyNotify) themed_icon_key_free,
+                                       (GDestroyNotify) g_object_unref);
+        }
 
         names = g_themed_icon_get_names (G_THEMED_ICON (icon));
 
+        joined_names = g_strjoinv ("\n", (char **) names);
+        lookup_key.filename = joined_names;
+        lookup_key.scale = scale;
+        lookup_key.size = size;
+
+        icon_info = g_hash_table_lookup (themed_name_cache, &lookup_key);
+        if (icon_info)
+        {
+            cache_hits++;
+            touch_cached_icon (icon_info);
+            return g_object_ref (icon_info);
+        }
+        cache_misses++;
+
         icon_theme = gtk_icon_theme_get_default ();
         gtkicon_info = gtk_icon_theme_choose_icon_for_scale (icon_theme, (const char **) names,
                                                              size, scale, GTK_ICON_LOOKUP_FORCE_SIZE);
@@ -425,50 +648,63 @@ nautilus_icon_info_lookup (GIcon *icon,
         lookup_key.size = size;
 
         icon_info = g_hash_table_lookup (themed_icon_cache, &lookup_key);
-        if (icon_info)
+        if (icon_info == NULL)
         {
-            g_object_unref (gtkicon_info);
-            return g_object_ref (icon_info);
-        }
+            icon_info = nautilus_icon_info_new_for_icon_info (gtkicon_info, scale);
 
-        icon_info = nautilus_icon_info_new_for_icon_info (gtkicon_info, scale);
+            key = themed_icon_key_new (filename, scale, size);
+            cache_icon (themed_icon_cache, key, icon_info);
+        }
+        else
+        {
+            touch_cached_icon (icon_info);
+        }
 
-        key = themed_icon_key_new (filename, scale, size);
-        g_hash_table_insert (themed_icon_cache, key, icon_info);
+        key = themed_icon_key_new (joined_names, scale, size);
+        cache_icon_name (key, icon_info);
 
         g_object_unref (gtkicon_info);
 
         return g_object_ref (icon_info);
     }
-    else
+    else if (G_IS_EMBLEMED_ICON (icon) &&
+             !GDK_IS_PIXBUF (g_emblemed_icon_get_icon (G_EMBLEMED_ICON (icon))))
     {
-        GdkPixbuf *pixbuf;
-        GtkIconInfo *gtk_icon_info;
-
-        gtk_icon_info = gtk_icon_theme_lookup_by_gicon_for_scale (gtk_icon_theme_get_default (),
-                                                                  icon,
-                                                                  size,
-                                                                  scale,
-                                                                  GTK_ICON_LOOKUP_FORCE_SIZE);
-        if (gtk_icon_info != NULL)
-        {
-            pixbuf = gtk_icon_info_load_icon (gtk_icon_info, NULL);
-            g_object_unref (gtk_icon_info);
-        }
-        else
+        LoadableIconKey lookup_key;
+
+        if (emblemed_icon_cache == NULL)
         {
-            pixbuf = NULL;
+            emblemed_icon_cache =
+                g_hash_table_new_full ((GHashFunc) loadable_icon_key_hash,
+                                       (GEqualFunc) loadable_icon_key_equal,
+                                       (GDestroyNotify) loadable_icon_key_free,
+                                       (GDestroyNotify) g_object_unref);
         }
 
-        icon_info = nautilus_icon_info_new_for_pixbuf (pixbuf, scale);
+        lookup_key.icon = icon;
+        lookup_key.scale = scale;
+        lookup_key.size = size;
 
-        if (pixbuf != NULL)
+        icon_info = g_hash_table_lookup (emblemed_icon_cache, &lookup_key);
+        if (icon_info)
         {
-            g_object_unref (pixbuf);
+            cache_hits++;
+            touch_cached_icon (icon_info);
+            return g_object_ref (icon_info);
         }
+        cache_misses++;
+
+        icon_info = lookup_gicon_in_theme (icon, size, scale);
+        cache_icon (emblemed_icon_cache,
+                    loadable_icon_key_new (icon, scale, size),
+                    g_object_ref (icon_info));
 
         return icon_info;
     }
+    else
+    {
+        return lookup_gicon_in_theme (icon, size, scale);
+    }
 }
 
 NautilusIconInfo *
@@ -0,0 +1,364 @@
+/* nautilus-job-scheduler.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-job-scheduler.h"
+
+#include <glib/gi18n.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+/* How many operations a device which copes with several at once takes */
+#define FAST_DEVICE_JOBS 2
+
+typedef struct
+{
+    char *id;                   /* as G_FILE_ATTRIBUTE_ID_FILESYSTEM */
+    guint limit;
+    gboolean rotational;
+    gboolean has_sources;
+} SlotDevice;
+
+struct NautilusJobSlot
+{
+    GArray *devices;
+    gboolean running;
+};
+
+static GMutex scheduler_mutex;
+static GCond scheduler_cond;
+/* The slots waiting for their devices, in the order they came in */
+static GQueue waiting_slots = G_QUEUE_INIT;
+/* The number of running operations by filesystem id */
+static GHashTable *running_jobs;
+
+#ifdef __linux__
+static gboolean
+read_sysfs_flag (const char *dir,
+                 const char *name)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *contents = NULL;
+
+    path = g_build_filename (dir, name, NULL);
+    if (!g_file_get_contents (path, &contents, NULL, NULL))
+    {
+        return FALSE;
+    }
+
+    return contents[0] == '1';
+}
+
+static void
+get_block_device_flags (guint32   device,
+                        gboolean *rotational,
+                        gboolean *removable)
+{
+    g_autofree char *dir = NULL;
+    g_autofree char *partition = NULL;
+    g_autofree char *disk = NULL;
+
+    dir = g_strdup_printf ("/sys/dev/block/%u:%u", major (device), minor (device));
+
+    /* The attributes of a partition are those of its disk. */
+    partition = g_build_filename (dir, "partition", NULL);
+    if (g_file_test (partition, G_FILE_TEST_EXISTS))
+    {
+        disk = g_build_filename (dir, "..", NULL);
+    }
+    else
+    {
+        disk = g_strdup (dir);
+    }
+
+    /* Optical drives are rotational too. */
+    *rotational = read_sysfs_flag (disk, "queue/rotational");
+    *removable = read_sysfs_flag (disk, "removable");
+}
+#endif
+
+static void
+slot_add_device (NautilusJobSlot *slot,
+                 GFile           *location,
+                 gboolean         is_source,
+                 GCancellable    *cancellable)
+{
+    g_autoptr (GFileInfo) info = NULL;
+    const char *id;
+    SlotDevice device;
+    gboolean rotational = FALSE;
+    gboolean removable = FALSE;
+
+    info = g_file_query_info (location,
+                              G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
+                              G_FILE_ATTRIBUTE_UNIX_DEVICE,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              cancellable, NULL);
+    id = info != NULL ? g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM) : NULL;
+    if (id == NULL)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < slot->devices->len; i++)
+    {
+        SlotDevice *added = &g_array_index (slot->devices, SlotDevice, i);
+
+        if (g_strcmp0 (added->id, id) == 0)
+        {
+            added->has_sources |= is_source;
+            return;
+        }
+    }
+
+#ifdef __linux__
+    if (g_file_is_native (location) &&
+        g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_DEVICE))
+    {
+        get_block_device_flags (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+                                &rotational, &removable);
+    }
+#endif
+
+    device.id = g_strdup (id);
+    device.limit = !g_file_is_native (location) || rotational || removable ? 1 : FAST_DEVICE_JOBS;
+    device.rotational = rotational;
+    device.has_sources = is_source;
+    g_array_append_val (slot->devices, device);
+}
+
+static gboolean
+slots_share_device (NautilusJobSlot *slot,
+                    NautilusJobSlot *other)
+{
+    for (guint i = 0; i < slot->devices->len; i++)
+    {
+        for (guint j = 0; j < other->devices->len; j++)
+        {
+            if (g_strcmp0 (g_array_index (slot->devices, SlotDevice, i).id,
+                           g_array_index (other->devices, SlotDevice, j).id) == 0)
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+slot_can_run (NautilusJobSlot *slot)
+{
+    /* Don't overtake the operations which came in before on the same
+     * devices. */
+    for (GList *l = waiting_slots.head; l->data != slot; l = l->next)
+    {
+        if (slots_share_device (l->data, slot))
+        {
+            return FALSE;
+        }
+    }
+
+    for (guint i = 0; i < slot->devices->len; i++)
+    {
+        SlotDevice *device = &g_array_index (slot->devices, SlotDevice, i);
+
+        if (GPOINTER_TO_UINT (g_hash_table_lookup (running_jobs, device->id)) >= device->limit)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+wake_up_waiting_slots (GCancellable *cancellable,
+                       gpointer      user_data)
+{
+    g_mutex_lock (&scheduler_mutex);
+    g_cond_broadcast (&scheduler_cond);
+    g_mutex_unlock (&scheduler_mutex);
+}
+
+NautilusJobSlot *
+nautilus_job_scheduler_acquire (GList                *sources,
+                                GFile                *destination,
+                                NautilusProgressInfo *progress,
+                                GCancellable         *cancellable)
+{
+    g_autoptr (GHashTable) parents = NULL;
+    NautilusJobSlot *slot;
+    gboolean queued;
+    gulong cancelled_id;
+
+    slot = g_new0 (NautilusJobSlot, 1);
+    slot->devices = g_array_new (FALSE, FALSE, sizeof (SlotDevice));
+
+    /* The sources mostly share a folder, so only that is looked at. */
+    parents = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                     g_object_unref, NULL);
+    for (GList *l = sources; l != NULL; l = l->next)
+    {
+        GFile *parent;
+
+        parent = g_file_get_parent (l->data);
+        if (parent == NULL)
+        {
+            parent = g_object_ref (l->data);
+        }
+        if (g_hash_table_add (parents, parent))
+        {
+            slot_add_device (slot, parent, TRUE, cancellable);
+        }
+    }
+    if (destination != NULL)
+    {
+        slot_add_device (slot, destination, FALSE, cancellable);
+    }
+
+    if (slot->devices->len == 0)
+    {
+        return slot;
+    }
+
+    cancelled_id = 0;
+    if (cancellable != NULL)
+    {
+        cancelled_id = g_cancellable_connect (cancellable,
+                                              G_CALLBACK (wake_up_waiting_slots),
+                                              NULL, NULL);
+    }
+
+    queued = FALSE;
+    g_mutex_lock (&scheduler_mutex);
+
+    if (running_jobs == NULL)
+    {
+        running_jobs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    g_queue_push_tail (&waiting_slots, slot);
+    while (!slot_can_run (slot) && !g_cancellable_is_cancelled (cancellable))
+    {
+        if (!queued)
+        {
+            queued = TRUE;
+            nautilus_progress_info_set_queued (progress, TRUE);
+            nautilus_progress_info_set_status (progress, _("Queued"));
+            nautilus_progress_info_set_details (progress,
+                                                _("Waiting for other operations on the same disk to finish"));
+        }
+
+        g_cond_wait (&scheduler_cond, &scheduler_mutex);
+    }
+    g_queue_remove (&waiting_slots, slot);
+
+    if (!g_cancellable_is_cancelled (cancellable))
+    {
+        for (guint i = 0; i < slot->devices->len; i++)
+        {
+            SlotDevice *device = &g_array_index (slot->devices, SlotDevice, i);
+            guint n_jobs;
+
+            n_jobs = GPOINTER_TO_UINT (g_hash_table_lookup (running_jobs, device->id));
+            g_hash_table_insert (running_jobs, g_strdup (device->id), GUINT_TO_POINTER (n_jobs + 1));
+        }
+        slot->running = TRUE;
+    }
+
+    /* The ones which waited behind this one may go now. */
+    g_cond_broadcast (&scheduler_cond);
+    g_mutex_unlock (&scheduler_mutex);
+
+    if (cancellable != NULL)
+    {
+        g_cancellable_disconnect (cancellable, cancelled_id);
+    }
+
+    if (queued)
+    {
+        nautilus_progress_info_set_queued (progress, FALSE);
+    }
+
+    return slot;
+}
+
+void
+nautilus_job_scheduler_release (NautilusJobSlot *slot)
+{
+    if (slot->running)
+    {
+        g_mutex_lock (&scheduler_mutex);
+
+        for (guint i = 0; i < slot->devices->len; i++)
+        {
+            SlotDevice *device = &g_array_index (slot->devices, SlotDevice, i);
+            guint n_jobs;
+
+            n_jobs = GPOINTER_TO_UINT (g_hash_table_lookup (running_jobs, device->id));
+            if (n_jobs > 1)
+            {
+                g_hash_table_insert (running_jobs, g_strdup (device->id), GUINT_TO_POINTER (n_jobs - 1));
+            }
+            else
+            {
+                g_hash_table_remove (running_jobs, device->id);
+            }
+        }
+
+        g_cond_broadcast (&scheduler_cond);
+        g_mutex_unlock (&scheduler_mutex);
+    }
+
+    for (guint i = 0; i < slot->devices->len; i++)
+    {
+        g_free (g_array_index (slot->devices, SlotDevice, i).id);
+    }
+    g_array_unref (slot->devices);
+    g_free (slot);
+}
+
+gboolean
+nautilus_job_slot_has_slow_device (NautilusJobSlot *slot)
+{
+    for (guint i = 0; i < slot->devices->len; i++)
+    {
+        if (g_array_index (slot->devices, SlotDevice, i).limit == 1)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+gboolean
+nautilus_job_slot_has_rotational_source (NautilusJobSlot *slot)
+{
+    for (guint i = 0; i < slot->devices->len; i++)
+    {
+        SlotDevice *device = &g_array_index (slot->devices, SlotDevice, i);
+
+        if (device->has_sources && device->rotational)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,50 @@
+/* nautilus-job-scheduler.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "nautilus-progress-info.h"
+
+/* The job scheduler keeps the file operations from fighting over a device.
+ * An operation takes a slot for the devices of its sources and destination
+ * before doing its work, waiting while they are busy with as many
+ * operations as they take: one for slow devices (rotating or removable
+ * disks, and everything that isn't local), a couple for the others.
+ * Operations on different devices run side by side, and the waiting ones
+ * start in the order they came in.
+ */
+
+typedef struct NautilusJobSlot NautilusJobSlot;
+
+/* Blocks until the devices are free, or @cancellable is cancelled, flagging
+ * @progress as queued in the meantime. Meant for the job threads. */
+NautilusJobSlot *nautilus_job_scheduler_acquire (GList                *sources,
+                                                 GFile                *destination,
+                                                 NautilusProgressInfo *progress,
+                                                 GCancellable         *cancellable);
+void             nautilus_job_scheduler_release (NautilusJobSlot      *slot);
+
+/* Whether one of the devices of @slot is a slow one, which the operation
+ * shouldn't make work on several things at once either. */
+gboolean         nautilus_job_slot_has_slow_device (NautilusJobSlot   *slot);
+
+/* Whether some of the sources of @slot are on a rotating disk, a hard
+ * disk or an optical one, where reading out of order means seeking. */
+gboolean         nautilus_job_slot_has_rotational_source (NautilusJobSlot *slot);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusJobSlot, nautilus_job_scheduler_release)
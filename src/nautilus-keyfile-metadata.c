@@ -25,8 +25,10 @@
 #include "nautilus-keyfile-metadata.h"
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-executor.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-metadata-writer.h"
 
 #include <glib/gstdio.h>
 
@@ -37,7 +39,10 @@
 typedef struct
 {
     GKeyFile *keyfile;
-    guint save_in_idle_id;
+    guint save_timeout_id;
+    /* The keyfile is written to disk by a worker, one save at a time */
+    gboolean saving;
+    gboolean dirty;
 } KeyfileMetadataData;
 
 static GHashTable *data_hash = NULL;
@@ -80,10 +85,7 @@ keyfile_metadata_data_free (KeyfileMetadataData *data)
 {
     g_key_file_unref (data->keyfile);
 
-    if (data->save_in_idle_id != 0)
-    {
-        g_source_remove (data->save_in_idle_id);
-    }
+    g_clear_handle_id (&data->save_timeout_id, g_source_remove);
 
     g_slice_free (KeyfileMetadataData, data);
 }
@@ -115,39 +117,121 @@ get_keyfile (const char *keyfile_filename)
     return data->keyfile;
 }
 
-static gboolean
-save_in_idle_cb (const gchar *keyfile_filename)
+typedef struct
 {
-    KeyfileMetadataData *data;
-    gchar *contents;
-    gsize length;
-    GError *error = NULL;
+    char *keyfile_filename;
+    GBytes *contents;
+} SaveData;
 
-    data = g_hash_table_lookup (data_hash, keyfile_filename);
-    data->save_in_idle_id = 0;
+static void
+save_data_free (SaveData *save_data)
+{
+    g_free (save_data->keyfile_filename);
+    g_bytes_unref (save_data->contents);
 
-    contents = g_key_file_to_data (data->keyfile, &length, NULL);
+    g_free (save_data);
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+    SaveData *save_data = task_data;
+    GError *error = NULL;
+
+    g_file_set_contents (save_data->keyfile_filename,
+                         g_bytes_get_data (save_data->contents, NULL),
+                         g_bytes_get_size (save_data->contents),
+                         &error);
 
-    if (contents != NULL)
+    if (error != NULL)
+    {
+        g_task_return_error (task, error);
+    }
+    else
     {
-        g_file_set_contents (keyfile_filename,
-                             contents, length,
-                             &error);
-        g_free (contents);
+        g_task_return_boolean (task, TRUE);
     }
+}
 
-    if (error != NULL)
+static void schedule_save (const char *keyfile_filename);
+
+static void
+save_done (GObject      *source_object,
+           GAsyncResult *result,
+           gpointer      user_data)
+{
+    KeyfileMetadataData *data;
+    SaveData *save_data;
+    GError *error = NULL;
+
+    save_data = g_task_get_task_data (G_TASK (result));
+
+    if (!g_task_propagate_boolean (G_TASK (result), &error))
     {
         g_warning ("Couldn't save the desktop metadata keyfile to disk: %s",
                    error->message);
         g_error_free (error);
     }
 
-    return FALSE;
+    data = g_hash_table_lookup (data_hash, save_data->keyfile_filename);
+    data->saving = FALSE;
+
+    if (data->dirty)
+    {
+        data->dirty = FALSE;
+        schedule_save (save_data->keyfile_filename);
+    }
+}
+
+static GBytes *
+get_keyfile_contents (KeyfileMetadataData *data)
+{
+    gchar *contents;
+    gsize length;
+
+    contents = g_key_file_to_data (data->keyfile, &length, NULL);
+
+    return contents != NULL ? g_bytes_new_take (contents, length) : NULL;
+}
+
+static gboolean
+save_timeout_cb (gpointer user_data)
+{
+    const char *keyfile_filename = user_data;
+    KeyfileMetadataData *data;
+    GBytes *contents;
+    SaveData *save_data;
+    g_autoptr (GTask) task = NULL;
+
+    data = g_hash_table_lookup (data_hash, keyfile_filename);
+    data->save_timeout_id = 0;
+
+    contents = get_keyfile_contents (data);
+    if (contents == NULL)
+    {
+        return G_SOURCE_REMOVE;
+    }
+
+    /* The keyfile keeps changing on the main thread, so the worker only
+     * gets the contents it is to write. */
+    save_data = g_new0 (SaveData, 1);
+    save_data->keyfile_filename = g_strdup (keyfile_filename);
+    save_data->contents = contents;
+
+    task = g_task_new (NULL, NULL, save_done, NULL);
+    g_task_set_task_data (task, save_data, (GDestroyNotify) save_data_free);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_METADATA, task, save_thread);
+
+    data->saving = TRUE;
+
+    return G_SOURCE_REMOVE;
 }
 
 static void
-save_in_idle (const char *keyfile_filename)
+schedule_save (const char *keyfile_filename)
 {
     KeyfileMetadataData *data;
 
@@ -156,15 +240,67 @@ save_in_idle (const char *keyfile_filename)
     data = g_hash_table_lookup (data_hash, keyfile_filename);
     g_return_if_fail (data != NULL);
 
-    if (data->save_in_idle_id != 0)
+    if (data->saving)
+    {
+        data->dirty = TRUE;
+        return;
+    }
+
+    if (data->save_timeout_id != 0)
+    {
+        return;
+    }
+
+    data->save_timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                                NAUTILUS_METADATA_FLUSH_INTERVAL_MSECS,
+                                                save_timeout_cb,
+                                                g_strdup (keyfile_filename),
+                                                g_free);
+}
+
+void
+nautilus_keyfile_metadata_flush (void)
+{
+    GHashTableIter iter;
+    const char *keyfile_filename;
+    KeyfileMetadataData *data;
+
+    if (data_hash == NULL)
     {
         return;
     }
 
-    data->save_in_idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-                                             (GSourceFunc) save_in_idle_cb,
-                                             g_strdup (keyfile_filename),
-                                             g_free);
+    g_hash_table_iter_init (&iter, data_hash);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &keyfile_filename, (gpointer *) &data))
+    {
+        g_autoptr (GBytes) contents = NULL;
+        GError *error = NULL;
+
+        while (data->saving)
+        {
+            g_main_context_iteration (NULL, TRUE);
+        }
+
+        if (data->save_timeout_id == 0 && !data->dirty)
+        {
+            continue;
+        }
+
+        g_clear_handle_id (&data->save_timeout_id, g_source_remove);
+        data->dirty = FALSE;
+
+        contents = get_keyfile_contents (data);
+        if (contents != NULL &&
+            !g_file_set_contents (keyfile_filename,
+                                  g_bytes_get_data (contents, NULL),
+                                  g_bytes_get_size (contents),
+                                  &error))
+        {
+            g_warning ("Couldn't save the desktop metadata keyfile to disk: %s",
+                       error->message);
+            g_error_free (error);
+        }
+    }
 }
 
 void
@@ -183,7 +319,7 @@ nautilus_keyfile_metadata_set_string (NautilusFile *file,
                            key,
                            string);
 
-    save_in_idle (keyfile_filename);
+    schedule_save (keyfile_filename);
 
     if (nautilus_keyfile_metadata_update_from_keyfile (file, keyfile_filename, name))
     {
@@ -234,7 +370,7 @@ nautilus_keyfile_metadata_set_stringv (NautilusFile       *file,
                                 (const gchar **) actual_stringv,
                                 length);
 
-    save_in_idle (keyfile_filename);
+    schedule_save (keyfile_filename);
 
     if (nautilus_keyfile_metadata_update_from_keyfile (file, keyfile_filename, name))
     {
@@ -41,3 +41,6 @@ void nautilus_keyfile_metadata_set_stringv (NautilusFile *file,
 gboolean nautilus_keyfile_metadata_update_from_keyfile (NautilusFile *file,
                                                         const char *keyfile_filename,
                                                         const gchar *name);
+
+/* Writes the keyfiles with unsaved changes to disk right away */
+void nautilus_keyfile_metadata_flush (void);
@@ -33,6 +33,7 @@
 
 #include <eel/eel-graphic-effects.h>
 #include "nautilus-dnd.h"
+#include "nautilus-parallel-sort.h"
 
 enum
 {
@@ -48,6 +49,16 @@ static GQuark attribute_name_q,
 /* msec delay after Loading... dummy row turns into (empty) */
 #define LOADING_TO_EMPTY_DELAY 100
 
+/* The flat index of the top level rows is rebuilt once it has been
+ * missed for 1/FLAT_INDEX_REBUILD_RATIO of the rows since the last change,
+ * so that rebuilding it costs no more than the lookups it saves.
+ */
+#define FLAT_INDEX_REBUILD_RATIO 64
+
+/* Icons shared by many rows stay rendered, but thumbnails are mostly
+ * one per row, so the cache is just dropped once it has this many. */
+#define MAX_ICON_SURFACES 500
+
 static guint list_model_signals[LAST_SIGNAL] = { 0 };
 
 static int nautilus_list_model_file_entry_compare_func (gconstpointer a,
@@ -62,6 +73,17 @@ typedef struct
     GHashTable *directory_reverse_map;     /* map from directory to GSequenceIter's */
     GHashTable *top_reverse_map;           /* map from files in top dir to GSequenceIter's */
 
+    /* GSequenceIter's of the top level rows by position, for constant
+     * time lookups while the rows don't change, which is most of the
+     * time when scrolling. */
+    GPtrArray *flat_index;
+    gboolean flat_index_valid;
+    guint flat_index_misses;
+
+    /* FileEntry's that changed and may have to move */
+    GHashTable *pending_changes;
+    guint pending_changes_idle_id;
+
     int stamp;
 
     GQuark sort_attribute;
@@ -76,6 +98,15 @@ typedef struct
     GPtrArray *columns;
 
     GList *highlight_files;
+
+    /* NautilusIconInfo -> cairo_surface_t rendered at the size and scale
+     * below, as the tree view asks for the icons on every redraw. */
+    GHashTable *icon_surfaces;
+    int icon_surfaces_size;
+    int icon_surfaces_scale;
+
+    /* Where the column strings are formatted before being kept */
+    GString *column_buffer;
 } NautilusListModelPrivate;
 
 typedef struct
@@ -95,6 +126,11 @@ struct FileEntry
     FileEntry *parent;
     GSequence *files;
     GSequenceIter *ptr;
+    /* The strings of the attribute columns, formatted when first shown
+     * and dropped when the row changes. */
+    GPtrArray *column_strings;
+    /* Position in the top level rows, while the flat index is valid */
+    guint position;
     guint loaded : 1;
 };
 
@@ -128,9 +164,97 @@ file_entry_free (FileEntry *file_entry)
     {
         g_sequence_free (file_entry->files);
     }
+    g_clear_pointer (&file_entry->column_strings, g_ptr_array_unref);
     g_free (file_entry);
 }
 
+static const char *
+file_entry_get_column_string (NautilusListModelPrivate *priv,
+                              FileEntry                *file_entry,
+                              guint                     index,
+                              GQuark                    attribute)
+{
+    char *str;
+    const char *value;
+
+    if (file_entry->column_strings == NULL)
+    {
+        file_entry->column_strings = g_ptr_array_new_with_free_func (g_free);
+    }
+    if (index >= file_entry->column_strings->len)
+    {
+        g_ptr_array_set_size (file_entry->column_strings, index + 1);
+    }
+
+    str = g_ptr_array_index (file_entry->column_strings, index);
+    if (str == NULL)
+    {
+        value = nautilus_file_peek_string_attribute_q (file_entry->file, attribute,
+                                                       priv->column_buffer);
+        str = value != NULL ?
+              g_strdup (value) :
+              nautilus_file_get_string_attribute_with_default_q (file_entry->file, attribute);
+        file_entry->column_strings->pdata[index] = str;
+    }
+
+    return str;
+}
+
+static cairo_surface_t *
+get_icon_surface (NautilusListModelPrivate *priv,
+                  NautilusIconInfo         *icon_info,
+                  int                       icon_size,
+                  int                       icon_scale,
+                  gboolean                  highlight)
+{
+    GdkPixbuf *icon, *rendered_icon;
+    cairo_surface_t *surface;
+
+    if (priv->icon_surfaces_size != icon_size ||
+        priv->icon_surfaces_scale != icon_scale ||
+        g_hash_table_size (priv->icon_surfaces) >= MAX_ICON_SURFACES)
+    {
+        g_hash_table_remove_all (priv->icon_surfaces);
+        priv->icon_surfaces_size = icon_size;
+        priv->icon_surfaces_scale = icon_scale;
+    }
+
+    if (!highlight)
+    {
+        surface = g_hash_table_lookup (priv->icon_surfaces, icon_info);
+        if (surface != NULL)
+        {
+            return cairo_surface_reference (surface);
+        }
+    }
+
+    icon = nautilus_icon_info_get_pixbuf_at_size (icon_info, icon_size);
+
+    if (highlight)
+    {
+        rendered_icon = eel_create_spotlight_pixbuf (icon);
+
+        if (rendered_icon != NULL)
+        {
+            g_object_unref (icon);
+            icon = rendered_icon;
+        }
+    }
+
+    surface = gdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
+    g_object_unref (icon);
+
+    /* Highlighting only lasts for a drag, not worth keeping. */
+    if (!highlight)
+    {
+        g_hash_table_insert (priv->icon_surfaces,
+                             g_object_ref (icon_info),
+                             cairo_surface_reference (surface));
+    }
+
+    return surface;
+}
+
 static GtkTreeModelFlags
 nautilus_list_model_get_flags (GtkTreeModel *tree_model)
 {
@@ -194,6 +318,62 @@ nautilus_list_model_get_column_type (GtkTreeModel *tree_model,
     }
 }
 
+static void
+invalidate_flat_index (NautilusListModel *model,
+                       GSequence         *files)
+{
+    NautilusListModelPrivate *priv;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    if (files == priv->files)
+    {
+        priv->flat_index_valid = FALSE;
+        priv->flat_index_misses = 0;
+    }
+}
+
+static gboolean
+ensure_flat_index (NautilusListModel *model)
+{
+    NautilusListModelPrivate *priv;
+    GSequenceIter *ptr;
+    FileEntry *file_entry;
+    guint i;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    if (priv->flat_index_valid)
+    {
+        return TRUE;
+    }
+
+    /* Disposed */
+    if (priv->files == NULL)
+    {
+        return FALSE;
+    }
+
+    priv->flat_index_misses++;
+    if (priv->flat_index_misses < g_sequence_get_length (priv->files) / FLAT_INDEX_REBUILD_RATIO)
+    {
+        return FALSE;
+    }
+
+    g_ptr_array_set_size (priv->flat_index, 0);
+    for (ptr = g_sequence_get_begin_iter (priv->files), i = 0;
+         !g_sequence_iter_is_end (ptr);
+         ptr = g_sequence_iter_next (ptr), i++)
+    {
+        file_entry = g_sequence_get (ptr);
+        file_entry->position = i;
+        g_ptr_array_add (priv->flat_index, ptr);
+    }
+    priv->flat_index_valid = TRUE;
+
+    return TRUE;
+}
+
 static void
 nautilus_list_model_ptr_to_iter (NautilusListModel *model,
                                  GSequenceIter     *ptr,
@@ -233,12 +413,23 @@ nautilus_list_model_get_iter (GtkTreeModel *tree_model,
     {
         i = gtk_tree_path_get_indices (path)[d];
 
-        if (files == NULL || i >= g_sequence_get_length (files))
+        if (d == 0 && ensure_flat_index (model))
         {
-            return FALSE;
+            if (i >= priv->flat_index->len)
+            {
+                return FALSE;
+            }
+            ptr = g_ptr_array_index (priv->flat_index, i);
+        }
+        else
+        {
+            if (files == NULL || i >= g_sequence_get_length (files))
+            {
+                return FALSE;
+            }
+            ptr = g_sequence_get_iter_at_pos (files, i);
         }
 
-        ptr = g_sequence_get_iter_at_pos (files, i);
         file_entry = g_sequence_get (ptr);
         files = file_entry->files;
     }
@@ -273,14 +464,22 @@ nautilus_list_model_get_path (GtkTreeModel *tree_model,
     ptr = iter->user_data;
     while (ptr != NULL)
     {
-        gtk_tree_path_prepend_index (path, g_sequence_iter_get_position (ptr));
         file_entry = g_sequence_get (ptr);
         if (file_entry->parent != NULL)
         {
+            gtk_tree_path_prepend_index (path, g_sequence_iter_get_position (ptr));
             ptr = file_entry->parent->ptr;
         }
         else
         {
+            if (ensure_flat_index (model))
+            {
+                gtk_tree_path_prepend_index (path, file_entry->position);
+            }
+            else
+            {
+                gtk_tree_path_prepend_index (path, g_sequence_iter_get_position (ptr));
+            }
             ptr = NULL;
         }
     }
@@ -340,8 +539,8 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model,
     NautilusListModelPrivate *priv;
     FileEntry *file_entry;
     NautilusFile *file;
-    char *str;
-    GdkPixbuf *icon, *rendered_icon;
+    NautilusIconInfo *icon_info;
+    gboolean highlight;
     int icon_size, icon_scale;
     NautilusListZoomLevel zoom_level;
     NautilusFileIconFlags flags;
@@ -413,24 +612,16 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model,
                     }
                 }
 
-                icon = nautilus_file_get_icon_pixbuf (file, icon_size, TRUE, icon_scale, flags);
-
-                if (priv->highlight_files != NULL &&
-                    g_list_find_custom (priv->highlight_files,
-                                        file, (GCompareFunc) nautilus_file_compare_location))
-                {
-                    rendered_icon = eel_create_spotlight_pixbuf (icon);
-
-                    if (rendered_icon != NULL)
-                    {
-                        g_object_unref (icon);
-                        icon = rendered_icon;
-                    }
-                }
+                highlight = priv->highlight_files != NULL &&
+                            g_list_find_custom (priv->highlight_files,
+                                                file, (GCompareFunc) nautilus_file_compare_location) != NULL;
 
-                surface = gdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
+                /* The icon info is memoized by the file and changes with it,
+                 * so it tells whether the rendered surface is still good. */
+                icon_info = nautilus_file_get_icon (file, icon_size, icon_scale, flags);
+                surface = get_icon_surface (priv, icon_info, icon_size, icon_scale, highlight);
                 g_value_take_boxed (value, surface);
-                g_object_unref (icon);
+                g_object_unref (icon_info);
             }
         }
         break;
@@ -456,9 +647,11 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model,
                               NULL);
                 if (file != NULL)
                 {
-                    str = nautilus_file_get_string_attribute_with_default_q (file,
-                                                                             attribute);
-                    g_value_take_string (value, str);
+                    g_value_set_string (value,
+                                        file_entry_get_column_string (priv,
+                                                                      file_entry,
+                                                                      column - NAUTILUS_LIST_MODEL_NUM_COLUMNS,
+                                                                      attribute));
                 }
                 else if (attribute == attribute_name_q)
                 {
@@ -479,6 +672,30 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model,
     }
 }
 
+/* Class handler of GtkTreeModel::row-changed, so that every change
+ * to a row, wherever it comes from, drops its formatted strings. */
+static void
+nautilus_list_model_row_changed (GtkTreeModel *tree_model,
+                                 GtkTreePath  *path,
+                                 GtkTreeIter  *iter)
+{
+    NautilusListModelPrivate *priv;
+    FileEntry *file_entry;
+
+    priv = nautilus_list_model_get_instance_private (NAUTILUS_LIST_MODEL (tree_model));
+
+    if (iter->stamp != priv->stamp || g_sequence_iter_is_end (iter->user_data))
+    {
+        return;
+    }
+
+    file_entry = g_sequence_get (iter->user_data);
+    if (file_entry->column_strings != NULL)
+    {
+        g_ptr_array_set_size (file_entry->column_strings, 0);
+    }
+}
+
 static gboolean
 nautilus_list_model_iter_next (GtkTreeModel *tree_model,
                                GtkTreeIter  *iter)
@@ -594,6 +811,19 @@ nautilus_list_model_iter_nth_child (GtkTreeModel *tree_model,
     else
     {
         files = priv->files;
+
+        if (ensure_flat_index (model))
+        {
+            if (n < 0 || n >= priv->flat_index->len)
+            {
+                return FALSE;
+            }
+
+            iter->stamp = priv->stamp;
+            iter->user_data = g_ptr_array_index (priv->flat_index, n);
+
+            return TRUE;
+        }
     }
 
     child = g_sequence_get_iter_at_pos (files, n);
@@ -826,6 +1056,7 @@ nautilus_list_model_sort_file_entries (NautilusListModel *model,
                                        GtkTreePath       *path)
 {
     GSequenceIter **old_order;
+    g_autofree gpointer *sorted = NULL;
     GtkTreeIter iter;
     int *new_order;
     int length;
@@ -857,8 +1088,21 @@ nautilus_list_model_sort_file_entries (NautilusListModel *model,
         old_order[i] = ptr;
     }
 
-    /* sort */
-    g_sequence_sort (files, nautilus_list_model_file_entry_compare_func, model);
+    /* Sort the entries out of the sequence, which isn't thread safe
+     * even to read, then move them in order to its end.
+     */
+    sorted = g_new (gpointer, length);
+    for (i = 0; i < length; ++i)
+    {
+        sorted[i] = g_sequence_get (old_order[i]);
+    }
+    nautilus_parallel_sort (sorted, length, nautilus_list_model_file_entry_compare_func, model);
+    for (i = 0; i < length; ++i)
+    {
+        file_entry = sorted[i];
+        g_sequence_move (file_entry->ptr, g_sequence_get_end_iter (files));
+    }
+    invalidate_flat_index (model, files);
 
     /* generate new order */
     new_order = g_new (int, length);
@@ -888,6 +1132,21 @@ nautilus_list_model_sort_file_entries (NautilusListModel *model,
     g_free (new_order);
 }
 
+/* Changes sorted from before a full sort have nothing left to do. */
+static void
+discard_pending_changes (NautilusListModel *model)
+{
+    NautilusListModelPrivate *priv;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    g_clear_handle_id (&priv->pending_changes_idle_id, g_source_remove);
+    if (priv->pending_changes != NULL)
+    {
+        g_hash_table_remove_all (priv->pending_changes);
+    }
+}
+
 static void
 nautilus_list_model_sort (NautilusListModel *model)
 {
@@ -897,6 +1156,7 @@ nautilus_list_model_sort (NautilusListModel *model)
     path = gtk_tree_path_new ();
     priv = nautilus_list_model_get_instance_private (model);
 
+    discard_pending_changes (model);
     nautilus_list_model_sort_file_entries (model, priv->files, path);
 
     gtk_tree_path_free (path);
@@ -996,6 +1256,9 @@ nautilus_list_model_add_file (NautilusListModel *model,
 
     priv = nautilus_list_model_get_instance_private (model);
 
+    /* Inserting needs the rows in order. */
+    nautilus_list_model_flush_pending_changes (model);
+
     parent_ptr = g_hash_table_lookup (priv->directory_reverse_map,
                                       directory);
     if (parent_ptr)
@@ -1054,6 +1317,7 @@ nautilus_list_model_add_file (NautilusListModel *model,
 
     file_entry->ptr = g_sequence_insert_sorted (files, file_entry,
                                                 nautilus_list_model_file_entry_compare_func, model);
+    invalidate_flat_index (model, files);
 
     g_hash_table_insert (parent_hash, file, file_entry->ptr);
 
@@ -1084,80 +1348,219 @@ nautilus_list_model_add_file (NautilusListModel *model,
     return TRUE;
 }
 
-void
-nautilus_list_model_file_changed (NautilusListModel *model,
-                                  NautilusFile      *file,
-                                  NautilusDirectory *directory)
+static gboolean
+file_entry_is_in_order (NautilusListModel *model,
+                        FileEntry         *file_entry)
 {
-    NautilusListModelPrivate *priv;
-    FileEntry *parent_file_entry;
-    GtkTreeIter iter;
-    GtkTreePath *path, *parent_path;
-    GSequenceIter *ptr;
-    int pos_before, pos_after, length, i, old;
-    int *new_order;
-    gboolean has_iter;
-    GSequence *files;
+    GSequenceIter *prev, *next;
 
-    priv = nautilus_list_model_get_instance_private (model);
+    if (!g_sequence_iter_is_begin (file_entry->ptr))
+    {
+        prev = g_sequence_iter_prev (file_entry->ptr);
+        if (nautilus_list_model_file_entry_compare_func (g_sequence_get (prev), file_entry, model) > 0)
+        {
+            return FALSE;
+        }
+    }
 
-    ptr = lookup_file (model, file, directory);
-    if (!ptr)
+    next = g_sequence_iter_next (file_entry->ptr);
+    if (!g_sequence_iter_is_end (next) &&
+        nautilus_list_model_file_entry_compare_func (file_entry, g_sequence_get (next), model) > 0)
     {
-        return;
+        return FALSE;
     }
 
+    return TRUE;
+}
 
-    pos_before = g_sequence_iter_get_position (ptr);
+/* Moves the changed entries of @files to their new positions and emits
+ * a single rows_reordered for all of them.
+ */
+static void
+resort_changed_file_entries (NautilusListModel *model,
+                             GSequence         *files,
+                             GList             *file_entries)
+{
+    FileEntry *file_entry, *parent_file_entry;
+    GSequence *moving;
+    GSequenceIter **old_order;
+    GSequenceIter *ptr;
+    GtkTreeIter iter;
+    GtkTreePath *parent_path;
+    GList *l;
+    int *new_order;
+    int length, i;
+    gboolean has_iter, moved;
 
-    g_sequence_sort_changed (ptr, nautilus_list_model_file_entry_compare_func, model);
+    /* The sequence is sorted if every changed entry is in order with its
+     * neighbors, which is the common case of a change that doesn't touch
+     * the sort attribute.
+     */
+    for (l = file_entries; l != NULL; l = l->next)
+    {
+        if (!file_entry_is_in_order (model, l->data))
+        {
+            break;
+        }
+    }
+    if (l == NULL)
+    {
+        return;
+    }
+
+    length = g_sequence_get_length (files);
+    old_order = g_new (GSequenceIter *, length);
+    for (ptr = g_sequence_get_begin_iter (files), i = 0;
+         !g_sequence_iter_is_end (ptr);
+         ptr = g_sequence_iter_next (ptr), i++)
+    {
+        old_order[i] = ptr;
+    }
 
-    pos_after = g_sequence_iter_get_position (ptr);
+    /* Take all the changed entries out first, so that the rest stays
+     * sorted, and put each back with a binary search.
+     */
+    moving = g_sequence_new (NULL);
+    for (l = file_entries; l != NULL; l = l->next)
+    {
+        file_entry = l->data;
+        g_sequence_move (file_entry->ptr, g_sequence_get_end_iter (moving));
+    }
+    for (l = file_entries; l != NULL; l = l->next)
+    {
+        file_entry = l->data;
+        g_sequence_move (file_entry->ptr,
+                         g_sequence_search (files, file_entry,
+                                            nautilus_list_model_file_entry_compare_func,
+                                            model));
+    }
+    g_sequence_free (moving);
 
-    if (pos_before != pos_after)
+    /* Note: new_order[newpos] = oldpos */
+    new_order = g_new (int, length);
+    moved = FALSE;
+    for (i = 0; i < length; ++i)
     {
-        /* The file moved, we need to send rows_reordered */
+        new_order[g_sequence_iter_get_position (old_order[i])] = i;
+    }
+    for (i = 0; i < length && !moved; ++i)
+    {
+        moved = new_order[i] != i;
+    }
 
-        parent_file_entry = ((FileEntry *) g_sequence_get (ptr))->parent;
+    if (moved)
+    {
+        invalidate_flat_index (model, files);
 
+        parent_file_entry = ((FileEntry *) file_entries->data)->parent;
         if (parent_file_entry == NULL)
         {
             has_iter = FALSE;
             parent_path = gtk_tree_path_new ();
-            files = priv->files;
         }
         else
         {
             has_iter = TRUE;
             nautilus_list_model_ptr_to_iter (model, parent_file_entry->ptr, &iter);
             parent_path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
-            files = parent_file_entry->files;
-        }
-
-        length = g_sequence_get_length (files);
-        new_order = g_new (int, length);
-        /* Note: new_order[newpos] = oldpos */
-        for (i = 0, old = 0; i < length; ++i)
-        {
-            if (i == pos_after)
-            {
-                new_order[i] = pos_before;
-            }
-            else
-            {
-                if (old == pos_before)
-                {
-                    old++;
-                }
-                new_order[i] = old++;
-            }
         }
 
         gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model),
                                        parent_path, has_iter ? &iter : NULL, new_order);
 
         gtk_tree_path_free (parent_path);
-        g_free (new_order);
+    }
+
+    g_free (old_order);
+    g_free (new_order);
+}
+
+/**
+ * nautilus_list_model_flush_pending_changes:
+ * @model: a #NautilusListModel
+ *
+ * Moves the rows that changed since the last flush to their sorted
+ * positions. Changed rows are only re-sorted in batches, so that a
+ * burst of changes, like the progress of a big copy into a folder sorted
+ * by size, reorders the rows once.
+ **/
+void
+nautilus_list_model_flush_pending_changes (NautilusListModel *model)
+{
+    NautilusListModelPrivate *priv;
+    g_autoptr (GHashTable) by_sequence = NULL;
+    GHashTableIter hash_iter;
+    gpointer key, value;
+    GList *file_entries;
+    GList *l;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    g_clear_handle_id (&priv->pending_changes_idle_id, g_source_remove);
+
+    if (priv->pending_changes == NULL || g_hash_table_size (priv->pending_changes) == 0)
+    {
+        return;
+    }
+
+    file_entries = g_hash_table_get_keys (priv->pending_changes);
+    g_hash_table_remove_all (priv->pending_changes);
+
+    by_sequence = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_list_free);
+    for (l = file_entries; l != NULL; l = l->next)
+    {
+        key = g_sequence_iter_get_sequence (((FileEntry *) l->data)->ptr);
+        value = g_hash_table_lookup (by_sequence, key);
+        g_hash_table_steal (by_sequence, key);
+        g_hash_table_insert (by_sequence, key, g_list_prepend (value, l->data));
+    }
+    g_list_free (file_entries);
+
+    g_hash_table_iter_init (&hash_iter, by_sequence);
+    while (g_hash_table_iter_next (&hash_iter, &key, &value))
+    {
+        resort_changed_file_entries (model, key, value);
+    }
+}
+
+static gboolean
+flush_pending_changes_idle_callback (gpointer user_data)
+{
+    NautilusListModel *model;
+    NautilusListModelPrivate *priv;
+
+    model = NAUTILUS_LIST_MODEL (user_data);
+    priv = nautilus_list_model_get_instance_private (model);
+
+    priv->pending_changes_idle_id = 0;
+    nautilus_list_model_flush_pending_changes (model);
+
+    return G_SOURCE_REMOVE;
+}
+
+void
+nautilus_list_model_file_changed (NautilusListModel *model,
+                                  NautilusFile      *file,
+                                  NautilusDirectory *directory)
+{
+    NautilusListModelPrivate *priv;
+    GtkTreeIter iter;
+    GtkTreePath *path;
+    GSequenceIter *ptr;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    ptr = lookup_file (model, file, directory);
+    if (!ptr)
+    {
+        return;
+    }
+
+    /* The row is moved to its new position at the next flush. */
+    g_hash_table_add (priv->pending_changes, g_sequence_get (ptr));
+    if (priv->pending_changes_idle_id == 0)
+    {
+        priv->pending_changes_idle_id = g_idle_add (flush_pending_changes_idle_callback, model);
     }
 
     nautilus_list_model_ptr_to_iter (model, ptr, &iter);
@@ -1190,6 +1593,11 @@ nautilus_list_model_remove (NautilusListModel *model,
     ptr = iter->user_data;
     file_entry = g_sequence_get (ptr);
 
+    if (priv->pending_changes != NULL)
+    {
+        g_hash_table_remove (priv->pending_changes, file_entry);
+    }
+
     if (file_entry->files != NULL)
     {
         while (g_sequence_get_length (file_entry->files) > 0)
@@ -1251,6 +1659,7 @@ nautilus_list_model_remove (NautilusListModel *model,
 
     path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), iter);
 
+    invalidate_flat_index (model, g_sequence_iter_get_sequence (ptr));
     g_sequence_remove (ptr);
     priv->stamp++;
     gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
@@ -1659,11 +2068,16 @@ nautilus_list_model_dispose (GObject *object)
         priv->columns = NULL;
     }
 
+    g_clear_handle_id (&priv->pending_changes_idle_id, g_source_remove);
+    g_clear_pointer (&priv->pending_changes, g_hash_table_unref);
+
     if (priv->files)
     {
         g_sequence_free (priv->files);
         priv->files = NULL;
     }
+    g_clear_pointer (&priv->flat_index, g_ptr_array_unref);
+    priv->flat_index_valid = FALSE;
 
     if (priv->top_reverse_map)
     {
@@ -1694,6 +2108,9 @@ nautilus_list_model_finalize (GObject *object)
         priv->highlight_files = NULL;
     }
 
+    g_hash_table_destroy (priv->icon_surfaces);
+    g_string_free (priv->column_buffer, TRUE);
+
     G_OBJECT_CLASS (nautilus_list_model_parent_class)->finalize (object);
 }
 
@@ -1705,11 +2122,17 @@ nautilus_list_model_init (NautilusListModel *model)
     priv = nautilus_list_model_get_instance_private (model);
 
     priv->files = g_sequence_new ((GDestroyNotify) file_entry_free);
+    priv->flat_index = g_ptr_array_new ();
+    priv->pending_changes = g_hash_table_new (NULL, NULL);
     priv->top_reverse_map = g_hash_table_new (g_direct_hash, g_direct_equal);
     priv->directory_reverse_map = g_hash_table_new (g_direct_hash, g_direct_equal);
     priv->stamp = g_random_int ();
     priv->sort_attribute = 0;
     priv->columns = g_ptr_array_new ();
+    priv->icon_surfaces = g_hash_table_new_full (NULL, NULL,
+                                                 g_object_unref,
+                                                 (GDestroyNotify) cairo_surface_destroy);
+    priv->column_buffer = g_string_new (NULL);
 }
 
 static void
@@ -1759,6 +2182,7 @@ nautilus_list_model_tree_model_init (GtkTreeModelIface *iface)
     iface->iter_n_children = nautilus_list_model_iter_n_children;
     iface->iter_nth_child = nautilus_list_model_iter_nth_child;
     iface->iter_parent = nautilus_list_model_iter_parent;
+    iface->row_changed = nautilus_list_model_row_changed;
 }
 
 static void
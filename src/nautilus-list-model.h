@@ -56,6 +56,7 @@ gboolean nautilus_list_model_add_file                          (NautilusListMode
 void     nautilus_list_model_file_changed                      (NautilusListModel          *model,
 								NautilusFile         *file,
 								NautilusDirectory    *directory);
+void     nautilus_list_model_flush_pending_changes             (NautilusListModel          *model);
 gboolean nautilus_list_model_is_empty                          (NautilusListModel          *model);
 void     nautilus_list_model_remove_file                       (NautilusListModel          *model,
 								NautilusFile         *file,
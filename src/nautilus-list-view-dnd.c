@@ -54,7 +54,7 @@ drag_data_get_callback (GtkWidget        *widget,
         return;
     }
 
-    nautilus_drag_drag_data_get_from_cache (list_view->details->drag_source_info->selection_cache,
+    nautilus_drag_drag_data_get_from_cache (list_view->details->drag_source_info,
                                             context, selection_data, info, time);
 }
 
@@ -169,7 +169,6 @@ drag_begin_callback (GtkWidget        *widget,
 {
     cairo_surface_t *surface;
     NautilusWindow *window;
-    GList *dragged_files;
 
     window = nautilus_files_view_get_window (NAUTILUS_FILES_VIEW (view));
     surface = get_drag_surface (view);
@@ -189,12 +188,10 @@ drag_begin_callback (GtkWidget        *widget,
     view->details->drag_source_info->selection_cache = nautilus_drag_create_selection_cache (view,
                                                                                              each_item_get_data_binder);
 
-    dragged_files = nautilus_drag_file_list_from_selection_list (view->details->drag_source_info->selection_cache);
-    if (nautilus_file_list_are_all_folders (dragged_files))
+    if (nautilus_drag_selection_list_are_all_folders (view->details->drag_source_info->selection_cache))
     {
         nautilus_window_start_dnd (window, context);
     }
-    g_list_free_full (dragged_files, g_object_unref);
 }
 
 static void
@@ -214,8 +211,7 @@ drag_end_callback (GtkWidget        *widget,
 static void
 drag_info_data_free (NautilusListView *list_view)
 {
-    nautilus_drag_destroy_selection_list (list_view->details->drag_source_info->selection_cache);
-    list_view->details->drag_source_info->selection_cache = NULL;
+    nautilus_drag_clear_selection_cache (list_view->details->drag_source_info);
 
     g_free (list_view->details->drag_source_info);
     list_view->details->drag_source_info = NULL;
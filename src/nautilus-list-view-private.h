@@ -75,5 +75,29 @@ struct NautilusListViewDetails {
 
   GtkGesture *tree_view_drag_gesture;
   GtkGesture *tree_view_multi_press_gesture;
+
+  guint prioritize_visible_rows_id;
+  /* Files whose thumbnails were queued while their rows were visible */
+  GHashTable *thumbnailing_files;
+  /* Files whose extension info is monitored, those of the rows in view
+   * and of the ones scrolled out less than a screen away */
+  GHashTable *extension_info_files;
+
+  /* NautilusFile -> formatted location, for the "where" and
+   * "trash_orig_path" columns. Dropped when the row changes. */
+  GHashTable *where_strings;
+  GHashTable *trash_orig_path_strings;
+
+  /* The folder under the pointer, listed ahead in case it gets expanded */
+  NautilusFile *prefetch_file;
+  guint prefetch_timeout_id;
+  NautilusDirectory *prefetch_directory; /* while loading */
+
+  /* Expanding all the folders under a row, a few loads at a time */
+  GQueue expand_all_queue; /* of GtkTreeRowReference, waiting their turn */
+  GHashTable *expand_all_directories; /* of NautilusDirectory, expanded so */
+  GHashTable *expand_all_loading; /* the ones of those still loading */
+  guint expand_all_count;
+  gboolean expanding_all;
 };
 
@@ -50,6 +50,7 @@
 #include "nautilus-metadata.h"
 #include "nautilus-search-directory.h"
 #include "nautilus-tag-manager.h"
+#include "nautilus-thumbnails.h"
 #include "nautilus-toolbar.h"
 #include "nautilus-tree-view-drag-dest.h"
 #include "nautilus-ui-utilities.h"
@@ -72,6 +73,20 @@ struct SelectionForeachData
 /* We wait two seconds after row is collapsed to unload the subdirectory */
 #define COLLAPSE_TO_UNLOAD_DELAY 2
 
+/* Folders with fewer rows than this are measured row by row as usual,
+ * so that the columns fit their contents. */
+#define FIXED_HEIGHT_MODE_MIN_ROWS 1000
+/* How many rows to measure to size the columns in fixed-height mode */
+#define FIXED_HEIGHT_MODE_SAMPLE_ROWS 100
+
+/* How long the pointer stays on a folder before its files are listed */
+#define PREFETCH_HOVER_DELAY_MSECS 300
+
+/* Expanding all the folders under a row loads this many at once, and
+ * stops after that many folders. */
+#define EXPAND_ALL_MAX_LOADS 4
+#define EXPAND_ALL_MAX_DIRECTORIES 1000
+
 static GdkCursor *hand_cursor = NULL;
 
 static GList *nautilus_list_view_get_selection (NautilusFilesView *view);
@@ -312,6 +327,167 @@ nautilus_list_view_did_not_drag (NautilusListView *view,
     gtk_tree_path_free (path);
 }
 
+static void
+prefetch_ready_callback (NautilusDirectory *directory,
+                         GList             *files,
+                         gpointer           callback_data)
+{
+    /* Nothing to do: the reference held on the directory keeps its files
+     * around until the next folder is hovered or this one is expanded. */
+}
+
+static void
+cancel_prefetch (NautilusListView *view)
+{
+    g_clear_handle_id (&view->details->prefetch_timeout_id, g_source_remove);
+    g_clear_pointer (&view->details->prefetch_file, nautilus_file_unref);
+
+    if (view->details->prefetch_directory != NULL)
+    {
+        nautilus_directory_cancel_callback (view->details->prefetch_directory,
+                                            prefetch_ready_callback, view);
+        g_clear_pointer (&view->details->prefetch_directory, nautilus_directory_unref);
+    }
+}
+
+static gboolean
+prefetch_timeout (gpointer user_data)
+{
+    NautilusListView *view = NAUTILUS_LIST_VIEW (user_data);
+    NautilusDirectory *directory;
+
+    view->details->prefetch_timeout_id = 0;
+
+    directory = nautilus_directory_get_for_file (view->details->prefetch_file);
+    if (directory == view->details->prefetch_directory ||
+        nautilus_directory_are_all_files_seen (directory))
+    {
+        nautilus_directory_unref (directory);
+        return G_SOURCE_REMOVE;
+    }
+
+    /* One at a time, the last one hovered */
+    if (view->details->prefetch_directory != NULL)
+    {
+        nautilus_directory_cancel_callback (view->details->prefetch_directory,
+                                            prefetch_ready_callback, view);
+        nautilus_directory_unref (view->details->prefetch_directory);
+    }
+    view->details->prefetch_directory = directory;
+
+    if (DEBUGGING)
+    {
+        g_autofree char *uri = nautilus_directory_get_uri (directory);
+        DEBUG ("Prefetching the files of %s", uri);
+    }
+
+    nautilus_directory_call_when_ready (directory,
+                                        NAUTILUS_FILE_ATTRIBUTE_INFO,
+                                        TRUE,
+                                        prefetch_ready_callback,
+                                        view);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Lists the files of the collapsed folder under the pointer in advance,
+ * so that they are there when it is expanded. */
+static void
+update_prefetch (NautilusListView *view,
+                 GtkTreePath      *path)
+{
+    g_autoptr (NautilusFile) file = NULL;
+    GtkTreeIter iter;
+
+    if (path != NULL &&
+        !gtk_tree_view_row_expanded (view->details->tree_view, path) &&
+        gtk_tree_model_get_iter (GTK_TREE_MODEL (view->details->model), &iter, path))
+    {
+        gtk_tree_model_get (GTK_TREE_MODEL (view->details->model), &iter,
+                            NAUTILUS_LIST_MODEL_FILE_COLUMN, &file,
+                            -1);
+    }
+
+    if (file == view->details->prefetch_file)
+    {
+        return;
+    }
+
+    g_clear_handle_id (&view->details->prefetch_timeout_id, g_source_remove);
+    g_clear_pointer (&view->details->prefetch_file, nautilus_file_unref);
+
+    if (file == NULL || !nautilus_file_is_directory (file) ||
+        !g_settings_get_boolean (nautilus_list_view_preferences,
+                                 NAUTILUS_PREFERENCES_LIST_VIEW_USE_TREE))
+    {
+        return;
+    }
+
+    view->details->prefetch_file = g_steal_pointer (&file);
+    view->details->prefetch_timeout_id = g_timeout_add (PREFETCH_HOVER_DELAY_MSECS,
+                                                        prefetch_timeout, view);
+}
+
+static void
+expand_all_next (NautilusListView *view)
+{
+    while (!g_queue_is_empty (&view->details->expand_all_queue) &&
+           g_hash_table_size (view->details->expand_all_loading) < EXPAND_ALL_MAX_LOADS &&
+           view->details->expand_all_count < EXPAND_ALL_MAX_DIRECTORIES)
+    {
+        GtkTreeRowReference *reference;
+        GtkTreePath *path;
+
+        reference = g_queue_pop_head (&view->details->expand_all_queue);
+        path = gtk_tree_row_reference_get_path (reference);
+        gtk_tree_row_reference_free (reference);
+
+        if (path == NULL)
+        {
+            continue;
+        }
+
+        view->details->expanding_all = TRUE;
+        gtk_tree_view_expand_row (view->details->tree_view, path, FALSE);
+        view->details->expanding_all = FALSE;
+
+        gtk_tree_path_free (path);
+    }
+}
+
+static void
+expand_all_clear (NautilusListView *view)
+{
+    g_queue_clear_full (&view->details->expand_all_queue,
+                        (GDestroyNotify) gtk_tree_row_reference_free);
+    g_hash_table_remove_all (view->details->expand_all_directories);
+    g_hash_table_remove_all (view->details->expand_all_loading);
+    view->details->expand_all_count = 0;
+}
+
+/* Queues the folder just added under a folder being expanded all */
+static void
+expand_all_add_file (NautilusListView  *view,
+                     NautilusFile      *file,
+                     NautilusDirectory *directory)
+{
+    GtkTreeIter iter;
+    GtkTreePath *path;
+
+    if (!nautilus_file_is_directory (file) ||
+        !g_hash_table_contains (view->details->expand_all_directories, directory) ||
+        !nautilus_list_model_get_tree_iter_from_file (view->details->model, file,
+                                                      directory, &iter))
+    {
+        return;
+    }
+
+    path = gtk_tree_model_get_path (GTK_TREE_MODEL (view->details->model), &iter);
+    g_queue_push_tail (&view->details->expand_all_queue,
+                       gtk_tree_row_reference_new (GTK_TREE_MODEL (view->details->model), path));
+    gtk_tree_path_free (path);
+}
+
 static gboolean
 on_motion_notify (GtkWidget *widget,
                   GdkEvent  *event,
@@ -331,6 +507,14 @@ on_motion_notify (GtkWidget *widget,
 
     g_assert (gdk_event_get_coords (event, &x, &y));
 
+    {
+        g_autoptr (GtkTreePath) path = NULL;
+
+        gtk_tree_view_get_path_at_pos (GTK_TREE_VIEW (widget), x, y,
+                                       &path, NULL, NULL, NULL);
+        update_prefetch (view, path);
+    }
+
     if (get_click_policy () == NAUTILUS_CLICK_POLICY_SINGLE)
     {
         GtkTreePath *old_hover_path;
@@ -371,6 +555,8 @@ on_leave_notify (GtkWidget *widget,
 
     view = NAUTILUS_LIST_VIEW (callback_data);
 
+    update_prefetch (view, NULL);
+
     if (get_click_policy () == NAUTILUS_CLICK_POLICY_SINGLE &&
         view->details->hover_path != NULL)
     {
@@ -480,7 +666,6 @@ on_star_cell_renderer_clicked (GtkTreePath      *path,
 {
     NautilusListModel *list_model;
     NautilusFile *file;
-    g_autofree gchar *uri = NULL;
     GList *selection;
 
     list_model = list_view->details->model;
@@ -493,10 +678,9 @@ on_star_cell_renderer_clicked (GtkTreePath      *path,
         return;
     }
 
-    uri = nautilus_file_get_uri (file);
     selection = g_list_prepend (NULL, file);
 
-    if (nautilus_tag_manager_file_is_starred (list_view->details->tag_manager, uri))
+    if (nautilus_file_is_starred (file))
     {
         nautilus_tag_manager_unstar_files (list_view->details->tag_manager,
                                            G_OBJECT (list_view),
@@ -923,7 +1107,8 @@ key_press_callback (GtkWidget *widget,
 
         if (path != NULL)
         {
-            gtk_tree_view_expand_row (tree_view, path, FALSE);
+            /* Shift expands all the folders under it too */
+            gtk_tree_view_expand_row (tree_view, path, (state & GDK_SHIFT_MASK) != 0);
         }
 
         return GDK_EVENT_STOP;
@@ -1020,6 +1205,11 @@ subdirectory_done_loading_callback (NautilusDirectory *directory,
                                     NautilusListView  *view)
 {
     nautilus_list_model_subdirectory_done_loading (view->details->model, directory);
+
+    if (g_hash_table_remove (view->details->expand_all_loading, directory))
+    {
+        expand_all_next (view);
+    }
 }
 
 static void
@@ -1031,6 +1221,8 @@ row_expanded_callback (GtkTreeView *treeview,
     NautilusListView *view;
     NautilusDirectory *directory;
     char *uri;
+    GdkModifierType state;
+    gboolean expand_all;
 
     view = NAUTILUS_LIST_VIEW (callback_data);
 
@@ -1043,6 +1235,27 @@ row_expanded_callback (GtkTreeView *treeview,
     DEBUG ("Row expanded callback for URI %s", uri);
     g_free (uri);
 
+    if (view->details->prefetch_directory == directory)
+    {
+        cancel_prefetch (view);
+    }
+
+    /* GTK expands all with Shift, but only the rows already there: the
+     * folders are expanded here as their files come in instead. */
+    expand_all = view->details->expanding_all ||
+                 (gtk_get_current_event_state (&state) && (state & GDK_SHIFT_MASK) != 0);
+    if (expand_all)
+    {
+        if (!view->details->expanding_all)
+        {
+            /* A new one, from the user */
+            view->details->expand_all_count = 0;
+        }
+        view->details->expand_all_count++;
+        g_hash_table_add (view->details->expand_all_directories,
+                          nautilus_directory_ref (directory));
+    }
+
     nautilus_files_view_add_subdirectory (NAUTILUS_FILES_VIEW (view), directory);
 
     if (nautilus_directory_are_all_files_seen (directory))
@@ -1052,6 +1265,12 @@ row_expanded_callback (GtkTreeView *treeview,
     }
     else
     {
+        if (expand_all)
+        {
+            g_hash_table_add (view->details->expand_all_loading,
+                              nautilus_directory_ref (directory));
+        }
+
         g_signal_connect_object (directory, "done-loading",
                                  G_CALLBACK (subdirectory_done_loading_callback),
                                  view, 0);
@@ -1190,6 +1409,11 @@ subdirectory_unloaded_callback (NautilusListModel *model,
     g_signal_handlers_disconnect_by_func (directory,
                                           G_CALLBACK (subdirectory_done_loading_callback),
                                           view);
+    g_hash_table_remove (view->details->expand_all_directories, directory);
+    if (g_hash_table_remove (view->details->expand_all_loading, directory))
+    {
+        expand_all_next (view);
+    }
     nautilus_files_view_remove_subdirectory (NAUTILUS_FILES_VIEW (view), directory);
 }
 
@@ -1706,7 +1930,6 @@ starred_cell_data_func (GtkTreeViewColumn *column,
                         NautilusListView  *view)
 {
     g_autofree gchar *text = NULL;
-    g_autofree gchar *uri = NULL;
     NautilusFile *file;
 
     gtk_tree_model_get (model, iter,
@@ -1728,9 +1951,7 @@ starred_cell_data_func (GtkTreeViewColumn *column,
         return;
     }
 
-    uri = nautilus_file_get_uri (file);
-
-    if (nautilus_tag_manager_file_is_starred (view->details->tag_manager, uri))
+    if (nautilus_file_is_starred (file))
     {
         g_object_set (renderer,
                       "icon-name", "starred-symbolic",
@@ -1851,14 +2072,12 @@ location_cell_data_func (GtkTreeViewColumn *column,
     NautilusDirectory *directory;
     GFile *home_location;
     NautilusFile *file;
+    NautilusFile *row_file;
     GFile *dir_location;
     GFile *base_location;
+    GHashTable *cache;
     gchar *where = NULL;
 
-    directory = nautilus_files_view_get_model (NAUTILUS_FILES_VIEW (view));
-
-    home_location = g_file_new_for_path (g_get_home_dir ());
-
     gtk_tree_model_get (model, iter,
                         NAUTILUS_LIST_MODEL_FILE_COLUMN, &file,
                         -1);
@@ -1871,6 +2090,23 @@ location_cell_data_func (GtkTreeViewColumn *column,
         return;
     }
 
+    cache = show_trash_orig ? view->details->trash_orig_path_strings : view->details->where_strings;
+    where = g_hash_table_lookup (cache, file);
+    if (where != NULL)
+    {
+        g_object_set (G_OBJECT (renderer),
+                      "text", where,
+                      NULL);
+        nautilus_file_unref (file);
+        return;
+    }
+
+    directory = nautilus_files_view_get_model (NAUTILUS_FILES_VIEW (view));
+
+    home_location = g_file_new_for_path (g_get_home_dir ());
+
+    row_file = nautilus_file_ref (file);
+
     if (show_trash_orig && nautilus_file_is_in_trash (file))
     {
         NautilusFile *orig_file;
@@ -1955,7 +2191,8 @@ location_cell_data_func (GtkTreeViewColumn *column,
                   "text", where,
                   NULL);
 
-    g_free (where);
+    /* Takes the reference on the file of the row. */
+    g_hash_table_insert (cache, row_file, where);
 
     g_object_unref (base_location);
     g_object_unref (dir_location);
@@ -1964,6 +2201,94 @@ location_cell_data_func (GtkTreeViewColumn *column,
 }
 
 
+static void
+on_model_row_changed (GtkTreeModel     *model,
+                      GtkTreePath      *path,
+                      GtkTreeIter      *iter,
+                      NautilusListView *view)
+{
+    NautilusFile *file;
+
+    gtk_tree_model_get (model, iter,
+                        NAUTILUS_LIST_MODEL_FILE_COLUMN, &file,
+                        -1);
+
+    if (file != NULL)
+    {
+        g_hash_table_remove (view->details->where_strings, file);
+        g_hash_table_remove (view->details->trash_orig_path_strings, file);
+        nautilus_file_unref (file);
+    }
+}
+
+/* At the zoom levels where rows have a single line of text, all the rows
+ * have the same height, so a big folder can go into fixed-height mode and
+ * the tree view no longer measures every row. Columns can't grow to fit
+ * their contents in that mode, so they are sized for the first rows.
+ */
+static void
+update_fixed_height_mode (NautilusListView *view)
+{
+    GtkTreeView *tree_view;
+    GtkTreeModel *model;
+    GtkTreeViewColumn *column;
+    GList *columns, *l;
+    GtkTreeIter iter;
+    gboolean fixed_height, valid;
+    int width, cell_width, n;
+
+    tree_view = view->details->tree_view;
+    model = GTK_TREE_MODEL (view->details->model);
+
+    fixed_height = view->details->zoom_level <= NAUTILUS_LIST_ZOOM_LEVEL_STANDARD &&
+                   gtk_tree_model_iter_n_children (model, NULL) >= FIXED_HEIGHT_MODE_MIN_ROWS;
+
+    if (fixed_height == gtk_tree_view_get_fixed_height_mode (tree_view))
+    {
+        return;
+    }
+
+    if (!fixed_height)
+    {
+        gtk_tree_view_set_fixed_height_mode (tree_view, FALSE);
+    }
+
+    columns = gtk_tree_view_get_columns (tree_view);
+    for (l = columns; l != NULL; l = l->next)
+    {
+        column = l->data;
+
+        if (!fixed_height)
+        {
+            gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_GROW_ONLY);
+            continue;
+        }
+
+        width = gtk_tree_view_column_get_width (column);
+        n = 0;
+        for (valid = gtk_tree_model_get_iter_first (model, &iter);
+             valid && n < FIXED_HEIGHT_MODE_SAMPLE_ROWS;
+             valid = gtk_tree_model_iter_next (model, &iter), n++)
+        {
+            gtk_tree_view_column_cell_set_cell_data (column, model, &iter, FALSE, FALSE);
+            gtk_tree_view_column_cell_get_size (column, NULL, NULL, NULL, &cell_width, NULL);
+            width = MAX (width, cell_width);
+        }
+
+        if (width > 0)
+        {
+            gtk_tree_view_column_set_fixed_width (column, width);
+        }
+        gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+    }
+    g_list_free (columns);
+
+    if (fixed_height)
+    {
+        gtk_tree_view_set_fixed_height_mode (tree_view, TRUE);
+    }
+}
+
 static void
 where_cell_data_func (GtkTreeViewColumn *column,
                       GtkCellRenderer   *renderer,
@@ -2108,6 +2433,311 @@ list_view_use_tree_changed_callback (gpointer callback_data)
 }
 
 
+/* Don't bother the directory with more rows than fit on a big screen. */
+#define MAX_PRIORITIZED_ROWS 200
+
+/* Queued thumbnails of rows scrolled more than this many screens away
+ * are dropped; closer ones only go to the lower tiers of the queue. */
+#define THUMBNAIL_CANCEL_SCREENS 4
+
+/* The extension info of rows scrolled more than this many screens away is
+ * no longer kept up to date. */
+#define EXTENSION_INFO_SCREENS 1
+
+/* Only asked for the rows in view, see update_extension_info_files() */
+#define LAZY_ATTRIBUTES (NAUTILUS_FILE_ATTRIBUTE_EXTENSION_INFO | \
+                         NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO)
+
+static gint
+get_top_level_position (GtkTreeModel *model,
+                        GtkTreeIter  *iter)
+{
+    GtkTreePath *path;
+    gint position;
+
+    path = gtk_tree_model_get_path (model, iter);
+    position = gtk_tree_path_get_indices (path)[0];
+    gtk_tree_path_free (path);
+
+    return position;
+}
+
+/* Thumbnails are made by tier, so the ones of the rows that went out
+ * of view make room for the visible ones: the rows within a screen of
+ * them go next, then the ones further away.
+ */
+static void
+demote_hidden_thumbnails (NautilusListView *view,
+                          GHashTable       *visible_files,
+                          gint              start_position,
+                          gint              end_position)
+{
+    GtkTreeModel *model;
+    GHashTableIter hash_iter;
+    GtkTreeIter iter;
+    gpointer key;
+    NautilusFile *file;
+    g_autoptr (GList) near_files = NULL;
+    g_autoptr (GList) far_files = NULL;
+    gint position, screen, distance;
+
+    model = GTK_TREE_MODEL (view->details->model);
+    screen = end_position - start_position + 1;
+    distance = screen * THUMBNAIL_CANCEL_SCREENS;
+
+    g_hash_table_iter_init (&hash_iter, view->details->thumbnailing_files);
+    while (g_hash_table_iter_next (&hash_iter, &key, NULL))
+    {
+        file = key;
+
+        if (!nautilus_file_is_thumbnailing (file))
+        {
+            g_hash_table_iter_remove (&hash_iter);
+            continue;
+        }
+        if (g_hash_table_contains (visible_files, file))
+        {
+            continue;
+        }
+
+        if (!nautilus_list_model_get_first_iter_for_file (view->details->model, file, &iter))
+        {
+            nautilus_thumbnail_cancel (file);
+            g_hash_table_iter_remove (&hash_iter);
+            continue;
+        }
+
+        position = get_top_level_position (model, &iter);
+        if (position < start_position - distance || position > end_position + distance)
+        {
+            nautilus_thumbnail_cancel (file);
+            g_hash_table_iter_remove (&hash_iter);
+        }
+        else if (position >= start_position - screen && position <= end_position + screen)
+        {
+            near_files = g_list_prepend (near_files, file);
+        }
+        else
+        {
+            far_files = g_list_prepend (far_files, file);
+        }
+    }
+
+    nautilus_thumbnail_set_priority (near_files, NAUTILUS_THUMBNAIL_PRIORITY_NEAR_VISIBLE, view);
+    nautilus_thumbnail_set_priority (far_files, NAUTILUS_THUMBNAIL_PRIORITY_PREFETCH, view);
+}
+
+static void
+clear_extension_info_files (NautilusListView *view)
+{
+    GHashTableIter iter;
+    gpointer key;
+
+    g_hash_table_iter_init (&iter, view->details->extension_info_files);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+        nautilus_file_monitor_remove (key, view->details->extension_info_files);
+        g_hash_table_iter_remove (&iter);
+    }
+}
+
+/* The info providers are only asked about the files of the rows in view,
+ * for their columns and emblems, rather than about every file of the
+ * folder. So is the info left out of the fast loads of slow locations,
+ * which takes a query for each file. The ones scrolled out of view keep
+ * what they got, which is only kept up to date while they are close. */
+static void
+update_extension_info_files (NautilusListView *view,
+                             GList            *visible_files,
+                             gint              start_position,
+                             gint              end_position)
+{
+    GHashTable *files = view->details->extension_info_files;
+    GHashTableIter hash_iter;
+    GtkTreeIter iter;
+    gpointer key;
+    gint position, distance;
+
+    distance = (end_position - start_position + 1) * EXTENSION_INFO_SCREENS;
+
+    g_hash_table_iter_init (&hash_iter, files);
+    while (g_hash_table_iter_next (&hash_iter, &key, NULL))
+    {
+        if (nautilus_list_model_get_first_iter_for_file (view->details->model, key, &iter))
+        {
+            position = get_top_level_position (GTK_TREE_MODEL (view->details->model), &iter);
+            if (position >= start_position - distance && position <= end_position + distance)
+            {
+                continue;
+            }
+        }
+
+        nautilus_file_monitor_remove (key, files);
+        g_hash_table_iter_remove (&hash_iter);
+    }
+
+    for (GList *l = visible_files; l != NULL; l = l->next)
+    {
+        if (!g_hash_table_contains (files, l->data))
+        {
+            g_hash_table_add (files, nautilus_file_ref (l->data));
+            nautilus_file_monitor_add (l->data, files, LAZY_ATTRIBUTES);
+        }
+    }
+}
+
+/* Goes to the row below, in or out of the expanded folders */
+static gboolean
+get_next_visible_iter (NautilusListView *view,
+                       GtkTreeIter      *iter)
+{
+    GtkTreeModel *model = GTK_TREE_MODEL (view->details->model);
+    GtkTreeIter next;
+    GtkTreePath *path;
+    gboolean expanded;
+
+    path = gtk_tree_model_get_path (model, iter);
+    expanded = gtk_tree_view_row_expanded (view->details->tree_view, path);
+    gtk_tree_path_free (path);
+
+    if (expanded && gtk_tree_model_iter_children (model, &next, iter))
+    {
+        *iter = next;
+        return TRUE;
+    }
+
+    while (TRUE)
+    {
+        GtkTreeIter parent;
+
+        next = *iter;
+        if (gtk_tree_model_iter_next (model, &next))
+        {
+            *iter = next;
+            return TRUE;
+        }
+
+        if (!gtk_tree_model_iter_parent (model, &parent, iter))
+        {
+            return FALSE;
+        }
+        *iter = parent;
+    }
+}
+
+static gboolean
+prioritize_visible_rows_idle_callback (gpointer user_data)
+{
+    NautilusListView *view;
+    GtkTreeModel *model;
+    GtkTreePath *start_path, *end_path, *path;
+    GtkTreeIter iter;
+    GList *files, *l;
+    g_autoptr (GHashTable) visible_files = NULL;
+    g_autoptr (GList) thumbnailing = NULL;
+    NautilusFile *file;
+    gboolean valid;
+    guint n_rows;
+
+    view = NAUTILUS_LIST_VIEW (user_data);
+    view->details->prioritize_visible_rows_id = 0;
+
+    if (!gtk_tree_view_get_visible_range (view->details->tree_view,
+                                          &start_path, &end_path))
+    {
+        return G_SOURCE_REMOVE;
+    }
+
+    model = GTK_TREE_MODEL (view->details->model);
+    files = NULL;
+    n_rows = 0;
+
+    valid = gtk_tree_model_get_iter (model, &iter, start_path);
+    while (valid && n_rows < MAX_PRIORITIZED_ROWS)
+    {
+        gtk_tree_model_get (model, &iter,
+                            NAUTILUS_LIST_MODEL_FILE_COLUMN, &file,
+                            -1);
+        if (file != NULL)
+        {
+            files = g_list_prepend (files, file);
+        }
+        n_rows++;
+
+        path = gtk_tree_model_get_path (model, &iter);
+        valid = gtk_tree_path_compare (path, end_path) < 0 &&
+                get_next_visible_iter (view, &iter);
+        gtk_tree_path_free (path);
+    }
+
+    visible_files = g_hash_table_new (NULL, NULL);
+    for (l = files; l != NULL; l = l->next)
+    {
+        g_hash_table_add (visible_files, l->data);
+    }
+
+    demote_hidden_thumbnails (view, visible_files,
+                              gtk_tree_path_get_indices (start_path)[0],
+                              gtk_tree_path_get_indices (end_path)[0]);
+    update_extension_info_files (view, files,
+                                 gtk_tree_path_get_indices (start_path)[0],
+                                 gtk_tree_path_get_indices (end_path)[0]);
+
+    /* The list is bottom-up, so the topmost row ends up first in
+     * the work queues.
+     */
+    for (l = files; l != NULL; l = l->next)
+    {
+        file = NAUTILUS_FILE (l->data);
+
+        nautilus_file_prioritize_attributes (file);
+
+        if (nautilus_file_is_thumbnailing (file))
+        {
+            thumbnailing = g_list_prepend (thumbnailing, file);
+            if (!g_hash_table_contains (view->details->thumbnailing_files, file))
+            {
+                g_hash_table_add (view->details->thumbnailing_files,
+                                  nautilus_file_ref (file));
+            }
+        }
+    }
+    nautilus_thumbnail_set_priority (thumbnailing, NAUTILUS_THUMBNAIL_PRIORITY_VISIBLE, view);
+
+    nautilus_file_list_free (files);
+    gtk_tree_path_free (start_path);
+    gtk_tree_path_free (end_path);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_prioritize_visible_rows (NautilusListView *view)
+{
+    if (view->details->prioritize_visible_rows_id == 0)
+    {
+        view->details->prioritize_visible_rows_id =
+            g_idle_add_full (G_PRIORITY_LOW,
+                             prioritize_visible_rows_idle_callback,
+                             view, NULL);
+    }
+}
+
+static void
+on_vadjustment_value_changed (GtkAdjustment    *adjustment,
+                              NautilusListView *view)
+{
+    schedule_prioritize_visible_rows (view);
+}
+
+static void
+on_tree_view_map (GtkWidget        *widget,
+                  NautilusListView *view)
+{
+    /* Its thumbnails were sent to the background while it was hidden */
+    schedule_prioritize_visible_rows (view);
+}
+
 static void
 create_and_set_up_tree_view (NautilusListView *view)
 {
@@ -2137,6 +2767,8 @@ create_and_set_up_tree_view (NautilusListView *view)
      */
     g_signal_connect (view->details->tree_view, "select-all",
                       G_CALLBACK (g_signal_stop_emission_by_name), "select-all");
+    g_signal_connect (view->details->tree_view, "map",
+                      G_CALLBACK (on_tree_view_map), view);
 
     g_signal_connect_object (view->details->drag_dest,
                              "get-root-uri",
@@ -2217,6 +2849,9 @@ create_and_set_up_tree_view (NautilusListView *view)
     g_signal_connect_object (view->details->model, "get-icon-scale",
                              G_CALLBACK (get_icon_scale_callback), view, 0);
 
+    g_signal_connect_object (view->details->model, "row-changed",
+                             G_CALLBACK (on_model_row_changed), view, 0);
+
     longpress_gesture = gtk_gesture_long_press_new (GTK_WIDGET (content_widget));
     gtk_event_controller_set_propagation_phase (GTK_EVENT_CONTROLLER (longpress_gesture),
                                                 GTK_PHASE_CAPTURE);
@@ -2411,6 +3046,11 @@ create_and_set_up_tree_view (NautilusListView *view)
     gtk_widget_show (GTK_WIDGET (view->details->tree_view));
     gtk_container_add (GTK_CONTAINER (content_widget), GTK_WIDGET (view->details->tree_view));
 
+    g_signal_connect_object (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view->details->tree_view)),
+                             "value-changed",
+                             G_CALLBACK (on_vadjustment_value_changed),
+                             view, 0);
+
     atk_obj = gtk_widget_get_accessible (GTK_WIDGET (view->details->tree_view));
     atk_object_set_name (atk_obj, _("List View"));
 
@@ -2433,11 +3073,17 @@ nautilus_list_view_add_files (NautilusFilesView *view,
 
         parent = nautilus_file_get_parent (NAUTILUS_FILE (l->data));
         directory = nautilus_directory_get_for_file (parent);
-        nautilus_list_model_add_file (model, NAUTILUS_FILE (l->data), directory);
+        if (nautilus_list_model_add_file (model, NAUTILUS_FILE (l->data), directory))
+        {
+            expand_all_add_file (NAUTILUS_LIST_VIEW (view), NAUTILUS_FILE (l->data), directory);
+        }
 
         nautilus_file_unref (parent);
         nautilus_directory_unref (directory);
     }
+
+    expand_all_next (NAUTILUS_LIST_VIEW (view));
+    schedule_prioritize_visible_rows (NAUTILUS_LIST_VIEW (view));
 }
 
 static char **
@@ -2757,7 +3403,17 @@ nautilus_list_view_clear (NautilusFilesView *view)
         gtk_tree_path_free (path);
 
         nautilus_list_model_clear (list_view->details->model);
+        update_fixed_height_mode (list_view);
     }
+
+    g_hash_table_remove_all (list_view->details->where_strings);
+    g_hash_table_remove_all (list_view->details->trash_orig_path_strings);
+    g_hash_table_remove_all (list_view->details->thumbnailing_files);
+    clear_extension_info_files (list_view);
+    nautilus_thumbnail_drop_owner (list_view);
+
+    cancel_prefetch (list_view);
+    expand_all_clear (list_view);
 }
 
 static void
@@ -3038,6 +3694,8 @@ nautilus_list_view_end_file_changes (NautilusFilesView *view)
 
     list_view = NAUTILUS_LIST_VIEW (view);
 
+    nautilus_list_model_flush_pending_changes (list_view->details->model);
+
     if (list_view->details->new_selection_path)
     {
         gtk_tree_view_set_cursor (list_view->details->tree_view,
@@ -3046,6 +3704,8 @@ nautilus_list_view_end_file_changes (NautilusFilesView *view)
         gtk_tree_path_free (list_view->details->new_selection_path);
         list_view->details->new_selection_path = NULL;
     }
+
+    update_fixed_height_mode (list_view);
 }
 
 static void
@@ -3503,6 +4163,8 @@ nautilus_list_view_set_zoom_level (NautilusListView      *view,
                                          "surface", column,
                                          NULL);
     set_up_pixbuf_size (view);
+
+    update_fixed_height_mode (view);
 }
 
 static void
@@ -3683,6 +4345,15 @@ nautilus_list_view_dispose (GObject *object)
 
     list_view = NAUTILUS_LIST_VIEW (object);
 
+    g_clear_handle_id (&list_view->details->prioritize_visible_rows_id, g_source_remove);
+    nautilus_thumbnail_drop_owner (list_view);
+    clear_extension_info_files (list_view);
+    cancel_prefetch (list_view);
+    if (list_view->details->expand_all_directories != NULL)
+    {
+        expand_all_clear (list_view);
+    }
+
     if (list_view->details->model)
     {
         g_object_unref (list_view->details->model);
@@ -3734,6 +4405,12 @@ nautilus_list_view_finalize (GObject *object)
 
     g_list_free (list_view->details->cells);
     g_hash_table_destroy (list_view->details->columns);
+    g_hash_table_destroy (list_view->details->where_strings);
+    g_hash_table_destroy (list_view->details->trash_orig_path_strings);
+    g_hash_table_destroy (list_view->details->thumbnailing_files);
+    g_hash_table_destroy (list_view->details->extension_info_files);
+    g_hash_table_destroy (list_view->details->expand_all_directories);
+    g_hash_table_destroy (list_view->details->expand_all_loading);
 
     if (list_view->details->hover_path != NULL)
     {
@@ -4068,6 +4745,12 @@ nautilus_list_view_preview_selection_event (NautilusFilesView *view,
     g_list_free_full (list, (GDestroyNotify) gtk_tree_path_free);
 }
 
+static NautilusFileAttributes
+nautilus_list_view_get_lazy_attributes (NautilusFilesView *view)
+{
+    return LAZY_ATTRIBUTES;
+}
+
 static void
 nautilus_list_view_class_init (NautilusListViewClass *class)
 {
@@ -4109,6 +4792,7 @@ nautilus_list_view_class_init (NautilusListViewClass *class)
     nautilus_files_view_class->compute_rename_popover_pointing_to = nautilus_list_view_compute_rename_popover_pointing_to;
     nautilus_files_view_class->reveal_for_selection_context_menu = nautilus_list_view_reveal_for_selection_context_menu;
     nautilus_files_view_class->preview_selection_event = nautilus_list_view_preview_selection_event;
+    nautilus_files_view_class->get_lazy_attributes = nautilus_list_view_get_lazy_attributes;
 }
 
 static void
@@ -4119,6 +4803,26 @@ nautilus_list_view_init (NautilusListView *list_view)
 
     list_view->details = g_new0 (NautilusListViewDetails, 1);
 
+    list_view->details->where_strings = g_hash_table_new_full (NULL, NULL,
+                                                               (GDestroyNotify) nautilus_file_unref,
+                                                               g_free);
+    list_view->details->trash_orig_path_strings = g_hash_table_new_full (NULL, NULL,
+                                                                         (GDestroyNotify) nautilus_file_unref,
+                                                                         g_free);
+    list_view->details->thumbnailing_files = g_hash_table_new_full (NULL, NULL,
+                                                                    (GDestroyNotify) nautilus_file_unref,
+                                                                    NULL);
+    list_view->details->extension_info_files = g_hash_table_new_full (NULL, NULL,
+                                                                      (GDestroyNotify) nautilus_file_unref,
+                                                                      NULL);
+    list_view->details->expand_all_directories = g_hash_table_new_full (NULL, NULL,
+                                                                        (GDestroyNotify) nautilus_directory_unref,
+                                                                        NULL);
+    list_view->details->expand_all_loading = g_hash_table_new_full (NULL, NULL,
+                                                                    (GDestroyNotify) nautilus_directory_unref,
+                                                                    NULL);
+    g_queue_init (&list_view->details->expand_all_queue);
+
     /* ensure that the zoom level is always set before settings up the tree view columns */
     list_view->details->zoom_level = get_default_zoom_level ();
 
@@ -31,6 +31,8 @@
 #include "nautilus-location-entry.h"
 
 #include "nautilus-application.h"
+#include "nautilus-directory.h"
+#include "nautilus-file.h"
 #include "nautilus-window.h"
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
@@ -69,7 +71,11 @@ static const GtkTargetEntry drop_types [] =
 typedef struct _NautilusLocationEntryPrivate
 {
     char *current_directory;
-    GFilenameCompleter *completer;
+
+    /* The directory completed in, and the sorted names of its
+     * subdirectories, NULL while it loads */
+    NautilusDirectory *completion_directory;
+    GPtrArray *completion_names;
 
     guint idle_id;
 
@@ -352,6 +358,232 @@ drag_data_get_callback (GtkWidget        *widget,
     g_object_unref (location);
 }
 
+static void
+clear_completion (NautilusLocationEntry *entry);
+static gboolean
+try_to_expand_path (gpointer callback_data);
+
+static int
+compare_names (gconstpointer a,
+               gconstpointer b)
+{
+    return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static void
+index_completion_names (NautilusLocationEntry *entry,
+                        GList                 *files)
+{
+    NautilusLocationEntryPrivate *priv;
+    g_auto (GStrv) hidden_names = NULL;
+
+    priv = nautilus_location_entry_get_instance_private (entry);
+
+    g_clear_pointer (&priv->completion_names, g_ptr_array_unref);
+    priv->completion_names = g_ptr_array_new_with_free_func (g_free);
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        g_autofree char *name = NULL;
+
+        if (!nautilus_file_is_directory (l->data))
+        {
+            continue;
+        }
+
+        name = nautilus_file_get_name (l->data);
+        if (name == NULL || !g_utf8_validate (name, -1, NULL))
+        {
+            continue;
+        }
+
+        /* With the separator, so that a single match completes to it */
+        g_ptr_array_add (priv->completion_names, g_strconcat (name, "/", NULL));
+    }
+
+    /* Not loaded unless shown, but typed all the same */
+    hidden_names = nautilus_directory_get_hidden_directory_names (priv->completion_directory);
+    for (guint i = 0; hidden_names[i] != NULL; i++)
+    {
+        if (g_utf8_validate (hidden_names[i], -1, NULL))
+        {
+            g_ptr_array_add (priv->completion_names, g_strconcat (hidden_names[i], "/", NULL));
+        }
+    }
+
+    g_ptr_array_sort (priv->completion_names, compare_names);
+}
+
+static void
+completion_files_ready (NautilusDirectory *directory,
+                        GList             *files,
+                        gpointer           callback_data)
+{
+    NautilusLocationEntry *entry;
+    NautilusLocationEntryPrivate *priv;
+
+    entry = NAUTILUS_LOCATION_ENTRY (callback_data);
+    priv = nautilus_location_entry_get_instance_private (entry);
+
+    index_completion_names (entry, files);
+
+    /* Complete what was typed meanwhile, unless more is coming */
+    if (priv->idle_id == 0)
+    {
+        try_to_expand_path (entry);
+    }
+}
+
+/* Returns the sorted names to complete with in @location, or NULL if they
+ * are still being loaded. Loaded directories are indexed right away, from
+ * the files they already have. */
+static GPtrArray *
+get_completion_names (NautilusLocationEntry *entry,
+                      GFile                 *location)
+{
+    NautilusLocationEntryPrivate *priv;
+    g_autoptr (NautilusDirectory) directory = NULL;
+
+    priv = nautilus_location_entry_get_instance_private (entry);
+
+    directory = nautilus_directory_get (location);
+    if (directory == priv->completion_directory)
+    {
+        return priv->completion_names;
+    }
+
+    clear_completion (entry);
+    priv->completion_directory = g_steal_pointer (&directory);
+
+    if (nautilus_directory_are_all_files_seen (priv->completion_directory))
+    {
+        g_autolist (NautilusFile) files = NULL;
+
+        files = nautilus_directory_get_file_list (priv->completion_directory);
+        index_completion_names (entry, files);
+    }
+    else
+    {
+        nautilus_directory_call_when_ready (priv->completion_directory,
+                                            NAUTILUS_FILE_ATTRIBUTE_INFO,
+                                            TRUE,
+                                            completion_files_ready,
+                                            entry);
+    }
+
+    return priv->completion_names;
+}
+
+static void
+clear_completion (NautilusLocationEntry *entry)
+{
+    NautilusLocationEntryPrivate *priv;
+
+    priv = nautilus_location_entry_get_instance_private (entry);
+
+    if (priv->completion_directory != NULL && priv->completion_names == NULL)
+    {
+        nautilus_directory_cancel_callback (priv->completion_directory,
+                                            completion_files_ready,
+                                            entry);
+    }
+
+    g_clear_pointer (&priv->completion_names, g_ptr_array_unref);
+    nautilus_directory_unref (priv->completion_directory);
+    priv->completion_directory = NULL;
+}
+
+/* Returns the first index in @names, from @low, of a name not sorting
+ * before @prefix, or with @past_prefix, of a name sorting after all the
+ * names starting with @prefix. */
+static guint
+search_names (GPtrArray  *names,
+              const char *prefix,
+              gsize       prefix_length,
+              gboolean    past_prefix,
+              guint       low)
+{
+    guint high;
+
+    high = names->len;
+    while (low < high)
+    {
+        guint middle;
+        int cmp;
+
+        middle = low + (high - low) / 2;
+        cmp = strncmp (g_ptr_array_index (names, middle), prefix, prefix_length);
+        if (cmp < 0 || (past_prefix && cmp == 0))
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/* Like g_filename_completer_get_completion_suffix(): what all the
+ * subdirectory names starting with the basename of @text share after it.
+ * Being sorted, that's what the first and the last of them share, so
+ * however many names match, only those two are looked at. */
+static char *
+get_completion_suffix (NautilusLocationEntry *entry,
+                       const char            *text)
+{
+    const char *basename;
+    g_autofree char *parent_name = NULL;
+    g_autoptr (GFile) parent = NULL;
+    GPtrArray *names;
+    gsize prefix_length;
+    guint first, last;
+    const char *first_name, *last_name;
+    gsize length;
+
+    basename = strrchr (text, '/');
+    /* Hidden folders are only completed when asked, as for an empty
+     * basename there's nothing to go by. */
+    if (basename == NULL || basename[1] == '\0')
+    {
+        return NULL;
+    }
+    basename++;
+
+    parent_name = g_strndup (text, basename - text);
+    parent = g_file_parse_name (parent_name);
+    names = get_completion_names (entry, parent);
+    if (names == NULL)
+    {
+        return NULL;
+    }
+
+    prefix_length = strlen (basename);
+    first = search_names (names, basename, prefix_length, FALSE, 0);
+    last = search_names (names, basename, prefix_length, TRUE, first);
+    if (first == last)
+    {
+        return NULL;
+    }
+
+    first_name = g_ptr_array_index (names, first) + prefix_length;
+    last_name = g_ptr_array_index (names, last - 1) + prefix_length;
+    for (length = 0; first_name[length] != '\0' && first_name[length] == last_name[length]; length++)
+    {
+    }
+
+    /* Not splitting a character */
+    length = g_utf8_find_prev_char (first_name, first_name + length + 1) - first_name;
+    if (length == 0)
+    {
+        return NULL;
+    }
+
+    return g_strndup (first_name, length);
+}
+
 /* routine that performs the tab expansion.  Extract the directory name and
  *  incomplete basename, then iterate through the directory trying to complete it.  If we
  *  find something, add it to the entry */
@@ -379,14 +611,12 @@ try_to_expand_path (gpointer callback_data)
     if (!g_path_is_absolute (user_location) && uri_scheme == NULL && user_location[0] != '~')
     {
         absolute_location = g_build_filename (priv->current_directory, user_location, NULL);
-        suffix = g_filename_completer_get_completion_suffix (priv->completer,
-                                                             absolute_location);
+        suffix = get_completion_suffix (entry, absolute_location);
         g_free (absolute_location);
     }
     else
     {
-        suffix = g_filename_completer_get_completion_suffix (priv->completer,
-                                                             user_location);
+        suffix = get_completion_suffix (entry, user_location);
     }
 
     g_free (user_location);
@@ -484,22 +714,6 @@ position_and_selection_are_at_end (GtkEditable *editable)
     return gtk_editable_get_position (editable) == end;
 }
 
-static void
-got_completion_data_callback (GFilenameCompleter    *completer,
-                              NautilusLocationEntry *entry)
-{
-    NautilusLocationEntryPrivate *priv;
-
-    priv = nautilus_location_entry_get_instance_private (entry);
-
-    if (priv->idle_id)
-    {
-        g_source_remove (priv->idle_id);
-        priv->idle_id = 0;
-    }
-    try_to_expand_path (entry);
-}
-
 static void
 finalize (GObject *object)
 {
@@ -509,7 +723,6 @@ finalize (GObject *object)
     entry = NAUTILUS_LOCATION_ENTRY (object);
     priv = nautilus_location_entry_get_instance_private (entry);
 
-    g_object_unref (priv->completer);
     g_free (priv->special_text);
 
     g_clear_object (&priv->last_location);
@@ -536,6 +749,8 @@ destroy (GtkWidget *object)
     g_free (priv->current_directory);
     priv->current_directory = NULL;
 
+    clear_completion (entry);
+
     GTK_WIDGET_CLASS (nautilus_location_entry_parent_class)->destroy (object);
 }
 
@@ -555,6 +770,9 @@ on_has_focus_changed (GObject    *object,
     entry = NAUTILUS_LOCATION_ENTRY (object);
     priv = nautilus_location_entry_get_instance_private (entry);
 
+    /* Folders may have come and gone since it was last used */
+    clear_completion (entry);
+
     if (priv->has_special_text)
     {
         priv->setting_special_text = TRUE;
@@ -867,9 +1085,6 @@ nautilus_location_entry_init (NautilusLocationEntry *entry)
 
     priv = nautilus_location_entry_get_instance_private (entry);
 
-    priv->completer = g_filename_completer_new ();
-    g_filename_completer_set_dirs_only (priv->completer, TRUE);
-
     gtk_entry_set_icon_from_icon_name (GTK_ENTRY (entry), GTK_ENTRY_ICON_PRIMARY, "folder-symbolic");
     gtk_entry_set_icon_activatable (GTK_ENTRY (entry), GTK_ENTRY_ICON_PRIMARY, FALSE);
     targetlist = gtk_target_list_new (drag_types, G_N_ELEMENTS (drag_types));
@@ -888,9 +1103,6 @@ nautilus_location_entry_init (NautilusLocationEntry *entry)
     g_signal_connect (entry, "icon-release",
                       G_CALLBACK (nautilus_location_entry_icon_release), NULL);
 
-    g_signal_connect (priv->completer, "got-completion-data",
-                      G_CALLBACK (got_completion_data_callback), entry);
-
     /* Drag source */
     g_signal_connect_object (entry, "drag-data-get",
                              G_CALLBACK (drag_data_get_callback), entry, 0);
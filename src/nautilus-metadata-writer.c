@@ -0,0 +1,292 @@
+/* nautilus-metadata-writer.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-metadata-writer.h"
+
+#include <gio/gio.h>
+
+#include "nautilus-executor.h"
+#include "nautilus-file-private.h"
+#include "nautilus-profile.h"
+
+typedef struct
+{
+    NautilusFile *file;
+    /* Only known once flushed, as the file may be renamed meanwhile */
+    GFile *location;
+    GFileInfo *attributes;
+    GFileInfo *new_info;
+} PendingWrite;
+
+/* NautilusFile -> PendingWrite, the keys set since the last flush */
+static GHashTable *pending_writes = NULL;
+static guint flush_timeout_id = 0;
+
+/* Flushes run one at a time, so an older value never lands after a newer
+ * one. This counts the directory jobs of the flush in progress. */
+static guint n_jobs_in_progress = 0;
+
+static void schedule_flush (void);
+
+static void
+pending_write_free (PendingWrite *write)
+{
+    nautilus_file_unref (write->file);
+    g_clear_object (&write->location);
+    g_object_unref (write->attributes);
+    g_clear_object (&write->new_info);
+
+    g_free (write);
+}
+
+static GFileInfo *
+get_pending_attributes (NautilusFile *file)
+{
+    PendingWrite *write;
+
+    if (pending_writes == NULL)
+    {
+        pending_writes = g_hash_table_new_full (NULL, NULL, NULL,
+                                                (GDestroyNotify) pending_write_free);
+    }
+
+    write = g_hash_table_lookup (pending_writes, file);
+    if (write == NULL)
+    {
+        write = g_new0 (PendingWrite, 1);
+        write->file = nautilus_file_ref (file);
+        write->attributes = g_file_info_new ();
+
+        g_hash_table_insert (pending_writes, file, write);
+    }
+
+    schedule_flush ();
+
+    return write->attributes;
+}
+
+void
+nautilus_metadata_writer_set_string (NautilusFile *file,
+                                     const char   *key,
+                                     const char   *value)
+{
+    GFileInfo *attributes;
+    g_autofree char *gio_key = NULL;
+
+    attributes = get_pending_attributes (file);
+    gio_key = g_strconcat ("metadata::", key, NULL);
+
+    if (value != NULL)
+    {
+        g_file_info_set_attribute_string (attributes, gio_key, value);
+    }
+    else
+    {
+        /* Unset the key */
+        g_file_info_set_attribute (attributes, gio_key,
+                                   G_FILE_ATTRIBUTE_TYPE_INVALID,
+                                   NULL);
+    }
+}
+
+void
+nautilus_metadata_writer_set_stringv (NautilusFile  *file,
+                                      const char    *key,
+                                      char         **value)
+{
+    GFileInfo *attributes;
+    g_autofree char *gio_key = NULL;
+
+    attributes = get_pending_attributes (file);
+    gio_key = g_strconcat ("metadata::", key, NULL);
+
+    g_file_info_set_attribute_stringv (attributes, gio_key, value);
+}
+
+static void
+write_attributes (PendingWrite *write,
+                  gboolean      query_info)
+{
+    g_autoptr (GError) error = NULL;
+
+    if (!g_file_set_attributes_from_info (write->location,
+                                          write->attributes,
+                                          0, NULL, &error))
+    {
+        return;
+    }
+
+    if (query_info)
+    {
+        write->new_info = g_file_query_info (write->location,
+                                             NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+                                             0, NULL, NULL);
+    }
+}
+
+static void
+write_directory_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+    GPtrArray *writes = task_data;
+
+    for (guint i = 0; i < writes->len; i++)
+    {
+        write_attributes (g_ptr_array_index (writes, i), TRUE);
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+write_directory_done (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+    GPtrArray *writes;
+
+    writes = g_task_get_task_data (G_TASK (result));
+
+    for (guint i = 0; i < writes->len; i++)
+    {
+        PendingWrite *write = g_ptr_array_index (writes, i);
+
+        if (write->new_info != NULL &&
+            nautilus_file_update_info (write->file, write->new_info))
+        {
+            nautilus_file_changed (write->file);
+        }
+    }
+
+    n_jobs_in_progress--;
+    if (n_jobs_in_progress == 0 && pending_writes != NULL &&
+        g_hash_table_size (pending_writes) > 0)
+    {
+        schedule_flush ();
+    }
+}
+
+/* Takes the pending writes, grouped by the directory of their files */
+static GHashTable *
+steal_pending_writes (void)
+{
+    GHashTable *by_directory;
+    GHashTableIter iter;
+    PendingWrite *write;
+
+    by_directory = g_hash_table_new_full (NULL, NULL, NULL,
+                                          (GDestroyNotify) g_ptr_array_unref);
+
+    g_hash_table_iter_init (&iter, pending_writes);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &write))
+    {
+        NautilusDirectory *directory;
+        GPtrArray *writes;
+
+        directory = nautilus_file_get_directory (write->file);
+        writes = g_hash_table_lookup (by_directory, directory);
+        if (writes == NULL)
+        {
+            writes = g_ptr_array_new_with_free_func ((GDestroyNotify) pending_write_free);
+            g_hash_table_insert (by_directory, directory, writes);
+        }
+
+        write->location = nautilus_file_get_location (write->file);
+        g_ptr_array_add (writes, write);
+        g_hash_table_iter_steal (&iter);
+    }
+
+    return by_directory;
+}
+
+static gboolean
+flush_timeout_cb (gpointer user_data)
+{
+    g_autoptr (GHashTable) by_directory = NULL;
+    GHashTableIter iter;
+    GPtrArray *writes;
+
+    flush_timeout_id = 0;
+
+    if (n_jobs_in_progress > 0)
+    {
+        /* Rescheduled when the flush in progress is done */
+        return G_SOURCE_REMOVE;
+    }
+
+    nautilus_profile_start ("%u files", g_hash_table_size (pending_writes));
+
+    by_directory = steal_pending_writes ();
+
+    g_hash_table_iter_init (&iter, by_directory);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &writes))
+    {
+        g_autoptr (GTask) task = NULL;
+
+        task = g_task_new (NULL, NULL, write_directory_done, NULL);
+        g_task_set_task_data (task, g_ptr_array_ref (writes),
+                              (GDestroyNotify) g_ptr_array_unref);
+        nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_METADATA, task, write_directory_thread);
+
+        n_jobs_in_progress++;
+    }
+
+    nautilus_profile_end ("%u directories", g_hash_table_size (by_directory));
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_flush (void)
+{
+    if (flush_timeout_id != 0 || n_jobs_in_progress > 0)
+    {
+        return;
+    }
+
+    flush_timeout_id = g_timeout_add (NAUTILUS_METADATA_FLUSH_INTERVAL_MSECS,
+                                      flush_timeout_cb, NULL);
+}
+
+void
+nautilus_metadata_writer_flush (void)
+{
+    GHashTableIter iter;
+    PendingWrite *write;
+
+    while (n_jobs_in_progress > 0)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    g_clear_handle_id (&flush_timeout_id, g_source_remove);
+
+    if (pending_writes == NULL)
+    {
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, pending_writes);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &write))
+    {
+        write->location = nautilus_file_get_location (write->file);
+        write_attributes (write, FALSE);
+        g_hash_table_iter_remove (&iter);
+    }
+}
@@ -0,0 +1,41 @@
+/* nautilus-metadata-writer.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "nautilus-types.h"
+
+/* The metadata writer buffers the metadata::* keys set on files and
+ * writes them once per flush interval: the keys of a file go out in a
+ * single attributes write, and the files of a directory in a single
+ * worker job. Main thread only.
+ */
+
+#define NAUTILUS_METADATA_FLUSH_INTERVAL_MSECS 250
+
+/* Queues @key, without the metadata:: prefix, to be set to @value on
+ * @file, or unset when @value is NULL. */
+void nautilus_metadata_writer_set_string  (NautilusFile *file,
+                                           const char   *key,
+                                           const char   *value);
+void nautilus_metadata_writer_set_stringv (NautilusFile *file,
+                                           const char   *key,
+                                           char        **value);
+
+/* Writes everything queued, and waits for the writes in progress. */
+void nautilus_metadata_writer_flush       (void);
@@ -376,6 +376,53 @@ nautilus_mime_actions_get_required_file_attributes (void)
     return NAUTILUS_FILE_ATTRIBUTE_INFO;
 }
 
+static void
+default_app_free (GAppInfo *app)
+{
+    if (app != NULL)
+    {
+        g_object_unref (app);
+    }
+}
+
+static void
+on_app_info_monitor_changed (GAppInfoMonitor *monitor,
+                             GHashTable      *default_apps)
+{
+    g_hash_table_remove_all (default_apps);
+}
+
+/* Like g_app_info_get_default_for_type(), with the results kept until the
+ * installed applications or their associations change */
+static GAppInfo *
+get_default_application_for_type (const char *mime_type,
+                                  gboolean    must_support_uris)
+{
+    static GHashTable *default_apps = NULL;
+    g_autofree char *key = NULL;
+    GAppInfo *app;
+
+    if (default_apps == NULL)
+    {
+        default_apps = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, (GDestroyNotify) default_app_free);
+
+        /* Kept for the whole session, along with the cache */
+        g_signal_connect (g_app_info_monitor_get (), "changed",
+                          G_CALLBACK (on_app_info_monitor_changed), default_apps);
+    }
+
+    key = g_strdup_printf ("%s %d", mime_type, must_support_uris);
+    if (!g_hash_table_lookup_extended (default_apps, key, NULL, (gpointer *) &app))
+    {
+        /* Also kept when there's none */
+        app = g_app_info_get_default_for_type (mime_type, must_support_uris);
+        g_hash_table_insert (default_apps, g_steal_pointer (&key), app);
+    }
+
+    return app != NULL ? g_object_ref (app) : NULL;
+}
+
 GAppInfo *
 nautilus_mime_get_default_application_for_file (NautilusFile *file)
 {
@@ -389,8 +436,8 @@ nautilus_mime_get_default_application_for_file (NautilusFile *file)
     }
 
     mime_type = nautilus_file_get_mime_type (file);
-    app = g_app_info_get_default_for_type (mime_type,
-                                           !nautilus_file_has_local_path (file));
+    app = get_default_application_for_type (mime_type,
+                                            !nautilus_file_has_local_path (file));
     g_free (mime_type);
 
     if (app == NULL)
@@ -406,61 +453,44 @@ nautilus_mime_get_default_application_for_file (NautilusFile *file)
     return app;
 }
 
-static int
-file_compare_by_mime_type (NautilusFile *file_a,
-                           NautilusFile *file_b)
-{
-    char *mime_type_a, *mime_type_b;
-    int ret;
-
-    mime_type_a = nautilus_file_get_mime_type (file_a);
-    mime_type_b = nautilus_file_get_mime_type (file_b);
-
-    ret = strcmp (mime_type_a, mime_type_b);
-
-    g_free (mime_type_a);
-    g_free (mime_type_b);
-
-    return ret;
-}
-
-static int
-file_compare_by_parent_uri (NautilusFile *file_a,
-                            NautilusFile *file_b)
+/* What the default application of a file depends on */
+static char *
+get_default_application_key (NautilusFile *file)
 {
-    char *parent_uri_a, *parent_uri_b;
-    int ret;
-
-    parent_uri_a = nautilus_file_get_parent_uri (file_a);
-    parent_uri_b = nautilus_file_get_parent_uri (file_b);
-
-    ret = strcmp (parent_uri_a, parent_uri_b);
+    g_autofree char *mime_type = NULL;
+    g_autofree char *uri_scheme = NULL;
 
-    g_free (parent_uri_a);
-    g_free (parent_uri_b);
+    mime_type = nautilus_file_get_mime_type (file);
+    uri_scheme = nautilus_file_get_uri_scheme (file);
 
-    return ret;
+    return g_strdup_printf ("%s %d %s", mime_type,
+                            nautilus_file_has_local_path (file),
+                            uri_scheme != NULL ? uri_scheme : "");
 }
 
 GAppInfo *
 nautilus_mime_get_default_application_for_files (GList *files)
 {
-    GList *l, *sorted_files;
+    g_autoptr (GHashTable) seen_keys = NULL;
+    GList *l;
     NautilusFile *file;
     GAppInfo *app, *one_app;
 
     g_assert (files != NULL);
 
-    sorted_files = g_list_sort (g_list_copy (files), (GCompareFunc) file_compare_by_mime_type);
+    /* The application is looked up once for each group of files that
+     * would get the same one */
+    seen_keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
     app = NULL;
-    for (l = sorted_files; l != NULL; l = l->next)
+    for (l = files; l != NULL; l = l->next)
     {
+        char *key;
+
         file = l->data;
 
-        if (l->prev &&
-            file_compare_by_mime_type (file, l->prev->data) == 0 &&
-            file_compare_by_parent_uri (file, l->prev->data) == 0)
+        key = get_default_application_key (file);
+        if (!g_hash_table_add (seen_keys, key))
         {
             continue;
         }
@@ -490,8 +520,6 @@ nautilus_mime_get_default_application_for_files (GList *files)
         }
     }
 
-    g_list_free (sorted_files);
-
     return app;
 }
 
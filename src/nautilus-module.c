@@ -23,8 +23,11 @@
 #include <config.h>
 #include "nautilus-module.h"
 
+#include "nautilus-profile.h"
+
 #include <eel/eel-debug.h>
 #include <gmodule.h>
+#include <string.h>
 
 #define NAUTILUS_TYPE_MODULE            (nautilus_module_get_type ())
 #define NAUTILUS_MODULE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), NAUTILUS_TYPE_MODULE, NautilusModule))
@@ -55,7 +58,21 @@ struct _NautilusModuleClass
     GTypeModuleClass parent;
 };
 
+/* An extension whose manifest lists the interfaces it implements, waiting
+ * for one of them to be asked for before its library is opened.
+ */
+typedef struct
+{
+    char *path;
+    char **interfaces;
+} LazyModule;
+
+#define MANIFEST_SUFFIX ".nautilus-extension"
+#define MANIFEST_GROUP "Nautilus Extension"
+#define MANIFEST_INTERFACES_KEY "Interfaces"
+
 static GList *module_objects = NULL;
+static GList *lazy_modules = NULL;
 
 static GType nautilus_module_get_type (void);
 
@@ -190,6 +207,9 @@ static NautilusModule *
 nautilus_module_load_file (const char *filename)
 {
     NautilusModule *module;
+    gint64 begin_time;
+
+    begin_time = g_get_monotonic_time ();
 
     module = g_object_new (NAUTILUS_TYPE_MODULE, NULL);
     module->path = g_strdup (filename);
@@ -198,13 +218,92 @@ nautilus_module_load_file (const char *filename)
     {
         add_module_objects (module);
         g_type_module_unuse (G_TYPE_MODULE (module));
-        return module;
     }
     else
     {
-        g_object_unref (module);
+        g_clear_object (&module);
+    }
+
+    nautilus_trace_span ("extension load", begin_time, "%s", filename);
+
+    return module;
+}
+
+static void
+lazy_module_free (LazyModule *lazy)
+{
+    g_free (lazy->path);
+    g_strfreev (lazy->interfaces);
+
+    g_free (lazy);
+}
+
+/* Looks for the manifest installed next to the library at @path, named
+ * after it with MANIFEST_SUFFIX in place of the module suffix. Returns
+ * NULL when there is none, or it has no interfaces, and the library must
+ * be loaded right away as before.
+ */
+static LazyModule *
+lazy_module_new (const char *path)
+{
+    g_autoptr (GKeyFile) manifest = NULL;
+    g_autofree char *basename = NULL;
+    g_autofree char *manifest_path = NULL;
+    g_auto (GStrv) interfaces = NULL;
+    LazyModule *lazy;
+
+    basename = g_strndup (path, strlen (path) - strlen ("." G_MODULE_SUFFIX));
+    manifest_path = g_strconcat (basename, MANIFEST_SUFFIX, NULL);
+
+    manifest = g_key_file_new ();
+    if (!g_key_file_load_from_file (manifest, manifest_path, G_KEY_FILE_NONE, NULL))
+    {
         return NULL;
     }
+
+    interfaces = g_key_file_get_string_list (manifest,
+                                             MANIFEST_GROUP,
+                                             MANIFEST_INTERFACES_KEY,
+                                             NULL, NULL);
+    if (interfaces == NULL || interfaces[0] == NULL)
+    {
+        return NULL;
+    }
+
+    lazy = g_new0 (LazyModule, 1);
+    lazy->path = g_strdup (path);
+    lazy->interfaces = g_steal_pointer (&interfaces);
+
+    return lazy;
+}
+
+/* Opens the lazy modules that declare @type, so that their objects are in
+ * module_objects before it is searched for @type.
+ */
+static void
+load_lazy_modules_for_type (GType type)
+{
+    const char *type_name;
+    GList *l, *next;
+
+    type_name = g_type_name (type);
+
+    for (l = lazy_modules; l != NULL; l = next)
+    {
+        LazyModule *lazy = l->data;
+
+        next = l->next;
+
+        if (!g_strv_contains ((const char * const *) lazy->interfaces, type_name))
+        {
+            continue;
+        }
+
+        lazy_modules = g_list_delete_link (lazy_modules, l);
+
+        nautilus_module_load_file (lazy->path);
+        lazy_module_free (lazy);
+    }
 }
 
 static void
@@ -223,11 +322,22 @@ load_module_dir (const char *dirname)
             if (g_str_has_suffix (name, "." G_MODULE_SUFFIX))
             {
                 char *filename;
+                LazyModule *lazy;
 
                 filename = g_build_filename (dirname,
                                              name,
                                              NULL);
-                nautilus_module_load_file (filename);
+
+                lazy = lazy_module_new (filename);
+                if (lazy != NULL)
+                {
+                    lazy_modules = g_list_prepend (lazy_modules, lazy);
+                }
+                else
+                {
+                    nautilus_module_load_file (filename);
+                }
+
                 g_free (filename);
             }
         }
@@ -248,6 +358,9 @@ free_module_objects (void)
     }
 
     g_list_free (module_objects);
+
+    g_list_free_full (lazy_modules, (GDestroyNotify) lazy_module_free);
+    lazy_modules = NULL;
 }
 
 void
@@ -271,6 +384,10 @@ nautilus_module_get_extensions_for_type (GType type)
     GList *l;
     GList *ret = NULL;
 
+    /* Not done at startup when running as a service */
+    nautilus_module_setup ();
+    load_lazy_modules_for_type (type);
+
     for (l = module_objects; l != NULL; l = l->next)
     {
         if (G_TYPE_CHECK_INSTANCE_TYPE (G_OBJECT (l->data),
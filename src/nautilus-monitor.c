@@ -25,18 +25,65 @@
 
 #include <config.h>
 #include "nautilus-monitor.h"
+#include "nautilus-directory-private.h"
 #include "nautilus-file-changes-queue.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-profile.h"
 
 #include <gio/gio.h>
 
-struct NautilusMonitor
+typedef enum
+{
+    MONITOR_ENTRY_WATCHING,     /* with an inotify watch, counted in the budget */
+    MONITOR_ENTRY_UNCOUNTED,    /* remote, or not monitorable */
+    MONITOR_ENTRY_EVICTED,      /* waiting for a watch to be free */
+} MonitorEntryState;
+
+/* The monitoring of a location, shared by all its NautilusMonitor */
+typedef struct
 {
+    GFile *location;
+    MonitorEntryState state;
     GFileMonitor *monitor;
     GVolumeMonitor *volume_monitor;
-    GFile *location;
+
+    guint n_clients;
+    /* Clients showing the directory, rather than watching some files of it */
+    guint n_foreground_clients;
+    gint64 last_used;
+
+    /* Events seen in the current second */
+    gint64 rate_window_start;
+    guint rate_window_events;
+
+    /* While storming, events are not processed one by one: the directory
+     * is rescanned instead, every STORM_RESCAN_INTERVAL_MS. */
+    guint storm_rescan_id;
+} MonitorEntry;
+
+struct NautilusMonitor
+{
+    MonitorEntry *entry;
+    gboolean background;
 };
 
+/* Directories are watched with inotify, and the watches are shared by all
+ * the applications of the user. Only take part of them, and past that,
+ * drop the watches of the directories that are not shown, and then of the
+ * ones least recently asked for. */
+#define DEFAULT_MAX_USER_WATCHES 8192
+#define WATCH_BUDGET_SHARE 2
+
+static GHashTable *monitor_entries;     /* of GFile to MonitorEntry */
+static guint n_watches;
+static guint n_evicted;
+
+/* Above this many events a second, a directory is storming, e.g. from a build
+ * or a download manager, and it is calm again under the lower rate */
+#define STORM_EVENTS_PER_SECOND 200
+#define CALM_EVENTS_PER_SECOND 20
+#define STORM_RESCAN_INTERVAL_MS 1000
+
 static gboolean call_consume_changes_idle_id = 0;
 
 static gboolean
@@ -62,7 +109,7 @@ mount_removed (GVolumeMonitor *volume_monitor,
                GMount         *mount,
                gpointer        user_data)
 {
-    NautilusMonitor *monitor = user_data;
+    MonitorEntry *monitor = user_data;
     GFile *mount_location;
 
     mount_location = g_mount_get_root (mount);
@@ -76,6 +123,71 @@ mount_removed (GVolumeMonitor *volume_monitor,
     g_object_unref (mount_location);
 }
 
+static void
+rescan_directory (MonitorEntry *monitor)
+{
+    g_autoptr (NautilusDirectory) directory = NULL;
+
+    directory = nautilus_directory_get_existing (monitor->location);
+    if (directory != NULL)
+    {
+        nautilus_directory_rescan_file_list (directory);
+    }
+}
+
+static gboolean
+storm_rescan_cb (gpointer user_data)
+{
+    MonitorEntry *monitor = user_data;
+    gboolean calm;
+
+    /* The events counted over the interval */
+    calm = monitor->rate_window_events < CALM_EVENTS_PER_SECOND * STORM_RESCAN_INTERVAL_MS / 1000;
+    monitor->rate_window_events = 0;
+    monitor->rate_window_start = g_get_monotonic_time ();
+
+    /* One last time once calm, for what came before */
+    rescan_directory (monitor);
+
+    if (calm)
+    {
+        monitor->storm_rescan_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* Counts the event, and returns whether the directory is storming */
+static gboolean
+count_event (MonitorEntry *monitor)
+{
+    gint64 now;
+
+    monitor->rate_window_events++;
+    if (monitor->storm_rescan_id != 0)
+    {
+        return TRUE;
+    }
+
+    now = g_get_monotonic_time ();
+    if (now - monitor->rate_window_start > G_USEC_PER_SEC)
+    {
+        monitor->rate_window_start = now;
+        monitor->rate_window_events = 1;
+    }
+    else if (monitor->rate_window_events > STORM_EVENTS_PER_SECOND)
+    {
+        monitor->rate_window_events = 0;
+        monitor->rate_window_start = now;
+        monitor->storm_rescan_id = g_timeout_add (STORM_RESCAN_INTERVAL_MS,
+                                                  storm_rescan_cb, monitor);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 static void
 dir_changed (GFileMonitor      *monitor,
              GFile             *child,
@@ -83,12 +195,13 @@ dir_changed (GFileMonitor      *monitor,
              GFileMonitorEvent  event_type,
              gpointer           user_data)
 {
-    char *to_uri;
+    MonitorEntry *entry = user_data;
 
-    to_uri = NULL;
-    if (other_file)
+    /* Events about the directory itself still go through */
+    if (count_event (entry) &&
+        !g_file_equal (child, entry->location))
     {
-        to_uri = g_file_get_uri (other_file);
+        return;
     }
 
     switch (event_type)
@@ -103,80 +216,355 @@ dir_changed (GFileMonitor      *monitor,
         case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
         case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
         {
-            nautilus_file_changes_queue_file_changed (child);
+            nautilus_file_changes_queue_monitor_file_changed (child);
         }
         break;
 
         case G_FILE_MONITOR_EVENT_UNMOUNTED:
         case G_FILE_MONITOR_EVENT_DELETED:
         {
-            nautilus_file_changes_queue_file_removed (child);
+            nautilus_file_changes_queue_monitor_file_removed (child);
         }
         break;
 
         case G_FILE_MONITOR_EVENT_CREATED:
         {
-            nautilus_file_changes_queue_file_added (child);
+            nautilus_file_changes_queue_monitor_file_added (child);
+        }
+        break;
+
+        /* Renames and moves are told as such, so that the files keep
+         * their thumbnails and metadata instead of being created anew.
+         * A move between two monitored directories reaches both, and the
+         * second one finds the file already moved. */
+        case G_FILE_MONITOR_EVENT_RENAMED:
+        {
+            nautilus_file_changes_queue_monitor_file_moved (child, other_file);
         }
         break;
-    }
 
-    g_free (to_uri);
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+        {
+            if (other_file != NULL)
+            {
+                nautilus_file_changes_queue_monitor_file_moved (other_file, child);
+            }
+            else
+            {
+                nautilus_file_changes_queue_monitor_file_added (child);
+            }
+        }
+        break;
+
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        {
+            if (other_file != NULL)
+            {
+                nautilus_file_changes_queue_monitor_file_moved (child, other_file);
+            }
+            else
+            {
+                nautilus_file_changes_queue_monitor_file_removed (child);
+            }
+        }
+        break;
+    }
 
     schedule_call_consume_changes ();
 }
 
+static guint
+get_watch_budget (void)
+{
+    static guint budget = 0;
+
+    if (budget == 0)
+    {
+        g_autofree gchar *contents = NULL;
+        guint64 max_user_watches = 0;
+
+        if (g_file_get_contents ("/proc/sys/fs/inotify/max_user_watches",
+                                 &contents, NULL, NULL))
+        {
+            max_user_watches = g_ascii_strtoull (contents, NULL, 10);
+        }
+        if (max_user_watches == 0)
+        {
+            max_user_watches = DEFAULT_MAX_USER_WATCHES;
+        }
+
+        budget = MAX (1, MIN (max_user_watches, G_MAXUINT) / WATCH_BUDGET_SHARE);
+    }
+
+    return budget;
+}
+
+static void
+profile_watches (void)
+{
+    nautilus_profile_msg ("monitors %u watches %u of %u evicted %u",
+                          g_hash_table_size (monitor_entries),
+                          n_watches, get_watch_budget (), n_evicted);
+}
+
+static void
+monitor_entry_arm (MonitorEntry *entry)
+{
+    if (entry->state == MONITOR_ENTRY_EVICTED)
+    {
+        n_evicted--;
+    }
+
+    entry->monitor = g_file_monitor_directory (entry->location,
+                                               G_FILE_MONITOR_WATCH_MOUNTS | G_FILE_MONITOR_WATCH_MOVES,
+                                               NULL, NULL);
+    if (entry->monitor != NULL)
+    {
+        g_signal_connect (entry->monitor, "changed",
+                          G_CALLBACK (dir_changed), entry);
+    }
+    else if (!g_file_is_native (entry->location) && entry->volume_monitor == NULL)
+    {
+        entry->volume_monitor = g_volume_monitor_get ();
+        g_signal_connect (entry->volume_monitor, "mount-removed",
+                          G_CALLBACK (mount_removed), entry);
+    }
+
+    if (entry->monitor != NULL && g_file_is_native (entry->location))
+    {
+        entry->state = MONITOR_ENTRY_WATCHING;
+        n_watches++;
+    }
+    else
+    {
+        /* We keep the entry even on failure, so we can avoid later trying again */
+        entry->state = MONITOR_ENTRY_UNCOUNTED;
+    }
+}
+
+static void
+monitor_entry_disarm (MonitorEntry *entry)
+{
+    if (entry->monitor != NULL)
+    {
+        g_signal_handlers_disconnect_by_func (entry->monitor, dir_changed, entry);
+        g_file_monitor_cancel (entry->monitor);
+        g_clear_object (&entry->monitor);
+    }
+
+    if (entry->state == MONITOR_ENTRY_WATCHING)
+    {
+        n_watches--;
+    }
+
+    g_clear_handle_id (&entry->storm_rescan_id, g_source_remove);
+}
+
+static void
+monitor_entry_evict (MonitorEntry *entry)
+{
+    monitor_entry_disarm (entry);
+    entry->state = MONITOR_ENTRY_EVICTED;
+    n_evicted++;
+}
+
+/* Whether @a should keep its watch rather than @b */
+static gboolean
+monitor_entry_is_preferred (MonitorEntry *a,
+                            MonitorEntry *b)
+{
+    if ((a->n_foreground_clients > 0) != (b->n_foreground_clients > 0))
+    {
+        return a->n_foreground_clients > 0;
+    }
+
+    return a->last_used > b->last_used;
+}
+
+/* Finds the watching entry to evict, or the evicted entry to watch again */
+static MonitorEntry *
+find_monitor_entry (MonitorEntryState state)
+{
+    GHashTableIter iter;
+    MonitorEntry *entry;
+    MonitorEntry *found = NULL;
+
+    g_hash_table_iter_init (&iter, monitor_entries);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+        if (entry->state != state)
+        {
+            continue;
+        }
+
+        if (found == NULL ||
+            (state == MONITOR_ENTRY_WATCHING ?
+             monitor_entry_is_preferred (found, entry) :
+             monitor_entry_is_preferred (entry, found)))
+        {
+            found = entry;
+        }
+    }
+
+    return found;
+}
+
+/* Evicts the watches that @entry is preferred to, until there is room
+ * for it, and returns whether there is. */
+static gboolean
+make_room_for (MonitorEntry *entry)
+{
+    while (n_watches >= get_watch_budget ())
+    {
+        MonitorEntry *victim;
+
+        victim = find_monitor_entry (MONITOR_ENTRY_WATCHING);
+        if (victim == NULL || !monitor_entry_is_preferred (entry, victim))
+        {
+            return FALSE;
+        }
+
+        monitor_entry_evict (victim);
+    }
+
+    return TRUE;
+}
+
+static void
+monitor_entry_request (MonitorEntry *entry)
+{
+    if (!g_file_is_native (entry->location) || make_room_for (entry))
+    {
+        monitor_entry_arm (entry);
+    }
+    else if (entry->state != MONITOR_ENTRY_EVICTED)
+    {
+        entry->state = MONITOR_ENTRY_EVICTED;
+        n_evicted++;
+    }
+}
+
+/* Gives the watches that got free to the evicted entries, which missed
+ * changes meanwhile, so have their directories rescanned. */
+static void
+rearm_evicted (void)
+{
+    while (n_evicted > 0 && n_watches < get_watch_budget ())
+    {
+        MonitorEntry *entry;
+
+        entry = find_monitor_entry (MONITOR_ENTRY_EVICTED);
+        monitor_entry_arm (entry);
+        rescan_directory (entry);
+    }
+}
+
 NautilusMonitor *
-nautilus_monitor_directory (GFile *location)
+nautilus_monitor_directory (GFile    *location,
+                            gboolean  background)
 {
-    GFileMonitor *dir_monitor;
     NautilusMonitor *ret;
+    MonitorEntry *entry;
 
-    ret = g_slice_new0 (NautilusMonitor);
-    dir_monitor = g_file_monitor_directory (location, G_FILE_MONITOR_WATCH_MOUNTS, NULL, NULL);
-
-    if (dir_monitor != NULL)
+    if (monitor_entries == NULL)
     {
-        ret->monitor = dir_monitor;
+        monitor_entries = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
     }
-    else if (!g_file_is_native (location))
+
+    entry = g_hash_table_lookup (monitor_entries, location);
+    if (entry == NULL)
     {
-        ret->location = g_object_ref (location);
-        ret->volume_monitor = g_volume_monitor_get ();
+        entry = g_slice_new0 (MonitorEntry);
+        entry->location = g_object_ref (location);
+        entry->state = MONITOR_ENTRY_EVICTED;
+        n_evicted++;
+        g_hash_table_insert (monitor_entries, entry->location, entry);
     }
 
-    if (ret->monitor != NULL)
+    entry->n_clients++;
+    if (!background)
     {
-        g_signal_connect (ret->monitor, "changed",
-                          G_CALLBACK (dir_changed), ret);
+        entry->n_foreground_clients++;
     }
+    entry->last_used = g_get_monotonic_time ();
 
-    if (ret->volume_monitor != NULL)
+    if (entry->state == MONITOR_ENTRY_EVICTED)
     {
-        g_signal_connect (ret->volume_monitor, "mount-removed",
-                          G_CALLBACK (mount_removed), ret);
+        monitor_entry_request (entry);
     }
 
+    ret = g_slice_new0 (NautilusMonitor);
+    ret->entry = entry;
+    ret->background = background;
+
+    profile_watches ();
+
     /* We return a monitor even on failure, so we can avoid later trying again */
     return ret;
 }
 
 void
-nautilus_monitor_cancel (NautilusMonitor *monitor)
+nautilus_monitor_set_background (NautilusMonitor *monitor,
+                                 gboolean         background)
 {
-    if (monitor->monitor != NULL)
+    MonitorEntry *entry = monitor->entry;
+
+    if (monitor->background == background)
     {
-        g_signal_handlers_disconnect_by_func (monitor->monitor, dir_changed, monitor);
-        g_file_monitor_cancel (monitor->monitor);
-        g_object_unref (monitor->monitor);
+        return;
     }
 
-    if (monitor->volume_monitor != NULL)
+    monitor->background = background;
+    if (background)
     {
-        g_signal_handlers_disconnect_by_func (monitor->volume_monitor, mount_removed, monitor);
-        g_object_unref (monitor->volume_monitor);
+        entry->n_foreground_clients--;
+        return;
     }
 
-    g_clear_object (&monitor->location);
+    entry->n_foreground_clients++;
+    entry->last_used = g_get_monotonic_time ();
+    if (entry->state == MONITOR_ENTRY_EVICTED && make_room_for (entry))
+    {
+        monitor_entry_arm (entry);
+        rescan_directory (entry);
+    }
+
+    profile_watches ();
+}
+
+void
+nautilus_monitor_cancel (NautilusMonitor *monitor)
+{
+    MonitorEntry *entry = monitor->entry;
+
+    if (!monitor->background)
+    {
+        entry->n_foreground_clients--;
+    }
     g_slice_free (NautilusMonitor, monitor);
+
+    entry->n_clients--;
+    if (entry->n_clients > 0)
+    {
+        return;
+    }
+
+    monitor_entry_disarm (entry);
+    if (entry->state == MONITOR_ENTRY_EVICTED)
+    {
+        n_evicted--;
+    }
+
+    if (entry->volume_monitor != NULL)
+    {
+        g_signal_handlers_disconnect_by_func (entry->volume_monitor, mount_removed, entry);
+        g_object_unref (entry->volume_monitor);
+    }
+
+    g_hash_table_remove (monitor_entries, entry->location);
+    g_object_unref (entry->location);
+    g_slice_free (MonitorEntry, entry);
+
+    rearm_evicted ();
+    profile_watches ();
 }
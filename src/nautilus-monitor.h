@@ -29,5 +29,11 @@
 
 typedef struct NautilusMonitor NautilusMonitor;
 
-NautilusMonitor *nautilus_monitor_directory (GFile *location);
-void             nautilus_monitor_cancel    (NautilusMonitor *monitor);
\ No newline at end of file
+/* Monitors of the same location share their watch. Background ones, only
+ * watching some files of the directory, are the first to lose their watch
+ * when the inotify watches run short. */
+NautilusMonitor *nautilus_monitor_directory      (GFile           *location,
+                                                  gboolean         background);
+void             nautilus_monitor_set_background (NautilusMonitor *monitor,
+                                                  gboolean         background);
+void             nautilus_monitor_cancel         (NautilusMonitor *monitor);
\ No newline at end of file
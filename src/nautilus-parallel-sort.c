@@ -0,0 +1,243 @@
+/* nautilus-parallel-sort.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-parallel-sort.h"
+
+#include <string.h>
+
+/* Below this many items per thread, threads cost more than they save. */
+#define MIN_ITEMS_PER_THREAD 4096
+#define MAX_THREADS 16
+
+typedef struct
+{
+    GCompareDataFunc compare;
+    gpointer user_data;
+
+    gpointer *items;
+    gpointer *scratch;
+
+    /* Boundaries of the sorted runs, n_runs + 1 of them */
+    gsize *bounds;
+    guint n_runs;
+} SortJob;
+
+typedef struct
+{
+    SortJob *job;
+    guint run;
+} SortTask;
+
+static gint
+compare_item_pointers (gconstpointer a,
+                       gconstpointer b,
+                       gpointer      user_data)
+{
+    SortJob *job = user_data;
+
+    return job->compare (*(gpointer *) a, *(gpointer *) b, job->user_data);
+}
+
+static gpointer
+sort_run_thread (gpointer data)
+{
+    SortTask *task = data;
+    SortJob *job = task->job;
+    gsize start, end;
+
+    start = job->bounds[task->run];
+    end = job->bounds[task->run + 1];
+
+    /* g_qsort_with_data() is a stable merge sort. */
+    g_qsort_with_data (job->items + start, end - start, sizeof (gpointer),
+                       compare_item_pointers, job);
+
+    return NULL;
+}
+
+/* Merges runs task->run and task->run + 1 into the scratch array. */
+static gpointer
+merge_runs_thread (gpointer data)
+{
+    SortTask *task = data;
+    SortJob *job = task->job;
+    gsize left, left_end, right, right_end, out;
+
+    left = job->bounds[task->run];
+    left_end = right = job->bounds[task->run + 1];
+    right_end = job->bounds[task->run + 2];
+    out = left;
+
+    while (left < left_end && right < right_end)
+    {
+        /* Take from the left on ties, to keep the sort stable. */
+        if (job->compare (job->items[left], job->items[right], job->user_data) <= 0)
+        {
+            job->scratch[out++] = job->items[left++];
+        }
+        else
+        {
+            job->scratch[out++] = job->items[right++];
+        }
+    }
+
+    memcpy (job->scratch + out, job->items + left, (left_end - left) * sizeof (gpointer));
+    out += left_end - left;
+    memcpy (job->scratch + out, job->items + right, (right_end - right) * sizeof (gpointer));
+
+    return NULL;
+}
+
+static void
+run_tasks (SortJob      *job,
+           guint         n_tasks,
+           guint         run_step,
+           GThreadFunc   func)
+{
+    g_autofree SortTask *tasks = NULL;
+    g_autofree GThread **threads = NULL;
+    guint i;
+
+    tasks = g_new (SortTask, n_tasks);
+    threads = g_new (GThread *, n_tasks);
+
+    for (i = 0; i < n_tasks; i++)
+    {
+        tasks[i].job = job;
+        tasks[i].run = i * run_step;
+    }
+
+    /* The calling thread takes the first task itself. */
+    for (i = 1; i < n_tasks; i++)
+    {
+        threads[i] = g_thread_new ("nautilus-sort", func, &tasks[i]);
+    }
+    func (&tasks[0]);
+    for (i = 1; i < n_tasks; i++)
+    {
+        g_thread_join (threads[i]);
+    }
+}
+
+void
+nautilus_parallel_sort (gpointer         *items,
+                        gsize             n_items,
+                        GCompareDataFunc  compare,
+                        gpointer          user_data)
+{
+    SortJob job;
+    g_autofree gpointer *scratch = NULL;
+    g_autofree gsize *bounds = NULL;
+    gpointer *swap;
+    guint n_threads;
+    guint n_pairs;
+    guint i;
+
+    n_threads = MIN (g_get_num_processors (), MAX_THREADS);
+    n_threads = MIN (n_threads, n_items / MIN_ITEMS_PER_THREAD);
+
+    job.compare = compare;
+    job.user_data = user_data;
+    job.items = items;
+
+    if (n_threads <= 1)
+    {
+        g_qsort_with_data (items, n_items, sizeof (gpointer),
+                           compare_item_pointers, &job);
+        return;
+    }
+
+    scratch = g_new (gpointer, n_items);
+    bounds = g_new (gsize, n_threads + 1);
+    for (i = 0; i <= n_threads; i++)
+    {
+        bounds[i] = n_items * i / n_threads;
+    }
+
+    job.scratch = scratch;
+    job.bounds = bounds;
+    job.n_runs = n_threads;
+
+    run_tasks (&job, job.n_runs, 1, sort_run_thread);
+
+    while (job.n_runs > 1)
+    {
+        n_pairs = job.n_runs / 2;
+
+        run_tasks (&job, n_pairs, 2, merge_runs_thread);
+
+        /* An odd run out is carried over as is. */
+        if (job.n_runs % 2 != 0)
+        {
+            memcpy (job.scratch + job.bounds[job.n_runs - 1],
+                    job.items + job.bounds[job.n_runs - 1],
+                    (job.bounds[job.n_runs] - job.bounds[job.n_runs - 1]) * sizeof (gpointer));
+        }
+
+        /* The merged runs now span every other bound. */
+        for (i = 0; i <= job.n_runs / 2; i++)
+        {
+            job.bounds[i] = job.bounds[MIN (2 * i, job.n_runs)];
+        }
+        if (job.n_runs % 2 != 0)
+        {
+            job.bounds[n_pairs + 1] = job.bounds[job.n_runs];
+        }
+        job.n_runs = (job.n_runs + 1) / 2;
+
+        swap = job.items;
+        job.items = job.scratch;
+        job.scratch = swap;
+    }
+
+    if (job.items != items)
+    {
+        memcpy (items, job.items, n_items * sizeof (gpointer));
+    }
+}
+
+GList *
+nautilus_parallel_sort_list (GList            *list,
+                             GCompareDataFunc  compare,
+                             gpointer          user_data)
+{
+    g_autofree gpointer *items = NULL;
+    GList *l;
+    gsize n_items;
+    gsize i;
+
+    n_items = g_list_length (list);
+    if (n_items < 2)
+    {
+        return list;
+    }
+
+    items = g_new (gpointer, n_items);
+    for (l = list, i = 0; l != NULL; l = l->next, i++)
+    {
+        items[i] = l->data;
+    }
+
+    nautilus_parallel_sort (items, n_items, compare, user_data);
+
+    for (l = list, i = 0; l != NULL; l = l->next, i++)
+    {
+        l->data = items[i];
+    }
+
+    return list;
+}
@@ -0,0 +1,39 @@
+/* nautilus-parallel-sort.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* Stable merge sorts spread over the available cores, for the big lists
+ * of files of search results and the like.
+ *
+ * Runs of items are sorted, then merged, in different threads, but an
+ * item is only ever handled by one thread at a time. So @compare may
+ * lazily compute and cache keys on the items it is given (as the file
+ * sort keys are), but must not touch anything else that isn't thread
+ * safe. The calling thread is blocked until the sort is done.
+ */
+
+void   nautilus_parallel_sort      (gpointer         *items,
+                                    gsize             n_items,
+                                    GCompareDataFunc  compare,
+                                    gpointer          user_data);
+
+/* Sorts the data of the list, keeping its links. */
+GList *nautilus_parallel_sort_list (GList            *list,
+                                    GCompareDataFunc  compare,
+                                    gpointer          user_data);
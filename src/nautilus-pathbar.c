@@ -68,6 +68,8 @@ typedef struct
     GFile *path;
     NautilusFile *file;
     unsigned int file_changed_signal_id;
+    /* Of the GMount, for MOUNT_BUTTONs, looked up once */
+    GIcon *mount_icon;
 
     GtkWidget *image;
     GtkWidget *label;
@@ -742,6 +744,7 @@ button_data_free (ButtonData *button_data)
 {
     g_object_unref (button_data->path);
     g_free (button_data->dir_name);
+    g_clear_object (&button_data->mount_icon);
     if (button_data->file != NULL)
     {
         g_signal_handler_disconnect (button_data->file,
@@ -1200,19 +1203,7 @@ on_multi_press_gesture_pressed (GtkGestureMultiPress *gesture,
 static GIcon *
 get_gicon_for_mount (ButtonData *button_data)
 {
-    GIcon *icon;
-    GMount *mount;
-
-    icon = NULL;
-    mount = nautilus_get_mounted_mount_for_root (button_data->path);
-
-    if (mount != NULL)
-    {
-        icon = g_mount_get_symbolic_icon (mount);
-        g_object_unref (mount);
-    }
-
-    return icon;
+    return button_data->mount_icon != NULL ? g_object_ref (button_data->mount_icon) : NULL;
 }
 
 static GIcon *
@@ -1338,6 +1329,7 @@ setup_button_type (ButtonData      *button_data,
     else if ((mount = nautilus_get_mounted_mount_for_root (location)) != NULL)
     {
         button_data->dir_name = g_mount_get_name (mount);
+        button_data->mount_icon = g_mount_get_symbolic_icon (mount);
         button_data->type = MOUNT_BUTTON;
         button_data->is_root = TRUE;
     }
@@ -1498,6 +1490,27 @@ button_data_file_changed (NautilusFile *file,
     nautilus_path_bar_update_button_appearance (button_data, current_dir);
 }
 
+/* Whether the button is the one of the current location, with the menu */
+static void
+set_button_is_current (NautilusPathBar *self,
+                       ButtonData      *button_data,
+                       gboolean         current_dir)
+{
+    if (current_dir)
+    {
+        gtk_widget_show (button_data->disclosure_arrow);
+        gtk_popover_set_relative_to (self->current_view_menu_popover, button_data->button);
+        gtk_style_context_add_class (gtk_widget_get_style_context (button_data->button),
+                                     "image-button");
+    }
+    else
+    {
+        gtk_widget_hide (button_data->disclosure_arrow);
+    }
+
+    nautilus_path_bar_update_button_state (button_data, current_dir);
+}
+
 static ButtonData *
 make_button_data (NautilusPathBar *self,
                   NautilusFile    *file,
@@ -1564,13 +1577,6 @@ make_button_data (NautilusPathBar *self,
     }
 
     gtk_widget_set_no_show_all (button_data->disclosure_arrow, TRUE);
-    if (current_dir)
-    {
-        gtk_widget_show (button_data->disclosure_arrow);
-        gtk_popover_set_relative_to (self->current_view_menu_popover, button_data->button);
-        gtk_style_context_add_class (gtk_widget_get_style_context (button_data->button),
-                                     "image-button");
-    }
 
     if (button_data->label != NULL)
     {
@@ -1599,7 +1605,7 @@ make_button_data (NautilusPathBar *self,
 
     gtk_widget_show_all (button_data->button);
 
-    nautilus_path_bar_update_button_state (button_data, current_dir);
+    set_button_is_current (self, button_data, current_dir);
 
     button_data->path_bar = self;
 
@@ -1622,13 +1628,28 @@ make_button_data (NautilusPathBar *self,
     return button_data;
 }
 
+static GList *
+find_button_for_file (NautilusPathBar *self,
+                      NautilusFile    *file)
+{
+    for (GList *l = self->button_list; l != NULL; l = l->next)
+    {
+        if (BUTTON_DATA (l->data)->file == file)
+        {
+            return l;
+        }
+    }
+
+    return NULL;
+}
+
 static void
 nautilus_path_bar_update_path (NautilusPathBar *self,
                                GFile           *file_path)
 {
     NautilusFile *file;
     gboolean first_directory;
-    GList *new_buttons, *l;
+    GList *new_buttons, *kept, *l;
     ButtonData *button_data;
 
     g_return_if_fail (NAUTILUS_IS_PATH_BAR (self));
@@ -1636,6 +1657,7 @@ nautilus_path_bar_update_path (NautilusPathBar *self,
 
     first_directory = TRUE;
     new_buttons = NULL;
+    kept = NULL;
 
     file = nautilus_file_get (file_path);
 
@@ -1643,6 +1665,15 @@ nautilus_path_bar_update_path (NautilusPathBar *self,
     {
         NautilusFile *parent_file;
 
+        /* The buttons from one already there up are the same, so they
+         * are kept, with their icons and monitors. */
+        kept = find_button_for_file (self, file);
+        if (kept != NULL)
+        {
+            nautilus_file_unref (file);
+            break;
+        }
+
         parent_file = nautilus_file_get_parent (file);
         button_data = make_button_data (self, file, first_directory);
         nautilus_file_unref (file);
@@ -1664,15 +1695,26 @@ nautilus_path_bar_update_path (NautilusPathBar *self,
         file = parent_file;
     }
 
-    nautilus_path_bar_clear_buttons (self);
-    self->button_list = g_list_reverse (new_buttons);
+    /* Remove the buttons below the ones kept, if any */
+    while (self->button_list != kept)
+    {
+        gtk_container_remove (GTK_CONTAINER (self),
+                              BUTTON_DATA (self->button_list->data)->button);
+    }
+
+    if (kept != NULL)
+    {
+        set_button_is_current (self, kept->data, new_buttons == NULL);
+    }
 
-    for (l = self->button_list; l; l = l->next)
+    for (l = new_buttons; l; l = l->next)
     {
         GtkWidget *button;
         button = BUTTON_DATA (l->data)->button;
         gtk_container_add (GTK_CONTAINER (self), button);
     }
+
+    self->button_list = g_list_concat (g_list_reverse (new_buttons), self->button_list);
 }
 
 void
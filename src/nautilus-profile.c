@@ -67,3 +67,299 @@ _nautilus_profile_log (const char *func,
     g_access (str, F_OK);
     g_free (str);
 }
+
+#define TRACE_RING_SIZE 8192
+
+typedef struct
+{
+    const char *name;
+    gint64 begin_time;
+    gint64 end_time;
+    gpointer thread;
+    char *detail;
+} TraceEvent;
+
+static char *trace_filename = NULL;
+static TraceEvent *trace_ring = NULL;
+static guint trace_head = 0;
+static guint trace_length = 0;
+static GMutex trace_mutex;
+
+gboolean
+nautilus_trace_is_enabled (void)
+{
+    static gsize initialized = 0;
+
+    if (g_once_init_enter (&initialized))
+    {
+        const char *filename;
+
+        filename = g_getenv ("NAUTILUS_TRACE");
+        if (filename != NULL && filename[0] != '\0')
+        {
+            trace_filename = g_strdup (filename);
+            trace_ring = g_new0 (TraceEvent, TRACE_RING_SIZE);
+        }
+
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return trace_ring != NULL;
+}
+
+static void
+trace_add (const char *name,
+           gint64      begin_time,
+           gint64      end_time,
+           const char *format,
+           va_list     args)
+{
+    TraceEvent *event;
+    char *detail;
+
+    detail = format != NULL ? g_strdup_vprintf (format, args) : NULL;
+
+    g_mutex_lock (&trace_mutex);
+
+    event = &trace_ring[(trace_head + trace_length) % TRACE_RING_SIZE];
+    if (trace_length < TRACE_RING_SIZE)
+    {
+        trace_length++;
+    }
+    else
+    {
+        /* Full, the oldest event makes room */
+        g_free (event->detail);
+        trace_head = (trace_head + 1) % TRACE_RING_SIZE;
+    }
+
+    event->name = name;
+    event->begin_time = begin_time;
+    event->end_time = end_time;
+    event->thread = g_thread_self ();
+    event->detail = detail;
+
+    g_mutex_unlock (&trace_mutex);
+}
+
+void
+nautilus_trace_span (const char *name,
+                     gint64      begin_time,
+                     const char *format,
+                     ...)
+{
+    va_list args;
+
+    if (!nautilus_trace_is_enabled ())
+    {
+        return;
+    }
+
+    va_start (args, format);
+    trace_add (name, begin_time, g_get_monotonic_time (), format, args);
+    va_end (args);
+}
+
+void
+nautilus_trace_mark (const char *name,
+                     const char *format,
+                     ...)
+{
+    va_list args;
+    gint64 now;
+
+    if (!nautilus_trace_is_enabled ())
+    {
+        return;
+    }
+
+    now = g_get_monotonic_time ();
+
+    va_start (args, format);
+    trace_add (name, now, now, format, args);
+    va_end (args);
+}
+
+void
+nautilus_trace_slow_span (const char *name,
+                          gint64      begin_time,
+                          const char *format,
+                          ...)
+{
+    va_list args;
+    gint64 now;
+
+    if (!nautilus_trace_is_enabled ())
+    {
+        return;
+    }
+
+    now = g_get_monotonic_time ();
+    if (now - begin_time <= NAUTILUS_TRACE_STALL_USECS)
+    {
+        return;
+    }
+
+    va_start (args, format);
+    trace_add (name, begin_time, now, format, args);
+    va_end (args);
+}
+
+/* A source that is never dispatched, but prepared first and checked
+ * first in every main loop iteration: what runs between its check,
+ * after the poll, and its next prepare is the dispatch of the others. */
+typedef struct
+{
+    GSource source;
+    gint64 check_time;
+} StallWatch;
+
+static gboolean
+stall_watch_prepare (GSource *source,
+                     gint    *timeout)
+{
+    StallWatch *watch = (StallWatch *) source;
+    gint64 now;
+
+    *timeout = -1;
+
+    if (watch->check_time != 0)
+    {
+        now = g_get_monotonic_time ();
+        if (now - watch->check_time > NAUTILUS_TRACE_STALL_USECS)
+        {
+            nautilus_trace_span ("main loop stall", watch->check_time, NULL);
+        }
+        watch->check_time = 0;
+    }
+
+    return FALSE;
+}
+
+static gboolean
+stall_watch_check (GSource *source)
+{
+    StallWatch *watch = (StallWatch *) source;
+
+    watch->check_time = g_get_monotonic_time ();
+
+    return FALSE;
+}
+
+static gboolean
+stall_watch_dispatch (GSource     *source,
+                      GSourceFunc  callback,
+                      gpointer     user_data)
+{
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs stall_watch_funcs =
+{
+    .prepare = stall_watch_prepare,
+    .check = stall_watch_check,
+    .dispatch = stall_watch_dispatch,
+};
+
+void
+nautilus_trace_watch_main_loop (void)
+{
+    static GSource *stall_watch = NULL;
+
+    if (!nautilus_trace_is_enabled () || stall_watch != NULL)
+    {
+        return;
+    }
+
+    stall_watch = g_source_new (&stall_watch_funcs, sizeof (StallWatch));
+    g_source_set_name (stall_watch, "[nautilus] main loop stall watch");
+    g_source_set_priority (stall_watch, G_MININT);
+    g_source_attach (stall_watch, NULL);
+}
+
+static void
+append_json_string (GString    *json,
+                    const char *string)
+{
+    g_string_append_c (json, '"');
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            g_string_append_printf (json, "\\%c", *c);
+        }
+        else if ((guchar) *c < 0x20)
+        {
+            g_string_append_printf (json, "\\u%04x", (guchar) *c);
+        }
+        else
+        {
+            g_string_append_c (json, *c);
+        }
+    }
+    g_string_append_c (json, '"');
+}
+
+void
+nautilus_trace_write (void)
+{
+    g_autoptr (GString) json = NULL;
+    g_autoptr (GHashTable) thread_ids = NULL;
+    g_autoptr (GError) error = NULL;
+
+    if (!nautilus_trace_is_enabled ())
+    {
+        return;
+    }
+
+    json = g_string_new ("[\n");
+    thread_ids = g_hash_table_new (NULL, NULL);
+
+    g_mutex_lock (&trace_mutex);
+
+    for (guint i = 0; i < trace_length; i++)
+    {
+        TraceEvent *event = &trace_ring[(trace_head + i) % TRACE_RING_SIZE];
+        guint tid;
+
+        tid = GPOINTER_TO_UINT (g_hash_table_lookup (thread_ids, event->thread));
+        if (tid == 0)
+        {
+            tid = g_hash_table_size (thread_ids) + 1;
+            g_hash_table_insert (thread_ids, event->thread, GUINT_TO_POINTER (tid));
+        }
+
+        g_string_append (json, i == 0 ? "  {\"name\": " : ",\n  {\"name\": ");
+        append_json_string (json, event->name);
+        g_string_append_printf (json,
+                                ", \"ph\": \"%s\", \"pid\": %d, \"tid\": %u"
+                                ", \"ts\": %" G_GINT64_FORMAT,
+                                event->end_time > event->begin_time ? "X" : "i",
+                                (int) getpid (), tid, event->begin_time);
+        if (event->end_time > event->begin_time)
+        {
+            g_string_append_printf (json, ", \"dur\": %" G_GINT64_FORMAT,
+                                    event->end_time - event->begin_time);
+        }
+        else
+        {
+            g_string_append (json, ", \"s\": \"p\"");
+        }
+        if (event->detail != NULL)
+        {
+            g_string_append (json, ", \"args\": {\"detail\": ");
+            append_json_string (json, event->detail);
+            g_string_append_c (json, '}');
+        }
+        g_string_append_c (json, '}');
+    }
+
+    g_mutex_unlock (&trace_mutex);
+
+    g_string_append (json, "\n]\n");
+
+    if (!g_file_set_contents (trace_filename, json->str, json->len, &error))
+    {
+        g_warning ("Could not write the trace to %s: %s", trace_filename, error->message);
+    }
+}
@@ -50,4 +50,36 @@ void            _nautilus_profile_log    (const char *func,
                                           const char *format,
                                           ...) G_GNUC_PRINTF (3, 4);
 
+/* Trace spans are kept in all builds, and recorded when NAUTILUS_TRACE is
+ * set to the name of a file. The last spans are kept in a ring buffer and
+ * written there at exit, as Chrome trace events that Perfetto and
+ * chrome://tracing can open. @name must be a static string; times
+ * are g_get_monotonic_time() ones. Thread safe.
+ */
+gboolean        nautilus_trace_is_enabled (void);
+void            nautilus_trace_span       (const char *name,
+                                           gint64      begin_time,
+                                           const char *format,
+                                           ...) G_GNUC_PRINTF (3, 4);
+void            nautilus_trace_mark       (const char *name,
+                                           const char *format,
+                                           ...) G_GNUC_PRINTF (2, 3);
+void            nautilus_trace_write      (void);
+
+/* Main loop dispatches longer than this, a frame at 60 Hz, are recorded
+ * as stalls, and so are the slow spans below. */
+#define NAUTILUS_TRACE_STALL_USECS (16 * G_TIME_SPAN_MILLISECOND)
+
+/* Records a span only if it took longer than NAUTILUS_TRACE_STALL_USECS,
+ * for work done often on the main thread. */
+void            nautilus_trace_slow_span  (const char *name,
+                                           gint64      begin_time,
+                                           const char *format,
+                                           ...) G_GNUC_PRINTF (3, 4);
+
+/* Records the main loop iterations that dispatched for longer than
+ * NAUTILUS_TRACE_STALL_USECS, as "main loop stall" spans. The spans of
+ * the same time tell what ran. */
+void            nautilus_trace_watch_main_loop (void);
+
 G_END_DECLS
\ No newline at end of file
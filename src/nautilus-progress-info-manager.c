@@ -24,18 +24,26 @@
 
 #include "nautilus-progress-info-manager.h"
 
+/* How often the infos are looked at for ::progress-changed */
+#define PROGRESS_SAMPLE_INTERVAL_MSEC 200
+
 struct _NautilusProgressInfoManager
 {
     GObject parent_instance;
 
     GList *progress_infos;
     GList *current_viewers;
+
+    guint sample_timeout_id;
+    /* Whether any info changed since the last sample */
+    gboolean infos_changed;
 };
 
 enum
 {
     NEW_PROGRESS_INFO,
     HAS_VIEWERS_CHANGED,
+    PROGRESS_CHANGED,
     LAST_SIGNAL
 };
 
@@ -55,6 +63,12 @@ nautilus_progress_info_manager_finalize (GObject *obj)
     GList *l;
     NautilusProgressInfoManager *self = NAUTILUS_PROGRESS_INFO_MANAGER (obj);
 
+    g_clear_handle_id (&self->sample_timeout_id, g_source_remove);
+
+    for (l = self->progress_infos; l != NULL; l = l->next)
+    {
+        g_signal_handlers_disconnect_by_data (l->data, self);
+    }
     if (self->progress_infos != NULL)
     {
         g_list_free_full (self->progress_infos, g_object_unref);
@@ -122,6 +136,17 @@ nautilus_progress_info_manager_class_init (NautilusProgressInfoManagerClass *kla
                       g_cclosure_marshal_VOID__VOID,
                       G_TYPE_NONE,
                       0);
+
+    /* Emitted at most once per sample interval, when any of the infos
+     * changed, for what shows all the operations together. */
+    signals[PROGRESS_CHANGED] =
+        g_signal_new ("progress-changed",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL,
+                      g_cclosure_marshal_VOID__VOID,
+                      G_TYPE_NONE,
+                      0);
 }
 
 NautilusProgressInfoManager *
@@ -130,6 +155,40 @@ nautilus_progress_info_manager_dup_singleton (void)
     return g_object_new (NAUTILUS_TYPE_PROGRESS_INFO_MANAGER, NULL);
 }
 
+static gboolean
+sample_timeout_cb (gpointer user_data)
+{
+    NautilusProgressInfoManager *self = user_data;
+
+    if (!self->infos_changed)
+    {
+        if (nautilus_progress_manager_are_all_infos_finished_or_cancelled (self))
+        {
+            self->sample_timeout_id = 0;
+            return G_SOURCE_REMOVE;
+        }
+
+        return G_SOURCE_CONTINUE;
+    }
+
+    self->infos_changed = FALSE;
+    g_signal_emit (self, signals[PROGRESS_CHANGED], 0);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+on_info_changed (NautilusProgressInfoManager *self)
+{
+    self->infos_changed = TRUE;
+
+    if (self->sample_timeout_id == 0)
+    {
+        self->sample_timeout_id = g_timeout_add (PROGRESS_SAMPLE_INTERVAL_MSEC,
+                                                 sample_timeout_cb, self);
+    }
+}
+
 void
 nautilus_progress_info_manager_add_new_info (NautilusProgressInfoManager *self,
                                              NautilusProgressInfo        *info)
@@ -143,6 +202,15 @@ nautilus_progress_info_manager_add_new_info (NautilusProgressInfoManager *self,
     self->progress_infos =
         g_list_prepend (self->progress_infos, g_object_ref (info));
 
+    g_signal_connect_swapped (info, "changed",
+                              G_CALLBACK (on_info_changed), self);
+    g_signal_connect_swapped (info, "progress-changed",
+                              G_CALLBACK (on_info_changed), self);
+    g_signal_connect_swapped (info, "finished",
+                              G_CALLBACK (on_info_changed), self);
+    g_signal_connect_swapped (info, "cancelled",
+                              G_CALLBACK (on_info_changed), self);
+
     g_signal_emit (self, signals[NEW_PROGRESS_INFO], 0, info);
 }
 
@@ -159,6 +227,7 @@ nautilus_progress_info_manager_remove_finished_or_cancelled_infos (NautilusProgr
         if (nautilus_progress_info_get_is_finished (l->data) ||
             nautilus_progress_info_get_is_cancelled (l->data))
         {
+            g_signal_handlers_disconnect_by_data (l->data, self);
             self->progress_infos = g_list_remove (self->progress_infos,
                                                   l->data);
         }
@@ -33,6 +33,10 @@ struct _NautilusProgressInfoWidgetPrivate
     GtkWidget *progress_bar;
     GtkWidget *button;
     GtkWidget *done_image;
+
+    /* The info changed while the widget wasn't shown */
+    gboolean data_outdated;
+    gboolean progress_outdated;
 };
 
 enum
@@ -92,6 +96,52 @@ update_progress (NautilusProgressInfoWidget *self)
     }
 }
 
+/* The rows are only kept up to date while they are shown, as there can
+ * be many operations running while the popover is closed. */
+static void
+on_info_changed (NautilusProgressInfoWidget *self)
+{
+    if (!gtk_widget_get_mapped (GTK_WIDGET (self)))
+    {
+        self->priv->data_outdated = TRUE;
+        return;
+    }
+
+    update_data (self);
+}
+
+static void
+on_info_progress_changed (NautilusProgressInfoWidget *self)
+{
+    if (!gtk_widget_get_mapped (GTK_WIDGET (self)))
+    {
+        self->priv->progress_outdated = TRUE;
+        return;
+    }
+
+    update_progress (self);
+}
+
+static void
+nautilus_progress_info_widget_map (GtkWidget *widget)
+{
+    NautilusProgressInfoWidget *self = NAUTILUS_PROGRESS_INFO_WIDGET (widget);
+
+    if (self->priv->data_outdated)
+    {
+        self->priv->data_outdated = FALSE;
+        update_data (self);
+    }
+
+    if (self->priv->progress_outdated)
+    {
+        self->priv->progress_outdated = FALSE;
+        update_progress (self);
+    }
+
+    GTK_WIDGET_CLASS (nautilus_progress_info_widget_parent_class)->map (widget);
+}
+
 static void
 button_clicked (GtkWidget                  *button,
                 NautilusProgressInfoWidget *self)
@@ -134,10 +184,10 @@ nautilus_progress_info_widget_constructed (GObject *obj)
 
     g_signal_connect_swapped (self->priv->info,
                               "changed",
-                              G_CALLBACK (update_data), self);
+                              G_CALLBACK (on_info_changed), self);
     g_signal_connect_swapped (self->priv->info,
                               "progress-changed",
-                              G_CALLBACK (update_progress), self);
+                              G_CALLBACK (on_info_progress_changed), self);
     g_signal_connect_swapped (self->priv->info,
                               "finished",
                               G_CALLBACK (info_finished), self);
@@ -196,6 +246,8 @@ nautilus_progress_info_widget_class_init (NautilusProgressInfoWidgetClass *klass
     oclass->constructed = nautilus_progress_info_widget_constructed;
     oclass->dispose = nautilus_progress_info_widget_dispose;
 
+    widget_class->map = nautilus_progress_info_widget_map;
+
     properties[PROP_INFO] =
         g_param_spec_object ("info",
                              "NautilusProgressInfo",
@@ -60,6 +60,9 @@ struct _NautilusProgressInfo
     gboolean started;
     gboolean finished;
     gboolean paused;
+    gboolean queued;
+    guint64 transferred_files;
+    guint64 transferred_bytes;
 
     GSource *idle_source;
     gboolean source_is_now;
@@ -478,6 +481,72 @@ nautilus_progress_info_get_is_paused (NautilusProgressInfo *info)
     return res;
 }
 
+gboolean
+nautilus_progress_info_get_is_queued (NautilusProgressInfo *info)
+{
+    gboolean res;
+
+    G_LOCK (progress_info);
+
+    res = info->queued;
+
+    G_UNLOCK (progress_info);
+
+    return res;
+}
+
+void
+nautilus_progress_info_set_queued (NautilusProgressInfo *info,
+                                   gboolean              queued)
+{
+    G_LOCK (progress_info);
+
+    if (info->queued != queued)
+    {
+        info->queued = queued;
+        /* The time spent waiting is not part of the operation. */
+        if (queued)
+        {
+            g_timer_stop (info->progress_timer);
+        }
+        else
+        {
+            g_timer_start (info->progress_timer);
+        }
+
+        info->changed_at_idle = TRUE;
+        queue_idle (info, FALSE);
+    }
+
+    G_UNLOCK (progress_info);
+}
+
+void
+nautilus_progress_info_set_transferred (NautilusProgressInfo *info,
+                                        guint64               files,
+                                        guint64               bytes)
+{
+    G_LOCK (progress_info);
+
+    info->transferred_files = files;
+    info->transferred_bytes = bytes;
+
+    G_UNLOCK (progress_info);
+}
+
+void
+nautilus_progress_info_get_transferred (NautilusProgressInfo *info,
+                                        guint64              *files,
+                                        guint64              *bytes)
+{
+    G_LOCK (progress_info);
+
+    *files = info->transferred_files;
+    *bytes = info->transferred_bytes;
+
+    G_UNLOCK (progress_info);
+}
+
 void
 nautilus_progress_info_pause (NautilusProgressInfo *info)
 {
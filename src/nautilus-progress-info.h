@@ -50,12 +50,16 @@ void          nautilus_progress_info_cancel          (NautilusProgressInfo *info
 gboolean      nautilus_progress_info_get_is_started  (NautilusProgressInfo *info);
 gboolean      nautilus_progress_info_get_is_finished (NautilusProgressInfo *info);
 gboolean      nautilus_progress_info_get_is_paused   (NautilusProgressInfo *info);
+/* Whether the operation waits for others to be done before running */
+gboolean      nautilus_progress_info_get_is_queued   (NautilusProgressInfo *info);
 gboolean      nautilus_progress_info_get_is_cancelled (NautilusProgressInfo *info);
 
 void          nautilus_progress_info_start           (NautilusProgressInfo *info);
 void          nautilus_progress_info_finish          (NautilusProgressInfo *info);
 void          nautilus_progress_info_pause           (NautilusProgressInfo *info);
 void          nautilus_progress_info_resume          (NautilusProgressInfo *info);
+void          nautilus_progress_info_set_queued      (NautilusProgressInfo *info,
+                                                      gboolean              queued);
 void          nautilus_progress_info_set_status      (NautilusProgressInfo *info,
 						      const char           *status);
 void          nautilus_progress_info_take_status     (NautilusProgressInfo *info,
@@ -68,6 +72,14 @@ void          nautilus_progress_info_set_progress    (NautilusProgressInfo *info
 						      double                current,
 						      double                total);
 void          nautilus_progress_info_pulse_progress  (NautilusProgressInfo *info);
+/* How many files and bytes the operation went through so far. Nothing is
+ * emitted when they change, they are for the callers which poll. */
+void          nautilus_progress_info_set_transferred (NautilusProgressInfo *info,
+                                                      guint64               files,
+                                                      guint64               bytes);
+void          nautilus_progress_info_get_transferred (NautilusProgressInfo *info,
+                                                      guint64              *files,
+                                                      guint64              *bytes);
 
 void          nautilus_progress_info_set_remaining_time (NautilusProgressInfo *info,
                                                          gdouble               time);
@@ -217,7 +217,10 @@ struct _NautilusPropertiesWindow
 
     GList *value_fields;
 
-    GList *mime_list;
+    /* Attribute name -> AttributeAggregate, for original_files and
+     * target_files */
+    GHashTable *original_aggregates;
+    GHashTable *target_aggregates;
 
     gboolean deep_count_finished;
     GList *deep_count_files;
@@ -987,29 +990,203 @@ remove_from_dialog (NautilusPropertiesWindow *self,
     nautilus_file_monitor_remove (target_file, &self->target_files);
 }
 
+/* The values of a string attribute over a list of files, kept up to date
+ * as the files change rather than computed again on each update */
+typedef struct
+{
+    char *attribute_name;
+    GQuark attribute_q;
+    GHashTable *file_values;    /* NautilusFile -> value, for the files not gone */
+    GHashTable *value_counts;   /* value -> number of files with it */
+    GString *buffer;            /* to peek at the values in */
+} AttributeAggregate;
+
+static void
+attribute_aggregate_free (AttributeAggregate *aggregate)
+{
+    g_free (aggregate->attribute_name);
+    g_hash_table_destroy (aggregate->file_values);
+    g_hash_table_destroy (aggregate->value_counts);
+    g_string_free (aggregate->buffer, TRUE);
+
+    g_free (aggregate);
+}
+
+static char *
+attribute_aggregate_get_value (AttributeAggregate *aggregate,
+                               NautilusFile       *file)
+{
+    const char *value;
+
+    value = nautilus_file_peek_string_attribute_q (file, aggregate->attribute_q,
+                                                   aggregate->buffer);
+    if (value == NULL)
+    {
+        return nautilus_file_get_string_attribute_with_default_q (file, aggregate->attribute_q);
+    }
+
+    return g_strdup (value);
+}
+
+static void
+attribute_aggregate_count_value (AttributeAggregate *aggregate,
+                                 const char         *value,
+                                 int                 delta)
+{
+    guint count;
+
+    count = GPOINTER_TO_UINT (g_hash_table_lookup (aggregate->value_counts, value)) + delta;
+    if (count == 0)
+    {
+        g_hash_table_remove (aggregate->value_counts, value);
+    }
+    else
+    {
+        g_hash_table_insert (aggregate->value_counts, g_strdup (value), GUINT_TO_POINTER (count));
+    }
+}
+
+static AttributeAggregate *
+attribute_aggregate_new (GList      *file_list,
+                         const char *attribute_name)
+{
+    AttributeAggregate *aggregate;
+
+    aggregate = g_new0 (AttributeAggregate, 1);
+    aggregate->attribute_name = g_strdup (attribute_name);
+    aggregate->attribute_q = g_quark_from_string (attribute_name);
+    aggregate->buffer = g_string_new (NULL);
+    aggregate->file_values = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+    aggregate->value_counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    for (GList *l = file_list; l != NULL; l = l->next)
+    {
+        NautilusFile *file = NAUTILUS_FILE (l->data);
+        char *value;
+
+        if (nautilus_file_is_gone (file))
+        {
+            continue;
+        }
+
+        value = attribute_aggregate_get_value (aggregate, file);
+        attribute_aggregate_count_value (aggregate, value, 1);
+        g_hash_table_insert (aggregate->file_values, file, value);
+    }
+
+    return aggregate;
+}
+
+/* Returns whether the value of @file changed */
 static gboolean
-mime_list_equal (GList *a,
-                 GList *b)
+attribute_aggregate_update_file (AttributeAggregate *aggregate,
+                                 NautilusFile       *file)
 {
-    while (a && b)
+    const char *old_value;
+    const char *peeked_value;
+    g_autofree char *new_value = NULL;
+
+    old_value = g_hash_table_lookup (aggregate->file_values, file);
+    if (old_value == NULL)
+    {
+        /* Not in the list, or already gone */
+        return FALSE;
+    }
+
+    if (!nautilus_file_is_gone (file))
     {
-        if (strcmp (a->data, b->data))
+        /* Most changes leave most attributes as they were */
+        peeked_value = nautilus_file_peek_string_attribute_q (file, aggregate->attribute_q,
+                                                              aggregate->buffer);
+        if (peeked_value != NULL && strcmp (old_value, peeked_value) == 0)
+        {
+            return FALSE;
+        }
+
+        new_value = attribute_aggregate_get_value (aggregate, file);
+        if (strcmp (old_value, new_value) == 0)
         {
             return FALSE;
         }
-        a = a->next;
-        b = b->next;
     }
 
-    return (a == b);
+    attribute_aggregate_count_value (aggregate, old_value, -1);
+
+    if (new_value != NULL)
+    {
+        attribute_aggregate_count_value (aggregate, new_value, 1);
+        g_hash_table_insert (aggregate->file_values, file, g_steal_pointer (&new_value));
+    }
+    else
+    {
+        g_hash_table_remove (aggregate->file_values, file);
+    }
+
+    return TRUE;
 }
 
-static GList *
-get_mime_list (NautilusPropertiesWindow *self)
+static AttributeAggregate *
+get_attribute_aggregate (NautilusPropertiesWindow *self,
+                         GList                    *file_list,
+                         const char               *attribute_name)
 {
-    return g_list_copy_deep (self->target_files,
-                             (GCopyFunc) nautilus_file_get_mime_type,
-                             NULL);
+    GHashTable **aggregates;
+    AttributeAggregate *aggregate;
+
+    g_assert (file_list == self->original_files || file_list == self->target_files);
+
+    aggregates = file_list == self->original_files ?
+                 &self->original_aggregates : &self->target_aggregates;
+    if (*aggregates == NULL)
+    {
+        *aggregates = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                             (GDestroyNotify) attribute_aggregate_free);
+    }
+
+    aggregate = g_hash_table_lookup (*aggregates, attribute_name);
+    if (aggregate == NULL)
+    {
+        aggregate = attribute_aggregate_new (file_list, attribute_name);
+        g_hash_table_insert (*aggregates, aggregate->attribute_name, aggregate);
+    }
+
+    return aggregate;
+}
+
+/* Returns whether the value of the mime type of a target file changed */
+static gboolean
+update_attribute_aggregates (NautilusPropertiesWindow *self,
+                             GList                    *files)
+{
+    GHashTable *tables[] = { self->original_aggregates, self->target_aggregates };
+    gboolean mime_type_changed = FALSE;
+
+    for (guint i = 0; i < G_N_ELEMENTS (tables); i++)
+    {
+        GHashTableIter iter;
+        AttributeAggregate *aggregate;
+
+        if (tables[i] == NULL)
+        {
+            continue;
+        }
+
+        g_hash_table_iter_init (&iter, tables[i]);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &aggregate))
+        {
+            for (GList *l = files; l != NULL; l = l->next)
+            {
+                if (attribute_aggregate_update_file (aggregate, NAUTILUS_FILE (l->data)) &&
+                    tables[i] == self->target_aggregates &&
+                    strcmp (aggregate->attribute_name, "mime_type") == 0)
+                {
+                    mime_type_changed = TRUE;
+                }
+            }
+        }
+    }
+
+    return mime_type_changed;
 }
 
 static gboolean
@@ -1086,15 +1263,22 @@ static void
 properties_window_update (NautilusPropertiesWindow *self,
                           GList                    *files)
 {
-    GList *mime_list;
     NautilusFile *changed_file;
     gboolean dirty_original = FALSE;
     gboolean dirty_target = FALSE;
+    gboolean mime_type_changed = FALSE;
 
     if (files == NULL)
     {
         dirty_original = TRUE;
         dirty_target = TRUE;
+
+        /* Tells when the extension pages need a refresh */
+        get_attribute_aggregate (self, self->target_files, "mime_type");
+    }
+    else
+    {
+        mime_type_changed = update_attribute_aggregates (self, files);
     }
 
     for (GList *tmp = files; tmp != NULL; tmp = tmp->next)
@@ -1147,21 +1331,9 @@ properties_window_update (NautilusPropertiesWindow *self,
                         self);
     }
 
-    mime_list = get_mime_list (self);
-
-    if (self->mime_list == NULL)
+    if (mime_type_changed)
     {
-        self->mime_list = mime_list;
-    }
-    else
-    {
-        if (!mime_list_equal (self->mime_list, mime_list))
-        {
-            refresh_extension_pages (self);
-        }
-
-        g_list_free_full (self->mime_list, g_free);
-        self->mime_list = mime_list;
+        refresh_extension_pages (self);
     }
 }
 
@@ -1205,71 +1377,46 @@ schedule_files_update (NautilusPropertiesWindow *self)
 }
 
 static gboolean
-file_list_attributes_identical (GList      *file_list,
-                                const char *attribute_name)
+file_list_attributes_identical (NautilusPropertiesWindow *self,
+                                GList                    *file_list,
+                                const char               *attribute_name)
 {
-    gboolean identical;
-    g_autofree char *first_attr = NULL;
-    GList *l;
+    AttributeAggregate *aggregate;
 
-    identical = TRUE;
+    aggregate = get_attribute_aggregate (self, file_list, attribute_name);
 
-    for (l = file_list; l != NULL; l = l->next)
-    {
-        NautilusFile *file;
-
-        file = NAUTILUS_FILE (l->data);
-
-        if (nautilus_file_is_gone (file))
-        {
-            continue;
-        }
-
-        if (first_attr == NULL)
-        {
-            first_attr = nautilus_file_get_string_attribute_with_default (file, attribute_name);
-        }
-        else
-        {
-            g_autofree char *attr = NULL;
-            attr = nautilus_file_get_string_attribute_with_default (file, attribute_name);
-            if (strcmp (attr, first_attr))
-            {
-                identical = FALSE;
-                break;
-            }
-        }
-    }
-
-    return identical;
+    return g_hash_table_size (aggregate->value_counts) <= 1;
 }
 
 static char *
-file_list_get_string_attribute (GList      *file_list,
-                                const char *attribute_name,
-                                const char *inconsistent_value)
+file_list_get_string_attribute (NautilusPropertiesWindow *self,
+                                GList                    *file_list,
+                                const char               *attribute_name,
+                                const char               *inconsistent_value)
 {
-    if (file_list_attributes_identical (file_list, attribute_name))
+    AttributeAggregate *aggregate;
+    GHashTableIter iter;
+    const char *value;
+
+    aggregate = get_attribute_aggregate (self, file_list, attribute_name);
+
+    switch (g_hash_table_size (aggregate->value_counts))
     {
-        GList *l;
+        case 0:
+        {
+            return g_strdup (_("unknown"));
+        }
 
-        for (l = file_list; l != NULL; l = l->next)
+        case 1:
         {
-            NautilusFile *file;
+            g_hash_table_iter_init (&iter, aggregate->value_counts);
+            g_hash_table_iter_next (&iter, (gpointer *) &value, NULL);
 
-            file = NAUTILUS_FILE (l->data);
-            if (!nautilus_file_is_gone (file))
-            {
-                return nautilus_file_get_string_attribute_with_default
-                           (file,
-                           attribute_name);
-            }
+            return g_strdup (value);
         }
-        return g_strdup (_("unknown"));
-    }
-    else
-    {
-        return g_strdup (inconsistent_value);
+
+        default:
+            return g_strdup (inconsistent_value);
     }
 }
 
@@ -1312,12 +1459,14 @@ value_field_update (GtkLabel                 *label,
     }
 
     inconsistent_string = INCONSISTENT_STATE_STRING;
-    attribute_value = file_list_get_string_attribute (file_list,
+    attribute_value = file_list_get_string_attribute (self,
+                                                      file_list,
                                                       attribute_name,
                                                       inconsistent_string);
     if (!strcmp (attribute_name, "detailed_type") && strcmp (attribute_value, inconsistent_string))
     {
-        g_autofree char *mime_type = file_list_get_string_attribute (file_list,
+        g_autofree char *mime_type = file_list_get_string_attribute (self,
+                                                                     file_list,
                                                                      "mime_type",
                                                                      inconsistent_string);
         if (strcmp (mime_type, inconsistent_string))
@@ -1327,7 +1476,11 @@ value_field_update (GtkLabel                 *label,
         }
     }
 
-    gtk_label_set_text (label, attribute_value);
+    /* Most updates are for rows other files changed, or none */
+    if (g_strcmp0 (gtk_label_get_text (label), attribute_value) != 0)
+    {
+        gtk_label_set_text (label, attribute_value);
+    }
 }
 
 static void
@@ -1589,11 +1742,52 @@ tree_model_get_entry_index (GtkTreeModel *model,
 }
 
 
+/* The account names are looked up in a worker, for a combo box. The
+ * lookup is cancelled when the combo box is destroyed or starts another,
+ * so the combo box is still there when it is not. */
+typedef struct
+{
+    GtkComboBox *combo_box;
+    NautilusFile *file;
+} AccountNamesLookup;
+
 static void
-synch_groups_combo_box (GtkComboBox  *combo_box,
-                        NautilusFile *file)
+cancel_and_unref (GCancellable *cancellable)
+{
+    g_cancellable_cancel (cancellable);
+    g_object_unref (cancellable);
+}
+
+static AccountNamesLookup *
+account_names_lookup_new (GtkComboBox   *combo_box,
+                          NautilusFile  *file,
+                          GCancellable **cancellable)
+{
+    AccountNamesLookup *lookup;
+
+    *cancellable = g_cancellable_new ();
+    g_object_set_data_full (G_OBJECT (combo_box), "account-names-cancellable",
+                            *cancellable, (GDestroyNotify) cancel_and_unref);
+
+    lookup = g_new0 (AccountNamesLookup, 1);
+    lookup->combo_box = combo_box;
+    lookup->file = nautilus_file_ref (file);
+
+    return lookup;
+}
+
+static void
+account_names_lookup_free (AccountNamesLookup *lookup)
+{
+    nautilus_file_unref (lookup->file);
+    g_free (lookup);
+}
+
+static void
+fill_groups_combo_box (GtkComboBox  *combo_box,
+                       NautilusFile *file,
+                       GList        *groups)
 {
-    GList *groups = NULL;
     GList *node;
     GtkTreeModel *model;
     GtkListStore *store;
@@ -1602,16 +1796,6 @@ synch_groups_combo_box (GtkComboBox  *combo_box,
     int group_index;
     int current_group_index;
 
-    g_assert (GTK_IS_COMBO_BOX (combo_box));
-    g_assert (NAUTILUS_IS_FILE (file));
-
-    if (nautilus_file_is_gone (file))
-    {
-        return;
-    }
-
-    groups = nautilus_file_get_settable_group_names (file);
-
     model = gtk_combo_box_get_model (combo_box);
     store = GTK_LIST_STORE (model);
     g_assert (GTK_IS_LIST_STORE (model));
@@ -1650,8 +1834,46 @@ synch_groups_combo_box (GtkComboBox  *combo_box,
         current_group_index = 0;
     }
     gtk_combo_box_set_active (combo_box, current_group_index);
+}
+
+static void
+on_settable_group_names_ready (GObject      *source_object,
+                               GAsyncResult *result,
+                               gpointer      user_data)
+{
+    AccountNamesLookup *lookup = user_data;
+    g_autoptr (GError) error = NULL;
+    GList *groups;
+
+    groups = nautilus_file_get_settable_group_names_finish (result, &error);
+    if (error == NULL && !nautilus_file_is_gone (lookup->file))
+    {
+        fill_groups_combo_box (lookup->combo_box, lookup->file, groups);
+    }
 
     g_list_free_full (groups, g_free);
+    account_names_lookup_free (lookup);
+}
+
+static void
+synch_groups_combo_box (GtkComboBox  *combo_box,
+                        NautilusFile *file)
+{
+    AccountNamesLookup *lookup;
+    GCancellable *cancellable;
+
+    g_assert (GTK_IS_COMBO_BOX (combo_box));
+    g_assert (NAUTILUS_IS_FILE (file));
+
+    if (nautilus_file_is_gone (file))
+    {
+        return;
+    }
+
+    lookup = account_names_lookup_new (combo_box, file, &cancellable);
+    nautilus_file_get_settable_group_names_async (file, cancellable,
+                                                  on_settable_group_names_ready,
+                                                  lookup);
 }
 
 static gboolean
@@ -1851,10 +2073,10 @@ changed_owner_callback (GtkComboBox  *combo_box,
 }
 
 static void
-synch_user_menu (GtkComboBox  *combo_box,
-                 NautilusFile *file)
+fill_user_menu (GtkComboBox  *combo_box,
+                NautilusFile *file,
+                GList        *users)
 {
-    GList *users = NULL;
     GList *node;
     GtkTreeModel *model;
     GtkListStore *store;
@@ -1865,16 +2087,6 @@ synch_user_menu (GtkComboBox  *combo_box,
     int user_index;
     int owner_index;
 
-    g_assert (GTK_IS_COMBO_BOX (combo_box));
-    g_assert (NAUTILUS_IS_FILE (file));
-
-    if (nautilus_file_is_gone (file))
-    {
-        return;
-    }
-
-    users = nautilus_get_user_names ();
-
     model = gtk_combo_box_get_model (combo_box);
     store = GTK_LIST_STORE (model);
     g_assert (GTK_IS_LIST_STORE (model));
@@ -1945,8 +2157,44 @@ synch_user_menu (GtkComboBox  *combo_box,
     }
 
     gtk_combo_box_set_active (combo_box, owner_index);
+}
+
+static void
+on_user_names_ready (GObject      *source_object,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+    AccountNamesLookup *lookup = user_data;
+    g_autoptr (GError) error = NULL;
+    GList *users;
+
+    users = nautilus_get_user_names_finish (result, &error);
+    if (error == NULL && !nautilus_file_is_gone (lookup->file))
+    {
+        fill_user_menu (lookup->combo_box, lookup->file, users);
+    }
 
     g_list_free_full (users, g_free);
+    account_names_lookup_free (lookup);
+}
+
+static void
+synch_user_menu (GtkComboBox  *combo_box,
+                 NautilusFile *file)
+{
+    AccountNamesLookup *lookup;
+    GCancellable *cancellable;
+
+    g_assert (GTK_IS_COMBO_BOX (combo_box));
+    g_assert (NAUTILUS_IS_FILE (file));
+
+    if (nautilus_file_is_gone (file))
+    {
+        return;
+    }
+
+    lookup = account_names_lookup_new (combo_box, file, &cancellable);
+    nautilus_get_user_names_async (cancellable, on_user_names_ready, lookup);
 }
 
 static void
@@ -4370,7 +4618,8 @@ should_show_open_with (NautilusPropertiesWindow *self)
     {
         GList *l;
 
-        if (!file_list_attributes_identical (self->target_files,
+        if (!file_list_attributes_identical (self,
+                                             self->target_files,
                                              "mime_type"))
         {
             return FALSE;
@@ -5127,6 +5376,9 @@ real_destroy (GtkWidget *object)
 
     g_clear_list (&self->value_fields, NULL);
 
+    g_clear_pointer (&self->original_aggregates, g_hash_table_destroy);
+    g_clear_pointer (&self->target_aggregates, g_hash_table_destroy);
+
     g_clear_handle_id (&self->update_directory_contents_timeout_id, g_source_remove);
     g_clear_handle_id (&self->update_files_timeout_id, g_source_remove);
 
@@ -5140,8 +5392,6 @@ real_finalize (GObject *object)
 
     self = NAUTILUS_PROPERTIES_WINDOW (object);
 
-    g_list_free_full (self->mime_list, g_free);
-
     g_free (self->pending_name);
     g_free (self->content_type);
     g_list_free (self->open_with_files);
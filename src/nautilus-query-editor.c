@@ -49,6 +49,7 @@ struct _NautilusQueryEditor
     GdTaggedEntryTag *date_range_tag;
 
     gboolean change_frozen;
+    guint changed_timeout_id;
 
     GFile *location;
 
@@ -74,6 +75,13 @@ enum
 
 static guint signals[LAST_SIGNAL];
 
+/* The searches of a location which took longer than that to give back
+ * their first hits lately, as recursive ones of network shares may, are
+ * only started again once the typing pauses, for up to the maximum. The
+ * others, as indexed searches, still start on every change. */
+#define SLOW_SEARCH_FIRST_HIT_MSECS 300
+#define SLOW_SEARCH_MAX_DELAY_MSECS 1000
+
 static void entry_activate_cb (GtkWidget           *entry,
                                NautilusQueryEditor *editor);
 static void entry_changed_cb (GtkWidget           *entry,
@@ -134,6 +142,7 @@ nautilus_query_editor_dispose (GObject *object)
 
     editor = NAUTILUS_QUERY_EDITOR (object);
 
+    g_clear_handle_id (&editor->changed_timeout_id, g_source_remove);
     g_clear_object (&editor->location);
     g_clear_object (&editor->query);
 
@@ -343,6 +352,10 @@ create_query (NautilusQueryEditor *editor)
     query = nautilus_query_new ();
 
     nautilus_query_set_search_content (query, fts_enabled);
+    if (!nautilus_search_popover_get_prune_enabled (NAUTILUS_SEARCH_POPOVER (editor->popover)))
+    {
+        nautilus_query_set_prune_patterns (query, NULL);
+    }
 
     nautilus_query_set_text (query, gtk_entry_get_text (GTK_ENTRY (editor->entry)));
     nautilus_query_set_location (query, editor->location);
@@ -355,10 +368,50 @@ create_query (NautilusQueryEditor *editor)
     nautilus_query_editor_set_query (editor, query);
 }
 
+static gboolean
+changed_timeout_cb (gpointer user_data)
+{
+    NautilusQueryEditor *editor = user_data;
+
+    editor->changed_timeout_id = 0;
+    nautilus_query_editor_changed (editor);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Emits "changed" after the text changed, later on the slow locations */
+static void
+schedule_changed (NautilusQueryEditor *editor)
+{
+    guint first_hit_delay = 0;
+
+    g_clear_handle_id (&editor->changed_timeout_id, g_source_remove);
+
+    if (editor->location != NULL)
+    {
+        first_hit_delay = nautilus_search_directory_get_first_hit_delay (editor->location);
+    }
+
+    if (first_hit_delay < SLOW_SEARCH_FIRST_HIT_MSECS)
+    {
+        nautilus_query_editor_changed (editor);
+        return;
+    }
+
+    editor->changed_timeout_id = g_timeout_add (MIN (first_hit_delay / 2, SLOW_SEARCH_MAX_DELAY_MSECS),
+                                                changed_timeout_cb, editor);
+}
+
 static void
 entry_activate_cb (GtkWidget           *entry,
                    NautilusQueryEditor *editor)
 {
+    /* Not waiting for the typing to pause anymore */
+    if (editor->changed_timeout_id != 0)
+    {
+        nautilus_query_editor_changed (editor);
+    }
+
     g_signal_emit (editor, signals[ACTIVATED], 0);
 }
 
@@ -385,7 +438,7 @@ entry_changed_cb (GtkWidget           *entry,
         nautilus_query_set_text (editor->query, text);
     }
 
-    nautilus_query_editor_changed (editor);
+    schedule_changed (editor);
 }
 
 static void
@@ -524,6 +577,30 @@ search_popover_fts_changed_cb (GObject    *popover,
     nautilus_query_editor_changed (editor);
 }
 
+static void
+search_popover_prune_changed_cb (GObject    *popover,
+                                 GParamSpec *pspec,
+                                 gpointer    user_data)
+{
+    NautilusQueryEditor *editor;
+    g_auto (GStrv) prune_patterns = NULL;
+
+    editor = NAUTILUS_QUERY_EDITOR (user_data);
+
+    if (editor->query == NULL)
+    {
+        create_query (editor);
+    }
+
+    if (nautilus_search_popover_get_prune_enabled (NAUTILUS_SEARCH_POPOVER (popover)))
+    {
+        prune_patterns = nautilus_get_prune_patterns ();
+    }
+    nautilus_query_set_prune_patterns (editor->query, (const char * const *) prune_patterns);
+
+    nautilus_query_editor_changed (editor);
+}
+
 static void
 entry_tag_clicked (NautilusQueryEditor *editor)
 {
@@ -609,6 +686,8 @@ setup_widgets (NautilusQueryEditor *editor)
                       G_CALLBACK (search_popover_time_type_changed_cb), editor);
     g_signal_connect (editor->popover, "notify::fts-enabled",
                       G_CALLBACK (search_popover_fts_changed_cb), editor);
+    g_signal_connect (editor->popover, "notify::prune-enabled",
+                      G_CALLBACK (search_popover_prune_changed_cb), editor);
 
     /* show everything */
     gtk_widget_show_all (vbox);
@@ -622,6 +701,8 @@ nautilus_query_editor_changed (NautilusQueryEditor *editor)
         return;
     }
 
+    g_clear_handle_id (&editor->changed_timeout_id, g_source_remove);
+
     g_signal_emit (editor, signals[CHANGED], 0, editor->query, TRUE);
 }
 
@@ -714,6 +795,12 @@ nautilus_query_editor_set_query (NautilusQueryEditor *self,
 
     self->change_frozen = TRUE;
 
+    /* The change pending is for the query being replaced */
+    if (query != self->query)
+    {
+        g_clear_handle_id (&self->changed_timeout_id, g_source_remove);
+    }
+
     current_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (self->entry)));
     current_text = g_strstrip (current_text);
     if (!g_str_equal (current_text, text))
@@ -23,6 +23,13 @@
 
 #include <eel/eel-glib-extensions.h>
 #include <glib/gi18n.h>
+#include <string.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "nautilus-enum-types.h"
 #include "nautilus-file-utilities.h"
@@ -44,12 +51,33 @@ struct _NautilusQuery
     NautilusQueryRecursive recursive;
     NautilusQuerySearchType search_type;
     NautilusQuerySearchContent search_content;
+    GStrv prune_patterns;
 
     gboolean searching;
-    char **prepared_words;
-    GMutex prepared_words_mutex;
+    NautilusQueryMatcher *matcher;
+    GMutex matcher_mutex;
+};
+
+struct _NautilusQueryMatcher
+{
+    gatomicrefcount ref_count;
+
+    /* NULL if the query has no text, and matches nothing */
+    char **words;
+    /* Whether the words are lowercase ASCII, and ASCII candidates can
+     * be lowered byte by byte instead of being normalized. */
+    gboolean ascii_words;
 };
 
+static void
+ascii_buffer_free (gpointer data)
+{
+    g_string_free (data, TRUE);
+}
+
+/* Lowered ASCII candidates, one buffer per thread and reused */
+static GPrivate ascii_buffer = G_PRIVATE_INIT (ascii_buffer_free);
+
 static void  nautilus_query_class_init (NautilusQueryClass *class);
 static void  nautilus_query_init (NautilusQuery *query);
 
@@ -61,6 +89,7 @@ enum
     PROP_DATE_RANGE,
     PROP_LOCATION,
     PROP_MIMETYPES,
+    PROP_PRUNE_PATTERNS,
     PROP_RECURSIVE,
     PROP_SEARCH_TYPE,
     PROP_SEARCHING,
@@ -77,10 +106,11 @@ finalize (GObject *object)
     query = NAUTILUS_QUERY (object);
 
     g_free (query->text);
-    g_strfreev (query->prepared_words);
+    g_clear_pointer (&query->matcher, nautilus_query_matcher_unref);
     g_clear_object (&query->location);
     g_clear_pointer (&query->date_range, g_ptr_array_unref);
-    g_mutex_clear (&query->prepared_words_mutex);
+    g_clear_pointer (&query->prune_patterns, g_strfreev);
+    g_mutex_clear (&query->matcher_mutex);
 
     G_OBJECT_CLASS (nautilus_query_parent_class)->finalize (object);
 }
@@ -113,6 +143,12 @@ nautilus_query_get_property (GObject    *object,
         }
         break;
 
+        case PROP_PRUNE_PATTERNS:
+        {
+            g_value_set_boxed (value, self->prune_patterns);
+        }
+        break;
+
         case PROP_RECURSIVE:
         {
             g_value_set_enum (value, self->recursive);
@@ -176,6 +212,12 @@ nautilus_query_set_property (GObject      *object,
         }
         break;
 
+        case PROP_PRUNE_PATTERNS:
+        {
+            nautilus_query_set_prune_patterns (self, g_value_get_boxed (value));
+        }
+        break;
+
         case PROP_RECURSIVE:
         {
             nautilus_query_set_recursive (self, g_value_get_enum (value));
@@ -261,6 +303,20 @@ nautilus_query_class_init (NautilusQueryClass *class)
                                                            "The MIME types of the query",
                                                            G_PARAM_READWRITE));
 
+    /**
+     * NautilusQuery::prune-patterns:
+     *
+     * The patterns of the folders a recursive query doesn't descend into.
+     *
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_PRUNE_PATTERNS,
+                                     g_param_spec_boxed ("prune-patterns",
+                                                         "Prune patterns of the query",
+                                                         "The patterns of the folders not to search in",
+                                                         G_TYPE_STRV,
+                                                         G_PARAM_READWRITE));
+
     /**
      * NautilusQuery::recursive:
      *
@@ -342,7 +398,8 @@ nautilus_query_init (NautilusQuery *query)
     query->show_hidden = TRUE;
     query->search_type = g_settings_get_enum (nautilus_preferences, "search-filter-time-type");
     query->search_content = NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE;
-    g_mutex_init (&query->prepared_words_mutex);
+    query->prune_patterns = nautilus_get_prune_patterns ();
+    g_mutex_init (&query->matcher_mutex);
 }
 
 static gchar *
@@ -357,49 +414,188 @@ prepare_string_for_compare (const gchar *string)
     return res;
 }
 
+static gboolean
+is_ascii (const gchar *string)
+{
+    const guchar *p;
+
+    for (p = (const guchar *) string; *p != '\0'; p++)
+    {
+        if (*p >= 0x80)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static NautilusQueryMatcher *
+nautilus_query_matcher_new (const char *text)
+{
+    NautilusQueryMatcher *matcher;
+    g_autofree gchar *prepared_string = NULL;
+    g_autofree gchar *lowered_i = NULL;
+
+    matcher = g_new0 (NautilusQueryMatcher, 1);
+    g_atomic_ref_count_init (&matcher->ref_count);
+
+    if (text == NULL)
+    {
+        return matcher;
+    }
+
+    prepared_string = prepare_string_for_compare (text);
+    matcher->words = g_strsplit (prepared_string, " ", -1);
+
+    /* Some locales don't lower ASCII letters to ASCII, e.g. Turkish I. */
+    lowered_i = g_utf8_strdown ("I", -1);
+    matcher->ascii_words = is_ascii (prepared_string) && strcmp (lowered_i, "i") == 0;
+
+    return matcher;
+}
+
+NautilusQueryMatcher *
+nautilus_query_matcher_ref (NautilusQueryMatcher *matcher)
+{
+    g_atomic_ref_count_inc (&matcher->ref_count);
+
+    return matcher;
+}
+
+void
+nautilus_query_matcher_unref (NautilusQueryMatcher *matcher)
+{
+    if (!g_atomic_ref_count_dec (&matcher->ref_count))
+    {
+        return;
+    }
+
+    g_strfreev (matcher->words);
+    g_free (matcher);
+}
+
+/* Copies @length bytes of @src lowered to @dest, 16 at a time where the
+ * CPU has the vector instructions for it. Returns FALSE, leaving @dest
+ * partly written, if @src isn't ASCII.
+ */
+static gboolean
+lower_ascii (const gchar *src,
+             gchar       *dest,
+             gsize        length)
+{
+    gsize i;
+
+    i = 0;
+
+#if defined (__SSE2__)
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i chunk, is_upper;
+
+        chunk = _mm_loadu_si128 ((const __m128i *) (src + i));
+        if (_mm_movemask_epi8 (chunk) != 0)
+        {
+            return FALSE;
+        }
+
+        /* The bytes are ASCII now, so comparing them as signed is fine. */
+        is_upper = _mm_and_si128 (_mm_cmpgt_epi8 (chunk, _mm_set1_epi8 ('A' - 1)),
+                                  _mm_cmplt_epi8 (chunk, _mm_set1_epi8 ('Z' + 1)));
+        chunk = _mm_or_si128 (chunk, _mm_and_si128 (is_upper, _mm_set1_epi8 (0x20)));
+        _mm_storeu_si128 ((__m128i *) (dest + i), chunk);
+    }
+#elif defined (__aarch64__)
+    for (; i + 16 <= length; i += 16)
+    {
+        uint8x16_t chunk, is_upper;
+
+        chunk = vld1q_u8 ((const uint8_t *) (src + i));
+        if (vmaxvq_u8 (chunk) >= 0x80)
+        {
+            return FALSE;
+        }
+
+        is_upper = vandq_u8 (vcgeq_u8 (chunk, vdupq_n_u8 ('A')),
+                             vcleq_u8 (chunk, vdupq_n_u8 ('Z')));
+        chunk = vorrq_u8 (chunk, vandq_u8 (is_upper, vdupq_n_u8 (0x20)));
+        vst1q_u8 ((uint8_t *) (dest + i), chunk);
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        if ((guchar) src[i] >= 0x80)
+        {
+            return FALSE;
+        }
+        dest[i] = g_ascii_tolower (src[i]);
+    }
+
+    return TRUE;
+}
+
+/* Lowers an ASCII string into the buffer of the calling thread, which is
+ * only valid until the next call. Returns NULL if @string isn't ASCII. */
+static const gchar *
+lower_ascii_string (const gchar *string,
+                    gsize       *length)
+{
+    GString *buffer;
+
+    buffer = g_private_get (&ascii_buffer);
+    if (buffer == NULL)
+    {
+        buffer = g_string_sized_new (256);
+        g_private_set (&ascii_buffer, buffer);
+    }
+
+    *length = strlen (string);
+    g_string_set_size (buffer, *length);
+    if (!lower_ascii (string, buffer->str, *length))
+    {
+        return NULL;
+    }
+
+    return buffer->str;
+}
+
 gdouble
-nautilus_query_matches_string (NautilusQuery *query,
-                               const gchar   *string)
+nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                              const gchar          *string)
 {
-    gchar *prepared_string, *ptr;
-    gboolean found;
-    gdouble retval;
+    const gchar *compared_string;
+    g_autofree gchar *prepared_string = NULL;
+    const gchar *ptr;
     gint idx, nonexact_malus;
+    gsize length;
 
-    if (!query->text)
+    if (matcher->words == NULL)
     {
         return -1;
     }
 
-    g_mutex_lock (&query->prepared_words_mutex);
-    if (!query->prepared_words)
+    /* Normalizing an ASCII string doesn't change it, and it only has
+     * ASCII letters to lower. */
+    compared_string = matcher->ascii_words ? lower_ascii_string (string, &length) : NULL;
+    if (compared_string == NULL)
     {
-        prepared_string = prepare_string_for_compare (query->text);
-        query->prepared_words = g_strsplit (prepared_string, " ", -1);
-        g_free (prepared_string);
+        prepared_string = prepare_string_for_compare (string);
+        compared_string = prepared_string;
+        length = strlen (compared_string);
     }
 
-    prepared_string = prepare_string_for_compare (string);
-    found = TRUE;
     ptr = NULL;
     nonexact_malus = 0;
 
-    for (idx = 0; query->prepared_words[idx] != NULL; idx++)
+    for (idx = 0; matcher->words[idx] != NULL; idx++)
     {
-        if ((ptr = strstr (prepared_string, query->prepared_words[idx])) == NULL)
+        if ((ptr = strstr (compared_string, matcher->words[idx])) == NULL)
         {
-            found = FALSE;
-            break;
+            return -1;
         }
 
-        nonexact_malus += strlen (ptr) - strlen (query->prepared_words[idx]);
-    }
-    g_mutex_unlock (&query->prepared_words_mutex);
-
-    if (!found)
-    {
-        g_free (prepared_string);
-        return -1;
+        nonexact_malus += (length - (ptr - compared_string)) - strlen (matcher->words[idx]);
     }
 
     /* The rank value depends on the numbers of letters before and after the match.
@@ -407,10 +603,54 @@ nautilus_query_matches_string (NautilusQuery *query,
      * after the match is divided by a factor, so that it decreases the rank by a
      * smaller amount.
      */
-    retval = MAX (MIN_RANK, MAX_RANK - (gdouble) (ptr - prepared_string) - (gdouble) nonexact_malus / RANK_SCALE_FACTOR);
-    g_free (prepared_string);
+    return MAX (MIN_RANK, MAX_RANK - (gdouble) (ptr - compared_string) - (gdouble) nonexact_malus / RANK_SCALE_FACTOR);
+}
+
+const gchar * const *
+nautilus_query_matcher_get_words (NautilusQueryMatcher *matcher)
+{
+    return (const gchar * const *) matcher->words;
+}
+
+gchar *
+nautilus_query_prepare_string (const gchar *string)
+{
+    return prepare_string_for_compare (string);
+}
+
+/* Returns a reference to the matcher for the current text of @query. */
+NautilusQueryMatcher *
+nautilus_query_get_matcher (NautilusQuery *query)
+{
+    NautilusQueryMatcher *matcher;
+
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
 
-    return retval;
+    g_mutex_lock (&query->matcher_mutex);
+    if (query->matcher == NULL)
+    {
+        query->matcher = nautilus_query_matcher_new (query->text);
+    }
+    matcher = nautilus_query_matcher_ref (query->matcher);
+    g_mutex_unlock (&query->matcher_mutex);
+
+    return matcher;
+}
+
+gdouble
+nautilus_query_matches_string (NautilusQuery *query,
+                               const gchar   *string)
+{
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+
+    if (!query->text)
+    {
+        return -1;
+    }
+
+    matcher = nautilus_query_get_matcher (query);
+
+    return nautilus_query_matcher_match (matcher, string);
 }
 
 NautilusQuery *
@@ -437,10 +677,9 @@ nautilus_query_set_text (NautilusQuery *query,
     g_free (query->text);
     query->text = g_strstrip (g_strdup (text));
 
-    g_mutex_lock (&query->prepared_words_mutex);
-    g_strfreev (query->prepared_words);
-    query->prepared_words = NULL;
-    g_mutex_unlock (&query->prepared_words_mutex);
+    g_mutex_lock (&query->matcher_mutex);
+    g_clear_pointer (&query->matcher, nautilus_query_matcher_unref);
+    g_mutex_unlock (&query->matcher_mutex);
 
     g_object_notify (G_OBJECT (query), "text");
 }
@@ -560,6 +799,40 @@ nautilus_query_set_search_content (NautilusQuery              *query,
     }
 }
 
+GStrv
+nautilus_query_get_prune_patterns (NautilusQuery *query)
+{
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
+
+    return g_strdupv (query->prune_patterns);
+}
+
+void
+nautilus_query_set_prune_patterns (NautilusQuery      *query,
+                                   const char * const *patterns)
+{
+    g_return_if_fail (NAUTILUS_IS_QUERY (query));
+
+    if (patterns != NULL && patterns[0] == NULL)
+    {
+        patterns = NULL;
+    }
+
+    if (patterns == NULL && query->prune_patterns == NULL)
+    {
+        return;
+    }
+    if (patterns != NULL && query->prune_patterns != NULL &&
+        g_strv_equal (patterns, (const char * const *) query->prune_patterns))
+    {
+        return;
+    }
+
+    g_clear_pointer (&query->prune_patterns, g_strfreev);
+    query->prune_patterns = g_strdupv ((char **) patterns);
+    g_object_notify (G_OBJECT (query), "prune-patterns");
+}
+
 NautilusQuerySearchType
 nautilus_query_get_search_type (NautilusQuery *query)
 {
@@ -64,6 +64,12 @@ NautilusQuerySearchContent nautilus_query_get_search_content (NautilusQuery *que
 void                       nautilus_query_set_search_content (NautilusQuery              *query,
                                                               NautilusQuerySearchContent  content);
 
+/* The folders matching these patterns are not descended into, NULL if
+ * none are. They default to the ones of the settings. */
+GStrv          nautilus_query_get_prune_patterns (NautilusQuery      *query);
+void           nautilus_query_set_prune_patterns (NautilusQuery      *query,
+                                                  const char * const *patterns);
+
 NautilusQuerySearchType nautilus_query_get_search_type (NautilusQuery *query);
 void                    nautilus_query_set_search_type (NautilusQuery           *query,
                                                         NautilusQuerySearchType  type);
@@ -83,6 +89,25 @@ void           nautilus_query_set_searching      (NautilusQuery *query,
 
 gdouble        nautilus_query_matches_string     (NautilusQuery *query, const gchar *string);
 
+/* The words of the query, prepared once for matching. A matcher is
+ * immutable, so it can be used from several threads at once without
+ * locking, and it stays valid when the text of the query changes. */
+typedef struct _NautilusQueryMatcher NautilusQueryMatcher;
+
+NautilusQueryMatcher *nautilus_query_get_matcher    (NautilusQuery        *query);
+NautilusQueryMatcher *nautilus_query_matcher_ref    (NautilusQueryMatcher *matcher);
+void                  nautilus_query_matcher_unref  (NautilusQueryMatcher *matcher);
+/* Returns the rank of @string, or -1 if it doesn't match. */
+gdouble               nautilus_query_matcher_match  (NautilusQueryMatcher *matcher,
+                                                     const gchar          *string);
+/* The prepared words, NULL if the query has no text */
+const gchar * const  *nautilus_query_matcher_get_words (NautilusQueryMatcher *matcher);
+/* Prepares a string the way the words of a matcher are prepared, so that
+ * the words are substrings of it if it matches. */
+gchar                *nautilus_query_prepare_string (const gchar *string);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusQueryMatcher, nautilus_query_matcher_unref)
+
 char *         nautilus_query_to_readable_string (NautilusQuery *query);
 
 gboolean       nautilus_query_is_empty           (NautilusQuery *query);
@@ -34,6 +34,7 @@
 #include "nautilus-search-engine-model.h"
 #include "nautilus-search-engine.h"
 #include "nautilus-search-provider.h"
+#include "nautilus-vfs-file.h"
 
 struct _NautilusSearchDirectory
 {
@@ -60,8 +61,14 @@ struct _NautilusSearchDirectory
      * scheduled timeouts. */
     gboolean search_ready_and_valid;
 
+    /* For learning how long the searches of the location take */
+    gint64 search_start_time;
+    gboolean got_first_hits;
+
     GList *files;
     GHashTable *files_hash;
+    /* The directories of the files -> their "files-changed" handler */
+    GHashTable *file_directories;
 
     GList *monitor_list;
     GList *callback_list;
@@ -116,6 +123,12 @@ G_DEFINE_TYPE_WITH_CODE (NautilusSearchDirectory, nautilus_search_directory, NAU
 
 static GParamSpec *properties[NUM_PROPERTIES] = { NULL, };
 
+/* Location URI -> how long its last searches took to give back their first
+ * hits, or to find none, in milliseconds */
+static GHashTable *first_hit_delays = NULL;
+
+#define FIRST_HIT_DELAYS_MAX 64
+
 static void search_engine_hits_added (NautilusSearchEngine    *engine,
                                       GList                   *hits,
                                       NautilusSearchDirectory *self);
@@ -126,6 +139,8 @@ static void search_callback_file_ready_callback (NautilusFile *file,
                                                  gpointer      data);
 static void file_changed (NautilusFile            *file,
                           NautilusSearchDirectory *self);
+static void monitor_remove_files (GList         *files,
+                                  SearchMonitor *monitor);
 
 static void
 reset_file_list (NautilusSearchDirectory *self)
@@ -133,24 +148,35 @@ reset_file_list (NautilusSearchDirectory *self)
     GList *list, *monitor_list;
     NautilusFile *file;
     SearchMonitor *monitor;
+    GHashTableIter iter;
+    gpointer directory, handler_id;
 
     /* Remove file connections */
     for (list = self->files; list != NULL; list = list->next)
     {
         file = list->data;
 
-        /* Disconnect change handler */
-        g_signal_handlers_disconnect_by_func (file, file_changed, self);
-
-        /* Remove monitors */
-        for (monitor_list = self->monitor_list; monitor_list;
-             monitor_list = monitor_list->next)
+        if (nautilus_file_is_self_owned (file))
         {
-            monitor = monitor_list->data;
-            nautilus_file_monitor_remove (file, monitor);
+            g_signal_handlers_disconnect_by_func (file, file_changed, self);
         }
     }
 
+    g_hash_table_iter_init (&iter, self->file_directories);
+    while (g_hash_table_iter_next (&iter, &directory, &handler_id))
+    {
+        g_signal_handler_disconnect (directory, GPOINTER_TO_SIZE (handler_id));
+    }
+    g_hash_table_remove_all (self->file_directories);
+
+    /* Remove monitors */
+    for (monitor_list = self->monitor_list; monitor_list;
+         monitor_list = monitor_list->next)
+    {
+        monitor = monitor_list->data;
+        monitor_remove_files (self->files, monitor);
+    }
+
     nautilus_file_list_free (self->files);
     self->files = NULL;
 
@@ -178,6 +204,38 @@ set_hidden_files (NautilusSearchDirectory *self)
     nautilus_query_set_show_hidden_files (self->query, monitor_hidden);
 }
 
+static void
+learn_first_hit_delay (NautilusSearchDirectory *self)
+{
+    g_autoptr (GFile) location = NULL;
+    g_autofree char *uri = NULL;
+    gpointer previous;
+    guint delay;
+
+    self->got_first_hits = TRUE;
+
+    if (first_hit_delays == NULL)
+    {
+        first_hit_delays = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+    else if (g_hash_table_size (first_hit_delays) >= FIRST_HIT_DELAYS_MAX)
+    {
+        g_hash_table_remove_all (first_hit_delays);
+    }
+
+    location = nautilus_query_get_location (self->query);
+    uri = g_file_get_uri (location);
+    delay = (g_get_monotonic_time () - self->search_start_time) / 1000;
+
+    /* Averaged, for a single slow search not to slow down the next ones */
+    if (g_hash_table_lookup_extended (first_hit_delays, uri, NULL, &previous))
+    {
+        delay = (3 * GPOINTER_TO_UINT (previous) + delay) / 4;
+    }
+
+    g_hash_table_insert (first_hit_delays, g_steal_pointer (&uri), GUINT_TO_POINTER (delay));
+}
+
 static void
 start_search (NautilusSearchDirectory *self)
 {
@@ -201,6 +259,8 @@ start_search (NautilusSearchDirectory *self)
     /* We need to start the search engine */
     self->search_running = TRUE;
     self->search_ready_and_valid = FALSE;
+    self->search_start_time = g_get_monotonic_time ();
+    self->got_first_hits = FALSE;
 
     set_hidden_files (self);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (self->engine),
@@ -240,6 +300,109 @@ file_changed (NautilusFile            *file,
     nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (self), &list);
 }
 
+static void
+directory_files_changed (NautilusDirectory       *directory,
+                         GList                   *files,
+                         NautilusSearchDirectory *self)
+{
+    g_autoptr (GList) changed_files = NULL;
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        if (g_hash_table_contains (self->files_hash, l->data))
+        {
+            changed_files = g_list_prepend (changed_files, l->data);
+        }
+    }
+
+    if (changed_files != NULL)
+    {
+        nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (self), changed_files);
+    }
+}
+
+/* Files that are their own directory, and the files whose class handles
+ * monitors in its own way, are returned in @other_files. */
+static GHashTable *
+group_files_by_directory (GList  *files,
+                          GList **other_files)
+{
+    GHashTable *directories;
+    NautilusFile *file;
+    GList *directory_files;
+
+    directories = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_list_free);
+    *other_files = NULL;
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        file = l->data;
+
+        if (!NAUTILUS_IS_VFS_FILE (file) || nautilus_file_is_self_owned (file))
+        {
+            *other_files = g_list_prepend (*other_files, file);
+            continue;
+        }
+
+        directory_files = g_hash_table_lookup (directories, file->details->directory);
+        g_hash_table_insert (directories, file->details->directory,
+                             g_list_prepend (directory_files, file));
+    }
+
+    return directories;
+}
+
+/* The monitors of the files of a directory are added at once, so that
+ * the directory only starts its I/O once for them. */
+static void
+monitor_add_files (GList         *files,
+                   SearchMonitor *monitor)
+{
+    g_autoptr (GHashTable) directories = NULL;
+    g_autoptr (GList) other_files = NULL;
+    GHashTableIter iter;
+    gpointer directory, directory_files;
+
+    directories = group_files_by_directory (files, &other_files);
+
+    g_hash_table_iter_init (&iter, directories);
+    while (g_hash_table_iter_next (&iter, &directory, &directory_files))
+    {
+        /* As nautilus_file_monitor_add() does for these files */
+        nautilus_directory_monitor_add_files_internal (directory, directory_files,
+                                                       monitor, TRUE,
+                                                       monitor->monitor_attributes);
+    }
+
+    for (GList *l = other_files; l != NULL; l = l->next)
+    {
+        nautilus_file_monitor_add (l->data, monitor, monitor->monitor_attributes);
+    }
+}
+
+static void
+monitor_remove_files (GList         *files,
+                      SearchMonitor *monitor)
+{
+    g_autoptr (GHashTable) directories = NULL;
+    g_autoptr (GList) other_files = NULL;
+    GHashTableIter iter;
+    gpointer directory, directory_files;
+
+    directories = group_files_by_directory (files, &other_files);
+
+    g_hash_table_iter_init (&iter, directories);
+    while (g_hash_table_iter_next (&iter, &directory, &directory_files))
+    {
+        nautilus_directory_monitor_remove_files_internal (directory, directory_files, monitor);
+    }
+
+    for (GList *l = other_files; l != NULL; l = l->next)
+    {
+        nautilus_file_monitor_remove (l->data, monitor);
+    }
+}
+
 static void
 search_monitor_add (NautilusDirectory         *directory,
                     gconstpointer              client,
@@ -248,10 +411,8 @@ search_monitor_add (NautilusDirectory         *directory,
                     NautilusDirectoryCallback  callback,
                     gpointer                   callback_data)
 {
-    GList *list;
     SearchMonitor *monitor;
     NautilusSearchDirectory *self;
-    NautilusFile *file;
 
     self = NAUTILUS_SEARCH_DIRECTORY (directory);
 
@@ -267,13 +428,7 @@ search_monitor_add (NautilusDirectory         *directory,
         (*callback)(directory, self->files, callback_data);
     }
 
-    for (list = self->files; list != NULL; list = list->next)
-    {
-        file = list->data;
-
-        /* Add monitors */
-        nautilus_file_monitor_add (file, monitor, file_attributes);
-    }
+    monitor_add_files (self->files, monitor);
 
     start_search (self);
 }
@@ -282,15 +437,7 @@ static void
 search_monitor_remove_file_monitors (SearchMonitor           *monitor,
                                      NautilusSearchDirectory *self)
 {
-    GList *list;
-    NautilusFile *file;
-
-    for (list = self->files; list != NULL; list = list->next)
-    {
-        file = list->data;
-
-        nautilus_file_monitor_remove (file, monitor);
-    }
+    monitor_remove_files (self->files, monitor);
 }
 
 static void
@@ -606,41 +753,59 @@ search_engine_hits_added (NautilusSearchEngine    *engine,
                           GList                   *hits,
                           NautilusSearchDirectory *self)
 {
-    GList *hit_list;
+    GList *hit_list, *l;
     GList *file_list;
+    g_autoptr (GList) uris = NULL;
     NautilusFile *file;
-    SearchMonitor *monitor;
+    NautilusDirectory *directory;
     GList *monitor_list;
+    gulong handler_id;
+
+    if (!self->got_first_hits && hits != NULL)
+    {
+        learn_first_hit_delay (self);
+    }
 
-    file_list = NULL;
+    nautilus_search_hit_compute_scores_for_hits (hits, self->query);
 
     for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
     {
-        NautilusSearchHit *hit = hit_list->data;
-        const char *uri;
-
-        uri = nautilus_search_hit_get_uri (hit);
+        uris = g_list_prepend (uris, (gpointer) nautilus_search_hit_get_uri (hit_list->data));
+    }
+    uris = g_list_reverse (uris);
+    file_list = nautilus_file_list_get_by_uris (uris);
 
-        nautilus_search_hit_compute_scores (hit, self->query);
+    for (hit_list = hits, l = file_list; hit_list != NULL; hit_list = hit_list->next, l = l->next)
+    {
+        NautilusSearchHit *hit = hit_list->data;
 
-        file = nautilus_file_get_by_uri (uri);
+        file = l->data;
         nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
         nautilus_file_set_search_fts_snippet (file, nautilus_search_hit_get_fts_snippet (hit));
 
-        for (monitor_list = self->monitor_list; monitor_list; monitor_list = monitor_list->next)
+        /* Changes are followed through the directories of the files,
+         * which don't report the changes of the files they are. */
+        directory = file->details->directory;
+        if (nautilus_file_is_self_owned (file))
         {
-            monitor = monitor_list->data;
-
-            /* Add monitors */
-            nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+            g_signal_connect (file, "changed", G_CALLBACK (file_changed), self);
+        }
+        else if (!g_hash_table_contains (self->file_directories, directory))
+        {
+            handler_id = g_signal_connect (directory, "files-changed",
+                                           G_CALLBACK (directory_files_changed), self);
+            g_hash_table_insert (self->file_directories, nautilus_directory_ref (directory),
+                                 GSIZE_TO_POINTER (handler_id));
         }
 
-        g_signal_connect (file, "changed", G_CALLBACK (file_changed), self),
-
-        file_list = g_list_prepend (file_list, file);
         g_hash_table_add (self->files_hash, file);
     }
 
+    for (monitor_list = self->monitor_list; monitor_list; monitor_list = monitor_list->next)
+    {
+        monitor_add_files (file_list, monitor_list->data);
+    }
+
     self->files = g_list_concat (self->files, file_list);
 
     nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), file_list);
@@ -681,6 +846,10 @@ search_engine_finished (NautilusSearchEngine         *engine,
      * happening. */
     if (status == NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL)
     {
+        if (!self->got_first_hits)
+        {
+            learn_first_hit_delay (self);
+        }
         on_search_directory_search_ready_and_valid (self);
         nautilus_directory_emit_done_loading (NAUTILUS_DIRECTORY (self));
     }
@@ -921,6 +1090,7 @@ search_finalize (GObject *object)
     self = NAUTILUS_SEARCH_DIRECTORY (object);
 
     g_hash_table_destroy (self->files_hash);
+    g_hash_table_destroy (self->file_directories);
 
     G_OBJECT_CLASS (nautilus_search_directory_parent_class)->finalize (object);
 }
@@ -930,6 +1100,9 @@ nautilus_search_directory_init (NautilusSearchDirectory *self)
 {
     self->query = NULL;
     self->files_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
+    self->file_directories = g_hash_table_new_full (NULL, NULL,
+                                                    (GDestroyNotify) nautilus_directory_unref,
+                                                    NULL);
 
     self->engine = nautilus_search_engine_new ();
     search_connect_engine (self);
@@ -1078,3 +1251,18 @@ nautilus_search_directory_get_query (NautilusSearchDirectory *self)
 
     return NULL;
 }
+
+guint
+nautilus_search_directory_get_first_hit_delay (GFile *location)
+{
+    g_autofree char *uri = NULL;
+
+    if (first_hit_delays == NULL)
+    {
+        return 0;
+    }
+
+    uri = g_file_get_uri (location);
+
+    return GPOINTER_TO_UINT (g_hash_table_lookup (first_hit_delays, uri));
+}
@@ -37,6 +37,10 @@ NautilusQuery *nautilus_search_directory_get_query       (NautilusSearchDirector
 void           nautilus_search_directory_set_query       (NautilusSearchDirectory *self,
 							  NautilusQuery           *query);
 
+/* How long the last searches of @location took to give back their first
+ * hits, in milliseconds, or 0 when it isn't known yet. */
+guint          nautilus_search_directory_get_first_hit_delay (GFile *location);
+
 NautilusDirectory *
                nautilus_search_directory_get_base_model (NautilusSearchDirectory  *self);
 void           nautilus_search_directory_set_base_model (NautilusSearchDirectory  *self,
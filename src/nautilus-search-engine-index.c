@@ -0,0 +1,246 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-engine-index.h"
+
+#include "nautilus-filename-index.h"
+#include "nautilus-search-hit.h"
+#include "nautilus-search-provider.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+struct _NautilusSearchEngineIndex
+{
+    GObject parent_instance;
+
+    NautilusQuery *query;
+    NautilusFilenameIndex *index;
+    gboolean running;
+    GCancellable *cancellable;
+};
+
+static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineIndex,
+                         nautilus_search_engine_index,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_SEARCH_PROVIDER,
+                                                nautilus_search_provider_init))
+
+enum
+{
+    PROP_0,
+    PROP_RUNNING,
+    LAST_PROP
+};
+
+typedef struct
+{
+    NautilusSearchEngineIndex *engine;
+    NautilusFilenameIndex *index;
+    NautilusQuery *query;
+    GCancellable *cancellable;
+    GList *hits;
+} SearchData;
+
+NautilusSearchEngineIndex *
+nautilus_search_engine_index_new (void)
+{
+    return g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_INDEX, NULL);
+}
+
+static void
+nautilus_search_engine_index_finalize (GObject *object)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+
+    g_cancellable_cancel (self->cancellable);
+
+    g_clear_object (&self->query);
+    g_clear_object (&self->cancellable);
+    g_clear_pointer (&self->index, nautilus_filename_index_unref);
+
+    G_OBJECT_CLASS (nautilus_search_engine_index_parent_class)->finalize (object);
+}
+
+static void
+search_data_free (SearchData *data)
+{
+    g_object_unref (data->engine);
+    nautilus_filename_index_unref (data->index);
+    g_object_unref (data->query);
+    g_object_unref (data->cancellable);
+    g_list_free_full (data->hits, g_object_unref);
+    g_free (data);
+}
+
+static gboolean
+search_thread_add_hits_idle (gpointer user_data)
+{
+    SearchData *data = user_data;
+    NautilusSearchEngineIndex *self = data->engine;
+    NautilusSearchProvider *provider = NAUTILUS_SEARCH_PROVIDER (self);
+
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        DEBUG ("Index engine add hits");
+        nautilus_search_provider_hits_added (provider, data->hits);
+    }
+
+    self->running = FALSE;
+    g_clear_object (&self->cancellable);
+
+    nautilus_search_provider_finished (provider,
+                                       NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+    g_object_notify (G_OBJECT (provider), "running");
+
+    search_data_free (data);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer
+search_thread_func (gpointer user_data)
+{
+    SearchData *data = user_data;
+
+    data->hits = nautilus_filename_index_search (data->index, data->query,
+                                                 data->cancellable);
+
+    /* The data keeps the engine alive until then. */
+    g_idle_add (search_thread_add_hits_idle, data);
+
+    return NULL;
+}
+
+gboolean
+nautilus_search_engine_index_can_search (NautilusSearchEngineIndex *self)
+{
+    g_return_val_if_fail (NAUTILUS_IS_SEARCH_ENGINE_INDEX (self), FALSE);
+    g_return_val_if_fail (self->query != NULL, FALSE);
+
+    g_clear_pointer (&self->index, nautilus_filename_index_unref);
+    self->index = nautilus_filename_index_lookup (self->query);
+
+    return self->index != NULL;
+}
+
+static void
+nautilus_search_engine_index_start (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+    g_autoptr (GThread) thread = NULL;
+    SearchData *data;
+
+    g_return_if_fail (self->index != NULL);
+    g_return_if_fail (self->cancellable == NULL);
+
+    DEBUG ("Index engine start");
+
+    self->running = TRUE;
+    self->cancellable = g_cancellable_new ();
+
+    data = g_new0 (SearchData, 1);
+    data->engine = g_object_ref (self);
+    data->index = g_steal_pointer (&self->index);
+    data->query = g_object_ref (self->query);
+    data->cancellable = g_object_ref (self->cancellable);
+
+    thread = g_thread_new ("nautilus-search-index", search_thread_func, data);
+
+    g_object_notify (G_OBJECT (provider), "running");
+}
+
+static void
+nautilus_search_engine_index_stop (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    if (self->cancellable != NULL)
+    {
+        DEBUG ("Index engine stop");
+        g_cancellable_cancel (self->cancellable);
+    }
+}
+
+static void
+nautilus_search_engine_index_set_query (NautilusSearchProvider *provider,
+                                        NautilusQuery          *query)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    g_clear_object (&self->query);
+    self->query = g_object_ref (query);
+}
+
+static gboolean
+nautilus_search_engine_index_is_running (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    return self->running;
+}
+
+static void
+nautilus_search_engine_index_get_property (GObject    *object,
+                                           guint       prop_id,
+                                           GValue     *value,
+                                           GParamSpec *pspec)
+{
+    NautilusSearchProvider *provider = NAUTILUS_SEARCH_PROVIDER (object);
+
+    switch (prop_id)
+    {
+        case PROP_RUNNING:
+        {
+            g_value_set_boolean (value, nautilus_search_engine_index_is_running (provider));
+        }
+        break;
+
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+nautilus_search_provider_init (NautilusSearchProviderInterface *iface)
+{
+    iface->set_query = nautilus_search_engine_index_set_query;
+    iface->start = nautilus_search_engine_index_start;
+    iface->stop = nautilus_search_engine_index_stop;
+    iface->is_running = nautilus_search_engine_index_is_running;
+}
+
+static void
+nautilus_search_engine_index_class_init (NautilusSearchEngineIndexClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = nautilus_search_engine_index_finalize;
+    object_class->get_property = nautilus_search_engine_index_get_property;
+
+    g_object_class_override_property (object_class, PROP_RUNNING, "running");
+}
+
+static void
+nautilus_search_engine_index_init (NautilusSearchEngineIndex *self)
+{
+}
@@ -0,0 +1,33 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define NAUTILUS_TYPE_SEARCH_ENGINE_INDEX (nautilus_search_engine_index_get_type ())
+
+G_DECLARE_FINAL_TYPE (NautilusSearchEngineIndex, nautilus_search_engine_index, NAUTILUS, SEARCH_ENGINE_INDEX, GObject);
+
+NautilusSearchEngineIndex *nautilus_search_engine_index_new        (void);
+/* Whether a filename index can answer the current query, in place of
+ * crawling the location with the simple engine. */
+gboolean                   nautilus_search_engine_index_can_search (NautilusSearchEngineIndex *self);
+
+G_END_DECLS
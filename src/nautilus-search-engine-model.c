@@ -25,7 +25,9 @@
 #include "nautilus-search-engine-model.h"
 #include "nautilus-directory.h"
 #include "nautilus-directory-private.h"
+#include "nautilus-executor.h"
 #include "nautilus-file.h"
+#include "nautilus-file-snapshot.h"
 #include "nautilus-ui-utilities.h"
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
 #include "nautilus-debug.h"
@@ -34,14 +36,17 @@
 #include <glib.h>
 #include <gio/gio.h>
 
+typedef struct ModelSearch ModelSearch;
+
 struct _NautilusSearchEngineModel
 {
     GObject parent;
 
     NautilusQuery *query;
 
-    GList *hits;
     NautilusDirectory *directory;
+    /* The search being filtered in a thread, if any */
+    ModelSearch *search;
 
     gboolean query_pending;
     guint finished_id;
@@ -69,12 +74,6 @@ finalize (GObject *object)
 
     model = NAUTILUS_SEARCH_ENGINE_MODEL (object);
 
-    if (model->hits != NULL)
-    {
-        g_list_free_full (model->hits, g_object_unref);
-        model->hits = NULL;
-    }
-
     if (model->finished_id != 0)
     {
         g_source_remove (model->finished_id);
@@ -87,20 +86,46 @@ finalize (GObject *object)
     G_OBJECT_CLASS (nautilus_search_engine_model_parent_class)->finalize (object);
 }
 
+/* The files matched in a thread at once */
+#define CHUNK_SIZE 5000
+
+typedef struct
+{
+    guint index;
+    gdouble rank;
+} ModelMatch;
+
+struct ModelSearch
+{
+    GCancellable *cancellable;
+    NautilusQueryMatcher *matcher;
+    GPtrArray *mime_types;
+    GPtrArray *date_range;
+    NautilusQuerySearchType search_type;
+
+    /* Of NautilusFileSnapshot, as NautilusFile is not thread safe */
+    GPtrArray *entries;
+    guint next_entry;   /* first entry of the next chunk */
+    GArray *matches;    /* of ModelMatch, set by the thread for a chunk */
+};
+
+static void
+model_search_free (ModelSearch *search)
+{
+    g_object_unref (search->cancellable);
+    nautilus_query_matcher_unref (search->matcher);
+    g_ptr_array_unref (search->mime_types);
+    g_clear_pointer (&search->date_range, g_ptr_array_unref);
+    g_ptr_array_unref (search->entries);
+    g_array_unref (search->matches);
+    g_free (search);
+}
+
 static gboolean
 search_finished (NautilusSearchEngineModel *model)
 {
     model->finished_id = 0;
 
-    if (model->hits != NULL)
-    {
-        DEBUG ("Model engine hits added");
-        nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (model),
-                                             model->hits);
-        g_list_free_full (model->hits, g_object_unref);
-        model->hits = NULL;
-    }
-
     model->query_pending = FALSE;
 
     g_object_notify (G_OBJECT (model), "running");
@@ -124,93 +149,177 @@ search_finished_idle (NautilusSearchEngineModel *model)
     model->finished_id = g_idle_add ((GSourceFunc) search_finished, model);
 }
 
-static void
-model_directory_ready_cb (NautilusDirectory *directory,
-                          GList             *list,
-                          gpointer           user_data)
+static gboolean
+entry_matches (ModelSearch          *search,
+               NautilusFileSnapshot *entry,
+               gdouble              *rank)
 {
-    NautilusSearchEngineModel *model = user_data;
-    g_autoptr (GPtrArray) mime_types = NULL;
-    gchar *uri, *display_name;
-    GList *files, *hits, *l;
-    NautilusFile *file;
-    gdouble match;
     gboolean found;
-    NautilusSearchHit *hit;
-    GDateTime *initial_date;
-    GDateTime *end_date;
-    GPtrArray *date_range;
-
-    files = nautilus_directory_get_file_list (directory);
-    mime_types = nautilus_query_get_mime_types (model->query);
-    hits = NULL;
 
-    for (l = files; l != NULL; l = l->next)
+    *rank = nautilus_query_matcher_match (search->matcher, entry->display_name);
+    if (*rank <= -1)
     {
-        file = l->data;
+        return FALSE;
+    }
 
-        display_name = nautilus_file_get_display_name (file);
-        match = nautilus_query_matches_string (model->query, display_name);
-        found = (match > -1);
+    if (search->mime_types->len > 0)
+    {
+        found = FALSE;
 
-        if (found && mime_types->len > 0)
+        for (guint i = 0; i < search->mime_types->len; i++)
         {
-            found = FALSE;
-
-            for (gint i = 0; i < mime_types->len; i++)
+            if (g_content_type_is_a (entry->mime_type, g_ptr_array_index (search->mime_types, i)))
             {
-                if (nautilus_file_is_mime_type (file, g_ptr_array_index (mime_types, i)))
-                {
-                    found = TRUE;
-                    break;
-                }
+                found = TRUE;
+                break;
             }
         }
 
-        date_range = nautilus_query_get_date_range (model->query);
-        if (found && date_range != NULL)
+        if (!found)
         {
-            NautilusQuerySearchType type;
-            guint64 current_file_unix_time;
+            return FALSE;
+        }
+    }
+
+    if (search->date_range != NULL)
+    {
+        time_t time = search->search_type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS ?
+                      entry->atime : entry->mtime;
 
-            type = nautilus_query_get_search_type (model->query);
-            initial_date = g_ptr_array_index (date_range, 0);
-            end_date = g_ptr_array_index (date_range, 1);
+        return nautilus_file_date_in_between (time,
+                                              g_ptr_array_index (search->date_range, 0),
+                                              g_ptr_array_index (search->date_range, 1));
+    }
 
-            if (type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS)
-            {
-                current_file_unix_time = nautilus_file_get_atime (file);
-            }
-            else
-            {
-                current_file_unix_time = nautilus_file_get_mtime (file);
-            }
+    return TRUE;
+}
 
-            found = nautilus_file_date_in_between (current_file_unix_time,
-                                                   initial_date,
-                                                   end_date);
-            g_ptr_array_unref (date_range);
-        }
+static void
+filter_chunk_thread (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+    ModelSearch *search = task_data;
+    guint end;
 
-        if (found)
-        {
-            uri = nautilus_file_get_uri (file);
-            hit = nautilus_search_hit_new (uri);
-            nautilus_search_hit_set_fts_rank (hit, match);
-            hits = g_list_prepend (hits, hit);
+    end = MIN (search->next_entry + CHUNK_SIZE, search->entries->len);
+    for (guint i = search->next_entry; i < end; i++)
+    {
+        ModelMatch match;
 
-            g_free (uri);
+        if (entry_matches (search, g_ptr_array_index (search->entries, i), &match.rank))
+        {
+            match.index = i;
+            g_array_append_val (search->matches, match);
         }
+    }
+    search->next_entry = end;
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void filter_chunk_callback (GObject      *object,
+                                   GAsyncResult *result,
+                                   gpointer      user_data);
+
+static void
+filter_next_chunk (NautilusSearchEngineModel *model,
+                   ModelSearch               *search)
+{
+    g_autoptr (GTask) task = NULL;
+
+    task = g_task_new (model, search->cancellable, filter_chunk_callback, search);
+    g_task_set_task_data (task, search, NULL);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_SEARCH, task, filter_chunk_thread);
+}
+
+static void
+filter_chunk_callback (GObject      *object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+    NautilusSearchEngineModel *model;
+    ModelSearch *search;
+    GList *hits;
+
+    model = NAUTILUS_SEARCH_ENGINE_MODEL (object);
+    search = user_data;
+
+    /* The search was stopped, which took care of finishing it. */
+    if (g_cancellable_is_cancelled (search->cancellable))
+    {
+        model_search_free (search);
+        return;
+    }
 
-        g_free (display_name);
+    hits = NULL;
+    for (guint i = 0; i < search->matches->len; i++)
+    {
+        ModelMatch *match = &g_array_index (search->matches, ModelMatch, i);
+        NautilusFileSnapshot *entry = g_ptr_array_index (search->entries, match->index);
+        g_autofree gchar *uri = NULL;
+        NautilusSearchHit *hit;
+
+        uri = nautilus_file_snapshot_get_uri (entry);
+        hit = nautilus_search_hit_new (uri);
+        nautilus_search_hit_set_fts_rank (hit, match->rank);
+        hits = g_list_prepend (hits, hit);
     }
+    g_array_set_size (search->matches, 0);
 
-    nautilus_file_list_free (files);
-    model->hits = hits;
+    if (hits != NULL)
+    {
+        DEBUG ("Model engine hits added");
+        nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (model), hits);
+        g_list_free_full (hits, g_object_unref);
+    }
+
+    if (search->next_entry < search->entries->len)
+    {
+        filter_next_chunk (model, search);
+        return;
+    }
 
+    model->search = NULL;
+    model_search_free (search);
     search_finished (model);
 }
 
+static void
+model_directory_ready_cb (NautilusDirectory *directory,
+                          GList             *list,
+                          gpointer           user_data)
+{
+    NautilusSearchEngineModel *model = user_data;
+    ModelSearch *search;
+    GList *files;
+
+    search = g_new0 (ModelSearch, 1);
+    search->cancellable = g_cancellable_new ();
+    search->matcher = nautilus_query_get_matcher (model->query);
+    search->mime_types = nautilus_query_get_mime_types (model->query);
+    search->date_range = nautilus_query_get_date_range (model->query);
+    search->matches = g_array_new (FALSE, FALSE, sizeof (ModelMatch));
+    search->search_type = nautilus_query_get_search_type (model->query);
+
+    /* The files are matched in a thread, not to freeze the view when
+     * searching big folders. */
+    files = nautilus_directory_get_file_list (directory);
+    search->entries = nautilus_file_snapshot_list_new (files);
+    nautilus_file_list_free (files);
+
+    if (search->entries->len == 0)
+    {
+        model_search_free (search);
+        search_finished (model);
+        return;
+    }
+
+    model->search = search;
+    filter_next_chunk (model, search);
+}
+
 static void
 nautilus_search_engine_model_start (NautilusSearchProvider *provider)
 {
@@ -254,6 +363,12 @@ nautilus_search_engine_model_stop (NautilusSearchProvider *provider)
 
         nautilus_directory_cancel_callback (model->directory,
                                             model_directory_ready_cb, model);
+        /* The thread frees the search once it is done with it. */
+        if (model->search != NULL)
+        {
+            g_cancellable_cancel (model->search->cancellable);
+            model->search = NULL;
+        }
         search_finished_idle (model);
     }
 
@@ -44,8 +44,30 @@ struct _NautilusSearchEngineRecent
     GCancellable *cancellable;
     GtkRecentManager *recent_manager;
     guint add_hits_idle_id;
+
+    /* RecentItem of the recent manager, NULL until the first search. A
+     * new array replaces it when the items change, as running searches
+     * use it without locking. */
+    GPtrArray *items;
+    gboolean items_changed;
+    gulong changed_id;
 };
 
+/* What searches need of a recent item. The item is read in the main
+ * thread, as GtkRecentManager is not thread safe, and shared between the
+ * arrays of items as long as it doesn't change. */
+typedef struct
+{
+    char *uri;
+    GFile *file;
+    char *display_name;
+    char *short_name;
+    char *mime_type;
+    time_t modified;
+    time_t visited;
+    gboolean is_local;
+} RecentItem;
+
 static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineRecent,
@@ -74,8 +96,11 @@ nautilus_search_engine_recent_finalize (GObject *object)
     NautilusSearchEngineRecent *self = NAUTILUS_SEARCH_ENGINE_RECENT (object);
 
     g_clear_handle_id (&self->add_hits_idle_id, g_source_remove);
+    g_clear_signal_handler (&self->changed_id, self->recent_manager);
     g_cancellable_cancel (self->cancellable);
 
+    g_clear_pointer (&self->items, g_ptr_array_unref);
+
     g_clear_object (&self->query);
     g_clear_object (&self->cancellable);
 
@@ -88,6 +113,106 @@ typedef struct
     GList *hits;
 } SearchHitsData;
 
+typedef struct
+{
+    NautilusSearchEngineRecent *recent;
+    GPtrArray *items;
+} SearchThreadData;
+
+static void
+recent_item_clear (RecentItem *item)
+{
+    g_free (item->uri);
+    g_object_unref (item->file);
+    g_free (item->display_name);
+    g_free (item->short_name);
+    g_free (item->mime_type);
+}
+
+static void
+recent_item_unref (RecentItem *item)
+{
+    g_atomic_rc_box_release_full (item, (GDestroyNotify) recent_item_clear);
+}
+
+static RecentItem *
+recent_item_new (GtkRecentInfo *info)
+{
+    RecentItem *item;
+
+    item = g_atomic_rc_box_new0 (RecentItem);
+    item->uri = g_strdup (gtk_recent_info_get_uri (info));
+    item->file = g_file_new_for_uri (item->uri);
+    item->display_name = g_strdup (gtk_recent_info_get_display_name (info));
+    item->short_name = gtk_recent_info_get_short_name (info);
+    item->mime_type = g_strdup (gtk_recent_info_get_mime_type (info));
+    item->modified = gtk_recent_info_get_modified (info);
+    item->visited = gtk_recent_info_get_visited (info);
+    item->is_local = gtk_recent_info_is_local (info);
+
+    return item;
+}
+
+static void
+recent_manager_changed (GtkRecentManager           *recent_manager,
+                        NautilusSearchEngineRecent *self)
+{
+    self->items_changed = TRUE;
+}
+
+/* Returns a reference to the items, updated if needed. The items that
+ * didn't change since the last update are kept. */
+static GPtrArray *
+get_items (NautilusSearchEngineRecent *self)
+{
+    g_autoptr (GHashTable) previous_items = NULL;
+    GList *recent_items;
+    GPtrArray *items;
+
+    if (self->items != NULL && !self->items_changed)
+    {
+        return g_ptr_array_ref (self->items);
+    }
+
+    previous_items = g_hash_table_new (g_str_hash, g_str_equal);
+    for (guint i = 0; self->items != NULL && i < self->items->len; i++)
+    {
+        RecentItem *item = g_ptr_array_index (self->items, i);
+
+        g_hash_table_insert (previous_items, item->uri, item);
+    }
+
+    recent_items = gtk_recent_manager_get_items (self->recent_manager);
+    items = g_ptr_array_new_full (g_list_length (recent_items),
+                                  (GDestroyNotify) recent_item_unref);
+    for (GList *l = recent_items; l != NULL; l = l->next)
+    {
+        GtkRecentInfo *info = l->data;
+        RecentItem *item;
+
+        item = g_hash_table_lookup (previous_items, gtk_recent_info_get_uri (info));
+        if (item != NULL &&
+            item->modified == gtk_recent_info_get_modified (info) &&
+            item->visited == gtk_recent_info_get_visited (info))
+        {
+            g_ptr_array_add (items, g_atomic_rc_box_acquire (item));
+        }
+        else
+        {
+            g_ptr_array_add (items, recent_item_new (info));
+        }
+    }
+    g_list_free_full (recent_items, (GDestroyNotify) gtk_recent_info_unref);
+
+    DEBUG ("Recent engine loaded %u items", items->len);
+
+    g_clear_pointer (&self->items, g_ptr_array_unref);
+    self->items = items;
+    self->items_changed = FALSE;
+
+    return g_ptr_array_ref (items);
+}
+
 
 static gboolean
 search_thread_add_hits_idle (gpointer user_data)
@@ -183,34 +308,32 @@ is_file_valid_recursive (NautilusSearchEngineRecent  *self,
 static gpointer
 recent_thread_func (gpointer user_data)
 {
-    g_autoptr (NautilusSearchEngineRecent) self = NAUTILUS_SEARCH_ENGINE_RECENT (user_data);
+    SearchThreadData *data = user_data;
+    g_autoptr (NautilusSearchEngineRecent) self = data->recent;
+    g_autoptr (GPtrArray) items = data->items;
     g_autoptr (GPtrArray) date_range = NULL;
     g_autoptr (GFile) query_location = NULL;
     g_autoptr (GPtrArray) mime_types = NULL;
-    GList *recent_items;
     GList *hits;
-    GList *l;
+
+    g_free (data);
 
     g_return_val_if_fail (self->query, NULL);
 
     hits = NULL;
-    recent_items = gtk_recent_manager_get_items (self->recent_manager);
     mime_types = nautilus_query_get_mime_types (self->query);
     date_range = nautilus_query_get_date_range (self->query);
     query_location = nautilus_query_get_location (self->query);
 
-    for (l = recent_items; l != NULL; l = l->next)
+    for (guint i = 0; i < items->len; i++)
     {
-        GtkRecentInfo *info = l->data;
-        g_autoptr (GFile) file = NULL;
-        const gchar *uri;
-        const gchar *name;
+        RecentItem *item = g_ptr_array_index (items, i);
+        NautilusSearchHit *hit;
+        g_autoptr (GDateTime) gmodified = NULL;
+        g_autoptr (GDateTime) gvisited = NULL;
         gdouble rank;
 
-        uri = gtk_recent_info_get_uri (info);
-        file = g_file_new_for_uri (uri);
-
-        if (!g_file_has_prefix (file, query_location))
+        if (!g_file_has_prefix (item->file, query_location))
         {
             continue;
         }
@@ -220,103 +343,93 @@ recent_thread_func (gpointer user_data)
             break;
         }
 
-        name = gtk_recent_info_get_display_name (info);
-        rank = nautilus_query_matches_string (self->query, name);
+        rank = nautilus_query_matches_string (self->query, item->display_name);
+
+        if (rank <= 0)
+        {
+            rank = nautilus_query_matches_string (self->query, item->short_name);
+        }
 
         if (rank <= 0)
         {
-            g_autofree char *short_name = gtk_recent_info_get_short_name (info);
-            rank = nautilus_query_matches_string (self->query, short_name);
+            continue;
         }
 
-        if (rank > 0)
+        if (mime_types->len > 0)
         {
-            NautilusSearchHit *hit;
-            time_t modified, visited;
-            g_autoptr (GDateTime) gmodified = NULL;
-            g_autoptr (GDateTime) gvisited = NULL;
+            gboolean found = FALSE;
 
-            if (gtk_recent_info_is_local (info))
+            for (gint j = 0; item->mime_type != NULL && j < mime_types->len; j++)
             {
-                g_autoptr (GError) error = NULL;
-
-                if (!is_file_valid_recursive (self, file, &error))
+                if (g_content_type_is_a (item->mime_type, g_ptr_array_index (mime_types, j)))
                 {
-                    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-                    {
-                        break;
-                    }
-
-                    if (error != NULL &&
-                        !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
-                    {
-                        g_debug ("Impossible to read recent file info: %s",
-                                 error->message);
-                    }
-
-                    continue;
+                    found = TRUE;
+                    break;
                 }
             }
 
-            if (mime_types->len > 0)
+            if (!found)
             {
-                const gchar *mime_type = gtk_recent_info_get_mime_type (info);
-                gboolean found = FALSE;
-
-                for (gint i = 0; mime_type != NULL && i < mime_types->len; i++)
-                {
-                    if (g_content_type_is_a (mime_type, g_ptr_array_index (mime_types, i)))
-                    {
-                        found = TRUE;
-                        break;
-                    }
-                }
-
-                if (!found)
-                {
-                    continue;
-                }
+                continue;
             }
+        }
 
-            modified = gtk_recent_info_get_modified (info);
-            visited = gtk_recent_info_get_visited (info);
+        if (date_range != NULL)
+        {
+            NautilusQuerySearchType type;
+            guint64 target_time;
+            GDateTime *initial_date;
+            GDateTime *end_date;
+
+            initial_date = g_ptr_array_index (date_range, 0);
+            end_date = g_ptr_array_index (date_range, 1);
+            type = nautilus_query_get_search_type (self->query);
+            target_time = (type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) ?
+                          item->visited : item->modified;
+
+            if (!nautilus_file_date_in_between (target_time,
+                                                initial_date, end_date))
+            {
+                continue;
+            }
+        }
 
-            gmodified = g_date_time_new_from_unix_local (modified);
-            gvisited = g_date_time_new_from_unix_local (visited);
+        /* Only the files that would be hits are looked at on disk. */
+        if (item->is_local)
+        {
+            g_autoptr (GError) error = NULL;
 
-            if (date_range != NULL)
+            if (!is_file_valid_recursive (self, item->file, &error))
             {
-                NautilusQuerySearchType type;
-                guint64 target_time;
-                GDateTime *initial_date;
-                GDateTime *end_date;
-
-                initial_date = g_ptr_array_index (date_range, 0);
-                end_date = g_ptr_array_index (date_range, 1);
-                type = nautilus_query_get_search_type (self->query);
-                target_time = (type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) ?
-                              visited : modified;
-
-                if (!nautilus_file_date_in_between (target_time,
-                                                    initial_date, end_date))
+                if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
                 {
-                    continue;
+                    break;
                 }
-            }
 
-            hit = nautilus_search_hit_new (uri);
-            nautilus_search_hit_set_fts_rank (hit, rank);
-            nautilus_search_hit_set_modification_time (hit, gmodified);
-            nautilus_search_hit_set_access_time (hit, gvisited);
+                if (error != NULL &&
+                    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+                {
+                    g_debug ("Impossible to read recent file info: %s",
+                             error->message);
+                }
 
-            hits = g_list_prepend (hits, hit);
+                continue;
+            }
         }
+
+        gmodified = g_date_time_new_from_unix_local (item->modified);
+        gvisited = g_date_time_new_from_unix_local (item->visited);
+
+        hit = nautilus_search_hit_new (item->uri);
+        nautilus_search_hit_set_fts_rank (hit, rank);
+        nautilus_search_hit_set_modification_time (hit, gmodified);
+        nautilus_search_hit_set_access_time (hit, gvisited);
+
+        hits = g_list_prepend (hits, hit);
     }
 
     search_add_hits_idle (self, hits);
 
-    g_list_free_full (recent_items, (GDestroyNotify) gtk_recent_info_unref);
-
     return NULL;
 }
 
@@ -326,6 +439,7 @@ nautilus_search_engine_recent_start (NautilusSearchProvider *provider)
     NautilusSearchEngineRecent *self = NAUTILUS_SEARCH_ENGINE_RECENT (provider);
     g_autoptr (GFile) location = NULL;
     g_autoptr (GThread) thread = NULL;
+    SearchThreadData *data;
 
     g_return_if_fail (self->query);
     g_return_if_fail (self->cancellable == NULL);
@@ -342,8 +456,11 @@ nautilus_search_engine_recent_start (NautilusSearchProvider *provider)
 
     self->running = TRUE;
     self->cancellable = g_cancellable_new ();
-    thread = g_thread_new ("nautilus-search-recent", recent_thread_func,
-                           g_object_ref (self));
+
+    data = g_new0 (SearchThreadData, 1);
+    data->recent = g_object_ref (self);
+    data->items = get_items (self);
+    thread = g_thread_new ("nautilus-search-recent", recent_thread_func, data);
 
     g_object_notify (G_OBJECT (provider), "running");
 }
@@ -427,4 +544,6 @@ static void
 nautilus_search_engine_recent_init (NautilusSearchEngineRecent *self)
 {
     self->recent_manager = gtk_recent_manager_get_default ();
+    self->changed_id = g_signal_connect (self->recent_manager, "changed",
+                                         G_CALLBACK (recent_manager_changed), self);
 }
@@ -22,6 +22,9 @@
 #include <config.h>
 #include "nautilus-search-engine-simple.h"
 
+#include "nautilus-directory-reader.h"
+#include "nautilus-file-utilities.h"
+#include "nautilus-filename-index.h"
 #include "nautilus-search-engine-private.h"
 #include "nautilus-search-hit.h"
 #include "nautilus-search-provider.h"
@@ -35,6 +38,24 @@
 
 #define BATCH_SIZE 500
 
+/* Directories are enumerated by this many threads at most, sharing a
+ * queue of directories to visit. */
+#define SEARCH_MAX_THREADS 4
+
+/* Like grep, a file with a NUL byte at its start is taken as binary. */
+#define CONTENT_SNIFF_SIZE 1024
+/* Only the start of bigger files is searched. */
+#define CONTENT_MAX_SIZE (16 * 1024 * 1024)
+#define CONTENT_CANCELLABLE_CHECK_INTERVAL (1024 * 1024)
+/* Words get a bit each in the table of first bytes. */
+#define CONTENT_MAX_WORDS 32
+#define SNIPPET_CONTEXT_BEFORE 40
+#define SNIPPET_CONTEXT_AFTER 80
+
+/* The listings of the directories crawled are kept for the next queries
+ * of the same search, up to this many bytes. */
+#define CRAWL_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
 enum
 {
     PROP_0,
@@ -48,26 +69,61 @@ typedef struct
     GCancellable *cancellable;
 
     GPtrArray *mime_types;
+    /* The folders not to descend into, NULL if none */
+    GStrv prune_patterns;
     GList *found_list;
 
+    NautilusQuery *query;
+    NautilusQueryMatcher *matcher;
+
+    /* Set when the contents of the files are searched as well */
+    gboolean search_contents;
+    const char *content_words[CONTENT_MAX_WORDS];
+    gsize content_word_lengths[CONTENT_MAX_WORDS];
+    guint n_content_words;
+    /* Byte -> the words that may start with it, in either case */
+    guint32 content_first_bytes[256];
+
+    GMutex mutex;
+    GCond cond;
+    /* The following data is shared by the search threads
+     * and needs to lock the mutex
+     */
     GQueue *directories;     /* GFiles */
-
     GHashTable *visited;
+    guint busy_threads;
+    guint running_threads;
+    /* The files seen by the whole crawl, to build a filename index */
+    GPtrArray *index_entries;
 
-    gint n_processed_files;
-    GList *hits;
-
-    NautilusQuery *query;
-
-    gint processing_id;
     GMutex idle_mutex;
     /* The following data can be accessed from different threads
      * and needs to lock the mutex
      */
+    gint processing_id;
     GQueue *idle_queue;
     gboolean finished;
 } SearchThreadData;
 
+/* The children of a directory, as read when it had @mtime. Shared by the
+ * crawl cache and the search threads visiting the directory. */
+typedef struct
+{
+    guint64 mtime;
+    guint32 mtime_usec;
+    GStringChunk *strings;
+    GArray *entries;     /* NautilusDirectoryEntry, with their strings in @strings */
+    gsize size;
+} CrawlListing;
+
+/* What a single search thread gathers between two batches */
+typedef struct
+{
+    gint n_processed_files;
+    GList *hits;
+    GPtrArray *index_entries;
+} SearchThreadBatch;
+
 
 struct _NautilusSearchEngineSimple
 {
@@ -75,6 +131,14 @@ struct _NautilusSearchEngineSimple
     NautilusQuery *query;
 
     SearchThreadData *active_search;
+
+    /* The directories listed by the crawls of the current location, so
+     * that typing a query doesn't read them again on every keystroke.
+     * GFile -> CrawlListing */
+    GMutex crawl_cache_mutex;
+    GHashTable *crawl_cache;
+    gsize crawl_cache_size;
+    GFile *crawl_cache_location;
 };
 
 static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
@@ -90,6 +154,9 @@ finalize (GObject *object)
 {
     NautilusSearchEngineSimple *simple = NAUTILUS_SEARCH_ENGINE_SIMPLE (object);
     g_clear_object (&simple->query);
+    g_hash_table_destroy (simple->crawl_cache);
+    g_mutex_clear (&simple->crawl_cache_mutex);
+    g_clear_object (&simple->crawl_cache_location);
 
     G_OBJECT_CLASS (nautilus_search_engine_simple_parent_class)->finalize (object);
 }
@@ -100,6 +167,7 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 {
     SearchThreadData *data;
     GFile *location;
+    const char * const *words;
 
     data = g_new0 (SearchThreadData, 1);
 
@@ -107,14 +175,45 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
     data->directories = g_queue_new ();
     data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     data->query = g_object_ref (query);
+    data->matcher = nautilus_query_get_matcher (query);
+    if (nautilus_filename_index_should_build (query))
+    {
+        data->index_entries = g_ptr_array_new_with_free_func ((GDestroyNotify) nautilus_filename_index_entry_free);
+    }
+
+    words = nautilus_query_matcher_get_words (data->matcher);
+    if (words != NULL &&
+        nautilus_query_get_search_content (query) == NAUTILUS_QUERY_SEARCH_CONTENT_FULL_TEXT)
+    {
+        for (guint i = 0; words[i] != NULL && data->n_content_words < CONTENT_MAX_WORDS; i++)
+        {
+            guint word = data->n_content_words;
+            guchar first_byte = words[i][0];
+
+            if (first_byte == '\0')
+            {
+                continue;
+            }
+
+            data->content_words[word] = words[i];
+            data->content_word_lengths[word] = strlen (words[i]);
+            data->content_first_bytes[g_ascii_tolower (first_byte)] |= 1u << word;
+            data->content_first_bytes[g_ascii_toupper (first_byte)] |= 1u << word;
+            data->n_content_words++;
+        }
+        data->search_contents = data->n_content_words > 0;
+    }
 
     location = nautilus_query_get_location (query);
 
     g_queue_push_tail (data->directories, location);
     data->mime_types = nautilus_query_get_mime_types (query);
+    data->prune_patterns = nautilus_query_get_prune_patterns (query);
 
     data->cancellable = g_cancellable_new ();
 
+    g_mutex_init (&data->mutex);
+    g_cond_init (&data->cond);
     g_mutex_init (&data->idle_mutex);
     data->idle_queue = g_queue_new ();
 
@@ -130,11 +229,15 @@ search_thread_data_free (SearchThreadData *data)
                      (GFunc) g_object_unref, NULL);
     g_queue_free (data->directories);
     g_hash_table_destroy (data->visited);
+    g_clear_pointer (&data->index_entries, g_ptr_array_unref);
     g_object_unref (data->cancellable);
     g_object_unref (data->query);
+    nautilus_query_matcher_unref (data->matcher);
     g_clear_pointer (&data->mime_types, g_ptr_array_unref);
-    g_list_free_full (data->hits, g_object_unref);
+    g_clear_pointer (&data->prune_patterns, g_strfreev);
     g_object_unref (data->engine);
+    g_mutex_clear (&data->mutex);
+    g_cond_clear (&data->cond);
     g_mutex_clear (&data->idle_mutex);
 
     while ((hits = g_queue_pop_head (data->idle_queue)))
@@ -228,14 +331,17 @@ search_thread_process_idle (gpointer user_data)
 static void
 finish_search_thread (SearchThreadData *thread_data)
 {
+    gboolean processing;
+
     g_mutex_lock (&thread_data->idle_mutex);
     thread_data->finished = TRUE;
+    processing = thread_data->processing_id != 0;
     g_mutex_unlock (&thread_data->idle_mutex);
 
     /* If no results were processed, direclty finish the search, in the main
      * thread.
      */
-    if (thread_data->processing_id == 0)
+    if (!processing)
     {
         g_idle_add (G_SOURCE_FUNC (search_thread_done), thread_data);
     }
@@ -249,47 +355,327 @@ process_batch_in_idle (SearchThreadData *thread_data,
 
     g_mutex_lock (&thread_data->idle_mutex);
     g_queue_push_tail (thread_data->idle_queue, hits);
-    g_mutex_unlock (&thread_data->idle_mutex);
 
     if (thread_data->processing_id == 0)
     {
         thread_data->processing_id = g_idle_add (search_thread_process_idle, thread_data);
     }
+    g_mutex_unlock (&thread_data->idle_mutex);
 }
 
 static void
-send_batch_in_idle (SearchThreadData *thread_data)
+send_batch_in_idle (SearchThreadData  *thread_data,
+                    SearchThreadBatch *batch)
+{
+    batch->n_processed_files = 0;
+
+    if (batch->hits)
+    {
+        process_batch_in_idle (thread_data, batch->hits);
+    }
+    batch->hits = NULL;
+}
+
+/* Returns the line around @match, cut at UTF-8 character boundaries. */
+static char *
+make_snippet (const char *contents,
+              gsize       length,
+              const char *match)
+{
+    const char *start, *end;
+    g_autofree char *text = NULL;
+
+    start = match;
+    while (start > contents && start[-1] != '\n' && match - start < SNIPPET_CONTEXT_BEFORE)
+    {
+        start--;
+    }
+    while (start < match && (*start & 0xc0) == 0x80)
+    {
+        start++;
+    }
+
+    end = match;
+    while (end < contents + length && *end != '\n' && end - match < SNIPPET_CONTEXT_AFTER)
+    {
+        end++;
+    }
+    while (end > match && end < contents + length && (*end & 0xc0) == 0x80)
+    {
+        end--;
+    }
+
+    text = g_utf8_make_valid (start, end - start);
+
+    return g_strdup_printf ("%s%s%s",
+                            start > contents && start[-1] != '\n' ? "…" : "",
+                            g_strstrip (text),
+                            end < contents + length && *end != '\n' ? "…" : "");
+}
+
+/* Runs in a search thread. Returns a snippet of the contents of @file if
+ * they contain every word of the query, or NULL.
+ *
+ * The file is scanned once for all the words: only the positions whose
+ * byte starts one of the words still missing are compared.
+ */
+static char *
+search_file_contents (SearchThreadData *data,
+                      GFile            *file)
+{
+    g_autofree char *path = NULL;
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    const char *contents;
+    const char *first_match;
+    gsize length;
+    guint32 missing, candidates;
+    guint word;
+
+    path = g_file_get_path (file);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        return NULL;
+    }
+
+    contents = g_mapped_file_get_contents (mapped_file);
+    length = MIN (g_mapped_file_get_length (mapped_file), CONTENT_MAX_SIZE);
+    if (contents == NULL || length == 0 ||
+        memchr (contents, '\0', MIN (length, CONTENT_SNIFF_SIZE)) != NULL)
+    {
+        return NULL;
+    }
+
+    missing = data->n_content_words == CONTENT_MAX_WORDS ? G_MAXUINT32 : (1u << data->n_content_words) - 1;
+    first_match = NULL;
+    for (gsize i = 0; i < length && missing != 0; i++)
+    {
+        if (i % CONTENT_CANCELLABLE_CHECK_INTERVAL == 0 &&
+            g_cancellable_is_cancelled (data->cancellable))
+        {
+            return NULL;
+        }
+
+        candidates = data->content_first_bytes[(guchar) contents[i]] & missing;
+        while (candidates != 0)
+        {
+            word = g_bit_nth_lsf (candidates, -1);
+            candidates &= ~(1u << word);
+
+            if (data->content_word_lengths[word] <= length - i &&
+                g_ascii_strncasecmp (contents + i, data->content_words[word],
+                                     data->content_word_lengths[word]) == 0)
+            {
+                missing &= ~(1u << word);
+                if (first_match == NULL)
+                {
+                    first_match = contents + i;
+                }
+            }
+        }
+    }
+
+    if (missing != 0)
+    {
+        return NULL;
+    }
+
+    return make_snippet (contents, length, first_match);
+}
+
+#define SEARCH_FIELDS (NAUTILUS_DIRECTORY_READER_TYPE | \
+                       NAUTILUS_DIRECTORY_READER_HIDDEN | \
+                       NAUTILUS_DIRECTORY_READER_DISPLAY_NAME | \
+                       NAUTILUS_DIRECTORY_READER_TIMES | \
+                       NAUTILUS_DIRECTORY_READER_IDS)
+
+static void
+crawl_listing_clear (CrawlListing *listing)
+{
+    g_string_chunk_free (listing->strings);
+    g_array_unref (listing->entries);
+}
+
+static void
+crawl_listing_unref (CrawlListing *listing)
+{
+    g_atomic_rc_box_release_full (listing, (GDestroyNotify) crawl_listing_clear);
+}
+
+static const char *
+crawl_listing_insert (CrawlListing *listing,
+                      const char   *string)
+{
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    listing->size += strlen (string) + 1;
+
+    return g_string_chunk_insert (listing->strings, string);
+}
+
+/* Runs in a search thread. Returns NULL if @dir can't be read. */
+static CrawlListing *
+crawl_listing_read (GFile        *dir,
+                    guint64       mtime,
+                    guint32       mtime_usec,
+                    GCancellable *cancellable,
+                    gboolean     *complete)
+{
+    g_autoptr (NautilusDirectoryReader) reader = NULL;
+    g_autoptr (GError) error = NULL;
+    const NautilusDirectoryEntry *entry;
+    CrawlListing *listing;
+
+    reader = nautilus_directory_reader_new (dir, SEARCH_FIELDS, cancellable, NULL);
+    if (reader == NULL)
+    {
+        return NULL;
+    }
+
+    listing = g_atomic_rc_box_new0 (CrawlListing);
+    listing->mtime = mtime;
+    listing->mtime_usec = mtime_usec;
+    listing->strings = g_string_chunk_new (4096);
+    listing->entries = g_array_new (FALSE, FALSE, sizeof (NautilusDirectoryEntry));
+
+    while ((entry = nautilus_directory_reader_next (reader, &error)) != NULL)
+    {
+        NautilusDirectoryEntry copy = *entry;
+
+        copy.name = crawl_listing_insert (listing, entry->name);
+        copy.display_name = crawl_listing_insert (listing, entry->display_name);
+        copy.file_id = crawl_listing_insert (listing, entry->file_id);
+        copy.filesystem_id = entry->filesystem_id != NULL ?
+                             g_string_chunk_insert_const (listing->strings, entry->filesystem_id) :
+                             NULL;
+        g_array_append_val (listing->entries, copy);
+    }
+    listing->size += sizeof (CrawlListing) + listing->entries->len * sizeof (NautilusDirectoryEntry);
+
+    *complete = error == NULL;
+
+    return listing;
+}
+
+/* Runs in a search thread. Returns the children of @dir, from the crawl
+ * cache if the directory didn't change since it was read. */
+static CrawlListing *
+get_directory_listing (SearchThreadData *data,
+                       GFile            *dir)
 {
-    thread_data->n_processed_files = 0;
+    NautilusSearchEngineSimple *engine = data->engine;
+    g_autoptr (GFileInfo) info = NULL;
+    CrawlListing *listing;
+    CrawlListing *cached;
+    guint64 mtime;
+    guint32 mtime_usec;
+    gboolean complete;
+
+    /* Taken before reading, so that a change while reading is noticed
+     * the next time. */
+    info = g_file_query_info (dir,
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              data->cancellable, NULL);
+    if (info == NULL ||
+        !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+    {
+        /* Nothing to tell whether a listing is still right */
+        return crawl_listing_read (dir, 0, 0, data->cancellable, &complete);
+    }
+
+    mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
 
-    if (thread_data->hits)
+    g_mutex_lock (&engine->crawl_cache_mutex);
+    listing = g_hash_table_lookup (engine->crawl_cache, dir);
+    if (listing != NULL && listing->mtime == mtime && listing->mtime_usec == mtime_usec)
     {
-        process_batch_in_idle (thread_data, thread_data->hits);
+        g_atomic_rc_box_acquire (listing);
+        g_mutex_unlock (&engine->crawl_cache_mutex);
+
+        return listing;
     }
-    thread_data->hits = NULL;
+    g_mutex_unlock (&engine->crawl_cache_mutex);
+
+    listing = crawl_listing_read (dir, mtime, mtime_usec, data->cancellable, &complete);
+    if (listing == NULL || !complete)
+    {
+        return listing;
+    }
+
+    g_mutex_lock (&engine->crawl_cache_mutex);
+    cached = g_hash_table_lookup (engine->crawl_cache, dir);
+    if (cached != NULL)
+    {
+        engine->crawl_cache_size -= cached->size;
+        g_hash_table_remove (engine->crawl_cache, dir);
+    }
+    /* Once full, the directories not listed yet are read every time */
+    if (engine->crawl_cache_size + listing->size <= CRAWL_CACHE_MAX_SIZE)
+    {
+        engine->crawl_cache_size += listing->size;
+        g_hash_table_insert (engine->crawl_cache, g_object_ref (dir),
+                             g_atomic_rc_box_acquire (listing));
+    }
+    g_mutex_unlock (&engine->crawl_cache_mutex);
+
+    return listing;
 }
 
-#define STD_ATTRIBUTES \
-    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
-    G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
-    G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
-    G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
-    G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
-    G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
-    G_FILE_ATTRIBUTE_TIME_ACCESS "," \
-    G_FILE_ATTRIBUTE_ID_FILE
+/* Guessing the type of a file may mean reading it, so it is only done
+ * for the files passing the other filters. */
+static gboolean
+matches_mime_types (SearchThreadData *data,
+                    GFile            *file)
+{
+    g_autoptr (GFileInfo) info = NULL;
+    const char *mime_type;
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              data->cancellable, NULL);
+    mime_type = info != NULL ? g_file_info_get_content_type (info) : NULL;
+    if (mime_type == NULL)
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0; i < data->mime_types->len; i++)
+    {
+        if (g_content_type_is_a (mime_type, g_ptr_array_index (data->mime_types, i)))
+        {
+            return TRUE;
+        }
+    }
 
+    return FALSE;
+}
+
+/* Runs in a search thread. The subdirectories to visit next are added
+ * to @subdirectories. */
 static void
-visit_directory (GFile            *dir,
-                 SearchThreadData *data)
+visit_directory (GFile             *dir,
+                 SearchThreadData  *data,
+                 SearchThreadBatch *batch,
+                 GQueue            *subdirectories)
 {
     g_autoptr (GPtrArray) date_range = NULL;
     NautilusQuerySearchType type;
     NautilusQueryRecursive recursive;
-    GFileEnumerator *enumerator;
-    GFileInfo *info;
+    CrawlListing *listing;
+    const NautilusDirectoryEntry *entry;
     GFile *child;
-    const char *mime_type, *display_name;
+    const char *display_name;
     gdouble match;
     gboolean is_hidden, found;
     const char *id;
@@ -299,18 +685,13 @@ visit_directory (GFile            *dir,
     GDateTime *initial_date;
     GDateTime *end_date;
     gchar *uri;
+    gboolean check_contents;
+    g_autofree char *snippet = NULL;
+    g_autofree char *dir_path = NULL;
+    g_autoptr (GFile) root = NULL;
 
-    enumerator = g_file_enumerate_children (dir,
-                                            data->mime_types->len > 0 ?
-                                            STD_ATTRIBUTES ","
-                                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
-                                            :
-                                            STD_ATTRIBUTES
-                                            ,
-                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                            data->cancellable, NULL);
-
-    if (enumerator == NULL)
+    listing = get_directory_listing (data, dir);
+    if (listing == NULL)
     {
         return;
     }
@@ -319,41 +700,61 @@ visit_directory (GFile            *dir,
     recursive = nautilus_query_get_recursive (data->query);
     date_range = nautilus_query_get_date_range (data->query);
 
-    while ((info = g_file_enumerator_next_file (enumerator, data->cancellable, NULL)) != NULL)
+    if (batch->index_entries != NULL)
+    {
+        root = nautilus_query_get_location (data->query);
+        dir_path = g_file_get_relative_path (root, dir);
+    }
+
+    for (guint i = 0; i < listing->entries->len; i++)
     {
-        display_name = g_file_info_get_display_name (info);
+        if (g_cancellable_is_cancelled (data->cancellable))
+        {
+            break;
+        }
+
+        entry = &g_array_index (listing->entries, NautilusDirectoryEntry, i);
+        display_name = entry->display_name;
         if (display_name == NULL)
         {
-            goto next;
+            continue;
         }
 
-        is_hidden = g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info);
+        is_hidden = entry->is_hidden || entry->is_backup;
         if (is_hidden && !nautilus_query_get_show_hidden_files (data->query))
         {
-            goto next;
+            continue;
         }
 
-        child = g_file_get_child (dir, g_file_info_get_name (info));
-        match = nautilus_query_matches_string (data->query, display_name);
+        child = g_file_get_child (dir, entry->name);
+        match = nautilus_query_matcher_match (data->matcher, display_name);
         found = (match > -1);
 
+        /* The contents are only read for the files passing the other filters. */
+        check_contents = !found && data->search_contents &&
+                         entry->type == G_FILE_TYPE_REGULAR;
+        found = found || check_contents;
+
         if (found && data->mime_types->len > 0)
         {
-            mime_type = g_file_info_get_content_type (info);
-            found = FALSE;
-
-            for (gint i = 0; i < data->mime_types->len; i++)
-            {
-                if (g_content_type_is_a (mime_type, g_ptr_array_index (data->mime_types, i)))
-                {
-                    found = TRUE;
-                    break;
-                }
-            }
+            found = matches_mime_types (data, child);
         }
 
-        mtime = g_file_info_get_attribute_uint64 (info, "time::modified");
-        atime = g_file_info_get_attribute_uint64 (info, "time::access");
+        mtime = entry->mtime;
+        atime = entry->atime;
+
+        if (batch->index_entries != NULL)
+        {
+            g_autofree char *path = NULL;
+
+            path = dir_path != NULL ?
+                   g_build_filename (dir_path, entry->name, NULL) :
+                   g_strdup (entry->name);
+            g_ptr_array_add (batch->index_entries,
+                             nautilus_filename_index_entry_new (path, display_name,
+                                                                mtime, atime,
+                                                                entry->type == G_FILE_TYPE_DIRECTORY));
+        }
 
         if (found && date_range != NULL)
         {
@@ -375,6 +776,14 @@ visit_directory (GFile            *dir,
                                                    end_date);
         }
 
+        if (found && check_contents)
+        {
+            g_clear_pointer (&snippet, g_free);
+            snippet = search_file_contents (data, child);
+            found = snippet != NULL;
+            match = 0;
+        }
+
         if (found)
         {
             NautilusSearchHit *hit;
@@ -384,28 +793,35 @@ visit_directory (GFile            *dir,
             hit = nautilus_search_hit_new (uri);
             g_free (uri);
             nautilus_search_hit_set_fts_rank (hit, match);
+            if (check_contents)
+            {
+                nautilus_search_hit_set_fts_snippet (hit, snippet);
+            }
             date = g_date_time_new_from_unix_local (mtime);
             nautilus_search_hit_set_modification_time (hit, date);
             g_date_time_unref (date);
 
-            data->hits = g_list_prepend (data->hits, hit);
+            batch->hits = g_list_prepend (batch->hits, hit);
         }
 
-        data->n_processed_files++;
-        if (data->n_processed_files > BATCH_SIZE)
+        batch->n_processed_files++;
+        if (batch->n_processed_files > BATCH_SIZE)
         {
-            send_batch_in_idle (data);
+            send_batch_in_idle (data, batch);
         }
 
         if (recursive != NAUTILUS_QUERY_RECURSIVE_NEVER &&
-            g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY &&
+            entry->type == G_FILE_TYPE_DIRECTORY &&
+            !nautilus_prune_patterns_match ((const char * const *) data->prune_patterns,
+                                            entry->name) &&
             is_recursive_search (NAUTILUS_SEARCH_ENGINE_TYPE_NON_INDEXED,
                                  recursive, child))
         {
-            id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+            id = entry->file_id;
             visited = FALSE;
             if (id)
             {
+                g_mutex_lock (&data->mutex);
                 if (g_hash_table_lookup_extended (data->visited,
                                                   id, NULL, NULL))
                 {
@@ -415,23 +831,126 @@ visit_directory (GFile            *dir,
                 {
                     g_hash_table_insert (data->visited, g_strdup (id), NULL);
                 }
+                g_mutex_unlock (&data->mutex);
             }
 
             if (!visited)
             {
-                g_queue_push_tail (data->directories, g_object_ref (child));
+                g_queue_push_tail (subdirectories, g_object_ref (child));
             }
         }
 
         g_object_unref (child);
-next:
-        g_object_unref (info);
     }
 
-    g_object_unref (enumerator);
+    crawl_listing_unref (listing);
 }
 
 
+/* Each thread takes a directory from the shared queue, visits it, and
+ * queues its subdirectories for whichever thread is free next. The
+ * search is over when the queue is empty and no thread is busy anymore,
+ * as a busy thread may still queue more directories.
+ */
+static gpointer
+search_worker_thread_func (gpointer user_data)
+{
+    SearchThreadData *data;
+    SearchThreadBatch batch = { 0 };
+    GQueue subdirectories = G_QUEUE_INIT;
+    GFile *dir;
+    gboolean last;
+    g_autoptr (GPtrArray) index_entries = NULL;
+    g_autoptr (GFile) root = NULL;
+    gboolean show_hidden = FALSE;
+    NautilusQueryRecursive recursive = NAUTILUS_QUERY_RECURSIVE_NEVER;
+    g_auto (GStrv) prune_patterns = NULL;
+
+    data = user_data;
+    if (data->index_entries != NULL)
+    {
+        batch.index_entries = g_ptr_array_new_with_free_func ((GDestroyNotify) nautilus_filename_index_entry_free);
+    }
+
+    g_mutex_lock (&data->mutex);
+    while (TRUE)
+    {
+        while (g_queue_is_empty (data->directories) &&
+               data->busy_threads > 0 &&
+               !g_cancellable_is_cancelled (data->cancellable))
+        {
+            g_cond_wait (&data->cond, &data->mutex);
+        }
+
+        if (g_queue_is_empty (data->directories) ||
+            g_cancellable_is_cancelled (data->cancellable))
+        {
+            break;
+        }
+
+        dir = g_queue_pop_head (data->directories);
+        data->busy_threads++;
+        g_mutex_unlock (&data->mutex);
+
+        visit_directory (dir, data, &batch, &subdirectories);
+        g_object_unref (dir);
+
+        g_mutex_lock (&data->mutex);
+        data->busy_threads--;
+        while (!g_queue_is_empty (&subdirectories))
+        {
+            g_queue_push_tail (data->directories, g_queue_pop_head (&subdirectories));
+        }
+        g_cond_broadcast (&data->cond);
+    }
+    g_mutex_unlock (&data->mutex);
+
+    /* Hits are merged into the batches already sent by the other threads. */
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        send_batch_in_idle (data, &batch);
+    }
+    g_list_free_full (batch.hits, g_object_unref);
+
+    g_mutex_lock (&data->mutex);
+    if (batch.index_entries != NULL)
+    {
+        g_ptr_array_extend_and_steal (data->index_entries, batch.index_entries);
+    }
+    data->running_threads--;
+    last = data->running_threads == 0;
+    g_cond_broadcast (&data->cond);
+    g_mutex_unlock (&data->mutex);
+
+    if (!last)
+    {
+        return NULL;
+    }
+
+    /* Only a complete crawl describes the whole tree. */
+    if (data->index_entries != NULL && !g_cancellable_is_cancelled (data->cancellable))
+    {
+        index_entries = g_steal_pointer (&data->index_entries);
+        root = nautilus_query_get_location (data->query);
+        show_hidden = nautilus_query_get_show_hidden_files (data->query);
+        recursive = nautilus_query_get_recursive (data->query);
+        prune_patterns = g_strdupv (data->prune_patterns);
+    }
+
+    /* The data is only freed from here on, in the main thread. */
+    finish_search_thread (data);
+
+    /* Building takes a while, the hits don't have to wait for it. */
+    if (index_entries != NULL)
+    {
+        nautilus_filename_index_build (root, show_hidden, recursive,
+                                       (const char * const *) prune_patterns,
+                                       g_steal_pointer (&index_entries));
+    }
+
+    return NULL;
+}
+
 static gpointer
 search_thread_func (gpointer user_data)
 {
@@ -439,6 +958,8 @@ search_thread_func (gpointer user_data)
     GFile *dir;
     GFileInfo *info;
     const char *id;
+    GThread *thread;
+    guint n_threads, i;
 
     data = user_data;
 
@@ -455,21 +976,24 @@ search_thread_func (gpointer user_data)
         g_object_unref (info);
     }
 
-    while (!g_cancellable_is_cancelled (data->cancellable) &&
-           (dir = g_queue_pop_head (data->directories)) != NULL)
+    /* A search that doesn't recurse has a single directory to visit. */
+    if (nautilus_query_get_recursive (data->query) == NAUTILUS_QUERY_RECURSIVE_NEVER)
     {
-        visit_directory (dir, data);
-        g_object_unref (dir);
+        n_threads = 1;
     }
-
-    if (!g_cancellable_is_cancelled (data->cancellable))
+    else
     {
-        send_batch_in_idle (data);
+        n_threads = CLAMP (g_get_num_processors (), 1, SEARCH_MAX_THREADS);
     }
 
-    finish_search_thread (data);
+    data->running_threads = n_threads;
+    for (i = 1; i < n_threads; i++)
+    {
+        thread = g_thread_new ("nautilus-search-simple", search_worker_thread_func, data);
+        g_thread_unref (thread);
+    }
 
-    return NULL;
+    return search_worker_thread_func (data);
 }
 
 static void
@@ -478,6 +1002,7 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
     NautilusSearchEngineSimple *simple;
     SearchThreadData *data;
     GThread *thread;
+    g_autoptr (GFile) location = NULL;
 
     simple = NAUTILUS_SEARCH_ENGINE_SIMPLE (provider);
 
@@ -488,6 +1013,19 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
 
     DEBUG ("Simple engine start");
 
+    /* The listings are only kept while searching the same location */
+    location = nautilus_query_get_location (simple->query);
+    if (simple->crawl_cache_location == NULL ||
+        !g_file_equal (simple->crawl_cache_location, location))
+    {
+        g_mutex_lock (&simple->crawl_cache_mutex);
+        g_hash_table_remove_all (simple->crawl_cache);
+        simple->crawl_cache_size = 0;
+        g_mutex_unlock (&simple->crawl_cache_mutex);
+
+        g_set_object (&simple->crawl_cache_location, location);
+    }
+
     data = search_thread_data_new (simple, simple->query);
 
     thread = g_thread_new ("nautilus-search-simple", search_thread_func, data);
@@ -580,6 +1118,11 @@ nautilus_search_engine_simple_init (NautilusSearchEngineSimple *engine)
 {
     engine->query = NULL;
     engine->active_search = NULL;
+
+    g_mutex_init (&engine->crawl_cache_mutex);
+    engine->crawl_cache = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                                 g_object_unref,
+                                                 (GDestroyNotify) crawl_listing_unref);
 }
 
 NautilusSearchEngineSimple *
@@ -22,6 +22,7 @@
 #include <config.h>
 #include "nautilus-search-engine-tracker.h"
 
+#include "nautilus-executor.h"
 #include "nautilus-search-engine-private.h"
 #include "nautilus-search-hit.h"
 #include "nautilus-search-provider.h"
@@ -39,9 +40,10 @@ struct _NautilusSearchEngineTracker
 
     TrackerSparqlConnection *connection;
     NautilusQuery *query;
+    /* SPARQL -> TrackerSparqlStatement, for the queries run so far */
+    GHashTable *statements;
 
     gboolean query_pending;
-    GQueue *hits_pending;
 
     gboolean recursive;
     gboolean fts_enabled;
@@ -78,37 +80,43 @@ finalize (GObject *object)
     }
 
     g_clear_object (&tracker->query);
-    g_queue_free_full (tracker->hits_pending, g_object_unref);
+    g_hash_table_destroy (tracker->statements);
     /* This is a singleton, no need to unref. */
     tracker->connection = NULL;
 
     G_OBJECT_CLASS (nautilus_search_engine_tracker_parent_class)->finalize (object);
 }
 
-#define BATCH_SIZE 100
+/* The rows read from the cursor at once in a thread. The first chunk is
+ * smaller, for the first hits to show up early. */
+#define CURSOR_FIRST_CHUNK_SIZE 100
+#define CURSOR_CHUNK_SIZE 500
 
-static void
-check_pending_hits (NautilusSearchEngineTracker *tracker,
-                    gboolean                     force_send)
-{
-    GList *hits = NULL;
-    NautilusSearchHit *hit;
+/* Queries only differ by the filters in use and the date range, so only
+ * a few are ever prepared in a session. */
+#define MAX_CACHED_STATEMENTS 16
 
-    DEBUG ("Tracker engine add hits");
-
-    if (!force_send &&
-        g_queue_get_length (tracker->hits_pending) < BATCH_SIZE)
-    {
-        return;
-    }
+/* State of the cursor of a search, passed from chunk to chunk */
+typedef struct
+{
+    TrackerSparqlCursor *cursor;
+    NautilusQueryMatcher *matcher;
+    gboolean has_text;
+    gboolean fts_enabled;
+    guint chunk_size;
 
-    while ((hit = g_queue_pop_head (tracker->hits_pending)))
-    {
-        hits = g_list_prepend (hits, hit);
-    }
+    /* Set by the thread reading a chunk */
+    GList *hits;
+    gboolean finished;
+} CursorReader;
 
-    nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (tracker), hits);
-    g_list_free_full (hits, g_object_unref);
+static void
+cursor_reader_free (CursorReader *reader)
+{
+    g_object_unref (reader->cursor);
+    nautilus_query_matcher_unref (reader->matcher);
+    g_list_free_full (reader->hits, g_object_unref);
+    g_free (reader);
 }
 
 static void
@@ -117,16 +125,6 @@ search_finished (NautilusSearchEngineTracker *tracker,
 {
     DEBUG ("Tracker engine finished");
 
-    if (error == NULL)
-    {
-        check_pending_hits (tracker, TRUE);
-    }
-    else
-    {
-        g_queue_foreach (tracker->hits_pending, (GFunc) g_object_unref, NULL);
-        g_queue_clear (tracker->hits_pending);
-    }
-
     tracker->query_pending = FALSE;
 
     g_object_notify (G_OBJECT (tracker), "running");
@@ -153,99 +151,156 @@ search_finished (NautilusSearchEngineTracker *tracker,
     g_object_unref (tracker);
 }
 
-static void cursor_callback (GObject      *object,
-                             GAsyncResult *result,
-                             gpointer      user_data);
-
-static void
-cursor_next (NautilusSearchEngineTracker *tracker,
-             TrackerSparqlCursor         *cursor)
+static GDateTime *
+parse_time (const char *time_str)
 {
-    tracker_sparql_cursor_next_async (cursor,
-                                      tracker->cancellable,
-                                      cursor_callback,
-                                      tracker);
+    GTimeVal tv;
+
+    if (!g_time_val_from_iso8601 (time_str, &tv))
+    {
+        return NULL;
+    }
+
+    return g_date_time_new_from_timeval_local (&tv);
 }
 
-static void
-cursor_callback (GObject      *object,
-                 GAsyncResult *result,
-                 gpointer      user_data)
+/* Runs in the thread reading a chunk. */
+static NautilusSearchHit *
+create_hit (CursorReader *reader)
 {
-    NautilusSearchEngineTracker *tracker;
-    GError *error = NULL;
-    TrackerSparqlCursor *cursor;
     NautilusSearchHit *hit;
     const char *uri;
     const char *mtime_str;
     const char *atime_str;
-    const gchar *snippet;
-    GTimeVal tv;
+    g_autofree gchar *basename = NULL;
+    g_autoptr (GDateTime) mtime = NULL;
+    g_autoptr (GDateTime) atime = NULL;
     gdouble rank, match;
-    gboolean success;
-    gchar *basename;
-
-    tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (user_data);
-
-    cursor = TRACKER_SPARQL_CURSOR (object);
-    success = tracker_sparql_cursor_next_finish (cursor, result, &error);
-
-    if (!success)
-    {
-        search_finished (tracker, error);
 
-        g_clear_error (&error);
-        g_clear_object (&cursor);
-
-        return;
-    }
-
-    /* We iterate result by result, not n at a time. */
-    uri = tracker_sparql_cursor_get_string (cursor, 0, NULL);
-    rank = tracker_sparql_cursor_get_double (cursor, 1);
-    mtime_str = tracker_sparql_cursor_get_string (cursor, 2, NULL);
-    atime_str = tracker_sparql_cursor_get_string (cursor, 3, NULL);
+    uri = tracker_sparql_cursor_get_string (reader->cursor, 0, NULL);
+    rank = tracker_sparql_cursor_get_double (reader->cursor, 1);
+    mtime_str = tracker_sparql_cursor_get_string (reader->cursor, 2, NULL);
+    atime_str = tracker_sparql_cursor_get_string (reader->cursor, 3, NULL);
     basename = g_path_get_basename (uri);
 
     hit = nautilus_search_hit_new (uri);
-    match = nautilus_query_matches_string (tracker->query, basename);
+    match = reader->has_text ? nautilus_query_matcher_match (reader->matcher, basename) : -1;
     nautilus_search_hit_set_fts_rank (hit, rank + match);
-    g_free (basename);
 
-    if (tracker->fts_enabled)
+    if (reader->fts_enabled)
     {
-        snippet = tracker_sparql_cursor_get_string (cursor, 4, NULL);
-        nautilus_search_hit_set_fts_snippet (hit, snippet);
+        nautilus_search_hit_set_fts_snippet (hit,
+                                             tracker_sparql_cursor_get_string (reader->cursor, 4, NULL));
     }
 
-    if (g_time_val_from_iso8601 (mtime_str, &tv))
+    mtime = parse_time (mtime_str);
+    if (mtime != NULL)
     {
-        GDateTime *date;
-        date = g_date_time_new_from_timeval_local (&tv);
-        nautilus_search_hit_set_modification_time (hit, date);
-        g_date_time_unref (date);
+        nautilus_search_hit_set_modification_time (hit, mtime);
     }
     else
     {
         g_warning ("unable to parse mtime: %s", mtime_str);
     }
-    if (g_time_val_from_iso8601 (atime_str, &tv))
+    atime = parse_time (atime_str);
+    if (atime != NULL)
     {
-        GDateTime *date;
-        date = g_date_time_new_from_timeval_local (&tv);
-        nautilus_search_hit_set_access_time (hit, date);
-        g_date_time_unref (date);
+        nautilus_search_hit_set_access_time (hit, atime);
     }
     else
     {
         g_warning ("unable to parse atime: %s", atime_str);
     }
 
-    g_queue_push_head (tracker->hits_pending, hit);
-    check_pending_hits (tracker, FALSE);
+    return hit;
+}
+
+/* Going through the cursor row by row asynchronously costs a main loop
+ * round trip per hit, so the rows are read in chunks in a thread instead.
+ */
+static void
+read_cursor_chunk (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      task_data,
+                   GCancellable *cancellable)
+{
+    CursorReader *reader = task_data;
+    GError *error = NULL;
+
+    for (guint i = 0; i < reader->chunk_size; i++)
+    {
+        if (!tracker_sparql_cursor_next (reader->cursor, cancellable, &error))
+        {
+            if (error != NULL)
+            {
+                g_task_return_error (task, error);
+                return;
+            }
+
+            reader->finished = TRUE;
+            break;
+        }
+
+        reader->hits = g_list_prepend (reader->hits, create_hit (reader));
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void read_cursor_chunk_callback (GObject      *object,
+                                        GAsyncResult *result,
+                                        gpointer      user_data);
+
+static void
+cursor_next_chunk (NautilusSearchEngineTracker *tracker,
+                   CursorReader                *reader)
+{
+    g_autoptr (GTask) task = NULL;
+
+    task = g_task_new (tracker, tracker->cancellable, read_cursor_chunk_callback, reader);
+    g_task_set_task_data (task, reader, NULL);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_SEARCH, task, read_cursor_chunk);
+}
+
+static void
+read_cursor_chunk_callback (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+    NautilusSearchEngineTracker *tracker;
+    CursorReader *reader;
+    GError *error = NULL;
+    GList *hits;
+
+    tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (object);
+    reader = user_data;
+
+    if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+        cursor_reader_free (reader);
+        search_finished (tracker, error);
+        g_error_free (error);
+        return;
+    }
+
+    DEBUG ("Tracker engine add hits");
+
+    hits = g_list_reverse (g_steal_pointer (&reader->hits));
+    if (hits != NULL)
+    {
+        nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (tracker), hits);
+        g_list_free_full (hits, g_object_unref);
+    }
 
-    /* Get next */
-    cursor_next (tracker, cursor);
+    if (reader->finished)
+    {
+        cursor_reader_free (reader);
+        search_finished (tracker, NULL);
+        return;
+    }
+
+    reader->chunk_size = CURSOR_CHUNK_SIZE;
+    cursor_next_chunk (tracker, reader);
 }
 
 static void
@@ -254,26 +309,36 @@ query_callback (GObject      *object,
                 gpointer      user_data)
 {
     NautilusSearchEngineTracker *tracker;
-    TrackerSparqlConnection *connection;
+    TrackerSparqlStatement *statement;
     TrackerSparqlCursor *cursor;
+    CursorReader *reader;
+    g_autofree char *text = NULL;
     GError *error = NULL;
 
     tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (user_data);
 
-    connection = TRACKER_SPARQL_CONNECTION (object);
-    cursor = tracker_sparql_connection_query_finish (connection,
-                                                     result,
-                                                     &error);
+    statement = TRACKER_SPARQL_STATEMENT (object);
+    cursor = tracker_sparql_statement_execute_finish (statement,
+                                                      result,
+                                                      &error);
 
     if (error != NULL)
     {
         search_finished (tracker, error);
         g_error_free (error);
+        return;
     }
-    else
-    {
-        cursor_next (tracker, cursor);
-    }
+
+    text = nautilus_query_get_text (tracker->query);
+
+    reader = g_new0 (CursorReader, 1);
+    reader->cursor = cursor;
+    reader->matcher = nautilus_query_get_matcher (tracker->query);
+    reader->has_text = text != NULL;
+    reader->fts_enabled = tracker->fts_enabled;
+    reader->chunk_size = CURSOR_FIRST_CHUNK_SIZE;
+
+    cursor_next_chunk (tracker, reader);
 }
 
 static gboolean
@@ -294,54 +359,24 @@ search_finished_idle (gpointer user_data)
  */
 #define FILENAME_RANK "5.0"
 
-static void
-nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
+/* Returns the SPARQL of the query. The text, location and types are left
+ * as parameters, so that the queries of the same shape share a prepared
+ * statement. */
+static GString *
+build_sparql (NautilusSearchEngineTracker *tracker,
+              gboolean                     has_text,
+              GPtrArray                   *mimetypes)
 {
-    NautilusSearchEngineTracker *tracker;
-    gchar *query_text, *search_text, *location_uri, *downcase;
-    GFile *location;
     GString *sparql;
-    g_autoptr (GPtrArray) mimetypes = NULL;
     GPtrArray *date_range;
 
-    tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (provider);
-
-    if (tracker->query_pending)
-    {
-        return;
-    }
-
-    DEBUG ("Tracker engine start");
-    g_object_ref (tracker);
-    tracker->query_pending = TRUE;
-
-    g_object_notify (G_OBJECT (provider), "running");
-
-    if (tracker->connection == NULL)
-    {
-        g_idle_add (search_finished_idle, provider);
-        return;
-    }
-
-    tracker->fts_enabled = nautilus_query_get_search_content (tracker->query);
-
-    query_text = nautilus_query_get_text (tracker->query);
-    downcase = g_utf8_strdown (query_text, -1);
-    search_text = tracker_sparql_escape_string (downcase);
-    g_free (query_text);
-    g_free (downcase);
-
-    location = nautilus_query_get_location (tracker->query);
-    location_uri = location ? g_file_get_uri (location) : NULL;
-    mimetypes = nautilus_query_get_mime_types (tracker->query);
-
     sparql = g_string_new ("SELECT DISTINCT"
                            " ?url"
                            " xsd:double(COALESCE(?rank2, ?rank1)) AS ?rank"
                            " nfo:fileLastModified(?file)"
                            " nfo:fileLastAccessed(?file)");
 
-    if (tracker->fts_enabled && *search_text)
+    if (tracker->fts_enabled && has_text)
     {
         g_string_append (sparql, " fts:snippet(?content)");
     }
@@ -368,38 +403,36 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
                          "    nie:mimeType ?mime");
     }
 
-    if (tracker->fts_enabled && *search_text)
+    if (tracker->fts_enabled && has_text)
     {
         /* Use fts:match only for content search to not lose some filename results due to stop words. */
-        g_string_append_printf (sparql,
-                                " { "
-                                " ?content nie:isStoredAs ?file ."
-                                " ?content fts:match \"%s*\" ."
-                                " BIND(fts:rank(?content) AS ?rank1) ."
-                                " } UNION",
-                                search_text);
-    }
-
-    g_string_append_printf (sparql,
-                            " {"
-                            " ?file nfo:fileName ?filename ."
-                            " FILTER(fn:contains(fn:lower-case(?filename), '%s')) ."
-                            " BIND(" FILENAME_RANK " AS ?rank2) ."
-                            " }",
-                            search_text);
+        g_string_append (sparql,
+                         " { "
+                         " ?content nie:isStoredAs ?file ."
+                         " ?content fts:match ~ftsMatch ."
+                         " BIND(fts:rank(?content) AS ?rank1) ."
+                         " } UNION");
+    }
+
+    g_string_append (sparql,
+                     " {"
+                     " ?file nfo:fileName ?filename ."
+                     " FILTER(fn:contains(fn:lower-case(?filename), ~match)) ."
+                     " BIND(" FILENAME_RANK " AS ?rank2) ."
+                     " }");
 
     g_string_append_printf (sparql, " . FILTER( ");
 
     if (!tracker->recursive)
     {
-        g_string_append_printf (sparql, "tracker:uri-is-parent('%s', ?url)", location_uri);
+        g_string_append (sparql, "tracker:uri-is-parent(~location, ?url)");
     }
     else
     {
         /* STRSTARTS is faster than tracker:uri-is-descendant().
          * See https://gitlab.gnome.org/GNOME/tracker/-/issues/243
          */
-        g_string_append_printf (sparql, "STRSTARTS(?url, '%s/')", location_uri);
+        g_string_append (sparql, "STRSTARTS(?url, ~location)");
     }
 
     date_range = nautilus_query_get_date_range (tracker->query);
@@ -438,6 +471,7 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
 
         g_free (initial_date_format);
         g_free (end_date_format);
+        g_date_time_unref (shifted_end_date);
         g_ptr_array_unref (date_range);
     }
 
@@ -452,25 +486,130 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
                 g_string_append (sparql, " || ");
             }
 
-            g_string_append_printf (sparql, "fn:contains(?mime, '%s')",
-                                    (gchar *) g_ptr_array_index (mimetypes, i));
+            g_string_append_printf (sparql, "fn:contains(?mime, ~mime%d)", i);
         }
         g_string_append (sparql, ")\n");
     }
 
     g_string_append (sparql, ")} ORDER BY DESC (?rank)");
 
-    tracker->cancellable = g_cancellable_new ();
-    tracker_sparql_connection_query_async (tracker->connection,
-                                           sparql->str,
-                                           tracker->cancellable,
-                                           query_callback,
-                                           tracker);
+    return sparql;
+}
+
+static TrackerSparqlStatement *
+get_statement (NautilusSearchEngineTracker  *tracker,
+               const char                   *sparql,
+               GError                      **error)
+{
+    TrackerSparqlStatement *statement;
+
+    statement = g_hash_table_lookup (tracker->statements, sparql);
+    if (statement != NULL)
+    {
+        return statement;
+    }
+
+    statement = tracker_sparql_connection_query_statement (tracker->connection,
+                                                           sparql,
+                                                           NULL,
+                                                           error);
+    if (statement == NULL)
+    {
+        return NULL;
+    }
+
+    if (g_hash_table_size (tracker->statements) >= MAX_CACHED_STATEMENTS)
+    {
+        g_hash_table_remove_all (tracker->statements);
+    }
+    g_hash_table_insert (tracker->statements, g_strdup (sparql), statement);
+
+    return statement;
+}
+
+static void
+nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineTracker *tracker;
+    g_autofree gchar *query_text = NULL;
+    g_autofree gchar *search_text = NULL;
+    g_autofree gchar *fts_match = NULL;
+    g_autofree gchar *location_uri = NULL;
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (GPtrArray) mimetypes = NULL;
+    g_autoptr (GError) error = NULL;
+    GString *sparql;
+    TrackerSparqlStatement *statement;
+
+    tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (provider);
+
+    if (tracker->query_pending)
+    {
+        return;
+    }
+
+    DEBUG ("Tracker engine start");
+    g_object_ref (tracker);
+    tracker->query_pending = TRUE;
+
+    g_object_notify (G_OBJECT (provider), "running");
+
+    if (tracker->connection == NULL)
+    {
+        g_idle_add (search_finished_idle, provider);
+        return;
+    }
+
+    tracker->fts_enabled = nautilus_query_get_search_content (tracker->query);
+
+    query_text = nautilus_query_get_text (tracker->query);
+    search_text = g_utf8_strdown (query_text, -1);
+
+    location = nautilus_query_get_location (tracker->query);
+    location_uri = location ? g_file_get_uri (location) : NULL;
+    mimetypes = nautilus_query_get_mime_types (tracker->query);
+
+    sparql = build_sparql (tracker, *search_text != '\0', mimetypes);
+    statement = get_statement (tracker, sparql->str, &error);
     g_string_free (sparql, TRUE);
 
-    g_free (search_text);
-    g_free (location_uri);
-    g_object_unref (location);
+    if (statement == NULL)
+    {
+        search_finished (tracker, error);
+        return;
+    }
+
+    if (tracker->fts_enabled && *search_text)
+    {
+        fts_match = g_strconcat (search_text, "*", NULL);
+        tracker_sparql_statement_bind_string (statement, "ftsMatch", fts_match);
+    }
+    tracker_sparql_statement_bind_string (statement, "match", search_text);
+
+    if (!tracker->recursive)
+    {
+        tracker_sparql_statement_bind_string (statement, "location", location_uri);
+    }
+    else
+    {
+        g_autofree gchar *prefix = g_strconcat (location_uri, "/", NULL);
+
+        tracker_sparql_statement_bind_string (statement, "location", prefix);
+    }
+
+    for (guint i = 0; i < mimetypes->len; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("mime%u", i);
+
+        tracker_sparql_statement_bind_string (statement, name,
+                                              g_ptr_array_index (mimetypes, i));
+    }
+
+    tracker->cancellable = g_cancellable_new ();
+    tracker_sparql_statement_execute_async (statement,
+                                            tracker->cancellable,
+                                            query_callback,
+                                            tracker);
 }
 
 static void
@@ -571,7 +710,8 @@ nautilus_search_engine_tracker_init (NautilusSearchEngineTracker *engine)
 {
     GError *error = NULL;
 
-    engine->hits_pending = g_queue_new ();
+    engine->statements = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, g_object_unref);
 
     engine->connection = nautilus_tracker_get_miner_fs_connection (&error);
     if (error)
@@ -28,6 +28,7 @@
 #include <glib/gi18n.h>
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
 #include "nautilus-debug.h"
+#include "nautilus-search-engine-index.h"
 #include "nautilus-search-engine-recent.h"
 #include "nautilus-search-engine-simple.h"
 #include "nautilus-search-engine-tracker.h"
@@ -38,8 +39,10 @@ typedef struct
     NautilusSearchEngineRecent *recent;
     NautilusSearchEngineSimple *simple;
     NautilusSearchEngineModel *model;
+    NautilusSearchEngineIndex *index;
 
-    GHashTable *uris;
+    /* The hits added so far, by URI. The keys are the URIs of the hits. */
+    GHashTable *hits;
     guint providers_running;
     guint providers_finished;
     guint providers_error;
@@ -80,6 +83,7 @@ nautilus_search_engine_set_query (NautilusSearchProvider *provider,
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->recent), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->model), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->simple), query);
+    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->index), query);
 }
 
 static void
@@ -143,7 +147,15 @@ search_engine_start_real_simple (NautilusSearchEngine *engine)
     priv = nautilus_search_engine_get_instance_private (engine);
     priv->providers_running++;
 
-    nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->simple));
+    /* An up to date filename index answers without crawling. */
+    if (nautilus_search_engine_index_can_search (priv->index))
+    {
+        nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->index));
+    }
+    else
+    {
+        nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->simple));
+    }
 }
 
 static void
@@ -285,6 +297,7 @@ nautilus_search_engine_stop (NautilusSearchProvider *provider)
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->recent));
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->model));
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->simple));
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->index));
 
     priv->running = FALSE;
     priv->restart = FALSE;
@@ -313,16 +326,20 @@ search_provider_hits_added (NautilusSearchProvider *provider,
     for (l = hits; l != NULL; l = l->next)
     {
         NautilusSearchHit *hit = l->data;
-        int count;
+        NautilusSearchHit *previous_hit;
         const char *uri;
 
         uri = nautilus_search_hit_get_uri (hit);
-        count = GPOINTER_TO_INT (g_hash_table_lookup (priv->uris, uri));
-        if (count == 0)
+        previous_hit = g_hash_table_lookup (priv->hits, uri);
+        if (previous_hit != NULL)
         {
-            added = g_list_prepend (added, hit);
+            /* Another provider found it already */
+            nautilus_search_hit_merge (previous_hit, hit);
+            continue;
         }
-        g_hash_table_replace (priv->uris, g_strdup (uri), GINT_TO_POINTER (++count));
+
+        g_hash_table_insert (priv->hits, (gpointer) uri, g_object_ref (hit));
+        added = g_list_prepend (added, hit);
     }
     if (added != NULL)
     {
@@ -370,7 +387,7 @@ check_providers_status (NautilusSearchEngine *engine)
     priv->running = FALSE;
     g_object_notify (G_OBJECT (engine), "running");
 
-    g_hash_table_remove_all (priv->uris);
+    g_hash_table_remove_all (priv->hits);
 
     if (priv->restart)
     {
@@ -455,12 +472,13 @@ nautilus_search_engine_finalize (GObject *object)
     engine = NAUTILUS_SEARCH_ENGINE (object);
     priv = nautilus_search_engine_get_instance_private (engine);
 
-    g_hash_table_destroy (priv->uris);
+    g_hash_table_destroy (priv->hits);
 
     g_clear_object (&priv->tracker);
     g_clear_object (&priv->recent);
     g_clear_object (&priv->model);
     g_clear_object (&priv->simple);
+    g_clear_object (&priv->index);
 
     G_OBJECT_CLASS (nautilus_search_engine_parent_class)->finalize (object);
 }
@@ -510,7 +528,7 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
     NautilusSearchEnginePrivate *priv;
 
     priv = nautilus_search_engine_get_instance_private (engine);
-    priv->uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->hits = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
 
     priv->tracker = nautilus_search_engine_tracker_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->tracker));
@@ -521,6 +539,9 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
     priv->simple = nautilus_search_engine_simple_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->simple));
 
+    priv->index = nautilus_search_engine_index_new ();
+    connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->index));
+
     priv->recent = nautilus_search_engine_recent_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->recent));
 }
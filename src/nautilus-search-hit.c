@@ -54,54 +54,97 @@ enum
 
 G_DEFINE_TYPE (NautilusSearchHit, nautilus_search_hit, G_TYPE_OBJECT)
 
-void
-nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
-                                    NautilusQuery     *query)
+/* What all the hits of a batch are scored against */
+typedef struct
 {
     GDateTime *now;
-    GFile *query_location;
-    GFile *hit_location;
-    GTimeSpan m_diff = G_MAXINT64;
-    GTimeSpan a_diff = G_MAXINT64;
-    GTimeSpan t_diff = G_MAXINT64;
-    gdouble recent_bonus = 0.0;
-    gdouble proximity_bonus = 0.0;
-    gdouble match_bonus = 0.0;
+    /* The URI of the query location, with a trailing separator */
+    gchar *location_prefix;
+    gsize location_prefix_length;
+} ScoringContext;
+
+static void
+scoring_context_init (ScoringContext *context,
+                      NautilusQuery  *query)
+{
+    g_autoptr (GFile) query_location = NULL;
+    g_autofree gchar *uri = NULL;
 
     query_location = nautilus_query_get_location (query);
-    hit_location = g_file_new_for_uri (hit->uri);
+    uri = g_file_get_uri (query_location);
+
+    context->now = g_date_time_new_now_local ();
+    context->location_prefix = g_str_has_suffix (uri, "/") ?
+                               g_strdup (uri) :
+                               g_strconcat (uri, "/", NULL);
+    context->location_prefix_length = strlen (context->location_prefix);
+}
+
+static void
+scoring_context_clear (ScoringContext *context)
+{
+    g_date_time_unref (context->now);
+    g_free (context->location_prefix);
+}
 
-    if (g_file_has_prefix (hit_location, query_location))
+/* Returns the number of directories between the query location and the
+ * hit, or -1 if the hit is not below the query location. */
+static gint
+get_directory_depth (ScoringContext *context,
+                     const gchar    *uri)
+{
+    const gchar *p;
+    gint depth;
+
+    if (strncmp (uri, context->location_prefix, context->location_prefix_length) != 0)
     {
-        GFile *parent, *location;
-        guint dir_count = 0;
+        return -1;
+    }
 
-        parent = g_file_get_parent (hit_location);
+    p = uri + context->location_prefix_length;
+    if (*p == '\0')
+    {
+        return -1;
+    }
 
-        while (!g_file_equal (parent, query_location))
+    depth = 0;
+    for (; *p != '\0'; p++)
+    {
+        /* A trailing separator doesn't make another level. */
+        if (*p == '/' && p[1] != '\0')
         {
-            dir_count++;
-            location = parent;
-            parent = g_file_get_parent (location);
-            g_object_unref (location);
+            depth++;
         }
-        g_object_unref (parent);
+    }
 
-        if (dir_count < 10)
-        {
-            proximity_bonus = 10000.0 - 1000.0 * dir_count;
-        }
+    return depth;
+}
+
+static void
+compute_scores (NautilusSearchHit *hit,
+                ScoringContext    *context)
+{
+    GTimeSpan m_diff = G_MAXINT64;
+    GTimeSpan a_diff = G_MAXINT64;
+    GTimeSpan t_diff = G_MAXINT64;
+    gdouble recent_bonus = 0.0;
+    gdouble proximity_bonus = 0.0;
+    gdouble match_bonus = 0.0;
+    gint dir_count;
+
+    dir_count = get_directory_depth (context, hit->uri);
+    if (dir_count >= 0 && dir_count < 10)
+    {
+        proximity_bonus = 10000.0 - 1000.0 * dir_count;
     }
-    g_object_unref (hit_location);
 
-    now = g_date_time_new_now_local ();
     if (hit->modification_time != NULL)
     {
-        m_diff = g_date_time_difference (now, hit->modification_time);
+        m_diff = g_date_time_difference (context->now, hit->modification_time);
     }
     if (hit->access_time != NULL)
     {
-        a_diff = g_date_time_difference (now, hit->access_time);
+        a_diff = g_date_time_difference (context->now, hit->access_time);
     }
     m_diff /= G_TIME_SPAN_DAY;
     a_diff /= G_TIME_SPAN_DAY;
@@ -143,9 +186,36 @@ nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
     hit->relevance = recent_bonus + proximity_bonus + match_bonus;
     DEBUG ("Hit %s computed relevance %.2f (%.2f + %.2f + %.2f)", hit->uri, hit->relevance,
            proximity_bonus, recent_bonus, match_bonus);
+}
+
+void
+nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
+                                    NautilusQuery     *query)
+{
+    ScoringContext context;
 
-    g_date_time_unref (now);
-    g_object_unref (query_location);
+    scoring_context_init (&context, query);
+    compute_scores (hit, &context);
+    scoring_context_clear (&context);
+}
+
+void
+nautilus_search_hit_compute_scores_for_hits (GList         *hits,
+                                             NautilusQuery *query)
+{
+    ScoringContext context;
+
+    if (hits == NULL)
+    {
+        return;
+    }
+
+    scoring_context_init (&context, query);
+    for (GList *l = hits; l != NULL; l = l->next)
+    {
+        compute_scores (NAUTILUS_SEARCH_HIT (l->data), &context);
+    }
+    scoring_context_clear (&context);
 }
 
 const char *
@@ -226,6 +296,41 @@ nautilus_search_hit_set_fts_snippet (NautilusSearchHit *hit,
     hit->fts_snippet = g_strdup (snippet);
 }
 
+gboolean
+nautilus_search_hit_merge (NautilusSearchHit *hit,
+                           NautilusSearchHit *other)
+{
+    gboolean changed = FALSE;
+
+    g_return_val_if_fail (g_strcmp0 (hit->uri, other->uri) == 0, FALSE);
+
+    if (other->fts_rank > hit->fts_rank)
+    {
+        hit->fts_rank = other->fts_rank;
+        changed = TRUE;
+    }
+
+    if (hit->fts_snippet == NULL && other->fts_snippet != NULL)
+    {
+        hit->fts_snippet = g_strdup (other->fts_snippet);
+        changed = TRUE;
+    }
+
+    if (hit->modification_time == NULL && other->modification_time != NULL)
+    {
+        hit->modification_time = g_date_time_ref (other->modification_time);
+        changed = TRUE;
+    }
+
+    if (hit->access_time == NULL && other->access_time != NULL)
+    {
+        hit->access_time = g_date_time_ref (other->access_time);
+        changed = TRUE;
+    }
+
+    return changed;
+}
+
 static void
 nautilus_search_hit_set_property (GObject      *object,
                                   guint         arg_id,
@@ -40,6 +40,15 @@ void                nautilus_search_hit_set_fts_snippet       (NautilusSearchHit
                                                                const gchar       *snippet);
 void                nautilus_search_hit_compute_scores        (NautilusSearchHit *hit,
 							       NautilusQuery     *query);
+/* Scores a list of hits of the same query at once. */
+void                nautilus_search_hit_compute_scores_for_hits (GList         *hits,
+                                                                 NautilusQuery *query);
+
+/* Adds to @hit what @other, a hit of the same file from another provider,
+ * knows more. Returns whether @hit changed. The relevance is left to be
+ * computed again. */
+gboolean            nautilus_search_hit_merge                 (NautilusSearchHit *hit,
+                                                               NautilusSearchHit *other);
 
 const char *        nautilus_search_hit_get_uri               (NautilusSearchHit *hit);
 gdouble             nautilus_search_hit_get_relevance         (NautilusSearchHit *hit);
@@ -47,10 +47,12 @@ struct _NautilusSearchPopover
     GtkWidget *last_modified_button;
     GtkWidget *full_text_search_button;
     GtkWidget *filename_search_button;
+    GtkWidget *prune_button;
 
     NautilusQuery *query;
 
     gboolean fts_enabled;
+    gboolean prune_enabled;
 };
 
 static void          show_date_selection_widgets (NautilusSearchPopover *popover,
@@ -68,6 +70,7 @@ enum
     PROP_0,
     PROP_QUERY,
     PROP_FTS_ENABLED,
+    PROP_PRUNE_ENABLED,
     LAST_PROP
 };
 
@@ -379,6 +382,21 @@ search_fts_mode_changed (GtkToggleButton       *button,
     }
 }
 
+static void
+search_prune_changed (GtkToggleButton       *button,
+                      NautilusSearchPopover *popover)
+{
+    gboolean active;
+
+    /* This only overrides the settings for the current search. */
+    active = gtk_toggle_button_get_active (button);
+    if (popover->prune_enabled != active)
+    {
+        popover->prune_enabled = active;
+        g_object_notify (G_OBJECT (popover), "prune-enabled");
+    }
+}
+
 /* Auxiliary methods */
 
 static GtkWidget *
@@ -737,6 +755,12 @@ nautilus_search_popover_get_property (GObject    *object,
         }
         break;
 
+        case PROP_PRUNE_ENABLED:
+        {
+            g_value_set_boolean (value, self->prune_enabled);
+        }
+        break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -766,6 +790,13 @@ nautilus_search_popover_set_property (GObject      *object,
         }
         break;
 
+        case PROP_PRUNE_ENABLED:
+        {
+            gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (self->prune_button),
+                                          g_value_get_boolean (value));
+        }
+        break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -839,6 +870,14 @@ nautilus_search_popover_class_init (NautilusSearchPopoverClass *klass)
                                                            FALSE,
                                                            G_PARAM_READWRITE));
 
+    g_object_class_install_property (object_class,
+                                     PROP_PRUNE_ENABLED,
+                                     g_param_spec_boolean ("prune-enabled",
+                                                           "prune enabled",
+                                                           "Whether the folders of the prune patterns are skipped",
+                                                           TRUE,
+                                                           G_PARAM_READWRITE));
+
     gtk_widget_class_set_template_from_resource (widget_class, "/org/gnome/nautilus/ui/nautilus-search-popover.ui");
 
     gtk_widget_class_bind_template_child (widget_class, NautilusSearchPopover, around_revealer);
@@ -857,6 +896,7 @@ nautilus_search_popover_class_init (NautilusSearchPopoverClass *klass)
     gtk_widget_class_bind_template_child (widget_class, NautilusSearchPopover, last_modified_button);
     gtk_widget_class_bind_template_child (widget_class, NautilusSearchPopover, full_text_search_button);
     gtk_widget_class_bind_template_child (widget_class, NautilusSearchPopover, filename_search_button);
+    gtk_widget_class_bind_template_child (widget_class, NautilusSearchPopover, prune_button);
 
     gtk_widget_class_bind_template_callback (widget_class, calendar_day_selected);
     gtk_widget_class_bind_template_callback (widget_class, clear_date_button_clicked);
@@ -868,6 +908,7 @@ nautilus_search_popover_class_init (NautilusSearchPopoverClass *klass)
     gtk_widget_class_bind_template_callback (widget_class, types_listbox_row_activated);
     gtk_widget_class_bind_template_callback (widget_class, search_time_type_changed);
     gtk_widget_class_bind_template_callback (widget_class, search_fts_mode_changed);
+    gtk_widget_class_bind_template_callback (widget_class, search_prune_changed);
 }
 
 static void
@@ -918,6 +959,8 @@ nautilus_search_popover_init (NautilusSearchPopover *self)
     {
         gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (self->filename_search_button), TRUE);
     }
+
+    self->prune_enabled = TRUE;
 }
 
 GtkWidget *
@@ -973,9 +1016,15 @@ nautilus_search_popover_set_query (NautilusSearchPopover *popover,
 
         if (query)
         {
+            g_auto (GStrv) prune_patterns = NULL;
+
             /* Date */
             setup_date (popover, query);
 
+            prune_patterns = nautilus_query_get_prune_patterns (query);
+            gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (popover->prune_button),
+                                          prune_patterns != NULL);
+
             g_signal_connect (query,
                               "notify::date",
                               G_CALLBACK (query_date_changed),
@@ -985,6 +1034,7 @@ nautilus_search_popover_set_query (NautilusSearchPopover *popover,
         {
             nautilus_search_popover_reset_mime_types (popover);
             nautilus_search_popover_reset_date_range (popover);
+            gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (popover->prune_button), TRUE);
         }
     }
 }
@@ -1021,3 +1071,9 @@ nautilus_search_popover_get_fts_enabled (NautilusSearchPopover *popover)
 {
     return popover->fts_enabled;
 }
+
+gboolean
+nautilus_search_popover_get_prune_enabled (NautilusSearchPopover *popover)
+{
+    return popover->prune_enabled;
+}
@@ -28,6 +28,7 @@
 #include <glib/gi18n.h>
 #include <gdk/gdk.h>
 
+#include "nautilus-cache-registry.h"
 #include "nautilus-file.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-search-engine.h"
@@ -39,6 +40,27 @@
 #include "nautilus-shell-search-provider-generated.h"
 #include "nautilus-shell-search-provider.h"
 
+/* The shell only shows a few results, and searches again for the
+ * subsearches, so only the best hits are kept. */
+#define SEARCH_MAX_HITS 20
+
+/* Once there are enough hits, they are returned if none of the hits
+ * found for this long were better. */
+#define SEARCH_STABLE_TIMEOUT_MS 500
+
+/* The metas of this many results are kept, the least recently asked for
+ * going first. */
+#define METAS_CACHE_MAX_ENTRIES 256
+
+/* The complete hits of the last search, which the subsearches that only
+ * add to its terms can be answered from. */
+typedef struct
+{
+    NautilusQuery *query;
+    GPtrArray *hits;            /* By decreasing relevance */
+    GHashTable *names;
+} LastSearch;
+
 typedef struct
 {
     NautilusShellSearchProvider *self;
@@ -46,7 +68,11 @@ typedef struct
     NautilusSearchEngine *engine;
     NautilusQuery *query;
 
-    GHashTable *hits;
+    GHashTable *hits;           /* URI -> the hits of top_hits */
+    GPtrArray *top_hits;        /* By decreasing relevance */
+    GHashTable *names;          /* URI -> name, for the hits not matched on their file name */
+    gboolean truncated;         /* Whether hits were left out of top_hits */
+    guint stable_timeout_id;
     GDBusMethodInvocation *invocation;
 
     gint64 start_time;
@@ -59,8 +85,12 @@ struct _NautilusShellSearchProvider
     NautilusShellSearchProvider2 *skeleton;
 
     PendingSearch *current_search;
+    LastSearch *last_search;
 
+    /* URI -> ResultMeta, the most recently used ones in metas_lru */
     GHashTable *metas_cache;
+    GQueue metas_lru;
+    guint metas_cache_registry_id;
 };
 
 G_DEFINE_TYPE (NautilusShellSearchProvider, nautilus_shell_search_provider, G_TYPE_OBJECT)
@@ -116,7 +146,10 @@ get_gicon (NautilusShellSearchProvider *self,
 static void
 pending_search_free (PendingSearch *search)
 {
+    g_clear_handle_id (&search->stable_timeout_id, g_source_remove);
+    g_ptr_array_unref (search->top_hits);
     g_hash_table_destroy (search->hits);
+    g_hash_table_destroy (search->names);
     g_clear_object (&search->query);
     g_clear_object (&search->engine);
     g_clear_object (&search->invocation);
@@ -142,92 +175,204 @@ pending_search_finish (PendingSearch         *search,
     pending_search_free (search);
 }
 
+static void
+last_search_free (LastSearch *last_search)
+{
+    g_object_unref (last_search->query);
+    g_ptr_array_unref (last_search->hits);
+    g_hash_table_destroy (last_search->names);
+
+    g_slice_free (LastSearch, last_search);
+}
+
 static void
 cancel_current_search (NautilusShellSearchProvider *self)
 {
     if (self->current_search != NULL)
     {
+        /* Whatever it found so far is only part of its hits. */
+        self->current_search->truncated = TRUE;
         nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (self->current_search->engine));
     }
 }
 
-static void
-search_hits_added_cb (NautilusSearchEngine *engine,
-                      GList                *hits,
-                      gpointer              user_data)
+static gdouble
+get_relevance (gconstpointer hit)
 {
-    PendingSearch *search = user_data;
-    GList *l;
-    NautilusSearchHit *hit;
+    return nautilus_search_hit_get_relevance (NAUTILUS_SEARCH_HIT ((gpointer) hit));
+}
+
+/* Returns whether @hit made it into the best hits. */
+static gboolean
+search_add_hit (PendingSearch     *search,
+                NautilusSearchHit *hit)
+{
+    NautilusSearchHit *existing, *last;
     const gchar *hit_uri;
+    gdouble relevance;
+    guint low, high, middle;
 
-    g_debug ("*** Search engine hits added");
+    hit_uri = nautilus_search_hit_get_uri (hit);
+    relevance = nautilus_search_hit_get_relevance (hit);
 
-    for (l = hits; l != NULL; l = l->next)
+    /* A later hit for the same file replaces the earlier one. */
+    existing = g_hash_table_lookup (search->hits, hit_uri);
+    if (existing != NULL)
     {
-        hit = l->data;
-        nautilus_search_hit_compute_scores (hit, search->query);
-        hit_uri = nautilus_search_hit_get_uri (hit);
-        g_debug ("    %s", hit_uri);
+        g_ptr_array_remove (search->top_hits, existing);
+        g_hash_table_remove (search->hits, hit_uri);
+    }
+
+    if (search->top_hits->len == SEARCH_MAX_HITS &&
+        relevance <= get_relevance (g_ptr_array_index (search->top_hits, SEARCH_MAX_HITS - 1)))
+    {
+        search->truncated = TRUE;
+        return existing != NULL;
+    }
+
+    /* After the hits that are as relevant, as sorting did before */
+    low = 0;
+    high = search->top_hits->len;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (get_relevance (g_ptr_array_index (search->top_hits, middle)) >= relevance)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
 
-        g_hash_table_replace (search->hits, g_strdup (hit_uri), g_object_ref (hit));
+    g_ptr_array_insert (search->top_hits, low, hit);
+    g_hash_table_replace (search->hits, g_strdup (hit_uri), g_object_ref (hit));
+
+    if (search->top_hits->len > SEARCH_MAX_HITS)
+    {
+        last = g_ptr_array_remove_index (search->top_hits, SEARCH_MAX_HITS);
+        g_hash_table_remove (search->hits, nautilus_search_hit_get_uri (last));
+        search->truncated = TRUE;
     }
+
+    return TRUE;
 }
 
-static gint
-search_hit_compare_relevance (gconstpointer a,
-                              gconstpointer b)
+static GVariant *
+get_hits_variant (GPtrArray *hits)
 {
-    NautilusSearchHit *hit_a, *hit_b;
-    gdouble relevance_a, relevance_b;
-
-    hit_a = NAUTILUS_SEARCH_HIT ((gpointer) a);
-    hit_b = NAUTILUS_SEARCH_HIT ((gpointer) b);
+    GVariantBuilder builder;
 
-    relevance_a = nautilus_search_hit_get_relevance (hit_a);
-    relevance_b = nautilus_search_hit_get_relevance (hit_b);
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
 
-    if (relevance_a > relevance_b)
+    for (guint i = 0; i < hits->len; i++)
     {
-        return -1;
+        g_variant_builder_add (&builder, "s",
+                               nautilus_search_hit_get_uri (g_ptr_array_index (hits, i)));
     }
-    else if (relevance_a == relevance_b)
+
+    return g_variant_new ("(as)", &builder);
+}
+
+static void
+set_last_search (NautilusShellSearchProvider *self,
+                 NautilusQuery               *query,
+                 GPtrArray                   *hits,
+                 GHashTable                  *names)
+{
+    LastSearch *last_search;
+
+    last_search = g_slice_new0 (LastSearch);
+    last_search->query = g_object_ref (query);
+    last_search->hits = g_ptr_array_new_full (hits->len, g_object_unref);
+    for (guint i = 0; i < hits->len; i++)
     {
-        return 0;
+        g_ptr_array_add (last_search->hits, g_object_ref (g_ptr_array_index (hits, i)));
     }
+    last_search->names = g_hash_table_ref (names);
 
-    return 1;
+    g_clear_pointer (&self->last_search, last_search_free);
+    self->last_search = last_search;
 }
 
 static void
-search_finished_cb (NautilusSearchEngine         *engine,
-                    NautilusSearchProviderStatus  status,
-                    gpointer                      user_data)
+search_return_hits (PendingSearch *search)
 {
-    PendingSearch *search = user_data;
-    GList *hits, *l;
-    NautilusSearchHit *hit;
-    GVariantBuilder builder;
     gint64 current_time;
 
     current_time = g_get_monotonic_time ();
     g_debug ("*** Search engine search finished - time elapsed %dms",
              (gint) ((current_time - search->start_time) / 1000));
 
-    hits = g_hash_table_get_values (search->hits);
-    hits = g_list_sort (hits, search_hit_compare_relevance);
+    /* The engine may still be running when the hits are stable. */
+    g_signal_handlers_disconnect_by_data (search->engine, search);
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (search->engine));
 
-    g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+    if (!search->truncated)
+    {
+        set_last_search (search->self, search->query, search->top_hits, search->names);
+    }
+
+    pending_search_finish (search, search->invocation,
+                           get_hits_variant (search->top_hits));
+}
+
+static gboolean
+search_stable_timeout_cb (gpointer user_data)
+{
+    PendingSearch *search = user_data;
+
+    search->stable_timeout_id = 0;
+    /* The engine hasn't gone through everything yet. */
+    search->truncated = TRUE;
+
+    g_debug ("*** Search hits are stable");
+    search_return_hits (search);
 
+    return G_SOURCE_REMOVE;
+}
+
+static void
+search_hits_added_cb (NautilusSearchEngine *engine,
+                      GList                *hits,
+                      gpointer              user_data)
+{
+    PendingSearch *search = user_data;
+    GList *l;
+    NautilusSearchHit *hit;
+    gboolean changed;
+
+    g_debug ("*** Search engine hits added");
+
+    nautilus_search_hit_compute_scores_for_hits (hits, search->query);
+
+    changed = FALSE;
     for (l = hits; l != NULL; l = l->next)
     {
         hit = l->data;
-        g_variant_builder_add (&builder, "s", nautilus_search_hit_get_uri (hit));
+        g_debug ("    %s", nautilus_search_hit_get_uri (hit));
+
+        changed |= search_add_hit (search, hit);
     }
 
-    g_list_free (hits);
-    pending_search_finish (search, search->invocation,
-                           g_variant_new ("(as)", &builder));
+    if (changed && search->top_hits->len == SEARCH_MAX_HITS)
+    {
+        g_clear_handle_id (&search->stable_timeout_id, g_source_remove);
+        search->stable_timeout_id = g_timeout_add (SEARCH_STABLE_TIMEOUT_MS,
+                                                   search_stable_timeout_cb,
+                                                   search);
+    }
+}
+
+static void
+search_finished_cb (NautilusSearchEngine         *engine,
+                    NautilusSearchProviderStatus  status,
+                    gpointer                      user_data)
+{
+    PendingSearch *search = user_data;
+
+    search_return_hits (search);
 }
 
 static void
@@ -419,7 +564,10 @@ search_add_volumes_and_bookmarks (PendingSearch *search)
             hit = nautilus_search_hit_new (candidate->uri);
             nautilus_search_hit_set_fts_rank (hit, match);
             nautilus_search_hit_compute_scores (hit, search->query);
-            g_hash_table_replace (search->hits, g_strdup (candidate->uri), hit);
+            g_hash_table_replace (search->names, g_strdup (candidate->uri),
+                                  g_strdup (candidate->string_for_compare));
+            search_add_hit (search, hit);
+            g_object_unref (hit);
         }
     }
     g_list_free_full (candidates, (GDestroyNotify) search_hit_candidate_free);
@@ -443,9 +591,135 @@ shell_query_new (gchar **terms)
     return query;
 }
 
+/* Whether every file matching @query also matches @previous_query. */
+static gboolean
+query_narrows (NautilusQuery *query,
+               NautilusQuery *previous_query)
+{
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+    g_autoptr (NautilusQueryMatcher) previous_matcher = NULL;
+    const gchar * const *words;
+    const gchar * const *previous_words;
+    gboolean found;
+
+    matcher = nautilus_query_get_matcher (query);
+    previous_matcher = nautilus_query_get_matcher (previous_query);
+    words = nautilus_query_matcher_get_words (matcher);
+    previous_words = nautilus_query_matcher_get_words (previous_matcher);
+    if (words == NULL || previous_words == NULL)
+    {
+        return FALSE;
+    }
+
+    /* The matcher wants every word somewhere in the name, so a name
+     * containing a word also contains the words it contains. */
+    for (guint i = 0; previous_words[i] != NULL; i++)
+    {
+        found = FALSE;
+        for (guint j = 0; words[j] != NULL && !found; j++)
+        {
+            found = strstr (words[j], previous_words[i]) != NULL;
+        }
+
+        if (!found)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static gint
+compare_hits_by_relevance (gconstpointer a,
+                           gconstpointer b)
+{
+    gdouble relevance_a = get_relevance (*(gpointer *) a);
+    gdouble relevance_b = get_relevance (*(gpointer *) b);
+
+    return (relevance_a < relevance_b) - (relevance_a > relevance_b);
+}
+
+/* Answers a subsearch from the hits of the last search when they are
+ * known to contain all of its hits. Returns whether it did. */
+static gboolean
+refine_last_search (NautilusShellSearchProvider  *self,
+                    GDBusMethodInvocation        *invocation,
+                    gchar                       **previous_results,
+                    NautilusQuery                *query)
+{
+    LastSearch *last_search = self->last_search;
+    g_autoptr (GPtrArray) hits = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+    g_autoptr (GHashTable) previous_uris = NULL;
+    NautilusSearchHit *hit;
+    const gchar *uri;
+    g_autofree gchar *name = NULL;
+    gdouble match;
+
+    if (last_search == NULL || !query_narrows (query, last_search->query))
+    {
+        return FALSE;
+    }
+
+    /* Make sure the shell is refining that search. */
+    if (g_strv_length (previous_results) != last_search->hits->len)
+    {
+        return FALSE;
+    }
+    previous_uris = g_hash_table_new (g_str_hash, g_str_equal);
+    for (guint i = 0; previous_results[i] != NULL; i++)
+    {
+        g_hash_table_add (previous_uris, previous_results[i]);
+    }
+    for (guint i = 0; i < last_search->hits->len; i++)
+    {
+        uri = nautilus_search_hit_get_uri (g_ptr_array_index (last_search->hits, i));
+        if (!g_hash_table_contains (previous_uris, uri))
+        {
+            return FALSE;
+        }
+    }
+
+    matcher = nautilus_query_get_matcher (query);
+    hits = g_ptr_array_new_full (last_search->hits->len, g_object_unref);
+    for (guint i = 0; i < last_search->hits->len; i++)
+    {
+        hit = g_ptr_array_index (last_search->hits, i);
+        uri = nautilus_search_hit_get_uri (hit);
+
+        g_clear_pointer (&name, g_free);
+        name = g_strdup (g_hash_table_lookup (last_search->names, uri));
+        if (name == NULL)
+        {
+            g_autoptr (GFile) location = g_file_new_for_uri (uri);
+            g_autofree gchar *basename = g_file_get_basename (location);
+
+            name = basename != NULL ? g_filename_display_name (basename) : NULL;
+        }
+
+        match = name != NULL ? nautilus_query_matcher_match (matcher, name) : -1;
+        if (match > -1)
+        {
+            nautilus_search_hit_set_fts_rank (hit, match);
+            nautilus_search_hit_compute_scores (hit, query);
+            g_ptr_array_add (hits, g_object_ref (hit));
+        }
+    }
+    g_ptr_array_sort (hits, compare_hits_by_relevance);
+
+    g_debug ("*** Narrowed down the last search to %u hits", hits->len);
+
+    g_dbus_method_invocation_return_value (invocation, get_hits_variant (hits));
+    set_last_search (self, query, hits, last_search->names);
+
+    return TRUE;
+}
+
 static void
 execute_search (NautilusShellSearchProvider  *self,
                 GDBusMethodInvocation        *invocation,
+                gchar                       **previous_results,
                 gchar                       **terms)
 {
     NautilusQuery *query;
@@ -465,9 +739,18 @@ execute_search (NautilusShellSearchProvider  *self,
     nautilus_query_set_recursive (query, NAUTILUS_QUERY_RECURSIVE_INDEXED_ONLY);
     nautilus_query_set_show_hidden_files (query, FALSE);
 
+    if (previous_results != NULL &&
+        refine_last_search (self, invocation, previous_results, query))
+    {
+        g_object_unref (query);
+        return;
+    }
+
     pending_search = g_slice_new0 (PendingSearch);
     pending_search->invocation = g_object_ref (invocation);
     pending_search->hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+    pending_search->top_hits = g_ptr_array_sized_new (SEARCH_MAX_HITS + 1);
+    pending_search->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
     pending_search->query = query;
     pending_search->engine = nautilus_search_engine_new ();
     pending_search->start_time = g_get_monotonic_time ();
@@ -501,7 +784,7 @@ handle_get_initial_result_set (NautilusShellSearchProvider2  *skeleton,
     NautilusShellSearchProvider *self = user_data;
 
     g_debug ("****** GetInitialResultSet");
-    execute_search (self, invocation, terms);
+    execute_search (self, invocation, NULL, terms);
     return TRUE;
 }
 
@@ -515,134 +798,258 @@ handle_get_subsearch_result_set (NautilusShellSearchProvider2  *skeleton,
     NautilusShellSearchProvider *self = user_data;
 
     g_debug ("****** GetSubSearchResultSet");
-    execute_search (self, invocation, terms);
+    execute_search (self, invocation, previous_results, terms);
     return TRUE;
 }
 
+/* A cached meta, in metas_lru */
 typedef struct
 {
-    NautilusShellSearchProvider *self;
+    gchar *uri;
+    GVariant *meta;
+    /* Whether the icon is the file's, or still a generic one */
+    gboolean complete;
+    GList *link;
+} ResultMeta;
 
-    gint64 start_time;
-    GDBusMethodInvocation *invocation;
+static void
+result_meta_free (ResultMeta *result_meta)
+{
+    g_free (result_meta->uri);
+    g_variant_unref (result_meta->meta);
 
-    gchar **uris;
-} ResultMetasData;
+    g_free (result_meta);
+}
 
-static void
-result_metas_data_free (ResultMetasData *data)
+static ResultMeta *
+lookup_result_meta (NautilusShellSearchProvider *self,
+                    const gchar                 *uri)
 {
-    g_clear_object (&data->self);
-    g_clear_object (&data->invocation);
-    g_strfreev (data->uris);
+    ResultMeta *result_meta;
 
-    g_slice_free (ResultMetasData, data);
+    result_meta = g_hash_table_lookup (self->metas_cache, uri);
+    if (result_meta != NULL)
+    {
+        g_queue_unlink (&self->metas_lru, result_meta->link);
+        g_queue_push_head_link (&self->metas_lru, result_meta->link);
+    }
+
+    return result_meta;
 }
 
-static void
-result_metas_return_from_cache (ResultMetasData *data)
+static ResultMeta *
+cache_result_meta (NautilusShellSearchProvider *self,
+                   const gchar                 *uri,
+                   GVariant                    *meta,
+                   gboolean                     complete)
 {
-    GVariantBuilder builder;
-    GVariant *meta;
-    gint64 current_time;
-    gint idx;
+    ResultMeta *result_meta;
 
-    g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+    result_meta = lookup_result_meta (self, uri);
+    if (result_meta != NULL)
+    {
+        g_variant_unref (result_meta->meta);
+    }
+    else
+    {
+        result_meta = g_new0 (ResultMeta, 1);
+        result_meta->uri = g_strdup (uri);
+        g_queue_push_head (&self->metas_lru, result_meta);
+        result_meta->link = self->metas_lru.head;
+        g_hash_table_insert (self->metas_cache, result_meta->uri, result_meta);
+    }
+
+    result_meta->meta = g_variant_ref_sink (meta);
+    result_meta->complete = complete;
 
-    for (idx = 0; data->uris[idx] != NULL; idx++)
+    while (self->metas_lru.length > METAS_CACHE_MAX_ENTRIES)
     {
-        meta = g_hash_table_lookup (data->self->metas_cache,
-                                    data->uris[idx]);
-        g_variant_builder_add_value (&builder, meta);
+        ResultMeta *oldest;
+
+        oldest = g_queue_pop_tail (&self->metas_lru);
+        g_hash_table_remove (self->metas_cache, oldest->uri);
     }
 
-    current_time = g_get_monotonic_time ();
-    g_debug ("*** GetResultMetas completed - time elapsed %dms",
-             (gint) ((current_time - data->start_time) / 1000));
+    return result_meta;
+}
 
-    g_dbus_method_invocation_return_value (data->invocation,
-                                           g_variant_new ("(aa{sv})", &builder));
+static gsize
+get_metas_cache_size (gpointer user_data)
+{
+    NautilusShellSearchProvider *self = user_data;
+    gsize size;
+
+    size = 0;
+    for (GList *l = self->metas_lru.head; l != NULL; l = l->next)
+    {
+        ResultMeta *result_meta = l->data;
+
+        size += sizeof (ResultMeta) + strlen (result_meta->uri) +
+                g_variant_get_size (result_meta->meta);
+    }
+
+    return size;
 }
 
 static void
-result_list_attributes_ready_cb (GList    *file_list,
-                                 gpointer  user_data)
+shed_metas_cache (NautilusCacheShedLevel level,
+                  gpointer               user_data)
+{
+    NautilusShellSearchProvider *self = user_data;
+    guint keep;
+
+    keep = self->metas_lru.length;
+    switch (level)
+    {
+        case NAUTILUS_CACHE_SHED_SOME:
+        {
+            keep /= 2;
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_MOST:
+        {
+            keep /= 4;
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_ALL:
+        {
+            keep = 0;
+        }
+        break;
+    }
+
+    while (self->metas_lru.length > keep)
+    {
+        ResultMeta *oldest;
+
+        oldest = g_queue_pop_tail (&self->metas_lru);
+        g_hash_table_remove (self->metas_cache, oldest->uri);
+    }
+}
+
+/* Without the file info, the icon is the generic one of the type its name
+ * suggests. */
+static GIcon *
+get_generic_gicon (NautilusShellSearchProvider *self,
+                   NautilusFile                *file)
+{
+    GFile *location;
+    NautilusBookmark *bookmark;
+    NautilusBookmarkList *bookmarks;
+    g_autofree gchar *name = NULL;
+    g_autofree gchar *content_type = NULL;
+
+    bookmarks = nautilus_application_get_bookmarks (NAUTILUS_APPLICATION (g_application_get_default ()));
+
+    location = nautilus_file_get_location (file);
+    bookmark = nautilus_bookmark_list_item_with_location (bookmarks, location, NULL);
+    g_object_unref (location);
+
+    if (bookmark)
+    {
+        return nautilus_bookmark_get_icon (bookmark);
+    }
+
+    name = nautilus_file_get_name (file);
+    content_type = g_content_type_guess (name, NULL, 0, NULL);
+
+    return g_content_type_get_icon (content_type);
+}
+
+static GVariant *
+build_result_meta (NautilusShellSearchProvider *self,
+                   NautilusFile                *file,
+                   gboolean                     complete)
 {
-    ResultMetasData *data = user_data;
     GVariantBuilder meta;
-    NautilusFile *file;
     GFile *file_location;
-    GList *l;
     gchar *uri, *display_name;
     gchar *path, *description;
     gchar *thumbnail_path;
     GIcon *gicon;
     GFile *location;
-    GVariant *meta_variant;
     gint icon_scale;
 
-    icon_scale = gdk_monitor_get_scale_factor (gdk_display_get_monitor (gdk_display_get_default (), 0));
+    g_variant_builder_init (&meta, G_VARIANT_TYPE ("a{sv}"));
 
-    for (l = file_list; l != NULL; l = l->next)
-    {
-        file = l->data;
-        g_variant_builder_init (&meta, G_VARIANT_TYPE ("a{sv}"));
+    uri = nautilus_file_get_uri (file);
+    display_name = get_display_name (self, file);
+    file_location = nautilus_file_get_location (file);
+    path = g_file_get_path (file_location);
+    description = path ? g_path_get_dirname (path) : NULL;
+    g_object_unref (file_location);
 
-        uri = nautilus_file_get_uri (file);
-        display_name = get_display_name (data->self, file);
-        file_location = nautilus_file_get_location (file);
-        path = g_file_get_path (file_location);
-        description = path ? g_path_get_dirname (path) : NULL;
+    g_variant_builder_add (&meta, "{sv}",
+                           "id", g_variant_new_string (uri));
+    g_variant_builder_add (&meta, "{sv}",
+                           "name", g_variant_new_string (display_name));
+    /* Some backends like trash:/// don't have a path, so we show the uri itself. */
+    g_variant_builder_add (&meta, "{sv}",
+                           "description", g_variant_new_string (description ? description : uri));
 
-        g_variant_builder_add (&meta, "{sv}",
-                               "id", g_variant_new_string (uri));
-        g_variant_builder_add (&meta, "{sv}",
-                               "name", g_variant_new_string (display_name));
-        /* Some backends like trash:/// don't have a path, so we show the uri itself. */
-        g_variant_builder_add (&meta, "{sv}",
-                               "description", g_variant_new_string (description ? description : uri));
+    gicon = NULL;
+    thumbnail_path = complete ? nautilus_file_get_thumbnail_path (file) : NULL;
 
-        gicon = NULL;
-        thumbnail_path = nautilus_file_get_thumbnail_path (file);
+    if (!complete)
+    {
+        gicon = get_generic_gicon (self, file);
+    }
+    else if (thumbnail_path != NULL)
+    {
+        location = g_file_new_for_path (thumbnail_path);
+        gicon = g_file_icon_new (location);
 
-        if (thumbnail_path != NULL)
-        {
-            location = g_file_new_for_path (thumbnail_path);
-            gicon = g_file_icon_new (location);
+        g_free (thumbnail_path);
+        g_object_unref (location);
+    }
+    else
+    {
+        gicon = get_gicon (self, file);
+    }
 
-            g_free (thumbnail_path);
-            g_object_unref (location);
-        }
-        else
-        {
-            gicon = get_gicon (data->self, file);
-        }
+    if (gicon == NULL)
+    {
+        icon_scale = gdk_monitor_get_scale_factor (gdk_display_get_monitor (gdk_display_get_default (), 0));
+        gicon = G_ICON (nautilus_file_get_icon_pixbuf (file, 128, TRUE,
+                                                       icon_scale,
+                                                       NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS));
+    }
 
-        if (gicon == NULL)
-        {
-            gicon = G_ICON (nautilus_file_get_icon_pixbuf (file, 128, TRUE,
-                                                           icon_scale,
-                                                           NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS));
-        }
+    g_variant_builder_add (&meta, "{sv}",
+                           "icon", g_icon_serialize (gicon));
+    g_object_unref (gicon);
 
-        g_variant_builder_add (&meta, "{sv}",
-                               "icon", g_icon_serialize (gicon));
-        g_object_unref (gicon);
+    g_free (display_name);
+    g_free (path);
+    g_free (description);
+    g_free (uri);
 
-        meta_variant = g_variant_builder_end (&meta);
-        g_hash_table_insert (data->self->metas_cache,
-                             g_strdup (uri), g_variant_ref_sink (meta_variant));
+    return g_variant_builder_end (&meta);
+}
 
-        g_free (display_name);
-        g_free (path);
-        g_free (description);
-        g_free (uri);
+static void
+result_list_attributes_ready_cb (GList    *file_list,
+                                 gpointer  user_data)
+{
+    NautilusShellSearchProvider *self = user_data;
+    GList *l;
+
+    for (l = file_list; l != NULL && self->metas_cache != NULL; l = l->next)
+    {
+        g_autofree gchar *uri = NULL;
+
+        uri = nautilus_file_get_uri (l->data);
+        cache_result_meta (self, uri, build_result_meta (self, l->data, TRUE), TRUE);
     }
 
-    result_metas_return_from_cache (data);
-    result_metas_data_free (data);
+    g_object_unref (self);
 }
 
+/* The metas are returned right away, the ones of files without their info
+ * yet with a generic icon. The info is then loaded for the next time the
+ * shell asks, with the thumbnails. */
 static gboolean
 handle_get_result_metas (NautilusShellSearchProvider2  *skeleton,
                          GDBusMethodInvocation         *invocation,
@@ -651,41 +1058,62 @@ handle_get_result_metas (NautilusShellSearchProvider2  *skeleton,
 {
     NautilusShellSearchProvider *self = user_data;
     GList *missing_files = NULL;
+    GVariantBuilder builder;
     const gchar *uri;
-    ResultMetasData *data;
+    ResultMeta *result_meta;
+    gint64 start_time;
     gint idx;
 
     g_debug ("****** GetResultMetas");
 
+    start_time = g_get_monotonic_time ();
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
     for (idx = 0; results[idx] != NULL; idx++)
     {
         uri = results[idx];
 
-        if (!g_hash_table_lookup (self->metas_cache, uri))
+        result_meta = lookup_result_meta (self, uri);
+        if (result_meta == NULL)
         {
-            missing_files = g_list_prepend (missing_files, nautilus_file_get_by_uri (uri));
+            NautilusFile *file;
+            gboolean complete;
+
+            file = nautilus_file_get_by_uri (uri);
+            complete = nautilus_file_check_if_ready (file, NAUTILUS_FILE_ATTRIBUTES_FOR_ICON);
+            result_meta = cache_result_meta (self, uri,
+                                             build_result_meta (self, file, complete),
+                                             complete);
+
+            if (complete)
+            {
+                nautilus_file_unref (file);
+            }
+            else
+            {
+                missing_files = g_list_prepend (missing_files, file);
+            }
         }
+
+        g_variant_builder_add_value (&builder, result_meta->meta);
     }
 
-    data = g_slice_new0 (ResultMetasData);
-    data->self = g_object_ref (self);
-    data->invocation = g_object_ref (invocation);
-    data->start_time = g_get_monotonic_time ();
-    data->uris = g_strdupv (results);
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(aa{sv})", &builder));
+
+    g_debug ("*** GetResultMetas completed - time elapsed %dms",
+             (gint) ((g_get_monotonic_time () - start_time) / 1000));
 
-    if (missing_files == NULL)
+    if (missing_files != NULL)
     {
-        result_metas_return_from_cache (data);
-        result_metas_data_free (data);
-        return TRUE;
+        nautilus_file_list_call_when_ready (missing_files,
+                                            NAUTILUS_FILE_ATTRIBUTES_FOR_ICON,
+                                            NULL,
+                                            result_list_attributes_ready_cb,
+                                            g_object_ref (self));
+        nautilus_file_list_free (missing_files);
     }
 
-    nautilus_file_list_call_when_ready (missing_files,
-                                        NAUTILUS_FILE_ATTRIBUTES_FOR_ICON,
-                                        NULL,
-                                        result_list_attributes_ready_cb,
-                                        data);
-    nautilus_file_list_free (missing_files);
     return TRUE;
 }
 
@@ -753,8 +1181,11 @@ search_provider_dispose (GObject *obj)
     NautilusShellSearchProvider *self = NAUTILUS_SHELL_SEARCH_PROVIDER (obj);
 
     g_clear_object (&self->skeleton);
-    g_hash_table_destroy (self->metas_cache);
+    g_clear_handle_id (&self->metas_cache_registry_id, nautilus_cache_registry_remove);
+    g_clear_pointer (&self->metas_cache, g_hash_table_destroy);
+    g_queue_clear (&self->metas_lru);
     cancel_current_search (self);
+    g_clear_pointer (&self->last_search, last_search_free);
 
     G_OBJECT_CLASS (nautilus_shell_search_provider_parent_class)->dispose (obj);
 }
@@ -763,7 +1194,12 @@ static void
 nautilus_shell_search_provider_init (NautilusShellSearchProvider *self)
 {
     self->metas_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               g_free, (GDestroyNotify) g_variant_unref);
+                                               NULL, (GDestroyNotify) result_meta_free);
+    g_queue_init (&self->metas_lru);
+    self->metas_cache_registry_id = nautilus_cache_registry_add ("search result metas",
+                                                                 NAUTILUS_CACHE_PRIORITY_RECOMPUTABLE,
+                                                                 get_metas_cache_size,
+                                                                 shed_metas_cache, self);
 
     self->skeleton = nautilus_shell_search_provider2_skeleton_new ();
 
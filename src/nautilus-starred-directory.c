@@ -28,6 +28,8 @@ struct _NautilusFavoriteDirectory
 
     NautilusTagManager *tag_manager;
     GList *files;
+    /* NautilusFile -> its link in files */
+    GHashTable *file_links;
 
     GList *monitor_list;
     GList *callback_list;
@@ -94,94 +96,85 @@ disconnect_and_unmonitor_file (NautilusFile              *file,
 }
 
 static void
-nautilus_starred_directory_update_files (NautilusFavoriteDirectory *self)
+add_file (NautilusFavoriteDirectory *self,
+          NautilusFile              *file)
 {
-    GList *l;
-    GList *tmp_l;
-    GList *new_starred_files;
     GList *monitor_list;
     FavoriteMonitor *monitor;
-    NautilusFile *file;
-    GHashTable *uri_table;
-    GList *files_added;
-    GList *files_removed;
-    gchar *uri;
-
-    files_added = NULL;
-    files_removed = NULL;
 
-    uri_table = g_hash_table_new_full (g_str_hash,
-                                       g_str_equal,
-                                       (GDestroyNotify) g_free,
-                                       NULL);
+    g_signal_connect (file, "changed", G_CALLBACK (file_changed), self);
 
-    for (l = self->files; l != NULL; l = l->next)
+    for (monitor_list = self->monitor_list; monitor_list; monitor_list = monitor_list->next)
     {
-        g_hash_table_add (uri_table, nautilus_file_get_uri (NAUTILUS_FILE (l->data)));
+        monitor = monitor_list->data;
+
+        /* Add monitors */
+        nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
     }
 
-    new_starred_files = nautilus_tag_manager_get_starred_files (self->tag_manager);
+    self->files = g_list_prepend (self->files, nautilus_file_ref (file));
+    g_hash_table_insert (self->file_links, file, self->files);
+}
 
-    for (l = new_starred_files; l != NULL; l = l->next)
+/* Whether @file is to be listed, as nautilus_tag_manager_get_starred_files()
+ * only lists the starred files in the home directory. */
+static gboolean
+is_member (NautilusFavoriteDirectory *self,
+           NautilusFile              *file)
+{
+    g_autoptr (GFile) parent = NULL;
+
+    if (!nautilus_file_is_starred (file))
     {
-        if (!g_hash_table_contains (uri_table, l->data))
-        {
-            file = nautilus_file_get_by_uri ((gchar *) l->data);
+        return FALSE;
+    }
 
-            for (monitor_list = self->monitor_list; monitor_list; monitor_list = monitor_list->next)
-            {
-                monitor = monitor_list->data;
+    parent = nautilus_file_get_parent_location (file);
 
-                /* Add monitors */
-                nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
-            }
+    return parent != NULL && nautilus_tag_manager_can_star_contents (self->tag_manager, parent);
+}
 
-            g_signal_connect (file, "changed", G_CALLBACK (file_changed), self);
+static void
+nautilus_starred_directory_update_files (NautilusFavoriteDirectory *self,
+                                         GList                     *changed_files)
+{
+    GList *l;
+    GList *link;
+    NautilusFile *file;
+    GList *files_added;
+    GList *files_removed;
 
-            files_added = g_list_prepend (files_added, file);
-        }
-    }
+    files_added = NULL;
+    files_removed = NULL;
 
-    l = self->files;
-    while (l != NULL)
+    /* Only the files whose starred state changed are looked at, so starring
+     * a file costs the same however many files are starred already. */
+    for (l = changed_files; l != NULL; l = l->next)
     {
-        uri = nautilus_file_get_uri (NAUTILUS_FILE (l->data));
+        file = NAUTILUS_FILE (l->data);
+        link = g_hash_table_lookup (self->file_links, file);
 
-        if (!nautilus_tag_manager_file_is_starred (self->tag_manager, uri))
+        if (link == NULL && is_member (self, file))
         {
-            files_removed = g_list_prepend (files_removed,
-                                            nautilus_file_ref (NAUTILUS_FILE (l->data)));
-
-            disconnect_and_unmonitor_file (NAUTILUS_FILE (l->data), self);
-
-            if (l == self->files)
-            {
-                self->files = g_list_delete_link (self->files, l);
-                l = self->files;
-            }
-            else
-            {
-                tmp_l = l->prev;
-                self->files = g_list_delete_link (self->files, l);
-                l = tmp_l->next;
-            }
+            add_file (self, file);
+
+            files_added = g_list_prepend (files_added, nautilus_file_ref (file));
         }
-        else
+        else if (link != NULL && !is_member (self, file))
         {
-            l = l->next;
-        }
+            disconnect_and_unmonitor_file (file, self);
+
+            g_hash_table_remove (self->file_links, file);
+            self->files = g_list_delete_link (self->files, link);
 
-        g_free (uri);
+            /* Takes over the reference of the list */
+            files_removed = g_list_prepend (files_removed, file);
+        }
     }
 
     if (files_added)
     {
         nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), files_added);
-
-        for (l = files_added; l != NULL; l = l->next)
-        {
-            self->files = g_list_prepend (self->files, nautilus_file_ref (NAUTILUS_FILE (l->data)));
-        }
     }
 
     if (files_removed)
@@ -191,7 +184,6 @@ nautilus_starred_directory_update_files (NautilusFavoriteDirectory *self)
 
     nautilus_file_list_free (files_added);
     nautilus_file_list_free (files_removed);
-    g_hash_table_destroy (uri_table);
 }
 
 static void
@@ -203,21 +195,14 @@ on_starred_files_changed (NautilusTagManager *tag_manager,
 
     self = NAUTILUS_STARRED_DIRECTORY (user_data);
 
-    nautilus_starred_directory_update_files (self);
+    nautilus_starred_directory_update_files (self, changed_files);
 }
 
 static gboolean
 real_contains_file (NautilusDirectory *directory,
                     NautilusFile      *file)
 {
-    NautilusFavoriteDirectory *self;
-    g_autofree gchar *uri = NULL;
-
-    self = NAUTILUS_STARRED_DIRECTORY (directory);
-
-    uri = nautilus_file_get_uri (file);
-
-    return nautilus_tag_manager_file_is_starred (self->tag_manager, uri);
+    return nautilus_file_is_starred (file);
 }
 
 static gboolean
@@ -445,11 +430,6 @@ nautilus_starred_directory_set_files (NautilusFavoriteDirectory *self)
     GList *starred_files;
     NautilusFile *file;
     GList *l;
-    GList *file_list;
-    FavoriteMonitor *monitor;
-    GList *monitor_list;
-
-    file_list = NULL;
 
     starred_files = nautilus_tag_manager_get_starred_files (self->tag_manager);
 
@@ -457,22 +437,14 @@ nautilus_starred_directory_set_files (NautilusFavoriteDirectory *self)
     {
         file = nautilus_file_get_by_uri ((gchar *) l->data);
 
-        g_signal_connect (file, "changed", G_CALLBACK (file_changed), self);
-
-        for (monitor_list = self->monitor_list; monitor_list; monitor_list = monitor_list->next)
-        {
-            monitor = monitor_list->data;
-
-            /* Add monitors */
-            nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
-        }
+        add_file (self, file);
 
-        file_list = g_list_prepend (file_list, file);
+        nautilus_file_unref (file);
     }
 
-    nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), file_list);
+    g_list_free (starred_files);
 
-    self->files = file_list;
+    nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), self->files);
 }
 
 static void
@@ -482,6 +454,7 @@ real_force_reload (NautilusDirectory *directory)
 
     /* Unset current file list */
     g_list_foreach (self->files, (GFunc) disconnect_and_unmonitor_file, self);
+    g_hash_table_remove_all (self->file_links);
     g_clear_list (&self->files, g_object_unref);
 
     /* Set a fresh file list  */
@@ -500,6 +473,7 @@ nautilus_starred_directory_finalize (GObject *object)
                                           self);
 
     g_object_unref (self->tag_manager);
+    g_hash_table_destroy (self->file_links);
     nautilus_file_list_free (self->files);
 
     G_OBJECT_CLASS (nautilus_starred_directory_parent_class)->finalize (object);
@@ -569,6 +543,7 @@ static void
 nautilus_starred_directory_init (NautilusFavoriteDirectory *self)
 {
     self->tag_manager = nautilus_tag_manager_get ();
+    self->file_links = g_hash_table_new (NULL, NULL);
 
     g_signal_connect (self->tag_manager,
                       "starred-changed",
@@ -26,6 +26,7 @@
 #include "nautilus-debug.h"
 
 #include <gio/gunixinputstream.h>
+#include <glib/gstdio.h>
 #include <tracker-sparql.h>
 
 #include "config.h"
@@ -39,24 +40,53 @@ struct _NautilusTagManager
     TrackerNotifier *notifier;
 
     TrackerSparqlStatement *query_starred_files;
-    TrackerSparqlStatement *query_file_is_starred;
 
     GHashTable *starred_file_uris;
     GFile *home;
 
+    /* The starred URIs inside home, owned by starred_file_uris, as of
+     * starred_in_home_generation */
+    GList *starred_in_home;
+    guint starred_in_home_generation;
+
+    /* While the live query runs after loading the starred files from the
+     * cache, the URIs it returned so far, to drop the others once done */
+    GHashTable *queried_uris;
+    gboolean got_starred_files;
+
     GCancellable *cancellable;
 };
 
 G_DEFINE_TYPE (NautilusTagManager, nautilus_tag_manager, G_TYPE_OBJECT);
 
+/* Bumped whenever starred_file_uris changes */
+static guint starred_generation = 1;
+
+/* Updates are written this many files at a time, so that starring or
+ * moving thousands of files doesn't build one giant query string */
+#define UPDATE_CHUNK_SIZE 500
+
 typedef struct
 {
     NautilusTagManager *tag_manager;
     GTask *task;
     GList *selection;
     gboolean star;
+    GCancellable *cancellable;
+
+    /* The URIs of selection, and how many of them are written */
+    GPtrArray *uris;
+    guint n_written;
 } UpdateData;
 
+typedef struct
+{
+    NautilusTagManager *tag_manager;
+    GPtrArray *old_uris;
+    GPtrArray *new_uris;
+    guint n_written;
+} MoveData;
+
 enum
 {
     STARRED_CHANGED,
@@ -70,15 +100,14 @@ enum
     "        nautilus:starred true . " \
     "}"
 
-#define QUERY_FILE_IS_STARRED \
-    "ASK " \
-    "{ " \
-    "    ~file a nautilus:File ; " \
-    "        nautilus:starred true . " \
-    "}"
-
 static guint signals[LAST_SIGNAL];
 
+/* Bump this whenever the format below changes. */
+#define STARRED_CACHE_VERSION 1
+
+/* version, stamp of the database and the starred URIs */
+#define STARRED_CACHE_FORMAT "(usas)"
+
 /* Limit to 10MB output from Tracker -- surely, nobody has over a million starred files. */
 #define TRACKER2_MAX_IMPORT_BYTES 10 * 1024 * 1024
 
@@ -88,40 +117,314 @@ tracker2_migration_stamp (void)
     return g_build_filename (g_get_user_data_dir (), "nautilus", "tracker2-migration-complete", NULL);
 }
 
+static gchar *
+get_store_path (void)
+{
+    return g_build_filename (g_get_user_data_dir (), "nautilus", "tags", NULL);
+}
+
+static gchar *
+get_starred_cache_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "starred-files", NULL);
+}
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+    return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Changes with every write to the database, while it is closed: the names,
+ * sizes and modification times of its files. Tracker has no change token
+ * for a database of its own, and no one else writes to it.
+ */
+static gchar *
+get_database_stamp (void)
+{
+    g_autofree gchar *store_path = NULL;
+    g_autoptr (GFile) store = NULL;
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    g_autoptr (GPtrArray) entries = NULL;
+    GFileInfo *info;
+
+    store_path = get_store_path ();
+    store = g_file_new_for_path (store_path);
+    enumerator = g_file_enumerate_children (store,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    if (enumerator == NULL)
+    {
+        return NULL;
+    }
+
+    entries = g_ptr_array_new_with_free_func (g_free);
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+    {
+        g_ptr_array_add (entries,
+                         g_strdup_printf ("%s %" G_GOFFSET_FORMAT " %" G_GUINT64_FORMAT ".%06u",
+                                          g_file_info_get_name (info),
+                                          g_file_info_get_size (info),
+                                          g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                                          g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC)));
+        g_object_unref (info);
+    }
+    if (entries->len == 0)
+    {
+        return NULL;
+    }
+
+    g_ptr_array_sort (entries, compare_strings);
+    g_ptr_array_add (entries, NULL);
+
+    return g_strjoinv (";", (gchar **) entries->pdata);
+}
+
+/* Loads the starred files saved when the database was last closed, if it
+ * didn't change since, so that the emblems and the Starred view are right
+ * from the start. The live query still runs, to reconcile with it.
+ */
+static void
+load_starred_cache (NautilusTagManager *self)
+{
+    g_autofree gchar *path = NULL;
+    g_autofree gchar *stamp = NULL;
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (GVariant) cache = NULL;
+    g_autoptr (GVariantIter) iter = NULL;
+    guint32 version;
+    const gchar *cached_stamp;
+    const gchar *uri;
+
+    path = get_starred_cache_path ();
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        return;
+    }
+
+    bytes = g_mapped_file_get_bytes (mapped_file);
+    /* Not trusted, so that a corrupted file can't do any harm. */
+    cache = g_variant_new_from_bytes (G_VARIANT_TYPE (STARRED_CACHE_FORMAT), bytes, FALSE);
+
+    g_variant_get (cache, "(u&sas)", &version, &cached_stamp, &iter);
+    stamp = get_database_stamp ();
+    if (version != STARRED_CACHE_VERSION || g_strcmp0 (stamp, cached_stamp) != 0)
+    {
+        DEBUG ("Starred files cache %s is out of date", path);
+        return;
+    }
+
+    while (g_variant_iter_next (iter, "&s", &uri))
+    {
+        g_hash_table_add (self->starred_file_uris, g_strdup (uri));
+    }
+    starred_generation++;
+
+    self->queried_uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    DEBUG ("Loaded %u starred files from %s",
+           g_hash_table_size (self->starred_file_uris), path);
+}
+
+/* Only once the database is closed, for its stamp not to change anymore. */
 static void
-start_query_or_update (TrackerSparqlConnection *db,
-                       GString                 *query,
-                       GAsyncReadyCallback      callback,
-                       gpointer                 user_data,
-                       gboolean                 is_query,
-                       GCancellable            *cancellable)
+save_starred_cache (NautilusTagManager *self)
 {
+    g_autofree gchar *path = NULL;
+    g_autofree gchar *dirname = NULL;
+    g_autofree gchar *stamp = NULL;
+    g_autoptr (GVariant) cache = NULL;
     g_autoptr (GError) error = NULL;
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    const gchar *uri;
 
-    if (!db)
+    stamp = get_database_stamp ();
+    path = get_starred_cache_path ();
+    if (stamp == NULL)
+    {
+        g_unlink (path);
+        return;
+    }
+
+    dirname = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dirname, 0700) != 0)
     {
-        g_message ("nautilus-tag-manager: No Tracker connection");
         return;
     }
 
-    if (is_query)
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+    g_hash_table_iter_init (&iter, self->starred_file_uris);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &uri, NULL))
     {
-        tracker_sparql_connection_query_async (db,
-                                               query->str,
-                                               cancellable,
-                                               callback,
-                                               user_data);
+        g_variant_builder_add (&builder, "s", uri);
+    }
+
+    cache = g_variant_ref_sink (g_variant_new ("(us@as)",
+                                               STARRED_CACHE_VERSION,
+                                               stamp,
+                                               g_variant_builder_end (&builder)));
+
+    if (!g_file_set_contents_full (path,
+                                   g_variant_get_data (cache),
+                                   g_variant_get_size (cache),
+                                   G_FILE_SET_CONTENTS_CONSISTENT,
+                                   0600, &error))
+    {
+        DEBUG ("Failed to save the starred files cache: %s", error->message);
+    }
+}
+
+/* Keeps what the live query is reconciled with in line with the changes
+ * made meanwhile, so that they aren't undone once it is done. */
+static void
+track_queried_uri (NautilusTagManager *self,
+                   const gchar        *uri,
+                   gboolean            starred)
+{
+    if (self->queried_uris == NULL)
+    {
+        return;
+    }
+
+    if (starred)
+    {
+        g_hash_table_add (self->queried_uris, g_strdup (uri));
     }
     else
     {
-        tracker_sparql_connection_update_async (db,
-                                                query->str,
-                                                cancellable,
-                                                callback,
-                                                user_data);
+        g_hash_table_remove (self->queried_uris, uri);
     }
 }
 
+/* Drops the starred files loaded from the cache which the live query
+ * didn't return. */
+static void
+finish_reconciling (NautilusTagManager *self)
+{
+    GHashTableIter iter;
+    const gchar *uri;
+    GList *changed_files = NULL;
+
+    if (self->queried_uris == NULL)
+    {
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, self->starred_file_uris);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &uri, NULL))
+    {
+        if (!g_hash_table_contains (self->queried_uris, uri))
+        {
+            DEBUG ("Cached starred file %s isn't starred anymore", uri);
+            changed_files = g_list_prepend (changed_files, nautilus_file_get_by_uri (uri));
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+    g_clear_pointer (&self->queried_uris, g_hash_table_destroy);
+
+    if (changed_files != NULL)
+    {
+        starred_generation++;
+        g_signal_emit_by_name (self, "starred-changed", changed_files);
+        nautilus_file_list_free (changed_files);
+    }
+}
+
+/* Appends the triples starring @uris, from @start on, up to a chunk of them.
+ * Returns where the next chunk starts. */
+static guint
+append_starred_triples (GString   *query,
+                        GPtrArray *uris,
+                        guint      start)
+{
+    guint end = MIN (start + UPDATE_CHUNK_SIZE, uris->len);
+
+    for (guint i = start; i < end; i++)
+    {
+        g_string_append_printf (query,
+                                "    <%s> a nautilus:File ; "
+                                "        nautilus:starred true . ",
+                                (gchar *) g_ptr_array_index (uris, i));
+    }
+
+    return end;
+}
+
+/* Brings starred_file_uris in line with what was just written, all at once,
+ * rather than waiting for the notifier to go through it file by file.
+ * Returns whether anything changed. */
+static gboolean
+apply_starred_delta (NautilusTagManager *self,
+                     GPtrArray          *unstarred_uris,
+                     GPtrArray          *starred_uris)
+{
+    gboolean changed = FALSE;
+
+    for (guint i = 0; unstarred_uris != NULL && i < unstarred_uris->len; i++)
+    {
+        track_queried_uri (self, g_ptr_array_index (unstarred_uris, i), FALSE);
+        changed |= g_hash_table_remove (self->starred_file_uris,
+                                        g_ptr_array_index (unstarred_uris, i));
+    }
+
+    for (guint i = 0; starred_uris != NULL && i < starred_uris->len; i++)
+    {
+        const gchar *uri = g_ptr_array_index (starred_uris, i);
+
+        track_queried_uri (self, uri, TRUE);
+        if (!g_hash_table_contains (self->starred_file_uris, uri))
+        {
+            g_hash_table_add (self->starred_file_uris, g_strdup (uri));
+            changed = TRUE;
+        }
+    }
+
+    if (changed)
+    {
+        starred_generation++;
+    }
+
+    return changed;
+}
+
+static void
+update_data_free (UpdateData *data)
+{
+    nautilus_file_list_free (data->selection);
+    g_clear_object (&data->cancellable);
+    g_ptr_array_unref (data->uris);
+    g_free (data);
+}
+
+static void on_update_callback (GObject      *object,
+                                GAsyncResult *result,
+                                gpointer      user_data);
+
+static void
+write_next_update_chunk (UpdateData *data)
+{
+    g_autoptr (GString) query = NULL;
+
+    query = g_string_new (data->star ? "INSERT DATA {" : "DELETE DATA {");
+    data->n_written = append_starred_triples (query, data->uris, data->n_written);
+    g_string_append (query, "}");
+
+    tracker_sparql_connection_update_async (data->tag_manager->db,
+                                            query->str,
+                                            data->cancellable,
+                                            on_update_callback,
+                                            data);
+}
+
 static void
 on_update_callback (GObject      *object,
                     GAsyncResult *result,
@@ -139,9 +442,17 @@ on_update_callback (GObject      *object,
 
     tracker_sparql_connection_update_finish (db, result, &error);
 
+    if (error == NULL && data->n_written < data->uris->len)
+    {
+        write_next_update_chunk (data);
+        return;
+    }
+
     if (error == NULL)
     {
-        /* FIXME: make sure data->tag_manager->starred_file_uris is up to date */
+        apply_starred_delta (data->tag_manager,
+                             data->star ? NULL : data->uris,
+                             data->star ? data->uris : NULL);
 
         if (!nautilus_file_undo_manager_is_operating ())
         {
@@ -169,8 +480,7 @@ on_update_callback (GObject      *object,
         g_object_unref (data->task);
     }
 
-    nautilus_file_list_free (data->selection);
-    g_free (data);
+    update_data_free (data);
 }
 
 /**
@@ -184,7 +494,13 @@ nautilus_tag_manager_get_starred_files (NautilusTagManager *self)
 {
     GHashTableIter starred_iter;
     gchar *starred_uri;
-    GList *starred_file_uris = NULL;
+
+    if (self->starred_in_home_generation == starred_generation)
+    {
+        return g_list_copy (self->starred_in_home);
+    }
+
+    g_clear_pointer (&self->starred_in_home, g_list_free);
 
     g_hash_table_iter_init (&starred_iter, self->starred_file_uris);
     while (g_hash_table_iter_next (&starred_iter, (gpointer *) &starred_uri, NULL))
@@ -195,11 +511,12 @@ nautilus_tag_manager_get_starred_files (NautilusTagManager *self)
          * See comment on nautilus_tag_manager_can_star_contents() */
         if (g_file_has_prefix (file, self->home))
         {
-            starred_file_uris = g_list_prepend (starred_file_uris, starred_uri);
+            self->starred_in_home = g_list_prepend (self->starred_in_home, starred_uri);
         }
     }
+    self->starred_in_home_generation = starred_generation;
 
-    return starred_file_uris;
+    return g_list_copy (self->starred_in_home);
 }
 
 static void
@@ -226,6 +543,13 @@ on_get_starred_files_cursor_callback (GObject      *object,
         if (error != NULL)
         {
             g_warning ("Error on getting all tags cursor callback: %s", error->message);
+            /* Keep the cached ones, rather than dropping the rest */
+            g_clear_pointer (&self->queried_uris, g_hash_table_destroy);
+        }
+        else
+        {
+            finish_reconciling (self);
+            self->got_starred_files = TRUE;
         }
 
         g_clear_object (&cursor);
@@ -234,21 +558,28 @@ on_get_starred_files_cursor_callback (GObject      *object,
 
     url = tracker_sparql_cursor_get_string (cursor, 0, NULL);
 
-    g_hash_table_add (self->starred_file_uris, g_strdup (url));
+    track_queried_uri (self, url, TRUE);
 
-    file = nautilus_file_get_by_uri (url);
-
-    if (file)
+    /* Already there when loaded from the cache */
+    if (!g_hash_table_contains (self->starred_file_uris, url))
     {
-        changed_files = g_list_prepend (NULL, file);
+        g_hash_table_add (self->starred_file_uris, g_strdup (url));
+        starred_generation++;
 
-        g_signal_emit_by_name (self, "starred-changed", changed_files);
+        file = nautilus_file_get_by_uri (url);
 
-        nautilus_file_list_free (changed_files);
-    }
-    else
-    {
-        DEBUG ("File %s is starred but not found", url);
+        if (file)
+        {
+            changed_files = g_list_prepend (NULL, file);
+
+            g_signal_emit_by_name (self, "starred-changed", changed_files);
+
+            nautilus_file_list_free (changed_files);
+        }
+        else
+        {
+            DEBUG ("File %s is starred but not found", url);
+        }
     }
 
     tracker_sparql_cursor_next_async (cursor,
@@ -280,6 +611,7 @@ on_get_starred_files_query_callback (GObject      *object,
         {
             g_warning ("Error on getting starred files: %s", error->message);
         }
+        g_clear_pointer (&self->queried_uris, g_hash_table_destroy);
     }
     else
     {
@@ -308,67 +640,58 @@ nautilus_tag_manager_query_starred_files (NautilusTagManager *self,
                                             self);
 }
 
-static GString *
-nautilus_tag_manager_delete_tag (NautilusTagManager *self,
-                                 GList              *selection)
+/**
+ * nautilus_tag_manager_get_starred_generation:
+ *
+ * Returns: a number that changes whenever files get starred or unstarred,
+ * so that results of nautilus_tag_manager_file_is_starred() can be cached
+ * until then.
+ */
+guint
+nautilus_tag_manager_get_starred_generation (void)
 {
-    GString *query;
-    NautilusFile *file;
-    GList *l;
-
-    query = g_string_new ("DELETE DATA {");
-
-    for (l = selection; l != NULL; l = l->next)
-    {
-        g_autofree gchar *uri = NULL;
-
-        file = l->data;
-
-        uri = nautilus_file_get_uri (file);
-        g_string_append_printf (query,
-                                "    <%s> a nautilus:File ; "
-                                "        nautilus:starred true . ",
-                                uri);
-    }
-
-    g_string_append (query, "}");
+    return starred_generation;
+}
 
-    return query;
+gboolean
+nautilus_tag_manager_file_is_starred (NautilusTagManager *self,
+                                      const gchar        *file_uri)
+{
+    return g_hash_table_contains (self->starred_file_uris, file_uri);
 }
 
-static GString *
-nautilus_tag_manager_insert_tag (NautilusTagManager *self,
-                                 GList              *selection)
+static void
+update_starred (NautilusTagManager  *self,
+                GObject             *object,
+                GList               *selection,
+                gboolean             star,
+                GAsyncReadyCallback  callback,
+                GCancellable        *cancellable)
 {
-    GString *query;
-    NautilusFile *file;
-    GList *l;
+    UpdateData *update_data;
 
-    query = g_string_new ("INSERT DATA {");
+    DEBUG ("%s %i files", star ? "Starring" : "Unstarring", g_list_length (selection));
 
-    for (l = selection; l != NULL; l = l->next)
+    if (!self->db)
     {
-        g_autofree gchar *uri = NULL;
-
-        file = l->data;
-
-        uri = nautilus_file_get_uri (file);
-        g_string_append_printf (query,
-                                "    <%s> a nautilus:File ; "
-                                "        nautilus:starred true . ",
-                                uri);
+        g_message ("nautilus-tag-manager: No Tracker connection");
+        return;
     }
 
-    g_string_append (query, "}");
+    update_data = g_new0 (UpdateData, 1);
+    update_data->task = g_task_new (object, cancellable, callback, NULL);
+    update_data->tag_manager = self;
+    update_data->selection = nautilus_file_list_copy (selection);
+    update_data->star = star;
+    update_data->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+    update_data->uris = g_ptr_array_new_with_free_func (g_free);
 
-    return query;
-}
+    for (GList *l = selection; l != NULL; l = l->next)
+    {
+        g_ptr_array_add (update_data->uris, nautilus_file_get_uri (l->data));
+    }
 
-gboolean
-nautilus_tag_manager_file_is_starred (NautilusTagManager *self,
-                                      const gchar        *file_uri)
-{
-    return g_hash_table_contains (self->starred_file_uris, file_uri);
+    write_next_update_chunk (update_data);
 }
 
 void
@@ -378,31 +701,7 @@ nautilus_tag_manager_star_files (NautilusTagManager  *self,
                                  GAsyncReadyCallback  callback,
                                  GCancellable        *cancellable)
 {
-    GString *query;
-    g_autoptr (GError) error = NULL;
-    GTask *task;
-    UpdateData *update_data;
-
-    DEBUG ("Starring %i files", g_list_length (selection));
-
-    task = g_task_new (object, cancellable, callback, NULL);
-
-    query = nautilus_tag_manager_insert_tag (self, selection);
-
-    update_data = g_new0 (UpdateData, 1);
-    update_data->task = task;
-    update_data->tag_manager = self;
-    update_data->selection = nautilus_file_list_copy (selection);
-    update_data->star = TRUE;
-
-    start_query_or_update (self->db,
-                           query,
-                           on_update_callback,
-                           update_data,
-                           FALSE,
-                           cancellable);
-
-    g_string_free (query, TRUE);
+    update_starred (self, object, selection, TRUE, callback, cancellable);
 }
 
 void
@@ -412,30 +711,50 @@ nautilus_tag_manager_unstar_files (NautilusTagManager  *self,
                                    GAsyncReadyCallback  callback,
                                    GCancellable        *cancellable)
 {
-    GString *query;
-    GTask *task;
-    UpdateData *update_data;
+    update_starred (self, object, selection, FALSE, callback, cancellable);
+}
 
-    DEBUG ("Unstarring %i files", g_list_length (selection));
+/* Finds which of @urns are starred, asking for a chunk of them at a time
+ * rather than for each one. Returns NULL on errors. */
+static GHashTable *
+query_starred_among (NautilusTagManager *self,
+                     GPtrArray          *urns)
+{
+    g_autoptr (GHashTable) starred = NULL;
 
-    task = g_task_new (object, cancellable, callback, NULL);
+    starred = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-    query = nautilus_tag_manager_delete_tag (self, selection);
+    for (guint start = 0; start < urns->len; start += UPDATE_CHUNK_SIZE)
+    {
+        g_autoptr (GString) query = NULL;
+        g_autoptr (TrackerSparqlCursor) cursor = NULL;
+        g_autoptr (GError) error = NULL;
 
-    update_data = g_new0 (UpdateData, 1);
-    update_data->task = task;
-    update_data->tag_manager = self;
-    update_data->selection = nautilus_file_list_copy (selection);
-    update_data->star = FALSE;
+        query = g_string_new ("SELECT ?file { VALUES ?file {");
+        for (guint i = start; i < MIN (start + UPDATE_CHUNK_SIZE, urns->len); i++)
+        {
+            g_string_append_printf (query, " <%s>", (gchar *) g_ptr_array_index (urns, i));
+        }
+        g_string_append (query,
+                         " } "
+                         "    ?file a nautilus:File ; "
+                         "        nautilus:starred true . "
+                         "}");
+
+        cursor = tracker_sparql_connection_query (self->db, query->str, NULL, &error);
+        while (cursor != NULL && tracker_sparql_cursor_next (cursor, NULL, &error))
+        {
+            g_hash_table_add (starred, g_strdup (tracker_sparql_cursor_get_string (cursor, 0, NULL)));
+        }
 
-    start_query_or_update (self->db,
-                           query,
-                           on_update_callback,
-                           update_data,
-                           FALSE,
-                           cancellable);
+        if (error != NULL)
+        {
+            g_warning ("Couldn't query the starred files database: '%s'", error->message);
+            return NULL;
+        }
+    }
 
-    g_string_free (query, TRUE);
+    return g_steal_pointer (&starred);
 }
 
 static void
@@ -445,77 +764,63 @@ on_tracker_notifier_events (TrackerNotifier *notifier,
                             GPtrArray       *events,
                             gpointer         user_data)
 {
-    TrackerNotifierEvent *event;
     NautilusTagManager *self;
-    int i;
-    const gchar *file_url;
-    GError *error = NULL;
-    TrackerSparqlCursor *cursor;
-    gboolean query_has_results = FALSE;
-    gboolean starred;
-    GList *changed_files;
-    NautilusFile *changed_file;
+    g_autoptr (GPtrArray) urns = NULL;
+    g_autoptr (GHashTable) starred = NULL;
+    GList *changed_files = NULL;
 
     self = NAUTILUS_TAG_MANAGER (user_data);
 
-    for (i = 0; i < events->len; i++)
+    urns = g_ptr_array_sized_new (events->len);
+    for (guint i = 0; i < events->len; i++)
     {
-        event = g_ptr_array_index (events, i);
+        TrackerNotifierEvent *event = g_ptr_array_index (events, i);
 
-        file_url = tracker_notifier_event_get_urn (event);
-        changed_file = NULL;
+        g_ptr_array_add (urns, (gpointer) tracker_notifier_event_get_urn (event));
+    }
 
-        DEBUG ("Got event for file %s", file_url);
+    starred = query_starred_among (self, urns);
+    if (starred == NULL)
+    {
+        return;
+    }
 
-        tracker_sparql_statement_bind_string (self->query_file_is_starred, "file", file_url);
-        cursor = tracker_sparql_statement_execute (self->query_file_is_starred,
-                                                   NULL,
-                                                   &error);
+    for (guint i = 0; i < urns->len; i++)
+    {
+        const gchar *file_url = g_ptr_array_index (urns, i);
+        gboolean changed = FALSE;
 
-        if (cursor)
-        {
-            query_has_results = tracker_sparql_cursor_next (cursor, NULL, &error);
-        }
+        DEBUG ("Got event for file %s", file_url);
 
-        if (error || !cursor || !query_has_results)
-        {
-            g_warning ("Couldn't query the starred files database: '%s'", error ? error->message : "(null error)");
-            g_clear_error (&error);
-            return;
-        }
+        track_queried_uri (self, file_url, g_hash_table_contains (starred, file_url));
 
-        starred = tracker_sparql_cursor_get_boolean (cursor, 0);
-        if (starred)
+        if (g_hash_table_contains (starred, file_url))
         {
-            gboolean inserted = g_hash_table_add (self->starred_file_uris, g_strdup (file_url));
-
-            if (inserted)
+            if (!g_hash_table_contains (self->starred_file_uris, file_url))
             {
                 DEBUG ("Added %s to starred files list", file_url);
-                changed_file = nautilus_file_get_by_uri (file_url);
+                g_hash_table_add (self->starred_file_uris, g_strdup (file_url));
+                changed = TRUE;
             }
         }
-        else
+        else if (g_hash_table_remove (self->starred_file_uris, file_url))
         {
-            gboolean removed = g_hash_table_remove (self->starred_file_uris, file_url);
-
-            if (removed)
-            {
-                DEBUG ("Removed %s from starred files list", file_url);
-                changed_file = nautilus_file_get_by_uri (file_url);
-            }
+            DEBUG ("Removed %s from starred files list", file_url);
+            changed = TRUE;
         }
 
-        if (changed_file)
+        if (changed)
         {
-            changed_files = g_list_prepend (NULL, changed_file);
-
-            g_signal_emit_by_name (self, "starred-changed", changed_files);
-
-            nautilus_file_list_free (changed_files);
+            changed_files = g_list_prepend (changed_files, nautilus_file_get_by_uri (file_url));
         }
+    }
 
-        g_object_unref (cursor);
+    /* Our own updates are applied already, so this is mostly for others' */
+    if (changed_files != NULL)
+    {
+        starred_generation++;
+        g_signal_emit_by_name (self, "starred-changed", changed_files);
+        nautilus_file_list_free (changed_files);
     }
 }
 
@@ -534,10 +839,17 @@ nautilus_tag_manager_finalize (GObject *object)
     }
 
     g_clear_object (&self->notifier);
-    g_clear_object (&self->db);
-    g_clear_object (&self->query_file_is_starred);
     g_clear_object (&self->query_starred_files);
+    g_clear_object (&self->db);
+
+    /* Unless the live query didn't get to the end */
+    if (self->got_starred_files)
+    {
+        save_starred_cache (self);
+    }
+    g_clear_pointer (&self->queried_uris, g_hash_table_destroy);
 
+    g_list_free (self->starred_in_home);
     g_hash_table_destroy (self->starred_file_uris);
     g_clear_object (&self->home);
 
@@ -606,7 +918,7 @@ setup_database (NautilusTagManager  *self,
 
     datadir = NAUTILUS_DATADIR;
 
-    store_path = g_build_filename (g_get_user_data_dir (), "nautilus", "tags", NULL);
+    store_path = get_store_path ();
     ontology_path = g_build_filename (datadir, "ontology", NULL);
 
     store = g_file_new_for_path (store_path);
@@ -624,16 +936,6 @@ setup_database (NautilusTagManager  *self,
     }
 
     /* Prepare reusable queries. */
-    self->query_file_is_starred = tracker_sparql_connection_query_statement (self->db,
-                                                                             QUERY_FILE_IS_STARRED,
-                                                                             cancellable,
-                                                                             error);
-
-    if (*error)
-    {
-        return FALSE;
-    }
-
     self->query_starred_files = tracker_sparql_connection_query_statement (self->db,
                                                                            QUERY_STARRED_FILES,
                                                                            cancellable,
@@ -654,11 +956,20 @@ nautilus_tag_manager_set_cancellable (NautilusTagManager *self,
 {
     g_autoptr (GError) error = NULL;
 
+    /* Before opening the database, which may write to it */
+    load_starred_cache (self);
+
     self->database_ok = setup_database (self, cancellable, &error);
 
     if (error)
     {
         g_warning ("Unable to initialize tag manager: %s", error->message);
+        g_clear_pointer (&self->queried_uris, g_hash_table_destroy);
+        if (g_hash_table_size (self->starred_file_uris) > 0)
+        {
+            g_hash_table_remove_all (self->starred_file_uris);
+            starred_generation++;
+        }
         return;
     }
 
@@ -680,6 +991,7 @@ nautilus_tag_manager_init (NautilusTagManager *self)
                                                      (GDestroyNotify) g_free,
                                                      /* values are keys */
                                                      NULL);
+    starred_generation++;
     self->home = g_file_new_for_path (g_get_home_dir ());
 }
 
@@ -694,36 +1006,79 @@ nautilus_tag_manager_can_star_contents (NautilusTagManager *tag_manager,
     return g_file_has_prefix (directory, tag_manager->home) || g_file_equal (directory, tag_manager->home);
 }
 
+static void
+move_data_free (MoveData *data)
+{
+    g_ptr_array_unref (data->old_uris);
+    g_ptr_array_unref (data->new_uris);
+    g_free (data);
+}
+
+static void update_moved_uris_callback (GObject      *object,
+                                        GAsyncResult *result,
+                                        gpointer      user_data);
+
+static void
+write_next_move_chunk (MoveData *data)
+{
+    g_autoptr (GString) query = NULL;
+    guint start = data->n_written;
+
+    query = g_string_new ("DELETE DATA {");
+    append_starred_triples (query, data->old_uris, start);
+    g_string_append (query, "} ; INSERT DATA {");
+    data->n_written = append_starred_triples (query, data->new_uris, start);
+    g_string_append (query, "}");
+
+    tracker_sparql_connection_update_async (data->tag_manager->db,
+                                            query->str,
+                                            data->tag_manager->cancellable,
+                                            update_moved_uris_callback,
+                                            data);
+}
+
 static void
 update_moved_uris_callback (GObject      *object,
                             GAsyncResult *result,
                             gpointer      user_data)
 {
     g_autoptr (GError) error = NULL;
-    g_autoptr (GPtrArray) new_uris = user_data;
+    MoveData *data = user_data;
 
     tracker_sparql_connection_update_finish (TRACKER_SPARQL_CONNECTION (object),
                                              result,
                                              &error);
 
-    if (error != NULL && error->code != G_IO_ERROR_CANCELLED)
+    if (error == NULL && data->n_written < data->new_uris->len)
     {
-        g_warning ("Error updating moved uris: %s", error->message);
+        write_next_move_chunk (data);
+        return;
+    }
+
+    if (error != NULL)
+    {
+        if (error->code != G_IO_ERROR_CANCELLED)
+        {
+            g_warning ("Error updating moved uris: %s", error->message);
+        }
     }
     else
     {
         g_autolist (NautilusFile) updated_files = NULL;
-        g_autoptr (NautilusTagManager) tag_manager = nautilus_tag_manager_get ();
 
-        for (guint i = 0; i < new_uris->len; i++)
+        apply_starred_delta (data->tag_manager, data->old_uris, data->new_uris);
+
+        for (guint i = 0; i < data->new_uris->len; i++)
         {
-            gchar *new_uri = g_ptr_array_index (new_uris, i);
+            gchar *new_uri = g_ptr_array_index (data->new_uris, i);
 
             updated_files = g_list_prepend (updated_files, nautilus_file_get_by_uri (new_uri));
         }
 
-        g_signal_emit_by_name (tag_manager, "starred-changed", updated_files);
+        g_signal_emit_by_name (data->tag_manager, "starred-changed", updated_files);
     }
+
+    move_data_free (data);
 }
 
 /**
@@ -744,7 +1099,7 @@ nautilus_tag_manager_update_moved_uris (NautilusTagManager *self,
     gchar *starred_uri;
     g_autoptr (GPtrArray) old_uris = NULL;
     g_autoptr (GPtrArray) new_uris = NULL;
-    g_autoptr (GString) query = NULL;
+    MoveData *data;
 
     if (!self->database_ok)
     {
@@ -752,7 +1107,7 @@ nautilus_tag_manager_update_moved_uris (NautilusTagManager *self,
         return;
     }
 
-    old_uris = g_ptr_array_new ();
+    old_uris = g_ptr_array_new_with_free_func (g_free);
     new_uris = g_ptr_array_new_with_free_func (g_free);
 
     g_hash_table_iter_init (&starred_iter, self->starred_file_uris);
@@ -766,7 +1121,7 @@ nautilus_tag_manager_update_moved_uris (NautilusTagManager *self,
         if (g_file_equal (starred_location, src))
         {
             /* The moved file/folder is starred */
-            g_ptr_array_add (old_uris, starred_uri);
+            g_ptr_array_add (old_uris, g_strdup (starred_uri));
             g_ptr_array_add (new_uris, g_file_get_uri (dest));
             continue;
         }
@@ -779,7 +1134,7 @@ nautilus_tag_manager_update_moved_uris (NautilusTagManager *self,
 
             new_location = g_file_resolve_relative_path (dest, relative_path);
 
-            g_ptr_array_add (old_uris, starred_uri);
+            g_ptr_array_add (old_uris, g_strdup (starred_uri));
             g_ptr_array_add (new_uris, g_file_get_uri (new_location));
         }
     }
@@ -792,39 +1147,15 @@ nautilus_tag_manager_update_moved_uris (NautilusTagManager *self,
 
     DEBUG ("Updating moved URI for %i starred files", new_uris->len);
 
-    query = g_string_new ("DELETE DATA {");
-
-    for (guint i = 0; i < old_uris->len; i++)
-    {
-        gchar *old_uri = g_ptr_array_index (old_uris, i);
-        g_string_append_printf (query,
-                                "    <%s> a nautilus:File ; "
-                                "        nautilus:starred true . ",
-                                old_uri);
-    }
-
-    g_string_append (query, "} ; INSERT DATA {");
-
-    for (guint i = 0; i < new_uris->len; i++)
-    {
-        gchar *new_uri = g_ptr_array_index (new_uris, i);
-        g_string_append_printf (query,
-                                "    <%s> a nautilus:File ; "
-                                "        nautilus:starred true . ",
-                                new_uri);
-    }
-
-    g_string_append (query, "}");
-
-    /* Forward the new_uris list to later pass in the ::files-changed signal.
-     * There is no need to pass the old_uris because the file model is updated
+    /* The new URIs are passed on in the ::starred-changed signal. There is
+     * no need to pass the old ones because the file model is updated
      * independently; we need only inform the view where to display stars now.
      */
-    tracker_sparql_connection_update_async (self->db,
-                                            query->str,
-                                            self->cancellable,
-                                            update_moved_uris_callback,
-                                            g_steal_pointer (&new_uris));
+    data = g_new0 (MoveData, 1);
+    data->tag_manager = self;
+    data->old_uris = g_steal_pointer (&old_uris);
+    data->new_uris = g_steal_pointer (&new_uris);
+    write_next_move_chunk (data);
 }
 
 static void
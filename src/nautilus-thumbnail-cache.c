@@ -0,0 +1,183 @@
+/* nautilus-thumbnail-cache.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-thumbnail-cache.h"
+
+#include "nautilus-cache-registry.h"
+#include "nautilus-file-private.h"
+#include "nautilus-global-preferences.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_THUMBNAILS
+#include "nautilus-debug.h"
+
+typedef struct
+{
+    /* Of NautilusFile, not referenced: the most recently used first */
+    GQueue files;
+    gsize total_bytes;
+} NautilusThumbnailCache;
+
+static gsize
+get_pixbuf_bytes (GdkPixbuf *pixbuf)
+{
+    return pixbuf != NULL ? gdk_pixbuf_get_byte_length (pixbuf) : 0;
+}
+
+static gsize
+get_budget (void)
+{
+    return g_settings_get_uint64 (nautilus_preferences,
+                                  NAUTILUS_PREFERENCES_THUMBNAIL_CACHE_SIZE) * 1024 * 1024;
+}
+
+/* Drops the thumbnails of the least recently used files until the cache
+ * is down to @bytes. */
+static void
+trim_to (NautilusThumbnailCache *cache,
+         gsize                   bytes)
+{
+    while (cache->total_bytes > bytes && !g_queue_is_empty (&cache->files))
+    {
+        NautilusFile *file;
+
+        file = g_queue_peek_tail (&cache->files);
+        DEBUG ("Evicting the thumbnail of %s", file->details->name);
+
+        nautilus_thumbnail_cache_forget (file);
+        nautilus_file_drop_loaded_thumbnail (file);
+    }
+}
+
+static gsize
+get_cache_size (gpointer user_data)
+{
+    NautilusThumbnailCache *cache = user_data;
+
+    return cache->total_bytes;
+}
+
+static void
+shed_cache (NautilusCacheShedLevel  level,
+            gpointer                user_data)
+{
+    NautilusThumbnailCache *cache = user_data;
+
+    switch (level)
+    {
+        case NAUTILUS_CACHE_SHED_SOME:
+        {
+            trim_to (cache, cache->total_bytes / 2);
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_MOST:
+        {
+            trim_to (cache, cache->total_bytes / 4);
+        }
+        break;
+
+        case NAUTILUS_CACHE_SHED_ALL:
+        {
+            trim_to (cache, 0);
+        }
+        break;
+    }
+}
+
+static NautilusThumbnailCache *
+get_cache (void)
+{
+    static NautilusThumbnailCache *cache = NULL;
+
+    if (cache == NULL)
+    {
+        cache = g_new0 (NautilusThumbnailCache, 1);
+        g_queue_init (&cache->files);
+
+        /* What can be reloaded from disk goes first */
+        nautilus_cache_registry_add ("thumbnails",
+                                     NAUTILUS_CACHE_PRIORITY_RELOADABLE,
+                                     get_cache_size, shed_cache, cache);
+    }
+
+    return cache;
+}
+
+void
+nautilus_thumbnail_cache_use (NautilusFile *file)
+{
+    NautilusThumbnailCache *cache = get_cache ();
+    NautilusFileThumbnailInfo *thumbnail_info = file->details->thumbnail_info;
+    gsize bytes;
+
+    g_return_if_fail (thumbnail_info != NULL);
+
+    bytes = get_pixbuf_bytes (thumbnail_info->pixbuf);
+    for (int i = 0; i < NAUTILUS_FILE_MAX_SCALED_THUMBNAILS; i++)
+    {
+        bytes += get_pixbuf_bytes (thumbnail_info->scaled[i].pixbuf);
+    }
+    if (bytes == 0)
+    {
+        nautilus_thumbnail_cache_forget (file);
+        return;
+    }
+
+    if (thumbnail_info->cache_link != NULL)
+    {
+        g_queue_unlink (&cache->files, thumbnail_info->cache_link);
+        g_queue_push_head_link (&cache->files, thumbnail_info->cache_link);
+    }
+    else
+    {
+        g_queue_push_head (&cache->files, file);
+        thumbnail_info->cache_link = g_queue_peek_head_link (&cache->files);
+    }
+
+    cache->total_bytes -= thumbnail_info->cache_bytes;
+    thumbnail_info->cache_bytes = bytes;
+    cache->total_bytes += bytes;
+
+    /* Never the thumbnail just used, even when over the budget by itself */
+    if (cache->total_bytes > get_budget ())
+    {
+        g_queue_unlink (&cache->files, thumbnail_info->cache_link);
+        cache->total_bytes -= bytes;
+
+        trim_to (cache, get_budget () > bytes ? get_budget () - bytes : 0);
+
+        g_queue_push_head_link (&cache->files, thumbnail_info->cache_link);
+        cache->total_bytes += bytes;
+    }
+}
+
+void
+nautilus_thumbnail_cache_forget (NautilusFile *file)
+{
+    NautilusThumbnailCache *cache = get_cache ();
+    NautilusFileThumbnailInfo *thumbnail_info = file->details->thumbnail_info;
+
+    if (thumbnail_info == NULL || thumbnail_info->cache_link == NULL)
+    {
+        return;
+    }
+
+    g_queue_delete_link (&cache->files, thumbnail_info->cache_link);
+    thumbnail_info->cache_link = NULL;
+    cache->total_bytes -= thumbnail_info->cache_bytes;
+    thumbnail_info->cache_bytes = 0;
+}
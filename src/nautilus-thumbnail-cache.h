@@ -0,0 +1,32 @@
+/* nautilus-thumbnail-cache.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "nautilus-file.h"
+
+/* The thumbnail cache keeps the loaded thumbnails of all files within a
+ * memory budget. Files are charged for the pixels of their thumbnails, and
+ * the least recently used ones lose them when the budget runs out, or when
+ * the system is low on memory; they are loaded again when asked for.
+ * Main thread only.
+ */
+
+/* Charges @file for its loaded thumbnails, as they are now, and makes it
+ * the most recently used. */
+void nautilus_thumbnail_cache_use    (NautilusFile *file);
+/* Stops charging @file, which dropped its thumbnails or is going away. */
+void nautilus_thumbnail_cache_forget (NautilusFile *file);
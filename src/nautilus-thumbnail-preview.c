@@ -0,0 +1,518 @@
+/* nautilus-thumbnail-preview.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-thumbnail-preview.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+/* RAW formats built on TIFF, whose IFDs point to their JPEG previews */
+static const char * const tiff_raw_mime_types[] =
+{
+    "image/x-adobe-dng",
+    "image/x-canon-cr2",
+    "image/x-nikon-nef",
+    "image/x-nikon-nrw",
+    "image/x-olympus-orf",
+    "image/x-panasonic-rw2",
+    "image/x-pentax-pef",
+    "image/x-samsung-srw",
+    "image/x-sony-arw",
+    "image/x-sony-sr2",
+    NULL
+};
+
+#define RAF_MAGIC "FUJIFILMCCD-RAW "
+#define RAF_JPEG_OFFSET 84
+
+/* IFDs are followed this deep, and this many along a chain */
+#define MAX_IFD_DEPTH 4
+#define MAX_IFD_CHAIN 8
+
+enum
+{
+    TIFF_TAG_RW2_JPEG_FROM_RAW = 0x002e,
+    TIFF_TAG_COMPRESSION = 0x0103,
+    TIFF_TAG_STRIP_OFFSETS = 0x0111,
+    TIFF_TAG_ORIENTATION = 0x0112,
+    TIFF_TAG_STRIP_BYTE_COUNTS = 0x0117,
+    TIFF_TAG_SUB_IFDS = 0x014a,
+    TIFF_TAG_JPEG_OFFSET = 0x0201,
+    TIFF_TAG_JPEG_LENGTH = 0x0202,
+};
+
+enum
+{
+    TIFF_TYPE_SHORT = 3,
+    TIFF_TYPE_LONG = 4,
+    TIFF_TYPE_UNDEFINED = 7,
+    TIFF_TYPE_IFD = 13,
+};
+
+typedef struct
+{
+    const guchar *data;
+    gsize length;
+    gboolean big_endian;
+
+    /* The biggest JPEG found so far */
+    gsize jpeg_offset;
+    gsize jpeg_length;
+    guint orientation;
+} TiffReader;
+
+static gboolean
+read_u16 (TiffReader *reader,
+          gsize       offset,
+          guint16    *value)
+{
+    const guchar *p;
+
+    if (offset > reader->length || reader->length - offset < 2)
+    {
+        return FALSE;
+    }
+
+    p = reader->data + offset;
+    *value = reader->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+
+    return TRUE;
+}
+
+static gboolean
+read_u32 (TiffReader *reader,
+          gsize       offset,
+          guint32    *value)
+{
+    const guchar *p;
+
+    if (offset > reader->length || reader->length - offset < 4)
+    {
+        return FALSE;
+    }
+
+    p = reader->data + offset;
+    if (reader->big_endian)
+    {
+        *value = ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    else
+    {
+        *value = ((guint32) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+    }
+
+    return TRUE;
+}
+
+/* Reads the value of the IFD entry at @entry, if it is a single integer */
+static gboolean
+read_entry_value (TiffReader *reader,
+                  gsize       entry,
+                  guint32    *value)
+{
+    guint16 type;
+    guint16 short_value;
+
+    if (!read_u16 (reader, entry + 2, &type))
+    {
+        return FALSE;
+    }
+
+    switch (type)
+    {
+        case TIFF_TYPE_SHORT:
+        {
+            if (!read_u16 (reader, entry + 8, &short_value))
+            {
+                return FALSE;
+            }
+            *value = short_value;
+            return TRUE;
+        }
+
+        case TIFF_TYPE_LONG:
+        case TIFF_TYPE_UNDEFINED:
+        case TIFF_TYPE_IFD:
+        {
+            return read_u32 (reader, entry + 8, value);
+        }
+
+        default:
+        {
+            return FALSE;
+        }
+    }
+}
+
+static void
+consider_jpeg (TiffReader *reader,
+               gsize       offset,
+               gsize       length)
+{
+    if (length < 4 || offset > reader->length || length > reader->length - offset)
+    {
+        return;
+    }
+
+    /* JPEG start of image */
+    if (reader->data[offset] != 0xff || reader->data[offset + 1] != 0xd8)
+    {
+        return;
+    }
+
+    if (length > reader->jpeg_length)
+    {
+        reader->jpeg_offset = offset;
+        reader->jpeg_length = length;
+    }
+}
+
+static void scan_ifd_chain (TiffReader *reader,
+                            guint32     offset,
+                            guint       depth);
+
+static void
+scan_sub_ifds (TiffReader *reader,
+               gsize       entry,
+               guint       depth)
+{
+    guint32 count;
+    guint32 value;
+
+    if (!read_u32 (reader, entry + 4, &count) ||
+        !read_u32 (reader, entry + 8, &value))
+    {
+        return;
+    }
+
+    if (count == 1)
+    {
+        scan_ifd_chain (reader, value, depth + 1);
+        return;
+    }
+
+    for (guint32 i = 0; i < MIN (count, MAX_IFD_CHAIN); i++)
+    {
+        guint32 sub_ifd;
+
+        if (read_u32 (reader, (gsize) value + i * 4, &sub_ifd))
+        {
+            scan_ifd_chain (reader, sub_ifd, depth + 1);
+        }
+    }
+}
+
+static void
+scan_ifd_chain (TiffReader *reader,
+                guint32     offset,
+                guint       depth)
+{
+    if (depth > MAX_IFD_DEPTH)
+    {
+        return;
+    }
+
+    for (guint n_ifds = 0; offset != 0 && n_ifds < MAX_IFD_CHAIN; n_ifds++)
+    {
+        guint16 n_entries;
+        guint32 jpeg_offset = 0;
+        guint32 jpeg_length = 0;
+        guint32 strip_offset = 0;
+        guint32 strip_length = 0;
+        guint32 compression = 0;
+
+        if (!read_u16 (reader, offset, &n_entries))
+        {
+            return;
+        }
+
+        for (guint i = 0; i < n_entries; i++)
+        {
+            gsize entry = (gsize) offset + 2 + i * 12;
+            guint16 tag;
+            guint32 count;
+            guint32 value;
+
+            if (!read_u16 (reader, entry, &tag) ||
+                !read_u32 (reader, entry + 4, &count))
+            {
+                return;
+            }
+
+            if (tag == TIFF_TAG_SUB_IFDS)
+            {
+                scan_sub_ifds (reader, entry, depth);
+                continue;
+            }
+
+            if (!read_entry_value (reader, entry, &value))
+            {
+                continue;
+            }
+
+            switch (tag)
+            {
+                case TIFF_TAG_RW2_JPEG_FROM_RAW:
+                {
+                    consider_jpeg (reader, value, count);
+                }
+                break;
+
+                case TIFF_TAG_COMPRESSION:
+                {
+                    compression = value;
+                }
+                break;
+
+                case TIFF_TAG_STRIP_OFFSETS:
+                {
+                    strip_offset = count == 1 ? value : 0;
+                }
+                break;
+
+                case TIFF_TAG_STRIP_BYTE_COUNTS:
+                {
+                    strip_length = count == 1 ? value : 0;
+                }
+                break;
+
+                case TIFF_TAG_ORIENTATION:
+                {
+                    /* Only the main image's counts */
+                    if (depth == 0 && n_ifds == 0)
+                    {
+                        reader->orientation = value;
+                    }
+                }
+                break;
+
+                case TIFF_TAG_JPEG_OFFSET:
+                {
+                    jpeg_offset = value;
+                }
+                break;
+
+                case TIFF_TAG_JPEG_LENGTH:
+                {
+                    jpeg_length = value;
+                }
+                break;
+
+                default:
+                {
+                }
+                break;
+            }
+        }
+
+        consider_jpeg (reader, jpeg_offset, jpeg_length);
+        /* Old-style and new-style JPEG compressed strips */
+        if (compression == 6 || compression == 7)
+        {
+            consider_jpeg (reader, strip_offset, strip_length);
+        }
+
+        if (!read_u32 (reader, (gsize) offset + 2 + n_entries * 12, &offset))
+        {
+            return;
+        }
+    }
+}
+
+/* Finds the biggest JPEG embedded in a RAW file */
+static gboolean
+find_embedded_jpeg (TiffReader *reader)
+{
+    guint16 magic;
+    guint32 ifd_offset;
+
+    if (reader->length >= RAF_JPEG_OFFSET + 8 &&
+        memcmp (reader->data, RAF_MAGIC, strlen (RAF_MAGIC)) == 0)
+    {
+        guint32 offset;
+        guint32 length;
+
+        reader->big_endian = TRUE;
+        read_u32 (reader, RAF_JPEG_OFFSET, &offset);
+        read_u32 (reader, RAF_JPEG_OFFSET + 4, &length);
+        consider_jpeg (reader, offset, length);
+
+        return reader->jpeg_length > 0;
+    }
+
+    if (reader->length < 8)
+    {
+        return FALSE;
+    }
+
+    if (memcmp (reader->data, "MM", 2) == 0)
+    {
+        reader->big_endian = TRUE;
+    }
+    else if (memcmp (reader->data, "II", 2) != 0)
+    {
+        return FALSE;
+    }
+
+    /* TIFF, Panasonic and Olympus flavours */
+    read_u16 (reader, 2, &magic);
+    if (magic != 42 && magic != 0x55 && magic != 0x4f52 && magic != 0x5352)
+    {
+        return FALSE;
+    }
+
+    read_u32 (reader, 4, &ifd_offset);
+    scan_ifd_chain (reader, ifd_offset, 0);
+
+    return reader->jpeg_length > 0;
+}
+
+typedef struct
+{
+    int size;
+    int original_width;
+    int original_height;
+} LoadData;
+
+static void
+on_size_prepared (GdkPixbufLoader *loader,
+                  int              width,
+                  int              height,
+                  gpointer         user_data)
+{
+    LoadData *data = user_data;
+    double scale;
+
+    data->original_width = width;
+    data->original_height = height;
+
+    if (MAX (width, height) <= data->size)
+    {
+        return;
+    }
+
+    /* The JPEG loader decodes straight at a fraction of the size */
+    scale = (double) data->size / MAX (width, height);
+    gdk_pixbuf_loader_set_size (loader,
+                                MAX (width * scale, 1),
+                                MAX (height * scale, 1));
+}
+
+static GdkPixbuf *
+load_jpeg (const guchar *data,
+           gsize         length,
+           LoadData     *load_data)
+{
+    g_autoptr (GdkPixbufLoader) loader = NULL;
+    GdkPixbuf *pixbuf;
+
+    loader = gdk_pixbuf_loader_new_with_type ("jpeg", NULL);
+    if (loader == NULL)
+    {
+        return NULL;
+    }
+
+    g_signal_connect (loader, "size-prepared",
+                      G_CALLBACK (on_size_prepared), load_data);
+
+    if (!gdk_pixbuf_loader_write (loader, data, length, NULL) ||
+        !gdk_pixbuf_loader_close (loader, NULL))
+    {
+        return NULL;
+    }
+
+    pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+    return pixbuf != NULL ? g_object_ref (pixbuf) : NULL;
+}
+
+static gboolean
+is_raw (const char *mime_type)
+{
+    return g_strv_contains (tiff_raw_mime_types, mime_type) ||
+           g_strcmp0 (mime_type, "image/x-fuji-raf") == 0;
+}
+
+GdkPixbuf *
+nautilus_thumbnail_preview_load (const char *uri,
+                                 const char *mime_type,
+                                 int         size)
+{
+    g_autofree char *path = NULL;
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    g_autoptr (GdkPixbuf) pixbuf = NULL;
+    TiffReader reader = { 0 };
+    LoadData load_data = { size, 0, 0 };
+    gboolean is_jpeg;
+    char orientation[2];
+
+    is_jpeg = g_strcmp0 (mime_type, "image/jpeg") == 0;
+    if (!is_jpeg && !is_raw (mime_type))
+    {
+        return NULL;
+    }
+
+    /* Mapping remote files would only trade one download for another */
+    path = g_filename_from_uri (uri, NULL, NULL);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        return NULL;
+    }
+
+    reader.data = (const guchar *) g_mapped_file_get_contents (mapped_file);
+    reader.length = g_mapped_file_get_length (mapped_file);
+
+    if (is_jpeg)
+    {
+        reader.jpeg_offset = 0;
+        reader.jpeg_length = reader.length;
+    }
+    else if (!find_embedded_jpeg (&reader))
+    {
+        return NULL;
+    }
+
+    pixbuf = load_jpeg (reader.data + reader.jpeg_offset, reader.jpeg_length, &load_data);
+    if (pixbuf == NULL)
+    {
+        return NULL;
+    }
+
+    /* A preview too small for the thumbnail would look blurry, unlike a
+     * JPEG that is just small. */
+    if (!is_jpeg && MAX (load_data.original_width, load_data.original_height) < size)
+    {
+        return NULL;
+    }
+
+    /* Previews carry no orientation of their own, the RAW file does */
+    if (reader.orientation >= 2 && reader.orientation <= 8 &&
+        gdk_pixbuf_get_option (pixbuf, "orientation") == NULL)
+    {
+        orientation[0] = '0' + reader.orientation;
+        orientation[1] = '\0';
+        gdk_pixbuf_set_option (pixbuf, "orientation", orientation);
+    }
+
+    return gdk_pixbuf_apply_embedded_orientation (pixbuf);
+}
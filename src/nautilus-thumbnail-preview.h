@@ -0,0 +1,29 @@
+/* nautilus-thumbnail-preview.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/* Makes a thumbnail of a local camera picture without decoding it whole:
+ * JPEG files are decoded scaled down, and RAW files have the JPEG preview
+ * they embed decoded instead, when it is at least @size big. Returns NULL
+ * when there is no such shortcut, for the thumbnailers to take over.
+ * Thread-safe.
+ */
+GdkPixbuf *nautilus_thumbnail_preview_load (const char *uri,
+                                            const char *mime_type,
+                                            int         size);
@@ -0,0 +1,298 @@
+/* nautilus-thumbnail-probe.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-thumbnail-probe.h"
+
+#include "nautilus-executor.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_THUMBNAILS
+#include "nautilus-debug.h"
+
+/* In the order GIO looks thumbnails up in */
+typedef enum
+{
+    PROBE_DIR_LARGE,
+    PROBE_DIR_NORMAL,
+    PROBE_DIR_FAILED,
+    PROBE_N_DIRS
+} ProbeDir;
+
+static const char *probe_dir_names[PROBE_N_DIRS] =
+{
+    "large",
+    "normal",
+    "fail/gnome-thumbnail-factory",
+};
+
+typedef struct
+{
+    char *name;
+    ProbeDir dir;
+    gboolean exists;
+} ProbeEvent;
+
+typedef struct
+{
+    char *dirs[PROBE_N_DIRS];
+    GFileMonitor *monitors[PROBE_N_DIRS];
+
+    /* Thumbnail file names, to a bit for each directory holding them.
+     * NULL while being listed. */
+    GHashTable *names;
+    /* Of ProbeEvent, seen while listing */
+    GPtrArray *pending_events;
+} NautilusThumbnailProbe;
+
+static void
+probe_event_free (ProbeEvent *event)
+{
+    g_free (event->name);
+    g_free (event);
+}
+
+static void
+apply_event (GHashTable *names,
+             const char *name,
+             ProbeDir    dir,
+             gboolean    exists)
+{
+    guint bits;
+
+    bits = GPOINTER_TO_UINT (g_hash_table_lookup (names, name));
+    if (exists)
+    {
+        bits |= 1 << dir;
+    }
+    else
+    {
+        bits &= ~(1 << dir);
+    }
+
+    if (bits != 0)
+    {
+        g_hash_table_insert (names, g_strdup (name), GUINT_TO_POINTER (bits));
+    }
+    else
+    {
+        g_hash_table_remove (names, name);
+    }
+}
+
+static void
+on_cache_dir_changed (GFileMonitor      *monitor,
+                      GFile             *child,
+                      GFile             *other_file,
+                      GFileMonitorEvent  event_type,
+                      gpointer           user_data)
+{
+    NautilusThumbnailProbe *probe = user_data;
+    g_autofree char *name = NULL;
+    gboolean exists;
+    ProbeDir dir;
+
+    if (event_type == G_FILE_MONITOR_EVENT_CREATED)
+    {
+        exists = TRUE;
+    }
+    else if (event_type == G_FILE_MONITOR_EVENT_DELETED)
+    {
+        exists = FALSE;
+    }
+    else
+    {
+        return;
+    }
+
+    /* Leaves out the temporary files thumbnails are written to */
+    name = g_file_get_basename (child);
+    if (!g_str_has_suffix (name, ".png"))
+    {
+        return;
+    }
+
+    for (dir = 0; dir < PROBE_N_DIRS; dir++)
+    {
+        if (probe->monitors[dir] == monitor)
+        {
+            break;
+        }
+    }
+    g_return_if_fail (dir < PROBE_N_DIRS);
+
+    if (probe->names != NULL)
+    {
+        apply_event (probe->names, name, dir, exists);
+    }
+    else
+    {
+        ProbeEvent *event;
+
+        event = g_new (ProbeEvent, 1);
+        event->name = g_steal_pointer (&name);
+        event->dir = dir;
+        event->exists = exists;
+        g_ptr_array_add (probe->pending_events, event);
+    }
+}
+
+static void
+list_thread_func (GTask        *task,
+                  gpointer      source_object,
+                  gpointer      task_data,
+                  GCancellable *cancellable)
+{
+    NautilusThumbnailProbe *probe = task_data;
+    GHashTable *names;
+
+    names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    for (ProbeDir dir = 0; dir < PROBE_N_DIRS; dir++)
+    {
+        g_autoptr (GDir) cache_dir = NULL;
+        const char *name;
+
+        cache_dir = g_dir_open (probe->dirs[dir], 0, NULL);
+        if (cache_dir == NULL)
+        {
+            continue;
+        }
+
+        while ((name = g_dir_read_name (cache_dir)) != NULL)
+        {
+            if (g_str_has_suffix (name, ".png"))
+            {
+                apply_event (names, name, dir, TRUE);
+            }
+        }
+    }
+
+    g_task_return_pointer (task, names, (GDestroyNotify) g_hash_table_unref);
+}
+
+static void
+list_done (GObject      *source_object,
+           GAsyncResult *result,
+           gpointer      user_data)
+{
+    NautilusThumbnailProbe *probe = user_data;
+
+    probe->names = g_task_propagate_pointer (G_TASK (result), NULL);
+
+    for (guint i = 0; i < probe->pending_events->len; i++)
+    {
+        ProbeEvent *event = g_ptr_array_index (probe->pending_events, i);
+
+        apply_event (probe->names, event->name, event->dir, event->exists);
+    }
+    g_ptr_array_set_size (probe->pending_events, 0);
+
+    DEBUG ("Thumbnail cache listed, %u thumbnails",
+           g_hash_table_size (probe->names));
+}
+
+static void
+start_listing (NautilusThumbnailProbe *probe)
+{
+    g_autoptr (GTask) task = NULL;
+
+    /* Watched first, so nothing is missed while listing */
+    for (ProbeDir dir = 0; dir < PROBE_N_DIRS; dir++)
+    {
+        g_autoptr (GFile) location = NULL;
+
+        probe->dirs[dir] = g_build_filename (g_get_user_cache_dir (),
+                                             "thumbnails", probe_dir_names[dir],
+                                             NULL);
+        location = g_file_new_for_path (probe->dirs[dir]);
+        probe->monitors[dir] = g_file_monitor_directory (location,
+                                                         G_FILE_MONITOR_NONE,
+                                                         NULL, NULL);
+        if (probe->monitors[dir] != NULL)
+        {
+            g_signal_connect (probe->monitors[dir], "changed",
+                              G_CALLBACK (on_cache_dir_changed), probe);
+        }
+    }
+
+    task = g_task_new (NULL, NULL, list_done, probe);
+    g_task_set_task_data (task, probe, NULL);
+    nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_THUMBNAILS, task, list_thread_func);
+}
+
+static NautilusThumbnailProbe *
+get_probe (void)
+{
+    static NautilusThumbnailProbe *probe = NULL;
+
+    if (probe == NULL)
+    {
+        probe = g_new0 (NautilusThumbnailProbe, 1);
+        probe->pending_events = g_ptr_array_new_with_free_func ((GDestroyNotify) probe_event_free);
+        start_listing (probe);
+    }
+
+    return probe;
+}
+
+gboolean
+nautilus_thumbnail_probe_is_ready (void)
+{
+    return get_probe ()->names != NULL;
+}
+
+gboolean
+nautilus_thumbnail_probe_resolve (GFile     *location,
+                                  GFileInfo *info)
+{
+    NautilusThumbnailProbe *probe = get_probe ();
+    g_autofree char *uri = NULL;
+    g_autofree char *checksum = NULL;
+    g_autofree char *name = NULL;
+    guint bits;
+
+    if (probe->names == NULL)
+    {
+        return FALSE;
+    }
+
+    uri = g_file_get_uri (location);
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+    name = g_strconcat (checksum, ".png", NULL);
+
+    bits = GPOINTER_TO_UINT (g_hash_table_lookup (probe->names, name));
+    if (bits == 0)
+    {
+        return TRUE;
+    }
+
+    for (ProbeDir dir = 0; dir < PROBE_DIR_FAILED; dir++)
+    {
+        if (bits & (1 << dir))
+        {
+            g_autofree char *path = NULL;
+
+            path = g_build_filename (probe->dirs[dir], name, NULL);
+            g_file_info_set_attribute_byte_string (info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH, path);
+
+            return TRUE;
+        }
+    }
+
+    g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED, TRUE);
+
+    return TRUE;
+}
@@ -0,0 +1,35 @@
+/* nautilus-thumbnail-probe.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* The thumbnail probe keeps the names of the files in the thumbnail cache
+ * directories, listed once and then followed through file monitors, so
+ * directory loads can tell which of their files have thumbnails without
+ * looking each one up on disk. Main thread only.
+ */
+
+/* Whether the thumbnail cache has been listed. The first call starts
+ * listing it. */
+gboolean nautilus_thumbnail_probe_is_ready (void);
+
+/* Sets the thumbnail::path and thumbnail::failed attributes of @info, the
+ * info of @location, as the thumbnail cache has them. Returns FALSE when
+ * the thumbnail cache is not listed yet. */
+gboolean nautilus_thumbnail_probe_resolve  (GFile     *location,
+                                            GFileInfo *info);
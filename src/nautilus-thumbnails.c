@@ -26,8 +26,10 @@
 #define GNOME_DESKTOP_USE_UNSTABLE_API
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-executor.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-thumbnail-preview.h"
 #include <math.h>
 #include <eel/eel-graphic-effects.h>
 #include <eel/eel-string.h>
@@ -52,6 +54,14 @@
 /* Cool-off period between last file modification time and thumbnail creation */
 #define THUMBNAIL_CREATION_DELAY_SECS 3
 
+/* Workers when the number is left to us, at most one per processor */
+#define DEFAULT_MAX_THUMBNAIL_WORKERS 8
+/* The threads of the executor left to the other thumbnail tasks */
+#define THUMBNAIL_LOADERS 2
+
+/* The pixel size of GNOME_DESKTOP_THUMBNAIL_SIZE_LARGE thumbnails */
+#define LARGE_THUMBNAIL_PIXELS 256
+
 static void thumbnail_thread_func (GTask        *task,
                                    gpointer      source_object,
                                    gpointer      task_data,
@@ -64,35 +74,63 @@ typedef struct
     char *image_uri;
     char *mime_type;
     time_t original_file_mtime;
+    /* Being made by a worker. It stays in the thumbnails_to_make list
+     * meanwhile, to avoid adding it again. */
+    gboolean in_progress;
+    /* The tier of thumbnails_to_make it is in */
+    NautilusThumbnailPriority priority;
+    /* The view that last set its priority, if any */
+    gconstpointer owner;
 } NautilusThumbnailInfo;
 
 /*
  * Thumbnail thread state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start the thumbnail threads, or 0 if no
  *  idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
- *  thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
- *  thumbnails_to_make list. */
+ *  thumbnail threads, i.e. the worker counts and the thumbnails_to_make
+ *  list. */
 static GMutex thumbnails_mutex;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
- *  start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
+/* The number of thumbnail threads running, and how many there can be.
+ *  Lock thumbnails_mutex when accessing these. */
+static guint n_running_workers = 0;
+static guint max_workers = 0;
+
+/* The workers making a thumbnail of each kind, see get_kind_limit().
+ *  Lock thumbnails_mutex when accessing this. */
+static GHashTable *running_workers_per_kind = NULL;
 
-/* The list of NautilusThumbnailInfo structs containing information about the
- *  thumbnails we are making. Lock thumbnails_mutex when accessing this. */
-static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
+/* The lists of NautilusThumbnailInfo structs containing information about the
+ *  thumbnails we are making, one for each priority tier, made in order.
+ *  Lock thumbnails_mutex when accessing this. */
+static GQueue thumbnails_to_make[NAUTILUS_THUMBNAIL_N_PRIORITIES];
 
 /* Quickly check if uri is in thumbnails_to_make list */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static NautilusThumbnailInfo *currently_thumbnailing = NULL;
+/* Recently modified files wait out THUMBNAIL_CREATION_DELAY_SECS in a timer
+ *  wheel of one-second slots, keyed by when they are old enough, and are
+ *  released a slot at a time by a single timeout. Ready times are never more
+ *  than the delay ahead, so each slot only holds one second's files.
+ *  Lock thumbnails_mutex when accessing these. */
+#define DELAY_WHEEL_SLOTS (THUMBNAIL_CREATION_DELAY_SECS + 2)
+
+typedef struct
+{
+    char *image_uri;
+    time_t ready_time;
+} DelayedThumbnail;
+
+/* Of DelayedThumbnail, by ready time modulo DELAY_WHEEL_SLOTS */
+static GPtrArray *delay_wheel[DELAY_WHEEL_SLOTS];
+/* The URIs in delay_wheel, to their DelayedThumbnail */
+static GHashTable *delayed_thumbnails = NULL;
+static guint delay_timeout_id = 0;
 
 static gboolean
 get_file_mtime (const char *file_uri,
@@ -144,36 +182,106 @@ get_thumbnail_factory (void)
 }
 
 
+static guint
+get_max_workers (void)
+{
+    int workers;
+
+    workers = g_settings_get_int (nautilus_preferences, NAUTILUS_PREFERENCES_THUMBNAIL_WORKERS);
+    if (workers <= 0)
+    {
+        workers = CLAMP (g_get_num_processors (), 1, DEFAULT_MAX_THUMBNAIL_WORKERS);
+    }
+
+    return workers;
+}
+
+/* Thumbnailers as slow as video and document ones only get part of the
+ *  workers, so that they don't hold up the thumbnails of everything else.
+ *  Videos of all types count as one kind. */
+static const char *
+get_kind (const char *mime_type)
+{
+    if (g_str_has_prefix (mime_type, "video/"))
+    {
+        return "video/";
+    }
+
+    return mime_type;
+}
+
+static guint
+get_kind_limit (const char *kind)
+{
+    if (g_str_equal (kind, "video/") ||
+        g_str_equal (kind, "application/pdf") ||
+        g_str_equal (kind, "application/postscript") ||
+        g_str_equal (kind, "image/vnd.djvu") ||
+        g_str_has_prefix (kind, "application/vnd.oasis.opendocument") ||
+        g_str_has_prefix (kind, "application/vnd.openxmlformats-officedocument"))
+    {
+        return MAX (1, max_workers / 4);
+    }
+
+    return max_workers;
+}
+
 /* This function is added as a very low priority idle function to start the
- *  thread to create any needed thumbnails. It is added with a very low priority
+ *  threads to create any needed thumbnails. It is added with a very low priority
  *  so that it doesn't delay showing the directory in the icon/list views.
  *  We want to show the files in the directory as quickly as possible. */
 static gboolean
 thumbnail_thread_starter_cb (gpointer data)
 {
-    GTask *task;
+    guint n_needed;
+
+    /* Set up here, as the workers would race to */
+    get_thumbnail_factory ();
+
+    g_mutex_lock (&thumbnails_mutex);
 
-    DEBUG ("(Main Thread) Creating thumbnails thread\n");
+    max_workers = get_max_workers ();
+    /* The thumbnails made already are loaded and probed there as well,
+     * which shouldn't wait for these */
+    nautilus_executor_set_max_threads (NAUTILUS_EXECUTOR_THUMBNAILS,
+                                       max_workers + THUMBNAIL_LOADERS);
+    if (running_workers_per_kind == NULL)
+    {
+        running_workers_per_kind = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    /* No more workers than thumbnails to make */
+    n_needed = 0;
+    for (int i = 0; i < NAUTILUS_THUMBNAIL_N_PRIORITIES; i++)
+    {
+        n_needed += g_queue_get_length (&thumbnails_to_make[i]);
+    }
+    n_needed = MIN (max_workers, n_needed);
+    while (n_running_workers < n_needed)
+    {
+        g_autoptr (GTask) task = NULL;
+
+        DEBUG ("(Main Thread) Creating thumbnails thread\n");
+
+        n_running_workers++;
+        task = g_task_new (NULL, NULL, NULL, NULL);
+        nautilus_executor_run_in_thread (NAUTILUS_EXECUTOR_THUMBNAILS, task, thumbnail_thread_func);
+    }
 
-    /* We set a flag to indicate the thread is running, so we don't create
-     *  a new one. We don't need to lock a mutex here, as the thumbnail
-     *  thread isn't running yet. And we know we won't create the thread
-     *  twice, as we also check thumbnail_thread_starter_id before
-     *  scheduling this idle function. */
-    thumbnail_thread_is_running = TRUE;
-    task = g_task_new (NULL, NULL, NULL, NULL);
-    g_task_run_in_thread (task, thumbnail_thread_func);
     thumbnail_thread_starter_id = 0;
 
-    g_object_unref (task);
+    g_mutex_unlock (&thumbnails_mutex);
 
     return FALSE;
 }
 
-void
-nautilus_thumbnail_remove_from_queue (const char *file_uri)
+static gboolean
+remove_from_queue (const char *file_uri)
 {
     GList *node;
+    gboolean removed;
+
+    removed = FALSE;
 
     DEBUG ("(Remove from queue) Locking mutex\n");
 
@@ -187,11 +295,14 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
     {
         node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 
-        if (node && node->data != currently_thumbnailing)
+        if (node && !((NautilusThumbnailInfo *) node->data)->in_progress)
         {
+            NautilusThumbnailInfo *info = node->data;
+
             g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-            free_thumbnail_info (node->data);
-            g_queue_delete_link ((GQueue *) &thumbnails_to_make, node);
+            g_queue_delete_link (&thumbnails_to_make[info->priority], node);
+            free_thumbnail_info (info);
+            removed = TRUE;
         }
     }
 
@@ -202,14 +313,96 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
     DEBUG ("(Remove from queue) Unlocking mutex\n");
 
     g_mutex_unlock (&thumbnails_mutex);
+
+    return removed;
+}
+
+void
+nautilus_thumbnail_remove_from_queue (const char *file_uri)
+{
+    remove_from_queue (file_uri);
+}
+
+void
+nautilus_thumbnail_cancel (NautilusFile *file)
+{
+    g_autofree char *uri = NULL;
+
+    if (!nautilus_file_is_thumbnailing (file))
+    {
+        return;
+    }
+
+    uri = nautilus_file_get_uri (file);
+    if (remove_from_queue (uri))
+    {
+        nautilus_file_set_is_thumbnailing (file, FALSE);
+    }
+}
+
+/* Moves a queued thumbnail to the head or the tail of the @priority tier.
+ *  Lock thumbnails_mutex when calling this. */
+static void
+move_to_tier (const char                *file_uri,
+              NautilusThumbnailPriority  priority,
+              gboolean                   at_head)
+{
+    NautilusThumbnailInfo *info;
+    GList *node;
+
+    if (thumbnails_to_make_hash == NULL)
+    {
+        return;
+    }
+
+    node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+    if (node == NULL)
+    {
+        return;
+    }
+
+    info = node->data;
+    if (info->in_progress)
+    {
+        return;
+    }
+
+    g_queue_unlink (&thumbnails_to_make[info->priority], node);
+    info->priority = priority;
+    if (at_head)
+    {
+        g_queue_push_head_link (&thumbnails_to_make[priority], node);
+    }
+    else
+    {
+        g_queue_push_tail_link (&thumbnails_to_make[priority], node);
+    }
 }
 
 void
 nautilus_thumbnail_prioritize (const char *file_uri)
+{
+    g_mutex_lock (&thumbnails_mutex);
+    move_to_tier (file_uri, NAUTILUS_THUMBNAIL_PRIORITY_VISIBLE, TRUE);
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
+void
+nautilus_thumbnail_demote (const char *file_uri)
+{
+    g_mutex_lock (&thumbnails_mutex);
+    move_to_tier (file_uri, NAUTILUS_THUMBNAIL_PRIORITY_PREFETCH, FALSE);
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
+void
+nautilus_thumbnail_set_priority (GList                     *files,
+                                 NautilusThumbnailPriority  priority,
+                                 gconstpointer              owner)
 {
     GList *node;
 
-    DEBUG ("(Prioritize) Locking mutex\n");
+    DEBUG ("(Set priority) Locking mutex\n");
 
     g_mutex_lock (&thumbnails_mutex);
 
@@ -217,14 +410,25 @@ nautilus_thumbnail_prioritize (const char *file_uri)
      * MUTEX LOCKED
      *********************************/
 
-    if (thumbnails_to_make_hash)
+    /* Pushed to the head from the last one, so that they are made in the
+     *  order given, before the rest of the tier. */
+    for (GList *l = g_list_last (files); l != NULL; l = l->prev)
     {
-        node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+        g_autofree char *uri = NULL;
 
-        if (node && node->data != currently_thumbnailing)
+        if (!nautilus_file_is_thumbnailing (l->data))
         {
-            g_queue_unlink ((GQueue *) &thumbnails_to_make, node);
-            g_queue_push_head_link ((GQueue *) &thumbnails_to_make, node);
+            continue;
+        }
+
+        uri = nautilus_file_get_uri (l->data);
+        move_to_tier (uri, priority, TRUE);
+
+        node = thumbnails_to_make_hash != NULL ?
+               g_hash_table_lookup (thumbnails_to_make_hash, uri) : NULL;
+        if (node != NULL)
+        {
+            ((NautilusThumbnailInfo *) node->data)->owner = owner;
         }
     }
 
@@ -232,9 +436,92 @@ nautilus_thumbnail_prioritize (const char *file_uri)
      * MUTEX UNLOCKED
      *********************************/
 
-    DEBUG ("(Prioritize) Unlocking mutex\n");
+    DEBUG ("(Set priority) Unlocking mutex\n");
+
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
+void
+nautilus_thumbnail_demote_owner (gconstpointer owner)
+{
+    GQueue demoted = G_QUEUE_INIT;
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    for (int i = 0; i < NAUTILUS_THUMBNAIL_PRIORITY_BACKGROUND; i++)
+    {
+        GList *next;
+
+        for (GList *l = thumbnails_to_make[i].head; l != NULL; l = next)
+        {
+            NautilusThumbnailInfo *info = l->data;
+
+            next = l->next;
+            if (info->owner != owner || info->in_progress)
+            {
+                continue;
+            }
+
+            g_queue_unlink (&thumbnails_to_make[i], l);
+            info->priority = NAUTILUS_THUMBNAIL_PRIORITY_BACKGROUND;
+            g_queue_push_tail_link (&demoted, l);
+        }
+    }
+
+    /* Ahead of the rest of the background tier, in the order they had */
+    while (!g_queue_is_empty (&demoted))
+    {
+        g_queue_push_head_link (&thumbnails_to_make[NAUTILUS_THUMBNAIL_PRIORITY_BACKGROUND],
+                                g_queue_pop_tail_link (&demoted));
+    }
+
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
+void
+nautilus_thumbnail_drop_owner (gconstpointer owner)
+{
+    g_autoptr (GPtrArray) dropped = NULL;
+
+    dropped = g_ptr_array_new_with_free_func (g_free);
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    for (int i = 0; i < NAUTILUS_THUMBNAIL_N_PRIORITIES; i++)
+    {
+        GList *next;
+
+        for (GList *l = thumbnails_to_make[i].head; l != NULL; l = next)
+        {
+            NautilusThumbnailInfo *info = l->data;
+
+            next = l->next;
+            if (info->owner != owner || info->in_progress)
+            {
+                continue;
+            }
+
+            g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+            g_queue_delete_link (&thumbnails_to_make[i], l);
+            g_ptr_array_add (dropped, g_steal_pointer (&info->image_uri));
+            free_thumbnail_info (info);
+        }
+    }
 
     g_mutex_unlock (&thumbnails_mutex);
+
+    /* As nautilus_thumbnail_cancel(), so they are asked for again if their
+     *  icons show up elsewhere. */
+    for (guint i = 0; i < dropped->len; i++)
+    {
+        g_autoptr (NautilusFile) file = NULL;
+
+        file = nautilus_file_get_existing_by_uri (g_ptr_array_index (dropped, i));
+        if (file != NULL)
+        {
+            nautilus_file_set_is_thumbnailing (file, FALSE);
+        }
+    }
 }
 
 
@@ -269,6 +556,128 @@ thumbnail_thread_notify_file_changed (gpointer image_uri)
     return FALSE;
 }
 
+static void
+delayed_thumbnail_free (DelayedThumbnail *delayed)
+{
+    g_free (delayed->image_uri);
+    g_free (delayed);
+}
+
+static void
+add_to_delay_wheel (DelayedThumbnail *delayed)
+{
+    guint slot = delayed->ready_time % DELAY_WHEEL_SLOTS;
+
+    if (delay_wheel[slot] == NULL)
+    {
+        delay_wheel[slot] = g_ptr_array_new_with_free_func ((GDestroyNotify) delayed_thumbnail_free);
+    }
+    g_ptr_array_add (delay_wheel[slot], delayed);
+}
+
+/* Notifies the files whose ready time has come, all at once, so that they
+ *  are asked for again. There are few slots, so all are looked at, which
+ *  also copes with the timeout running late. */
+static gboolean
+release_delayed_thumbnails (gpointer data)
+{
+    g_autoptr (GPtrArray) released = NULL;
+    time_t current_time;
+    gboolean more;
+
+    released = g_ptr_array_new ();
+    time (&current_time);
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    for (guint slot = 0; slot < DELAY_WHEEL_SLOTS; slot++)
+    {
+        for (guint i = 0; delay_wheel[slot] != NULL && i < delay_wheel[slot]->len;)
+        {
+            DelayedThumbnail *delayed = g_ptr_array_index (delay_wheel[slot], i);
+
+            if (delayed->ready_time <= current_time)
+            {
+                g_hash_table_remove (delayed_thumbnails, delayed->image_uri);
+                g_ptr_array_add (released, g_steal_pointer (&delayed->image_uri));
+                g_ptr_array_remove_index_fast (delay_wheel[slot], i);
+            }
+            else if (delayed->ready_time % DELAY_WHEEL_SLOTS != slot)
+            {
+                /* Pushed back by a later modification */
+                add_to_delay_wheel (g_ptr_array_steal_index_fast (delay_wheel[slot], i));
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    more = g_hash_table_size (delayed_thumbnails) > 0;
+    if (!more)
+    {
+        delay_timeout_id = 0;
+    }
+
+    g_mutex_unlock (&thumbnails_mutex);
+
+    DEBUG ("(Main Thread) Releasing %u delayed thumbnails\n", released->len);
+
+    for (guint i = 0; i < released->len; i++)
+    {
+        thumbnail_thread_notify_file_changed (g_ptr_array_index (released, i));
+    }
+
+    return more ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/* Holds back the thumbnail of @image_uri until @ready_time, when it is
+ *  notified as changed. Lock thumbnails_mutex when calling this. */
+static void
+delay_thumbnail (const char *image_uri,
+                 time_t      ready_time)
+{
+    DelayedThumbnail *delayed;
+
+    if (delayed_thumbnails == NULL)
+    {
+        delayed_thumbnails = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+    delayed = g_hash_table_lookup (delayed_thumbnails, image_uri);
+    if (delayed != NULL)
+    {
+        /* Moved to its new slot when its old one comes around */
+        delayed->ready_time = MAX (delayed->ready_time, ready_time);
+        return;
+    }
+
+    delayed = g_new (DelayedThumbnail, 1);
+    delayed->image_uri = g_strdup (image_uri);
+    delayed->ready_time = ready_time;
+    g_hash_table_insert (delayed_thumbnails, delayed->image_uri, delayed);
+    add_to_delay_wheel (delayed);
+
+    if (delay_timeout_id == 0)
+    {
+        delay_timeout_id = g_timeout_add_seconds (1, release_delayed_thumbnails, NULL);
+    }
+}
+
+/* Whether a file with @mtime was modified too recently to be thumbnailed.
+ *  This prevents constant re-thumbnailing of changing files. */
+static gboolean
+is_recently_modified (time_t mtime)
+{
+    time_t current_time;
+
+    time (&current_time);
+
+    return current_time < mtime + THUMBNAIL_CREATION_DELAY_SECS &&
+           current_time >= mtime;
+}
+
 static GHashTable *
 get_types_table (void)
 {
@@ -386,6 +795,23 @@ nautilus_create_thumbnail (NautilusFile *file)
      * MUTEX LOCKED
      *********************************/
 
+    /* Not even queued until it is old enough, as a camera import would
+     *  otherwise keep the workers skipping files. Queued ones get the new
+     *  mtime below, for the worker to hold back. */
+    if (is_recently_modified (file_mtime) &&
+        (thumbnails_to_make_hash == NULL ||
+         g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri) == NULL))
+    {
+        DEBUG ("(Main Thread) Delaying thumbnail: %s\n",
+               info->image_uri);
+
+        delay_thumbnail (info->image_uri,
+                         file_mtime + THUMBNAIL_CREATION_DELAY_SECS);
+        g_mutex_unlock (&thumbnails_mutex);
+        free_thumbnail_info (info);
+        return;
+    }
+
     if (thumbnails_to_make_hash == NULL)
     {
         thumbnails_to_make_hash = g_hash_table_new (g_str_hash,
@@ -399,16 +825,17 @@ nautilus_create_thumbnail (NautilusFile *file)
         /* Add the thumbnail to the list. */
         DEBUG ("(Main Thread) Adding thumbnail: %s\n",
                info->image_uri);
-        g_queue_push_tail ((GQueue *) &thumbnails_to_make, info);
-        node = g_queue_peek_tail_link ((GQueue *) &thumbnails_to_make);
+        info->priority = NAUTILUS_THUMBNAIL_PRIORITY_BACKGROUND;
+        g_queue_push_tail (&thumbnails_to_make[info->priority], info);
+        node = g_queue_peek_tail_link (&thumbnails_to_make[info->priority]);
         g_hash_table_insert (thumbnails_to_make_hash,
                              info->image_uri,
                              node);
-        /* If the thumbnail thread isn't running, and we haven't
-         *  scheduled an idle function to start it up, do that now.
-         *  We don't want to start it until all the other work is done,
+        /* If not all thumbnail threads are running, and we haven't
+         *  scheduled an idle function to start them up, do that now.
+         *  We don't want to start them until all the other work is done,
          *  so the GUI will be updated as quickly as possible.*/
-        if (thumbnail_thread_is_running == FALSE &&
+        if ((max_workers == 0 || n_running_workers < max_workers) &&
             thumbnail_thread_starter_id == 0)
         {
             thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
@@ -434,7 +861,65 @@ nautilus_create_thumbnail (NautilusFile *file)
     g_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+/* Takes the first thumbnail to make, by tier, that no other worker is making and whose
+ *  kind doesn't have all the workers it can get. Lock thumbnails_mutex when
+ *  calling this. */
+static NautilusThumbnailInfo *
+take_next_thumbnail (void)
+{
+    for (int i = 0; i < NAUTILUS_THUMBNAIL_N_PRIORITIES; i++)
+    {
+        for (GList *l = thumbnails_to_make[i].head; l != NULL; l = l->next)
+        {
+            NautilusThumbnailInfo *info = l->data;
+            const char *kind;
+            guint running;
+
+            if (info->in_progress)
+            {
+                continue;
+            }
+
+            kind = get_kind (info->mime_type);
+            running = GPOINTER_TO_UINT (g_hash_table_lookup (running_workers_per_kind, kind));
+            if (running >= get_kind_limit (kind))
+            {
+                continue;
+            }
+
+            g_hash_table_insert (running_workers_per_kind, g_strdup (kind), GUINT_TO_POINTER (running + 1));
+            info->in_progress = TRUE;
+
+            return info;
+        }
+    }
+
+    return NULL;
+}
+
+/* Lock thumbnails_mutex when calling this. */
+static void
+release_thumbnail (NautilusThumbnailInfo *info)
+{
+    const char *kind;
+    guint running;
+
+    kind = get_kind (info->mime_type);
+    running = GPOINTER_TO_UINT (g_hash_table_lookup (running_workers_per_kind, kind));
+    if (running > 1)
+    {
+        g_hash_table_insert (running_workers_per_kind, g_strdup (kind), GUINT_TO_POINTER (running - 1));
+    }
+    else
+    {
+        g_hash_table_remove (running_workers_per_kind, kind);
+    }
+
+    info->in_progress = FALSE;
+}
+
+/* thumbnail_thread is invoked as separate threads, the workers, to make
+ *  thumbnails. They share the thumbnails_to_make list. */
 static void
 thumbnail_thread_func (GTask        *task,
                        gpointer      source_object,
@@ -445,12 +930,11 @@ thumbnail_thread_func (GTask        *task,
     NautilusThumbnailInfo *info = NULL;
     GdkPixbuf *pixbuf;
     time_t current_orig_mtime = 0;
-    time_t current_time;
     GList *node;
 
     thumbnail_factory = get_thumbnail_factory ();
 
-    /* We loop until there are no more thumbails to make, at which point
+    /* We loop until there are no more thumbails we can make, at which point
      *  we exit the thread. */
     for (;;)
     {
@@ -462,42 +946,41 @@ thumbnail_thread_func (GTask        *task,
          * MUTEX LOCKED
          *********************************/
 
-        /* Pop the last thumbnail we just made off the head of the
-         *  list and free it. I did this here so we only have to lock
-         *  the mutex once per thumbnail, rather than once before
-         *  creating it and once after.
+        /* Pop the last thumbnail we just made off the list and free it.
+         *  I did this here so we only have to lock the mutex once per
+         *  thumbnail, rather than once before creating it and once after.
          *  Don't pop the thumbnail off the queue if the original file
          *  mtime of the request changed. Then we need to redo the thumbnail.
          */
-        if (currently_thumbnailing &&
-            currently_thumbnailing->original_file_mtime == current_orig_mtime)
+        if (info != NULL)
         {
-            g_assert (info == currently_thumbnailing);
-            node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-            g_assert (node != NULL);
-            g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-            free_thumbnail_info (info);
-            g_queue_delete_link ((GQueue *) &thumbnails_to_make, node);
+            release_thumbnail (info);
+            if (info->original_file_mtime == current_orig_mtime)
+            {
+                node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
+                g_assert (node != NULL);
+                g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+                g_queue_delete_link (&thumbnails_to_make[info->priority], node);
+                free_thumbnail_info (info);
+            }
         }
-        currently_thumbnailing = NULL;
 
-        /* If there are no more thumbnails to make, reset the
-         *  thumbnail_thread_is_running flag, unlock the mutex, and
-         *  exit the thread. */
-        if (g_queue_is_empty ((GQueue *) &thumbnails_to_make))
+        /* Get the next one to make. We leave it on the list until it
+         *  is created so the main thread doesn't add it again while we
+         *  are creating it. */
+        info = take_next_thumbnail ();
+
+        /* If there are no more thumbnails we can make, the other workers
+         *  having the rest, unlock the mutex and exit the thread. */
+        if (info == NULL)
         {
             DEBUG ("(Thumbnail Thread) Exiting\n");
 
-            thumbnail_thread_is_running = FALSE;
+            n_running_workers--;
             g_mutex_unlock (&thumbnails_mutex);
             return;
         }
 
-        /* Get the next one to make. We leave it on the list until it
-         *  is created so the main thread doesn't add it again while we
-         *  are creating it. */
-        info = g_queue_peek_head ((GQueue *) &thumbnails_to_make);
-        currently_thumbnailing = info;
         current_orig_mtime = info->original_file_mtime;
         /*********************************
          * MUTEX UNLOCKED
@@ -507,19 +990,17 @@ thumbnail_thread_func (GTask        *task,
 
         g_mutex_unlock (&thumbnails_mutex);
 
-        time (&current_time);
-
-        /* Don't try to create a thumbnail if the file was modified recently.
-         *  This prevents constant re-thumbnailing of changing files. */
-        if (current_time < current_orig_mtime + THUMBNAIL_CREATION_DELAY_SECS &&
-            current_time >= current_orig_mtime)
+        /* Modified again since it was queued */
+        if (is_recently_modified (current_orig_mtime))
         {
             DEBUG ("(Thumbnail Thread) Skipping: %s\n",
                    info->image_uri);
 
             /* Reschedule thumbnailing via a change notification */
-            g_timeout_add_seconds (1, thumbnail_thread_notify_file_changed,
-                                   g_strdup (info->image_uri));
+            g_mutex_lock (&thumbnails_mutex);
+            delay_thumbnail (info->image_uri,
+                             current_orig_mtime + THUMBNAIL_CREATION_DELAY_SECS);
+            g_mutex_unlock (&thumbnails_mutex);
             continue;
         }
 
@@ -527,9 +1008,17 @@ thumbnail_thread_func (GTask        *task,
         DEBUG ("(Thumbnail Thread) Creating thumbnail: %s\n",
                info->image_uri);
 
-        pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
-                                                                     info->image_uri,
-                                                                     info->mime_type);
+        /* Camera pictures are the bulk of big image folders, and spawning a
+         * thumbnailer to decode them whole is what makes those slow. */
+        pixbuf = nautilus_thumbnail_preview_load (info->image_uri,
+                                                  info->mime_type,
+                                                  LARGE_THUMBNAIL_PIXELS);
+        if (pixbuf == NULL)
+        {
+            pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
+                                                                         info->image_uri,
+                                                                         info->mime_type);
+        }
 
         if (pixbuf)
         {
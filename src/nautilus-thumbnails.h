@@ -24,6 +24,16 @@
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include "nautilus-file.h"
 
+/* The tiers of the thumbnail queue, made one after the other */
+typedef enum
+{
+    NAUTILUS_THUMBNAIL_PRIORITY_VISIBLE,
+    NAUTILUS_THUMBNAIL_PRIORITY_NEAR_VISIBLE,
+    NAUTILUS_THUMBNAIL_PRIORITY_BACKGROUND,
+    NAUTILUS_THUMBNAIL_PRIORITY_PREFETCH,
+    NAUTILUS_THUMBNAIL_N_PRIORITIES
+} NautilusThumbnailPriority;
+
 /* Returns NULL if there's no thumbnail yet. */
 void       nautilus_create_thumbnail                (NautilusFile *file);
 gboolean   nautilus_can_thumbnail                   (NautilusFile *file);
@@ -32,4 +42,17 @@ gboolean   nautilus_thumbnail_is_mimetype_limited_by_size
 
 /* Queue handling: */
 void       nautilus_thumbnail_remove_from_queue     (const char   *file_uri);
-void       nautilus_thumbnail_prioritize            (const char   *file_uri);
\ No newline at end of file
+void       nautilus_thumbnail_prioritize            (const char   *file_uri);
+void       nautilus_thumbnail_demote                (const char   *file_uri);
+/* Drops a queued thumbnail, so it's only made if the icon is asked for again. */
+void       nautilus_thumbnail_cancel                (NautilusFile *file);
+/* Moves the queued thumbnails of @files, in this order, to the head of the
+ * @priority tier, on behalf of @owner, the view showing them. */
+void       nautilus_thumbnail_set_priority          (GList                     *files,
+						     NautilusThumbnailPriority  priority,
+						     gconstpointer              owner);
+/* Moves the queued thumbnails that @owner last set the priority of to the
+ * background tier, e.g. when its view is hidden. */
+void       nautilus_thumbnail_demote_owner          (gconstpointer              owner);
+/* Drops the queued thumbnails that @owner, going away, last set the priority of. */
+void       nautilus_thumbnail_drop_owner            (gconstpointer              owner);
\ No newline at end of file
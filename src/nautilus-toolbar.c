@@ -461,7 +461,7 @@ on_progress_info_cancelled (NautilusToolbar *self)
 }
 
 static void
-on_progress_info_progress_changed (NautilusToolbar *self)
+on_progress_manager_progress_changed (NautilusToolbar *self)
 {
     /* Update the pie chart progress */
     gtk_widget_queue_draw (self->operations_icon);
@@ -537,8 +537,6 @@ update_operations (NautilusToolbar *self)
                                   G_CALLBACK (on_progress_info_finished), self);
         g_signal_connect_swapped (l->data, "cancelled",
                                   G_CALLBACK (on_progress_info_cancelled), self);
-        g_signal_connect_swapped (l->data, "progress-changed",
-                                  G_CALLBACK (on_progress_info_progress_changed), self);
         progress = nautilus_progress_info_widget_new (l->data);
         gtk_box_pack_start (GTK_BOX (self->operations_container),
                             progress,
@@ -928,6 +926,8 @@ nautilus_toolbar_constructed (GObject *object)
                       G_CALLBACK (on_new_progress_info), self);
     g_signal_connect (self->progress_manager, "has-viewers-changed",
                       G_CALLBACK (on_progress_has_viewers_changed), self);
+    g_signal_connect_swapped (self->progress_manager, "progress-changed",
+                              G_CALLBACK (on_progress_manager_progress_changed), self);
 
     update_operations (self);
 
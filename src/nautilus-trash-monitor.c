@@ -23,6 +23,11 @@
 
 #include <eel/eel-debug.h>
 
+/* The changes to the trash come in storms when many files are trashed
+ * or deleted. It is queried once they stop for QUERY_DELAY_MSECS, and
+ * UPDATE_RATE_SECONDS after the first of them at the latest.
+ */
+#define QUERY_DELAY_MSECS 200
 #define UPDATE_RATE_SECONDS 1
 
 struct _NautilusTrashMonitor
@@ -31,8 +36,10 @@ struct _NautilusTrashMonitor
 
     gboolean empty;
     GFileMonitor *file_monitor;
-    gboolean pending;
-    gint timeout_id;
+    gboolean query_in_progress;
+    gboolean pending; /* changed while the query was in flight */
+    guint timeout_id;
+    gint64 first_change_time;
 };
 
 enum
@@ -53,11 +60,7 @@ nautilus_trash_monitor_finalize (GObject *object)
 
     trash_monitor = NAUTILUS_TRASH_MONITOR (object);
 
-    if (trash_monitor->timeout_id > 0)
-    {
-        g_source_remove (trash_monitor->timeout_id);
-        trash_monitor->timeout_id = 0;
-    }
+    g_clear_handle_id (&trash_monitor->timeout_id, g_source_remove);
 
     if (trash_monitor->file_monitor)
     {
@@ -104,6 +107,8 @@ update_empty_info (NautilusTrashMonitor *trash_monitor,
                    trash_monitor->empty);
 }
 
+static void schedule_update_info (NautilusTrashMonitor *trash_monitor);
+
 /* Use G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT since we only want to know whether the
  * trash is empty or not, not access its children. This is available for the
  * trash backend since it uses a cache. In this way we prevent flooding the
@@ -119,6 +124,8 @@ trash_query_info_cb (GObject      *source,
     guint32 item_count;
     gboolean is_empty = TRUE;
 
+    trash_monitor->query_in_progress = FALSE;
+
     info = g_file_query_info_finish (G_FILE (source), res, NULL);
 
     if (info != NULL)
@@ -130,12 +137,35 @@ trash_query_info_cb (GObject      *source,
         g_object_unref (info);
     }
 
-    update_empty_info (trash_monitor, is_empty);
+    if (trash_monitor->pending)
+    {
+        /* The result may be outdated already */
+        trash_monitor->pending = FALSE;
+        schedule_update_info (trash_monitor);
+    }
+    else
+    {
+        update_empty_info (trash_monitor, is_empty);
+    }
 
     g_object_unref (trash_monitor);
 }
 
-static void schedule_update_info (NautilusTrashMonitor *trash_monitor);
+static void
+query_info (NautilusTrashMonitor *trash_monitor)
+{
+    GFile *location;
+
+    trash_monitor->query_in_progress = TRUE;
+
+    location = g_file_new_for_uri ("trash:///");
+    g_file_query_info_async (location,
+                             G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT,
+                             G_FILE_QUERY_INFO_NONE,
+                             G_PRIORITY_DEFAULT, NULL,
+                             trash_query_info_cb, g_object_ref (trash_monitor));
+    g_object_unref (location);
+}
 
 static gboolean
 schedule_update_info_cb (gpointer data)
@@ -143,11 +173,7 @@ schedule_update_info_cb (gpointer data)
     NautilusTrashMonitor *trash_monitor = data;
 
     trash_monitor->timeout_id = 0;
-    if (trash_monitor->pending)
-    {
-        trash_monitor->pending = FALSE;
-        schedule_update_info (trash_monitor);
-    }
+    query_info (trash_monitor);
 
     return G_SOURCE_REMOVE;
 }
@@ -155,28 +181,47 @@ schedule_update_info_cb (gpointer data)
 static void
 schedule_update_info (NautilusTrashMonitor *trash_monitor)
 {
-    GFile *location;
+    gint64 now;
 
-    /* Rate limit the updates to not flood the gvfsd-trash when too many changes
-     * happended in a short time.
+    /* Only one query at a time, with the changes in between coalesced
+     * into the next one, to not flood the gvfsd-trash.
      */
-    if (trash_monitor->timeout_id > 0)
+    if (trash_monitor->query_in_progress)
     {
         trash_monitor->pending = TRUE;
         return;
     }
 
-    location = g_file_new_for_uri ("trash:///");
-    g_file_query_info_async (location,
-                             G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT,
-                             G_FILE_QUERY_INFO_NONE,
-                             G_PRIORITY_DEFAULT, NULL,
-                             trash_query_info_cb, g_object_ref (trash_monitor));
+    now = g_get_monotonic_time ();
+    if (trash_monitor->timeout_id == 0)
+    {
+        trash_monitor->first_change_time = now;
+    }
+    else if (now - trash_monitor->first_change_time + QUERY_DELAY_MSECS * 1000 >=
+             UPDATE_RATE_SECONDS * G_USEC_PER_SEC)
+    {
+        /* Not postponed any further */
+        return;
+    }
 
-    trash_monitor->timeout_id = g_timeout_add_seconds (UPDATE_RATE_SECONDS,
-                                                       schedule_update_info_cb,
-                                                       trash_monitor);
-    g_object_unref (location);
+    g_clear_handle_id (&trash_monitor->timeout_id, g_source_remove);
+    trash_monitor->timeout_id = g_timeout_add (QUERY_DELAY_MSECS,
+                                               schedule_update_info_cb,
+                                               trash_monitor);
+}
+
+/* An item coming in can't leave the trash empty, so there is nothing to
+ * ask. Only a query in flight, which could still say otherwise, is redone.
+ */
+static void
+trash_not_empty (NautilusTrashMonitor *trash_monitor)
+{
+    if (trash_monitor->query_in_progress)
+    {
+        trash_monitor->pending = TRUE;
+    }
+
+    update_empty_info (trash_monitor, FALSE);
 }
 
 static void
@@ -190,6 +235,13 @@ file_changed (GFileMonitor      *monitor,
 
     trash_monitor = NAUTILUS_TRASH_MONITOR (user_data);
 
+    if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+        event_type == G_FILE_MONITOR_EVENT_MOVED_IN)
+    {
+        trash_not_empty (trash_monitor);
+        return;
+    }
+
     schedule_update_info (trash_monitor);
 }
 
@@ -211,7 +263,7 @@ nautilus_trash_monitor_init (NautilusTrashMonitor *trash_monitor)
 
     g_object_unref (location);
 
-    schedule_update_info (trash_monitor);
+    query_info (trash_monitor);
 }
 
 static void
@@ -235,6 +287,15 @@ nautilus_trash_monitor_get (void)
     return nautilus_trash_monitor;
 }
 
+void
+nautilus_trash_monitor_files_trashed (void)
+{
+    NautilusTrashMonitor *monitor;
+
+    monitor = nautilus_trash_monitor_get ();
+    trash_not_empty (monitor);
+}
+
 gboolean
 nautilus_trash_monitor_is_empty (void)
 {
@@ -32,4 +32,7 @@ G_DECLARE_FINAL_TYPE (NautilusTrashMonitor, nautilus_trash_monitor,
 
 NautilusTrashMonitor   *nautilus_trash_monitor_get      (void);
 gboolean                nautilus_trash_monitor_is_empty (void);
+/* For the files Nautilus trashed itself, which leave the trash full
+ * without it being queried. */
+void                    nautilus_trash_monitor_files_trashed (void);
 GIcon                  *nautilus_trash_monitor_get_symbolic_icon (void);
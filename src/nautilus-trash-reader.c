@@ -0,0 +1,347 @@
+/* nautilus-trash-reader.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "nautilus-trash-reader.h"
+
+#include <gio/gunixmounts.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nautilus-directory-reader.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_FILE
+#include "nautilus-debug.h"
+
+#define TRASH_INFO_SUFFIX ".trashinfo"
+
+/* The .trashinfo files are only parsed by several threads from that many
+ * on, and by that many threads at most */
+#define MIN_FILES_PER_THREAD 256
+#define MAX_THREADS 8
+
+typedef struct
+{
+    char *path;
+    /* What the paths of its .trashinfo files are relative to, NULL when
+     * they are absolute, as in the home trash */
+    char *top_dir;
+} TrashDir;
+
+typedef struct
+{
+    TrashDir *trash_dir;
+    char *name;                 /* of the trashed file */
+    NautilusTrashItem *item;    /* once parsed, NULL if it couldn't be */
+} PendingItem;
+
+typedef struct
+{
+    GPtrArray *pending;
+    gint next;
+    GCancellable *cancellable;
+} ParseData;
+
+static void
+trash_item_free (NautilusTrashItem *item)
+{
+    g_object_unref (item->file);
+    g_free (item->orig_path);
+    g_free (item);
+}
+
+static void
+trash_dir_free (TrashDir *trash_dir)
+{
+    g_free (trash_dir->path);
+    g_free (trash_dir->top_dir);
+    g_free (trash_dir);
+}
+
+static void
+pending_item_free (PendingItem *pending)
+{
+    g_free (pending->name);
+    g_clear_pointer (&pending->item, trash_item_free);
+    g_free (pending);
+}
+
+static char *
+get_info_path (const char *trash_dir,
+               const char *name)
+{
+    g_autofree char *info_name = g_strconcat (name, TRASH_INFO_SUFFIX, NULL);
+
+    return g_build_filename (trash_dir, "info", info_name, NULL);
+}
+
+/* The Path and DeletionDate keys of the [Trash Info] group, without the
+ * cost of a GKeyFile, as there may be hundreds of thousands of them. */
+static gboolean
+parse_trash_info (char        *contents,
+                  const char  *top_dir,
+                  char       **orig_path,
+                  gint64      *deletion_time)
+{
+    g_auto (GStrv) lines = NULL;
+    gboolean in_group = FALSE;
+
+    *orig_path = NULL;
+    *deletion_time = 0;
+
+    lines = g_strsplit (contents, "\n", -1);
+    for (guint i = 0; lines[i] != NULL; i++)
+    {
+        char *line = g_strchomp (lines[i]);
+
+        if (*line == '[')
+        {
+            in_group = strcmp (line, "[Trash Info]") == 0;
+        }
+        else if (in_group && g_str_has_prefix (line, "Path=") && *orig_path == NULL)
+        {
+            g_autofree char *path = g_uri_unescape_string (line + strlen ("Path="), NULL);
+
+            if (path != NULL && (top_dir != NULL || g_path_is_absolute (path)))
+            {
+                *orig_path = g_path_is_absolute (path) ?
+                             g_steal_pointer (&path) :
+                             g_build_filename (top_dir, path, NULL);
+            }
+        }
+        else if (in_group && g_str_has_prefix (line, "DeletionDate="))
+        {
+            g_autoptr (GTimeZone) local = g_time_zone_new_local ();
+            g_autoptr (GDateTime) date = NULL;
+
+            /* In local time, as g_file_info_get_deletion_date() reads it */
+            date = g_date_time_new_from_iso8601 (line + strlen ("DeletionDate="), local);
+            if (date != NULL)
+            {
+                *deletion_time = g_date_time_to_unix (date);
+            }
+        }
+    }
+
+    return *orig_path != NULL;
+}
+
+static void
+parse_pending_item (PendingItem *pending)
+{
+    g_autofree char *info_path = NULL;
+    g_autofree char *contents = NULL;
+    g_autofree char *file_path = NULL;
+    char *orig_path;
+    gint64 deletion_time;
+
+    info_path = get_info_path (pending->trash_dir->path, pending->name);
+    if (!g_file_get_contents (info_path, &contents, NULL, NULL) ||
+        !parse_trash_info (contents, pending->trash_dir->top_dir, &orig_path, &deletion_time))
+    {
+        return;
+    }
+
+    file_path = g_build_filename (pending->trash_dir->path, "files", pending->name, NULL);
+
+    pending->item = g_new0 (NautilusTrashItem, 1);
+    pending->item->file = g_file_new_for_path (file_path);
+    pending->item->orig_path = orig_path;
+    pending->item->deletion_time = deletion_time;
+}
+
+static gpointer
+parse_thread_func (gpointer user_data)
+{
+    ParseData *data = user_data;
+    guint i;
+
+    while ((i = g_atomic_int_add (&data->next, 1)) < data->pending->len &&
+           !g_cancellable_is_cancelled (data->cancellable))
+    {
+        parse_pending_item (g_ptr_array_index (data->pending, i));
+    }
+
+    return NULL;
+}
+
+static void
+parse_pending_items (GPtrArray    *pending,
+                     GCancellable *cancellable)
+{
+    ParseData data = { pending, 0, cancellable };
+    GThread *threads[MAX_THREADS];
+    guint n_threads;
+
+    n_threads = CLAMP (MIN (pending->len / MIN_FILES_PER_THREAD, g_get_num_processors ()),
+                       1, MAX_THREADS);
+
+    /* This thread is one of them */
+    for (guint i = 1; i < n_threads; i++)
+    {
+        threads[i] = g_thread_new ("nautilus-trash-reader", parse_thread_func, &data);
+    }
+    parse_thread_func (&data);
+    for (guint i = 1; i < n_threads; i++)
+    {
+        g_thread_join (threads[i]);
+    }
+}
+
+static void
+list_trash_dir (TrashDir     *trash_dir,
+                GPtrArray    *pending,
+                GCancellable *cancellable)
+{
+    g_autofree char *info_dir_path = NULL;
+    g_autoptr (GFile) info_dir = NULL;
+    g_autoptr (NautilusDirectoryReader) reader = NULL;
+    const NautilusDirectoryEntry *entry;
+
+    info_dir_path = g_build_filename (trash_dir->path, "info", NULL);
+    info_dir = g_file_new_for_path (info_dir_path);
+    reader = nautilus_directory_reader_new (info_dir, NAUTILUS_DIRECTORY_READER_TYPE,
+                                            cancellable, NULL);
+    while (reader != NULL && (entry = nautilus_directory_reader_next (reader, NULL)) != NULL)
+    {
+        PendingItem *item;
+
+        if (entry->type != G_FILE_TYPE_REGULAR ||
+            !g_str_has_suffix (entry->name, TRASH_INFO_SUFFIX))
+        {
+            continue;
+        }
+
+        item = g_new0 (PendingItem, 1);
+        item->trash_dir = trash_dir;
+        item->name = g_strndup (entry->name, strlen (entry->name) - strlen (TRASH_INFO_SUFFIX));
+        g_ptr_array_add (pending, item);
+    }
+}
+
+/* The home trash and the .Trash-$uid folders of the mounts */
+static GPtrArray *
+get_trash_dirs (void)
+{
+    GPtrArray *trash_dirs;
+    TrashDir *trash_dir;
+    GList *mounts;
+    g_autofree char *trash_name = NULL;
+
+    trash_dirs = g_ptr_array_new_with_free_func ((GDestroyNotify) trash_dir_free);
+
+    trash_dir = g_new0 (TrashDir, 1);
+    trash_dir->path = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+    g_ptr_array_add (trash_dirs, trash_dir);
+
+    trash_name = g_strdup_printf (".Trash-%u", (guint) getuid ());
+    mounts = g_unix_mounts_get (NULL);
+    for (GList *l = mounts; l != NULL; l = l->next)
+    {
+        GUnixMountEntry *mount = l->data;
+        const char *mount_path = g_unix_mount_get_mount_path (mount);
+        g_autofree char *path = NULL;
+
+        if (g_unix_mount_is_system_internal (mount))
+        {
+            continue;
+        }
+
+        /* Not followed, as the specification wants */
+        path = g_build_filename (mount_path, trash_name, NULL);
+        if (!g_file_test (path, G_FILE_TEST_IS_DIR) ||
+            g_file_test (path, G_FILE_TEST_IS_SYMLINK))
+        {
+            continue;
+        }
+
+        trash_dir = g_new0 (TrashDir, 1);
+        trash_dir->path = g_steal_pointer (&path);
+        trash_dir->top_dir = g_strdup (mount_path);
+        g_ptr_array_add (trash_dirs, trash_dir);
+    }
+    g_list_free_full (mounts, (GDestroyNotify) g_unix_mount_free);
+
+    return trash_dirs;
+}
+
+GPtrArray *
+nautilus_trash_reader_read (GCancellable *cancellable)
+{
+    g_autoptr (GPtrArray) trash_dirs = NULL;
+    g_autoptr (GPtrArray) pending = NULL;
+    GPtrArray *items;
+
+    trash_dirs = get_trash_dirs ();
+    pending = g_ptr_array_new_with_free_func ((GDestroyNotify) pending_item_free);
+    for (guint i = 0; i < trash_dirs->len; i++)
+    {
+        list_trash_dir (g_ptr_array_index (trash_dirs, i), pending, cancellable);
+    }
+
+    parse_pending_items (pending, cancellable);
+    if (g_cancellable_is_cancelled (cancellable))
+    {
+        return NULL;
+    }
+
+    items = g_ptr_array_new_full (pending->len, (GDestroyNotify) trash_item_free);
+    for (guint i = 0; i < pending->len; i++)
+    {
+        PendingItem *item = g_ptr_array_index (pending, i);
+
+        if (item->item != NULL)
+        {
+            g_ptr_array_add (items, g_steal_pointer (&item->item));
+        }
+    }
+
+    DEBUG ("Read %u trashed files in %u trash folders", items->len, trash_dirs->len);
+
+    return items;
+}
+
+gboolean
+nautilus_trash_reader_restore (GFile   *file,
+                               GFile   *dest,
+                               GError **error)
+{
+    g_autoptr (GFile) files_dir = NULL;
+    g_autoptr (GFile) trash_dir = NULL;
+    g_autofree char *name = NULL;
+    g_autofree char *trash_dir_path = NULL;
+    g_autofree char *info_path = NULL;
+
+    if (!g_file_move (file, dest, G_FILE_COPY_NOFOLLOW_SYMLINKS, NULL, NULL, NULL, error))
+    {
+        return FALSE;
+    }
+
+    files_dir = g_file_get_parent (file);
+    trash_dir = g_file_get_parent (files_dir);
+    name = g_file_get_basename (file);
+    trash_dir_path = g_file_get_path (trash_dir);
+    info_path = get_info_path (trash_dir_path, name);
+
+    /* The file is restored already, a stale .trashinfo isn't worth failing */
+    if (g_unlink (info_path) != 0)
+    {
+        DEBUG ("Failed to remove %s", info_path);
+    }
+
+    return TRUE;
+}
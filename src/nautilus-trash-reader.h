@@ -0,0 +1,46 @@
+/* nautilus-trash-reader.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* The trash reader reads the local trash folders of the freedesktop.org
+ * specification itself, the home one and the .Trash-$uid ones at the top
+ * of the mounts, parsing their .trashinfo files in a few threads. That is
+ * for looking trashed files up by their original location, for which
+ * listing trash:/// has gvfsd-trash parse them one by one and send them
+ * over D-Bus entry by entry.
+ *
+ * The shared .Trash/$uid folders are left to GVfs. Blocking, for worker
+ * threads.
+ */
+
+typedef struct
+{
+    GFile *file;            /* the trashed file, in files/ */
+    char *orig_path;
+    gint64 deletion_time;   /* as a Unix time, 0 when unknown */
+} NautilusTrashItem;
+
+/* Returns a GPtrArray of NautilusTrashItem, or NULL when cancelled. */
+GPtrArray *nautilus_trash_reader_read    (GCancellable  *cancellable);
+
+/* Moves @file, as read above, back to @dest and removes its .trashinfo,
+ * as gvfsd-trash does when restoring. */
+gboolean   nautilus_trash_reader_restore (GFile         *file,
+                                          GFile         *dest,
+                                          GError       **error);
@@ -9,6 +9,11 @@
 #include "nautilus-window-slot.h"
 #include "nautilus-directory.h"
 #include "nautilus-global-preferences.h"
+#include "nautilus-thumbnails.h"
+
+/* How far above and below the viewport items keep their icon loaded,
+ * in pages. */
+#define VISIBLE_ITEMS_MARGIN 0.5
 
 struct _NautilusViewIconController
 {
@@ -22,6 +27,14 @@ struct _NautilusViewIconController
     gint zoom_level;
 
     GtkGesture *multi_press_gesture;
+
+    /* Item models of the files removed since the last begin_file_changes,
+     * removed from the model all at once at end_file_changes. */
+    GQueue pending_removals;
+
+    /* The item UIs near the viewport, which have their icon loaded. */
+    GHashTable *visible_items;
+    guint update_visible_items_id;
 };
 
 G_DEFINE_TYPE (NautilusViewIconController, nautilus_view_icon_controller, NAUTILUS_TYPE_FILES_VIEW)
@@ -245,12 +258,170 @@ real_begin_loading (NautilusFilesView *files_view)
     nautilus_files_view_update_toolbar_menus (files_view);
 }
 
+/* The children are laid out in model order, so the first one reaching
+ * below @y can be found by bisection.
+ */
+static guint
+find_first_item_below (NautilusViewIconController *self,
+                       gint                        y)
+{
+    GtkFlowBoxChild *child;
+    GtkAllocation allocation;
+    guint low, high, middle;
+
+    low = 0;
+    high = g_list_model_get_n_items (G_LIST_MODEL (nautilus_view_model_get_g_model (self->model)));
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        child = gtk_flow_box_get_child_at_index (GTK_FLOW_BOX (self->view_ui), middle);
+        if (child == NULL)
+        {
+            high = middle;
+            continue;
+        }
+
+        gtk_widget_get_allocation (GTK_WIDGET (child), &allocation);
+        if (allocation.y + allocation.height <= y)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static gboolean
+update_visible_items_idle_callback (gpointer user_data)
+{
+    NautilusViewIconController *self = NAUTILUS_VIEW_ICON_CONTROLLER (user_data);
+    GtkWidget *content_widget;
+    GtkAdjustment *vadjustment;
+    GtkFlowBoxChild *child;
+    GtkAllocation allocation;
+    GHashTable *visible_items;
+    GHashTableIter iter;
+    gpointer item_ui;
+    GList *files, *l;
+    g_autoptr (GList) thumbnailing = NULL;
+    g_autoptr (GList) hidden_thumbnailing = NULL;
+    NautilusFile *file;
+    gdouble value, page_size;
+    gint top, bottom;
+    guint i;
+
+    self->update_visible_items_id = 0;
+
+    content_widget = nautilus_files_view_get_content_widget (NAUTILUS_FILES_VIEW (self));
+    vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (content_widget));
+    value = gtk_adjustment_get_value (vadjustment);
+    page_size = gtk_adjustment_get_page_size (vadjustment);
+    top = value - page_size * VISIBLE_ITEMS_MARGIN;
+    bottom = value + page_size * (1 + VISIBLE_ITEMS_MARGIN);
+
+    visible_items = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+    files = NULL;
+    for (i = find_first_item_below (self, top);
+         (child = gtk_flow_box_get_child_at_index (GTK_FLOW_BOX (self->view_ui), i)) != NULL;
+         i++)
+    {
+        gtk_widget_get_allocation (GTK_WIDGET (child), &allocation);
+        if (allocation.y >= bottom)
+        {
+            break;
+        }
+
+        nautilus_view_icon_item_ui_set_icon_visible (NAUTILUS_VIEW_ICON_ITEM_UI (child), TRUE);
+        g_hash_table_add (visible_items, g_object_ref (child));
+
+        if (!g_hash_table_contains (self->visible_items, child))
+        {
+            file = nautilus_view_item_model_get_file (nautilus_view_icon_item_ui_get_model (NAUTILUS_VIEW_ICON_ITEM_UI (child)));
+            files = g_list_prepend (files, file);
+        }
+    }
+
+    /* Recycle the icons of the items that went out of the way. */
+    g_hash_table_iter_init (&iter, self->visible_items);
+    while (g_hash_table_iter_next (&iter, &item_ui, NULL))
+    {
+        if (!g_hash_table_contains (visible_items, item_ui))
+        {
+            nautilus_view_icon_item_ui_set_icon_visible (item_ui, FALSE);
+
+            file = nautilus_view_item_model_get_file (nautilus_view_icon_item_ui_get_model (item_ui));
+            if (nautilus_file_is_thumbnailing (file))
+            {
+                hidden_thumbnailing = g_list_prepend (hidden_thumbnailing, file);
+            }
+        }
+    }
+    g_hash_table_destroy (self->visible_items);
+    self->visible_items = visible_items;
+
+    /* The list is bottom-up, so the topmost item ends up first in the
+     * work queues.
+     */
+    for (l = files; l != NULL; l = l->next)
+    {
+        file = NAUTILUS_FILE (l->data);
+        nautilus_file_prioritize_attributes (file);
+        if (nautilus_file_is_thumbnailing (file))
+        {
+            thumbnailing = g_list_prepend (thumbnailing, file);
+        }
+    }
+    g_list_free (files);
+
+    nautilus_thumbnail_set_priority (thumbnailing, NAUTILUS_THUMBNAIL_PRIORITY_VISIBLE, self);
+    nautilus_thumbnail_set_priority (hidden_thumbnailing, NAUTILUS_THUMBNAIL_PRIORITY_PREFETCH, self);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_update_visible_items (NautilusViewIconController *self)
+{
+    if (self->update_visible_items_id == 0)
+    {
+        self->update_visible_items_id =
+            g_idle_add_full (G_PRIORITY_LOW,
+                             update_visible_items_idle_callback,
+                             self, NULL);
+    }
+}
+
+static void
+on_vadjustment_changed (GtkAdjustment              *adjustment,
+                        NautilusViewIconController *self)
+{
+    schedule_update_visible_items (self);
+}
+
+static void
+on_view_ui_size_allocate (GtkWidget                  *widget,
+                          GtkAllocation              *allocation,
+                          NautilusViewIconController *self)
+{
+    schedule_update_visible_items (self);
+}
+
 static void
 real_clear (NautilusFilesView *files_view)
 {
     NautilusViewIconController *self = NAUTILUS_VIEW_ICON_CONTROLLER (files_view);
 
+    if (self->visible_items != NULL)
+    {
+        g_hash_table_remove_all (self->visible_items);
+    }
+    g_queue_clear_full (&self->pending_removals, g_object_unref);
     nautilus_view_model_remove_all_items (self->model);
+    nautilus_thumbnail_drop_owner (self);
 }
 
 
@@ -306,6 +477,13 @@ real_is_empty (NautilusFilesView *files_view)
 static void
 real_end_file_changes (NautilusFilesView *files_view)
 {
+    NautilusViewIconController *self = NAUTILUS_VIEW_ICON_CONTROLLER (files_view);
+
+    if (!g_queue_is_empty (&self->pending_removals))
+    {
+        nautilus_view_model_remove_items (self->model, &self->pending_removals);
+        g_queue_clear_full (&self->pending_removals, g_object_unref);
+    }
 }
 
 static void
@@ -314,19 +492,12 @@ real_remove_file (NautilusFilesView *files_view,
                   NautilusDirectory *directory)
 {
     NautilusViewIconController *self = NAUTILUS_VIEW_ICON_CONTROLLER (files_view);
-    NautilusFile *current_file;
-    NautilusViewItemModel *current_item_model;
-    guint i = 0;
+    NautilusViewItemModel *item_model;
 
-    while ((current_item_model = NAUTILUS_VIEW_ITEM_MODEL (g_list_model_get_item (G_LIST_MODEL (nautilus_view_model_get_g_model (self->model)), i))))
+    item_model = nautilus_view_model_get_item_from_file (self->model, file);
+    if (item_model != NULL)
     {
-        current_file = nautilus_view_item_model_get_file (current_item_model);
-        if (current_file == file)
-        {
-            g_list_store_remove (nautilus_view_model_get_g_model (self->model), i);
-            break;
-        }
-        i++;
+        g_queue_push_tail (&self->pending_removals, g_object_ref (item_model));
     }
 }
 
@@ -966,6 +1137,9 @@ dispose (GObject *object)
     self = NAUTILUS_VIEW_ICON_CONTROLLER (object);
 
     g_clear_object (&self->multi_press_gesture);
+    g_clear_handle_id (&self->update_visible_items_id, g_source_remove);
+    g_clear_pointer (&self->visible_items, g_hash_table_destroy);
+    nautilus_thumbnail_drop_owner (self);
 
     G_OBJECT_CLASS (nautilus_view_icon_controller_parent_class)->dispose (object);
 }
@@ -973,6 +1147,12 @@ dispose (GObject *object)
 static void
 finalize (GObject *object)
 {
+    NautilusViewIconController *self;
+
+    self = NAUTILUS_VIEW_ICON_CONTROLLER (object);
+
+    g_queue_clear_full (&self->pending_removals, g_object_unref);
+
     G_OBJECT_CLASS (nautilus_view_icon_controller_parent_class)->finalize (object);
 }
 
@@ -1002,6 +1182,14 @@ constructed (GObject *object)
     gtk_flow_box_set_hadjustment (GTK_FLOW_BOX (self->view_ui), hadjustment);
     gtk_flow_box_set_vadjustment (GTK_FLOW_BOX (self->view_ui), vadjustment);
     gtk_widget_show (GTK_WIDGET (self->view_ui));
+
+    self->visible_items = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+    g_signal_connect_object (vadjustment, "value-changed",
+                             G_CALLBACK (on_vadjustment_changed), self, 0);
+    g_signal_connect_object (vadjustment, "changed",
+                             G_CALLBACK (on_vadjustment_changed), self, 0);
+    g_signal_connect_after (self->view_ui, "size-allocate",
+                            G_CALLBACK (on_view_ui_size_allocate), self);
     self->view_icon = g_themed_icon_new ("view-grid-symbolic");
 
     /* Compensating for the lack of event boxen to allow clicks outside the flow box. */
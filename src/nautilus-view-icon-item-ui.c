@@ -13,6 +13,11 @@ struct _NautilusViewIconItemUi
     NautilusContainerMaxWidth *item_container;
     GtkWidget *icon;
     GtkLabel *label;
+
+    /* Only items near the viewport load their icon, the others keep an
+     * empty box of the same size in its place.
+     */
+    gboolean icon_visible;
 };
 
 G_DEFINE_TYPE (NautilusViewIconItemUi, nautilus_view_icon_item_ui, GTK_TYPE_FLOW_BOX_CHILD)
@@ -37,6 +42,17 @@ create_icon (NautilusViewIconItemUi *self)
 
     file = nautilus_view_item_model_get_file (self->model);
     icon_size = nautilus_view_item_model_get_icon_size (self->model);
+
+    fixed_height_box = GTK_BOX (gtk_box_new (GTK_ORIENTATION_VERTICAL, 0));
+    gtk_widget_set_valign (GTK_WIDGET (fixed_height_box), GTK_ALIGN_CENTER);
+    gtk_widget_set_halign (GTK_WIDGET (fixed_height_box), GTK_ALIGN_CENTER);
+    gtk_widget_set_size_request (GTK_WIDGET (fixed_height_box), icon_size, icon_size);
+
+    if (!self->icon_visible)
+    {
+        return GTK_WIDGET (fixed_height_box);
+    }
+
     flags = NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS |
             NAUTILUS_FILE_ICON_FLAGS_FORCE_THUMBNAIL_SIZE |
             NAUTILUS_FILE_ICON_FLAGS_USE_EMBLEMS |
@@ -50,11 +66,6 @@ create_icon (NautilusViewIconItemUi *self)
     gtk_widget_set_valign (GTK_WIDGET (icon), GTK_ALIGN_CENTER);
     gtk_widget_set_halign (GTK_WIDGET (icon), GTK_ALIGN_CENTER);
 
-    fixed_height_box = GTK_BOX (gtk_box_new (GTK_ORIENTATION_VERTICAL, 0));
-    gtk_widget_set_valign (GTK_WIDGET (fixed_height_box), GTK_ALIGN_CENTER);
-    gtk_widget_set_halign (GTK_WIDGET (fixed_height_box), GTK_ALIGN_CENTER);
-    gtk_widget_set_size_request (GTK_WIDGET (fixed_height_box), icon_size, icon_size);
-
     if (nautilus_can_thumbnail (file) &&
         nautilus_file_should_show_thumbnail (file))
     {
@@ -285,3 +296,16 @@ nautilus_view_icon_item_ui_get_model (NautilusViewIconItemUi *self)
 {
     return self->model;
 }
+
+void
+nautilus_view_icon_item_ui_set_icon_visible (NautilusViewIconItemUi *self,
+                                             gboolean                icon_visible)
+{
+    if (self->icon_visible == icon_visible)
+    {
+        return;
+    }
+
+    self->icon_visible = icon_visible;
+    update_icon (self);
+}
@@ -14,5 +14,8 @@ G_DECLARE_FINAL_TYPE (NautilusViewIconItemUi, nautilus_view_icon_item_ui, NAUTIL
 NautilusViewIconItemUi * nautilus_view_icon_item_ui_new (NautilusViewItemModel *item_model);
 
 NautilusViewItemModel * nautilus_view_icon_item_ui_get_model (NautilusViewIconItemUi *self);
+/* Loads the icon of the item, or drops it for an empty box of the same size. */
+void nautilus_view_icon_item_ui_set_icon_visible (NautilusViewIconItemUi *self,
+                                                  gboolean                icon_visible);
 
 G_END_DECLS
@@ -105,8 +105,16 @@ nautilus_view_icon_ui_set_selection (NautilusViewIconUi *self,
     NautilusViewItemModel *item_model;
     NautilusViewModel *model;
     GListStore *gmodel;
+    g_autoptr (GHashTable) selected = NULL;
+    GList *l;
     gint i = 0;
 
+    selected = g_hash_table_new (NULL, NULL);
+    for (l = g_queue_peek_head_link (selection); l != NULL; l = l->next)
+    {
+        g_hash_table_add (selected, l->data);
+    }
+
     model = nautilus_view_icon_controller_get_model (self->controller);
     gmodel = nautilus_view_model_get_g_model (model);
     while ((item_model = NAUTILUS_VIEW_ITEM_MODEL (g_list_model_get_item (G_LIST_MODEL (gmodel), i))))
@@ -114,7 +122,7 @@ nautilus_view_icon_ui_set_selection (NautilusViewIconUi *self,
         GtkWidget *item_ui;
 
         item_ui = nautilus_view_item_model_get_item_ui (item_model);
-        if (g_queue_find (selection, item_model) != NULL)
+        if (g_hash_table_contains (selected, item_model))
         {
             gtk_flow_box_select_child (GTK_FLOW_BOX (self),
                                        GTK_FLOW_BOX_CHILD (item_ui));
@@ -125,6 +133,7 @@ nautilus_view_icon_ui_set_selection (NautilusViewIconUi *self,
                                          GTK_FLOW_BOX_CHILD (item_ui));
         }
 
+        g_object_unref (item_model);
         i++;
     }
 }
@@ -1,6 +1,12 @@
 #include "nautilus-view-model.h"
 #include "nautilus-view-item-model.h"
 #include "nautilus-global-preferences.h"
+#include "nautilus-parallel-sort.h"
+
+/* Past this many separate places to insert new items at, replace the
+ * whole content with the merged one in a single items-changed instead.
+ */
+#define MAX_INSERTION_RUNS 64
 
 struct _NautilusViewModel
 {
@@ -133,6 +139,33 @@ compare_data_func (gconstpointer a,
                                            self->sort_data->reversed);
 }
 
+/* Cheaper than g_list_store_sort() for big models, and still a single
+ * items-changed.
+ */
+static void
+sort_model (NautilusViewModel *self)
+{
+    GListModel *model = G_LIST_MODEL (self->internal_model);
+    g_autofree gpointer *items = NULL;
+    guint n_items;
+    guint i;
+
+    n_items = g_list_model_get_n_items (model);
+    items = g_new (gpointer, n_items);
+    for (i = 0; i < n_items; i++)
+    {
+        items[i] = g_list_model_get_item (model, i);
+    }
+
+    nautilus_parallel_sort (items, n_items, compare_data_func, self);
+    g_list_store_splice (self->internal_model, 0, n_items, items, n_items);
+
+    for (i = 0; i < n_items; i++)
+    {
+        g_object_unref (items[i]);
+    }
+}
+
 NautilusViewModel *
 nautilus_view_model_new ()
 {
@@ -153,7 +186,7 @@ nautilus_view_model_set_sort_type (NautilusViewModel         *self,
     self->sort_data->reversed = sort_data->reversed;
     self->sort_data->directories_first = sort_data->directories_first;
 
-    g_list_store_sort (self->internal_model, compare_data_func, self);
+    sort_model (self);
 }
 
 NautilusViewModelSortData *
@@ -176,29 +209,16 @@ nautilus_view_model_get_items_from_files (NautilusViewModel *self,
     NautilusViewItemModel *item_model;
     GQueue *item_models;
 
+    /* NautilusFile objects are unique per location, so the map gives the
+     * same answer as comparing URIs, without walking the whole model.
+     */
     item_models = g_queue_new ();
     for (l = g_queue_peek_head_link (files); l != NULL; l = l->next)
     {
-        NautilusFile *file1;
-        gint i = 0;
-
-        file1 = NAUTILUS_FILE (l->data);
-        while ((item_model = g_list_model_get_item (G_LIST_MODEL (self->internal_model), i)))
+        item_model = g_hash_table_lookup (self->map_files_to_model, l->data);
+        if (item_model != NULL)
         {
-            NautilusFile *file2;
-            g_autofree gchar *file1_uri = NULL;
-            g_autofree gchar *file2_uri = NULL;
-
-            file2 = nautilus_view_item_model_get_file (item_model);
-            file1_uri = nautilus_file_get_uri (file1);
-            file2_uri = nautilus_file_get_uri (file2);
-            if (g_strcmp0 (file1_uri, file2_uri) == 0)
-            {
-                g_queue_push_tail (item_models, item_model);
-                break;
-            }
-
-            i++;
+            g_queue_push_tail (item_models, item_model);
         }
     }
 
@@ -212,32 +232,134 @@ nautilus_view_model_get_item_from_file (NautilusViewModel *self,
     return g_hash_table_lookup (self->map_files_to_model, file);
 }
 
+/* The model is kept sorted, so the position of an item can be found by
+ * bisection. That fails if the file changed in a way that moved it in the
+ * sort order since it was inserted, in which case we fall back to walking
+ * the model.
+ */
+static gboolean
+find_item_position (NautilusViewModel     *self,
+                    NautilusViewItemModel *item,
+                    guint                 *position)
+{
+    GListModel *model = G_LIST_MODEL (self->internal_model);
+    guint low, high, middle;
+    guint n_items;
+    guint i;
+    gint result;
+
+    n_items = g_list_model_get_n_items (model);
+
+    if (self->sort_data != NULL)
+    {
+        low = 0;
+        high = n_items;
+        while (low < high)
+        {
+            g_autoptr (NautilusViewItemModel) item_model = NULL;
+
+            middle = low + (high - low) / 2;
+            item_model = g_list_model_get_item (model, middle);
+            if (item_model == item)
+            {
+                *position = middle;
+                return TRUE;
+            }
+
+            result = compare_data_func (item_model, item, self);
+            if (result < 0)
+            {
+                low = middle + 1;
+            }
+            else if (result > 0)
+            {
+                high = middle;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < n_items; i++)
+    {
+        g_autoptr (NautilusViewItemModel) item_model = NULL;
+
+        item_model = g_list_model_get_item (model, i);
+        if (item_model == item)
+        {
+            *position = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 void
 nautilus_view_model_remove_item (NautilusViewModel     *self,
                                  NautilusViewItemModel *item)
 {
-    NautilusViewItemModel *item_model;
-    gint i;
+    guint position;
 
-    i = 0;
-    item_model = NULL;
-    while ((item_model = g_list_model_get_item (G_LIST_MODEL (self->internal_model), i)))
+    if (find_item_position (self, item, &position))
     {
-        if (item_model == item)
+        g_hash_table_remove (self->map_files_to_model,
+                             nautilus_view_item_model_get_file (item));
+        g_list_store_remove (self->internal_model, position);
+    }
+}
+
+void
+nautilus_view_model_remove_items (NautilusViewModel *self,
+                                  GQueue            *items)
+{
+    GListModel *model = G_LIST_MODEL (self->internal_model);
+    g_autoptr (GHashTable) removed = NULL;
+    g_autoptr (GArray) positions = NULL;
+    GList *l;
+    guint n_items;
+    guint i, start, end;
+
+    removed = g_hash_table_new (NULL, NULL);
+    for (l = g_queue_peek_head_link (items); l != NULL; l = l->next)
+    {
+        g_hash_table_add (removed, l->data);
+    }
+
+    /* A single pass to find them all, whatever their number. */
+    positions = g_array_new (FALSE, FALSE, sizeof (guint));
+    n_items = g_list_model_get_n_items (model);
+    for (i = 0; i < n_items; i++)
+    {
+        g_autoptr (NautilusViewItemModel) item_model = NULL;
+
+        item_model = g_list_model_get_item (model, i);
+        if (g_hash_table_contains (removed, item_model))
         {
-            break;
+            g_array_append_val (positions, i);
+            g_hash_table_remove (self->map_files_to_model,
+                                 nautilus_view_item_model_get_file (item_model));
         }
-
-        i++;
     }
 
-    if (item_model != NULL)
+    /* Remove contiguous ranges with one splice each, starting from the end
+     * so that the positions still to be removed stay valid.
+     */
+    i = positions->len;
+    while (i > 0)
     {
-        NautilusFile *file;
+        end = g_array_index (positions, guint, i - 1) + 1;
+        start = end - 1;
+        i--;
+        while (i > 0 && g_array_index (positions, guint, i - 1) == start - 1)
+        {
+            start--;
+            i--;
+        }
 
-        file = nautilus_view_item_model_get_file (item_model);
-        g_list_store_remove (self->internal_model, i);
-        g_hash_table_remove (self->map_files_to_model, file);
+        g_list_store_splice (self->internal_model, start, end - start, NULL, 0);
     }
 }
 
@@ -258,17 +380,99 @@ nautilus_view_model_add_item (NautilusViewModel     *self,
     g_list_store_insert_sorted (self->internal_model, item, compare_data_func, self);
 }
 
+/* Returns the position after the last item in [low, high) not sorting
+ * after @item, so that items that compare equal keep their order.
+ */
+static guint
+find_insertion_position (NautilusViewModel     *self,
+                         NautilusViewItemModel *item,
+                         guint                  low,
+                         guint                  high)
+{
+    GListModel *model = G_LIST_MODEL (self->internal_model);
+    guint middle;
+
+    while (low < high)
+    {
+        g_autoptr (NautilusViewItemModel) item_model = NULL;
+
+        middle = low + (high - low) / 2;
+        item_model = g_list_model_get_item (model, middle);
+        if (compare_data_func (item_model, item, self) <= 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static void
+merge_items (NautilusViewModel *self,
+             gpointer          *items,
+             guint              n_new_items)
+{
+    GListModel *model = G_LIST_MODEL (self->internal_model);
+    g_autofree gpointer *merged = NULL;
+    gpointer current;
+    guint n_items;
+    guint i, j, k;
+
+    n_items = g_list_model_get_n_items (model);
+    merged = g_new (gpointer, n_items + n_new_items);
+
+    i = 0;
+    j = 0;
+    k = 0;
+    current = n_items > 0 ? g_list_model_get_item (model, 0) : NULL;
+    while (current != NULL || j < n_new_items)
+    {
+        if (current == NULL ||
+            (j < n_new_items && compare_data_func (items[j], current, self) < 0))
+        {
+            merged[k++] = g_object_ref (items[j++]);
+        }
+        else
+        {
+            merged[k++] = current;
+            i++;
+            current = i < n_items ? g_list_model_get_item (model, i) : NULL;
+        }
+    }
+
+    g_list_store_splice (self->internal_model, 0, n_items, merged, k);
+
+    for (k = 0; k < n_items + n_new_items; k++)
+    {
+        g_object_unref (merged[k]);
+    }
+}
+
 void
 nautilus_view_model_add_items (NautilusViewModel *self,
                                GQueue            *items)
 {
     g_autofree gpointer *array = NULL;
+    g_autofree guint *positions = NULL;
     GList *l;
-    int i = 0;
+    guint n_new_items;
+    guint n_items;
+    guint n_runs;
+    guint i, start;
 
-    array = g_malloc_n (g_queue_get_length (items),
-                        sizeof (NautilusViewItemModel *));
+    n_new_items = g_queue_get_length (items);
+    if (n_new_items == 0)
+    {
+        return;
+    }
 
+    array = g_malloc_n (n_new_items, sizeof (NautilusViewItemModel *));
+
+    i = 0;
     for (l = g_queue_peek_head_link (items); l != NULL; l = l->next)
     {
         array[i] = l->data;
@@ -278,9 +482,56 @@ nautilus_view_model_add_items (NautilusViewModel *self,
         i++;
     }
 
-    g_list_store_splice (self->internal_model,
-                         g_list_model_get_n_items (G_LIST_MODEL (self->internal_model)),
-                         0, array, g_queue_get_length (items));
+    n_items = g_list_model_get_n_items (G_LIST_MODEL (self->internal_model));
+    if (self->sort_data == NULL)
+    {
+        g_list_store_splice (self->internal_model, n_items, 0, array, n_new_items);
+        return;
+    }
 
-    g_list_store_sort (self->internal_model, compare_data_func, self);
+    /* Sort the new items only, then merge them into the existing order. */
+    nautilus_parallel_sort (array, n_new_items, compare_data_func, self);
+
+    if (n_items == 0)
+    {
+        g_list_store_splice (self->internal_model, 0, 0, array, n_new_items);
+        return;
+    }
+
+    /* The new items being sorted, each one goes at or after the previous. */
+    positions = g_new (guint, n_new_items);
+    n_runs = 0;
+    for (i = 0; i < n_new_items; i++)
+    {
+        positions[i] = find_insertion_position (self, array[i],
+                                                i > 0 ? positions[i - 1] : 0,
+                                                n_items);
+        if (i == 0 || positions[i] != positions[i - 1])
+        {
+            n_runs++;
+        }
+    }
+
+    if (n_runs > MAX_INSERTION_RUNS)
+    {
+        merge_items (self, array, n_new_items);
+        return;
+    }
+
+    /* One splice for each run of new items going to the same place,
+     * starting from the end so that the positions stay valid.
+     */
+    i = n_new_items;
+    while (i > 0)
+    {
+        start = i - 1;
+        while (start > 0 && positions[start - 1] == positions[i - 1])
+        {
+            start--;
+        }
+
+        g_list_store_splice (self->internal_model, positions[start], 0,
+                             &array[start], i - start);
+        i = start;
+    }
 }
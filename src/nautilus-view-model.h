@@ -25,11 +25,14 @@ NautilusViewModelSortData * nautilus_view_model_get_sort_type (NautilusViewModel
 GListStore * nautilus_view_model_get_g_model (NautilusViewModel *self);
 NautilusViewItemModel * nautilus_view_model_get_item_from_file (NautilusViewModel *self,
                                                                 NautilusFile      *file);
+/* The item models are owned by the model. */
 GQueue * nautilus_view_model_get_items_from_files (NautilusViewModel *self,
                                                    GQueue            *files);
-/* Don't use inside a loop, use nautilus_view_model_remove_all_items instead. */
+/* Don't use inside a loop, use nautilus_view_model_remove_items instead. */
 void nautilus_view_model_remove_item (NautilusViewModel     *self,
                                       NautilusViewItemModel *item);
+void nautilus_view_model_remove_items (NautilusViewModel *self,
+                                       GQueue            *items);
 void nautilus_view_model_remove_all_items (NautilusViewModel *self);
 /* Don't use inside a loop, use nautilus_view_model_add_items instead. */
 void nautilus_view_model_add_item (NautilusViewModel     *self,
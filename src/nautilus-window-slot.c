@@ -48,6 +48,12 @@
 #include "nautilus-ui-utilities.h"
 #include <eel/eel-vfs-extensions.h>
 
+/* Views of big directories are kept alive when going to another location,
+ * so that going back to them needs no loading, sorting or layout. */
+#define VIEW_CACHE_MAX_VIEWS 3
+#define VIEW_CACHE_MIN_ITEMS 1000
+#define VIEW_CACHE_MAX_ITEMS 100000
+
 enum
 {
     PROP_ACTIVE = 1,
@@ -87,6 +93,12 @@ typedef struct
     /* Viewed file */
     NautilusView *content_view;
     NautilusView *new_content_view;
+    /* Views left for other locations, most recent first */
+    GQueue cached_views;
+    /* Whether content_view goes to cached_views when replaced */
+    gboolean cache_content_view;
+    /* Whether new_content_view comes from cached_views, already loaded */
+    gboolean new_content_view_is_cached;
     NautilusFile *viewed_file;
     gboolean viewed_file_seen;
     gboolean viewed_file_in_trash;
@@ -176,6 +188,8 @@ static void real_set_templates_menu (NautilusWindowSlot *self,
                                      GMenuModel         *menu);
 static GMenuModel *real_get_templates_menu (NautilusWindowSlot *self);
 static void nautilus_window_slot_setup_extra_location_widgets (NautilusWindowSlot *self);
+static void view_ended_loading (NautilusWindowSlot *self,
+                                NautilusView       *view);
 
 void
 free_navigation_state (gpointer data)
@@ -743,6 +757,166 @@ nautilus_window_slot_add_extra_location_widget (NautilusWindowSlot *self,
     gtk_widget_show (priv->extra_location_widgets);
 }
 
+static guint
+get_view_item_count (NautilusView *view)
+{
+    NautilusFile *directory_as_file;
+    guint count;
+
+    if (!NAUTILUS_IS_FILES_VIEW (view) ||
+        nautilus_view_is_loading (view) ||
+        nautilus_view_is_searching (view))
+    {
+        return 0;
+    }
+
+    directory_as_file = nautilus_files_view_get_directory_as_file (NAUTILUS_FILES_VIEW (view));
+    if (directory_as_file == NULL ||
+        !nautilus_file_get_directory_item_count (directory_as_file, &count, NULL))
+    {
+        return 0;
+    }
+
+    return count;
+}
+
+static void
+destroy_view (NautilusView *view)
+{
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
+static void
+clear_cached_views (NautilusWindowSlot *self)
+{
+    NautilusWindowSlotPrivate *priv;
+    NautilusView *view;
+
+    priv = nautilus_window_slot_get_instance_private (self);
+
+    while ((view = g_queue_pop_head (&priv->cached_views)) != NULL)
+    {
+        destroy_view (view);
+    }
+}
+
+/* Takes a ref of @view, which must have no parent. */
+static void
+cache_view (NautilusWindowSlot *self,
+            NautilusView       *view)
+{
+    NautilusWindowSlotPrivate *priv;
+    guint total_items;
+
+    priv = nautilus_window_slot_get_instance_private (self);
+
+    g_queue_push_head (&priv->cached_views, view);
+
+    total_items = 0;
+    for (GList *l = priv->cached_views.head; l != NULL; l = l->next)
+    {
+        total_items += get_view_item_count (l->data);
+    }
+
+    /* The most recent view stays, whatever its size */
+    while (priv->cached_views.length > 1 &&
+           (priv->cached_views.length > VIEW_CACHE_MAX_VIEWS ||
+            total_items > VIEW_CACHE_MAX_ITEMS))
+    {
+        NautilusView *oldest;
+
+        oldest = g_queue_pop_tail (&priv->cached_views);
+        total_items -= get_view_item_count (oldest);
+        destroy_view (oldest);
+    }
+}
+
+/* Returns a ref to the cached view of @location, if any and still in the
+ * @view_id mode. */
+static NautilusView *
+take_cached_view (NautilusWindowSlot *self,
+                  GFile              *location,
+                  guint               view_id)
+{
+    NautilusWindowSlotPrivate *priv;
+
+    priv = nautilus_window_slot_get_instance_private (self);
+
+    for (GList *l = priv->cached_views.head; l != NULL; l = l->next)
+    {
+        NautilusView *view = l->data;
+        GFile *view_location;
+
+        view_location = nautilus_view_get_location (view);
+        if (view_location == NULL || !g_file_equal (view_location, location))
+        {
+            continue;
+        }
+
+        g_queue_delete_link (&priv->cached_views, l);
+
+        if (nautilus_files_view_get_view_id (view) != view_id ||
+            nautilus_view_is_loading (view))
+        {
+            destroy_view (view);
+            return NULL;
+        }
+
+        return view;
+    }
+
+    return NULL;
+}
+
+/* When going to another location would reuse the current view, a big
+ * directory gets a fresh view instead and keeps the current one; and a
+ * location with a view in the cache gets that view back.
+ */
+static NautilusView *
+use_cached_view (NautilusWindowSlot *self,
+                 GFile              *location,
+                 NautilusView       *view)
+{
+    NautilusWindowSlotPrivate *priv;
+    NautilusView *cached_view;
+    GFile *current_location;
+    guint view_id;
+
+    priv = nautilus_window_slot_get_instance_private (self);
+
+    if (view != priv->content_view ||
+        !NAUTILUS_IS_FILES_VIEW (view) ||
+        priv->location_change_type == NAUTILUS_LOCATION_CHANGE_RELOAD)
+    {
+        return view;
+    }
+
+    current_location = nautilus_view_get_location (view);
+    if (current_location == NULL || g_file_equal (current_location, location))
+    {
+        return view;
+    }
+
+    view_id = nautilus_files_view_get_view_id (view);
+    cached_view = take_cached_view (self, location, view_id);
+
+    priv->cache_content_view = get_view_item_count (view) >= VIEW_CACHE_MIN_ITEMS;
+
+    if (cached_view != NULL)
+    {
+        priv->new_content_view_is_cached = TRUE;
+        return cached_view;
+    }
+
+    if (priv->cache_content_view)
+    {
+        return NAUTILUS_VIEW (nautilus_files_view_new (view_id, self));
+    }
+
+    return view;
+}
+
 static void
 nautilus_window_slot_set_searching (NautilusWindowSlot *self,
                                     gboolean            searching)
@@ -1470,6 +1644,22 @@ begin_location_change (NautilusWindowSlot         *self,
     nautilus_profile_end (NULL);
 }
 
+static void
+update_focused_directory (NautilusWindowSlot *self)
+{
+    NautilusWindowSlotPrivate *priv;
+    g_autoptr (NautilusDirectory) directory = NULL;
+
+    priv = nautilus_window_slot_get_instance_private (self);
+    if (!priv->active || priv->location == NULL)
+    {
+        return;
+    }
+
+    directory = nautilus_directory_get (priv->location);
+    nautilus_directory_set_focused (directory);
+}
+
 static void
 nautilus_window_slot_set_location (NautilusWindowSlot *self,
                                    GFile              *location)
@@ -1494,6 +1684,7 @@ nautilus_window_slot_set_location (NautilusWindowSlot *self,
     if (nautilus_window_slot_get_active (self))
     {
         nautilus_window_sync_location_widgets (priv->window);
+        update_focused_directory (self);
     }
 
     nautilus_window_slot_update_title (self);
@@ -1949,6 +2140,7 @@ got_file_info_for_view_selection_callback (NautilusFile *file,
     if (!error || g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
     {
         view = nautilus_window_slot_get_view_for_location (self, location);
+        view = use_cached_view (self, location, view);
         setup_view (self, view);
     }
     else
@@ -2077,6 +2269,7 @@ setup_view (NautilusWindowSlot *self,
     gboolean ret = TRUE;
     GFile *old_location;
     NautilusWindowSlotPrivate *priv;
+    gboolean restoring_view;
 
     nautilus_profile_start (NULL);
 
@@ -2122,9 +2315,17 @@ setup_view (NautilusWindowSlot *self,
         goto out;
     }
 
+    restoring_view = priv->new_content_view_is_cached;
+
     change_view (self);
     gtk_widget_show (GTK_WIDGET (priv->window));
 
+    /* A view from the cache has nothing to load, so it is done already */
+    if (restoring_view && priv->content_view == view)
+    {
+        view_ended_loading (self, view);
+    }
+
 out:
     nautilus_profile_end (NULL);
 
@@ -2161,7 +2362,10 @@ load_new_location (NautilusWindowSlot *self,
          priv->new_content_view != priv->content_view))
     {
         view = priv->new_content_view;
-        nautilus_view_set_location (priv->new_content_view, location);
+        if (!priv->new_content_view_is_cached)
+        {
+            nautilus_view_set_location (priv->new_content_view, location);
+        }
     }
     if (view)
     {
@@ -2251,6 +2455,8 @@ nautilus_window_slot_set_content_view (NautilusWindowSlot *self,
                                        guint               id)
 {
     NautilusFilesView *view;
+    NautilusView *cached_view;
+    GFile *location;
     g_autolist (NautilusFile) selection = NULL;
     char *uri;
     NautilusWindowSlotPrivate *priv;
@@ -2263,7 +2469,21 @@ nautilus_window_slot_set_content_view (NautilusWindowSlot *self,
     g_free (uri);
 
     selection = nautilus_view_get_selection (priv->content_view);
-    view = nautilus_files_view_new (id, self);
+
+    /* Going back and forth between modes on a big directory swaps the
+     * loaded views instead of loading it again each time */
+    location = nautilus_window_slot_get_location (self);
+    cached_view = location != NULL ? take_cached_view (self, location, id) : NULL;
+    priv->cache_content_view = get_view_item_count (priv->content_view) >= VIEW_CACHE_MIN_ITEMS;
+    if (cached_view != NULL)
+    {
+        view = NAUTILUS_FILES_VIEW (cached_view);
+        priv->new_content_view_is_cached = TRUE;
+    }
+    else
+    {
+        view = nautilus_files_view_new (id, self);
+    }
 
     nautilus_window_slot_stop_loading (self);
 
@@ -2696,7 +2916,6 @@ found_mount_cb (GObject      *source_object,
         data->mount = mount;
         nautilus_get_x_content_types_for_mount_async (mount,
                                                       found_content_type_cb,
-                                                      data->cancellable,
                                                       data);
         return;
     }
@@ -3030,8 +3249,16 @@ nautilus_window_slot_switch_new_content_view (NautilusWindowSlot *self)
         g_binding_unbind (priv->extensions_background_menu_binding);
         g_binding_unbind (priv->templates_menu_binding);
         widget = GTK_WIDGET (priv->content_view);
-        gtk_widget_destroy (widget);
-        g_clear_object (&priv->content_view);
+        if (priv->cache_content_view)
+        {
+            gtk_container_remove (GTK_CONTAINER (self), widget);
+            cache_view (self, g_steal_pointer (&priv->content_view));
+        }
+        else
+        {
+            gtk_widget_destroy (widget);
+            g_clear_object (&priv->content_view);
+        }
     }
 
     if (priv->new_content_view != NULL)
@@ -3066,6 +3293,8 @@ done:
     /* Clean up, so we don't confuse having a new_content_view available or
      * just that we didn't care about it here */
     priv->new_content_view = NULL;
+    priv->cache_content_view = FALSE;
+    priv->new_content_view_is_cached = FALSE;
 }
 
 /* This is called when we have decided we can actually change to the new view/location situation. */
@@ -3133,6 +3362,8 @@ nautilus_window_slot_dispose (GObject *object)
         g_clear_object (&priv->new_content_view);
     }
 
+    clear_cached_views (self);
+
     nautilus_window_slot_set_viewed_file (self, NULL);
 
     g_clear_object (&priv->location);
@@ -3683,6 +3914,7 @@ nautilus_window_slot_set_active (NautilusWindowSlot *self,
             nautilus_window_sync_title (window, self);
             nautilus_window_sync_location_widgets (window);
             nautilus_window_slot_sync_actions (self);
+            update_focused_directory (self);
 
             gtk_widget_insert_action_group (GTK_WIDGET (window), "slot", priv->slot_action_group);
         }
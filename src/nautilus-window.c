@@ -1600,15 +1600,15 @@ on_in_app_notification_undo_timeout (NautilusWindow *window)
 static gchar *
 in_app_notification_undo_deleted_get_label (NautilusFileUndoInfo *undo_info)
 {
-    GList *files;
+    g_autolist (GFile) files = NULL;
     gchar *file_label;
     gchar *label;
     gint length;
 
-    files = nautilus_file_undo_info_trash_get_files (NAUTILUS_FILE_UNDO_INFO_TRASH (undo_info));
-    length = g_list_length (files);
+    length = nautilus_file_undo_info_trash_get_n_files (NAUTILUS_FILE_UNDO_INFO_TRASH (undo_info));
     if (length == 1)
     {
+        files = nautilus_file_undo_info_trash_get_files (NAUTILUS_FILE_UNDO_INFO_TRASH (undo_info));
         file_label = g_file_get_basename (files->data);
         /* Translators: only one item has been deleted and %s is its name. */
         label = g_markup_printf_escaped (_("“%s” deleted"), file_label);
@@ -1669,14 +1669,14 @@ nautilus_window_on_undo_changed (NautilusFileUndoManager *manager,
 
         if (nautilus_file_undo_info_get_op_type (undo_info) == NAUTILUS_FILE_UNDO_OP_MOVE_TO_TRASH)
         {
-            g_autoptr (GList) files = NULL;
+            guint n_files;
 
-            files = nautilus_file_undo_info_trash_get_files (NAUTILUS_FILE_UNDO_INFO_TRASH (undo_info));
+            n_files = nautilus_file_undo_info_trash_get_n_files (NAUTILUS_FILE_UNDO_INFO_TRASH (undo_info));
 
             /* Don't pop up a notification if user canceled the operation or the focus
              * is not in the this window. This is an easy way to know from which window
              * was the delete operation made */
-            if (files != NULL && gtk_window_has_toplevel_focus (GTK_WINDOW (window)))
+            if (n_files > 0 && gtk_window_has_toplevel_focus (GTK_WINDOW (window)))
             {
                 popup_notification = TRUE;
                 label = in_app_notification_undo_deleted_get_label (undo_info);
@@ -2275,7 +2275,8 @@ nautilus_window_destroy (GtkWidget *object)
     GList *slots_copy;
 
     window = NAUTILUS_WINDOW (object);
-    application = NAUTILUS_APPLICATION (gtk_window_get_application (GTK_WINDOW (window)));
+    /* Not the window's own, a spare window has none */
+    application = NAUTILUS_APPLICATION (g_application_get_default ());
 
     DEBUG ("Destroying window");
 
@@ -1310,6 +1310,8 @@ main (int   argc,
     g_test_init (&argc, &argv, NULL);
     g_test_set_nonfatal_assertions ();
     nautilus_ensure_extension_points ();
+    /* The file operations go by some of the preferences. */
+    nautilus_global_preferences_init ();
 
     setup_test_suite ();
 
@@ -0,0 +1,208 @@
+#include "test-utilities.h"
+
+#include <string.h>
+
+#define MB (1024 * 1024)
+#define SOURCE_SIZE (3 * MB + 17)
+/* Over the large file threshold, so that the copy is resumed */
+#define JOURNALED_OFFSET (1 * MB)
+
+static char *cache_dir;
+
+static char *
+make_contents (gsize size,
+               guint seed)
+{
+    g_autoptr (GRand) rand = NULL;
+    char *data;
+
+    rand = g_rand_new_with_seed (seed);
+    data = g_malloc (size);
+    for (gsize i = 0; i < size; i++)
+    {
+        data[i] = g_rand_int_range (rand, 0, 256);
+    }
+
+    return data;
+}
+
+/* Where the job copying @src to @destination looks for its journal */
+static char *
+get_journal_path (GFile *src,
+                  GFile *destination)
+{
+    g_autoptr (GChecksum) checksum = NULL;
+    g_autofree char *destination_uri = NULL;
+    g_autofree char *src_uri = NULL;
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    destination_uri = g_file_get_uri (destination);
+    src_uri = g_file_get_uri (src);
+    g_checksum_update (checksum, (const guchar *) destination_uri, -1);
+    g_checksum_update (checksum, (const guchar *) "\n", 1);
+    g_checksum_update (checksum, (const guchar *) src_uri, -1);
+
+    return g_build_filename (cache_dir, "nautilus", "copy-journals",
+                             g_checksum_get_string (checksum), NULL);
+}
+
+/* As left by a job interrupted after it recorded @offset of @src */
+static void
+write_journal (GFile   *src,
+               GFile   *destination,
+               goffset  offset,
+               goffset  src_size)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *dir = NULL;
+    g_autofree char *src_uri = NULL;
+    g_autofree char *contents = NULL;
+
+    path = get_journal_path (src, destination);
+    dir = g_path_get_dirname (path);
+    g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+    src_uri = g_file_get_uri (src);
+    contents = g_strdup_printf ("S %" G_GINT64_FORMAT "\n"
+                                "P %" G_GOFFSET_FORMAT " %" G_GOFFSET_FORMAT " %s\n",
+                                g_get_real_time () / G_USEC_PER_SEC,
+                                offset, src_size, src_uri);
+    g_assert_true (g_file_set_contents (path, contents, -1, NULL));
+}
+
+/* The copy goes on from where the journal says it got, past which what
+ * was left is written again. */
+static void
+test_resume_partial_copy (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) first_dir = NULL;
+    g_autoptr (GFile) second_dir = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFile) result_file = NULL;
+    g_autolist (GFile) files = NULL;
+    g_autofree char *src_contents = NULL;
+    g_autofree char *partial_contents = NULL;
+    g_autofree char *journal_path = NULL;
+    g_autofree char *contents = NULL;
+    gsize length;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    first_dir = g_file_get_child (root, "journal_first_dir");
+    g_file_make_directory (first_dir, NULL, NULL);
+    second_dir = g_file_get_child (root, "journal_second_dir");
+    g_file_make_directory (second_dir, NULL, NULL);
+
+    file = g_file_get_child (first_dir, "journal_first_dir_child");
+    src_contents = make_contents (SOURCE_SIZE, 1);
+    g_assert_true (g_file_replace_contents (file, src_contents, SOURCE_SIZE, NULL, FALSE,
+                                            G_FILE_CREATE_NONE, NULL, NULL, NULL));
+    files = g_list_prepend (files, g_object_ref (file));
+
+    /* Written further than recorded, and with other contents, to tell what
+     * is taken from where. */
+    result_file = g_file_get_child (second_dir, "journal_first_dir_child");
+    partial_contents = make_contents (2 * MB, 2);
+    g_assert_true (g_file_replace_contents (result_file, partial_contents, 2 * MB, NULL, FALSE,
+                                            G_FILE_CREATE_NONE, NULL, NULL, NULL));
+    write_journal (file, second_dir, JOURNALED_OFFSET, SOURCE_SIZE);
+
+    nautilus_file_operations_copy_sync (files, second_dir);
+
+    g_assert_true (g_file_load_contents (result_file, NULL, &contents, &length, NULL, NULL));
+    g_assert_cmpuint (length, ==, SOURCE_SIZE);
+    /* Only the journaled range is kept, */
+    g_assert_true (memcmp (contents, partial_contents, JOURNALED_OFFSET) == 0);
+    /* the rest being copied again. */
+    g_assert_true (memcmp (contents + JOURNALED_OFFSET, src_contents + JOURNALED_OFFSET,
+                           SOURCE_SIZE - JOURNALED_OFFSET) == 0);
+
+    /* Done with, the journal is gone. */
+    journal_path = get_journal_path (file, second_dir);
+    g_assert_false (g_file_test (journal_path, G_FILE_TEST_EXISTS));
+
+    empty_directory_by_prefix (root, "journal");
+}
+
+/* A journal recorded for a source which has changed size since is not
+ * gone on from: the copy is done whole. */
+static void
+test_partial_copy_of_changed_source (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) first_dir = NULL;
+    g_autoptr (GFile) second_dir = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFile) result_file = NULL;
+    g_autolist (GFile) files = NULL;
+    g_autofree char *src_contents = NULL;
+    g_autofree char *contents = NULL;
+    gsize length;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    first_dir = g_file_get_child (root, "journal_first_dir");
+    g_file_make_directory (first_dir, NULL, NULL);
+    second_dir = g_file_get_child (root, "journal_second_dir");
+    g_file_make_directory (second_dir, NULL, NULL);
+
+    file = g_file_get_child (first_dir, "journal_first_dir_child");
+    src_contents = make_contents (SOURCE_SIZE, 3);
+    g_assert_true (g_file_replace_contents (file, src_contents, SOURCE_SIZE, NULL, FALSE,
+                                            G_FILE_CREATE_NONE, NULL, NULL, NULL));
+    files = g_list_prepend (files, g_object_ref (file));
+
+    /* Nothing left at the destination, as after a clean up */
+    result_file = g_file_get_child (second_dir, "journal_first_dir_child");
+    write_journal (file, second_dir, JOURNALED_OFFSET, SOURCE_SIZE + 1);
+
+    nautilus_file_operations_copy_sync (files, second_dir);
+
+    g_assert_true (g_file_load_contents (result_file, NULL, &contents, &length, NULL, NULL));
+    g_assert_cmpuint (length, ==, SOURCE_SIZE);
+    g_assert_true (memcmp (contents, src_contents, SOURCE_SIZE) == 0);
+
+    empty_directory_by_prefix (root, "journal");
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/test-copy-journal-resume-partial/1.0",
+                     test_resume_partial_copy);
+    g_test_add_func ("/test-copy-journal-resume-partial/1.1",
+                     test_partial_copy_of_changed_source);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_autoptr (NautilusFileUndoManager) undo_manager = NULL;
+    int ret;
+
+    /* Not to touch the settings of whoever runs the tests, and to keep
+     * the journals away from the real cache. */
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+    cache_dir = g_dir_make_tmp ("nautilus-copy-journal-cache-XXXXXX", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    undo_manager = nautilus_file_undo_manager_new ();
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    g_settings_set_boolean (nautilus_preferences,
+                            NAUTILUS_PREFERENCES_RESUMABLE_COPIES, TRUE);
+    g_settings_set_uint64 (nautilus_preferences,
+                           NAUTILUS_PREFERENCES_LARGE_FILE_COPY_THRESHOLD, 1);
+
+    setup_test_suite ();
+
+    ret = g_test_run ();
+
+    test_clear_tmp_dir ();
+    g_free (cache_dir);
+
+    return ret;
+}
@@ -0,0 +1,152 @@
+#include "test-utilities.h"
+
+#include <string.h>
+
+static char *cache_dir;
+
+static void
+create_file_of_size (GFile *file,
+                     gsize  size)
+{
+    g_autoptr (GRand) rand = NULL;
+    g_autofree guint32 *data = NULL;
+    gsize n_words;
+
+    rand = g_rand_new_with_seed (size);
+    n_words = (size + sizeof (guint32) - 1) / sizeof (guint32);
+    data = g_new (guint32, n_words);
+    for (gsize i = 0; i < n_words; i++)
+    {
+        data[i] = g_rand_int (rand);
+    }
+
+    g_assert_true (g_file_replace_contents (file, (const char *) data, size, NULL, FALSE,
+                                            G_FILE_CREATE_NONE, NULL, NULL, NULL));
+}
+
+static void
+assert_same_contents (GFile *file,
+                      GFile *other)
+{
+    g_autofree char *contents = NULL;
+    g_autofree char *other_contents = NULL;
+    gsize length;
+    gsize other_length;
+
+    g_assert_true (g_file_load_contents (file, NULL, &contents, &length, NULL, NULL));
+    g_assert_true (g_file_load_contents (other, NULL, &other_contents, &other_length, NULL, NULL));
+    g_assert_cmpuint (length, ==, other_length);
+    g_assert_true (memcmp (contents, other_contents, length) == 0);
+}
+
+/* The journal of a copy is removed once it is done. */
+static void
+assert_no_journal_left (void)
+{
+    g_autofree char *journals_path = NULL;
+    g_autoptr (GDir) dir = NULL;
+
+    journals_path = g_build_filename (cache_dir, "nautilus", "copy-journals", NULL);
+    dir = g_dir_open (journals_path, 0, NULL);
+    g_assert_null (dir != NULL ? g_dir_read_name (dir) : NULL);
+}
+
+static void
+copy_and_check (gsize size)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) first_dir = NULL;
+    g_autoptr (GFile) second_dir = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFile) result_file = NULL;
+    g_autolist (GFile) files = NULL;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    first_dir = g_file_get_child (root, "verify_first_dir");
+    g_file_make_directory (first_dir, NULL, NULL);
+    second_dir = g_file_get_child (root, "verify_second_dir");
+    g_file_make_directory (second_dir, NULL, NULL);
+
+    file = g_file_get_child (first_dir, "verify_first_dir_child");
+    create_file_of_size (file, size);
+    files = g_list_prepend (files, g_object_ref (file));
+
+    nautilus_file_operations_copy_sync (files, second_dir);
+
+    result_file = g_file_get_child (second_dir, "verify_first_dir_child");
+    g_assert_true (g_file_query_exists (result_file, NULL));
+    assert_same_contents (file, result_file);
+    assert_no_journal_left ();
+
+    empty_directory_by_prefix (root, "verify");
+}
+
+/* Under the large file threshold, the copy is streamed, hashing the
+ * original as it goes by. */
+static void
+test_verify_stream_copy (void)
+{
+    copy_and_check (300 * 1024 + 17);
+}
+
+static void
+test_verify_empty_stream_copy (void)
+{
+    copy_and_check (0);
+}
+
+/* Over it, the reader thread hashes what it reads. */
+static void
+test_verify_large_copy (void)
+{
+    copy_and_check (3 * 1024 * 1024 + 17);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/test-verify-copies-stream/1.0",
+                     test_verify_stream_copy);
+    g_test_add_func ("/test-verify-copies-stream/1.1",
+                     test_verify_empty_stream_copy);
+    g_test_add_func ("/test-verify-copies-large/1.0",
+                     test_verify_large_copy);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_autoptr (NautilusFileUndoManager) undo_manager = NULL;
+    int ret;
+
+    /* Not to touch the settings of whoever runs the tests, and to keep
+     * the journals away from the real cache. */
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+    cache_dir = g_dir_make_tmp ("nautilus-verify-copies-cache-XXXXXX", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+    /* Local copies are not read back otherwise */
+    g_setenv ("NAUTILUS_COPY_READ_BACK", "always", TRUE);
+
+    undo_manager = nautilus_file_undo_manager_new ();
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    g_settings_set_boolean (nautilus_preferences,
+                            NAUTILUS_PREFERENCES_VERIFY_COPIES, TRUE);
+    g_settings_set_boolean (nautilus_preferences,
+                            NAUTILUS_PREFERENCES_RESUMABLE_COPIES, TRUE);
+    g_settings_set_uint64 (nautilus_preferences,
+                           NAUTILUS_PREFERENCES_LARGE_FILE_COPY_THRESHOLD, 1);
+
+    setup_test_suite ();
+
+    ret = g_test_run ();
+
+    test_clear_tmp_dir ();
+    g_free (cache_dir);
+
+    return ret;
+}
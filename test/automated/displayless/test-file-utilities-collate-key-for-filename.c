@@ -0,0 +1,110 @@
+#include <glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include "src/nautilus-file-utilities.h"
+
+/* Includes the dots, digits and zeros the keys treat specially */
+static const char name_characters[] = "aAbBzZ09150.-_ ~:\1";
+
+static void
+random_name (char  *name,
+             gsize  size)
+{
+    gsize length;
+
+    length = g_test_rand_int_range (0, size);
+    for (gsize i = 0; i < length; i++)
+    {
+        name[i] = name_characters[g_test_rand_int_range (0, sizeof (name_characters) - 1)];
+    }
+    name[length] = '\0';
+}
+
+static void
+assert_same_key (const char *name)
+{
+    g_autofree char *actual = NULL;
+    g_autofree char *expected = NULL;
+
+    actual = nautilus_collate_key_for_filename (name);
+    expected = g_utf8_collate_key_for_filename (name, -1);
+
+    g_assert_cmpstr (actual, ==, expected);
+}
+
+static void
+test_random_ascii_names (void)
+{
+    char name[16];
+
+    for (guint i = 0; i < 100000; i++)
+    {
+        random_name (name, sizeof (name));
+        assert_same_key (name);
+    }
+}
+
+static void
+test_special_names (void)
+{
+    assert_same_key ("");
+    assert_same_key (".");
+    assert_same_key ("..");
+    assert_same_key (".hidden");
+    assert_same_key ("0");
+    assert_same_key ("000");
+    assert_same_key ("file000");
+    assert_same_key ("file007.txt");
+    assert_same_key ("1.2.10");
+    assert_same_key ("a very long file name with many words in it, longer than some "
+                     "buffer would be, so that the segment has to be copied on the "
+                     "heap before it can be transformed, and then a digit 42 too.txt");
+}
+
+static void
+test_non_ascii_names (void)
+{
+    assert_same_key ("caf\xc3\xa9");
+    assert_same_key ("\xc3\xa9t\xc3\xa9 2021.jpg");
+    assert_same_key ("\xe6\x97\xa5\xe6\x9c\xac 10.txt");
+}
+
+static void
+test_natural_order (void)
+{
+    g_autofree char *key_1 = NULL;
+    g_autofree char *key_2 = NULL;
+
+    key_1 = nautilus_collate_key_for_filename ("file2.txt");
+    key_2 = nautilus_collate_key_for_filename ("file10.txt");
+
+    g_assert_cmpint (strcmp (key_1, key_2), <, 0);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/collate-key-for-filename/1.0",
+                     test_random_ascii_names);
+    g_test_add_func ("/collate-key-for-filename/1.1",
+                     test_special_names);
+    g_test_add_func ("/collate-key-for-filename/1.2",
+                     test_non_ascii_names);
+    g_test_add_func ("/collate-key-for-filename/2.0",
+                     test_natural_order);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    setup_test_suite ();
+
+    return g_test_run ();
+}
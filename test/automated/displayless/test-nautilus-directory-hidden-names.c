@@ -0,0 +1,166 @@
+#include <glib.h>
+#include "src/nautilus-directory.h"
+#include "src/nautilus-file.h"
+#include "src/nautilus-global-preferences.h"
+#include "test-utilities.h"
+
+static void
+create_hidden_names_hierarchy (GFile *root)
+{
+    g_autoptr (GFile) folder = NULL;
+    g_autoptr (GFile) hidden_folder = NULL;
+    g_autoptr (GFile) hidden_file = NULL;
+    g_autoptr (GFile) visible_file = NULL;
+    g_autoptr (GFileOutputStream) out = NULL;
+
+    folder = g_file_get_child (root, "hidden_names");
+    g_file_make_directory (folder, NULL, NULL);
+
+    hidden_folder = g_file_get_child (folder, ".hidden_folder");
+    g_file_make_directory (hidden_folder, NULL, NULL);
+
+    hidden_file = g_file_get_child (folder, ".hidden_file");
+    out = g_file_create (hidden_file, G_FILE_CREATE_NONE, NULL, NULL);
+    g_clear_object (&out);
+
+    visible_file = g_file_get_child (folder, "visible_file");
+    out = g_file_create (visible_file, G_FILE_CREATE_NONE, NULL, NULL);
+}
+
+static void
+hidden_names_ready (NautilusDirectory *directory,
+                    GList             *files,
+                    gpointer           callback_data)
+{
+    GMainLoop *loop = callback_data;
+    g_autoptr (NautilusFile) hidden_file = NULL;
+    g_auto (GStrv) hidden_directory_names = NULL;
+    gboolean is_directory;
+
+    /* Not loaded, as they are not shown... */
+    hidden_file = nautilus_directory_get_file_by_name (directory, ".hidden_file");
+    g_assert_null (hidden_file);
+
+    /* ...but their names clash all the same */
+    is_directory = TRUE;
+    g_assert_true (nautilus_directory_has_hidden_file_by_name (directory, ".hidden_file",
+                                                               &is_directory));
+    g_assert_false (is_directory);
+    g_assert_true (nautilus_directory_has_hidden_file_by_name (directory, ".hidden_folder",
+                                                               &is_directory));
+    g_assert_true (is_directory);
+
+    g_assert_false (nautilus_directory_has_hidden_file_by_name (directory, "visible_file", NULL));
+    g_assert_false (nautilus_directory_has_hidden_file_by_name (directory, ".missing", NULL));
+
+    hidden_directory_names = nautilus_directory_get_hidden_directory_names (directory);
+    g_assert_cmpuint (g_strv_length (hidden_directory_names), ==, 1);
+    g_assert_cmpstr (hidden_directory_names[0], ==, ".hidden_folder");
+
+    g_main_loop_quit (loop);
+}
+
+static void
+test_hidden_names_clash (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (NautilusDirectory) directory = NULL;
+    g_autoptr (GMainLoop) loop = NULL;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    create_hidden_names_hierarchy (root);
+
+    location = g_file_get_child (root, "hidden_names");
+    directory = nautilus_directory_get (location);
+    loop = g_main_loop_new (NULL, FALSE);
+
+    nautilus_directory_call_when_ready (directory,
+                                        NAUTILUS_FILE_ATTRIBUTE_INFO,
+                                        TRUE,
+                                        hidden_names_ready,
+                                        loop);
+    g_main_loop_run (loop);
+}
+
+static void
+hidden_name_removed_ready (NautilusDirectory *directory,
+                           GList             *files,
+                           gpointer           callback_data)
+{
+    GMainLoop *loop = callback_data;
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (GFile) hidden_file = NULL;
+    g_autoptr (GList) removed = NULL;
+
+    location = nautilus_directory_get_location (directory);
+    hidden_file = g_file_get_child (location, ".hidden_file");
+    g_assert_true (nautilus_directory_has_hidden_file_by_name (directory, ".hidden_file", NULL));
+
+    g_file_delete (hidden_file, NULL, NULL);
+    removed = g_list_prepend (NULL, hidden_file);
+    nautilus_directory_notify_files_removed (removed);
+
+    g_assert_false (nautilus_directory_has_hidden_file_by_name (directory, ".hidden_file", NULL));
+    g_assert_true (nautilus_directory_has_hidden_file_by_name (directory, ".hidden_folder", NULL));
+
+    g_main_loop_quit (loop);
+}
+
+static void
+test_hidden_name_removed (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (NautilusDirectory) directory = NULL;
+    g_autoptr (GMainLoop) loop = NULL;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    create_hidden_names_hierarchy (root);
+
+    location = g_file_get_child (root, "hidden_names");
+    directory = nautilus_directory_get (location);
+    loop = g_main_loop_new (NULL, FALSE);
+
+    nautilus_directory_call_when_ready (directory,
+                                        NAUTILUS_FILE_ATTRIBUTE_INFO,
+                                        TRUE,
+                                        hidden_name_removed_ready,
+                                        loop);
+    g_main_loop_run (loop);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/directory-hidden-names/clash/1.0",
+                     test_hidden_names_clash);
+    g_test_add_func ("/directory-hidden-names/removed/1.0",
+                     test_hidden_name_removed);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    int ret;
+
+    /* Not to touch the settings of whoever runs the tests */
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    g_settings_set_boolean (gtk_filechooser_preferences,
+                            NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES, FALSE);
+
+    setup_test_suite ();
+
+    ret = g_test_run ();
+
+    test_clear_tmp_dir ();
+
+    return ret;
+}
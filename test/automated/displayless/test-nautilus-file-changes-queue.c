@@ -0,0 +1,274 @@
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "src/nautilus-file-changes-queue.h"
+#include "src/nautilus-file-changes-queue-private.h"
+
+#define N_PRODUCERS 8
+#define N_CHANGES_PER_PRODUCER 5000
+/* How many of them each producer pushes at once */
+#define BATCH_SIZE 10
+
+static gint n_producers_done;
+
+/* Coalesces @events, like "A:a R:a" for a file a added then removed,
+ * M:ab being a move from a to b, and returns what is left the same way. */
+static char *
+coalesce (const char *events)
+{
+    g_auto (GStrv) tokens = NULL;
+    g_autoptr (GArray) changes = NULL;
+    g_autoptr (GArray) coalesced = NULL;
+    g_autoptr (GPtrArray) result = NULL;
+    const char kinds[] = " ACRM";
+
+    tokens = g_strsplit (events, " ", -1);
+    changes = g_array_new (FALSE, TRUE, sizeof (NautilusFileChange));
+    for (guint i = 0; tokens[i] != NULL; i++)
+    {
+        NautilusFileChange change = { 0 };
+        char from[] = { tokens[i][2], '\0' };
+
+        change.kind = strchr (kinds, tokens[i][0]) - kinds;
+        change.files.from = g_file_new_for_path (from);
+        if (change.kind == CHANGE_FILE_MOVED)
+        {
+            char to[] = { tokens[i][3], '\0' };
+
+            change.files.to = g_file_new_for_path (to);
+        }
+        g_array_append_val (changes, change);
+    }
+
+    coalesced = nautilus_file_changes_coalesce (changes);
+
+    result = g_ptr_array_new_with_free_func (g_free);
+    for (guint i = 0; i < coalesced->len; i++)
+    {
+        NautilusFileChange *change = &g_array_index (coalesced, NautilusFileChange, i);
+        g_autofree char *from = g_file_get_basename (change->files.from);
+        g_autofree char *to = NULL;
+
+        if (change->files.to != NULL)
+        {
+            to = g_file_get_basename (change->files.to);
+        }
+        g_ptr_array_add (result, g_strdup_printf ("%c:%s%s", kinds[change->kind], from,
+                                                  to != NULL ? to : ""));
+
+        g_object_unref (change->files.from);
+        g_clear_object (&change->files.to);
+    }
+    g_ptr_array_add (result, NULL);
+
+    return g_strjoinv (" ", (char **) result->pdata);
+}
+
+#define assert_coalesced(events, expected) \
+    G_STMT_START { \
+        g_autofree char *coalesced = coalesce (events); \
+        g_assert_cmpstr (coalesced, ==, expected); \
+    } G_STMT_END
+
+/* Tests what two changes to the same file come down to */
+static void
+test_two_changes (void)
+{
+    assert_coalesced ("A:a R:a", "");
+    assert_coalesced ("R:a A:a", "R:a A:a");
+    assert_coalesced ("A:a C:a", "A:a");
+    assert_coalesced ("C:a A:a", "A:a");
+    assert_coalesced ("C:a R:a", "R:a");
+    assert_coalesced ("R:a C:a", "R:a A:a");
+    assert_coalesced ("C:a C:a", "C:a");
+}
+
+/* Tests what three changes to the same file come down to */
+static void
+test_three_changes (void)
+{
+    /* The file is back, and the views never saw it */
+    assert_coalesced ("A:a R:a C:a", "A:a");
+    assert_coalesced ("A:a R:a A:a", "A:a");
+    assert_coalesced ("A:a R:a R:a", "");
+    assert_coalesced ("A:a C:a R:a", "");
+    assert_coalesced ("R:a A:a R:a", "R:a");
+    assert_coalesced ("R:a A:a C:a", "R:a A:a");
+    assert_coalesced ("C:a R:a A:a", "R:a A:a");
+}
+
+/* Tests that moves stay in place, the changes around them being sent
+ * before and after */
+static void
+test_moves (void)
+{
+    assert_coalesced ("M:ab C:b", "M:ab C:b");
+    assert_coalesced ("C:a M:ab", "C:a M:ab");
+    assert_coalesced ("M:ab R:b", "M:ab R:b");
+    assert_coalesced ("A:a M:ab C:b", "A:a M:ab C:b");
+    assert_coalesced ("C:b M:ab C:b", "C:b M:ab C:b");
+}
+
+/* Tests that the changes to other files are kept apart, removals first */
+static void
+test_several_files (void)
+{
+    assert_coalesced ("A:a R:b C:c", "R:b A:a C:c");
+    assert_coalesced ("A:a A:b R:a", "A:b");
+}
+
+/* Pushes the changes of one producer, one at a time for the odd ones and
+ * as batches for the even ones, to /<producer>/<change> */
+static gpointer
+produce_changes (gpointer user_data)
+{
+    guint producer = GPOINTER_TO_UINT (user_data);
+
+    for (guint i = 0; i < N_CHANGES_PER_PRODUCER; i += BATCH_SIZE)
+    {
+        g_autolist (GFile) batch = NULL;
+
+        for (guint j = i + BATCH_SIZE; j > i; j--)
+        {
+            g_autofree char *path = g_strdup_printf ("/%u/%u", producer, j - 1);
+
+            batch = g_list_prepend (batch, g_file_new_for_path (path));
+        }
+
+        if (producer % 2 == 0)
+        {
+            nautilus_file_changes_queue_files_changed (batch);
+        }
+        else
+        {
+            for (GList *l = batch; l != NULL; l = l->next)
+            {
+                nautilus_file_changes_queue_file_added (l->data);
+            }
+        }
+    }
+    g_atomic_int_inc (&n_producers_done);
+
+    return NULL;
+}
+
+/* Checks that @changes come in the order each producer pushed them, after
+ * the @next_changes ones seen so far, which it moves past them. */
+static void
+check_taken_changes (GArray *changes,
+                     guint  *next_changes)
+{
+    for (guint i = 0; i < changes->len; i++)
+    {
+        NautilusFileChange *change = &g_array_index (changes, NautilusFileChange, i);
+        g_autofree char *path = g_file_get_path (change->files.from);
+        guint producer;
+        guint n;
+
+        g_assert_cmpint (sscanf (path, "/%u/%u", &producer, &n), ==, 2);
+        g_assert_cmpuint (producer, <, N_PRODUCERS);
+        g_assert_cmpuint (n, ==, next_changes[producer]);
+        g_assert_cmpint (change->kind, ==,
+                         producer % 2 == 0 ? CHANGE_FILE_CHANGED : CHANGE_FILE_ADDED);
+        next_changes[producer]++;
+
+        g_object_unref (change->files.from);
+        g_clear_object (&change->files.to);
+    }
+}
+
+/* Tests that the changes pushed by several threads at once are all taken,
+ * each in the order it was pushed */
+static void
+test_producers (void)
+{
+    GThread *producers[N_PRODUCERS];
+    guint next_changes[N_PRODUCERS] = { 0 };
+    g_autoptr (GArray) changes = NULL;
+
+    for (guint i = 0; i < N_PRODUCERS; i++)
+    {
+        producers[i] = g_thread_new ("producer", produce_changes, GUINT_TO_POINTER (i));
+    }
+    for (guint i = 0; i < N_PRODUCERS; i++)
+    {
+        g_thread_join (producers[i]);
+    }
+
+    changes = nautilus_file_changes_queue_take (G_MAXUINT);
+    g_assert_cmpuint (changes->len, ==, N_PRODUCERS * N_CHANGES_PER_PRODUCER);
+    check_taken_changes (changes, next_changes);
+}
+
+/* Tests taking the changes a few at a time, from within the batches, while
+ * they are being pushed */
+static void
+test_consumer_while_producing (void)
+{
+    GThread *producers[N_PRODUCERS];
+    guint next_changes[N_PRODUCERS] = { 0 };
+    g_autoptr (GArray) left = NULL;
+    guint n_taken = 0;
+
+    n_producers_done = 0;
+    for (guint i = 0; i < N_PRODUCERS; i++)
+    {
+        producers[i] = g_thread_new ("producer", produce_changes, GUINT_TO_POINTER (i));
+    }
+
+    while (TRUE)
+    {
+        g_autoptr (GArray) changes = NULL;
+        gboolean done;
+
+        /* Whatever was pushed before is there to take then */
+        done = g_atomic_int_get (&n_producers_done) == N_PRODUCERS;
+        changes = nautilus_file_changes_queue_take (BATCH_SIZE / 2 + 1);
+        g_assert_cmpuint (changes->len, <=, BATCH_SIZE / 2 + 1);
+        check_taken_changes (changes, next_changes);
+        n_taken += changes->len;
+
+        if (done && changes->len == 0)
+        {
+            break;
+        }
+    }
+    g_assert_cmpuint (n_taken, ==, N_PRODUCERS * N_CHANGES_PER_PRODUCER);
+
+    for (guint i = 0; i < N_PRODUCERS; i++)
+    {
+        g_thread_join (producers[i]);
+    }
+
+    left = nautilus_file_changes_queue_take (G_MAXUINT);
+    g_assert_cmpuint (left->len, ==, 0);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/file-changes-queue/coalesce/1.0",
+                     test_two_changes);
+    g_test_add_func ("/file-changes-queue/coalesce/1.1",
+                     test_three_changes);
+    g_test_add_func ("/file-changes-queue/coalesce/1.2",
+                     test_moves);
+    g_test_add_func ("/file-changes-queue/coalesce/1.3",
+                     test_several_files);
+    g_test_add_func ("/file-changes-queue/queue/1.0",
+                     test_producers);
+    g_test_add_func ("/file-changes-queue/queue/1.1",
+                     test_consumer_while_producing);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    setup_test_suite ();
+
+    return g_test_run ();
+}
@@ -0,0 +1,144 @@
+#include <glib.h>
+#include "src/nautilus-file.h"
+#include "src/nautilus-file-private.h"
+#include "src/nautilus-global-preferences.h"
+#include "test-utilities.h"
+
+#define N_FILES 10000
+
+/* Plain files must not pay for the side structs of NautilusFileDetails */
+static void
+test_plain_files_have_no_side_structs (void)
+{
+    g_autoptr (GFile) root = NULL;
+    GList *files = NULL;
+    GList *l;
+    gint i;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+
+    for (i = 0; i < N_FILES; i++)
+    {
+        g_autofree gchar *name = NULL;
+        g_autoptr (GFile) location = NULL;
+
+        name = g_strdup_printf ("footprint_file_%d", i);
+        location = g_file_get_child (root, name);
+        files = g_list_prepend (files, nautilus_file_get (location));
+    }
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        NautilusFile *file = l->data;
+
+        g_assert_null (file->details->deep_counts);
+        g_assert_null (file->details->thumbnail_info);
+        g_assert_null (file->details->trash_info);
+        g_assert_null (file->details->search_info);
+        g_assert_null (file->details->extension_data);
+        g_assert_null (file->details->sort_keys);
+        g_assert_null (file->details->icon_memo);
+    }
+
+    nautilus_file_list_free (files);
+}
+
+/* Only search hits get the search side struct */
+static void
+test_search_info_is_allocated_on_demand (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (NautilusFile) file = NULL;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    location = g_file_get_child (root, "footprint_search_hit");
+    file = nautilus_file_get (location);
+
+    g_assert_null (nautilus_file_get_search_fts_snippet (file));
+    g_assert_null (file->details->search_info);
+
+    nautilus_file_set_search_fts_snippet (file, "snippet");
+    g_assert_nonnull (file->details->search_info);
+    g_assert_cmpstr (nautilus_file_get_search_fts_snippet (file), ==, "snippet");
+}
+
+static NautilusFile *
+get_file_with_info (GFile      *root,
+                    const char *name)
+{
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (GFileInfo) info = NULL;
+    NautilusFile *file;
+
+    location = g_file_get_child (root, name);
+    file = nautilus_file_get (location);
+
+    info = g_file_info_new ();
+    g_file_info_set_name (info, name);
+    g_file_info_set_display_name (info, name);
+    g_file_info_set_edit_name (info, name);
+    g_file_info_set_file_type (info, G_FILE_TYPE_REGULAR);
+    g_file_info_set_content_type (info, "text/plain");
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER, "footprint-user");
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER_REAL, "Footprint User");
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP, "footprint-group");
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM, "footprint-fs");
+    nautilus_file_update_info (file, info);
+
+    return file;
+}
+
+/* The strings most files have in common are interned, so that each file
+ * only costs a reference to them */
+static void
+test_common_strings_are_shared (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (NautilusFile) file_1 = NULL;
+    g_autoptr (NautilusFile) file_2 = NULL;
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    file_1 = get_file_with_info (root, "footprint_shared_1");
+    file_2 = get_file_with_info (root, "footprint_shared_2");
+
+    g_assert_cmpstr (file_1->details->mime_type, ==, "text/plain");
+    g_assert_true (file_1->details->mime_type == file_2->details->mime_type);
+    g_assert_cmpstr (file_1->details->owner, ==, "footprint-user");
+    g_assert_true (file_1->details->owner == file_2->details->owner);
+    g_assert_true (file_1->details->owner_real == file_2->details->owner_real);
+    g_assert_cmpstr (file_1->details->group, ==, "footprint-group");
+    g_assert_true (file_1->details->group == file_2->details->group);
+    g_assert_true (file_1->details->filesystem_id == file_2->details->filesystem_id);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/file-footprint-plain-files/1.0",
+                     test_plain_files_have_no_side_structs);
+    g_test_add_func ("/file-footprint-search-info/1.0",
+                     test_search_info_is_allocated_on_demand);
+    g_test_add_func ("/file-footprint-shared-strings/1.0",
+                     test_common_strings_are_shared);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    int ret;
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    setup_test_suite ();
+
+    ret = g_test_run ();
+
+    test_clear_tmp_dir ();
+
+    return ret;
+}
@@ -0,0 +1,260 @@
+#include <glib.h>
+#include "src/nautilus-directory-notify.h"
+#include "src/nautilus-filename-index.h"
+#include "src/nautilus-global-preferences.h"
+#include "src/nautilus-query.h"
+#include "src/nautilus-search-hit.h"
+
+/* More than the index bothers with */
+#define N_FILLER_FILES 6000
+
+static GFile *root = NULL;
+static const char * const prune_patterns[] = { "node_modules", NULL };
+
+static NautilusQuery *
+query_new_for_text (const char *text)
+{
+    NautilusQuery *query;
+
+    query = nautilus_query_new ();
+    nautilus_query_set_text (query, text);
+    nautilus_query_set_location (query, root);
+    nautilus_query_set_recursive (query, NAUTILUS_QUERY_RECURSIVE_ALWAYS);
+    nautilus_query_set_show_hidden_files (query, FALSE);
+    nautilus_query_set_prune_patterns (query, prune_patterns);
+
+    return query;
+}
+
+static void
+build_index (void)
+{
+    GPtrArray *entries;
+
+    entries = g_ptr_array_new_with_free_func ((GDestroyNotify) nautilus_filename_index_entry_free);
+    for (guint i = 0; i < N_FILLER_FILES; i++)
+    {
+        g_autofree char *name = g_strdup_printf ("file-%u.txt", i);
+
+        g_ptr_array_add (entries, nautilus_filename_index_entry_new (name, name, 0, 0, FALSE));
+    }
+    g_ptr_array_add (entries, nautilus_filename_index_entry_new ("Tax 2019.pdf", "Tax 2019.pdf",
+                                                                 0, 0, FALSE));
+    g_ptr_array_add (entries, nautilus_filename_index_entry_new ("sub", "sub", 0, 0, TRUE));
+    g_ptr_array_add (entries, nautilus_filename_index_entry_new ("sub/Report.odt", "Report.odt",
+                                                                 0, 0, FALSE));
+
+    nautilus_filename_index_build (root, FALSE, NAUTILUS_QUERY_RECURSIVE_ALWAYS,
+                                   prune_patterns, entries);
+}
+
+/* Returns the number of hits of @text, or -1 if there is no usable index. */
+static gint
+count_hits (const char *text)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusFilenameIndex) index = NULL;
+    GList *hits;
+    gint n_hits;
+
+    query = query_new_for_text (text);
+    index = nautilus_filename_index_lookup (query);
+    if (index == NULL)
+    {
+        return -1;
+    }
+
+    hits = nautilus_filename_index_search (index, query, NULL);
+    n_hits = g_list_length (hits);
+    g_list_free_full (hits, g_object_unref);
+
+    return n_hits;
+}
+
+/* Tests that words match the names they are substrings of */
+static void
+test_search (void)
+{
+    g_assert_cmpint (count_hits ("report"), ==, 1);
+    g_assert_cmpint (count_hits ("2019 tax"), ==, 1);
+    g_assert_cmpint (count_hits ("file-599"), ==, 11);
+    /* Too short for the trigrams, so every name is looked at */
+    g_assert_cmpint (count_hits ("ub"), ==, 1);
+    g_assert_cmpint (count_hits ("nothing"), ==, 0);
+}
+
+/* Tests that an index is only used for the settings it was built with */
+static void
+test_settings (void)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusFilenameIndex) index = NULL;
+
+    query = query_new_for_text ("report");
+    nautilus_query_set_show_hidden_files (query, TRUE);
+    index = nautilus_filename_index_lookup (query);
+
+    g_assert_null (index);
+
+    nautilus_query_set_show_hidden_files (query, FALSE);
+    nautilus_query_set_prune_patterns (query, NULL);
+    index = nautilus_filename_index_lookup (query);
+
+    g_assert_null (index);
+}
+
+/* Tests that the index follows the files notified afterwards */
+static void
+test_changes (void)
+{
+    g_autoptr (GFile) directory = NULL;
+    g_autoptr (GFile) added = NULL;
+    g_autoptr (GFile) pruned = NULL;
+    g_autoptr (GFile) from = NULL;
+    g_autoptr (GFile) to = NULL;
+    g_autoptr (GList) files = NULL;
+    g_autoptr (GList) pairs = NULL;
+    GFilePair pair;
+
+    directory = g_file_get_child (root, "sub");
+    files = g_list_prepend (NULL, directory);
+    nautilus_filename_index_notify_files_removed (files);
+    g_assert_cmpint (count_hits ("report"), ==, 0);
+
+    added = g_file_resolve_relative_path (root, "sub/Report (copy).odt");
+    g_list_free (g_steal_pointer (&files));
+    files = g_list_prepend (NULL, added);
+    nautilus_filename_index_notify_files_added (files);
+    g_assert_cmpint (count_hits ("report"), ==, 1);
+
+    /* The crawl didn't descend into it either */
+    pruned = g_file_resolve_relative_path (root, "node_modules/report.js");
+    g_list_free (g_steal_pointer (&files));
+    files = g_list_prepend (NULL, pruned);
+    nautilus_filename_index_notify_files_added (files);
+    g_assert_cmpint (count_hits ("report"), ==, 1);
+
+    from = g_file_get_child (root, "Tax 2019.pdf");
+    to = g_file_get_child (root, "Taxes 2019.pdf");
+    pair.from = from;
+    pair.to = to;
+    pairs = g_list_prepend (NULL, &pair);
+    nautilus_filename_index_notify_files_moved (pairs);
+    g_assert_cmpint (count_hits ("taxes"), ==, 1);
+    g_assert_cmpint (count_hits ("tax"), ==, 1);
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+    gboolean *timed_out = user_data;
+
+    *timed_out = TRUE;
+
+    return G_SOURCE_REMOVE;
+}
+
+/* The type of the moved files is looked up asynchronously. */
+static void
+wait_for_type_checks (void)
+{
+    gboolean timed_out = FALSE;
+
+    g_timeout_add (500, timeout_cb, &timed_out);
+    while (!timed_out)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+}
+
+/* Moves @from_name, created in @root, and notifies the index of both */
+static void
+add_and_move (const char *from_name,
+              const char *to_name,
+              gboolean    is_directory)
+{
+    g_autoptr (GFile) from = NULL;
+    g_autoptr (GFile) to = NULL;
+    g_autoptr (GList) files = NULL;
+    g_autoptr (GList) pairs = NULL;
+    GFilePair pair;
+
+    from = g_file_get_child (root, from_name);
+    to = g_file_get_child (root, to_name);
+    if (is_directory)
+    {
+        g_assert_true (g_file_make_directory (from, NULL, NULL));
+    }
+    else
+    {
+        g_assert_true (g_file_replace_contents (from, "x", 1, NULL, FALSE,
+                                                G_FILE_CREATE_NONE, NULL, NULL, NULL));
+    }
+    files = g_list_prepend (NULL, from);
+    nautilus_filename_index_notify_files_added (files);
+
+    g_assert_true (g_file_move (from, to, G_FILE_COPY_NONE, NULL, NULL, NULL, NULL));
+    pair.from = from;
+    pair.to = to;
+    pairs = g_list_prepend (NULL, &pair);
+    nautilus_filename_index_notify_files_moved (pairs);
+}
+
+/* Tests that new files, of a type not known yet, can be moved without the
+ * index being dropped, unless they turn out to be directories */
+static void
+test_new_files_moved (void)
+{
+    add_and_move ("Draft.txt", "Final draft.txt", FALSE);
+    g_assert_cmpint (count_hits ("final"), ==, 1);
+    wait_for_type_checks ();
+    g_assert_cmpint (count_hits ("final"), ==, 1);
+
+    /* Its files were not notified, so the index can't be trusted */
+    add_and_move ("Drafts", "Old drafts", TRUE);
+    wait_for_type_checks ();
+    g_assert_cmpint (count_hits ("final"), ==, -1);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/filename-index/search/1.0",
+                     test_search);
+    g_test_add_func ("/filename-index/settings/1.0",
+                     test_settings);
+    g_test_add_func ("/filename-index/changes/1.0",
+                     test_changes);
+    /* Last, as it gets the index dropped */
+    g_test_add_func ("/filename-index/changes/1.1",
+                     test_new_files_moved);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_autofree char *cache_dir = NULL;
+    g_autofree char *root_dir = NULL;
+    int result;
+
+    /* Keeps the index away from the real cache. */
+    cache_dir = g_dir_make_tmp ("nautilus-filename-index-cache-XXXXXX", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+    root_dir = g_dir_make_tmp ("nautilus-filename-index-XXXXXX", NULL);
+    root = g_file_new_for_path (root_dir);
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    /* Needed for nautilus-query.c. */
+    nautilus_global_preferences_init ();
+
+    build_index ();
+    setup_test_suite ();
+
+    result = g_test_run ();
+
+    g_object_unref (root);
+
+    return result;
+}
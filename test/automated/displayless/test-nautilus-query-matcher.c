@@ -0,0 +1,121 @@
+#include <glib.h>
+#include "src/nautilus-global-preferences.h"
+#include "src/nautilus-query.h"
+
+static NautilusQuery *
+query_new_for_text (const char *text)
+{
+    NautilusQuery *query;
+
+    query = nautilus_query_new ();
+    nautilus_query_set_text (query, text);
+
+    return query;
+}
+
+/* Tests that ASCII names match regardless of case */
+static void
+test_ascii_case (void)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+
+    query = query_new_for_text ("Report");
+    matcher = nautilus_query_get_matcher (query);
+
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "report.txt"), >, -1);
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "OLD REPORT"), >, -1);
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "repo.txt"), ==, -1);
+}
+
+/* Tests that every word of the query has to match */
+static void
+test_words (void)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+
+    query = query_new_for_text ("tax 2019");
+    matcher = nautilus_query_get_matcher (query);
+
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "2019-Tax-Return.pdf"), >, -1);
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "Tax-Return.pdf"), ==, -1);
+}
+
+/* Tests that the rank of ASCII names is computed as for any name */
+static void
+test_ascii_rank (void)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+
+    query = query_new_for_text ("photo");
+    matcher = nautilus_query_get_matcher (query);
+
+    /* 50, less the letters before the match and a hundredth of the others */
+    g_assert_cmpfloat_with_epsilon (nautilus_query_matcher_match (matcher, "Photo.jpg"),
+                                    49.96, 0.001);
+    g_assert_cmpfloat_with_epsilon (nautilus_query_matcher_match (matcher, "My Photo.jpg"),
+                                    46.96, 0.001);
+}
+
+/* Tests that accented names match unaccented words */
+static void
+test_unicode (void)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+
+    query = query_new_for_text ("cafe");
+    matcher = nautilus_query_get_matcher (query);
+
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "Café"), >, -1);
+    g_assert_cmpfloat (nautilus_query_matcher_match (matcher, "CAFÉ"), >, -1);
+}
+
+/* Tests that a matcher keeps matching the text it was made for */
+static void
+test_text_changed (void)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusQueryMatcher) old_matcher = NULL;
+    g_autoptr (NautilusQueryMatcher) new_matcher = NULL;
+
+    query = query_new_for_text ("first");
+    old_matcher = nautilus_query_get_matcher (query);
+    nautilus_query_set_text (query, "second");
+    new_matcher = nautilus_query_get_matcher (query);
+
+    g_assert_cmpfloat (nautilus_query_matcher_match (old_matcher, "first"), >, -1);
+    g_assert_cmpfloat (nautilus_query_matcher_match (new_matcher, "first"), ==, -1);
+    g_assert_cmpfloat (nautilus_query_matches_string (query, "second"), >, -1);
+}
+
+static void
+setup_test_suite (void)
+{
+    g_test_add_func ("/query-matcher/ascii/1.0",
+                     test_ascii_case);
+    g_test_add_func ("/query-matcher/ascii/1.1",
+                     test_words);
+    g_test_add_func ("/query-matcher/ascii/1.2",
+                     test_ascii_rank);
+    g_test_add_func ("/query-matcher/unicode/1.0",
+                     test_unicode);
+    g_test_add_func ("/query-matcher/text-changed/1.0",
+                     test_text_changed);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    /* Needed for nautilus-query.c. */
+    nautilus_global_preferences_init ();
+
+    setup_test_suite ();
+
+    return g_test_run ();
+}
@@ -0,0 +1,122 @@
+#include "bench-common.h"
+
+#include <glib/gstdio.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+glong
+bench_get_peak_rss_kb (void)
+{
+    struct rusage usage;
+
+    if (getrusage (RUSAGE_SELF, &usage) != 0)
+    {
+        return -1;
+    }
+
+    return usage.ru_maxrss;
+}
+
+gsize
+bench_get_heap_bytes (void)
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ (2, 33)
+    return mallinfo2 ().uordblks;
+#endif
+#endif
+    return 0;
+}
+
+void
+bench_delete_tree (const char *path)
+{
+    g_autoptr (GDir) dir = NULL;
+    const char *name;
+
+    if (!g_file_test (path, G_FILE_TEST_IS_SYMLINK) &&
+        g_file_test (path, G_FILE_TEST_IS_DIR))
+    {
+        dir = g_dir_open (path, 0, NULL);
+        while (dir != NULL && (name = g_dir_read_name (dir)) != NULL)
+        {
+            g_autofree char *child = g_build_filename (path, name, NULL);
+
+            bench_delete_tree (child);
+        }
+    }
+
+    g_remove (path);
+}
+
+GKeyFile *
+bench_load_snapshot (const char *path)
+{
+    g_autoptr (GKeyFile) snapshot = NULL;
+    g_autoptr (GError) error = NULL;
+
+    snapshot = g_key_file_new ();
+    if (path != NULL &&
+        !g_key_file_load_from_file (snapshot, path, G_KEY_FILE_NONE, &error))
+    {
+        g_printerr ("Failed to load %s: %s\n", path, error->message);
+        return NULL;
+    }
+
+    return g_steal_pointer (&snapshot);
+}
+
+gboolean
+bench_save_results (GKeyFile   *results,
+                    const char *path)
+{
+    g_autoptr (GError) error = NULL;
+
+    if (path != NULL &&
+        !g_key_file_save_to_file (results, path, &error))
+    {
+        g_printerr ("Failed to save %s: %s\n", path, error->message);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+bench_report (GKeyFile   *results,
+              GKeyFile   *snapshot,
+              const char *group,
+              const char *key,
+              gdouble     value)
+{
+    bench_report_with_limit (results, snapshot, group, key, value, 0);
+}
+
+gboolean
+bench_report_with_limit (GKeyFile   *results,
+                         GKeyFile   *snapshot,
+                         const char *group,
+                         const char *key,
+                         gdouble     value,
+                         gdouble     max_regression)
+{
+    g_autoptr (GError) error = NULL;
+    gdouble previous;
+    gdouble change;
+
+    g_key_file_set_double (results, group, key, value);
+
+    previous = g_key_file_get_double (snapshot, group, key, &error);
+    if (error != NULL || previous == 0)
+    {
+        g_print ("  %-20s %14.1f\n", key, value);
+        return TRUE;
+    }
+
+    change = 100 * (value - previous) / previous;
+    g_print ("  %-20s %14.1f  (was %.1f, %+.1f%%)\n", key, value, previous, change);
+
+    return max_regression <= 0 || change <= max_regression;
+}
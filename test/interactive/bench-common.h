@@ -0,0 +1,40 @@
+/* What the benchmarks share: how much memory the process takes, the trees
+ * they generate, and their results, saved with --save=FILE as a key file
+ * of one group per case and compared with --compare=FILE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* The peak RSS of the whole process so far, or -1 */
+glong      bench_get_peak_rss_kb      (void);
+/* The heap bytes in use, where glibc tells them, or 0 */
+gsize      bench_get_heap_bytes       (void);
+
+/* Deletes @path and what is under it, not following the links. */
+void       bench_delete_tree          (const char *path);
+
+/* An empty key file without @path. Prints why and returns NULL when it
+ * can't be loaded. */
+GKeyFile * bench_load_snapshot        (const char *path);
+/* Does nothing without @path. Prints why and returns FALSE when it can't
+ * be saved. */
+gboolean   bench_save_results         (GKeyFile   *results,
+                                       const char *path);
+
+/* Sets @key of @group in @results to @value, and prints it, with how it
+ * changed since @snapshot. */
+void       bench_report               (GKeyFile   *results,
+                                       GKeyFile   *snapshot,
+                                       const char *group,
+                                       const char *key,
+                                       gdouble     value);
+/* The same, returning whether it grew by less than @max_regression percent
+ * since @snapshot, which 0 doesn't limit. */
+gboolean   bench_report_with_limit    (GKeyFile   *results,
+                                       GKeyFile   *snapshot,
+                                       const char *group,
+                                       const char *key,
+                                       gdouble     value,
+                                       gdouble     max_regression);
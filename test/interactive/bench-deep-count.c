@@ -0,0 +1,229 @@
+/* Times the deep counts of a generated tree, as the properties window
+ * asks for them, and how much memory they take while counting.
+ *
+ *   bench-deep-count [--files=N] [--links=PERCENT] [--save=FILE] [--compare=FILE]
+ *
+ * The tree has folders of FILES_PER_FOLDER files each. --links makes that
+ * percentage of the files hardlinked from a second folder too, so that the
+ * inodes that may be seen twice have to be remembered. The files counted
+ * are checked against the ones generated, the links not being counted
+ * twice.
+ *
+ * The results can be saved to a key file, and a later run compared with
+ * it. Peak RSS is the peak of the whole process so far. The heap bytes are
+ * the most in use while counting, where glibc tells them.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <src/nautilus-file.h>
+#include <src/nautilus-file-utilities.h>
+#include <src/nautilus-global-preferences.h>
+
+#include "bench-common.h"
+
+#define DEFAULT_N_FILES 200000
+#define FILES_PER_FOLDER 100
+#define N_RUNS 5
+/* How often the heap is looked at while counting */
+#define HEAP_SAMPLE_INTERVAL_MS 10
+
+typedef struct
+{
+    GMainLoop *loop;
+    gsize heap_start;
+    gsize heap_peak;
+} CountRun;
+
+/* Returns the number of folders made, the top one included */
+static guint
+generate_tree (const char *path,
+               guint       n_files,
+               guint       links_percent)
+{
+    g_autofree char *links_path = NULL;
+    g_autofree char *folder = NULL;
+    guint n_folders = 1;
+
+    if (links_percent > 0)
+    {
+        links_path = g_build_filename (path, "links", NULL);
+        g_mkdir (links_path, 0755);
+        n_folders++;
+    }
+
+    for (guint i = 0; i < n_files; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *file_path = NULL;
+
+        if (i % FILES_PER_FOLDER == 0)
+        {
+            g_autofree char *folder_name = g_strdup_printf ("folder %06u", i / FILES_PER_FOLDER);
+
+            g_free (folder);
+            folder = g_build_filename (path, folder_name, NULL);
+            g_mkdir (folder, 0755);
+            n_folders++;
+        }
+
+        name = g_strdup_printf ("file %06u.txt", i);
+        file_path = g_build_filename (folder, name, NULL);
+        g_file_set_contents (file_path, "x", 1, NULL);
+
+        /* Spread evenly, so that runs can be compared */
+        if (links_percent > 0 && (i * links_percent) % 100 < links_percent)
+        {
+            g_autofree char *link_path = g_build_filename (links_path, name, NULL);
+
+            if (link (file_path, link_path) != 0)
+            {
+                g_printerr ("Failed to link %s\n", file_path);
+            }
+        }
+    }
+
+    return n_folders;
+}
+
+static gboolean
+sample_heap (gpointer user_data)
+{
+    CountRun *run = user_data;
+
+    run->heap_peak = MAX (run->heap_peak, bench_get_heap_bytes ());
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+deep_counts_ready (NautilusFile *file,
+                   gpointer      callback_data)
+{
+    CountRun *run = callback_data;
+
+    g_main_loop_quit (run->loop);
+}
+
+static gdouble
+run_count (NautilusFile *file,
+           CountRun     *run)
+{
+    gint64 start_time;
+    guint sample_id;
+
+    run->heap_start = bench_get_heap_bytes ();
+    run->heap_peak = run->heap_start;
+    sample_id = g_timeout_add (HEAP_SAMPLE_INTERVAL_MS, sample_heap, run);
+
+    start_time = g_get_monotonic_time ();
+    nautilus_file_recompute_deep_counts (file);
+    nautilus_file_call_when_ready (file, NAUTILUS_FILE_ATTRIBUTE_DEEP_COUNTS,
+                                   deep_counts_ready, run);
+    g_main_loop_run (run->loop);
+
+    g_source_remove (sample_id);
+
+    return (g_get_monotonic_time () - start_time) / 1000.0;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gint n_files = DEFAULT_N_FILES;
+    gint links_percent = 0;
+    g_autofree char *save_path = NULL;
+    g_autofree char *compare_path = NULL;
+    GOptionEntry entries[] =
+    {
+        { "files", 0, 0, G_OPTION_ARG_INT, &n_files, "Number of files", "N" },
+        { "links", 0, 0, G_OPTION_ARG_INT, &links_percent, "Percentage of the files hardlinked", "PERCENT" },
+        { "save", 0, 0, G_OPTION_ARG_FILENAME, &save_path, "Save the results to FILE", "FILE" },
+        { "compare", 0, 0, G_OPTION_ARG_FILENAME, &compare_path, "Compare with the results saved in FILE", "FILE" },
+        { NULL }
+    };
+    g_autoptr (GOptionContext) context = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autoptr (GKeyFile) results = NULL;
+    g_autoptr (GKeyFile) snapshot = NULL;
+    g_autofree char *tmp_dir = NULL;
+    g_autofree char *group = NULL;
+    g_autoptr (GFile) location = NULL;
+    NautilusFile *file;
+    CountRun run = { 0 };
+    guint n_folders;
+    guint directory_count;
+    guint file_count;
+    gdouble best_ms;
+    gsize heap_peak;
+
+    context = g_option_context_new (NULL);
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error) ||
+        n_files <= 0 || links_percent < 0 || links_percent > 100)
+    {
+        g_printerr ("%s\n", error != NULL ? error->message : "Invalid number of files or links");
+        return 1;
+    }
+
+    snapshot = bench_load_snapshot (compare_path);
+    if (snapshot == NULL)
+    {
+        return 1;
+    }
+    results = g_key_file_new ();
+
+    tmp_dir = g_dir_make_tmp ("nautilus-bench-XXXXXX", &error);
+    if (tmp_dir == NULL)
+    {
+        g_printerr ("%s\n", error->message);
+        return 1;
+    }
+
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    n_folders = generate_tree (tmp_dir, n_files, links_percent);
+    group = g_strdup_printf ("%d files %d%% links", n_files, links_percent);
+    g_print ("%s:\n", group);
+
+    run.loop = g_main_loop_new (NULL, FALSE);
+    location = g_file_new_for_path (tmp_dir);
+    file = nautilus_file_get (location);
+
+    /* Keep the best run, to leave out the noise, and the most memory */
+    best_ms = G_MAXDOUBLE;
+    heap_peak = 0;
+    for (guint i = 0; i < N_RUNS; i++)
+    {
+        best_ms = MIN (best_ms, run_count (file, &run));
+        heap_peak = MAX (heap_peak, run.heap_peak - run.heap_start);
+    }
+
+    nautilus_file_get_deep_counts (file, &directory_count, &file_count, NULL, NULL, TRUE);
+    if (file_count != (guint) n_files || directory_count + 1 != n_folders)
+    {
+        g_printerr ("Counted %u files and %u folders, instead of %d and %u\n",
+                    file_count, directory_count, n_files, n_folders - 1);
+    }
+
+    bench_report (results, snapshot, group, "count-ms", best_ms);
+    bench_report (results, snapshot, group, "files-per-second", n_files / (best_ms / 1000));
+    bench_report (results, snapshot, group, "peak-rss-kb", bench_get_peak_rss_kb ());
+    bench_report (results, snapshot, group, "counting-heap-kb", heap_peak / 1024.0);
+
+    nautilus_file_unref (file);
+    g_main_loop_unref (run.loop);
+
+    bench_delete_tree (tmp_dir);
+
+    if (!bench_save_results (results, save_path))
+    {
+        return 1;
+    }
+
+    return 0;
+}
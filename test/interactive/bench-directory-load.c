@@ -0,0 +1,293 @@
+/* Times opening a generated directory the way the views do: monitoring
+ * its files with the attributes they ask for, until the first files are
+ * added, until done-loading, and until all the attributes are ready.
+ * Then it loads the directory again, when every name enumerated is looked
+ * up among the files already there.
+ *
+ *   bench-directory-load [--files=N] [--shape=SHAPE] [--save=FILE] [--compare=FILE]
+ *
+ * The shapes are "photos", long names of a single type; "mixed", short
+ * names of many types with some hidden files and folders; and "folders",
+ * folders of a few files each, whose items get counted.
+ *
+ * The results can be saved to a key file, and a later run compared with
+ * it, so that the changes to the directory loading can be measured.
+ * Peak RSS is the peak of the whole process so far. The heap bytes per
+ * file are the ones still in use once loaded, where glibc tells them.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include <src/nautilus-directory.h>
+#include <src/nautilus-file.h>
+#include <src/nautilus-file-utilities.h>
+#include <src/nautilus-global-preferences.h>
+
+#include "bench-common.h"
+
+#define DEFAULT_N_FILES 200000
+#define N_RELOADS 5
+#define FILES_PER_FOLDER 4
+
+/* The attributes of the files view, see nautilus_files_view_load_location() */
+#define VIEW_ATTRIBUTES (NAUTILUS_FILE_ATTRIBUTES_FOR_ICON | \
+                         NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT | \
+                         NAUTILUS_FILE_ATTRIBUTE_INFO | \
+                         NAUTILUS_FILE_ATTRIBUTE_MOUNT | \
+                         NAUTILUS_FILE_ATTRIBUTE_EXTENSION_INFO | \
+                         NAUTILUS_FILE_ATTRIBUTE_EXTENDED_INFO)
+
+static const char *extensions[] =
+{
+    ".c", ".h", ".txt", ".png", ".jpg", ".pdf", ".odt", ".tar.gz", ".mp3", "",
+};
+
+typedef struct
+{
+    GMainLoop *loop;
+    gint64 start_time;
+    gint64 first_batch_time;
+    gint64 done_loading_time;
+    gint64 ready_time;
+    gboolean ready;
+} LoadRun;
+
+static void
+create_file (const char *directory,
+             const char *name)
+{
+    g_autofree char *path = g_build_filename (directory, name, NULL);
+
+    g_file_set_contents (path, "", 0, NULL);
+}
+
+static void
+generate_directory (const char *path,
+                    const char *shape,
+                    guint       n_files)
+{
+    g_autoptr (GRand) rand = NULL;
+
+    /* Always the same names, so that runs can be compared */
+    rand = g_rand_new_with_seed (42);
+
+    for (guint i = 0; i < n_files; i++)
+    {
+        g_autofree char *name = NULL;
+
+        if (g_strcmp0 (shape, "mixed") == 0)
+        {
+            guint kind = g_rand_int_range (rand, 0, 20);
+
+            name = g_strdup_printf ("%s%x%s",
+                                    kind == 0 ? "." : "",
+                                    g_rand_int (rand),
+                                    kind == 1 ? "" : extensions[g_rand_int_range (rand, 0, G_N_ELEMENTS (extensions))]);
+            if (kind == 1)
+            {
+                g_autofree char *folder = g_build_filename (path, name, NULL);
+
+                g_mkdir (folder, 0755);
+                continue;
+            }
+        }
+        else if (g_strcmp0 (shape, "folders") == 0)
+        {
+            g_autofree char *folder = NULL;
+
+            name = g_strdup_printf ("Folder %06u", i);
+            folder = g_build_filename (path, name, NULL);
+            g_mkdir (folder, 0755);
+            for (guint j = 0; j < FILES_PER_FOLDER; j++)
+            {
+                g_autofree char *child = g_strdup_printf ("file %u.txt", j);
+
+                create_file (folder, child);
+            }
+            continue;
+        }
+        else
+        {
+            name = g_strdup_printf ("Screenshot from 2019-%02u-%02u %06u.png",
+                                    g_rand_int_range (rand, 1, 13),
+                                    g_rand_int_range (rand, 1, 29),
+                                    i);
+        }
+
+        create_file (path, name);
+    }
+}
+
+static void
+files_added (NautilusDirectory *directory,
+             GList             *files,
+             LoadRun           *run)
+{
+    if (run->first_batch_time == 0)
+    {
+        run->first_batch_time = g_get_monotonic_time ();
+    }
+}
+
+static void
+maybe_quit (LoadRun *run)
+{
+    if (run->done_loading_time != 0 && run->ready)
+    {
+        g_main_loop_quit (run->loop);
+    }
+}
+
+static void
+done_loading (NautilusDirectory *directory,
+              LoadRun           *run)
+{
+    run->done_loading_time = g_get_monotonic_time ();
+    maybe_quit (run);
+}
+
+static void
+attributes_ready (NautilusDirectory *directory,
+                  GList             *files,
+                  gpointer           callback_data)
+{
+    LoadRun *run = callback_data;
+
+    run->ready_time = g_get_monotonic_time ();
+    run->ready = TRUE;
+    maybe_quit (run);
+}
+
+static void
+run_load (NautilusDirectory *directory,
+          LoadRun           *run,
+          gboolean           reload)
+{
+    run->first_batch_time = 0;
+    run->done_loading_time = 0;
+    run->ready = FALSE;
+
+    run->start_time = g_get_monotonic_time ();
+    if (reload)
+    {
+        nautilus_directory_force_reload (directory);
+    }
+    else
+    {
+        nautilus_directory_file_monitor_add (directory, run, FALSE,
+                                             VIEW_ATTRIBUTES,
+                                             NULL, NULL);
+    }
+    nautilus_directory_call_when_ready (directory, VIEW_ATTRIBUTES, TRUE,
+                                        attributes_ready, run);
+    g_main_loop_run (run->loop);
+}
+
+static gdouble
+ms_since_start (LoadRun *run,
+                gint64   time)
+{
+    return time != 0 ? (time - run->start_time) / 1000.0 : 0;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gint n_files = DEFAULT_N_FILES;
+    g_autofree char *shape = NULL;
+    g_autofree char *save_path = NULL;
+    g_autofree char *compare_path = NULL;
+    GOptionEntry entries[] =
+    {
+        { "files", 0, 0, G_OPTION_ARG_INT, &n_files, "Number of files", "N" },
+        { "shape", 0, 0, G_OPTION_ARG_STRING, &shape, "photos, mixed or folders", "SHAPE" },
+        { "save", 0, 0, G_OPTION_ARG_FILENAME, &save_path, "Save the results to FILE", "FILE" },
+        { "compare", 0, 0, G_OPTION_ARG_FILENAME, &compare_path, "Compare with the results saved in FILE", "FILE" },
+        { NULL }
+    };
+    g_autoptr (GOptionContext) context = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autoptr (GKeyFile) results = NULL;
+    g_autoptr (GKeyFile) snapshot = NULL;
+    g_autofree char *tmp_dir = NULL;
+    g_autofree char *group = NULL;
+    g_autoptr (GFile) location = NULL;
+    NautilusDirectory *directory;
+    LoadRun run = { 0 };
+    gdouble best_reload_ms;
+    gsize heap_bytes;
+
+    context = g_option_context_new (NULL);
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error) || n_files <= 0)
+    {
+        g_printerr ("%s\n", error != NULL ? error->message : "Invalid number of files");
+        return 1;
+    }
+    if (shape == NULL)
+    {
+        shape = g_strdup ("photos");
+    }
+
+    snapshot = bench_load_snapshot (compare_path);
+    if (snapshot == NULL)
+    {
+        return 1;
+    }
+    results = g_key_file_new ();
+
+    tmp_dir = g_dir_make_tmp ("nautilus-bench-XXXXXX", &error);
+    if (tmp_dir == NULL)
+    {
+        g_printerr ("%s\n", error->message);
+        return 1;
+    }
+
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    generate_directory (tmp_dir, shape, n_files);
+    group = g_strdup_printf ("%s %d", shape, n_files);
+    g_print ("%s:\n", group);
+
+    run.loop = g_main_loop_new (NULL, FALSE);
+    location = g_file_new_for_path (tmp_dir);
+    directory = nautilus_directory_get (location);
+    g_signal_connect (directory, "files-added", G_CALLBACK (files_added), &run);
+    g_signal_connect (directory, "done-loading", G_CALLBACK (done_loading), &run);
+
+    heap_bytes = bench_get_heap_bytes ();
+    run_load (directory, &run, FALSE);
+    heap_bytes = bench_get_heap_bytes () - heap_bytes;
+
+    bench_report (results, snapshot, group, "first-batch-ms", ms_since_start (&run, run.first_batch_time));
+    bench_report (results, snapshot, group, "done-loading-ms", ms_since_start (&run, run.done_loading_time));
+    bench_report (results, snapshot, group, "ready-ms", ms_since_start (&run, run.ready_time));
+    bench_report (results, snapshot, group, "peak-rss-kb", bench_get_peak_rss_kb ());
+    bench_report (results, snapshot, group, "heap-bytes-per-file", (gdouble) heap_bytes / n_files);
+
+    /* Keep the best reload, to leave out the noise */
+    best_reload_ms = G_MAXDOUBLE;
+    for (guint i = 0; i < N_RELOADS; i++)
+    {
+        run_load (directory, &run, TRUE);
+        best_reload_ms = MIN (best_reload_ms, ms_since_start (&run, run.done_loading_time));
+    }
+    bench_report (results, snapshot, group, "reload-ms", best_reload_ms);
+
+    nautilus_directory_file_monitor_remove (directory, &run);
+    nautilus_directory_unref (directory);
+    g_main_loop_unref (run.loop);
+
+    bench_delete_tree (tmp_dir);
+
+    if (!bench_save_results (results, save_path))
+    {
+        return 1;
+    }
+
+    return 0;
+}
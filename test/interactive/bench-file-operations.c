@@ -0,0 +1,532 @@
+/* Times copying, moving, trashing and deleting generated trees, through
+ * the synchronous file operations.
+ *
+ *   bench-file-operations [--files=N] [--huge-files=N] [--huge-size=MB]
+ *                         [--depth=N] [--save=FILE] [--compare=FILE]
+ *                         [--max-regression=PERCENT]
+ *
+ * The results can be saved to a key file, and a later run compared with
+ * it, as with bench-search-engines. With --max-regression, the exit status
+ * is 2 when a time got worse than that compared with the saved run, so
+ * that it can guard a CI job. The system calls are those the kernel counts
+ * in /proc/self/io, so only on Linux.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <src/nautilus-file-operations.h>
+#include <src/nautilus-file-undo-manager.h>
+#include <src/nautilus-file-utilities.h>
+#include <src/nautilus-global-preferences.h>
+
+#include "bench-common.h"
+
+#define DEFAULT_N_FILES 10000
+#define DEFAULT_N_HUGE_FILES 2
+#define DEFAULT_HUGE_SIZE_MB 256
+#define DEFAULT_DEPTH 100
+/* The files of the trees other than the huge one */
+#define SMALL_FILE_SIZE 512
+#define FILES_PER_DIRECTORY 100
+
+typedef struct
+{
+    guint n_files;
+    goffset size;
+} Tree;
+
+typedef struct
+{
+    gint64 read_syscalls;
+    gint64 write_syscalls;
+    gint64 read_bytes;
+    gint64 write_bytes;
+} IoCounters;
+
+static gboolean
+get_io_counters (IoCounters *counters)
+{
+    g_autofree char *contents = NULL;
+    g_auto (GStrv) lines = NULL;
+
+    memset (counters, 0, sizeof (IoCounters));
+    if (!g_file_get_contents ("/proc/self/io", &contents, NULL, NULL))
+    {
+        return FALSE;
+    }
+
+    lines = g_strsplit (contents, "\n", -1);
+    for (guint i = 0; lines[i] != NULL; i++)
+    {
+        const char *value = strchr (lines[i], ':');
+
+        if (value == NULL)
+        {
+            continue;
+        }
+        if (g_str_has_prefix (lines[i], "syscr:"))
+        {
+            counters->read_syscalls = g_ascii_strtoll (value + 1, NULL, 10);
+        }
+        else if (g_str_has_prefix (lines[i], "syscw:"))
+        {
+            counters->write_syscalls = g_ascii_strtoll (value + 1, NULL, 10);
+        }
+        else if (g_str_has_prefix (lines[i], "read_bytes:"))
+        {
+            counters->read_bytes = g_ascii_strtoll (value + 1, NULL, 10);
+        }
+        else if (g_str_has_prefix (lines[i], "write_bytes:"))
+        {
+            counters->write_bytes = g_ascii_strtoll (value + 1, NULL, 10);
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+create_file (const char *path,
+             goffset     size,
+             Tree       *tree)
+{
+    static char block[64 * 1024];
+    goffset written;
+    FILE *file;
+
+    file = fopen (path, "w");
+    if (file == NULL)
+    {
+        g_printerr ("Failed to create %s\n", path);
+        return;
+    }
+
+    /* Not zeros, so that no filesystem gets smart about them */
+    memset (block, 'n', sizeof (block));
+    for (written = 0; written < size; written += sizeof (block))
+    {
+        fwrite (block, 1, MIN ((goffset) sizeof (block), size - written), file);
+    }
+    fclose (file);
+
+    tree->n_files++;
+    tree->size += size;
+}
+
+/* Lots of small files, a hundred in each directory */
+static void
+generate_tiny_tree (const char *root,
+                    guint       n_files,
+                    guint       n_huge_files,
+                    goffset     huge_size,
+                    guint       depth,
+                    Tree       *tree)
+{
+    for (guint i = 0; i * FILES_PER_DIRECTORY < n_files; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *directory = NULL;
+
+        name = g_strdup_printf ("folder %u", i);
+        directory = g_build_filename (root, name, NULL);
+        g_mkdir (directory, 0755);
+
+        for (guint j = 0; j < FILES_PER_DIRECTORY && i * FILES_PER_DIRECTORY + j < n_files; j++)
+        {
+            g_autofree char *file_name = NULL;
+            g_autofree char *path = NULL;
+
+            file_name = g_strdup_printf ("file %u.txt", j);
+            path = g_build_filename (directory, file_name, NULL);
+            create_file (path, SMALL_FILE_SIZE, tree);
+        }
+    }
+}
+
+/* A few big files */
+static void
+generate_huge_tree (const char *root,
+                    guint       n_files,
+                    guint       n_huge_files,
+                    goffset     huge_size,
+                    guint       depth,
+                    Tree       *tree)
+{
+    for (guint i = 0; i < n_huge_files; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *path = NULL;
+
+        name = g_strdup_printf ("image %u.iso", i);
+        path = g_build_filename (root, name, NULL);
+        create_file (path, huge_size, tree);
+    }
+}
+
+/* A long chain of directories, with the files spread along it */
+static void
+generate_deep_tree (const char *root,
+                    guint       n_files,
+                    guint       n_huge_files,
+                    goffset     huge_size,
+                    guint       depth,
+                    Tree       *tree)
+{
+    g_autofree char *directory = NULL;
+
+    directory = g_strdup (root);
+    for (guint i = 0; i < depth; i++)
+    {
+        char *child;
+
+        child = g_build_filename (directory, "level", NULL);
+        g_mkdir (child, 0755);
+        g_free (directory);
+        directory = child;
+
+        for (guint j = 0; j < n_files / depth; j++)
+        {
+            g_autofree char *file_name = NULL;
+            g_autofree char *path = NULL;
+
+            file_name = g_strdup_printf ("file %u.txt", j);
+            path = g_build_filename (directory, file_name, NULL);
+            create_file (path, SMALL_FILE_SIZE, tree);
+        }
+    }
+}
+
+/* Small files, each linked from a few places */
+static void
+generate_hardlinks_tree (const char *root,
+                         guint       n_files,
+                         guint       n_huge_files,
+                         goffset     huge_size,
+                         guint       depth,
+                         Tree       *tree)
+{
+    g_autofree char *targets = NULL;
+
+    targets = g_build_filename (root, "targets", NULL);
+    g_mkdir (targets, 0755);
+
+    for (guint i = 0; i < n_files / 4; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *target = NULL;
+
+        name = g_strdup_printf ("file %u.txt", i);
+        target = g_build_filename (targets, name, NULL);
+        create_file (target, SMALL_FILE_SIZE, tree);
+
+        for (guint j = 0; j < 3; j++)
+        {
+            g_autofree char *link_directory_name = NULL;
+            g_autofree char *link_directory = NULL;
+            g_autofree char *path = NULL;
+
+            link_directory_name = g_strdup_printf ("links %u", j);
+            link_directory = g_build_filename (root, link_directory_name, NULL);
+            g_mkdir (link_directory, 0755);
+            path = g_build_filename (link_directory, name, NULL);
+            if (link (target, path) == 0)
+            {
+                tree->n_files++;
+                tree->size += SMALL_FILE_SIZE;
+            }
+        }
+    }
+}
+
+/* The children of @path, which are what is handed to the operations */
+static GList *
+list_children (const char *path)
+{
+    g_autoptr (GDir) dir = NULL;
+    const char *name;
+    GList *files = NULL;
+
+    dir = g_dir_open (path, 0, NULL);
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL)
+    {
+        g_autofree char *child = g_build_filename (path, name, NULL);
+
+        files = g_list_prepend (files, g_file_new_for_path (child));
+    }
+
+    return files;
+}
+
+typedef enum
+{
+    OPERATION_COPY,
+    OPERATION_MOVE,
+    OPERATION_TRASH_OR_DELETE,
+    OPERATION_DELETE,
+} Operation;
+
+static const char *operation_names[] =
+{
+    "copy", "move", "trash-or-delete", "delete",
+};
+
+/* Runs @operation on the children of @source, into @destination for the
+ * copies and moves, and returns whether it didn't regress. */
+static gboolean
+run_operation (const char *tree_name,
+               const Tree *tree,
+               Operation   operation,
+               const char *source,
+               const char *destination,
+               GKeyFile   *results,
+               GKeyFile   *snapshot,
+               gdouble     max_regression)
+{
+    g_autolist (GFile) files = NULL;
+    g_autoptr (GFile) destination_dir = NULL;
+    g_autofree char *group = NULL;
+    IoCounters before, after;
+    gboolean has_counters;
+    gint64 start_time;
+    gdouble total_ms, files_per_second, mb_per_second;
+    gboolean ok;
+
+    files = list_children (source);
+    if (destination != NULL)
+    {
+        g_mkdir (destination, 0755);
+        destination_dir = g_file_new_for_path (destination);
+    }
+
+    has_counters = get_io_counters (&before);
+    start_time = g_get_monotonic_time ();
+
+    switch (operation)
+    {
+        case OPERATION_COPY:
+        {
+            nautilus_file_operations_copy_sync (files, destination_dir);
+        }
+        break;
+
+        case OPERATION_MOVE:
+        {
+            nautilus_file_operations_move_sync (files, destination_dir);
+        }
+        break;
+
+        case OPERATION_TRASH_OR_DELETE:
+        {
+            nautilus_file_operations_trash_or_delete_sync (files);
+        }
+        break;
+
+        case OPERATION_DELETE:
+        {
+            nautilus_file_operations_delete_sync (files);
+        }
+        break;
+    }
+
+    total_ms = (g_get_monotonic_time () - start_time) / 1000.0;
+    has_counters = has_counters && get_io_counters (&after);
+
+    files_per_second = total_ms > 0 ? tree->n_files * 1000.0 / total_ms : 0;
+    mb_per_second = total_ms > 0 ? tree->size / (1024.0 * 1024.0) * 1000.0 / total_ms : 0;
+
+    group = g_strdup_printf ("%s %s", tree_name, operation_names[operation]);
+    g_print ("%s: %u files, %" G_GOFFSET_FORMAT " bytes\n", group, tree->n_files, tree->size);
+    ok = bench_report_with_limit (results, snapshot, group, "total-ms", total_ms, max_regression);
+    bench_report (results, snapshot, group, "files-per-second", files_per_second);
+    bench_report (results, snapshot, group, "mb-per-second", mb_per_second);
+
+    if (has_counters)
+    {
+        struct
+        {
+            const char *key;
+            gint64 value;
+        } counters[] =
+        {
+            { "read-syscalls", after.read_syscalls - before.read_syscalls },
+            { "write-syscalls", after.write_syscalls - before.write_syscalls },
+            { "disk-read-mb", (after.read_bytes - before.read_bytes) / (1024 * 1024) },
+            { "disk-write-mb", (after.write_bytes - before.write_bytes) / (1024 * 1024) },
+        };
+
+        for (guint i = 0; i < G_N_ELEMENTS (counters); i++)
+        {
+            bench_report (results, snapshot, group, counters[i].key, counters[i].value);
+        }
+    }
+
+    return ok;
+}
+
+/* Copies the tree, moves the copy, trashes what was moved, and deletes
+ * another copy. Returns whether nothing regressed. */
+static gboolean
+run_tree (const char *tree_name,
+          const Tree *tree,
+          const char *source,
+          const char *work_dir,
+          GKeyFile   *results,
+          GKeyFile   *snapshot,
+          gdouble     max_regression)
+{
+    g_autofree char *copied = NULL;
+    g_autofree char *moved = NULL;
+    g_autofree char *deleted = NULL;
+    g_autoptr (GKeyFile) untimed = NULL;
+    gboolean ok = TRUE;
+
+    copied = g_build_filename (work_dir, "copied", NULL);
+    moved = g_build_filename (work_dir, "moved", NULL);
+    deleted = g_build_filename (work_dir, "deleted", NULL);
+
+    /* Flushed, so that the copy doesn't pay for writing the tree back */
+    sync ();
+
+    ok &= run_operation (tree_name, tree, OPERATION_COPY, source, copied,
+                         results, snapshot, max_regression);
+    ok &= run_operation (tree_name, tree, OPERATION_MOVE, copied, moved,
+                         results, snapshot, max_regression);
+    ok &= run_operation (tree_name, tree, OPERATION_TRASH_OR_DELETE, moved, NULL,
+                         results, snapshot, max_regression);
+
+    /* Not timed, only there to be deleted */
+    untimed = g_key_file_new ();
+    run_operation (tree_name, tree, OPERATION_COPY, source, deleted,
+                   untimed, untimed, 0);
+    ok &= run_operation (tree_name, tree, OPERATION_DELETE, deleted, NULL,
+                         results, snapshot, max_regression);
+
+    bench_delete_tree (copied);
+    bench_delete_tree (moved);
+    bench_delete_tree (deleted);
+
+    return ok;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gint n_files = DEFAULT_N_FILES;
+    gint n_huge_files = DEFAULT_N_HUGE_FILES;
+    gint huge_size_mb = DEFAULT_HUGE_SIZE_MB;
+    gint depth = DEFAULT_DEPTH;
+    gdouble max_regression = 0;
+    g_autofree char *save_path = NULL;
+    g_autofree char *compare_path = NULL;
+    GOptionEntry entries[] =
+    {
+        { "files", 0, 0, G_OPTION_ARG_INT, &n_files, "Number of files of the tiny, deep and hardlinks trees", "N" },
+        { "huge-files", 0, 0, G_OPTION_ARG_INT, &n_huge_files, "Number of files of the huge tree", "N" },
+        { "huge-size", 0, 0, G_OPTION_ARG_INT, &huge_size_mb, "Size of the files of the huge tree", "MB" },
+        { "depth", 0, 0, G_OPTION_ARG_INT, &depth, "Depth of the deep tree", "N" },
+        { "save", 0, 0, G_OPTION_ARG_FILENAME, &save_path, "Save the results to FILE", "FILE" },
+        { "compare", 0, 0, G_OPTION_ARG_FILENAME, &compare_path, "Compare with the results saved in FILE", "FILE" },
+        { "max-regression", 0, 0, G_OPTION_ARG_DOUBLE, &max_regression, "Fail when a time is more than PERCENT worse than in the compared results", "PERCENT" },
+        { NULL }
+    };
+    g_autoptr (GOptionContext) context = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autoptr (GKeyFile) results = NULL;
+    g_autoptr (GKeyFile) snapshot = NULL;
+    g_autoptr (NautilusFileUndoManager) undo_manager = NULL;
+    g_autofree char *tmp_dir = NULL;
+    g_autofree char *data_dir = NULL;
+    g_autofree char *cache_dir = NULL;
+    gboolean ok = TRUE;
+    struct
+    {
+        const char *name;
+        void (*generate) (const char *root,
+                          guint       n_files,
+                          guint       n_huge_files,
+                          goffset     huge_size,
+                          guint       depth,
+                          Tree       *tree);
+    } trees[] =
+    {
+        { "tiny", generate_tiny_tree },
+        { "huge", generate_huge_tree },
+        { "deep", generate_deep_tree },
+        { "hardlinks", generate_hardlinks_tree },
+    };
+
+    context = g_option_context_new (NULL);
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error) ||
+        n_files <= 0 || n_huge_files < 0 || huge_size_mb < 0 || depth <= 0)
+    {
+        g_printerr ("%s\n", error != NULL ? error->message : "Invalid tree shape");
+        return 1;
+    }
+
+    snapshot = bench_load_snapshot (compare_path);
+    if (snapshot == NULL)
+    {
+        return 1;
+    }
+    results = g_key_file_new ();
+
+    /* In the home directory rather than in /tmp, which may well be in
+     * memory and have no trash. */
+    tmp_dir = g_build_filename (g_get_home_dir (), ".nautilus-bench-XXXXXX", NULL);
+    if (g_mkdtemp (tmp_dir) == NULL)
+    {
+        g_printerr ("Failed to create %s\n", tmp_dir);
+        return 1;
+    }
+
+    /* Keep the trash and the copy journals of the benchmark away from the
+     * ones of the user. */
+    data_dir = g_build_filename (tmp_dir, "data", NULL);
+    cache_dir = g_build_filename (tmp_dir, "cache", NULL);
+    g_mkdir (data_dir, 0700);
+    g_mkdir (cache_dir, 0700);
+    g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    undo_manager = nautilus_file_undo_manager_new ();
+    nautilus_ensure_extension_points ();
+    nautilus_global_preferences_init ();
+
+    for (guint i = 0; i < G_N_ELEMENTS (trees); i++)
+    {
+        g_autofree char *root = NULL;
+        g_autofree char *work_dir = NULL;
+        Tree tree = { 0 };
+
+        root = g_build_filename (tmp_dir, trees[i].name, NULL);
+        work_dir = g_build_filename (tmp_dir, "work", NULL);
+        g_mkdir (root, 0755);
+        g_mkdir (work_dir, 0755);
+
+        trees[i].generate (root, n_files, n_huge_files,
+                           (goffset) huge_size_mb * 1024 * 1024, depth, &tree);
+        g_print ("Generated the %s tree with %u files\n", trees[i].name, tree.n_files);
+
+        ok &= run_tree (trees[i].name, &tree, root, work_dir,
+                        results, snapshot, max_regression);
+
+        bench_delete_tree (root);
+        bench_delete_tree (work_dir);
+        bench_delete_tree (data_dir);
+        g_mkdir (data_dir, 0700);
+    }
+
+    bench_delete_tree (tmp_dir);
+
+    if (!bench_save_results (results, save_path))
+    {
+        return 1;
+    }
+
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,169 @@
+/* Times the search query matcher over a generated corpus of file names,
+ * against normalizing every name as the matcher used to.
+ *
+ *   bench-query-matcher [number of names]
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include <src/nautilus-global-preferences.h>
+#include <src/nautilus-query.h>
+
+#define DEFAULT_N_NAMES 200000
+#define N_RUNS 5
+
+static const char *prefixes[] =
+{
+    "IMG_", "DSC", "Screenshot from ", "Report ", "invoice-", "Meeting notes ",
+    "backup_", "README", "main", "Résumé ", "Übersicht ", "draft ", "Copy of ",
+};
+
+static const char *words[] =
+{
+    "2019", "final", "v2", "Q3", "budget", "holiday", "photo", "project",
+    "Nautilus", "config", "old", "new", "scan", "März", "export",
+};
+
+static const char *extensions[] =
+{
+    ".jpg", ".JPG", ".png", ".pdf", ".docx", ".txt", ".c", ".h", ".tar.gz",
+    ".mp3", ".odt", "",
+};
+
+static char **
+generate_names (guint n_names)
+{
+    g_autoptr (GRand) rand = NULL;
+    GPtrArray *names;
+    guint i;
+
+    /* Always the same corpus, so that runs can be compared */
+    rand = g_rand_new_with_seed (42);
+    names = g_ptr_array_new ();
+
+    for (i = 0; i < n_names; i++)
+    {
+        g_ptr_array_add (names,
+                         g_strdup_printf ("%s%s %s %05u%s",
+                                          prefixes[g_rand_int_range (rand, 0, G_N_ELEMENTS (prefixes))],
+                                          words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+                                          words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+                                          g_rand_int_range (rand, 0, 100000),
+                                          extensions[g_rand_int_range (rand, 0, G_N_ELEMENTS (extensions))]));
+    }
+    g_ptr_array_add (names, NULL);
+
+    return (char **) g_ptr_array_free (names, FALSE);
+}
+
+/* What every name went through before the matcher */
+static gboolean
+legacy_match (char       **words_to_match,
+              const char  *name)
+{
+    g_autofree char *normalized = NULL;
+    g_autofree char *prepared = NULL;
+    guint i;
+
+    normalized = g_utf8_normalize (name, -1, G_NORMALIZE_NFD);
+    prepared = g_utf8_strdown (normalized, -1);
+
+    for (i = 0; words_to_match[i] != NULL; i++)
+    {
+        if (strstr (prepared, words_to_match[i]) == NULL)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+run_query (char       **names,
+           guint        n_names,
+           const char  *text)
+{
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+    g_auto (GStrv) legacy_words = NULL;
+    g_autofree char *normalized_text = NULL;
+    g_autofree char *lowered_text = NULL;
+    gint64 start, matcher_time, legacy_time;
+    guint matcher_hits, legacy_hits;
+    guint run, i;
+
+    query = nautilus_query_new ();
+    nautilus_query_set_text (query, text);
+    matcher = nautilus_query_get_matcher (query);
+
+    normalized_text = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+    lowered_text = g_utf8_strdown (normalized_text, -1);
+    legacy_words = g_strsplit (lowered_text, " ", -1);
+
+    matcher_time = G_MAXINT64;
+    legacy_time = G_MAXINT64;
+    matcher_hits = 0;
+    legacy_hits = 0;
+
+    /* Keep the best run of each, to leave out the noise */
+    for (run = 0; run < N_RUNS; run++)
+    {
+        start = g_get_monotonic_time ();
+        matcher_hits = 0;
+        for (i = 0; i < n_names; i++)
+        {
+            if (nautilus_query_matcher_match (matcher, names[i]) > -1)
+            {
+                matcher_hits++;
+            }
+        }
+        matcher_time = MIN (matcher_time, g_get_monotonic_time () - start);
+
+        start = g_get_monotonic_time ();
+        legacy_hits = 0;
+        for (i = 0; i < n_names; i++)
+        {
+            if (legacy_match (legacy_words, names[i]))
+            {
+                legacy_hits++;
+            }
+        }
+        legacy_time = MIN (legacy_time, g_get_monotonic_time () - start);
+    }
+
+    g_print ("%-20s %8u hits  matcher %7.1f ns/name  normalizing %7.1f ns/name%s\n",
+             text, matcher_hits,
+             (double) matcher_time * 1000 / n_names,
+             (double) legacy_time * 1000 / n_names,
+             matcher_hits != legacy_hits ? "  (hits differ!)" : "");
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_auto (GStrv) names = NULL;
+    guint n_names;
+
+    n_names = argc > 1 ? (guint) g_ascii_strtoull (argv[1], NULL, 10) : DEFAULT_N_NAMES;
+    if (n_names == 0)
+    {
+        g_printerr ("Usage: %s [number of names]\n", argv[0]);
+        return 1;
+    }
+
+    /* Needed for nautilus-query.c. */
+    nautilus_global_preferences_init ();
+
+    names = generate_names (n_names);
+
+    run_query (names, n_names, "photo");
+    run_query (names, n_names, "IMG 2019");
+    run_query (names, n_names, "final report .pdf");
+    run_query (names, n_names, "résumé");
+    run_query (names, n_names, "zzz");
+
+    return 0;
+}
@@ -0,0 +1,429 @@
+/* Times the simple, model and recent search engines on generated trees,
+ * through NautilusSearchEngine as the views use them.
+ *
+ *   bench-search-engines [--files=N] [--save=FILE] [--compare=FILE]
+ *
+ * The results can be saved to a key file, and a later run compared with
+ * it, so that regressions show up as the relative change of each number.
+ * Peak RSS is the peak of the whole process so far, so it only grows
+ * from one run to the next.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <src/nautilus-directory.h>
+#include <src/nautilus-file-utilities.h>
+#include <src/nautilus-global-preferences.h>
+#include <src/nautilus-search-engine.h>
+#include <src/nautilus-search-engine-model.h>
+
+#include "bench-common.h"
+
+#define DEFAULT_N_FILES 20000
+#define N_RECENT_FILES 500
+
+static const char *ascii_words[] =
+{
+    "report", "photo", "IMG", "budget", "notes", "backup", "draft", "final",
+    "config", "export", "scan", "project",
+};
+
+static const char *unicode_words[] =
+{
+    "Résumé", "Übersicht", "März", "Ελληνικά", "日本語", "Привет", "café",
+    "naïve",
+};
+
+static const char *queries[] =
+{
+    "report",
+    "final 2019",
+    "résumé",
+    "zzzz",
+};
+
+typedef struct
+{
+    GMainLoop *loop;
+    gint64 start_time;
+    gint64 first_hit_time;
+    gint64 end_time;
+    guint n_hits;
+} Run;
+
+static void
+hits_added_cb (NautilusSearchEngine *engine,
+               GList                *hits,
+               Run                  *run)
+{
+    if (run->n_hits == 0)
+    {
+        run->first_hit_time = g_get_monotonic_time ();
+    }
+    run->n_hits += g_list_length (hits);
+}
+
+static void
+finished_cb (NautilusSearchEngine         *engine,
+             NautilusSearchProviderStatus  status,
+             Run                          *run)
+{
+    run->end_time = g_get_monotonic_time ();
+    g_main_loop_quit (run->loop);
+}
+
+static char *
+generate_name (GRand      *rand,
+               gboolean    unicode,
+               const char *extension)
+{
+    const char *word;
+
+    word = unicode ?
+           unicode_words[g_rand_int_range (rand, 0, G_N_ELEMENTS (unicode_words))] :
+           ascii_words[g_rand_int_range (rand, 0, G_N_ELEMENTS (ascii_words))];
+
+    return g_strdup_printf ("%s %s %u %05u%s",
+                            word,
+                            ascii_words[g_rand_int_range (rand, 0, G_N_ELEMENTS (ascii_words))],
+                            g_rand_int_range (rand, 2010, 2025),
+                            g_rand_int_range (rand, 0, 100000),
+                            extension);
+}
+
+static void
+create_files (GRand      *rand,
+              const char *directory,
+              guint       n_files,
+              GPtrArray  *paths)
+{
+    for (guint i = 0; i < n_files; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *path = NULL;
+
+        /* One name out of four isn't ASCII */
+        name = generate_name (rand, g_rand_int_range (rand, 0, 4) == 0, ".txt");
+        path = g_build_filename (directory, name, NULL);
+        if (!g_file_set_contents (path, name, -1, NULL))
+        {
+            continue;
+        }
+
+        g_ptr_array_add (paths, g_steal_pointer (&path));
+    }
+}
+
+/* All the files in a single directory */
+static void
+generate_wide_tree (GRand      *rand,
+                    const char *root,
+                    guint       n_files,
+                    GPtrArray  *paths)
+{
+    create_files (rand, root, n_files, paths);
+}
+
+/* A few files in each directory of a tree four directories wide, with a
+ * long chain of single directories at the bottom. */
+static void
+generate_deep_directory (GRand      *rand,
+                         const char *directory,
+                         guint       depth,
+                         guint       n_files,
+                         GPtrArray  *paths)
+{
+    guint n_children;
+
+    n_children = depth < 4 ? 4 : 1;
+    create_files (rand, directory, MIN (n_files, 10), paths);
+    if (n_files <= 10 || depth > 200)
+    {
+        return;
+    }
+    n_files -= MIN (n_files, 10);
+
+    for (guint i = 0; i < n_children; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *path = NULL;
+
+        name = generate_name (rand, i % 2 == 1, "");
+        path = g_build_filename (directory, name, NULL);
+        if (g_mkdir (path, 0755) != 0)
+        {
+            continue;
+        }
+
+        generate_deep_directory (rand, path, depth + 1, n_files / n_children, paths);
+    }
+}
+
+static void
+generate_deep_tree (GRand      *rand,
+                    const char *root,
+                    guint       n_files,
+                    GPtrArray  *paths)
+{
+    generate_deep_directory (rand, root, 0, n_files, paths);
+}
+
+/* A tree whose files are mostly hard links to each other, with symbolic
+ * links looping back to its parents. */
+static void
+generate_links_tree (GRand      *rand,
+                     const char *root,
+                     guint       n_files,
+                     GPtrArray  *paths)
+{
+    g_autofree char *target = NULL;
+    g_autofree char *loop = NULL;
+
+    target = g_build_filename (root, "report target.txt", NULL);
+    g_file_set_contents (target, "", -1, NULL);
+    g_ptr_array_add (paths, g_strdup (target));
+
+    for (guint i = 0; i < 10; i++)
+    {
+        g_autofree char *name = NULL;
+        g_autofree char *directory = NULL;
+        g_autofree char *parent_loop = NULL;
+        g_autofree char *root_loop = NULL;
+
+        name = g_strdup_printf ("links %u", i);
+        directory = g_build_filename (root, name, NULL);
+        if (g_mkdir (directory, 0755) != 0)
+        {
+            continue;
+        }
+
+        parent_loop = g_build_filename (directory, "parent loop", NULL);
+        root_loop = g_build_filename (directory, "root loop", NULL);
+        if (symlink ("..", parent_loop) != 0 || symlink (root, root_loop) != 0)
+        {
+            g_printerr ("Failed to create symbolic links in %s\n", directory);
+        }
+
+        for (guint j = 0; j < n_files / 10; j++)
+        {
+            g_autofree char *link_name = NULL;
+            g_autofree char *path = NULL;
+
+            link_name = generate_name (rand, j % 4 == 0, ".txt");
+            path = g_build_filename (directory, link_name, NULL);
+            if (link (target, path) == 0)
+            {
+                g_ptr_array_add (paths, g_steal_pointer (&path));
+            }
+        }
+    }
+
+    loop = g_build_filename (root, "self loop", NULL);
+    if (symlink (".", loop) != 0)
+    {
+        g_printerr ("Failed to create symbolic link %s\n", loop);
+    }
+}
+
+static void
+add_recent_files (GPtrArray *paths)
+{
+    GtkRecentManager *manager;
+
+    manager = gtk_recent_manager_get_default ();
+    for (guint i = 0; i < paths->len && i < N_RECENT_FILES; i++)
+    {
+        g_autofree char *uri = NULL;
+
+        uri = g_filename_to_uri (g_ptr_array_index (paths, i * paths->len / N_RECENT_FILES), NULL, NULL);
+        gtk_recent_manager_add_item (manager, uri);
+    }
+}
+
+static void
+run_engine (const char                 *tree_name,
+            GFile                      *root,
+            NautilusSearchEngineTarget  target,
+            const char                 *engine_name,
+            const char                 *text,
+            GKeyFile                   *results,
+            GKeyFile                   *snapshot)
+{
+    g_autoptr (NautilusSearchEngine) engine = NULL;
+    g_autoptr (NautilusQuery) query = NULL;
+    g_autoptr (NautilusDirectory) directory = NULL;
+    g_autofree char *group = NULL;
+    Run run = { 0 };
+    gdouble total_ms, first_hit_ms, hits_per_second;
+    glong peak_rss_kb;
+
+    run.loop = g_main_loop_new (NULL, FALSE);
+
+    engine = nautilus_search_engine_new ();
+    g_signal_connect (engine, "hits-added", G_CALLBACK (hits_added_cb), &run);
+    g_signal_connect (engine, "finished", G_CALLBACK (finished_cb), &run);
+
+    query = nautilus_query_new ();
+    nautilus_query_set_text (query, text);
+    nautilus_query_set_location (query, root);
+    nautilus_query_set_recursive (query, NAUTILUS_QUERY_RECURSIVE_ALWAYS);
+    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine), query);
+
+    if (target == NAUTILUS_SEARCH_ENGINE_MODEL_ENGINE)
+    {
+        directory = nautilus_directory_get (root);
+        nautilus_search_engine_model_set_model (nautilus_search_engine_get_model_provider (engine),
+                                                directory);
+    }
+
+    run.start_time = g_get_monotonic_time ();
+    nautilus_search_engine_start_by_target (NAUTILUS_SEARCH_PROVIDER (engine), target);
+    g_main_loop_run (run.loop);
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine));
+
+    total_ms = (run.end_time - run.start_time) / 1000.0;
+    first_hit_ms = run.n_hits > 0 ? (run.first_hit_time - run.start_time) / 1000.0 : total_ms;
+    hits_per_second = total_ms > 0 ? run.n_hits * 1000.0 / total_ms : 0;
+    peak_rss_kb = bench_get_peak_rss_kb ();
+
+    group = g_strdup_printf ("%s %s %s", tree_name, engine_name, text);
+    g_print ("%s: %u hits\n", group, run.n_hits);
+    g_key_file_set_integer (results, group, "hits", run.n_hits);
+    bench_report (results, snapshot, group, "first-hit-ms", first_hit_ms);
+    bench_report (results, snapshot, group, "total-ms", total_ms);
+    bench_report (results, snapshot, group, "hits-per-second", hits_per_second);
+    bench_report (results, snapshot, group, "peak-rss-kb", peak_rss_kb);
+
+    g_main_loop_unref (run.loop);
+}
+
+static void
+run_tree (const char *tree_name,
+          const char *root_path,
+          GKeyFile   *results,
+          GKeyFile   *snapshot)
+{
+    g_autoptr (GFile) root = NULL;
+
+    root = g_file_new_for_path (root_path);
+
+    for (guint i = 0; i < G_N_ELEMENTS (queries); i++)
+    {
+        /* Big crawls are turned into a filename index, which answers
+         * the second simple search. */
+        run_engine (tree_name, root, NAUTILUS_SEARCH_ENGINE_SIMPLE_ENGINE,
+                    "simple", queries[i], results, snapshot);
+        run_engine (tree_name, root, NAUTILUS_SEARCH_ENGINE_SIMPLE_ENGINE,
+                    "simple-again", queries[i], results, snapshot);
+        run_engine (tree_name, root, NAUTILUS_SEARCH_ENGINE_MODEL_ENGINE,
+                    "model", queries[i], results, snapshot);
+        run_engine (tree_name, root, NAUTILUS_SEARCH_ENGINE_RECENT_ENGINE,
+                    "recent", queries[i], results, snapshot);
+    }
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gint n_files = DEFAULT_N_FILES;
+    g_autofree char *save_path = NULL;
+    g_autofree char *compare_path = NULL;
+    GOptionEntry entries[] =
+    {
+        { "files", 0, 0, G_OPTION_ARG_INT, &n_files, "Number of files of each tree", "N" },
+        { "save", 0, 0, G_OPTION_ARG_FILENAME, &save_path, "Save the results to FILE", "FILE" },
+        { "compare", 0, 0, G_OPTION_ARG_FILENAME, &compare_path, "Compare with the results saved in FILE", "FILE" },
+        { NULL }
+    };
+    g_autoptr (GOptionContext) context = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autoptr (GKeyFile) results = NULL;
+    g_autoptr (GKeyFile) snapshot = NULL;
+    g_autoptr (GRand) rand = NULL;
+    g_autofree char *tmp_dir = NULL;
+    g_autofree char *data_dir = NULL;
+    g_autofree char *cache_dir = NULL;
+    struct
+    {
+        const char *name;
+        void (*generate) (GRand      *rand,
+                          const char *root,
+                          guint       n_files,
+                          GPtrArray  *paths);
+    } trees[] =
+    {
+        { "wide", generate_wide_tree },
+        { "deep", generate_deep_tree },
+        { "links", generate_links_tree },
+    };
+
+    context = g_option_context_new (NULL);
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error) || n_files <= 0)
+    {
+        g_printerr ("%s\n", error != NULL ? error->message : "Invalid number of files");
+        return 1;
+    }
+
+    snapshot = bench_load_snapshot (compare_path);
+    if (snapshot == NULL)
+    {
+        return 1;
+    }
+    results = g_key_file_new ();
+
+    tmp_dir = g_dir_make_tmp ("nautilus-bench-XXXXXX", &error);
+    if (tmp_dir == NULL)
+    {
+        g_printerr ("%s\n", error->message);
+        return 1;
+    }
+
+    /* Keep the recent files and the filename indexes of the benchmark
+     * away from the ones of the user. */
+    data_dir = g_build_filename (tmp_dir, "data", NULL);
+    cache_dir = g_build_filename (tmp_dir, "cache", NULL);
+    g_mkdir (data_dir, 0700);
+    g_mkdir (cache_dir, 0700);
+    g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    nautilus_ensure_extension_points ();
+    /* Needed for nautilus-query.c. */
+    nautilus_global_preferences_init ();
+
+    /* Always the same trees, so that runs can be compared */
+    rand = g_rand_new_with_seed (42);
+
+    for (guint i = 0; i < G_N_ELEMENTS (trees); i++)
+    {
+        g_autoptr (GPtrArray) paths = NULL;
+        g_autofree char *root = NULL;
+
+        root = g_build_filename (tmp_dir, trees[i].name, NULL);
+        g_mkdir (root, 0755);
+        paths = g_ptr_array_new_with_free_func (g_free);
+
+        trees[i].generate (rand, root, n_files, paths);
+        g_print ("Generated the %s tree with %u files\n", trees[i].name, paths->len);
+
+        add_recent_files (paths);
+        run_tree (trees[i].name, root, results, snapshot);
+
+        bench_delete_tree (root);
+    }
+
+    bench_delete_tree (tmp_dir);
+
+    if (!bench_save_results (results, save_path))
+    {
+        return 1;
+    }
+
+    return 0;
+}